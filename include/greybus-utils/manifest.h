@@ -33,6 +33,8 @@
 #include <zephyr/types.h>
 #include <zephyr/devicetree.h>
 
+struct gb_message;
+
 #define _GREYBUS_BASE_NODE DT_PATH(zephyr_greybus)
 
 #define _BUNDLE_PROP_LEN(node_id, cfg, prop)                                                       \
@@ -43,17 +45,49 @@
 	 _BUNDLE_PROP_LEN(node_id, CONFIG_GREYBUS_I2C, i2c_controllers) +                          \
 	 _BUNDLE_PROP_LEN(node_id, CONFIG_GREYBUS_SPI, spi_controllers) +                          \
 	 _BUNDLE_PROP_LEN(node_id, CONFIG_GREYBUS_UART, uart_controllers) +                        \
+	 _BUNDLE_PROP_LEN(node_id, CONFIG_GREYBUS_SDIO, sdio_controllers) +                        \
+	 _BUNDLE_PROP_LEN(node_id, CONFIG_GREYBUS_USB, usb_controllers) +                          \
 	 _BUNDLE_PROP_LEN(node_id, CONFIG_GREYBUS_PWM, pwm_controllers))
 
 #define _GREYBUS_CPORTS_IN_VIBRATOR_BUNDLE(_node_id)                                               \
 	_BUNDLE_PROP_LEN(_node_id, CONFIG_GREYBUS_VIBRATOR, vibrators)
 
-#define _GREYBUS_CPORT_COUNTER(_node_id)                                                           \
-	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_bridged_phy, okay),  \
-		    (_GREYBUS_CPORTS_IN_BRIDGED_PHY_BUNDLE(_node_id)),                             \
+/* Management and data cport */
+#define _GREYBUS_CPORTS_IN_AUDIO_BUNDLE(_node_id) COND_CODE_1(CONFIG_GREYBUS_AUDIO, (2), (0))
+
+/* Management and data cport */
+#define _GREYBUS_CPORTS_IN_CAMERA_BUNDLE(_node_id) COND_CODE_1(CONFIG_GREYBUS_CAMERA, (2), (0))
+
+#define _GREYBUS_CPORTS_IN_HID_BUNDLE(_node_id) COND_CODE_1(CONFIG_GREYBUS_HID, (1), (0))
+
+/* All supplies of the bundle share one cport */
+#define _GREYBUS_CPORTS_IN_POWER_SUPPLY_BUNDLE(_node_id)                                           \
+	COND_CODE_1(CONFIG_GREYBUS_POWER_SUPPLY, (1), (0))
+
+#define _GREYBUS_CPORTS_IN_HID_OR_OTHER(_node_id)                                                  \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_hid, okay),          \
+		    (_GREYBUS_CPORTS_IN_HID_BUNDLE(_node_id)),                                     \
 		    (COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id,                               \
-							   zephyr_greybus_bundle_vibrator, okay),  \
-				 (_GREYBUS_CPORTS_IN_VIBRATOR_BUNDLE(_node_id)), (1))))
+							   zephyr_greybus_bundle_power_supply,     \
+							   okay),                                  \
+				 (_GREYBUS_CPORTS_IN_POWER_SUPPLY_BUNDLE(_node_id)), (1))))
+
+#define _GREYBUS_CPORTS_IN_CAMERA_OR_OTHER(_node_id)                                               \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_camera, okay),       \
+		    (_GREYBUS_CPORTS_IN_CAMERA_BUNDLE(_node_id)),                                  \
+		    (_GREYBUS_CPORTS_IN_HID_OR_OTHER(_node_id)))
+
+#define _GREYBUS_CPORT_COUNTER(_node_id)                                                           \
+	COND_CODE_1(                                                                               \
+		DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_bridged_phy, okay),      \
+		(_GREYBUS_CPORTS_IN_BRIDGED_PHY_BUNDLE(_node_id)),                                 \
+		(COND_CODE_1(                                                                      \
+			DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_vibrator, okay), \
+			(_GREYBUS_CPORTS_IN_VIBRATOR_BUNDLE(_node_id)),                            \
+			(COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id,                           \
+							       zephyr_greybus_bundle_audio, okay), \
+				     (_GREYBUS_CPORTS_IN_AUDIO_BUNDLE(_node_id)),                  \
+				     (_GREYBUS_CPORTS_IN_CAMERA_OR_OTHER(_node_id)))))))
 
 /*
  * Handler for cports and bundles that do not exist in DT.
@@ -96,6 +130,27 @@ int manifest_create(uint8_t buf[], size_t len);
  */
 size_t manifest_size(void);
 
+/**
+ * Get the GET_MANIFEST response message.
+ *
+ * The response is generated on first call and reused afterwards, only the operation id is updated.
+ * It is copied only while the previous response is still held by the transport. Callers must be
+ * serialized, which holds for requests on the control cport.
+ *
+ * @param operation_id: operation id of the request being answered.
+ *
+ * @return response to be released with gb_message_dealloc. NULL in case of error
+ */
+struct gb_message *manifest_response(uint16_t operation_id);
+
+/**
+ * Get the CRC-32 (IEEE) of the manifest, as returned by GET_MANIFEST.
+ *
+ * Lets a host recognize a manifest it has seen before without fetching it. Same serialization rules
+ * as manifest_response(). Returns 0 if the manifest could not be generated.
+ */
+uint32_t manifest_hash(void);
+
 /**
  * Print greybus manifest to stdout. Intended for debugging.
  */
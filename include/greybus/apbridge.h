@@ -11,13 +11,18 @@
 #ifndef _GREYBUS_APBRIDGE_H_
 #define _GREYBUS_APBRIDGE_H_
 
+#include <greybus/greybus.h>
 #include <greybus/greybus_messages.h>
+#include <zephyr/kernel.h>
 
 #define AP_MAX_NODES  CONFIG_GREYBUS_APBRIDGE_CPORTS
 #define SVC_INF_ID    0
 #define AP_INF_ID     1
 #define INTF_START_ID 2
 
+/* Most connections the bridge can route at once, AP and node to node combined */
+#define AP_MAX_CONNECTIONS (BIT(LOG2CEIL(AP_MAX_NODES * 4)) / 4)
+
 struct gb_interface;
 
 /**
@@ -49,6 +54,27 @@ typedef int (*gb_controller_create_connection_t)(struct gb_interface *, uint16_t
  */
 typedef void (*gb_controller_destroy_connection_t)(struct gb_interface *, uint16_t);
 
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+/**
+ * Messages waiting to be written to an interface
+ *
+ * @param wq: work queue the messages are written from. NULL if the queue is not started.
+ * @param work: writes the queued messages
+ * @param lock: protects the ring
+ * @param items: ring of queued messages
+ * @param head: index of the oldest message
+ * @param num: number of queued messages
+ */
+struct gb_interface_tx_queue {
+	struct k_work_q *wq;
+	struct k_work work;
+	struct k_spinlock lock;
+	struct gb_msg_with_cport items[CONFIG_GREYBUS_APBRIDGE_TX_QUEUE_DEPTH];
+	size_t head;
+	size_t num;
+};
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+
 /**
  * A greybus interface. Can have multiple Cports
  *
@@ -59,6 +85,7 @@ typedef void (*gb_controller_destroy_connection_t)(struct gb_interface *, uint16
  * @param destroy_connection: Called when an existing connection with a cport is destroyed.
  * Optional.
  * @param ctrl_data: private controller data
+ * @param tx_queue: messages waiting to be written, when the queue is started
  */
 struct gb_interface {
 	gb_controller_write_callback_t write;
@@ -66,6 +93,9 @@ struct gb_interface {
 	gb_controller_destroy_connection_t destroy_connection;
 	void *ctrl_data;
 	uint8_t id;
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+	struct gb_interface_tx_queue tx_queue;
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
 };
 
 /**
@@ -84,8 +114,8 @@ void gb_apbridge_deinit(void);
 /**
  * Create connection between 2 interface cports.
  *
- * NOTE: It is only possible to create connection between AP-Node. Node-Node and AP-AP are not
- * supported.
+ * Both AP-Node and Node-Node connections are supported. Messages on a Node-Node connection are
+ * forwarded directly between the interfaces. AP-AP connections are not supported.
  *
  * @param intf1_id
  * @param intf1_cport
@@ -115,7 +145,9 @@ int gb_apbridge_connection_destroy(uint8_t intf1_id, uint16_t intf1_cport, uint8
 /**
  * Send message between connected cports.
  *
- * Looks up the target connected inteface and sends the greybus message.
+ * Looks up the target connected inteface and sends the greybus message. If the target has a
+ * started TX queue, the message is queued and written from the work queue of the target instead.
+ * On error, the message is still owned by the caller.
  *
  * @param intf_id: Interface ID of the origin.
  * @param intf_cport: Interface CPort of the origin.
@@ -174,4 +206,29 @@ int gb_interface_add(struct gb_interface *intf);
  */
 void gb_interface_remove(uint8_t id);
 
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+/**
+ * Write messages to an interface from a work queue instead of the sending thread.
+ *
+ * A slow interface then only holds up its own queue. Interfaces sharing a work queue are still
+ * written one after the other, so an interface that can block for long should get its own.
+ *
+ * @param intf: Greybus interface
+ * @param wq: work queue to write from. NULL for the shared APBridge work queue.
+ *
+ * @return 0 in case of success.
+ * @return -EALREADY if the queue is already started.
+ */
+int gb_interface_tx_queue_start(struct gb_interface *intf, struct k_work_q *wq);
+
+/**
+ * Go back to writing messages inline. Messages still queued are dropped.
+ *
+ * Must not be called from the work queue of the interface.
+ *
+ * @param intf: Greybus interface
+ */
+void gb_interface_tx_queue_stop(struct gb_interface *intf);
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+
 #endif // _GREYBUS_APBRIDGE_H_
@@ -55,6 +55,8 @@ struct gb_transport_backend {
 	int (*stop_listening)(uint16_t cport);
 	/* Send greybus message */
 	int (*send)(uint16_t cport, const struct gb_message *msg);
+	/* Send several greybus messages in as few writes as possible. Optional. */
+	int (*send_batch)(const struct gb_msg_with_cport *msgs, size_t num);
 };
 
 /**
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Capture of the Greybus traffic of the node in pcapng format.
+ *
+ * Messages are copied into a ring as they are received and sent, and the application drains the
+ * ring into wherever it wants the capture: a file, a UART or a socket. Each packet is a
+ * struct gb_capture_hdr followed by the greybus message, on the link type
+ * CONFIG_GREYBUS_CAPTURE_LINKTYPE, one of the LINKTYPE_USER* values.
+ */
+
+#ifndef _GREYBUS_CAPTURE_H_
+#define _GREYBUS_CAPTURE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include <greybus/types.h>
+
+#define GB_CAPTURE_DIR_RX 0x00
+#define GB_CAPTURE_DIR_TX 0x01
+
+/*
+ * struct gb_capture_hdr: Pseudo header in front of each captured message
+ *
+ * @cport: cport of the message
+ * @direction: GB_CAPTURE_DIR_RX for messages from the AP, GB_CAPTURE_DIR_TX for the others
+ * @pad: always 0
+ */
+struct gb_capture_hdr {
+	__le16 cport;
+	__u8 direction;
+	__u8 pad;
+} __packed;
+
+/**
+ * Write part of the capture to its destination
+ *
+ * @param data: bytes of the pcapng stream.
+ * @param len: number of bytes.
+ * @param user_data: passed to gb_capture_drain().
+ *
+ * @return 0 on success, negative error otherwise.
+ */
+typedef int (*gb_capture_write_t)(const void *data, size_t len, void *user_data);
+
+/**
+ * Start a new capture
+ *
+ * Drops whatever was not drained from the previous one. The next drain starts with the pcapng
+ * section and interface headers. Waits for a running drain to finish.
+ */
+void gb_capture_start(void);
+
+/**
+ * Stop capturing. Messages already captured can still be drained.
+ */
+void gb_capture_stop(void);
+
+/**
+ * Pass everything captured so far to write, as pcapng blocks
+ *
+ * Drains run one at a time and not during gb_capture_start(), the capture itself goes on
+ * meanwhile.
+ *
+ * @param write: called for each part of the stream.
+ * @param user_data: passed to write.
+ *
+ * @return 0 on success, or the error of write. The packet being written is dropped then.
+ */
+int gb_capture_drain(gb_capture_write_t write, void *user_data);
+
+/**
+ * Get the number of messages not captured since the start, because the ring was full
+ */
+uint32_t gb_capture_drops(void);
+
+#endif // _GREYBUS_CAPTURE_H_
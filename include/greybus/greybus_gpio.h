@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Latency of GPIO interrupt events, from the GPIO callback to the acknowledgement by the AP.
+ */
+
+#ifndef _GREYBUS_GPIO_H_PUBLIC_
+#define _GREYBUS_GPIO_H_PUBLIC_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+
+/* Latency histogram buckets: <= 1us, <= 2us, ..., <= 16ms, larger */
+#define GB_GPIO_LATENCY_BUCKETS         16
+#define GB_GPIO_LATENCY_BUCKET_US(_idx) (1U << (_idx))
+
+struct gb_gpio_latency_hist {
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t histogram[GB_GPIO_LATENCY_BUCKETS];
+};
+
+struct gb_gpio_latency_stats {
+	/* Interrupts seen by the GPIO callback, merged ones included */
+	uint32_t irqs;
+	/* Events sent as tracked operations */
+	uint32_t events;
+	/* Events sent without tracking, because too many were in flight */
+	uint32_t untracked;
+	/* Events never acknowledged, or that could not be sent */
+	uint32_t errors;
+	/* Benchmark toggle to GPIO callback, only while the benchmark runs */
+	struct gb_gpio_latency_hist edge_to_irq;
+	/* GPIO callback to the event being passed to the transport */
+	struct gb_gpio_latency_hist irq_to_send;
+	/* Event passed to the transport to the response of the AP */
+	struct gb_gpio_latency_hist send_to_ack;
+};
+
+/**
+ * Get a snapshot of the latency statistics.
+ */
+void gb_gpio_latency_get(struct gb_gpio_latency_stats *stats);
+
+/**
+ * Reset the latency statistics.
+ */
+void gb_gpio_latency_reset(void);
+
+/**
+ * Estimate a latency percentile from a histogram.
+ *
+ * @returns upper bound of the bucket holding the percentile, in microseconds.
+ * @returns max_us if the percentile falls in the last bucket.
+ */
+uint32_t gb_gpio_latency_percentile(const struct gb_gpio_latency_hist *hist, uint8_t percent);
+
+/**
+ * Start toggling an output pin at a fixed rate.
+ *
+ * The pin is meant to be wired to a line of the bundle the AP listens to, so that each toggle
+ * goes all the way to the AP as an interrupt event. The time from each toggle to the GPIO
+ * callback is recorded in edge_to_irq. Requires CONFIG_GREYBUS_GPIO_IRQ_BENCH.
+ *
+ * @param port: GPIO controller of the output pin.
+ * @param pin: Output pin, configured as output by this call.
+ * @param rate_hz: Number of toggles per second.
+ * @param count: Number of toggles. 0 to run until stopped.
+ *
+ * @returns 0 in case of success.
+ * @returns -EBUSY if a benchmark is already running.
+ * @returns -EINVAL if rate_hz is 0 or above 1 MHz.
+ * @returns other negative errno if the pin cannot be configured.
+ */
+int gb_gpio_bench_start(const struct device *port, gpio_pin_t pin, uint32_t rate_hz,
+			uint32_t count);
+
+/**
+ * Stop the running benchmark.
+ */
+void gb_gpio_bench_stop(void);
+
+/**
+ * Check if the benchmark is running.
+ */
+bool gb_gpio_bench_running(void);
+
+#endif // _GREYBUS_GPIO_H_PUBLIC_
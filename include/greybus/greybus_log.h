@@ -12,6 +12,9 @@
 /**
  * Send greybus log message
  *
+ * The message is queued and sent later, batched with other messages. It is dropped if the queue
+ * is full. Does not block, and can be called from any context.
+ *
  * @param len: size of string excluding NULL terminator.
  * @param log: UTF-8 string.
  */
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GREYBUS_LOOPBACK_H_
+#define _GREYBUS_LOOPBACK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Round trip latency histogram buckets: <= 8us, <= 16us, ..., <= 131ms, larger */
+#define GB_LOOPBACK_BENCH_BUCKETS         16
+#define GB_LOOPBACK_BENCH_BUCKET_US(_idx) (8U << (_idx))
+
+struct gb_loopback_bench_stats {
+	bool running;
+	/* Requests sent to the AP */
+	uint32_t sent;
+	/* Successful responses received */
+	uint32_t completed;
+	/* Failed sends, error responses, bad payloads and timeouts */
+	uint32_t errors;
+	uint32_t alloc_failures;
+	/* Payload bytes sent and received */
+	uint64_t bytes;
+	/* Time from start to the last response */
+	uint32_t elapsed_ms;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t histogram[GB_LOOPBACK_BENCH_BUCKETS];
+};
+
+/**
+ * Start sending loopback requests to the AP.
+ *
+ * A single request is in flight at any time. The next one is sent once the previous one
+ * completed, and at least interval_us after it was sent.
+ *
+ * @param type: GB_LOOPBACK_TYPE_PING, GB_LOOPBACK_TYPE_TRANSFER or GB_LOOPBACK_TYPE_SINK.
+ * @param size: Payload size of transfer and sink requests.
+ * @param count: Number of requests to send. 0 to run until stopped.
+ * @param interval_us: Minimum time between two requests.
+ *
+ * @returns 0 in case of success.
+ * @returns -ENOTCONN if the loopback cport is not connected.
+ * @returns -EBUSY if a benchmark is already running.
+ * @returns -EINVAL if type or size are invalid.
+ */
+int gb_loopback_bench_start(uint8_t type, uint32_t size, uint32_t count, uint32_t interval_us);
+
+/**
+ * Stop the running benchmark. Statistics are kept until the next start.
+ */
+void gb_loopback_bench_stop(void);
+
+/**
+ * Get a snapshot of the benchmark statistics.
+ */
+void gb_loopback_bench_stats_get(struct gb_loopback_bench_stats *stats);
+
+/**
+ * Estimate a latency percentile from the histogram.
+ *
+ * @returns upper bound of the bucket holding the percentile, in microseconds.
+ * @returns max_us if the percentile falls in the last bucket.
+ */
+uint32_t gb_loopback_bench_percentile(const struct gb_loopback_bench_stats *stats,
+				      uint8_t percent);
+
+#endif // _GREYBUS_LOOPBACK_H_
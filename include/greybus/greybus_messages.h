@@ -7,6 +7,7 @@
 #define _GREYBUS_MESSAGES_H_
 
 #include <zephyr/types.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/sys/byteorder.h>
 #include <greybus/greybus_protocols.h>
 
@@ -128,12 +129,67 @@ struct gb_message *gb_message_alloc(size_t payload_len, uint8_t message_type, ui
 				    uint8_t status);
 
 /*
- * Deallocate a greybus message.
+ * Allocate Greybus message from interrupt context, without blocking
+ *
+ * Same as gb_message_alloc, but the memory comes from the pool reserved for interrupt context.
+ * Such messages can be sent with gb_transport_message_send_isr.
+ *
+ * @return greybus message. Null if the pools are exhausted
+ */
+struct gb_message *gb_message_alloc_isr(size_t payload_len, uint8_t message_type,
+					uint16_t operation_id, uint8_t status);
+
+/*
+ * Deallocate a greybus message. The memory is only released once the last reference is dropped.
  *
  * @param pointer to the message to deallcate
  */
 void gb_message_dealloc(struct gb_message *msg);
 
+/*
+ * Take an additional reference to a message allocated by gb_message_alloc. Each reference is
+ * dropped with gb_message_dealloc. A message with more than one owner must not be modified.
+ *
+ * @param msg: greybus message
+ *
+ * @return msg
+ */
+struct gb_message *gb_message_ref(struct gb_message *msg);
+
+/*
+ * Check if a message allocated by gb_message_alloc has more than one owner.
+ *
+ * @param msg: greybus message
+ *
+ * @return true if other references to msg exist, false if the caller holds the only one
+ */
+bool gb_message_is_shared(const struct gb_message *msg);
+
+/*
+ * Get a message that stays valid after the caller's copy goes away. Heap messages gain a
+ * reference, anything else (e.g. messages on stack) is copied.
+ *
+ * @param msg: greybus message
+ *
+ * @return greybus message to be released with gb_message_dealloc. Null in case of error
+ */
+struct gb_message *gb_message_get(const struct gb_message *msg);
+
+/*
+ * Turn a request into its response. The request buffer is reused if it is not shared and is
+ * large enough, otherwise a new message is allocated and the request is released. Either way the
+ * caller gives up its reference to req.
+ *
+ * @param req: greybus request allocated by gb_message_alloc
+ * @param payload: response payload. May point into the request payload.
+ * @param payload_len: response payload length
+ * @param status: response status
+ *
+ * @return greybus response message. Null in case of error
+ */
+struct gb_message *gb_message_request_to_response(struct gb_message *req, const void *payload,
+						  size_t payload_len, uint8_t status);
+
 /*
  * Allocate a greybus request message
  *
@@ -187,7 +243,11 @@ static inline struct gb_message *gb_message_response_alloc(const void *payload,
 {
 	struct gb_message *msg =
 		gb_message_alloc(payload_len, GB_RESPONSE(request_type), operation_id, status);
-	memcpy(msg->payload, payload, payload_len);
+
+	if (msg) {
+		memcpy(msg->payload, payload, payload_len);
+	}
+
 	return msg;
 }
 
@@ -224,13 +284,24 @@ static inline struct gb_message *gb_message_copy(const struct gb_message *msg)
 	struct gb_message *resp = gb_message_alloc(payload_len, gb_message_type(msg),
 						   msg->header.operation_id, msg->header.result);
 
-	memcpy(resp->payload, msg->payload, payload_len);
+	if (resp) {
+		memcpy(resp->payload, msg->payload, payload_len);
+	}
 
 	return resp;
 }
 
+/**
+ * Helper to get the next operation id from a counter. Lock-free, never returns 0.
+ *
+ * @param counter: last operation id handed out, 0 initially
+ */
+uint16_t gb_operation_id_next(atomic_t *counter);
+
 /**
  * Helper to get a new unique operation id.
+ *
+ * Shared by all cports. Nodes should prefer the ids of the cport the request is sent on.
  */
 uint16_t new_operation_id(void);
 
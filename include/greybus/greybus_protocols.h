@@ -84,6 +84,10 @@ struct gb_cport_shutdown_request {
 #define GB_CONTROL_TYPE_INTF_DEACTIVATE_PREPARE 0x14
 #define GB_CONTROL_TYPE_INTF_HIBERNATE_ABORT    0x15
 
+/* Zephyr specific control requests */
+#define GB_CONTROL_TYPE_VENDOR_HEAP_STATS   0x70
+#define GB_CONTROL_TYPE_VENDOR_ENERGY_STATS 0x71
+
 struct gb_control_version_request {
 	__u8 major;
 	__u8 minor;
@@ -128,6 +132,34 @@ struct gb_control_disconnected_request {
 } __packed;
 /* Control protocol [dis]connected response has no payload */
 
+/* Control protocol heap stats request has no payload */
+struct gb_control_heap_stats_response {
+	__le32 cur_bytes;
+	__le32 peak_bytes;
+	__le32 allocs;
+	__le32 frees;
+	__le32 failures;
+	__le32 max_request;
+	/* Request sizes: <= 16, <= 32, ..., <= 4096, larger */
+	__le32 histogram[10];
+} __packed;
+
+/* Control protocol energy stats request, counters add up all cports of the bundle */
+struct gb_control_energy_stats_request {
+	__u8 bundle_id;
+} __packed;
+
+struct gb_control_energy_stats_response {
+	__le32 rx_msgs;
+	__le32 rx_bytes;
+	__le32 tx_msgs;
+	__le32 tx_bytes;
+	/* Estimated radio time of the traffic, in microseconds */
+	__le64 radio_us;
+	/* Time spent in operation handlers, in microseconds */
+	__le64 cpu_us;
+} __packed;
+
 /*
  * All Bundle power management operations use the same request and response
  * layout and status codes.
@@ -161,6 +193,31 @@ struct gb_control_intf_pm_response {
 	__u8 status;
 } __packed;
 
+/* TimeSync operations */
+
+#define GB_TIMESYNC_MAX_STROBES 0x04
+
+struct gb_control_timesync_enable_request {
+	__u8 count;
+	__le64 frame_time;
+	__le32 strobe_delay;
+	__le32 refclk;
+} __packed;
+
+/* disable request has no payload */
+/* disable response has no payload */
+
+struct gb_control_timesync_authoritative_request {
+	__le64 frame_time[GB_TIMESYNC_MAX_STROBES];
+} __packed;
+
+/* authoritative response has no payload */
+
+/* get last event request has no payload */
+struct gb_control_timesync_get_last_event_response {
+	__le64 frame_time;
+} __packed;
+
 /* APBridge protocol */
 
 /* request APB1 log */
@@ -250,6 +307,9 @@ struct gb_fw_download_release_firmware_request {
 #define GB_FW_LOAD_METHOD_UNIPRO   0x01
 #define GB_FW_LOAD_METHOD_INTERNAL 0x02
 
+/* Zephyr specific load methods */
+#define GB_FW_LOAD_METHOD_VENDOR_UNIPRO_DELTA 0x70
+
 #define GB_FW_LOAD_STATUS_FAILED            0x00
 #define GB_FW_LOAD_STATUS_UNVALIDATED       0x01
 #define GB_FW_LOAD_STATUS_VALIDATED         0x02
@@ -713,6 +773,11 @@ struct gb_i2c_transfer_response {
 #define GB_GPIO_TYPE_IRQ_UNMASK    0x0d
 #define GB_GPIO_TYPE_IRQ_EVENT     0x0e
 
+/* Zephyr specific gpio requests */
+#define GB_GPIO_TYPE_VENDOR_PORT_GET   0x70
+#define GB_GPIO_TYPE_VENDOR_PORT_SET   0x71
+#define GB_GPIO_TYPE_VENDOR_EDGE_COUNT 0x72
+
 #define GB_GPIO_IRQ_TYPE_NONE         0x00
 #define GB_GPIO_IRQ_TYPE_EDGE_RISING  0x01
 #define GB_GPIO_IRQ_TYPE_EDGE_FALLING 0x02
@@ -794,6 +859,30 @@ struct gb_gpio_irq_event_request {
 } __packed;
 /* irq event has no response */
 
+/* port get request has no payload */
+struct gb_gpio_port_get_response {
+	__le32 value;
+} __packed;
+
+/* Only lines set in mask are changed */
+struct gb_gpio_port_set_request {
+	__le32 mask;
+	__le32 value;
+} __packed;
+/* port set response has no payload */
+
+struct gb_gpio_edge_count_request {
+	__u8 which;
+} __packed;
+
+/* Counts of a debounced line since its debounce time was set */
+struct gb_gpio_edge_count_response {
+	/* Raw edges, bounces included */
+	__le32 edges;
+	/* Settled transitions */
+	__le32 transitions;
+} __packed;
+
 /* PWM */
 
 /* Greybus PWM operation types */
@@ -805,6 +894,9 @@ struct gb_gpio_irq_event_request {
 #define GB_PWM_TYPE_ENABLE     0x07
 #define GB_PWM_TYPE_DISABLE    0x08
 
+/* Zephyr specific pwm requests */
+#define GB_PWM_TYPE_VENDOR_BATCH 0x70
+
 /* pwm count request has no payload */
 struct gb_pwm_count_response {
 	__u8 count;
@@ -837,6 +929,23 @@ struct gb_pwm_disable_request {
 	__u8 which;
 } __packed;
 
+/* pwm batch entry flags */
+#define GB_PWM_BATCH_FLAG_ENABLE   0x01
+#define GB_PWM_BATCH_FLAG_INVERTED 0x02
+
+struct gb_pwm_batch_entry {
+	__u8 which;
+	__u8 flags;
+	__le32 duty;
+	__le32 period;
+} __packed;
+
+/* pwm batch request: response has no payload */
+struct gb_pwm_batch_request {
+	__u8 count;
+	struct gb_pwm_batch_entry entries[];
+} __packed;
+
 /* SPI */
 
 /* Should match up with modes in linux/spi/spi.h */
@@ -1286,11 +1395,20 @@ struct gb_svc_intf_oops_request {
 /* Greybus raw request types */
 #define GB_RAW_TYPE_SEND 0x02
 
+/* Zephyr specific raw requests */
+#define GB_RAW_TYPE_VENDOR_CREDITS 0x70
+
 struct gb_raw_send_request {
 	__le32 len;
 	__u8 data[];
 } __packed;
 
+/* credits request: response has no payload */
+struct gb_raw_credits_request {
+	/* Number of additional send requests the host is ready to receive */
+	__le16 count;
+} __packed;
+
 /* UART */
 
 /* Greybus UART operation types */
@@ -1398,6 +1516,77 @@ struct gb_loopback_transfer_response {
 	__u8 data[];
 } __packed;
 
+/* USB */
+
+/* Greybus USB request types */
+#define GB_USB_TYPE_HCD_START   0x02
+#define GB_USB_TYPE_HCD_STOP    0x03
+#define GB_USB_TYPE_HUB_CONTROL 0x04
+
+/* Zephyr specific usb requests */
+#define GB_USB_TYPE_VENDOR_URB_SUBMIT   0x70
+#define GB_USB_TYPE_VENDOR_URB_DEQUEUE  0x71
+/* Sent by the module, operation has no response */
+#define GB_USB_TYPE_VENDOR_URB_COMPLETE 0x72
+
+/* Root hub request, typeReq is (bmRequestType << 8) | bRequest */
+struct gb_usb_hub_control_request {
+	__le16 typeReq;
+	__le16 wValue;
+	__le16 wIndex;
+	__le16 wLength;
+} __packed;
+
+struct gb_usb_hub_control_response {
+	__u8 buf[0];
+} __packed;
+
+/* URB submitted by the AP, followed by length bytes of data for OUT endpoints */
+struct gb_usb_urb {
+	__le16 id;
+	__u8 devnum;
+	/* Endpoint address, bit 7 is set for IN endpoints */
+	__u8 ep;
+	__u8 type;
+#define GB_USB_URB_TYPE_CONTROL   0x00
+#define GB_USB_URB_TYPE_BULK      0x02
+#define GB_USB_URB_TYPE_INTERRUPT 0x03
+	__u8 padding;
+	__le16 mps;
+	/* Data to send for OUT endpoints, buffer size for IN endpoints */
+	__le16 length;
+	__u8 padding2[2];
+	/* Control endpoints only */
+	__u8 setup[8];
+	__u8 data[];
+} __packed;
+
+/* URB submit request, response has no payload. URBs complete asynchronously */
+struct gb_usb_urb_submit_request {
+	__u8 count;
+	__u8 padding[3];
+	__u8 urbs[];
+} __packed;
+
+struct gb_usb_urb_dequeue_request {
+	__le16 id;
+} __packed;
+
+/* Completed URB, followed by actual_length bytes of data for IN endpoints */
+struct gb_usb_urb_completion {
+	__le16 id;
+	__le16 actual_length;
+	/* 0 or negative errno */
+	__le32 status;
+	__u8 data[];
+} __packed;
+
+struct gb_usb_urb_complete_request {
+	__u8 count;
+	__u8 padding[3];
+	__u8 urbs[];
+} __packed;
+
 /* SDIO */
 /* Greybus SDIO operation types */
 #define GB_SDIO_TYPE_GET_CAPABILITIES 0x02
@@ -1625,6 +1814,29 @@ struct gb_camera_metadata_request {
 	__u8 metadata[];
 } __packed;
 
+/* Zephyr specific camera data request, sent by the module on the camera data cport */
+#define GB_CAMERA_TYPE_VENDOR_FRAME_CHUNK 0x70
+
+/* Metadata of frames carried over the data cport */
+struct gb_camera_frame_metadata {
+	/* Size of the frame in bytes */
+	__le32 size;
+	/* Capture time in milliseconds */
+	__le32 timestamp;
+} __packed;
+
+/* frame chunk request: operation has no response */
+struct gb_camera_frame_chunk_request {
+	__le32 request_id;
+	__le16 frame_number;
+	__u8 flags;
+#define GB_CAMERA_FRAME_CHUNK_LAST 0x01
+	__u8 padding;
+	/* Position of the data in the frame */
+	__le32 offset;
+	__u8 data[];
+} __packed;
+
 /* Lights */
 
 /* Greybus Lights request types */
@@ -1642,6 +1854,9 @@ struct gb_camera_metadata_request {
 #define GB_LIGHTS_TYPE_SET_FLASH_TIMEOUT        0x0D
 #define GB_LIGHTS_TYPE_GET_FLASH_FAULT          0x0E
 
+/* Zephyr specific lights requests */
+#define GB_LIGHTS_TYPE_VENDOR_SET_BRIGHTNESS_BATCH 0x70
+
 /* Greybus Light modes */
 
 /*
@@ -1733,6 +1948,12 @@ struct gb_lights_set_brightness_request {
 	__u8 brightness;
 } __packed;
 
+/* set brightness batch request payload: response have no payload */
+struct gb_lights_set_brightness_batch_request {
+	__u8 count;
+	struct gb_lights_set_brightness_request entries[];
+} __packed;
+
 /* set color request payload: response have no payload */
 struct gb_lights_set_color_request {
 	__u8 light_id;
@@ -2168,17 +2389,65 @@ struct gb_audio_send_data_request {
 /* operations */
 #define GB_LOG_TYPE_SEND_LOG 0x02
 
+/* Zephyr specific log requests */
+#define GB_LOG_TYPE_VENDOR_SET_FILTER     0x70
+#define GB_LOG_TYPE_VENDOR_SET_RATE_LIMIT 0x71
+
 /* length */
 #define GB_LOG_MAX_LEN 1024
 
+#define GB_LOG_MODULE_NAME_MAX 32
+
 struct gb_log_send_log_request {
 	__le16 len;
 	__u8 msg[];
 } __packed;
 
+/* Runtime level of a log module, or of all modules if module is empty. Level as in Zephyr. */
+struct gb_log_vendor_set_filter_request {
+	__u8 level;
+	char module[GB_LOG_MODULE_NAME_MAX];
+} __packed;
+
+struct gb_log_vendor_set_filter_response {
+	__le16 modules;
+} __packed;
+
+/* Sustained lines per second and burst size. 0 lines per second disables the limit. */
+struct gb_log_vendor_set_rate_limit_request {
+	__le16 lines_per_sec;
+	__le16 burst;
+} __packed;
+
 /* Vibrator */
 
 #define GB_VIBRATOR_TYPE_ON  0x02
 #define GB_VIBRATOR_TYPE_OFF 0x03
 
+/* Zephyr specific vibrator requests */
+#define GB_VIBRATOR_TYPE_VENDOR_PATTERN_UPLOAD 0x70
+#define GB_VIBRATOR_TYPE_VENDOR_PATTERN_PLAY   0x71
+
+/* Play the pattern until stopped */
+#define GB_VIBRATOR_PATTERN_REPEAT_FOREVER 0xff
+
+struct gb_vibrator_pattern_step {
+	__le16 on_ms;
+	__le16 off_ms;
+} __packed;
+
+/* pattern upload request: response has no payload */
+struct gb_vibrator_pattern_upload_request {
+	/* Number of times the pattern is played again after the first time */
+	__u8 repeat;
+	__u8 count;
+	struct gb_vibrator_pattern_step steps[];
+} __packed;
+
+/* pattern play request: response has no payload */
+struct gb_vibrator_pattern_play_request {
+	/* Delay before the first step, measured from reception of the request */
+	__le16 delay_ms;
+} __packed;
+
 #endif /* __GREYBUS_PROTOCOLS_H */
@@ -8,6 +8,7 @@
 #define _GREYBUS_RAW_H_
 
 #include <stdint.h>
+#include <zephyr/kernel.h>
 
 /**
  * Callback for greybus raw protocol.
@@ -43,4 +44,40 @@ int greybus_raw_register(greybus_raw_cb_t cb, void *priv);
  */
 int greybus_raw_send_data(uint16_t id, uint32_t len, const uint8_t *data);
 
+/**
+ * Allocate a buffer for greybus_raw_send_buf().
+ *
+ * The buffer is the payload of a greybus message, so sending it does not copy the data.
+ *
+ * @param len: Maximum number of bytes that will be sent from the buffer.
+ *
+ * @returns pointer to the buffer in case of success.
+ * @returns NULL if out of memory.
+ */
+uint8_t *greybus_raw_buf_alloc(uint32_t len);
+
+/**
+ * Free a buffer obtained from greybus_raw_buf_alloc() that could not be sent.
+ *
+ * @param buf
+ */
+void greybus_raw_buf_free(uint8_t *buf);
+
+/**
+ * Send a buffer to AP without copying it.
+ *
+ * Takes ownership of the buffer in case of success. Each call consumes a credit granted by the
+ * host, and waits for one if none is left.
+ *
+ * @param id: ID obtained from greybus_raw_register.
+ * @param buf: Buffer obtained from greybus_raw_buf_alloc.
+ * @param len: Number of bytes to send. Must not exceed the allocated length.
+ * @param timeout: Time to wait for a credit.
+ *
+ * @returns 0 in case of success.
+ * @returns -EAGAIN if no credit was granted in time. The caller still owns the buffer.
+ * @returns < 0 in case of other errors. The caller still owns the buffer.
+ */
+int greybus_raw_send_buf(uint16_t id, uint8_t *buf, uint32_t len, k_timeout_t timeout);
+
 #endif // _GREYBUS_RAW_H_
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GREYBUS_TIMESYNC_H_
+#define _GREYBUS_TIMESYNC_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+/**
+ * Get the node local time used for TimeSync
+ *
+ * Cheap enough to timestamp samples or events with, and can be called from any context. Also
+ * available without CONFIG_GREYBUS_TIMESYNC, so that all timestamps share one clock.
+ *
+ * @return local time in nanoseconds.
+ */
+static inline uint64_t gb_timesync_local_time(void)
+{
+	if (IS_ENABLED(CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER)) {
+		return k_cyc_to_ns_floor64(k_cycle_get_64());
+	}
+
+	return k_ticks_to_ns_floor64(k_uptime_ticks());
+}
+
+/**
+ * Convert a local time to the frame time of the AP
+ *
+ * @param local_ns: local time in nanoseconds, from gb_timesync_local_time().
+ * @param frame_time: frame time in ticks of the reference clock of the AP.
+ *
+ * @return 0 on success, -EAGAIN if TimeSync has not synchronized yet.
+ */
+int gb_timesync_to_frame_time(uint64_t local_ns, uint64_t *frame_time);
+
+/**
+ * Get the current frame time of the AP
+ *
+ * @param frame_time: frame time in ticks of the reference clock of the AP.
+ *
+ * @return 0 on success, -EAGAIN if TimeSync has not synchronized yet.
+ */
+static inline int gb_timesync_get_frame_time(uint64_t *frame_time)
+{
+	return gb_timesync_to_frame_time(gb_timesync_local_time(), frame_time);
+}
+
+#endif // _GREYBUS_TIMESYNC_H_
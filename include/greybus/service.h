@@ -7,9 +7,23 @@
 #ifndef _GREYBUS_SERVICE_H_
 #define _GREYBUS_SERVICE_H_
 
+#include <zephyr/kernel.h>
+
 /**
  * Intialize greybus service.
  */
 int greybus_service_init(void);
 
+/**
+ * Wait for greybus service initialization to finish
+ *
+ * With CONFIG_GREYBUS_SERVICE_ASYNC, the service starts in the background while the application
+ * runs.
+ *
+ * @param timeout: how long to wait
+ *
+ * @return result of greybus_service_init(), or -EAGAIN on timeout
+ */
+int greybus_service_wait(k_timeout_t timeout);
+
 #endif // _GREYBUS_SERVICE_H_
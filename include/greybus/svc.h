@@ -8,12 +8,26 @@
 #define _GREYBUS_SVC_H_
 
 #include <stdint.h>
+#include <zephyr/kernel.h>
 
 /**
  * Intialize SVC
+ *
+ * Does not wait for the handshake with the AP, use gb_svc_wait_ready() for that.
+ *
+ * @return 0 if the handshake was started, negative in case of error
  */
 int gb_svc_init(void);
 
+/**
+ * Wait for the AP to answer the SVC hello
+ *
+ * @param timeout: how long to wait
+ *
+ * @return 0 once the SVC is ready, -EAGAIN on timeout
+ */
+int gb_svc_wait_ready(k_timeout_t timeout);
+
 /**
  * De-initialize SVC
  */
@@ -22,20 +36,25 @@ void gb_svc_deinit(void);
 /**
  * Send the SVC module inserted request.
  *
+ * The request is queued until the AP answered the SVC hello and fewer than
+ * CONFIG_GREYBUS_SVC_MAX_OPERATIONS module events are waiting for a response. Does not block.
+ *
  * @param primary_intf_id: Primary interface id of the new module
  * @param intf_count: Number of interfaces covered by module
  * @param flags
  *
- * @return 0 if successfully, negative in case of error
+ * @return 0 if successfully queued, -ENOBUFS if too many events are queued
  */
 int gb_svc_send_module_inserted(uint8_t primary_intf_id, uint8_t intf_count, uint16_t flags);
 
 /**
  * Send the SVC module removed request.
  *
+ * Queued after earlier module events, like gb_svc_send_module_inserted().
+ *
  * @param interface id of the module removed
  *
- * @return 0 if successfully, negative in case of error
+ * @return 0 if successfully queued, -ENOBUFS if too many events are queued
  */
 int gb_svc_send_module_removed(uint8_t primary_intf_id);
 
@@ -0,0 +1,354 @@
+#!/usr/bin/env python3
+# Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+# SPDX-License-Identifier: Apache-2.0
+
+"""Load generator for the Greybus TCP/IP transport.
+
+Connects to a node running the tcpip_bench sample, and sweeps loopback message size and
+pipelining depth. Every point reports throughput, latency percentiles and node CPU usage, as CSV
+or JSON lines.
+
+Each message on the wire is a little endian 16 bit cport id followed by the greybus message.
+"""
+
+import argparse
+import json
+import socket
+import ssl
+import struct
+import sys
+import threading
+import time
+
+GB_PORT = 4242
+
+GB_HDR = struct.Struct("<HHBBxx")
+GB_CPORT = struct.Struct("<H")
+GB_TYPE_RESPONSE_FLAG = 0x80
+GB_OP_SUCCESS = 0x00
+
+CONTROL_CPORT = 0
+GB_CONTROL_TYPE_GET_MANIFEST_SIZE = 0x03
+GB_CONTROL_TYPE_GET_MANIFEST = 0x04
+GB_CONTROL_TYPE_VENDOR_HEAP_STATS = 0x70
+GB_HEAP_STATS = struct.Struct("<IIIIII")
+
+GB_LOOPBACK_TYPE_PING = 0x02
+GB_LOOPBACK_TYPE_TRANSFER = 0x03
+GB_LOOPBACK_TRANSFER = struct.Struct("<III")
+
+GB_RAW_TYPE_SEND = 0x02
+GB_RAW_SEND = struct.Struct("<I")
+
+GREYBUS_TYPE_CPORT = 0x04
+GREYBUS_PROTOCOL_LOOPBACK = 0x11
+GREYBUS_PROTOCOL_RAW = 0xFE
+
+BENCH_CMD_CPU_STATS = b"S"
+BENCH_CPU_STATS = struct.Struct("<IIQQ")
+BENCH_CPU_STATS_MAGIC = 0x54534247
+
+FIELDS = [
+    "size",
+    "depth",
+    "ops",
+    "errors",
+    "seconds",
+    "ops_per_sec",
+    "kib_per_sec",
+    "lat_min_us",
+    "lat_p50_us",
+    "lat_p90_us",
+    "lat_p99_us",
+    "lat_max_us",
+    "node_cpu_pct",
+    "node_heap_peak",
+]
+
+
+class Connection:
+    """A single greybus session. Responses are matched by operation id."""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.send_lock = threading.Lock()
+        self.lock = threading.Condition()
+        self.pending = {}
+        self.next_id = 1
+        self.requests = []
+        self.closed = False
+        self.reader = threading.Thread(target=self._read_loop, daemon=True)
+        self.reader.start()
+
+    def _recv_exact(self, n):
+        buf = bytearray()
+        while len(buf) < n:
+            chunk = self.sock.recv(n - len(buf))
+            if not chunk:
+                raise ConnectionError("connection closed by node")
+            buf += chunk
+        return bytes(buf)
+
+    def _send(self, cport, op_id, msg_type, payload, result=0):
+        data = (
+            GB_CPORT.pack(cport)
+            + GB_HDR.pack(GB_HDR.size + len(payload), op_id, msg_type, result)
+            + payload
+        )
+        with self.send_lock:
+            self.sock.sendall(data)
+
+    def _read_loop(self):
+        try:
+            while True:
+                (cport,) = GB_CPORT.unpack(self._recv_exact(GB_CPORT.size))
+                size, op_id, msg_type, result = GB_HDR.unpack(self._recv_exact(GB_HDR.size))
+                payload = self._recv_exact(size - GB_HDR.size)
+                now = time.perf_counter_ns()
+
+                if not msg_type & GB_TYPE_RESPONSE_FLAG:
+                    # Node initiated request, acknowledge it and keep it for the caller
+                    if op_id:
+                        self._send(cport, op_id, msg_type | GB_TYPE_RESPONSE_FLAG, b"")
+                    with self.lock:
+                        self.requests.append((cport, msg_type, payload))
+                        self.lock.notify_all()
+                    continue
+
+                with self.lock:
+                    callback = self.pending.pop(op_id, None)
+                    self.lock.notify_all()
+                if callback:
+                    callback(now, result, payload)
+        except (ConnectionError, OSError):
+            with self.lock:
+                self.closed = True
+                self.lock.notify_all()
+
+    def submit(self, cport, msg_type, payload, callback):
+        """Send a request, callback(ns, result, payload) runs on the reader thread."""
+        with self.lock:
+            op_id = self.next_id
+            # Operation id 0 is reserved for unidirectional operations
+            self.next_id = self.next_id % 0xFFFF + 1
+            self.pending[op_id] = callback
+        self._send(cport, op_id, msg_type, payload)
+
+    def in_flight(self):
+        return len(self.pending)
+
+    def wait(self, predicate, timeout):
+        with self.lock:
+            if not self.lock.wait_for(lambda: predicate() or self.closed, timeout):
+                raise TimeoutError("node did not respond")
+            if self.closed:
+                raise ConnectionError("connection closed by node")
+
+    def transact(self, cport, msg_type, payload=b"", timeout=5.0):
+        done = []
+        self.submit(cport, msg_type, payload, lambda ns, res, data: done.append((res, data)))
+        self.wait(lambda: done, timeout)
+        result, data = done[0]
+        if result != GB_OP_SUCCESS:
+            raise RuntimeError(f"request 0x{msg_type:02x} failed with {result}")
+        return data
+
+    def wait_request(self, cport, msg_type, timeout=5.0):
+        def match():
+            for i, (c, t, _) in enumerate(self.requests):
+                if c == cport and t == msg_type:
+                    return i
+            return None
+
+        self.wait(lambda: match() is not None, timeout)
+        with self.lock:
+            return self.requests.pop(match())[2]
+
+
+def parse_manifest(manifest):
+    """Return {protocol: [cport, ...]} from a greybus manifest blob."""
+    cports = {}
+    off = 4
+    while off + 4 <= len(manifest):
+        size, desc_type = struct.unpack_from("<HB", manifest, off)
+        if size < 4:
+            break
+        if desc_type == GREYBUS_TYPE_CPORT:
+            cport, _, protocol = struct.unpack_from("<HBB", manifest, off + 4)
+            cports.setdefault(protocol, []).append(cport)
+        off += size
+    return cports
+
+
+def discover(conn):
+    (size,) = struct.unpack("<H", conn.transact(CONTROL_CPORT, GB_CONTROL_TYPE_GET_MANIFEST_SIZE))
+    manifest = conn.transact(CONTROL_CPORT, GB_CONTROL_TYPE_GET_MANIFEST)
+    if len(manifest) != size:
+        raise RuntimeError("truncated manifest")
+    return parse_manifest(manifest)
+
+
+class Node:
+    """Optional node side counters, None when the node does not provide them."""
+
+    def __init__(self, conn, cports):
+        self.conn = conn
+        raw = cports.get(GREYBUS_PROTOCOL_RAW)
+        self.raw_cport = raw[0] if raw else None
+
+    def cpu_stats(self):
+        if self.raw_cport is None:
+            return None
+        payload = GB_RAW_SEND.pack(len(BENCH_CMD_CPU_STATS)) + BENCH_CMD_CPU_STATS
+        self.conn.transact(self.raw_cport, GB_RAW_TYPE_SEND, payload)
+        data = self.conn.wait_request(self.raw_cport, GB_RAW_TYPE_SEND)
+        magic, _, execution, busy = BENCH_CPU_STATS.unpack_from(data, GB_RAW_SEND.size)
+        if magic != BENCH_CPU_STATS_MAGIC:
+            return None
+        return execution, busy
+
+    def heap_peak(self):
+        try:
+            data = self.conn.transact(CONTROL_CPORT, GB_CONTROL_TYPE_VENDOR_HEAP_STATS)
+        except RuntimeError:
+            return None
+        return GB_HEAP_STATS.unpack_from(data)[1]
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0
+    idx = min(len(sorted_values) - 1, int(len(sorted_values) * pct / 100))
+    return sorted_values[idx]
+
+
+def run_point(conn, node, cport, size, depth, args):
+    if size:
+        msg_type = GB_LOOPBACK_TYPE_TRANSFER
+        payload = GB_LOOPBACK_TRANSFER.pack(size, 0, 0) + bytes(i & 0xFF for i in range(size))
+    else:
+        msg_type = GB_LOOPBACK_TYPE_PING
+        payload = b""
+
+    latencies = []
+    errors = [0]
+    window = threading.Semaphore(depth)
+
+    def make_callback(sent_ns):
+        def callback(ns, result, data):
+            if result != GB_OP_SUCCESS or (size and len(data) != len(payload)):
+                errors[0] += 1
+            else:
+                latencies.append((ns - sent_ns) // 1000)
+            window.release()
+
+        return callback
+
+    # Warm up the connection before sampling the node
+    for _ in range(args.warmup):
+        conn.transact(cport, msg_type, payload)
+
+    cpu_start = node.cpu_stats()
+    sent = 0
+    start = time.perf_counter()
+    deadline = start + args.duration if args.duration else None
+
+    while (deadline and time.perf_counter() < deadline) or (not deadline and sent < args.count):
+        if not window.acquire(timeout=args.timeout):
+            raise TimeoutError("node stopped responding")
+        conn.submit(cport, msg_type, payload, make_callback(time.perf_counter_ns()))
+        sent += 1
+
+    conn.wait(lambda: conn.in_flight() == 0, args.timeout)
+    elapsed = time.perf_counter() - start
+    cpu_end = node.cpu_stats()
+
+    latencies.sort()
+    ops = len(latencies)
+    cpu = None
+    if cpu_start and cpu_end and cpu_end[0] > cpu_start[0]:
+        cpu = round(100.0 * (cpu_end[1] - cpu_start[1]) / (cpu_end[0] - cpu_start[0]), 1)
+
+    return {
+        "size": size,
+        "depth": depth,
+        "ops": ops,
+        "errors": errors[0],
+        "seconds": round(elapsed, 3),
+        "ops_per_sec": round(ops / elapsed, 1),
+        # Both directions carry the payload
+        "kib_per_sec": round(2 * ops * len(payload) / elapsed / 1024, 1),
+        "lat_min_us": latencies[0] if latencies else 0,
+        "lat_p50_us": percentile(latencies, 50),
+        "lat_p90_us": percentile(latencies, 90),
+        "lat_p99_us": percentile(latencies, 99),
+        "lat_max_us": latencies[-1] if latencies else 0,
+        "node_cpu_pct": cpu,
+        "node_heap_peak": node.heap_peak(),
+    }
+
+
+def int_list(value):
+    return [int(v, 0) for v in value.split(",") if v]
+
+
+def connect(args):
+    sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+    sock.settimeout(None)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    if args.tls:
+        ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+        if args.ca:
+            ctx.load_verify_locations(args.ca)
+            ctx.check_hostname = bool(args.tls_hostname)
+        else:
+            ctx.check_hostname = False
+            ctx.verify_mode = ssl.CERT_NONE
+        sock = ctx.wrap_socket(sock, server_hostname=args.tls_hostname or args.host)
+    return sock
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="address of the node")
+    parser.add_argument("--port", type=int, default=GB_PORT)
+    parser.add_argument("--sizes", type=int_list, default=[0, 16, 64, 256, 1024],
+                        help="comma separated loopback payload sizes, 0 sends pings")
+    parser.add_argument("--depths", type=int_list, default=[1, 2, 4, 8],
+                        help="comma separated number of requests kept in flight")
+    parser.add_argument("--count", type=int, default=1000, help="requests per point")
+    parser.add_argument("--duration", type=float, default=0,
+                        help="seconds per point, overrides --count")
+    parser.add_argument("--warmup", type=int, default=20)
+    parser.add_argument("--timeout", type=float, default=5.0)
+    parser.add_argument("--cport", type=int, help="loopback cport, read from the manifest")
+    parser.add_argument("--format", choices=["csv", "json"], default="csv")
+    parser.add_argument("--tls", action="store_true", help="connect with TLS 1.2")
+    parser.add_argument("--ca", help="CA certificate to verify the node with")
+    parser.add_argument("--tls-hostname", help="hostname presented by the node certificate")
+    args = parser.parse_args()
+
+    conn = Connection(connect(args))
+    cports = discover(conn)
+    cport = args.cport
+    if cport is None:
+        if GREYBUS_PROTOCOL_LOOPBACK not in cports:
+            sys.exit("node does not expose a loopback cport")
+        cport = cports[GREYBUS_PROTOCOL_LOOPBACK][0]
+    node = Node(conn, cports)
+
+    if args.format == "csv":
+        print(",".join(FIELDS), flush=True)
+
+    for size in args.sizes:
+        for depth in args.depths:
+            point = run_point(conn, node, cport, size, depth, args)
+            if args.format == "csv":
+                print(",".join("" if point[f] is None else str(point[f]) for f in FIELDS),
+                      flush=True)
+            else:
+                print(json.dumps(point), flush=True)
+
+
+if __name__ == "__main__":
+    main()
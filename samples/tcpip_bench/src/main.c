@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <greybus/greybus_raw.h>
+#include <greybus/greybus_messages.h>
+
+LOG_MODULE_REGISTER(tcpip_bench, LOG_LEVEL_INF);
+
+/* Sent on the raw cport by the load generator, answered with struct bench_cpu_stats */
+#define BENCH_CMD_CPU_STATS 'S'
+
+#define BENCH_CPU_STATS_MAGIC 0x54534247 /* "GBST" */
+
+/* Cumulative counters, the load generator computes the load from two samples */
+struct bench_cpu_stats {
+	uint32_t magic;
+	uint32_t cycles_per_sec;
+	/* All cycles, including the idle thread */
+	uint64_t execution_cycles;
+	/* Cycles spent outside of the idle thread */
+	uint64_t busy_cycles;
+} __packed;
+
+static int raw_id;
+
+static void bench_cpu_stats_work_handler(struct k_work *work)
+{
+	k_thread_runtime_stats_t rt;
+	struct bench_cpu_stats stats;
+	int ret;
+
+	ARG_UNUSED(work);
+
+	ret = k_thread_runtime_stats_all_get(&rt);
+	if (ret < 0) {
+		LOG_ERR("Failed to get runtime stats (%d)", ret);
+		return;
+	}
+
+	stats.magic = sys_cpu_to_le32(BENCH_CPU_STATS_MAGIC);
+	stats.cycles_per_sec = sys_cpu_to_le32(sys_clock_hw_cycles_per_sec());
+	stats.execution_cycles = sys_cpu_to_le64(rt.execution_cycles);
+	stats.busy_cycles = sys_cpu_to_le64(rt.total_cycles);
+
+	ret = greybus_raw_send_data(raw_id, sizeof(stats), (const uint8_t *)&stats);
+	if (ret < 0) {
+		LOG_ERR("Failed to send cpu stats (%d)", ret);
+	}
+}
+
+static K_WORK_DEFINE(bench_cpu_stats_work, bench_cpu_stats_work_handler);
+
+static uint8_t bench_raw_cb(uint32_t len, const uint8_t *data, void *priv)
+{
+	ARG_UNUSED(priv);
+
+	if (len != 1 || data[0] != BENCH_CMD_CPU_STATS) {
+		return GB_OP_INVALID;
+	}
+
+	/* Sample outside of the receive path, so that the response is not held back */
+	k_work_submit(&bench_cpu_stats_work);
+
+	return GB_OP_SUCCESS;
+}
+
+int main(void)
+{
+	raw_id = greybus_raw_register(bench_raw_cb, NULL);
+	if (raw_id < 0) {
+		LOG_ERR("Failed to register raw callback (%d)", raw_id);
+		return raw_id;
+	}
+
+	LOG_INF("Waiting for the load generator on port 4242");
+
+	return 0;
+}
@@ -1,168 +1,450 @@
 #include <greybus/apbridge.h>
 #include <zephyr/sys/errno_private.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
 
 LOG_MODULE_REGISTER(greybus_apbridge, CONFIG_GREYBUS_LOG_LEVEL);
 
-struct node_ap_item {
-	struct gb_interface *node_intf;
-	uint16_t node_cport;
+/*
+ * A route from one interface cport to another. Each connection is stored as two routes, one in
+ * each direction, so that lookups are the same from either end.
+ */
+struct gb_route {
+	uint16_t src_cport;
+	uint16_t dst_cport;
+	uint8_t src_intf;
+	uint8_t dst_intf;
+	bool used;
 };
 
-static struct node_ap_item node_ap_map[AP_MAX_NODES] = {0};
+/* Two routes per connection, and the table is kept at most half full */
+#define ROUTE_TABLE_SIZE  (AP_MAX_CONNECTIONS * 4)
+#define ROUTE_TABLE_MASK  (ROUTE_TABLE_SIZE - 1)
+#define ROUTE_TABLE_LIMIT (AP_MAX_CONNECTIONS * 2)
 
-static int node_ap_add(uint16_t ap_cport, uint16_t node_cport, struct gb_interface *node_intf)
+/* Open addressing with linear probing, keyed by (src_intf, src_cport) */
+static struct gb_route routes[ROUTE_TABLE_SIZE];
+static size_t routes_used;
+static struct k_spinlock routes_lock;
+
+static size_t route_hash(uint8_t intf_id, uint16_t cport)
 {
-	if (ap_cport >= ARRAY_SIZE(node_ap_map)) {
-		return -EOVERFLOW;
+	return (((uint32_t)intf_id << 16 | cport) * 0x9E3779B1U) >> 16 & ROUTE_TABLE_MASK;
+}
+
+/*
+ * Find the slot of a route. If the route does not exist, the first empty slot in its probe
+ * sequence is returned instead. The probe is bounded by the table size, so ROUTE_TABLE_SIZE is
+ * returned if the table is full and the route is not in it.
+ */
+static size_t route_slot(uint8_t intf_id, uint16_t cport)
+{
+	size_t i = route_hash(intf_id, cport);
+	size_t step;
+
+	for (step = 0; step < ROUTE_TABLE_SIZE; step++) {
+		if (!routes[i].used ||
+		    (routes[i].src_intf == intf_id && routes[i].src_cport == cport)) {
+			return i;
+		}
+		i = (i + 1) & ROUTE_TABLE_MASK;
 	}
 
-	if (node_ap_map[ap_cport].node_intf) {
+	return ROUTE_TABLE_SIZE;
+}
+
+static bool route_slot_used(size_t slot)
+{
+	return slot < ROUTE_TABLE_SIZE && routes[slot].used;
+}
+
+static void route_remove_slot(size_t slot)
+{
+	size_t next = slot, home;
+
+	routes[slot].used = false;
+	routes_used--;
+
+	/* Shift back entries that would otherwise become unreachable */
+	while (true) {
+		next = (next + 1) & ROUTE_TABLE_MASK;
+		if (!routes[next].used) {
+			return;
+		}
+
+		home = route_hash(routes[next].src_intf, routes[next].src_cport);
+		if (((next - home) & ROUTE_TABLE_MASK) >= ((next - slot) & ROUTE_TABLE_MASK)) {
+			routes[slot] = routes[next];
+			routes[next].used = false;
+			slot = next;
+		}
+	}
+}
+
+static int route_add(uint8_t intf1_id, uint16_t intf1_cport, uint8_t intf2_id,
+		     uint16_t intf2_cport)
+{
+	size_t slot1, slot2;
+	k_spinlock_key_t key = k_spin_lock(&routes_lock);
+
+	slot1 = route_slot(intf1_id, intf1_cport);
+	slot2 = route_slot(intf2_id, intf2_cport);
+	if (route_slot_used(slot1) || route_slot_used(slot2)) {
+		k_spin_unlock(&routes_lock, key);
 		return -EALREADY;
 	}
 
-	node_ap_map[ap_cport].node_cport = node_cport;
-	node_ap_map[ap_cport].node_intf = node_intf;
+	if (routes_used + 2 > ROUTE_TABLE_LIMIT) {
+		k_spin_unlock(&routes_lock, key);
+		return -ENOMEM;
+	}
+
+	routes[slot1] = (struct gb_route){
+		.src_intf = intf1_id,
+		.src_cport = intf1_cport,
+		.dst_intf = intf2_id,
+		.dst_cport = intf2_cport,
+		.used = true,
+	};
+
+	/* Inserting the first route might have taken the slot of the second */
+	slot2 = route_slot(intf2_id, intf2_cport);
+	routes[slot2] = (struct gb_route){
+		.src_intf = intf2_id,
+		.src_cport = intf2_cport,
+		.dst_intf = intf1_id,
+		.dst_cport = intf1_cport,
+		.used = true,
+	};
+	routes_used += 2;
+
+	k_spin_unlock(&routes_lock, key);
 
 	return 0;
 }
 
-static int node_ap_remove(uint16_t ap_cport)
+static void route_remove(uint8_t intf1_id, uint16_t intf1_cport, uint8_t intf2_id,
+			 uint16_t intf2_cport)
+{
+	size_t slot;
+	k_spinlock_key_t key = k_spin_lock(&routes_lock);
+
+	slot = route_slot(intf1_id, intf1_cport);
+	if (route_slot_used(slot)) {
+		route_remove_slot(slot);
+	}
+
+	slot = route_slot(intf2_id, intf2_cport);
+	if (route_slot_used(slot)) {
+		route_remove_slot(slot);
+	}
+
+	k_spin_unlock(&routes_lock, key);
+}
+
+static int route_lookup(uint8_t intf_id, uint16_t cport, uint8_t *dst_intf, uint16_t *dst_cport)
 {
-	if (ap_cport >= ARRAY_SIZE(node_ap_map)) {
-		return -EOVERFLOW;
+	size_t slot;
+	int ret = -ENOENT;
+	k_spinlock_key_t key = k_spin_lock(&routes_lock);
+
+	slot = route_slot(intf_id, cport);
+	if (route_slot_used(slot)) {
+		*dst_intf = routes[slot].dst_intf;
+		*dst_cport = routes[slot].dst_cport;
+		ret = 0;
 	}
 
-	node_ap_map[ap_cport].node_cport = 0;
-	node_ap_map[ap_cport].node_intf = NULL;
+	k_spin_unlock(&routes_lock, key);
 
+	return ret;
+}
+
+int gb_apbridge_init(void)
+{
 	return 0;
 }
 
-static int node_to_ap_cport(uint8_t node_id, uint16_t node_cport)
+void gb_apbridge_deinit(void)
 {
-	const struct node_ap_item *item;
+	k_spinlock_key_t key = k_spin_lock(&routes_lock);
 
-	for (size_t i = 0; i < ARRAY_SIZE(node_ap_map); i++) {
-		item = &node_ap_map[i];
+	memset(routes, 0, sizeof(routes));
+	routes_used = 0;
 
-		if (item->node_intf && item->node_intf->id == node_id &&
-		    item->node_cport == node_cport) {
-			return i;
+	k_spin_unlock(&routes_lock, key);
+}
+
+/*
+ * Helper to check one end of a connection. AP cports are limited by the routing table, other
+ * ends must be registered interfaces.
+ */
+static int connection_end_check(uint8_t intf_id, uint16_t cport)
+{
+	if (intf_id == AP_INF_ID) {
+		if (cport >= AP_MAX_NODES) {
+			LOG_ERR("AP cport %u out of range", cport);
+			return -EOVERFLOW;
 		}
+		return 0;
 	}
 
-	return -EINVAL;
+	if (!gb_interface_get(intf_id)) {
+		LOG_ERR("Failed to find interface %u", intf_id);
+		return -EINVAL;
+	}
+
+	return 0;
 }
 
-int gb_apbridge_init(void)
+/*
+ * Helper to notify a node interface of a new connection. The AP side is not notified.
+ */
+static int connection_end_create(uint8_t intf_id, uint16_t cport)
 {
+	struct gb_interface *intf;
+
+	if (intf_id == AP_INF_ID) {
+		return 0;
+	}
+
+	intf = gb_interface_get(intf_id);
+
+	/* create_connection is optional */
+	if (intf && intf->create_connection) {
+		return intf->create_connection(intf, cport);
+	}
+
 	return 0;
 }
 
-void gb_apbridge_deinit(void)
+static void connection_end_destroy(uint8_t intf_id, uint16_t cport)
 {
-	for (size_t i = 0; i < ARRAY_SIZE(node_ap_map); ++i) {
-		node_ap_map[i].node_cport = 0;
-		node_ap_map[i].node_intf = NULL;
+	struct gb_interface *intf;
+
+	if (intf_id == AP_INF_ID) {
+		return;
+	}
+
+	intf = gb_interface_get(intf_id);
+
+	/* Ignore if intf has already been cleaned up, or if destroy_connection is not defined */
+	if (intf && intf->destroy_connection) {
+		intf->destroy_connection(intf, cport);
 	}
 }
 
 int gb_apbridge_connection_create(uint8_t intf1_id, uint16_t intf1_cport, uint8_t intf2_id,
 				  uint16_t intf2_cport)
 {
-	struct gb_interface *intf;
-	uint8_t node_id;
-	uint16_t ap_cport, node_cport;
 	int ret;
 
-	if (intf1_id == AP_INF_ID) {
-		node_id = intf2_id;
-		node_cport = intf2_cport;
-		ap_cport = intf1_cport;
-	} else if (intf2_id == AP_INF_ID) {
-		node_id = intf1_id;
-		node_cport = intf1_cport;
-		ap_cport = intf2_cport;
-	} else {
-		LOG_ERR("Cannot create connection between two non-AP");
+	if (intf1_id == AP_INF_ID && intf2_id == AP_INF_ID) {
+		LOG_ERR("Cannot create connection between two AP cports");
 		return -EINVAL;
 	}
 
-	intf = gb_interface_get(node_id);
-	if (!intf) {
-		LOG_ERR("Failed to find node interface");
-		return -EINVAL;
+	ret = connection_end_check(intf1_id, intf1_cport);
+	if (ret < 0) {
+		return ret;
 	}
 
-	/* create_connection is optional */
-	if (intf->create_connection) {
-		ret = intf->create_connection(intf, node_cport);
-		if (ret < 0) {
-			LOG_ERR("Failed to create node connection");
-			return ret;
-		}
+	ret = connection_end_check(intf2_id, intf2_cport);
+	if (ret < 0) {
+		return ret;
 	}
 
-	ret = node_ap_add(ap_cport, node_cport, intf);
+	ret = connection_end_create(intf1_id, intf1_cport);
 	if (ret < 0) {
-		LOG_ERR("Failed to add AP to node");
+		LOG_ERR("Failed to create connection on interface %u", intf1_id);
 		return ret;
 	}
 
+	ret = connection_end_create(intf2_id, intf2_cport);
+	if (ret < 0) {
+		LOG_ERR("Failed to create connection on interface %u", intf2_id);
+		goto destroy_intf1;
+	}
+
+	/* Node to node traffic is forwarded within the bridge without going through the AP */
+	ret = route_add(intf1_id, intf1_cport, intf2_id, intf2_cport);
+	if (ret < 0) {
+		LOG_ERR("Failed to add route");
+		goto destroy_intf2;
+	}
+
 	return 0;
+
+destroy_intf2:
+	connection_end_destroy(intf2_id, intf2_cport);
+destroy_intf1:
+	connection_end_destroy(intf1_id, intf1_cport);
+	return ret;
 }
 
 int gb_apbridge_connection_destroy(uint8_t intf1_id, uint16_t intf1_cport, uint8_t intf2_id,
 				   uint16_t intf2_cport)
 {
-	uint8_t node_id;
-	struct gb_interface *intf;
-	uint16_t ap_cport, node_cport;
-
-	if (intf1_id == AP_INF_ID) {
-		node_id = intf2_id;
-		node_cport = intf2_cport;
-		ap_cport = intf1_cport;
-	} else if (intf2_id == AP_INF_ID) {
-		node_id = intf1_id;
-		node_cport = intf1_cport;
-		ap_cport = intf2_cport;
-	} else {
-		LOG_ERR("Cannot destroy connection between two non-AP");
-		return -EINVAL;
+	connection_end_destroy(intf1_id, intf1_cport);
+	connection_end_destroy(intf2_id, intf2_cport);
+
+	route_remove(intf1_id, intf1_cport, intf2_id, intf2_cport);
+
+	return 0;
+}
+
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+
+static K_THREAD_STACK_DEFINE(gb_apbridge_wq_stack,
+			     CONFIG_GREYBUS_APBRIDGE_TX_QUEUE_WQ_STACK_SIZE);
+static struct k_work_q gb_apbridge_wq;
+
+static void gb_interface_tx_work_handler(struct k_work *work)
+{
+	struct gb_interface_tx_queue *txq = CONTAINER_OF(work, struct gb_interface_tx_queue, work);
+	struct gb_interface *intf = CONTAINER_OF(txq, struct gb_interface, tx_queue);
+	struct gb_msg_with_cport item;
+	k_spinlock_key_t key;
+	int ret;
+
+	while (true) {
+		key = k_spin_lock(&txq->lock);
+		if (!txq->num) {
+			k_spin_unlock(&txq->lock, key);
+			return;
+		}
+		item = txq->items[txq->head];
+		txq->head = (txq->head + 1) % ARRAY_SIZE(txq->items);
+		txq->num--;
+		k_spin_unlock(&txq->lock, key);
+
+		/* Nobody is left to hand the message back to */
+		ret = intf->write(intf, item.msg, item.cport);
+		if (ret < 0) {
+			LOG_ERR("Failed to write to interface %u cport %u (%d)", intf->id,
+				item.cport, ret);
+			gb_message_dealloc(item.msg);
+		}
 	}
+}
 
-	intf = gb_interface_get(node_id);
-	/* Ignore if intf has already been cleaned up, or if destroy_connection is not defined */
-	if (intf && intf->destroy_connection) {
-		intf->destroy_connection(intf, node_cport);
+/*
+ * Helper to queue a message for an interface. Returns -ENOTCONN if the queue is not started, in
+ * which case the message is written inline.
+ */
+static int gb_interface_tx_queue_put(struct gb_interface *intf, struct gb_message *msg,
+				     uint16_t cport)
+{
+	struct gb_interface_tx_queue *txq = &intf->tx_queue;
+	struct k_work_q *wq;
+	k_spinlock_key_t key = k_spin_lock(&txq->lock);
+
+	wq = txq->wq;
+	if (!wq) {
+		k_spin_unlock(&txq->lock, key);
+		return -ENOTCONN;
+	}
+
+	if (txq->num == ARRAY_SIZE(txq->items)) {
+		k_spin_unlock(&txq->lock, key);
+		LOG_WRN("TX queue of interface %u is full", intf->id);
+		return -ENOBUFS;
 	}
 
-	node_ap_remove(ap_cport);
+	txq->items[(txq->head + txq->num) % ARRAY_SIZE(txq->items)] = (struct gb_msg_with_cport){
+		.cport = cport,
+		.msg = msg,
+	};
+	txq->num++;
+	k_spin_unlock(&txq->lock, key);
+
+	k_work_submit_to_queue(wq, &txq->work);
+
+	return 0;
+}
+
+int gb_interface_tx_queue_start(struct gb_interface *intf, struct k_work_q *wq)
+{
+	struct gb_interface_tx_queue *txq = &intf->tx_queue;
+	k_spinlock_key_t key;
+
+	if (txq->wq) {
+		return -EALREADY;
+	}
+
+	k_work_init(&txq->work, gb_interface_tx_work_handler);
+
+	key = k_spin_lock(&txq->lock);
+	txq->head = 0;
+	txq->num = 0;
+	txq->wq = wq ? wq : &gb_apbridge_wq;
+	k_spin_unlock(&txq->lock, key);
+
+	return 0;
+}
+
+void gb_interface_tx_queue_stop(struct gb_interface *intf)
+{
+	struct gb_interface_tx_queue *txq = &intf->tx_queue;
+	struct k_work_sync sync;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&txq->lock);
+	if (!txq->wq) {
+		k_spin_unlock(&txq->lock, key);
+		return;
+	}
+	txq->wq = NULL;
+	k_spin_unlock(&txq->lock, key);
+
+	k_work_cancel_sync(&txq->work, &sync);
+
+	for (; txq->num; txq->num--) {
+		gb_message_dealloc(txq->items[txq->head].msg);
+		txq->head = (txq->head + 1) % ARRAY_SIZE(txq->items);
+	}
+}
+
+static int gb_apbridge_wq_init(void)
+{
+	k_work_queue_start(&gb_apbridge_wq, gb_apbridge_wq_stack,
+			   K_THREAD_STACK_SIZEOF(gb_apbridge_wq_stack),
+			   CONFIG_GREYBUS_APBRIDGE_TX_QUEUE_WQ_PRIORITY, NULL);
+	k_thread_name_set(&gb_apbridge_wq.thread, "gb_apbridge_wq");
 
 	return 0;
 }
 
+SYS_INIT(gb_apbridge_wq_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+
 int gb_apbridge_send(uint8_t intf_id, uint16_t intf_cport, struct gb_message *msg)
 {
 	struct gb_interface *intf;
 	uint16_t target_cport;
+	uint8_t target_intf;
 	int ret;
 
-	if (intf_id == AP_INF_ID) {
-		intf = node_ap_map[intf_cport].node_intf;
-		target_cport = node_ap_map[intf_cport].node_cport;
-	} else {
-		ret = node_to_ap_cport(intf_id, intf_cport);
-		if (ret < 0) {
-			LOG_ERR("Failed to find AP cport");
-			return ret;
-		}
+	ret = route_lookup(intf_id, intf_cport, &target_intf, &target_cport);
+	if (ret < 0) {
+		LOG_ERR("No connection for interface %u cport %u", intf_id, intf_cport);
+		return ret;
+	}
 
-		intf = gb_interface_get(AP_INF_ID);
-		target_cport = ret;
+	intf = gb_interface_get(target_intf);
+	if (!intf) {
+		LOG_ERR("Interface %u is gone", target_intf);
+		return -ENODEV;
+	}
+
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+	ret = gb_interface_tx_queue_put(intf, msg, target_cport);
+	if (ret != -ENOTCONN) {
+		return ret;
 	}
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
 
 	return intf->write(intf, msg, target_cport);
 }
@@ -24,508 +24,623 @@
  * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
  * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @brief Greybus Camera Protocol Driver
  */
 
-#include <stdlib.h>
-#include <stdbool.h>
-#include <string.h>
-#include <greybus/greybus.h>
-#include <zephyr/sys/byteorder.h>
+#include <zephyr/drivers/video.h>
+#include <zephyr/init.h>
 #include <zephyr/logging/log.h>
-LOG_MODULE_REGISTER(greybus_camera, CONFIG_GREYBUS_LOG_LEVEL);
-
-#include "camera-gb.h"
+#include <zephyr/sys/byteorder.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/greybus_messages.h>
+#include <greybus-utils/manifest.h>
+#include "greybus-manifest.h"
+#include "greybus_cport.h"
+#include "greybus_transport.h"
+#include "greybus_internal.h"
+#include "greybus_camera.h"
 
-#define GB_CAMERA_VERSION_MAJOR 0
-#define GB_CAMERA_VERSION_MINOR 1
+LOG_MODULE_REGISTER(greybus_camera, CONFIG_GREYBUS_LOG_LEVEL);
 
 /* Camera protocol error codes */
 #define GB_CAM_OP_INVALID_STATE 0x80
 
-/* Reserved value for not used data type */
-#define GB_CAM_DT_NOT_USED 0x00
+/* Frames are not carried over CSI-2, so the virtual channel is always 0 */
+#define GB_CAM_VIRTUAL_CHANNEL 0
+
+/* Lets the transmit work notice a stop request when no frame arrives */
+#define GB_CAMERA_DEQUEUE_TIMEOUT_MS 100
+
+static const struct gb_camera_format {
+	uint32_t pixelformat;
+	uint16_t gb_format;
+	/* CSI-2 data type reported to the AP */
+	uint8_t data_type;
+	/* Bits per pixel, 0 for compressed formats */
+	uint8_t bpp;
+} gb_camera_formats[] = {
+	{VIDEO_PIX_FMT_UYVY, 0x01, 0x1e, 16},
+	{VIDEO_PIX_FMT_JPEG, 0x40, 0x30, 0},
+};
 
-/* Camera protocol operational model */
-#define STATE_REMOVED      0
-#define STATE_INSERTED     1
-#define STATE_UNCONFIGURED 2
-#define STATE_CONFIGURED   3
-#define STATE_STREAMING    4
+static K_THREAD_STACK_DEFINE(gb_camera_wq_stack, CONFIG_GREYBUS_CAMERA_WQ_STACK_SIZE);
+static struct k_work_q gb_camera_wq;
 
-/**
- * Camera protocol private information.
- */
-struct gb_camera_info {
-	/** CPort from greybus */
-	unsigned int cport;
-	/** Camera driver handle */
-	struct device *dev;
-	/** Camera operational model */
-	uint8_t state;
-};
+struct gb_camera_configure_streams_response_full {
+	struct gb_camera_configure_streams_response resp;
+	struct gb_camera_stream_config_response config;
+} __packed;
 
-static struct gb_camera_info *info = NULL;
+static const struct gb_camera_format *gb_camera_format_get(uint32_t pixelformat)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(gb_camera_formats); i++) {
+		if (gb_camera_formats[i].pixelformat == pixelformat) {
+			return &gb_camera_formats[i];
+		}
+	}
 
-/**
- * @brief Returns the major and minor Greybus Camera Protocol version number
- *
- * This operation returns the major and minor version number supported by
- * Greybus Camera Protocol
- *
- * @param operation Pointer to structure of Greybus operation.
- * @return GB_OP_SUCCESS on success, error code on failure.
- */
-static uint8_t gb_camera_protocol_version(struct gb_operation *operation)
+	return NULL;
+}
+
+static uint32_t gb_camera_pixelformat_get(uint16_t gb_format)
 {
-	struct gb_camera_version_response *response;
+	for (size_t i = 0; i < ARRAY_SIZE(gb_camera_formats); i++) {
+		if (gb_camera_formats[i].gb_format == gb_format) {
+			return gb_camera_formats[i].pixelformat;
+		}
+	}
 
-	LOG_DBG("gb_camera_protocol_version() + ");
+	return 0;
+}
 
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+/* Compressed frames are assumed to never be larger than 16 bits per pixel */
+static uint32_t gb_camera_frame_size(const struct video_format *fmt,
+				     const struct gb_camera_format *info)
+{
+	if (fmt->pitch) {
+		return fmt->pitch * fmt->height;
 	}
 
-	response->major = GB_CAMERA_VERSION_MAJOR;
-	response->minor = GB_CAMERA_VERSION_MINOR;
+	return fmt->width * fmt->height * (info->bpp ? info->bpp : 16) / 8;
+}
 
-	LOG_DBG("gb_camera_protocol_version() - ");
+static uint32_t gb_camera_dim_adjust(uint32_t val, uint32_t min, uint32_t max, uint16_t step)
+{
+	val = CLAMP(val, min, max);
 
-	return GB_OP_SUCCESS;
+	return step ? min + ROUND_DOWN(val - min, step) : val;
 }
 
-/**
- * @brief Get Camera capabilities
- *
- * This operation retrieves the list of capabilities of the Camera Module and
- * then returns to host.
- *
- * @param operation Pointer to structure of Greybus operation.
- * @return GB_OP_SUCCESS on success, error code on failure.
+/*
+ * Fit the requested format into the capabilities of the video device. Falls back to the first
+ * format of the device that can be carried over Greybus when the pixel format is not supported.
  */
-static uint8_t gb_camera_capabilities(struct gb_operation *operation)
+static int gb_camera_format_adjust(const struct gb_camera_driver_data *data,
+				   struct video_format *fmt)
 {
-	struct gb_camera_capabilities_response *response;
-	const uint8_t *caps;
-	size_t size;
 	int ret;
+	const struct video_format_cap *cap, *fallback = NULL;
+	struct video_caps caps = {.type = VIDEO_BUF_TYPE_OUTPUT};
 
-	LOG_DBG("gb_camera_capabilities() + ");
-
-	if (info->state < STATE_UNCONFIGURED) {
-		LOG_DBG("state error %d ", info->state);
-		return GB_OP_INVALID;
+	ret = video_get_caps(data->dev, &caps);
+	if (ret < 0) {
+		return ret;
 	}
 
-	/* Retrieve the capabilities and their size. */
-	ret = device_camera_capabilities(info->dev, &size, &caps);
-	if (ret) {
-		return gb_errno_to_op_result(ret);
-	}
+	for (cap = caps.format_caps; cap->pixelformat; cap++) {
+		if (cap->pixelformat == fmt->pixelformat) {
+			break;
+		}
 
-	if (size > GB_MAX_PAYLOAD_SIZE) {
-		return GB_OP_NO_MEMORY;
+		if (!fallback && gb_camera_format_get(cap->pixelformat)) {
+			fallback = cap;
+		}
 	}
 
-	response = gb_operation_alloc_response(operation, sizeof(*response) + size);
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	if (!cap->pixelformat) {
+		if (!fallback) {
+			return -ENOTSUP;
+		}
+		cap = fallback;
 	}
 
-	memcpy(response->capabilities, caps, size);
+	fmt->pixelformat = cap->pixelformat;
+	fmt->width = gb_camera_dim_adjust(fmt->width, cap->width_min, cap->width_max,
+					  cap->width_step);
+	fmt->height = gb_camera_dim_adjust(fmt->height, cap->height_min, cap->height_max,
+					   cap->height_step);
 
-	LOG_DBG("gb_camera_capabilities() - ");
+	return 0;
+}
 
-	return GB_OP_SUCCESS;
+static void gb_camera_buffers_release(struct gb_camera_driver_data *data)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(data->buffers); i++) {
+		if (data->buffers[i]) {
+			video_buffer_release(data->buffers[i]);
+			data->buffers[i] = NULL;
+		}
+	}
 }
 
-struct csi_bus_config {
-	int fooey;
-};
-/**
- * @brief Configure camera module streams
- *
- * The Configure Streams operation configures or unconfigures the Camera Module
- * to prepare or stop video capture.
+static int gb_camera_buffers_alloc(struct gb_camera_driver_data *data, size_t size)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(data->buffers); i++) {
+		data->buffers[i] = video_buffer_alloc(size, K_NO_WAIT);
+		if (!data->buffers[i]) {
+			gb_camera_buffers_release(data);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Stop the video device and take back all buffers. Stopping the stream cancels the buffers still
+ * waiting for a frame, so they can all be dequeued right away.
  *
- * @param operation pointer to structure of Greybus operation message
- * @return GB_OP_SUCCESS on success, error code on failure
+ * Must be called with the lock held, after the transmit work has finished.
  */
-static uint8_t gb_camera_configure_streams(struct gb_operation *operation)
+static void gb_camera_stream_stop_locked(struct gb_camera_driver_data *data)
 {
-	struct gb_camera_configure_streams_request *request;
-	struct gb_camera_configure_streams_response *response;
-	struct gb_stream_config_req *cfg_set_req;
-	struct gb_stream_config_resp *cfg_ans_resp;
-	struct streams_cfg_req *cfg_request;
-	struct streams_cfg_ans *cfg_answer;
-	struct csi_bus_config csi_cfg;
-	uint8_t num_streams;
-	uint8_t res_flags = 0;
-	int i, ret;
+	struct video_buffer *vbuf;
 
-	LOG_DBG("gb_camera_configure_streams() + ");
+	if (data->state != GB_CAMERA_STATE_STREAMING) {
+		return;
+	}
 
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
-		LOG_ERR("dropping short message ");
-		return GB_OP_INVALID;
+	video_stream_stop(data->dev, VIDEO_BUF_TYPE_OUTPUT);
+	while (video_dequeue(data->dev, &vbuf, K_NO_WAIT) == 0) {
 	}
 
-	request = gb_operation_get_request_payload(operation);
+	data->state = GB_CAMERA_STATE_CONFIGURED;
+}
 
-	num_streams = request->num_streams;
-	LOG_DBG("num_streams = %d ", num_streams);
-	LOG_DBG("req flags = %d ", request->flags);
+static void gb_camera_stream_stop(struct gb_camera_driver_data *data)
+{
+	struct k_work_sync sync;
 
-	if (num_streams > MAX_STREAMS_NUM) {
-		return GB_OP_INVALID;
-	}
+	k_mutex_lock(&data->lock, K_FOREVER);
+	data->streaming = false;
+	k_mutex_unlock(&data->lock);
 
-	/* Check if the request is acceptable in the current state. */
-	if (num_streams == 0) {
-		if (info->state < STATE_UNCONFIGURED || info->state > STATE_CONFIGURED) {
-			return GB_OP_INVALID;
-		}
-	} else {
-		if (info->state != STATE_UNCONFIGURED) {
-			return GB_OP_INVALID;
+	k_work_cancel_sync(&data->tx_work, &sync);
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	gb_camera_stream_stop_locked(data);
+	k_mutex_unlock(&data->lock);
+}
+
+static int gb_camera_stream_start_locked(struct gb_camera_driver_data *data)
+{
+	int ret;
+
+	for (size_t i = 0; i < ARRAY_SIZE(data->buffers); i++) {
+		ret = video_enqueue(data->dev, data->buffers[i]);
+		if (ret < 0) {
+			goto fail;
 		}
 	}
 
-	/* Zero streams unconfigures the camera, move to the unconfigured state. */
-	if (num_streams == 0) {
-		info->state = STATE_UNCONFIGURED;
+	ret = video_stream_start(data->dev, VIDEO_BUF_TYPE_OUTPUT);
+	if (ret < 0) {
+		goto fail;
+	}
 
-		ret = device_camera_set_streams_cfg(info->dev, &num_streams, NULL, 0, NULL, NULL,
-						    NULL);
-		if (ret) {
-			return gb_errno_to_op_result(ret);
-		}
+	data->state = GB_CAMERA_STATE_STREAMING;
+	data->streaming = true;
+	k_work_submit_to_queue(&gb_camera_wq, &data->tx_work);
 
-		response = gb_operation_alloc_response(operation, sizeof(*response));
-		return GB_OP_SUCCESS;
-	}
-
-	/* Otherwise pass stream configuration to the camera module. */
-	cfg_set_req = request->config;
-	cfg_request = malloc(num_streams * sizeof(*cfg_request));
-	if (!cfg_request) {
-		return GB_OP_NO_MEMORY;
-	}
-
-	/* convert data for driver */
-	for (i = 0; i < num_streams; i++) {
-		LOG_DBG("   stream #%d", i);
-		cfg_request[i].width = sys_le16_to_cpu(cfg_set_req[i].width);
-		cfg_request[i].height = sys_le16_to_cpu(cfg_set_req[i].height);
-		cfg_request[i].format = sys_le16_to_cpu(cfg_set_req[i].format);
-		cfg_request[i].padding = sys_le16_to_cpu(cfg_set_req[i].padding);
-
-		LOG_DBG("    width = %d ", cfg_request[i].width);
-		LOG_DBG("    height = %d ", cfg_request[i].height);
-		LOG_DBG("    format = %d ", cfg_request[i].format);
-		LOG_DBG("    padding = %d ", cfg_request[i].padding);
-	}
-
-	/* alloc for getting answer from driver */
-	cfg_answer = malloc(MAX_STREAMS_NUM * sizeof(*cfg_answer));
-	if (!cfg_answer) {
-		ret = GB_OP_NO_MEMORY;
-		goto err_free_req_mem;
-	}
-
-	/* driver shall check the num_streams, it can't exceed its capability */
-	ret = device_camera_set_streams_cfg(info->dev, &num_streams, &csi_cfg, request->flags,
-					    cfg_request, &res_flags, cfg_answer);
-	if (ret) {
-		/* FIXME:
-		 * add greybus protocol error for EIO operations.
-		 * For now, return OP_INVALID
-		 */
-		LOG_DBG("Camera module reported error in configure stream %d", ret);
-		ret = GB_OP_INVALID;
-		goto err_free_ans_mem;
-	}
-
-	/*
-	 * If the requested format is not supported keep camera in un-configured
-	 * state;
-	 * Stay un-configured anyhow if AP is just testing format;
-	 * Move to configured otherwise
-	 */
-	if (res_flags & CAMERA_CONF_STREAMS_ADJUSTED) {
-		info->state = STATE_UNCONFIGURED;
-	} else if (request->flags & CAMERA_CONF_STREAMS_TEST_ONLY) {
-		info->state = STATE_UNCONFIGURED;
-	} else {
-		info->state = STATE_CONFIGURED;
-	}
-
-	/* Create and fill the greybus response. */
-	LOG_DBG("Resp: ");
-	response = gb_operation_alloc_response(
-		operation, sizeof(*response) + request->num_streams * sizeof(*cfg_ans_resp));
-	response->num_streams = num_streams;
-	response->flags = res_flags;
-	response->num_lanes = csi_cfg.num_lanes;
-	response->padding = 0;
-	response->bus_freq = sys_cpu_to_le32(csi_cfg.bus_freq);
-	response->lines_per_second = sys_cpu_to_le32(csi_cfg.lines_per_second);
-
-	LOG_DBG("flags = 0x%2x", response->flags);
-	LOG_DBG("lanes = %u", response->num_lanes);
-	LOG_DBG("freq = %u", csi_cfg.bus_freq);
-	LOG_DBG("lines = %u", csi_cfg.lines_per_second);
-
-	for (i = 0; i < num_streams; i++) {
-		cfg_ans_resp = &response->config[i];
-
-		LOG_DBG("");
-		LOG_DBG("    width = %d ", cfg_answer[i].width);
-		LOG_DBG("    height = %d ", cfg_answer[i].height);
-		LOG_DBG("    format = %d ", cfg_answer[i].format);
-		LOG_DBG("    virtual_channel = %d ", cfg_answer[i].virtual_channel);
-		LOG_DBG("    data_type = %d ", cfg_answer[i].data_type);
-		LOG_DBG("    max_size = %d ", cfg_answer[i].max_size);
-
-		cfg_ans_resp->width = sys_cpu_to_le16(cfg_answer[i].width);
-		cfg_ans_resp->height = sys_cpu_to_le16(cfg_answer[i].height);
-		cfg_ans_resp->format = sys_cpu_to_le16(cfg_answer[i].format);
-		cfg_ans_resp->virtual_channel = cfg_answer[i].virtual_channel;
-
-		/*
-		 * FIXME
-		 * The API towards the camera driver supports a single data type
-		 * for now, always return NOT_USED for the second data type
-		 */
-		cfg_ans_resp->data_type[0] = cfg_answer[i].data_type;
-		cfg_ans_resp->data_type[1] = GB_CAM_DT_NOT_USED;
-
-		cfg_ans_resp->padding[0] = 0;
-		cfg_ans_resp->padding[1] = 0;
-		cfg_ans_resp->padding[2] = 0;
-		cfg_ans_resp->max_size = sys_cpu_to_le32(cfg_answer[i].max_size);
-	}
-
-	ret = GB_OP_SUCCESS;
-
-err_free_ans_mem:
-	free(cfg_answer);
-err_free_req_mem:
-	free(cfg_request);
-
-	LOG_DBG("gb_camera_configure_streams() %d - ", ret);
+	return 0;
+
+fail:
+	/* Take back the buffers queued so far */
+	data->state = GB_CAMERA_STATE_STREAMING;
+	gb_camera_stream_stop_locked(data);
 	return ret;
 }
 
-/**
- * @brief Engage camera capture operation
- *
- * It tell camera module to start capture.
- *
- * @param operation pointer to structure of Greybus operation message
- * @return GB_OP_SUCCESS on success, error code on failure
- */
-static uint8_t gb_camera_capture(struct gb_operation *operation)
+static void gb_camera_unconfigure(struct gb_camera_driver_data *data)
+{
+	gb_camera_stream_stop(data);
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	gb_camera_buffers_release(data);
+	data->state = GB_CAMERA_STATE_UNCONFIGURED;
+	k_mutex_unlock(&data->lock);
+}
+
+static void gb_camera_capabilities(uint16_t cport, struct gb_message *req)
+{
+	/* Capabilities are opaque to the protocol, the video API has none to report */
+	gb_transport_message_response_success_send(req, NULL, 0, cport);
+}
+
+static int gb_camera_configure_locked(struct gb_camera_driver_data *data,
+				      const struct video_format *fmt, size_t size)
 {
-	struct gb_camera_capture_request *request;
-	struct capture_info *capt_req;
-	size_t request_size;
 	int ret;
+	struct video_format applied = *fmt;
 
-	LOG_DBG("gb_camera_capture() + ");
+	gb_camera_buffers_release(data);
 
-	if (info->state != STATE_CONFIGURED && info->state != STATE_STREAMING) {
-		return GB_OP_INVALID;
+	ret = video_set_format(data->dev, &applied);
+	if (ret < 0) {
+		return ret;
 	}
 
-	request_size = gb_operation_get_request_payload_size(operation);
-	if (request_size < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return GB_OP_INVALID;
+	ret = gb_camera_buffers_alloc(data, size);
+	if (ret < 0) {
+		return ret;
 	}
 
-	request = gb_operation_get_request_payload(operation);
+	data->fmt = applied;
+	data->state = GB_CAMERA_STATE_CONFIGURED;
 
-	if (request->padding != 0) {
-		LOG_ERR("invalid padding value");
-		return GB_OP_INVALID;
-	}
+	return 0;
+}
 
-	capt_req = malloc(sizeof(*capt_req));
-	if (!capt_req) {
-		return GB_OP_NO_MEMORY;
+/*
+ * Only the first stream is supported. The configuration is applied as long as it needs no
+ * adjustment and the request is not a test.
+ */
+static void gb_camera_configure_streams(uint16_t cport, struct gb_message *req,
+					struct gb_camera_driver_data *data)
+{
+	int ret;
+	uint8_t status;
+	bool adjusted;
+	struct video_format fmt;
+	const struct gb_camera_format *info;
+	struct gb_camera_configure_streams_response_full resp = {0};
+	const struct gb_camera_configure_streams_request *req_data =
+		(const struct gb_camera_configure_streams_request *)req->payload;
+	const struct gb_camera_stream_config_request *cfg = &req_data->config[0];
+	const size_t req_len = gb_message_payload_len(req);
+
+	if (req_len < sizeof(*req_data) ||
+	    req_len < sizeof(*req_data) + req_data->num_streams * sizeof(req_data->config[0])) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	capt_req->request_id = sys_le32_to_cpu(request->request_id);
-	capt_req->streams = request->streams;
-	capt_req->num_frames = sys_le32_to_cpu(request->num_frames);
-	capt_req->settings = request->settings;
-	capt_req->settings_size = request_size - sizeof(*request);
+	if (req_data->num_streams > GB_CAMERA_MAX_STREAMS) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
 
-	LOG_DBG("    request_id = %d ", capt_req->request_id);
-	LOG_DBG("    streams = %d ", capt_req->streams);
-	LOG_DBG("    num_frames = %d ", capt_req->num_frames);
-	LOG_DBG("    settings_size = %u", capt_req->settings_size);
+	if (data->state == GB_CAMERA_STATE_STREAMING) {
+		return gb_transport_message_empty_response_send(req, GB_CAM_OP_INVALID_STATE,
+								cport);
+	}
 
-	ret = device_camera_capture(info->dev, capt_req);
-	if (ret) {
-		LOG_ERR("error in camera capture thread. ");
-		ret = gb_errno_to_op_result(ret);
-		goto err_free_mem;
+	if (req_data->num_streams == 0) {
+		if (!(req_data->flags & GB_CAMERA_CONFIGURE_STREAMS_TEST_ONLY)) {
+			gb_camera_unconfigure(data);
+		}
+		return gb_transport_message_response_success_send(req, &resp.resp,
+								  sizeof(resp.resp), cport);
 	}
 
-	free(capt_req);
+	fmt = (struct video_format){
+		.type = VIDEO_BUF_TYPE_OUTPUT,
+		.pixelformat = gb_camera_pixelformat_get(sys_le16_to_cpu(cfg->format)),
+		.width = sys_le16_to_cpu(cfg->width),
+		.height = sys_le16_to_cpu(cfg->height),
+	};
+
+	ret = gb_camera_format_adjust(data, &fmt);
+	if (ret < 0) {
+		LOG_ERR("No format supported by the video device: %d", ret);
+		return gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret),
+								cport);
+	}
 
-	LOG_DBG("gb_camera_capture() - ");
+	info = gb_camera_format_get(fmt.pixelformat);
+	adjusted = req_data->num_streams > 1 ||
+		   info->gb_format != sys_le16_to_cpu(cfg->format) ||
+		   fmt.width != sys_le16_to_cpu(cfg->width) ||
+		   fmt.height != sys_le16_to_cpu(cfg->height);
+
+	if (!adjusted && !(req_data->flags & GB_CAMERA_CONFIGURE_STREAMS_TEST_ONLY)) {
+		k_mutex_lock(&data->lock, K_FOREVER);
+		ret = gb_camera_configure_locked(data, &fmt, gb_camera_frame_size(&fmt, info));
+		if (ret == 0) {
+			fmt = data->fmt;
+		} else {
+			data->state = GB_CAMERA_STATE_UNCONFIGURED;
+		}
+		k_mutex_unlock(&data->lock);
 
-	return GB_OP_SUCCESS;
+		if (ret < 0) {
+			LOG_ERR("Failed to configure the video device: %d", ret);
+			status = gb_errno_to_op_result(ret);
+			return gb_transport_message_empty_response_send(req, status, cport);
+		}
+	}
 
-err_free_mem:
-	free(capt_req);
-	return ret;
+	resp.resp.num_streams = 1;
+	resp.resp.flags = adjusted ? GB_CAMERA_CONFIGURE_STREAMS_ADJUSTED : 0;
+	/* There is no CSI-2 link to size, frames are carried over the data cport */
+	resp.resp.data_rate = 0;
+	resp.config.width = sys_cpu_to_le16(fmt.width);
+	resp.config.height = sys_cpu_to_le16(fmt.height);
+	resp.config.format = sys_cpu_to_le16(info->gb_format);
+	resp.config.virtual_channel = GB_CAM_VIRTUAL_CHANNEL;
+	resp.config.data_type[0] = info->data_type;
+	resp.config.max_pkt_size = sys_cpu_to_le16(CONFIG_GREYBUS_CAMERA_CHUNK_SIZE);
+	resp.config.max_size = sys_cpu_to_le32(gb_camera_frame_size(&fmt, info));
+
+	gb_transport_message_response_success_send(req, &resp, sizeof(resp), cport);
 }
 
-/**
- * @brief Flush the camera capture
- *
- * The Flush operation calls camera driver to flush capture.
- *
- * @param operation pointer to structure of Greybus operation message
- * @return GB_OP_SUCCESS on success, error code on failure
+/*
+ * A capture request received while streaming replaces the one being served, starting with the
+ * next frame. Settings are not supported by the video API and are ignored.
  */
-static uint8_t gb_camera_flush(struct gb_operation *operation)
+static void gb_camera_capture(uint16_t cport, struct gb_message *req,
+			      struct gb_camera_driver_data *data)
 {
-	struct gb_camera_flush_response *response;
-	uint32_t request_id = 0;
 	int ret;
+	struct k_work_sync sync;
+	const struct gb_camera_capture_request *req_data =
+		(const struct gb_camera_capture_request *)req->payload;
 
-	LOG_DBG("gb_camera_flush() + ");
-
-	if (info->state != STATE_STREAMING && info->state != STATE_CONFIGURED) {
-		return GB_OP_INVALID;
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	ret = device_camera_flush(info->dev, &request_id);
-	if (ret) {
-		return gb_errno_to_op_result(ret);
+	if (req_data->streams != BIT(0)) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	info->state = STATE_CONFIGURED;
+	k_mutex_lock(&data->lock, K_FOREVER);
+	if (!data->streaming) {
+		/* Wait for the transmit work of a finished capture request to exit */
+		k_mutex_unlock(&data->lock);
+		k_work_cancel_sync(&data->tx_work, &sync);
+		k_mutex_lock(&data->lock, K_FOREVER);
+		gb_camera_stream_stop_locked(data);
+	}
 
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	if (data->state == GB_CAMERA_STATE_UNCONFIGURED) {
+		k_mutex_unlock(&data->lock);
+		return gb_transport_message_empty_response_send(req, GB_CAM_OP_INVALID_STATE,
+								cport);
 	}
 
-	response->request_id = sys_cpu_to_le32(request_id);
-	LOG_DBG("    request_id = %d + ", request_id);
+	data->request_id = sys_le32_to_cpu(req_data->request_id);
+	data->frames_left = sys_le16_to_cpu(req_data->num_frames);
+	data->frame_number = 0;
 
-	LOG_DBG("gb_camera_flush() + ");
+	ret = 0;
+	if (data->state == GB_CAMERA_STATE_CONFIGURED) {
+		ret = gb_camera_stream_start_locked(data);
+	}
+	k_mutex_unlock(&data->lock);
+
+	if (ret < 0) {
+		LOG_ERR("Failed to start streaming: %d", ret);
+		return gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret),
+								cport);
+	}
 
-	return GB_OP_SUCCESS;
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
 }
 
-/**
- * @brief Greybus Camera Protocol initialize function
- *
- * This function performs the protocol inintilization, such as open the
- * cooperation device driver and create buffers etc.
- *
- * @param cport CPort number
- * @param bundle Greybus bundle handle
- * @return 0 on success, negative errno on error
- */
-static int gb_camera_init(unsigned int cport, struct gb_bundle *bundle)
+static void gb_camera_flush(uint16_t cport, struct gb_message *req,
+			    struct gb_camera_driver_data *data)
 {
-	int ret;
-
-	LOG_DBG("gb_camera_init + ");
+	struct gb_camera_flush_response resp_data;
 
-	info = zalloc(sizeof(*info));
-	if (info == NULL) {
-		return -ENOMEM;
+	if (data->state == GB_CAMERA_STATE_UNCONFIGURED) {
+		return gb_transport_message_empty_response_send(req, GB_CAM_OP_INVALID_STATE,
+								cport);
 	}
 
-	info->cport = cport;
+	gb_camera_stream_stop(data);
 
-	info->state = STATE_INSERTED;
+	resp_data.request_id = sys_cpu_to_le32(data->request_id);
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
+}
+
+static void gb_camera_mgmt_handler(const void *priv, struct gb_message *msg, uint16_t cport)
+{
+	struct gb_camera_driver_data *data = (struct gb_camera_driver_data *)priv;
 
-	info->dev = device_open(DEVICE_TYPE_CAMERA_HW, 0);
-	if (!info->dev) {
-		return -EIO;
-		goto err_free_info;
+	switch (gb_message_type(msg)) {
+	case GB_CAMERA_TYPE_CAPABILITIES:
+		return gb_camera_capabilities(cport, msg);
+	case GB_CAMERA_TYPE_CONFIGURE_STREAMS:
+		return gb_camera_configure_streams(cport, msg, data);
+	case GB_CAMERA_TYPE_CAPTURE:
+		return gb_camera_capture(cport, msg, data);
+	case GB_CAMERA_TYPE_FLUSH:
+		return gb_camera_flush(cport, msg, data);
+	default:
+		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
 	}
+}
 
-	info->state = STATE_UNCONFIGURED;
+static void gb_camera_disconnected(const void *priv)
+{
+	gb_camera_unconfigure((struct gb_camera_driver_data *)priv);
+}
 
-	LOG_DBG("gb_camera_init - ");
+const struct gb_driver gb_camera_mgmt_driver = {
+	.disconnected = gb_camera_disconnected,
+	.op_handler = gb_camera_mgmt_handler,
+};
 
-	return 0;
+static void gb_camera_data_handler(const void *priv, struct gb_message *msg, uint16_t cport)
+{
+	/* The AP sends nothing on the data cport */
+	gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
+}
+
+const struct gb_driver gb_camera_data_driver = {
+	.disconnected = gb_camera_disconnected,
+	.op_handler = gb_camera_data_handler,
+};
 
-err_free_info:
-	free(info);
+static void gb_camera_metadata_send(const struct gb_camera_driver_data *data,
+				    const struct video_buffer *vbuf, uint32_t request_id,
+				    uint16_t frame_number)
+{
+	struct gb_camera_metadata_request *req_data;
+	struct gb_camera_frame_metadata *meta;
+	struct gb_message *req = gb_message_request_alloc(sizeof(*req_data) + sizeof(*meta),
+							  GB_CAMERA_TYPE_METADATA, true);
 
-	return ret;
+	if (!req) {
+		return;
+	}
+
+	req_data = (struct gb_camera_metadata_request *)req->payload;
+	req_data->request_id = sys_cpu_to_le32(request_id);
+	req_data->frame_number = sys_cpu_to_le16(frame_number);
+	req_data->stream = 0;
+	req_data->padding = 0;
+
+	meta = (struct gb_camera_frame_metadata *)req_data->metadata;
+	meta->size = sys_cpu_to_le32(vbuf->bytesused);
+	meta->timestamp = sys_cpu_to_le32(vbuf->timestamp);
+
+	gb_transport_message_send(req, data->mgmt_cport);
+	gb_message_dealloc(req);
 }
 
-/**
- * @brief Greybus Camera Protocol deinitialize function
- *
- * This function is called when protocol terminated.
- *
- * @param cport CPort number
- * @param bundle Greybus bundle handle
- * @return None.
+/*
+ * Send a frame in chunks of at most CONFIG_GREYBUS_CAMERA_CHUNK_SIZE bytes. Each chunk is copied
+ * once, from the video buffer into the message, which the transport then sends without copying.
+ * The metadata follows the last chunk, and is only sent for complete frames.
  */
-static void gb_camera_exit(unsigned int cport, struct gb_bundle *bundle)
+static int gb_camera_frame_send(const struct gb_camera_driver_data *data,
+				const struct video_buffer *vbuf, uint32_t request_id,
+				uint16_t frame_number)
 {
-	DEBUGASSERT(cport == info->cport);
+	int ret;
+	size_t len;
+	struct gb_message *req;
+	struct gb_camera_frame_chunk_request *req_data;
 
-	device_close(info->dev);
+	for (size_t offset = 0; offset < vbuf->bytesused; offset += len) {
+		len = MIN(CONFIG_GREYBUS_CAMERA_CHUNK_SIZE, vbuf->bytesused - offset);
 
-	free(info);
-	info = NULL;
+		req = gb_message_request_alloc(sizeof(*req_data) + len,
+					       GB_CAMERA_TYPE_VENDOR_FRAME_CHUNK, true);
+		if (!req) {
+			return -ENOMEM;
+		}
+
+		req_data = (struct gb_camera_frame_chunk_request *)req->payload;
+		req_data->request_id = sys_cpu_to_le32(request_id);
+		req_data->frame_number = sys_cpu_to_le16(frame_number);
+		req_data->flags =
+			(offset + len == vbuf->bytesused) ? GB_CAMERA_FRAME_CHUNK_LAST : 0;
+		req_data->padding = 0;
+		req_data->offset = sys_cpu_to_le32(offset);
+		memcpy(req_data->data, vbuf->buffer + offset, len);
+
+		ret = gb_transport_message_send(req, data->data_cport);
+		gb_message_dealloc(req);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	gb_camera_metadata_send(data, vbuf, request_id, frame_number);
+
+	return 0;
 }
 
-/**
- * @brief Greybus Camera Protocol operation handler
+/*
+ * Forward frames to the AP until capture stops. Each buffer goes back to the video device as soon
+ * as it is sent, so the other buffers are filled while a frame is in flight.
  */
-static uint8_t gb_camera_handler(uint8_t type, struct gb_operation *opr)
+static void gb_camera_tx_work_handler(struct k_work *work)
 {
-	switch (type) {
-	case GB_CAMERA_TYPE_PROTOCOL_VERSION:
-		return gb_camera_protocol_version(opr);
-	case GB_CAMERA_TYPE_CAPABILITIES:
-		return gb_camera_capabilities(opr);
-	case GB_CAMERA_TYPE_CONFIGURE_STREAMS:
-		return gb_camera_configure_streams(opr);
-	case GB_CAMERA_TYPE_CAPTURE:
-		return gb_camera_capture(opr);
-	case GB_CAMERA_TYPE_FLUSH:
-		return gb_camera_flush(opr);
-	default:
-		LOG_ERR("Invalid type");
-		return GB_OP_INVALID;
+	int ret;
+	uint32_t request_id;
+	uint16_t frame_number;
+	struct video_buffer *vbuf;
+	struct gb_camera_driver_data *data =
+		CONTAINER_OF(work, struct gb_camera_driver_data, tx_work);
+
+	while (data->streaming) {
+		ret = video_dequeue(data->dev, &vbuf, K_MSEC(GB_CAMERA_DEQUEUE_TIMEOUT_MS));
+		if (ret < 0) {
+			continue;
+		}
+
+		k_mutex_lock(&data->lock, K_FOREVER);
+		request_id = data->request_id;
+		frame_number = data->frame_number++;
+		k_mutex_unlock(&data->lock);
+
+		if (vbuf->bytesused) {
+			ret = gb_camera_frame_send(data, vbuf, request_id, frame_number);
+			if (ret < 0) {
+				LOG_WRN("Dropped frame %u: %d", frame_number, ret);
+			}
+		}
+
+		video_enqueue(data->dev, vbuf);
+
+		k_mutex_lock(&data->lock, K_FOREVER);
+		if (data->frames_left && --data->frames_left == 0) {
+			data->streaming = false;
+		}
+		k_mutex_unlock(&data->lock);
+	}
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	if (!data->streaming) {
+		gb_camera_stream_stop_locked(data);
 	}
+	k_mutex_unlock(&data->lock);
 }
 
-/**
- * @brief Greybus Camera Protocol driver ops
- */
-static struct gb_driver gb_camera_driver = {
-	.init = gb_camera_init,
-	.exit = gb_camera_exit,
-	.op_handler = gb_camera_handler,
-};
+static uint16_t gb_camera_cport_find(const struct gb_camera_driver_data *data, uint8_t protocol)
+{
+	const struct gb_cport *cport;
 
-/**
- * @brief Register Greybus Camera Protocol
- *
- * @param cport CPort number.
- * @param bundle Bundle number.
- */
-void gb_camera_register(int cport, int bundle)
+	for (uint16_t i = 0; i < GREYBUS_CPORT_COUNT; i++) {
+		cport = gb_cport_get(i);
+		if (cport->priv == data && cport->protocol == protocol) {
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+static int gb_camera_init(void)
 {
-	gb_register_driver(cport, bundle, &gb_camera_driver);
+	const struct gb_cport *cport;
+	struct gb_camera_driver_data *data;
+
+	for (uint16_t i = 0; i < GREYBUS_CPORT_COUNT; i++) {
+		cport = gb_cport_get(i);
+		if (cport->protocol != GREYBUS_PROTOCOL_CAMERA_MGMT) {
+			continue;
+		}
+
+		data = (struct gb_camera_driver_data *)cport->priv;
+		k_mutex_init(&data->lock);
+		k_work_init(&data->tx_work, gb_camera_tx_work_handler);
+		data->mgmt_cport = i;
+		data->data_cport = gb_camera_cport_find(data, GREYBUS_PROTOCOL_CAMERA_DATA);
+	}
+
+	k_work_queue_start(&gb_camera_wq, gb_camera_wq_stack,
+			   K_THREAD_STACK_SIZEOF(gb_camera_wq_stack),
+			   CONFIG_GREYBUS_CAMERA_WQ_PRIORITY, NULL);
+	k_thread_name_set(&gb_camera_wq.thread, "gb_camera_wq");
+
+	return 0;
 }
+
+SYS_INIT(gb_camera_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
@@ -35,13 +35,17 @@
 #include <zephyr/logging/log.h>
 #include <greybus/greybus_protocols.h>
 #include "greybus_internal.h"
+#include "greybus_heap.h"
+#include "greybus_cport.h"
+#include "greybus_timesync.h"
+#include "greybus_stats.h"
 
 LOG_MODULE_REGISTER(greybus_control, CONFIG_GREYBUS_LOG_LEVEL);
 
 #define GB_CONTROL_VERSION_MAJOR 0
 #define GB_CONTROL_VERSION_MINOR 1
 
-static void gb_control_protocol_version(uint16_t cport, struct gb_message *req)
+static void gb_control_protocol_version(const void *priv, struct gb_message *req, uint16_t cport)
 {
 	const struct gb_control_version_request resp_data = {
 		.major = GB_CONTROL_VERSION_MAJOR,
@@ -51,7 +55,7 @@ static void gb_control_protocol_version(uint16_t cport, struct gb_message *req)
 	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-static void gb_control_get_manifest_size(uint16_t cport, struct gb_message *req)
+static void gb_control_get_manifest_size(const void *priv, struct gb_message *req, uint16_t cport)
 {
 	const struct gb_control_get_manifest_size_response resp_data = {
 		.size = sys_cpu_to_le16(manifest_size()),
@@ -60,30 +64,26 @@ static void gb_control_get_manifest_size(uint16_t cport, struct gb_message *req)
 	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-static void gb_control_get_manifest(uint16_t cport, struct gb_message *req)
+static void gb_control_get_manifest(const void *priv, struct gb_message *req, uint16_t cport)
 {
-	struct gb_message *msg = gb_message_alloc(manifest_size(), GB_RESPONSE(req->header.type),
-						  req->header.operation_id, GB_OP_SUCCESS);
+	struct gb_message *resp = manifest_response(req->header.operation_id);
 
-	manifest_create(msg->payload, manifest_size());
-
-	gb_transport_message_send(msg, cport);
+	if (!resp) {
+		return gb_transport_message_empty_response_send(req, GB_OP_NO_MEMORY, cport);
+	}
 
-	gb_message_dealloc(msg);
+	gb_transport_message_send(resp, cport);
+	gb_message_dealloc(resp);
+	gb_message_dealloc(req);
 }
 
-static void gb_control_connected(uint16_t cport, struct gb_message *req)
+static void gb_control_connected(const void *priv, struct gb_message *req, uint16_t cport)
 {
 	int retval;
 	const struct gb_control_connected_request *req_data =
 		(const struct gb_control_connected_request *)req->payload;
 	uint16_t target_cport = sys_le16_to_cpu(req_data->cport_id);
 
-	if (gb_message_payload_len(req) < sizeof(*req_data)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
-
 	retval = gb_listen(target_cport);
 	if (retval) {
 		LOG_ERR("Can not connect cport %d: error %d", sys_le16_to_cpu(req_data->cport_id),
@@ -103,17 +103,12 @@ error_notify:
 	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(retval), cport);
 }
 
-static void gb_control_disconnected(uint16_t cport, struct gb_message *req)
+static void gb_control_disconnected(const void *priv, struct gb_message *req, uint16_t cport)
 {
 	int retval;
 	const struct gb_control_disconnected_request *req_data =
 		(const struct gb_control_disconnected_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*req_data)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
-
 	retval = gb_notify(sys_le16_to_cpu(req_data->cport_id), GB_EVT_DISCONNECTED);
 	if (retval) {
 		LOG_ERR("Cannot notify GB driver of disconnect event.");
@@ -131,59 +126,237 @@ static void gb_control_disconnected(uint16_t cport, struct gb_message *req)
 	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(retval), cport);
 }
 
-static void gb_control_disconnecting(uint16_t cport, struct gb_message *req)
+static void gb_control_disconnecting(const void *priv, struct gb_message *req, uint16_t cport)
 {
 	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
 }
 
-static void gb_control_pm_stub(uint16_t cport, struct gb_message *req)
+static uint8_t gb_control_bundle_pm_status(int ret)
+{
+	switch (ret) {
+	case 0:
+		return GB_CONTROL_BUNDLE_PM_OK;
+	case -EINVAL:
+		return GB_CONTROL_BUNDLE_PM_INVAL;
+	case -EBUSY:
+		return GB_CONTROL_BUNDLE_PM_BUSY;
+	default:
+		return GB_CONTROL_BUNDLE_PM_FAIL;
+	}
+}
+
+/* Helper to respond to a bundle power management request */
+static void gb_control_bundle_pm_send(struct gb_message *req, int ret, uint16_t cport)
 {
 	const struct gb_control_bundle_pm_response resp_data = {
-		.status = GB_CONTROL_BUNDLE_PM_OK,
+		.status = gb_control_bundle_pm_status(ret),
 	};
 
 	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-static void gb_control_handler(const void *priv, struct gb_message *msg, uint16_t cport)
-{
-	ARG_UNUSED(priv);
-
-	switch (gb_message_type(msg)) {
-	case GB_CONTROL_TYPE_VERSION:
-		return gb_control_protocol_version(cport, msg);
-	case GB_CONTROL_TYPE_GET_MANIFEST_SIZE:
-		return gb_control_get_manifest_size(cport, msg);
-	case GB_CONTROL_TYPE_GET_MANIFEST:
-		return gb_control_get_manifest(cport, msg);
-	case GB_CONTROL_TYPE_CONNECTED:
-		return gb_control_connected(cport, msg);
-	case GB_CONTROL_TYPE_DISCONNECTED:
-		return gb_control_disconnected(cport, msg);
-	case GB_CONTROL_TYPE_DISCONNECTING:
-		return gb_control_disconnecting(cport, msg);
-	case GB_CONTROL_TYPE_BUNDLE_ACTIVATE:
-	case GB_CONTROL_TYPE_BUNDLE_SUSPEND:
-	case GB_CONTROL_TYPE_BUNDLE_RESUME:
-	case GB_CONTROL_TYPE_BUNDLE_DEACTIVATE:
-	case GB_CONTROL_TYPE_INTF_SUSPEND_PREPARE:
-	case GB_CONTROL_TYPE_INTF_DEACTIVATE_PREPARE:
-		return gb_control_pm_stub(cport, msg);
-	/* XXX SW-4136: see control-gb.h */
-	/*GB_HANDLER(GB_CONTROL_TYPE_INTF_POWER_STATE_SET, gb_control_intf_pwr_set),
-	GB_HANDLER(GB_CONTROL_TYPE_BUNDLE_POWER_STATE_SET, gb_control_bundle_pwr_set),*/
-	/* TODO: Properly implement timesync */
-	case GB_CONTROL_TYPE_TIMESYNC_ENABLE:
-	case GB_CONTROL_TYPE_TIMESYNC_DISABLE:
-	case GB_CONTROL_TYPE_TIMESYNC_AUTHORITATIVE:
-	case GB_CONTROL_TYPE_TIMESYNC_GET_LAST_EVENT:
-		return gb_transport_message_empty_response_send(msg, GB_OP_SUCCESS, cport);
-	default:
-		LOG_ERR("Invalid type");
-		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
+static void gb_control_bundle_suspend(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	const struct gb_control_bundle_pm_request *req_data =
+		(const struct gb_control_bundle_pm_request *)req->payload;
+
+	gb_control_bundle_pm_send(req, gb_bundle_suspend(req_data->bundle_id), cport);
+}
+
+static void gb_control_bundle_resume(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	const struct gb_control_bundle_pm_request *req_data =
+		(const struct gb_control_bundle_pm_request *)req->payload;
+
+	gb_control_bundle_pm_send(req, gb_bundle_resume(req_data->bundle_id), cport);
+}
+
+/*
+ * The AP suspends the bundles one by one before preparing the interface, this only catches the
+ * ones it did not know about.
+ */
+static void gb_control_intf_pm_prepare(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	struct gb_control_intf_pm_response resp_data = {
+		.status = GB_CONTROL_INTF_PM_OK,
+	};
+
+	for (uint16_t i = 0; i < GREYBUS_CPORT_COUNT; i++) {
+		if (gb_bundle_suspend(gb_cport_get(i)->bundle) < 0) {
+			resp_data.status = GB_CONTROL_INTF_PM_BUSY;
+		}
 	}
+
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
+}
+
+static void gb_control_intf_hibernate_abort(const void *priv, struct gb_message *req,
+					    uint16_t cport)
+{
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+
+#ifdef CONFIG_GREYBUS_TIMESYNC
+static void gb_control_timesync_enable(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	const struct gb_control_timesync_enable_request *req_data =
+		(const struct gb_control_timesync_enable_request *)req->payload;
+	int ret;
+
+	ret = gb_timesync_enable(req_data->count, sys_le64_to_cpu(req_data->frame_time),
+				 sys_le32_to_cpu(req_data->strobe_delay),
+				 sys_le32_to_cpu(req_data->refclk));
+
+	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
 }
 
+static void gb_control_timesync_disable(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	gb_timesync_disable();
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+
+static void gb_control_timesync_authoritative(const void *priv, struct gb_message *req,
+					      uint16_t cport)
+{
+	const struct gb_control_timesync_authoritative_request *req_data =
+		(const struct gb_control_timesync_authoritative_request *)req->payload;
+	uint64_t frame_time[GB_TIMESYNC_MAX_STROBES];
+	int ret;
+
+	for (size_t i = 0; i < GB_TIMESYNC_MAX_STROBES; i++) {
+		frame_time[i] = sys_le64_to_cpu(req_data->frame_time[i]);
+	}
+
+	ret = gb_timesync_authoritative(frame_time);
+	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
+}
+
+static void gb_control_timesync_get_last_event(const void *priv, struct gb_message *req,
+					       uint16_t cport)
+{
+	struct gb_control_timesync_get_last_event_response resp_data;
+	uint64_t frame_time;
+	int ret;
+
+	ret = gb_timesync_get_last_event(&frame_time);
+	if (ret < 0) {
+		gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
+		return;
+	}
+
+	resp_data.frame_time = sys_cpu_to_le64(frame_time);
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
+}
+#else
+static void gb_control_timesync_stub(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+#endif // CONFIG_GREYBUS_TIMESYNC
+
+#ifdef CONFIG_GREYBUS_HEAP_STATS
+static void gb_control_heap_stats(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	struct gb_heap_stats stats;
+	struct gb_control_heap_stats_response resp_data;
+
+	BUILD_ASSERT(ARRAY_SIZE(resp_data.histogram) == GB_HEAP_STATS_BUCKETS);
+
+	gb_heap_stats_get(&stats);
+
+	resp_data.cur_bytes = sys_cpu_to_le32(stats.cur_bytes);
+	resp_data.peak_bytes = sys_cpu_to_le32(stats.peak_bytes);
+	resp_data.allocs = sys_cpu_to_le32(stats.allocs);
+	resp_data.frees = sys_cpu_to_le32(stats.frees);
+	resp_data.failures = sys_cpu_to_le32(stats.failures);
+	resp_data.max_request = sys_cpu_to_le32(stats.max_request);
+	for (size_t i = 0; i < GB_HEAP_STATS_BUCKETS; i++) {
+		resp_data.histogram[i] = sys_cpu_to_le32(stats.histogram[i]);
+	}
+
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
+}
+#endif // CONFIG_GREYBUS_HEAP_STATS
+
+#ifdef CONFIG_GREYBUS_ENERGY_STATS
+static void gb_control_energy_stats(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	struct gb_bundle_energy energy;
+	struct gb_control_energy_stats_response resp_data;
+	const struct gb_control_energy_stats_request *req_data =
+		(const struct gb_control_energy_stats_request *)req->payload;
+
+	if (gb_stats_bundle_energy_get(req_data->bundle_id, &energy) < 0) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	resp_data.rx_msgs = sys_cpu_to_le32(energy.rx_msgs);
+	resp_data.rx_bytes = sys_cpu_to_le32(energy.rx_bytes);
+	resp_data.tx_msgs = sys_cpu_to_le32(energy.tx_msgs);
+	resp_data.tx_bytes = sys_cpu_to_le32(energy.tx_bytes);
+	resp_data.radio_us = sys_cpu_to_le64(energy.radio_us);
+	resp_data.cpu_us = sys_cpu_to_le64(energy.cpu_us);
+
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
+}
+#endif // CONFIG_GREYBUS_ENERGY_STATS
+
+#if defined(CONFIG_GREYBUS_HEAP_STATS) || defined(CONFIG_GREYBUS_ENERGY_STATS)
+#define GB_CONTROL_VENDOR_OPS
+#endif
+
+static const struct gb_operation_entry gb_control_ops[] = {
+	GB_OPERATION(GB_CONTROL_TYPE_VERSION, gb_control_protocol_version, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_GET_MANIFEST_SIZE, gb_control_get_manifest_size, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_GET_MANIFEST, gb_control_get_manifest, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_CONNECTED, gb_control_connected,
+		     sizeof(struct gb_control_connected_request)),
+	GB_OPERATION(GB_CONTROL_TYPE_DISCONNECTED, gb_control_disconnected,
+		     sizeof(struct gb_control_disconnected_request)),
+	GB_OPERATION(GB_CONTROL_TYPE_DISCONNECTING, gb_control_disconnecting, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_BUNDLE_ACTIVATE, gb_control_bundle_resume,
+		     sizeof(struct gb_control_bundle_pm_request)),
+	GB_OPERATION(GB_CONTROL_TYPE_BUNDLE_SUSPEND, gb_control_bundle_suspend,
+		     sizeof(struct gb_control_bundle_pm_request)),
+	GB_OPERATION(GB_CONTROL_TYPE_BUNDLE_RESUME, gb_control_bundle_resume,
+		     sizeof(struct gb_control_bundle_pm_request)),
+	GB_OPERATION(GB_CONTROL_TYPE_BUNDLE_DEACTIVATE, gb_control_bundle_suspend,
+		     sizeof(struct gb_control_bundle_pm_request)),
+	GB_OPERATION(GB_CONTROL_TYPE_INTF_SUSPEND_PREPARE, gb_control_intf_pm_prepare, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_INTF_DEACTIVATE_PREPARE, gb_control_intf_pm_prepare, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_INTF_HIBERNATE_ABORT, gb_control_intf_hibernate_abort, 0),
+#ifdef CONFIG_GREYBUS_TIMESYNC
+	GB_OPERATION(GB_CONTROL_TYPE_TIMESYNC_ENABLE, gb_control_timesync_enable,
+		     sizeof(struct gb_control_timesync_enable_request)),
+	GB_OPERATION(GB_CONTROL_TYPE_TIMESYNC_DISABLE, gb_control_timesync_disable, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_TIMESYNC_AUTHORITATIVE, gb_control_timesync_authoritative,
+		     sizeof(struct gb_control_timesync_authoritative_request)),
+	GB_OPERATION(GB_CONTROL_TYPE_TIMESYNC_GET_LAST_EVENT, gb_control_timesync_get_last_event,
+		     0),
+#else
+	GB_OPERATION(GB_CONTROL_TYPE_TIMESYNC_ENABLE, gb_control_timesync_stub, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_TIMESYNC_DISABLE, gb_control_timesync_stub, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_TIMESYNC_AUTHORITATIVE, gb_control_timesync_stub, 0),
+	GB_OPERATION(GB_CONTROL_TYPE_TIMESYNC_GET_LAST_EVENT, gb_control_timesync_stub, 0),
+#endif // CONFIG_GREYBUS_TIMESYNC
+};
+
+#ifdef GB_CONTROL_VENDOR_OPS
+static const struct gb_operation_entry gb_control_vendor_ops[] = {
+#ifdef CONFIG_GREYBUS_HEAP_STATS
+	GB_VENDOR_OPERATION(GB_CONTROL_TYPE_VENDOR_HEAP_STATS, gb_control_heap_stats, 0),
+#endif // CONFIG_GREYBUS_HEAP_STATS
+#ifdef CONFIG_GREYBUS_ENERGY_STATS
+	GB_VENDOR_OPERATION(GB_CONTROL_TYPE_VENDOR_ENERGY_STATS, gb_control_energy_stats,
+			    sizeof(struct gb_control_energy_stats_request)),
+#endif // CONFIG_GREYBUS_ENERGY_STATS
+};
+#endif // GB_CONTROL_VENDOR_OPS
+
 const struct gb_driver gb_control_driver = {
-	.op_handler = gb_control_handler,
+	GB_OPERATIONS(gb_control_ops),
+#ifdef GB_CONTROL_VENDOR_OPS
+	GB_VENDOR_OPERATIONS(gb_control_vendor_ops),
+#endif // GB_CONTROL_VENDOR_OPS
 };
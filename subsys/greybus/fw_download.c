@@ -6,40 +6,351 @@
 
 #include "greybus_transport.h"
 #include <greybus/greybus_protocols.h>
+#include <zephyr/init.h>
 #include <zephyr/dfu/flash_img.h>
 #include <zephyr/dfu/mcuboot.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/storage/stream_flash.h>
+#include <zephyr/sys/crc.h>
 #include "greybus_fw_mgmt.h"
 #include <greybus-utils/manifest.h>
 #include <zephyr/logging/log.h>
+#include "greybus_cport.h"
 #include "greybus_internal.h"
+#include "greybus_operation.h"
 
 LOG_MODULE_REGISTER(greybus_fw_download, CONFIG_GREYBUS_LOG_LEVEL);
 
-#define DATA_SIZE_MAX 64
+#define DATA_SIZE_MAX CONFIG_GREYBUS_FW_DOWNLOAD_CHUNK_SIZE
+#define FETCH_WINDOW  CONFIG_GREYBUS_FW_DOWNLOAD_WINDOW
+
+BUILD_ASSERT(FETCH_WINDOW <= CONFIG_GREYBUS_OPERATIONS_PER_CPORT,
+	     "Fetch window does not fit in the tracked operations of a cport");
+
+enum fw_fetch_state {
+	FW_FETCH_FREE,
+	FW_FETCH_IN_FLIGHT,
+	FW_FETCH_READY,
+};
+
+/* A chunk requested from the AP. Kept until it has been written to flash. */
+struct fw_fetch_slot {
+	struct gb_message *resp;
+	uint32_t offset;
+	uint16_t size;
+	uint16_t operation_id;
+	enum fw_fetch_state state;
+};
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK
+
+#define FW_HS_MAGIC       "GBHS"
+#define FW_HS_WINDOW_BITS CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK_WINDOW_BITS
+
+/*
+ * Header in front of a heatshrink compressed image. The AP serves the file as is, so fw_size and
+ * all fetch offsets are in compressed bytes.
+ */
+struct fw_hs_header {
+	uint8_t magic[4];
+	uint8_t window_bits;
+	uint8_t lookahead_bits;
+	uint8_t pad[2];
+	__le32 size;
+} __packed;
+
+/* Streaming decoder state, survives from one chunk to the next */
+struct fw_hs_decoder {
+	bool enabled;
+	uint8_t window_bits;
+	uint8_t lookahead_bits;
+	/* Not yet decoded input bits, the oldest one is the most significant */
+	uint8_t nbits;
+	uint32_t bits;
+	/* Decompressed image size, and bytes decompressed so far */
+	uint32_t size;
+	uint32_t produced;
+	uint16_t head;
+	uint16_t out_len;
+	uint8_t window[BIT(FW_HS_WINDOW_BITS)];
+	uint8_t out[64];
+};
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_DELTA
+
+#define FW_DELTA_MAGIC "GBDL"
+
+/*
+ * Header in front of a delta image. It is only applied on top of the source image it was made
+ * from, identified by its size and crc.
+ */
+struct fw_delta_header {
+	uint8_t magic[4];
+	__le32 source_size;
+	__le32 source_crc;
+	__le32 target_size;
+} __packed;
+
+/*
+ * Control record of the patch, as in bsdiff. diff_len bytes are added to the source, extra_len
+ * bytes are copied as is, then the source offset moves by seek.
+ */
+struct fw_delta_control {
+	__le32 diff_len;
+	__le32 extra_len;
+	__le32 seek;
+} __packed;
+
+/* Streaming patcher state, survives from one chunk to the next */
+struct fw_delta_decoder {
+	/* The start of the image has been checked for the header */
+	bool started;
+	bool enabled;
+	/* Running image, patched against */
+	const struct flash_area *source;
+	uint32_t source_size;
+	uint32_t source_offset;
+	/* Patched image size, and bytes covered by the records so far */
+	uint32_t target_size;
+	uint32_t produced;
+	/* Left to do of the current record */
+	uint32_t diff_left;
+	uint32_t extra_left;
+	int32_t seek;
+	uint8_t control_len;
+	uint8_t control[sizeof(struct fw_delta_control)];
+	uint8_t buf[64];
+};
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_DELTA
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
+
+/*
+ * Sectors of the image slot erased in the background. The writer only waits for the eraser when
+ * it catches up with it.
+ */
+struct fw_erase_ahead {
+	/* Flash offset up to which the slot is erased */
+	atomic_t offset;
+	/* Flash offset the image needs erased up to */
+	atomic_t end;
+	/* First erase error, or -ECANCELED once the download is reset */
+	atomic_t error;
+	/* Given whenever offset or error changes */
+	struct k_sem progress;
+	/* Flash offset up to which the image has been handed to the stream, writer only */
+	uint32_t queued;
+};
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
 
 struct fw_download_priv_data {
 	struct flash_img_context ctx;
+	struct fw_fetch_slot slots[FETCH_WINDOW];
+	/* Protects everything below along with the slots */
+	struct k_mutex lock;
 	uint32_t fw_size;
-	uint32_t offset;
+	/* Offset of the next chunk to request */
+	uint32_t fetch_offset;
+	/* Offset of the next chunk to write to flash */
+	uint32_t write_offset;
+	/* Bumped whenever the download is reset */
+	uint32_t generation;
+	/* Flash offset the stream of the current download starts at */
+	uint32_t stream_start;
 	int req_id;
+	uint16_t cport;
 	uint8_t fw_id;
+	bool active;
+	char fw_tag[GB_FIRMWARE_TAG_MAX_SIZE];
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_RESUME
+	/* Flash offset covered by the last checkpoint, and crc of the image up to it */
+	uint32_t ckpt_offset;
+	uint32_t ckpt_crc;
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_RESUME
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK
+	struct fw_hs_decoder hs;
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_DELTA
+	struct fw_delta_decoder delta;
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_DELTA
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
+	struct fw_erase_ahead erase;
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
 };
 
-static struct fw_download_priv_data priv_data = {.req_id = -1};
+static struct fw_download_priv_data priv_data = {
+	.lock = Z_MUTEX_INITIALIZER(priv_data.lock),
+	.req_id = -1,
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
+	.erase.progress = Z_SEM_INITIALIZER(priv_data.erase.progress, 0, 1),
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
+};
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_RESUME
+
+#define FW_CHECKPOINT_KEY  "greybus/fw_dl"
+#define FW_CHECKPOINT_SIZE CONFIG_GREYBUS_FW_DOWNLOAD_CHECKPOINT_SIZE
+
+/* Persisted download progress. Only valid for an image with the same tag and size. */
+struct fw_download_checkpoint {
+	char fw_tag[GB_FIRMWARE_TAG_MAX_SIZE];
+	uint32_t fw_size;
+	uint32_t offset;
+	uint32_t crc;
+};
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_RESUME
+
+static K_THREAD_STACK_DEFINE(fw_wq_stack, CONFIG_GREYBUS_FW_DOWNLOAD_WQ_STACK_SIZE);
+static struct k_work_q fw_wq;
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
+
+static K_THREAD_STACK_DEFINE(fw_erase_wq_stack, CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_WQ_STACK_SIZE);
+static struct k_work_q fw_erase_wq;
+
+/*
+ * Erase the slot one sector at a time up to the end of the image. Runs on its own work queue, so
+ * that the writer keeps programming the sectors already erased meanwhile.
+ */
+static void gb_fw_download_erase_handler(struct k_work *work)
+{
+	int ret;
+	off_t offset;
+	uint32_t generation;
+	struct flash_pages_info info;
+	const struct flash_area *fa;
+	struct fw_erase_ahead *erase = &priv_data.erase;
+
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&priv_data.lock, K_FOREVER);
+	generation = priv_data.generation;
+	fa = priv_data.ctx.flash_area;
+	k_mutex_unlock(&priv_data.lock);
+
+	while (!atomic_get(&erase->error) && atomic_get(&erase->offset) < atomic_get(&erase->end)) {
+		ret = flash_get_page_info_by_offs(flash_area_get_device(fa),
+						  fa->fa_off + atomic_get(&erase->offset), &info);
+		if (ret == 0) {
+			offset = info.start_offset - fa->fa_off;
+			ret = flash_area_erase(fa, offset, info.size);
+		}
+
+		k_mutex_lock(&priv_data.lock, K_FOREVER);
+		if (generation != priv_data.generation) {
+			/* Download was reset while erasing, the next one starts its own erase */
+			k_mutex_unlock(&priv_data.lock);
+			return;
+		}
+
+		if (ret < 0) {
+			LOG_ERR("Failed to erase firmware slot: %d", ret);
+			atomic_set(&erase->error, ret);
+		} else {
+			atomic_set(&erase->offset, offset + info.size);
+		}
+		k_mutex_unlock(&priv_data.lock);
+
+		k_sem_give(&erase->progress);
+	}
+}
+
+static K_WORK_DEFINE(fw_erase_work, gb_fw_download_erase_handler);
+
+/* Make sure the slot gets erased up to the flash offset end, capped to the slot size */
+static void gb_fw_download_erase_to(uint32_t end)
+{
+	atomic_set(&priv_data.erase.end, MIN(end, priv_data.ctx.flash_area->fa_size));
+	k_work_submit_to_queue(&fw_erase_wq, &fw_erase_work);
+}
+
+/* Start erasing from the flash offset start. Must be called with the lock held. */
+static void gb_fw_download_erase_start(uint32_t start, uint32_t end)
+{
+	priv_data.erase.queued = start;
+	atomic_set(&priv_data.erase.offset, start);
+	atomic_set(&priv_data.erase.error, 0);
+	k_sem_reset(&priv_data.erase.progress);
+	gb_fw_download_erase_to(end);
+}
+
+/* Stop erasing and wake up the writer. Must be called with the lock held. */
+static void gb_fw_download_erase_cancel(void)
+{
+	atomic_set(&priv_data.erase.error, -ECANCELED);
+	k_sem_give(&priv_data.erase.progress);
+}
+
+/*
+ * Program len more bytes, once everything the stream may flush with them is erased. The chunks
+ * arriving meanwhile wait in the fetch slots.
+ */
+static int gb_fw_download_flash_write(const uint8_t *data, size_t len, bool flush)
+{
+	int ret;
+	struct fw_erase_ahead *erase = &priv_data.erase;
+	const uint32_t need = MIN(erase->queued + len, atomic_get(&erase->end));
+
+	while (atomic_get(&erase->offset) < need) {
+		ret = atomic_get(&erase->error);
+		if (ret) {
+			return ret;
+		}
+		k_sem_take(&erase->progress, K_FOREVER);
+	}
+
+	ret = flash_img_buffered_write(&priv_data.ctx, data, len, flush);
+	if (ret == 0) {
+		erase->queued += len;
+	}
+
+	return ret;
+}
+
+#else
+
+static void gb_fw_download_erase_to(uint32_t end)
+{
+}
+
+static void gb_fw_download_erase_start(uint32_t start, uint32_t end)
+{
+}
+
+static void gb_fw_download_erase_cancel(void)
+{
+}
+
+static int gb_fw_download_flash_write(const uint8_t *data, size_t len, bool flush)
+{
+	return flash_img_buffered_write(&priv_data.ctx, data, len, flush);
+}
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
 
 struct fw_fetch_req {
 	struct gb_operation_msg_hdr hdr;
 	struct gb_fw_download_fetch_firmware_request req;
 };
 
-static void gb_fw_download_fetch_firmware(uint16_t cport, uint8_t id, uint16_t offset,
-					  uint16_t size)
+static void gb_fw_download_fetch_firmware_cb(uint16_t cport, uint16_t operation_id,
+					     struct gb_message *resp, int err, void *priv);
+
+static int gb_fw_download_fetch_firmware(uint16_t cport, uint8_t id, uint16_t operation_id,
+					 uint32_t offset, uint16_t size)
 {
 	const struct fw_fetch_req req = {
 		.hdr =
 			{
 				.size = sizeof(req),
-				.operation_id = new_operation_id(),
+				.operation_id = operation_id,
 				.type = GB_FW_DOWNLOAD_TYPE_FETCH_FIRMWARE,
 				.result = 0,
 				.pad = {0, 0},
@@ -52,9 +363,639 @@ static void gb_fw_download_fetch_firmware(uint16_t cport, uint8_t id, uint16_t o
 			},
 	};
 
-	gb_transport_message_send((const struct gb_message *)&req, cport);
+	return gb_operation_send(cport, (const struct gb_message *)&req,
+				 CONFIG_GREYBUS_FW_DOWNLOAD_FETCH_TIMEOUT_MS,
+				 gb_fw_download_fetch_firmware_cb, NULL);
+}
+
+static void gb_fw_download_abort(void);
+
+/* Issue fetches for every free slot. Must be called with the lock held. */
+static void gb_fw_download_fill_window(void)
+{
+	int ret;
+	struct fw_fetch_slot *slot;
+
+	for (size_t i = 0; i < FETCH_WINDOW && priv_data.fetch_offset < priv_data.fw_size; i++) {
+		slot = &priv_data.slots[i];
+		if (slot->state != FW_FETCH_FREE) {
+			continue;
+		}
+
+		slot->offset = priv_data.fetch_offset;
+		slot->size = MIN(priv_data.fw_size - priv_data.fetch_offset, DATA_SIZE_MAX);
+		slot->operation_id = gb_cport_operation_id(priv_data.cport);
+		slot->state = FW_FETCH_IN_FLIGHT;
+		priv_data.fetch_offset += slot->size;
+
+		ret = gb_fw_download_fetch_firmware(priv_data.cport, priv_data.fw_id,
+						    slot->operation_id, slot->offset, slot->size);
+		if (ret < 0) {
+			LOG_ERR("Failed to send fetch firmware request: %d", ret);
+			gb_fw_download_abort();
+			return;
+		}
+	}
+}
+
+/* Drop all chunks of the current download. Must be called with the lock held. */
+static void gb_fw_download_reset(void)
+{
+	for (size_t i = 0; i < FETCH_WINDOW; i++) {
+		if (priv_data.slots[i].state == FW_FETCH_IN_FLIGHT) {
+			gb_operation_cancel(priv_data.cport, priv_data.slots[i].operation_id);
+		}
+		gb_message_dealloc(priv_data.slots[i].resp);
+		priv_data.slots[i].resp = NULL;
+		priv_data.slots[i].state = FW_FETCH_FREE;
+	}
+
+	gb_fw_download_erase_cancel();
+	priv_data.active = false;
+	priv_data.req_id = -1;
+	priv_data.generation++;
+}
+
+/*
+ * Point the stream of a freshly initialized image at the flash offset start, everything below it
+ * being in flash already. The stream counts its bytes from there.
+ */
+static int gb_fw_download_stream_start(uint32_t start)
+{
+	const struct flash_area *fa = priv_data.ctx.flash_area;
+
+	priv_data.stream_start = start;
+	if (start == 0) {
+		return 0;
+	}
+
+	return stream_flash_init(&priv_data.ctx.stream, flash_area_get_device(fa),
+				 priv_data.ctx.buf, sizeof(priv_data.ctx.buf), fa->fa_off + start,
+				 fa->fa_size - start, NULL);
+}
+
+/* Flash offset up to which the image has been written */
+static uint32_t gb_fw_download_flash_offset(void)
+{
+	return priv_data.stream_start + flash_img_bytes_written(&priv_data.ctx);
+}
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_RESUME
+
+/* Extend crc over the image bytes in [start, end) as stored in flash */
+static int gb_fw_download_flash_crc(uint32_t start, uint32_t end, uint32_t *crc)
+{
+	int ret;
+	uint8_t buf[64];
+	size_t len;
+
+	for (; start < end; start += len) {
+		len = MIN(sizeof(buf), end - start);
+
+		ret = flash_area_read(priv_data.ctx.flash_area, start, buf, len);
+		if (ret < 0) {
+			return ret;
+		}
+
+		*crc = crc32_ieee_update(*crc, buf, len);
+	}
+
+	return 0;
+}
+
+static int gb_fw_download_checkpoint_cb(const char *key, size_t len, settings_read_cb read_cb,
+					void *cb_arg, void *param)
+{
+	struct fw_download_checkpoint *ckpt = param;
+
+	if (key || len != sizeof(*ckpt)) {
+		return 0;
+	}
+
+	return MIN(read_cb(cb_arg, ckpt, sizeof(*ckpt)), 0);
+}
+
+/*
+ * Find the offset to resume the current download from. The part of the image already in flash is
+ * only trusted if it still matches the crc recorded with the checkpoint.
+ */
+static uint32_t gb_fw_download_checkpoint_load(void)
+{
+	int ret;
+	uint32_t crc = 0;
+	struct fw_download_checkpoint ckpt = {0};
+
+	priv_data.ckpt_offset = 0;
+	priv_data.ckpt_crc = 0;
+
+	ret = settings_load_subtree_direct(FW_CHECKPOINT_KEY, gb_fw_download_checkpoint_cb, &ckpt);
+	if (ret < 0 || ckpt.offset == 0) {
+		return 0;
+	}
+
+	if (ckpt.fw_size != priv_data.fw_size || ckpt.offset >= priv_data.fw_size ||
+	    strncmp(ckpt.fw_tag, priv_data.fw_tag, sizeof(ckpt.fw_tag))) {
+		LOG_INF("Discarding checkpoint of a different image");
+		settings_delete(FW_CHECKPOINT_KEY);
+		return 0;
+	}
+
+	ret = gb_fw_download_flash_crc(0, ckpt.offset, &crc);
+	if (ret < 0 || crc != ckpt.crc) {
+		LOG_WRN("Checkpoint does not match flash contents");
+		settings_delete(FW_CHECKPOINT_KEY);
+		return 0;
+	}
+
+	priv_data.ckpt_offset = ckpt.offset;
+	priv_data.ckpt_crc = ckpt.crc;
+
+	LOG_INF("Resuming firmware download at %u", ckpt.offset);
+
+	return ckpt.offset;
+}
+
+/* Record progress whenever another checkpoint sized block has reached flash */
+static void gb_fw_download_checkpoint_update(void)
+{
+	int ret;
+	uint32_t crc = priv_data.ckpt_crc;
+	const uint32_t offset = ROUND_DOWN(gb_fw_download_flash_offset(), FW_CHECKPOINT_SIZE);
+	struct fw_download_checkpoint ckpt = {
+		.fw_size = priv_data.fw_size,
+		.offset = offset,
+	};
+
+	if (offset <= priv_data.ckpt_offset) {
+		return;
+	}
+
+	ret = gb_fw_download_flash_crc(priv_data.ckpt_offset, offset, &crc);
+	if (ret < 0) {
+		LOG_WRN("Failed to read back firmware: %d", ret);
+		return;
+	}
+
+	ckpt.crc = crc;
+	memcpy(ckpt.fw_tag, priv_data.fw_tag, sizeof(ckpt.fw_tag));
+
+	ret = settings_save_one(FW_CHECKPOINT_KEY, &ckpt, sizeof(ckpt));
+	if (ret < 0) {
+		LOG_WRN("Failed to save checkpoint: %d", ret);
+		return;
+	}
+
+	priv_data.ckpt_offset = offset;
+	priv_data.ckpt_crc = crc;
+}
+
+static void gb_fw_download_checkpoint_clear(void)
+{
+	settings_delete(FW_CHECKPOINT_KEY);
+	priv_data.ckpt_offset = 0;
+	priv_data.ckpt_crc = 0;
+}
+
+#else
+
+static uint32_t gb_fw_download_checkpoint_load(void)
+{
+	return 0;
+}
+
+static void gb_fw_download_checkpoint_update(void)
+{
+}
+
+static void gb_fw_download_checkpoint_clear(void)
+{
+}
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_RESUME
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_DELTA
+
+static void gb_fw_delta_reset(void)
+{
+	if (priv_data.delta.source) {
+		flash_area_close(priv_data.delta.source);
+	}
+	memset(&priv_data.delta, 0, sizeof(priv_data.delta));
+}
+
+/* Helper to check that the running image is the one the delta was made from */
+static int gb_fw_delta_source_check(struct fw_delta_decoder *delta, uint32_t crc)
+{
+	int ret;
+	size_t n;
+	uint32_t actual = 0;
+
+	for (uint32_t off = 0; off < delta->source_size; off += n) {
+		n = MIN(delta->source_size - off, sizeof(delta->buf));
+		ret = flash_area_read(delta->source, off, delta->buf, n);
+		if (ret < 0) {
+			return ret;
+		}
+		actual = crc32_ieee_update(actual, delta->buf, n);
+	}
+
+	if (actual != crc) {
+		LOG_ERR("Delta image does not apply to the running image");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Check for the header at the start of the image. Returns the number of header bytes. */
+static int gb_fw_delta_start(const uint8_t *data, size_t len)
+{
+	int ret;
+	struct fw_delta_header hdr;
+	struct fw_delta_decoder *delta = &priv_data.delta;
+
+	if (len < sizeof(hdr) || memcmp(data, FW_DELTA_MAGIC, sizeof(hdr.magic))) {
+		return 0;
+	}
+
+	memcpy(&hdr, data, sizeof(hdr));
+	delta->source_size = sys_le32_to_cpu(hdr.source_size);
+	delta->target_size = sys_le32_to_cpu(hdr.target_size);
+
+	ret = flash_area_open(FIXED_PARTITION_ID(slot0_partition), &delta->source);
+	if (ret < 0) {
+		LOG_ERR("Failed to open running image: %d", ret);
+		return ret;
+	}
+
+	if (delta->source_size > delta->source->fa_size) {
+		LOG_ERR("Delta source of %u bytes does not fit the slot", delta->source_size);
+		return -EINVAL;
+	}
+
+	ret = gb_fw_delta_source_check(delta, sys_le32_to_cpu(hdr.source_crc));
+	if (ret < 0) {
+		return ret;
+	}
+
+	delta->enabled = true;
+	gb_fw_download_erase_to(delta->target_size);
+
+	LOG_INF("Delta image, %u bytes patched from %u", delta->target_size, delta->source_size);
+
+	return sizeof(hdr);
+}
+
+/* Helper to move on to the next record once the current one is done */
+static int gb_fw_delta_next(struct fw_delta_decoder *delta)
+{
+	const int64_t offset = (int64_t)delta->source_offset + delta->seek;
+
+	if (delta->diff_left || delta->extra_left) {
+		return 0;
+	}
+
+	if (offset < 0 || offset > delta->source_size) {
+		LOG_ERR("Delta seeks out of the source image");
+		return -EINVAL;
+	}
+
+	delta->source_offset = offset;
+	delta->control_len = 0;
+
+	return 0;
+}
+
+/* Helper to start a record once its control part has been received */
+static int gb_fw_delta_control(struct fw_delta_decoder *delta)
+{
+	struct fw_delta_control control;
+
+	memcpy(&control, delta->control, sizeof(control));
+	delta->diff_left = sys_le32_to_cpu(control.diff_len);
+	delta->extra_left = sys_le32_to_cpu(control.extra_len);
+	delta->seek = (int32_t)sys_le32_to_cpu(control.seek);
+
+	if (delta->diff_left > delta->source_size - delta->source_offset ||
+	    (uint64_t)delta->diff_left + delta->extra_left > delta->target_size - delta->produced) {
+		LOG_ERR("Invalid delta record");
+		return -EINVAL;
+	}
+	delta->produced += delta->diff_left + delta->extra_left;
+
+	return gb_fw_delta_next(delta);
+}
+
+/* Helper to patch a chunk of the delta image into flash */
+static int gb_fw_delta_patch(struct fw_delta_decoder *delta, const uint8_t *data, size_t len)
+{
+	int ret;
+	size_t n;
+
+	while (len) {
+		if (delta->control_len < sizeof(delta->control)) {
+			n = MIN(len, sizeof(delta->control) - delta->control_len);
+			memcpy(delta->control + delta->control_len, data, n);
+			delta->control_len += n;
+			ret = 0;
+			if (delta->control_len == sizeof(delta->control)) {
+				ret = gb_fw_delta_control(delta);
+			}
+		} else if (delta->diff_left) {
+			n = MIN(MIN(len, delta->diff_left), sizeof(delta->buf));
+			ret = flash_area_read(delta->source, delta->source_offset, delta->buf, n);
+			if (ret < 0) {
+				return ret;
+			}
+			for (size_t i = 0; i < n; i++) {
+				delta->buf[i] += data[i];
+			}
+			delta->source_offset += n;
+			delta->diff_left -= n;
+			ret = gb_fw_download_flash_write(delta->buf, n, false);
+		} else {
+			n = MIN(len, delta->extra_left);
+			delta->extra_left -= n;
+			ret = gb_fw_download_flash_write(data, n, false);
+		}
+
+		if (ret == 0 && delta->control_len == sizeof(delta->control)) {
+			ret = gb_fw_delta_next(delta);
+		}
+		if (ret < 0) {
+			return ret;
+		}
+
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Write the next bytes of the image to flash, patching them if it turns out to be a delta */
+static int gb_fw_delta_write(const uint8_t *data, size_t len, bool flush)
+{
+	int ret;
+	struct fw_delta_decoder *delta = &priv_data.delta;
+
+	if (!delta->started) {
+		delta->started = true;
+		ret = gb_fw_delta_start(data, len);
+		if (ret < 0) {
+			return ret;
+		}
+		data += ret;
+		len -= ret;
+	}
+
+	if (!delta->enabled) {
+		return gb_fw_download_flash_write(data, len, flush);
+	}
+
+	ret = gb_fw_delta_patch(delta, data, len);
+	if (ret < 0 || !flush) {
+		return ret;
+	}
+
+	if (delta->control_len || delta->produced != delta->target_size) {
+		LOG_ERR("Delta patched %u bytes instead of %u", delta->produced,
+			delta->target_size);
+		return -EINVAL;
+	}
+
+	return gb_fw_download_flash_write(delta->buf, 0, true);
+}
+
+static bool gb_fw_delta_is_enabled(void)
+{
+	return priv_data.delta.enabled;
+}
+
+#else
+
+static void gb_fw_delta_reset(void)
+{
+}
+
+static int gb_fw_delta_write(const uint8_t *data, size_t len, bool flush)
+{
+	return gb_fw_download_flash_write(data, len, flush);
+}
+
+static bool gb_fw_delta_is_enabled(void)
+{
+	return false;
+}
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_DELTA
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK
+
+static void gb_fw_hs_reset(void)
+{
+	memset(&priv_data.hs, 0, sizeof(priv_data.hs));
+}
+
+/* Check for the header at the start of the image. Returns the number of header bytes. */
+static int gb_fw_hs_start(const uint8_t *data, size_t len)
+{
+	struct fw_hs_header hdr;
+	struct fw_hs_decoder *hs = &priv_data.hs;
+
+	if (len < sizeof(hdr) || memcmp(data, FW_HS_MAGIC, sizeof(hdr.magic))) {
+		return 0;
+	}
+
+	memcpy(&hdr, data, sizeof(hdr));
+	if (hdr.window_bits < 4 || hdr.window_bits > FW_HS_WINDOW_BITS ||
+	    hdr.lookahead_bits < 3 || hdr.lookahead_bits >= hdr.window_bits) {
+		LOG_ERR("Unsupported heatshrink parameters -w %u -l %u", hdr.window_bits,
+			hdr.lookahead_bits);
+		return -ENOTSUP;
+	}
+
+	hs->enabled = true;
+	hs->window_bits = hdr.window_bits;
+	hs->lookahead_bits = hdr.lookahead_bits;
+	hs->size = sys_le32_to_cpu(hdr.size);
+	gb_fw_download_erase_to(hs->size);
+
+	LOG_INF("Compressed image, %u bytes decompressed", hs->size);
+
+	return sizeof(hdr);
+}
+
+static int gb_fw_hs_emit(uint8_t c)
+{
+	int ret;
+	struct fw_hs_decoder *hs = &priv_data.hs;
+
+	if (hs->produced == hs->size) {
+		return -EINVAL;
+	}
+
+	hs->window[hs->head] = c;
+	hs->head = (hs->head + 1) & (BIT(hs->window_bits) - 1);
+	hs->out[hs->out_len++] = c;
+	hs->produced++;
+
+	if (hs->out_len == sizeof(hs->out)) {
+		ret = gb_fw_delta_write(hs->out, hs->out_len, false);
+		hs->out_len = 0;
+		return ret;
+	}
+
+	return 0;
+}
+
+/* Take the next count bits of the input */
+static uint32_t gb_fw_hs_take(struct fw_hs_decoder *hs, uint8_t count)
+{
+	hs->nbits -= count;
+
+	return (hs->bits >> hs->nbits) & (BIT(count) - 1);
+}
+
+/*
+ * Decompress a chunk of the image into flash. A set tag bit is followed by a literal byte, a clear
+ * one by the offset and length of an earlier match in the window.
+ */
+static int gb_fw_hs_write(const uint8_t *data, size_t len, bool flush)
+{
+	int ret = 0;
+	uint32_t offset, count;
+	struct fw_hs_decoder *hs = &priv_data.hs;
+	const uint8_t backref_bits = 1 + hs->window_bits + hs->lookahead_bits;
+	const uint16_t mask = BIT(hs->window_bits) - 1;
+
+	for (size_t i = 0; i < len && ret == 0; i++) {
+		hs->bits = (hs->bits << 8) | data[i];
+		hs->nbits += 8;
+
+		/* Whatever follows the last byte of the image is padding */
+		while (ret == 0 && hs->produced < hs->size && hs->nbits >= 9) {
+			if (hs->bits & BIT(hs->nbits - 1)) {
+				gb_fw_hs_take(hs, 1);
+				ret = gb_fw_hs_emit(gb_fw_hs_take(hs, 8));
+				continue;
+			}
+
+			if (hs->nbits < backref_bits) {
+				break;
+			}
+
+			gb_fw_hs_take(hs, 1);
+			offset = gb_fw_hs_take(hs, hs->window_bits) + 1;
+			count = gb_fw_hs_take(hs, hs->lookahead_bits) + 1;
+			while (count-- && ret == 0) {
+				ret = gb_fw_hs_emit(hs->window[(hs->head - offset) & mask]);
+			}
+		}
+	}
+
+	if (ret < 0 || !flush) {
+		return ret;
+	}
+
+	if (hs->produced != hs->size) {
+		LOG_ERR("Image decompressed to %u bytes instead of %u", hs->produced, hs->size);
+		return -EINVAL;
+	}
+
+	ret = gb_fw_delta_write(hs->out, hs->out_len, true);
+	hs->out_len = 0;
+
+	return ret;
 }
 
+/* Write a chunk of the image at offset to flash, decompressing it if needed */
+static int gb_fw_download_image_write(uint32_t offset, const uint8_t *data, size_t len, bool flush)
+{
+	int ret;
+
+	if (offset == 0) {
+		ret = gb_fw_hs_start(data, len);
+		if (ret < 0) {
+			return ret;
+		}
+		data += ret;
+		len -= ret;
+	}
+
+	if (priv_data.hs.enabled) {
+		return gb_fw_hs_write(data, len, flush);
+	}
+
+	return gb_fw_delta_write(data, len, flush);
+}
+
+static bool gb_fw_download_image_is_compressed(void)
+{
+	return priv_data.hs.enabled;
+}
+
+#else
+
+static void gb_fw_hs_reset(void)
+{
+}
+
+static int gb_fw_download_image_write(uint32_t offset, const uint8_t *data, size_t len, bool flush)
+{
+	return gb_fw_delta_write(data, len, flush);
+}
+
+static bool gb_fw_download_image_is_compressed(void)
+{
+	return false;
+}
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK
+
+/* Prepare flash and start fetching. Runs on the flash work queue since resuming reads flash. */
+static void gb_fw_download_start_handler(struct k_work *work)
+{
+	int ret;
+	uint32_t offset;
+
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&priv_data.lock, K_FOREVER);
+
+	if (!priv_data.active) {
+		goto unlock;
+	}
+
+	ret = flash_img_init(&priv_data.ctx);
+	if (ret < 0) {
+		LOG_ERR("Failed to initialize flash: %d", ret);
+		gb_fw_download_abort();
+		goto unlock;
+	}
+
+	gb_fw_hs_reset();
+	gb_fw_delta_reset();
+	offset = gb_fw_download_checkpoint_load();
+	ret = gb_fw_download_stream_start(offset);
+	if (ret < 0) {
+		LOG_ERR("Failed to resume at %u: %d", offset, ret);
+		gb_fw_download_abort();
+		goto unlock;
+	}
+	priv_data.fetch_offset = offset;
+	priv_data.write_offset = offset;
+	/* For a compressed or delta image this moves once its header says how large it is */
+	gb_fw_download_erase_start(offset, priv_data.fw_size);
+
+	gb_fw_download_fill_window();
+
+unlock:
+	k_mutex_unlock(&priv_data.lock);
+}
+
+static K_WORK_DEFINE(fw_start_work, gb_fw_download_start_handler);
+
 static void gb_fw_download_find_firmware_response_handler(uint16_t cport, struct gb_message *resp)
 {
 	const struct gb_fw_download_find_firmware_response *resp_data =
@@ -65,21 +1006,26 @@ static void gb_fw_download_find_firmware_response_handler(uint16_t cport, struct
 		return gb_message_dealloc(resp);
 	}
 
-	flash_img_init(&priv_data.ctx);
+	k_mutex_lock(&priv_data.lock, K_FOREVER);
+
 	priv_data.fw_id = resp_data->firmware_id;
-	priv_data.fw_size = resp_data->size;
-	priv_data.offset = 0;
+	priv_data.fw_size = sys_le32_to_cpu(resp_data->size);
+	priv_data.cport = cport;
+	priv_data.active = true;
 
 	gb_message_dealloc(resp);
 
-	gb_fw_download_fetch_firmware(cport, resp_data->firmware_id, 0, DATA_SIZE_MAX);
+	k_work_submit_to_queue(&fw_wq, &fw_start_work);
+
+	k_mutex_unlock(&priv_data.lock);
 }
 
 static void gb_fw_release_firmware(uint16_t cport, u8 firmware_id)
 {
 	struct gb_message *req =
-		gb_message_request_alloc(sizeof(struct gb_fw_download_release_firmware_request),
-					 GB_FW_DOWNLOAD_TYPE_RELEASE_FIRMWARE, false);
+		gb_cport_request_alloc(cport,
+				       sizeof(struct gb_fw_download_release_firmware_request),
+				       GB_FW_DOWNLOAD_TYPE_RELEASE_FIRMWARE);
 	struct gb_fw_download_release_firmware_request *req_data =
 		(struct gb_fw_download_release_firmware_request *)req->payload;
 
@@ -95,6 +1041,19 @@ static void gb_fw_download_early_fail(uint16_t cport, u8 firmware_id, uint8_t re
 	gb_fw_mgmt_interface_fw_loaded(req_id, GB_FW_LOAD_STATUS_FAILED, 0, 0);
 }
 
+/* Abort the current download. Must be called with the lock held. */
+static void gb_fw_download_abort(void)
+{
+	const int req_id = priv_data.req_id;
+
+	if (!priv_data.active) {
+		return;
+	}
+
+	gb_fw_download_reset();
+	gb_fw_download_early_fail(priv_data.cport, priv_data.fw_id, req_id);
+}
+
 static void gb_fw_download_fetch_final(uint16_t cport, u8 firmware_id, uint8_t req_id)
 {
 	int ret;
@@ -116,43 +1075,154 @@ static void gb_fw_download_fetch_final(uint16_t cport, u8 firmware_id, uint8_t r
 				       hdr.h.v1.sem_ver.minor);
 }
 
-static void gb_fw_download_fetch_firmware_response_handler(uint16_t cport, struct gb_message *resp)
+static struct fw_fetch_slot *gb_fw_download_slot_in_flight(uint16_t operation_id)
+{
+	for (size_t i = 0; i < FETCH_WINDOW; i++) {
+		if (priv_data.slots[i].state == FW_FETCH_IN_FLIGHT &&
+		    priv_data.slots[i].operation_id == operation_id) {
+			return &priv_data.slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct fw_fetch_slot *gb_fw_download_slot_ready(uint32_t offset)
+{
+	for (size_t i = 0; i < FETCH_WINDOW; i++) {
+		if (priv_data.slots[i].state == FW_FETCH_READY &&
+		    priv_data.slots[i].offset == offset) {
+			return &priv_data.slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Write received chunks to flash in offset order. Runs on its own work queue so that fetches for
+ * the following chunks proceed while the flash is busy.
+ */
+static void gb_fw_download_write_handler(struct k_work *work)
 {
 	int ret;
-	uint32_t new_data_size;
-	uint32_t cur_data_size = MIN(priv_data.fw_size - priv_data.offset, DATA_SIZE_MAX);
-	bool is_final_write = priv_data.offset + cur_data_size >= priv_data.fw_size;
+	bool is_final_write;
+	uint32_t generation;
+	struct fw_fetch_slot *slot;
+	struct gb_message *resp;
 
-	if (!gb_message_is_success(resp)) {
-		LOG_ERR("Fetch firmware request failed");
-		return gb_message_dealloc(resp);
+	ARG_UNUSED(work);
+
+	k_mutex_lock(&priv_data.lock, K_FOREVER);
+
+	while (priv_data.active) {
+		slot = gb_fw_download_slot_ready(priv_data.write_offset);
+		if (!slot) {
+			break;
+		}
+
+		is_final_write = slot->offset + slot->size >= priv_data.fw_size;
+		resp = slot->resp;
+		slot->resp = NULL;
+		generation = priv_data.generation;
+
+		/* RX path only touches slots in flight, so the flash write can run unlocked */
+		k_mutex_unlock(&priv_data.lock);
+		ret = gb_fw_download_image_write(slot->offset, resp->payload, slot->size,
+						 is_final_write);
+		gb_message_dealloc(resp);
+		/* Flash offsets say nothing about where a compressed or delta stream is */
+		if (ret >= 0 && !is_final_write && !gb_fw_download_image_is_compressed() &&
+		    !gb_fw_delta_is_enabled()) {
+			gb_fw_download_checkpoint_update();
+		}
+		k_mutex_lock(&priv_data.lock, K_FOREVER);
+
+		if (generation != priv_data.generation) {
+			/* Download was restarted while writing */
+			break;
+		}
+
+		if (ret < 0) {
+			LOG_ERR("Failed to write firmware to flash: %d", ret);
+			gb_fw_download_abort();
+			break;
+		}
+
+		priv_data.write_offset += slot->size;
+		slot->state = FW_FETCH_FREE;
+		LOG_INF("Offset: %u", priv_data.write_offset);
+
+		if (is_final_write) {
+			gb_fw_download_checkpoint_clear();
+			gb_fw_release_firmware(priv_data.cport, priv_data.fw_id);
+			gb_fw_download_fetch_final(priv_data.cport, priv_data.fw_id,
+						   priv_data.req_id);
+			gb_fw_download_reset();
+			break;
+		}
+
+		gb_fw_download_fill_window();
 	}
 
-	priv_data.offset += cur_data_size;
-	if (is_final_write) {
-		gb_fw_release_firmware(cport, priv_data.fw_id);
-	} else {
-		new_data_size = MIN(priv_data.fw_size - priv_data.offset, DATA_SIZE_MAX);
-		gb_fw_download_fetch_firmware(cport, priv_data.fw_id, priv_data.offset,
-					      new_data_size);
+	k_mutex_unlock(&priv_data.lock);
+}
+
+static K_WORK_DEFINE(fw_write_work, gb_fw_download_write_handler);
+
+static void gb_fw_download_fetch_firmware_response_handler(uint16_t cport, struct gb_message *resp)
+{
+	struct fw_fetch_slot *slot;
+
+	ARG_UNUSED(cport);
+
+	k_mutex_lock(&priv_data.lock, K_FOREVER);
+
+	slot = gb_fw_download_slot_in_flight(resp->header.operation_id);
+	if (!slot) {
+		LOG_WRN("Unexpected fetch firmware response");
+		gb_message_dealloc(resp);
+		goto unlock;
 	}
 
-	ret = flash_img_buffered_write(&priv_data.ctx, resp->payload, cur_data_size,
-				       is_final_write);
-	if (ret < 0) {
-		LOG_ERR("Failed to write firmware to flash: %d", ret);
-		gb_fw_download_early_fail(cport, priv_data.fw_id, priv_data.fw_size);
-		return gb_message_dealloc(resp);
+	if (!gb_message_is_success(resp) || gb_message_payload_len(resp) != slot->size) {
+		LOG_ERR("Fetch firmware request failed");
+		gb_message_dealloc(resp);
+		gb_fw_download_abort();
+		goto unlock;
 	}
 
-	gb_message_dealloc(resp);
+	slot->resp = resp;
+	slot->state = FW_FETCH_READY;
 
-	if (is_final_write) {
-		gb_fw_download_fetch_final(cport, priv_data.fw_id, priv_data.req_id);
-		priv_data.req_id = -1;
+	if (slot->offset == priv_data.write_offset) {
+		k_work_submit_to_queue(&fw_wq, &fw_write_work);
 	}
 
-	LOG_INF("Offset: %u", priv_data.offset);
+unlock:
+	k_mutex_unlock(&priv_data.lock);
+}
+
+static void gb_fw_download_fetch_firmware_cb(uint16_t cport, uint16_t operation_id,
+					     struct gb_message *resp, int err, void *priv)
+{
+	ARG_UNUSED(priv);
+
+	if (err == -ECANCELED) {
+		/* Only happens on reset, which frees the slot itself */
+		return;
+	}
+
+	if (err == 0) {
+		return gb_fw_download_fetch_firmware_response_handler(cport, resp);
+	}
+
+	k_mutex_lock(&priv_data.lock, K_FOREVER);
+	if (gb_fw_download_slot_in_flight(operation_id)) {
+		LOG_ERR("Fetch firmware request timed out");
+		gb_fw_download_abort();
+	}
+	k_mutex_unlock(&priv_data.lock);
 }
 
 static void op_handler(const void *priv, struct gb_message *msg, uint16_t cport)
@@ -178,14 +1248,38 @@ const struct gb_driver gb_fw_download_driver = {
 void gb_fw_download_find_firmware(uint8_t req_id, const char *firmware_tag)
 {
 	struct gb_message *req =
-		gb_message_request_alloc(sizeof(struct gb_fw_download_find_firmware_request),
-					 GB_FW_DOWNLOAD_TYPE_FIND_FIRMWARE, false);
+		gb_cport_request_alloc(GREYBUS_FW_DOWNLOAD_CPORT,
+				       sizeof(struct gb_fw_download_find_firmware_request),
+				       GB_FW_DOWNLOAD_TYPE_FIND_FIRMWARE);
 	struct gb_fw_download_find_firmware_request *req_data =
 		(struct gb_fw_download_find_firmware_request *)req->payload;
 
+	k_mutex_lock(&priv_data.lock, K_FOREVER);
+	/* A new request from the AP supersedes whatever was in progress */
+	gb_fw_download_reset();
 	priv_data.req_id = req_id;
+	memcpy(priv_data.fw_tag, firmware_tag, sizeof(priv_data.fw_tag));
+	k_mutex_unlock(&priv_data.lock);
+
 	strncpy(req_data->firmware_tag, firmware_tag, sizeof(req_data->firmware_tag));
 
 	gb_transport_message_send(req, GREYBUS_FW_DOWNLOAD_CPORT);
 	gb_message_dealloc(req);
 }
+
+static int gb_fw_download_init(void)
+{
+	k_work_queue_start(&fw_wq, fw_wq_stack, K_THREAD_STACK_SIZEOF(fw_wq_stack),
+			   CONFIG_GREYBUS_FW_DOWNLOAD_WQ_PRIORITY, NULL);
+	k_thread_name_set(&fw_wq.thread, "gb_fw_wq");
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
+	k_work_queue_start(&fw_erase_wq, fw_erase_wq_stack,
+			   K_THREAD_STACK_SIZEOF(fw_erase_wq_stack),
+			   CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_WQ_PRIORITY, NULL);
+	k_thread_name_set(&fw_erase_wq.thread, "gb_fw_erase_wq");
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
+
+	return 0;
+}
+
+SYS_INIT(gb_fw_download_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
@@ -10,6 +10,7 @@
 #include <greybus-utils/manifest.h>
 #include <zephyr/logging/log.h>
 #include "greybus_fw_download.h"
+#include "greybus_cport.h"
 #include "greybus_internal.h"
 
 LOG_MODULE_REGISTER(greybus_fw_mgmt, CONFIG_GREYBUS_LOG_LEVEL);
@@ -40,7 +41,13 @@ static void fw_mgmt_interface_fw_load_and_validate(uint16_t cport, struct gb_mes
 	const struct gb_fw_mgmt_load_and_validate_fw_request *req_data =
 		(const struct gb_fw_mgmt_load_and_validate_fw_request *)req->payload;
 
-	if (req_data->load_method != GB_FW_LOAD_METHOD_UNIPRO) {
+	/*
+	 * An AP with a delta image asks for it first and falls back to the full image if refused.
+	 * Either way the image comes over fw_download, which tells them apart by their header.
+	 */
+	if (req_data->load_method != GB_FW_LOAD_METHOD_UNIPRO &&
+	    (req_data->load_method != GB_FW_LOAD_METHOD_VENDOR_UNIPRO_DELTA ||
+	     !IS_ENABLED(CONFIG_GREYBUS_FW_DOWNLOAD_DELTA))) {
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
@@ -73,8 +80,10 @@ const struct gb_driver gb_fw_mgmt_driver = {
 
 void gb_fw_mgmt_interface_fw_loaded(uint8_t id, uint8_t status, uint16_t major, uint16_t minor)
 {
-	struct gb_message *msg = gb_message_request_alloc(
-		sizeof(struct gb_fw_mgmt_loaded_fw_request), GB_FW_MGMT_TYPE_LOADED_FW, false);
+	struct gb_message *msg =
+		gb_cport_request_alloc(GREYBUS_FW_MANAGEMENT_CPORT,
+				       sizeof(struct gb_fw_mgmt_loaded_fw_request),
+				       GB_FW_MGMT_TYPE_LOADED_FW);
 	struct gb_fw_mgmt_loaded_fw_request *req_data =
 		(struct gb_fw_mgmt_loaded_fw_request *)msg->payload;
 
@@ -37,12 +37,16 @@
 #include "greybus_gpio.h"
 #include <greybus/greybus_protocols.h>
 #include "greybus_internal.h"
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+#include "greybus_cport.h"
+#include "greybus_operation.h"
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
 
 LOG_MODULE_REGISTER(greybus_gpio, CONFIG_GREYBUS_LOG_LEVEL);
 
-static void gb_gpio_line_count(uint16_t cport, struct gb_message *req,
-			       const struct gb_gpio_driver_data *data)
+static void gb_gpio_line_count(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	const struct gb_gpio_driver_data *data = priv;
 	const struct gb_gpio_line_count_response resp_data = {
 		/* Need to return 1 less than number of GPIOs */
 		.count = data->ngpios - 1,
@@ -51,16 +55,12 @@ static void gb_gpio_line_count(uint16_t cport, struct gb_message *req,
 	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-static void gb_gpio_activate(uint16_t cport, struct gb_message *req,
-			     const struct gb_gpio_driver_data *data)
+static void gb_gpio_activate(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	const struct gb_gpio_driver_data *data = priv;
 	const struct gb_gpio_activate_request *request =
 		(const struct gb_gpio_activate_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
@@ -69,16 +69,12 @@ static void gb_gpio_activate(uint16_t cport, struct gb_message *req,
 	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
 }
 
-static void gb_gpio_deactivate(uint16_t cport, struct gb_message *req,
-			       const struct gb_gpio_driver_data *data)
+static void gb_gpio_deactivate(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	const struct gb_gpio_driver_data *data = priv;
 	const struct gb_gpio_deactivate_request *request =
 		(const struct gb_gpio_deactivate_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
@@ -88,17 +84,13 @@ static void gb_gpio_deactivate(uint16_t cport, struct gb_message *req,
 	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
 }
 
-static void gb_gpio_get_direction(uint16_t cport, struct gb_message *req,
-				  const struct gb_gpio_driver_data *data)
+static void gb_gpio_get_direction(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	const struct gb_gpio_driver_data *data = priv;
 	struct gb_gpio_get_direction_response resp_data;
 	const struct gb_gpio_get_direction_request *request =
 		(const struct gb_gpio_get_direction_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
@@ -108,17 +100,13 @@ static void gb_gpio_get_direction(uint16_t cport, struct gb_message *req,
 	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-static void gb_gpio_direction_in(uint16_t cport, struct gb_message *req,
-				 const struct gb_gpio_driver_data *data)
+static void gb_gpio_direction_in(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	const struct gb_gpio_driver_data *data = priv;
 	uint8_t ret;
 	const struct gb_gpio_direction_in_request *request =
 		(const struct gb_gpio_direction_in_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
@@ -128,17 +116,13 @@ static void gb_gpio_direction_in(uint16_t cport, struct gb_message *req,
 	return gb_transport_message_empty_response_send(req, ret, cport);
 }
 
-static void gb_gpio_direction_out(uint16_t cport, struct gb_message *req,
-				  const struct gb_gpio_driver_data *data)
+static void gb_gpio_direction_out(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	const struct gb_gpio_driver_data *data = priv;
 	int ret;
 	const struct gb_gpio_direction_out_request *request =
 		(const struct gb_gpio_direction_out_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
@@ -153,17 +137,13 @@ static void gb_gpio_direction_out(uint16_t cport, struct gb_message *req,
 	gb_transport_message_empty_response_send(req, ret, cport);
 }
 
-static void gb_gpio_get_value(uint16_t cport, struct gb_message *req,
-			      const struct gb_gpio_driver_data *data)
+static void gb_gpio_get_value(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	const struct gb_gpio_driver_data *data = priv;
 	struct gb_gpio_get_value_response resp_data;
 	const struct gb_gpio_get_value_request *request =
 		(const struct gb_gpio_get_value_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
@@ -172,17 +152,13 @@ static void gb_gpio_get_value(uint16_t cport, struct gb_message *req,
 	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-static void gb_gpio_set_value(uint16_t cport, struct gb_message *req,
-			      const struct gb_gpio_driver_data *data)
+static void gb_gpio_set_value(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	const struct gb_gpio_driver_data *data = priv;
 	uint8_t ret;
 	const struct gb_gpio_set_value_request *request =
 		(const struct gb_gpio_set_value_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
@@ -191,9 +167,206 @@ static void gb_gpio_set_value(uint16_t cport, struct gb_message *req,
 	gb_transport_message_empty_response_send(req, ret, cport);
 }
 
-static void gb_gpio_set_debounce(uint16_t cport, struct gb_message *req,
-				 const struct gb_gpio_driver_data *data)
+#ifdef CONFIG_GREYBUS_GPIO_DEBOUNCE
+static void gb_gpio_irq_raise(struct gb_gpio_driver_data *data, gpio_port_pins_t pins);
+
+static gpio_flags_t gb_gpio_debounce_edges(const struct gb_gpio_driver_data *data, gpio_pin_t pin)
 {
+	if ((data->rising & BIT(pin)) && (data->falling & BIT(pin))) {
+		return GPIO_INT_EDGE_BOTH;
+	} else if (data->rising & BIT(pin)) {
+		return GPIO_INT_EDGE_RISING;
+	} else if (data->falling & BIT(pin)) {
+		return GPIO_INT_EDGE_FALLING;
+	}
+
+	return 0;
+}
+
+/*
+ * Helper to restart the timer of the bouncing lines. Edges are counted, and the line is only
+ * reported once it settled. Called from the GPIO callback, so possibly in interrupt context.
+ *
+ * @returns lines which are not debounced, and must be reported right away.
+ */
+static gpio_port_pins_t gb_gpio_debounce_filter(struct gb_gpio_driver_data *data,
+						gpio_port_pins_t pins)
+{
+	size_t i;
+	gpio_port_pins_t lines;
+	int64_t now, next = INT64_MAX;
+	k_spinlock_key_t key = k_spin_lock(&data->debounce_lock);
+	/* Only edge interrupts are debounced, level interrupts are reported as they come */
+	const gpio_port_pins_t bounce = pins & data->debounced & (data->rising | data->falling);
+
+	if (!bounce) {
+		k_spin_unlock(&data->debounce_lock, key);
+		return pins;
+	}
+
+	now = k_uptime_ticks();
+	for (i = 0, lines = bounce; i < GPIO_MAX_PINS_PER_PORT && lines != 0; ++i, lines >>= 1) {
+		if (lines & 1) {
+			data->edges[i]++;
+			data->deadline[i] = now + k_us_to_ticks_ceil64(data->debounce_us[i]);
+		}
+	}
+
+	data->bouncing |= bounce;
+	for (i = 0, lines = data->bouncing; i < GPIO_MAX_PINS_PER_PORT && lines != 0;
+	     ++i, lines >>= 1) {
+		if (lines & 1) {
+			next = MIN(next, data->deadline[i]);
+		}
+	}
+	k_work_reschedule(&data->debounce_work, K_TIMEOUT_ABS_TICKS(next));
+
+	k_spin_unlock(&data->debounce_lock, key);
+
+	return pins & ~bounce;
+}
+
+static void gb_gpio_debounce_work_handler(struct k_work *work)
+{
+	size_t i;
+	int ret;
+	gpio_port_value_t value;
+	gpio_port_pins_t lines, changed, events, ready = 0;
+	int64_t next = INT64_MAX;
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct gb_gpio_driver_data *data =
+		CONTAINER_OF(dwork, struct gb_gpio_driver_data, debounce_work);
+	/* Taken before the read, lines with an edge after it are not settled yet */
+	const int64_t now = k_uptime_ticks();
+	k_spinlock_key_t key;
+
+	ret = gpio_port_get(data->dev, &value);
+	if (ret < 0) {
+		LOG_ERR("Failed to read debounced lines: %d", ret);
+		return;
+	}
+
+	key = k_spin_lock(&data->debounce_lock);
+
+	for (i = 0, lines = data->bouncing; i < GPIO_MAX_PINS_PER_PORT && lines != 0;
+	     ++i, lines >>= 1) {
+		if (!(lines & 1)) {
+			continue;
+		}
+
+		if (data->deadline[i] <= now) {
+			ready |= BIT(i);
+		} else {
+			next = MIN(next, data->deadline[i]);
+		}
+	}
+
+	data->bouncing &= ~ready;
+	changed = (value ^ data->settled) & ready;
+	data->settled ^= changed;
+	events = changed & ((value & data->rising) | (~value & data->falling));
+
+	for (i = 0, lines = changed; i < GPIO_MAX_PINS_PER_PORT && lines != 0; ++i, lines >>= 1) {
+		if (lines & 1) {
+			data->transitions[i]++;
+		}
+	}
+
+	if (data->bouncing) {
+		k_work_reschedule(&data->debounce_work, K_TIMEOUT_ABS_TICKS(next));
+	}
+
+	k_spin_unlock(&data->debounce_lock, key);
+
+	if (events) {
+		gb_gpio_irq_raise(data, events);
+	}
+}
+
+/*
+ * Helper to start or stop debouncing a line. Debounced lines catch edges in both directions, so
+ * that the settled level always follows the line.
+ */
+static int gb_gpio_debounce_set(struct gb_gpio_driver_data *data, gpio_pin_t pin, uint16_t usec)
+{
+	int level = 0;
+	gpio_flags_t flags;
+	k_spinlock_key_t key;
+
+	if (usec) {
+		level = gpio_pin_get(data->dev, pin);
+		if (level < 0) {
+			return level;
+		}
+	}
+
+	key = k_spin_lock(&data->debounce_lock);
+	WRITE_BIT(data->debounced, pin, usec != 0);
+	WRITE_BIT(data->settled, pin, level > 0);
+	data->bouncing &= ~BIT(pin);
+	data->debounce_us[pin] = usec;
+	data->edges[pin] = 0;
+	data->transitions[pin] = 0;
+	flags = gb_gpio_debounce_edges(data, pin);
+	k_spin_unlock(&data->debounce_lock, key);
+
+	if (!flags) {
+		return 0;
+	}
+
+	return gpio_pin_interrupt_configure(data->dev, pin, usec ? GPIO_INT_EDGE_BOTH : flags);
+}
+
+static void gb_gpio_edge_count(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	struct gb_gpio_driver_data *data = (struct gb_gpio_driver_data *)priv;
+	struct gb_gpio_edge_count_response resp_data;
+	k_spinlock_key_t key;
+	const struct gb_gpio_edge_count_request *request =
+		(const struct gb_gpio_edge_count_request *)req->payload;
+
+	if (request->which >= data->ngpios) {
+		LOG_ERR("Invalid GPIO pin index: %u", request->which);
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	key = k_spin_lock(&data->debounce_lock);
+	resp_data.edges = sys_cpu_to_le32(data->edges[request->which]);
+	resp_data.transitions = sys_cpu_to_le32(data->transitions[request->which]);
+	k_spin_unlock(&data->debounce_lock, key);
+
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
+}
+#endif // CONFIG_GREYBUS_GPIO_DEBOUNCE
+
+/*
+ * Helper to configure the interrupt of a line. Edges of debounced lines are caught in both
+ * directions, the requested ones are picked once the line settled.
+ */
+static int gb_gpio_irq_configure(struct gb_gpio_driver_data *data, gpio_pin_t pin,
+				 gpio_flags_t flags)
+{
+#ifdef CONFIG_GREYBUS_GPIO_DEBOUNCE
+	const bool edge = (flags & GPIO_INT_EDGE) && (flags & GPIO_INT_ENABLE);
+	bool debounced;
+	k_spinlock_key_t key = k_spin_lock(&data->debounce_lock);
+
+	WRITE_BIT(data->rising, pin, edge && (flags & GPIO_INT_HIGH_1));
+	WRITE_BIT(data->falling, pin, edge && (flags & GPIO_INT_LOW_0));
+	debounced = edge && (data->debounced & BIT(pin));
+	k_spin_unlock(&data->debounce_lock, key);
+
+	if (debounced) {
+		flags = GPIO_INT_EDGE_BOTH;
+	}
+#endif // CONFIG_GREYBUS_GPIO_DEBOUNCE
+
+	return gpio_pin_interrupt_configure(data->dev, pin, flags);
+}
+
+static void gb_gpio_set_debounce(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	struct gb_gpio_driver_data *data = (struct gb_gpio_driver_data *)priv;
 	uint8_t ret = GB_OP_SUCCESS;
 	gpio_flags_t flags = 0;
 	const struct gb_gpio_set_debounce_request *request =
@@ -203,74 +376,63 @@ static void gb_gpio_set_debounce(uint16_t cport, struct gb_message *req,
 	flags = CC13XX_CC26XX_GPIO_DEBOUNCE;
 #endif
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
+#ifdef CONFIG_GREYBUS_GPIO_DEBOUNCE
+	ARG_UNUSED(flags);
+	ret = gb_errno_to_op_result(
+		gb_gpio_debounce_set(data, request->which, sys_le16_to_cpu(request->usec)));
+#else
 	if (sys_le16_to_cpu(request->usec) > 0) {
 		ret = gb_errno_to_op_result(
 			gpio_pin_configure(data->dev, (gpio_pin_t)request->which, flags));
 	}
+#endif // CONFIG_GREYBUS_GPIO_DEBOUNCE
 
 	gb_transport_message_empty_response_send(req, ret, cport);
 }
 
-static void gb_gpio_irq_mask(uint16_t cport, struct gb_message *req,
-			     const struct gb_gpio_driver_data *data)
+static void gb_gpio_irq_mask(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	struct gb_gpio_driver_data *data = (struct gb_gpio_driver_data *)priv;
 	uint8_t ret;
 	const struct gb_gpio_irq_mask_request *request =
 		(const struct gb_gpio_irq_mask_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
-	ret = gb_errno_to_op_result(
-		gpio_pin_interrupt_configure(data->dev, request->which, GPIO_INT_DISABLE));
+	ret = gb_errno_to_op_result(gb_gpio_irq_configure(data, request->which, GPIO_INT_DISABLE));
 	gb_transport_message_empty_response_send(req, ret, cport);
 }
 
-static void gb_gpio_irq_unmask(uint16_t cport, struct gb_message *req,
-			       const struct gb_gpio_driver_data *data)
+static void gb_gpio_irq_unmask(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	struct gb_gpio_driver_data *data = (struct gb_gpio_driver_data *)priv;
 	uint8_t ret;
 	const struct gb_gpio_irq_unmask_request *request =
 		(const struct gb_gpio_irq_unmask_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
-	ret = gb_errno_to_op_result(gpio_pin_interrupt_configure(
-		data->dev, request->which, GPIO_INT_ENABLE | GPIO_INT_EDGE_RISING));
+	ret = gb_errno_to_op_result(gb_gpio_irq_configure(data, request->which,
+							  GPIO_INT_ENABLE | GPIO_INT_EDGE_RISING));
 	gb_transport_message_empty_response_send(req, ret, cport);
 }
 
-static void gb_gpio_irq_type(uint16_t cport, struct gb_message *req,
-			     const struct gb_gpio_driver_data *data)
+static void gb_gpio_irq_type(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	struct gb_gpio_driver_data *data = (struct gb_gpio_driver_data *)priv;
 	uint8_t ret;
 	gpio_flags_t flags;
 	const struct gb_gpio_irq_type_request *request =
 		(const struct gb_gpio_irq_type_request *)req->payload;
 
-	if (gb_message_payload_len(req) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
-	}
 	if (request->which >= data->ngpios) {
 		LOG_ERR("Invalid GPIO pin index: %u", request->which);
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
@@ -298,68 +460,173 @@ static void gb_gpio_irq_type(uint16_t cport, struct gb_message *req,
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	ret = gb_errno_to_op_result(gpio_pin_interrupt_configure(data->dev, request->which, flags));
+	ret = gb_errno_to_op_result(gb_gpio_irq_configure(data, request->which, flags));
 
 	gb_transport_message_empty_response_send(req, ret, cport);
 }
 
-static void gb_gpio_handler(const void *priv, struct gb_message *msg, uint16_t cport)
+#ifdef CONFIG_GREYBUS_GPIO_PORT_OPS
+static void gb_gpio_port_get(const void *priv, struct gb_message *req, uint16_t cport)
 {
 	const struct gb_gpio_driver_data *data = priv;
+	int ret;
+	gpio_port_value_t value;
+	struct gb_gpio_port_get_response resp_data;
 
-	switch (gb_message_type(msg)) {
-	case GB_GPIO_TYPE_LINE_COUNT:
-		return gb_gpio_line_count(cport, msg, data);
-	case GB_GPIO_TYPE_ACTIVATE:
-		return gb_gpio_activate(cport, msg, data);
-	case GB_GPIO_TYPE_DEACTIVATE:
-		return gb_gpio_deactivate(cport, msg, data);
-	case GB_GPIO_TYPE_GET_DIRECTION:
-		return gb_gpio_get_direction(cport, msg, data);
-	case GB_GPIO_TYPE_DIRECTION_IN:
-		return gb_gpio_direction_in(cport, msg, data);
-	case GB_GPIO_TYPE_DIRECTION_OUT:
-		return gb_gpio_direction_out(cport, msg, data);
-	case GB_GPIO_TYPE_GET_VALUE:
-		return gb_gpio_get_value(cport, msg, data);
-	case GB_GPIO_TYPE_SET_VALUE:
-		return gb_gpio_set_value(cport, msg, data);
-	case GB_GPIO_TYPE_SET_DEBOUNCE:
-		return gb_gpio_set_debounce(cport, msg, data);
-	case GB_GPIO_TYPE_IRQ_TYPE:
-		return gb_gpio_irq_type(cport, msg, data);
-	case GB_GPIO_TYPE_IRQ_MASK:
-		return gb_gpio_irq_mask(cport, msg, data);
-	case GB_GPIO_TYPE_IRQ_UNMASK:
-		return gb_gpio_irq_unmask(cport, msg, data);
-	default:
-		LOG_ERR("Invalid type");
-		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
+	ret = gpio_port_get_raw(data->dev, &value);
+	if (ret < 0) {
+		return gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret),
+								cport);
+	}
+
+	resp_data.value = sys_cpu_to_le32(value);
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
+}
+
+static void gb_gpio_port_set(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	const struct gb_gpio_driver_data *data = priv;
+	uint8_t ret;
+	gpio_port_pins_t mask;
+	const struct gpio_driver_config *cfg = (const struct gpio_driver_config *)data->dev->config;
+	const struct gb_gpio_port_set_request *request =
+		(const struct gb_gpio_port_set_request *)req->payload;
+
+	mask = sys_le32_to_cpu(request->mask);
+	if (mask & ~cfg->port_pin_mask) {
+		LOG_ERR("Invalid GPIO port mask: 0x%08x", mask);
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	ret = gb_errno_to_op_result(
+		gpio_port_set_masked_raw(data->dev, mask, sys_le32_to_cpu(request->value)));
+	gb_transport_message_empty_response_send(req, ret, cport);
+}
+#endif // CONFIG_GREYBUS_GPIO_PORT_OPS
+
+static const struct gb_operation_entry gb_gpio_ops[] = {
+	GB_OPERATION(GB_GPIO_TYPE_LINE_COUNT, gb_gpio_line_count, 0),
+	GB_OPERATION(GB_GPIO_TYPE_ACTIVATE, gb_gpio_activate,
+		     sizeof(struct gb_gpio_activate_request)),
+	GB_OPERATION(GB_GPIO_TYPE_DEACTIVATE, gb_gpio_deactivate,
+		     sizeof(struct gb_gpio_deactivate_request)),
+	GB_OPERATION(GB_GPIO_TYPE_GET_DIRECTION, gb_gpio_get_direction,
+		     sizeof(struct gb_gpio_get_direction_request)),
+	GB_OPERATION(GB_GPIO_TYPE_DIRECTION_IN, gb_gpio_direction_in,
+		     sizeof(struct gb_gpio_direction_in_request)),
+	GB_OPERATION(GB_GPIO_TYPE_DIRECTION_OUT, gb_gpio_direction_out,
+		     sizeof(struct gb_gpio_direction_out_request)),
+	GB_OPERATION(GB_GPIO_TYPE_GET_VALUE, gb_gpio_get_value,
+		     sizeof(struct gb_gpio_get_value_request)),
+	GB_OPERATION(GB_GPIO_TYPE_SET_VALUE, gb_gpio_set_value,
+		     sizeof(struct gb_gpio_set_value_request)),
+	GB_OPERATION(GB_GPIO_TYPE_SET_DEBOUNCE, gb_gpio_set_debounce,
+		     sizeof(struct gb_gpio_set_debounce_request)),
+	GB_OPERATION(GB_GPIO_TYPE_IRQ_TYPE, gb_gpio_irq_type,
+		     sizeof(struct gb_gpio_irq_type_request)),
+	GB_OPERATION(GB_GPIO_TYPE_IRQ_MASK, gb_gpio_irq_mask,
+		     sizeof(struct gb_gpio_irq_mask_request)),
+	GB_OPERATION(GB_GPIO_TYPE_IRQ_UNMASK, gb_gpio_irq_unmask,
+		     sizeof(struct gb_gpio_irq_unmask_request)),
+};
+
+#if defined(CONFIG_GREYBUS_GPIO_PORT_OPS) || defined(CONFIG_GREYBUS_GPIO_DEBOUNCE)
+#define GB_GPIO_VENDOR_OPS
+#endif
+
+#ifdef GB_GPIO_VENDOR_OPS
+static const struct gb_operation_entry gb_gpio_vendor_ops[] = {
+#ifdef CONFIG_GREYBUS_GPIO_PORT_OPS
+	GB_VENDOR_OPERATION(GB_GPIO_TYPE_VENDOR_PORT_GET, gb_gpio_port_get, 0),
+	GB_VENDOR_OPERATION(GB_GPIO_TYPE_VENDOR_PORT_SET, gb_gpio_port_set,
+			    sizeof(struct gb_gpio_port_set_request)),
+#endif // CONFIG_GREYBUS_GPIO_PORT_OPS
+#ifdef CONFIG_GREYBUS_GPIO_DEBOUNCE
+	GB_VENDOR_OPERATION(GB_GPIO_TYPE_VENDOR_EDGE_COUNT, gb_gpio_edge_count,
+			    sizeof(struct gb_gpio_edge_count_request)),
+#endif // CONFIG_GREYBUS_GPIO_DEBOUNCE
+};
+#endif // GB_GPIO_VENDOR_OPS
+
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+static void gb_gpio_irq_event_ack(uint16_t cport, uint16_t operation_id, struct gb_message *resp,
+				  int err, void *priv)
+{
+	if (!err && !gb_message_is_success(resp)) {
+		err = -EIO;
 	}
+
+	gb_gpio_latency_acked(POINTER_TO_UINT(priv), err);
+	gb_message_dealloc(resp);
 }
 
+/*
+ * Helper to send the event of a line as a tracked operation, so that the acknowledgement of the
+ * AP can be timed. Falls back to an untracked event if too many are already in flight.
+ */
+static int gb_gpio_irq_event_send_tracked(const struct gb_gpio_driver_data *data, uint8_t which)
+{
+	int ret;
+	bool tracked = true;
+	uint32_t sent_cycles;
+	struct gb_message *msg = gb_cport_request_alloc(
+		data->cport, sizeof(struct gb_gpio_irq_event_request), GB_GPIO_TYPE_IRQ_EVENT);
+
+	if (!msg) {
+		gb_gpio_latency_error();
+		return -ENOMEM;
+	}
+
+	((struct gb_gpio_irq_event_request *)msg->payload)->which = which;
+
+	sent_cycles = k_cycle_get_32();
+	ret = gb_operation_send(data->cport, msg, CONFIG_GREYBUS_GPIO_IRQ_LATENCY_TIMEOUT_MS,
+				gb_gpio_irq_event_ack, UINT_TO_POINTER(sent_cycles));
+	if (ret == -EBUSY || ret == -ENOMEM) {
+		/* Without an operation id the AP does not answer */
+		msg->header.operation_id = 0;
+		tracked = false;
+		ret = gb_transport_message_send(msg, data->cport);
+	}
+
+	if (ret < 0) {
+		gb_gpio_latency_error();
+	} else {
+		gb_gpio_latency_sent(data->irq_cycles[which], sent_cycles, tracked);
+	}
+
+	gb_message_dealloc(msg);
+
+	return ret;
+}
+#else
 struct gpio_irq_event_request_msg {
 	struct gb_operation_msg_hdr hdr;
 	struct gb_gpio_irq_event_request body;
 } __packed;
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
 
-static void gpio_callback_handler(const struct device *port, struct gpio_callback *cb,
-				  gpio_port_pins_t pins)
+static void gb_gpio_irq_event_send(const struct gb_gpio_driver_data *data, gpio_port_pins_t pins)
 {
 	int ret;
 	size_t i;
-	struct gb_gpio_driver_data *data = CONTAINER_OF(cb, struct gb_gpio_driver_data, cb);
+#ifndef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
 	uint8_t buf[sizeof(struct gpio_irq_event_request_msg)] = {0};
 	struct gpio_irq_event_request_msg *msg = (struct gpio_irq_event_request_msg *)buf;
 
 	msg->hdr.size = sys_cpu_to_le16(sizeof(buf));
 	msg->hdr.type = GB_GPIO_TYPE_IRQ_EVENT;
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
 
 	for (i = 0; i < GPIO_MAX_PINS_PER_PORT && pins != 0; ++i, pins >>= 1) {
 		if (pins & 1) {
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+			ret = gb_gpio_irq_event_send_tracked(data, i);
+#else
 			msg->body.which = i;
 			ret = gb_transport_message_send((const struct gb_message *)buf,
 							data->cport);
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
 			if (ret < 0) {
 				LOG_ERR("GPIO irq send failed: %d", ret);
 			}
@@ -367,6 +634,88 @@ static void gpio_callback_handler(const struct device *port, struct gpio_callbac
 	}
 }
 
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_DEFERRED
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_COALESCE
+#define GB_GPIO_IRQ_DELAY K_USEC(CONFIG_GREYBUS_GPIO_IRQ_COALESCE_US)
+#else
+#define GB_GPIO_IRQ_DELAY K_NO_WAIT
+#endif // CONFIG_GREYBUS_GPIO_IRQ_COALESCE
+
+static void gpio_irq_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct gb_gpio_driver_data *data =
+		CONTAINER_OF(dwork, struct gb_gpio_driver_data, irq_work);
+
+	gb_gpio_irq_event_send(data, atomic_clear(&data->irq_pending));
+}
+
+static void gb_gpio_irq_raise(struct gb_gpio_driver_data *data, gpio_port_pins_t pins)
+{
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+	const uint32_t now = k_cycle_get_32();
+	/* Merged interrupts keep the time of the first one */
+	gpio_port_pins_t fresh = pins & ~(gpio_port_pins_t)atomic_get(&data->irq_pending);
+
+	gb_gpio_latency_irq(POPCOUNT(pins), now);
+	for (size_t i = 0; i < GPIO_MAX_PINS_PER_PORT && fresh != 0; ++i, fresh >>= 1) {
+		if (fresh & 1) {
+			data->irq_cycles[i] = now;
+		}
+	}
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+
+	atomic_or(&data->irq_pending, pins);
+	/* Does nothing if already scheduled, which opens the coalescing window */
+	k_work_schedule(&data->irq_work, GB_GPIO_IRQ_DELAY);
+}
+#else
+/* The transport may block, so events raised in interrupt context are queued */
+static void gb_gpio_irq_event_send_isr(const struct gb_gpio_driver_data *data,
+				       gpio_port_pins_t pins)
+{
+	struct gb_message *msg;
+	size_t i;
+
+	for (i = 0; i < GPIO_MAX_PINS_PER_PORT && pins != 0; ++i, pins >>= 1) {
+		if (!(pins & 1)) {
+			continue;
+		}
+
+		msg = gb_message_alloc_isr(sizeof(struct gb_gpio_irq_event_request),
+					   GB_GPIO_TYPE_IRQ_EVENT, 0, 0);
+		if (!msg) {
+			continue;
+		}
+
+		((struct gb_gpio_irq_event_request *)msg->payload)->which = i;
+		gb_transport_message_send_isr(msg, data->cport);
+	}
+}
+
+static void gb_gpio_irq_raise(struct gb_gpio_driver_data *data, gpio_port_pins_t pins)
+{
+	if (k_is_in_isr()) {
+		gb_gpio_irq_event_send_isr(data, pins);
+	} else {
+		gb_gpio_irq_event_send(data, pins);
+	}
+}
+#endif // CONFIG_GREYBUS_GPIO_IRQ_DEFERRED
+
+static void gpio_callback_handler(const struct device *port, struct gpio_callback *cb,
+				  gpio_port_pins_t pins)
+{
+	struct gb_gpio_driver_data *data = CONTAINER_OF(cb, struct gb_gpio_driver_data, cb);
+
+#ifdef CONFIG_GREYBUS_GPIO_DEBOUNCE
+	pins = gb_gpio_debounce_filter(data, pins);
+#endif // CONFIG_GREYBUS_GPIO_DEBOUNCE
+	if (pins) {
+		gb_gpio_irq_raise(data, pins);
+	}
+}
+
 static void gb_gpio_connected(const void *priv, uint16_t cport)
 {
 	int ret;
@@ -375,6 +724,14 @@ static void gb_gpio_connected(const void *priv, uint16_t cport)
 
 	data->cport = cport;
 	gpio_init_callback(&data->cb, gpio_callback_handler, cfg->port_pin_mask);
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_DEFERRED
+	atomic_clear(&data->irq_pending);
+	k_work_init_delayable(&data->irq_work, gpio_irq_work_handler);
+#endif // CONFIG_GREYBUS_GPIO_IRQ_DEFERRED
+#ifdef CONFIG_GREYBUS_GPIO_DEBOUNCE
+	data->bouncing = 0;
+	k_work_init_delayable(&data->debounce_work, gb_gpio_debounce_work_handler);
+#endif // CONFIG_GREYBUS_GPIO_DEBOUNCE
 
 	ret = gpio_add_callback(data->dev, &data->cb);
 	if (ret < 0) {
@@ -387,10 +744,19 @@ static void gb_gpio_disconnected(const void *priv)
 	struct gb_gpio_driver_data *data = (struct gb_gpio_driver_data *)priv;
 
 	gpio_remove_callback(data->dev, &data->cb);
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_DEFERRED
+	k_work_cancel_delayable(&data->irq_work);
+#endif // CONFIG_GREYBUS_GPIO_IRQ_DEFERRED
+#ifdef CONFIG_GREYBUS_GPIO_DEBOUNCE
+	k_work_cancel_delayable(&data->debounce_work);
+#endif // CONFIG_GREYBUS_GPIO_DEBOUNCE
 }
 
 const struct gb_driver gb_gpio_driver = {
 	.connected = gb_gpio_connected,
 	.disconnected = gb_gpio_disconnected,
-	.op_handler = gb_gpio_handler,
+	GB_OPERATIONS(gb_gpio_ops),
+#ifdef GB_GPIO_VENDOR_OPS
+	GB_VENDOR_OPERATIONS(gb_gpio_vendor_ops),
+#endif // GB_GPIO_VENDOR_OPS
 };
@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Interrupts are timestamped with the cycle counter in the GPIO callback, Zephyr has no generic
+ * API for hardware timestamps of GPIO edges. Acknowledgements are the responses of the AP to
+ * events sent as tracked operations.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <greybus/greybus_gpio.h>
+#include "greybus_gpio.h"
+
+static struct {
+	struct k_spinlock lock;
+	struct gb_gpio_latency_stats stats;
+} gb_gpio_latency = {
+	.stats = {
+		.edge_to_irq.min_us = UINT32_MAX,
+		.irq_to_send.min_us = UINT32_MAX,
+		.send_to_ack.min_us = UINT32_MAX,
+	},
+};
+
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_BENCH
+static void gb_gpio_bench_expiry(struct k_timer *timer);
+
+static K_TIMER_DEFINE(gb_gpio_bench_timer, gb_gpio_bench_expiry, NULL);
+
+/*
+ * Toggles of an output pin wired to a line of the bundle. Only ever touched under the stats
+ * lock.
+ */
+static struct {
+	const struct device *port;
+	/* Cycle count of the last toggle */
+	uint32_t edge_cycles;
+	uint32_t remaining;
+	gpio_pin_t pin;
+	bool running;
+	/* The last toggle has not reached the callback yet */
+	bool edge_pending;
+} bench;
+#endif // CONFIG_GREYBUS_GPIO_IRQ_BENCH
+
+/*
+ * Helper to add a latency to a histogram. Must be called with the stats lock held.
+ */
+static void gb_gpio_latency_hist_add(struct gb_gpio_latency_hist *hist, uint32_t cycles)
+{
+	size_t i = 0;
+	const uint32_t latency_us = k_cyc_to_us_floor32(cycles);
+
+	hist->count++;
+	hist->min_us = MIN(hist->min_us, latency_us);
+	hist->max_us = MAX(hist->max_us, latency_us);
+	while (i < GB_GPIO_LATENCY_BUCKETS - 1 && latency_us > GB_GPIO_LATENCY_BUCKET_US(i)) {
+		i++;
+	}
+	hist->histogram[i]++;
+}
+
+void gb_gpio_latency_irq(size_t num, uint32_t cycles)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_gpio_latency.lock);
+
+	gb_gpio_latency.stats.irqs += num;
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_BENCH
+	if (bench.edge_pending) {
+		bench.edge_pending = false;
+		gb_gpio_latency_hist_add(&gb_gpio_latency.stats.edge_to_irq,
+					 cycles - bench.edge_cycles);
+	}
+#endif // CONFIG_GREYBUS_GPIO_IRQ_BENCH
+
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+}
+
+void gb_gpio_latency_sent(uint32_t irq_cycles, uint32_t sent_cycles, bool tracked)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_gpio_latency.lock);
+
+	if (tracked) {
+		gb_gpio_latency.stats.events++;
+	} else {
+		gb_gpio_latency.stats.untracked++;
+	}
+	gb_gpio_latency_hist_add(&gb_gpio_latency.stats.irq_to_send, sent_cycles - irq_cycles);
+
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+}
+
+void gb_gpio_latency_acked(uint32_t sent_cycles, int err)
+{
+	const uint32_t now = k_cycle_get_32();
+	k_spinlock_key_t key = k_spin_lock(&gb_gpio_latency.lock);
+
+	if (err) {
+		gb_gpio_latency.stats.errors++;
+	} else {
+		gb_gpio_latency_hist_add(&gb_gpio_latency.stats.send_to_ack, now - sent_cycles);
+	}
+
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+}
+
+void gb_gpio_latency_error(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_gpio_latency.lock);
+
+	gb_gpio_latency.stats.errors++;
+
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+}
+
+void gb_gpio_latency_get(struct gb_gpio_latency_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_gpio_latency.lock);
+
+	*stats = gb_gpio_latency.stats;
+
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+}
+
+void gb_gpio_latency_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_gpio_latency.lock);
+
+	memset(&gb_gpio_latency.stats, 0, sizeof(gb_gpio_latency.stats));
+	gb_gpio_latency.stats.edge_to_irq.min_us = UINT32_MAX;
+	gb_gpio_latency.stats.irq_to_send.min_us = UINT32_MAX;
+	gb_gpio_latency.stats.send_to_ack.min_us = UINT32_MAX;
+
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+}
+
+uint32_t gb_gpio_latency_percentile(const struct gb_gpio_latency_hist *hist, uint8_t percent)
+{
+	size_t i;
+	uint32_t seen = 0;
+	uint32_t target = DIV_ROUND_UP(hist->count * (uint64_t)percent, 100);
+
+	if (!hist->count) {
+		return 0;
+	}
+
+	for (i = 0; i < GB_GPIO_LATENCY_BUCKETS - 1; i++) {
+		seen += hist->histogram[i];
+		if (seen >= target) {
+			return MIN(GB_GPIO_LATENCY_BUCKET_US(i), hist->max_us);
+		}
+	}
+
+	return hist->max_us;
+}
+
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_BENCH
+static void gb_gpio_bench_expiry(struct k_timer *timer)
+{
+	const struct device *port;
+	gpio_pin_t pin;
+	k_spinlock_key_t key = k_spin_lock(&gb_gpio_latency.lock);
+
+	if (!bench.running) {
+		k_spin_unlock(&gb_gpio_latency.lock, key);
+		return;
+	}
+
+	port = bench.port;
+	pin = bench.pin;
+	if (bench.remaining && --bench.remaining == 0) {
+		bench.running = false;
+		k_timer_stop(timer);
+	}
+
+	/* Taken before the toggle, since the callback may run within gpio_pin_toggle() */
+	bench.edge_cycles = k_cycle_get_32();
+	bench.edge_pending = true;
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+
+	gpio_pin_toggle(port, pin);
+}
+
+int gb_gpio_bench_start(const struct device *port, gpio_pin_t pin, uint32_t rate_hz,
+			uint32_t count)
+{
+	int ret;
+	k_spinlock_key_t key;
+
+	if (rate_hz == 0 || rate_hz > USEC_PER_SEC) {
+		return -EINVAL;
+	}
+
+	if (gb_gpio_bench_running()) {
+		return -EBUSY;
+	}
+
+	ret = gpio_pin_configure(port, pin, GPIO_OUTPUT_INACTIVE);
+	if (ret < 0) {
+		return ret;
+	}
+
+	key = k_spin_lock(&gb_gpio_latency.lock);
+	bench.port = port;
+	bench.pin = pin;
+	bench.remaining = count;
+	bench.edge_pending = false;
+	bench.running = true;
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+
+	k_timer_start(&gb_gpio_bench_timer, K_USEC(USEC_PER_SEC / rate_hz),
+		      K_USEC(USEC_PER_SEC / rate_hz));
+
+	return 0;
+}
+
+void gb_gpio_bench_stop(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_gpio_latency.lock);
+
+	bench.running = false;
+	bench.edge_pending = false;
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+
+	k_timer_stop(&gb_gpio_bench_timer);
+}
+
+bool gb_gpio_bench_running(void)
+{
+	bool running;
+	k_spinlock_key_t key = k_spin_lock(&gb_gpio_latency.lock);
+
+	running = bench.running;
+	k_spin_unlock(&gb_gpio_latency.lock, key);
+
+	return running;
+}
+#endif // CONFIG_GREYBUS_GPIO_IRQ_BENCH
@@ -29,22 +29,78 @@
  *
  * Author: Fabien Parent <fparent@baylibre.com>
  */
+#include <zephyr/init.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include "greybus_capture.h"
 #include "greybus_cport.h"
 #include "greybus_transport.h"
 #include <greybus-utils/manifest.h>
+#include "greybus-manifest.h"
 #include "greybus_internal.h"
+#include "greybus_stats.h"
+#include "greybus_operation.h"
+#include "greybus_quota.h"
 
 LOG_MODULE_REGISTER(greybus, CONFIG_GREYBUS_LOG_LEVEL);
 
 #define GB_PING_TYPE 0x00
 
-/* 2 msg per cport seems to be a good number */
-K_MSGQ_DEFINE(gb_rx_msgq, sizeof(struct gb_msg_with_cport), GREYBUS_CPORT_COUNT * 2, 1);
+/* Large enough for every cport to use all of its credits, whichever lane it maps to */
+#define GB_RX_POOL_DEPTH (GREYBUS_CPORT_COUNT * CONFIG_GREYBUS_RX_CPORT_CREDITS)
 
-K_THREAD_STACK_DEFINE(gb_rx_thread_stack, 1280);
-static struct k_thread gb_rx_thread;
+/*
+ * Each lane has its own worker thread, which drains the expedited queue before the normal one. A
+ * cport always maps to the same lane, and all requests of a cport go to the same queue, so
+ * requests on a single cport are still processed in order.
+ */
+enum gb_rx_prio {
+	/* Control and SVC traffic, and responses to requests sent by the node */
+	GB_RX_PRIO_EXPEDITED,
+	GB_RX_PRIO_NORMAL,
+	GB_RX_PRIO_COUNT,
+};
+
+struct gb_rx_item {
+	struct gb_msg_with_cport msg;
+#ifdef CONFIG_GREYBUS_CPORT_STATS
+	/* Cycle count when the message was queued */
+	uint32_t cycles;
+#endif // CONFIG_GREYBUS_CPORT_STATS
+#ifdef CONFIG_GREYBUS_RX_DEADLINE
+	/* Uptime in milliseconds when the message was received */
+	uint32_t received_ms;
+#endif // CONFIG_GREYBUS_RX_DEADLINE
+};
+
+struct gb_rx_lane {
+	struct k_msgq msgq[GB_RX_PRIO_COUNT];
+	/* Number of messages queued over all priorities */
+	struct k_sem pending;
+	struct k_thread thread;
+	/* The message being handled was deferred by its handler */
+	bool deferred;
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+	/* Cport of the message being handled, GB_QUOTA_NO_CPORT when idle */
+	uint16_t cport;
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+};
+
+static struct gb_rx_lane gb_rx_lanes[CONFIG_GREYBUS_RX_WORKERS];
+/* Split between the lanes at init, by the number of cports mapped to each of them */
+static char __aligned(4) gb_rx_msgq_buf[GB_RX_PRIO_COUNT]
+				       [GB_RX_POOL_DEPTH * sizeof(struct gb_rx_item)];
+K_THREAD_STACK_ARRAY_DEFINE(gb_rx_thread_stacks, CONFIG_GREYBUS_RX_WORKERS,
+			    CONFIG_GREYBUS_RX_WORKER_STACK_SIZE);
+
+/* Messages each cport may still queue. Taken on receive and given back once handled. */
+static struct k_sem gb_rx_credits[GREYBUS_CPORT_COUNT];
+
+#ifdef CONFIG_GREYBUS_ASYNC_OPERATIONS
+static K_THREAD_STACK_DEFINE(gb_async_wq_stack, CONFIG_GREYBUS_ASYNC_OPERATIONS_WQ_STACK_SIZE);
+static struct k_work_q gb_async_wq;
+#endif // CONFIG_GREYBUS_ASYNC_OPERATIONS
 
 uint8_t gb_errno_to_op_result(int err)
 {
@@ -97,6 +153,72 @@ uint8_t gb_errno_to_op_result(int err)
 	}
 }
 
+static const struct gb_operation_entry *gb_operation_lookup(const struct gb_driver *driver,
+							     uint8_t type)
+{
+	const struct gb_operation_entry *entry = NULL;
+
+	if (type >= GB_VENDOR_TYPE_BASE) {
+		type -= GB_VENDOR_TYPE_BASE;
+		if (type < driver->vendor_ops_num) {
+			entry = &driver->vendor_ops[type];
+		}
+	} else if (type < driver->ops_num) {
+		entry = &driver->ops[type];
+	}
+
+	return (entry && entry->handler) ? entry : NULL;
+}
+
+static bool gb_operation_payload_valid(const struct gb_operation_entry *entry,
+				       const struct gb_message *msg)
+{
+	const size_t len = gb_message_payload_len(msg);
+	size_t count;
+
+	if (len < entry->min_payload_len) {
+		return false;
+	}
+
+	if (!entry->elem_size) {
+		return true;
+	}
+
+	if (entry->count_size == sizeof(uint8_t)) {
+		count = msg->payload[entry->count_offset];
+	} else {
+		count = sys_get_le16(&msg->payload[entry->count_offset]);
+	}
+
+	return len - entry->min_payload_len >= count * entry->elem_size;
+}
+
+/* Requests are validated here, so that handlers can rely on the fixed part of their payload */
+static void gb_operation_dispatch(const struct gb_cport *cport_ptr, struct gb_message *msg,
+				  uint16_t cport)
+{
+	const struct gb_operation_entry *entry;
+
+	/* Nothing waits for responses which are not tracked by an operation */
+	if (gb_message_is_response(msg)) {
+		LOG_DBG("Dropping untracked response 0x%02x", gb_message_type(msg));
+		return gb_message_dealloc(msg);
+	}
+
+	entry = gb_operation_lookup(cport_ptr->driver, gb_message_type(msg));
+	if (!entry) {
+		LOG_ERR("Invalid type 0x%02x on cport %u", gb_message_type(msg), cport);
+		return gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
+	}
+
+	if (!gb_operation_payload_valid(entry, msg)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
+	}
+
+	entry->handler(cport_ptr->priv, msg, cport);
+}
+
 static void gb_process_msg(struct gb_message *msg, uint16_t cport)
 {
 	const struct gb_cport *cport_ptr = gb_cport_get(cport);
@@ -105,49 +227,289 @@ static void gb_process_msg(struct gb_message *msg, uint16_t cport)
 		return gb_transport_message_empty_response_send(msg, GB_OP_SUCCESS, cport);
 	}
 
-	cport_ptr->driver->op_handler(cport_ptr->priv, msg, cport);
+	/* Responses to tracked requests go to the operation callback instead of the driver */
+	if (gb_message_is_response(msg) && gb_operation_complete(cport, msg)) {
+		return;
+	}
+
+	if (cport_ptr->driver->op_handler) {
+		return cport_ptr->driver->op_handler(cport_ptr->priv, msg, cport);
+	}
+
+	gb_operation_dispatch(cport_ptr, msg, cport);
+}
+
+#ifdef CONFIG_GREYBUS_RX_DEADLINE
+/*
+ * Check if the host has most likely given up on a request. Responses, unidirectional requests
+ * and the control and SVC cports change state on either side, so they never expire.
+ */
+static bool gb_rx_item_expired(const struct gb_rx_item *item)
+{
+	const struct gb_message *msg = item->msg.msg;
+	uint32_t deadline_ms = gb_cport_get(item->msg.cport)->driver->rx_deadline_ms;
+
+	if (gb_message_is_response(msg) || msg->header.operation_id == 0 ||
+	    gb_cport_is_expedited(item->msg.cport)) {
+		return false;
+	}
+
+	if (!deadline_ms) {
+		deadline_ms = CONFIG_GREYBUS_RX_DEADLINE_MS;
+	}
+
+	return k_uptime_get_32() - item->received_ms > deadline_ms;
+}
+#else
+static inline bool gb_rx_item_expired(const struct gb_rx_item *item)
+{
+	return false;
+}
+#endif // CONFIG_GREYBUS_RX_DEADLINE
+
+/* Requests past their deadline are answered right away, without calling the driver */
+static void gb_rx_item_process(const struct gb_rx_item *item)
+{
+	if (gb_rx_item_expired(item)) {
+		LOG_DBG("Request 0x%02x on cport %u is past its deadline",
+			gb_message_type(item->msg.msg), item->msg.cport);
+		return gb_transport_message_empty_response_send(item->msg.msg, GB_OP_TIMEOUT,
+								item->msg.cport);
+	}
+
+	gb_process_msg(item->msg.msg, item->msg.cport);
+}
+
+/*
+ * Responses, such as GPIO IRQ acks, complete operations the node is waiting on. They are matched
+ * by operation id, so letting them overtake queued requests does not change behaviour.
+ */
+static enum gb_rx_prio gb_rx_prio_get(uint16_t cport, const struct gb_message *msg)
+{
+	if (gb_cport_is_expedited(cport) || gb_message_is_response(msg)) {
+		return GB_RX_PRIO_EXPEDITED;
+	}
+
+	return GB_RX_PRIO_NORMAL;
+}
+
+/*
+ * Control and SVC cports get lane 0 to themselves (when there is more than one lane). Everything
+ * else is spread over the remaining lanes by cport number.
+ */
+static struct gb_rx_lane *gb_rx_lane_get(uint16_t cport)
+{
+	const size_t bulk_lanes = ARRAY_SIZE(gb_rx_lanes) - 1;
+
+	if (bulk_lanes == 0 || gb_cport_is_expedited(cport)) {
+		return &gb_rx_lanes[0];
+	}
+
+	return &gb_rx_lanes[1 + (cport % bulk_lanes)];
+}
+
+/* Take the oldest message of the highest priority queued on the lane */
+static void gb_rx_lane_get_item(struct gb_rx_lane *lane, struct gb_rx_item *item)
+{
+	k_sem_take(&lane->pending, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(lane->msgq); i++) {
+		if (k_msgq_get(&lane->msgq[i], item, K_NO_WAIT) == 0) {
+			return;
+		}
+	}
+
+	/* Unreachable, every give of pending follows a successful put */
+	__ASSERT_NO_MSG(false);
 }
 
 static void gb_pending_message_worker(void *p1, void *p2, void *p3)
 {
-	ARG_UNUSED(p1);
 	ARG_UNUSED(p2);
 	ARG_UNUSED(p3);
 
-	int ret;
-	struct gb_msg_with_cport msg;
+	struct gb_rx_item item;
+	struct gb_rx_lane *lane = p1;
+	const struct gb_msg_with_cport *msg = &item.msg;
+	uint32_t __maybe_unused start;
 
 	while (1) {
-		ret = k_msgq_get(&gb_rx_msgq, &msg, K_FOREVER);
-		if (ret < 0) {
-			continue;
+		gb_rx_lane_get_item(lane, &item);
+		lane->deferred = false;
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+		lane->cport = msg->cport;
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+
+		LOG_DBG("CPort: %d, Type: %d, Result: %d, Id: %u", msg->cport,
+			gb_message_type(msg->msg), msg->msg->header.result,
+			msg->msg->header.operation_id);
+
+#ifdef CONFIG_GREYBUS_CPORT_STATS
+		start = k_cycle_get_32();
+		gb_stats_rx(msg->cport, msg->msg, start - item.cycles);
+		gb_rx_item_process(&item);
+		gb_stats_handler(msg->cport, k_cycle_get_32() - start);
+#else
+		gb_rx_item_process(&item);
+#endif // CONFIG_GREYBUS_CPORT_STATS
+
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+		lane->cport = GB_QUOTA_NO_CPORT;
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+
+		/* A deferred request gives its credit back once it is done */
+		if (!lane->deferred) {
+			k_sem_give(&gb_rx_credits[msg->cport]);
 		}
+	}
+}
+
+void gb_operation_defer(uint16_t cport)
+{
+	struct gb_rx_lane *lane = gb_rx_lane_get(cport);
+
+	__ASSERT(k_current_get() == &lane->thread, "Only operation handlers can defer");
+	lane->deferred = true;
+}
 
-		LOG_DBG("CPort: %d, Type: %d, Result: %d, Id: %u", msg.cport,
-			gb_message_type(msg.msg), msg.msg->header.result,
-			msg.msg->header.operation_id);
+void gb_operation_deferred_done(uint16_t cport)
+{
+	k_sem_give(&gb_rx_credits[cport]);
+}
 
-		gb_process_msg(msg.msg, msg.cport);
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+/* Bytes of message memory charged to each cport */
+static atomic_t gb_quota_used[GREYBUS_CPORT_COUNT];
+
+uint16_t gb_quota_current_cport(void)
+{
+	const k_tid_t self = k_current_get();
+
+	if (k_is_in_isr()) {
+		return GB_QUOTA_NO_CPORT;
 	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(gb_rx_lanes); i++) {
+		if (self == &gb_rx_lanes[i].thread) {
+			return gb_rx_lanes[i].cport;
+		}
+	}
+
+	return GB_QUOTA_NO_CPORT;
+}
+
+int gb_quota_charge(uint16_t cport, size_t bytes)
+{
+	atomic_val_t used;
+
+	if (cport >= GREYBUS_CPORT_COUNT || gb_cport_is_expedited(cport)) {
+		return 0;
+	}
+
+	used = atomic_add(&gb_quota_used[cport], bytes);
+	if (used + bytes > CONFIG_GREYBUS_CPORT_QUOTA_BYTES) {
+		atomic_sub(&gb_quota_used[cport], bytes);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void gb_quota_release(uint16_t cport, size_t bytes)
+{
+	if (cport >= GREYBUS_CPORT_COUNT || gb_cport_is_expedited(cport)) {
+		return;
+	}
+
+	atomic_sub(&gb_quota_used[cport], bytes);
+}
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+
+#ifdef CONFIG_GREYBUS_ASYNC_OPERATIONS
+void gb_operation_deferred_submit(struct k_work *work)
+{
+	k_work_submit_to_queue(&gb_async_wq, work);
+}
+
+static int gb_async_wq_init(void)
+{
+	k_work_queue_start(&gb_async_wq, gb_async_wq_stack,
+			   K_THREAD_STACK_SIZEOF(gb_async_wq_stack),
+			   CONFIG_GREYBUS_ASYNC_OPERATIONS_WQ_PRIORITY, NULL);
+	k_thread_name_set(&gb_async_wq.thread, "gb_async_wq");
+
+	return 0;
+}
+
+SYS_INIT(gb_async_wq_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+#endif // CONFIG_GREYBUS_ASYNC_OPERATIONS
+
+/*
+ * Wait for a credit of the cport. Responses always wait, since the node has sent the matching
+ * request and dropping the response would leave that operation hanging.
+ */
+static int gb_rx_credit_take(uint16_t cport, const struct gb_message *msg)
+{
+	const bool wait =
+		IS_ENABLED(CONFIG_GREYBUS_RX_OVERFLOW_BLOCK) || gb_message_is_response(msg);
+
+	return k_sem_take(&gb_rx_credits[cport], wait ? K_FOREVER : K_NO_WAIT);
 }
 
 int greybus_rx_handler(uint16_t cport, struct gb_message *msg)
 {
-	const struct gb_driver *drv;
-	const struct gb_msg_with_cport item = {
-		.cport = cport,
-		.msg = msg,
+	const struct gb_cport *cport_ptr = gb_cport_get(cport);
+	struct gb_rx_lane *lane;
+	const struct gb_rx_item item = {
+		.msg = {
+			.cport = cport,
+			.msg = msg,
+		},
+#ifdef CONFIG_GREYBUS_CPORT_STATS
+		.cycles = k_cycle_get_32(),
+#endif // CONFIG_GREYBUS_CPORT_STATS
+#ifdef CONFIG_GREYBUS_RX_DEADLINE
+		.received_ms = k_uptime_get_32(),
+#endif // CONFIG_GREYBUS_RX_DEADLINE
 	};
 
-	drv = gb_cport_get(cport)->driver;
-	if (!drv || !drv->op_handler) {
+	gb_capture_rx(cport, msg);
+
+	if (!cport_ptr || !cport_ptr->driver ||
+	    (!cport_ptr->driver->op_handler && !cport_ptr->driver->ops_num &&
+	     !cport_ptr->driver->vendor_ops_num)) {
 		LOG_ERR("Cport %u does not have a valid driver registered", cport);
 		gb_message_dealloc(msg);
 		return 0;
 	}
 	// LOG_HEXDUMP_DBG(data, size, "RX: ");
 
-	k_msgq_put(&gb_rx_msgq, &item, K_FOREVER);
+	/* Responses complete operations of the node, dropping them would only cause retries */
+	if (!gb_message_is_response(msg) && gb_message_quota_charge(msg, cport) < 0) {
+		LOG_DBG("Cport %u is over its memory budget", cport);
+		if (msg->header.operation_id == 0) {
+			gb_message_dealloc(msg);
+		} else {
+			gb_transport_message_empty_response_send(msg, GB_OP_NO_MEMORY, cport);
+		}
+		return 0;
+	}
+
+	if (gb_rx_credit_take(cport, msg) < 0) {
+		LOG_DBG("Cport %u is out of credits", cport);
+		/* Unidirectional requests expect no response */
+		if (msg->header.operation_id == 0) {
+			gb_message_dealloc(msg);
+		} else {
+			gb_transport_message_empty_response_send(msg, GB_OP_RETRY, cport);
+		}
+		return 0;
+	}
+
+	/* Never blocks, each queue of the lane has room for all credits of its cports */
+	lane = gb_rx_lane_get(cport);
+	k_msgq_put(&lane->msgq[gb_rx_prio_get(cport, msg)], &item, K_FOREVER);
+	k_sem_give(&lane->pending);
 
 	return 0;
 }
@@ -191,6 +553,8 @@ int gb_stop_listening(uint16_t cport)
 int gb_init(const struct gb_transport_backend *transport)
 {
 	int ret;
+	size_t lane_cports[ARRAY_SIZE(gb_rx_lanes)] = {0};
+	size_t offset = 0;
 
 	if (!transport) {
 		return -EINVAL;
@@ -202,9 +566,36 @@ int gb_init(const struct gb_transport_backend *transport)
 		return ret;
 	}
 
-	k_thread_create(&gb_rx_thread, gb_rx_thread_stack,
-			K_THREAD_STACK_SIZEOF(gb_rx_thread_stack), gb_pending_message_worker, NULL,
-			NULL, NULL, 5, 0, K_NO_WAIT);
+	for (size_t i = 0; i < ARRAY_SIZE(gb_rx_credits); i++) {
+		k_sem_init(&gb_rx_credits[i], CONFIG_GREYBUS_RX_CPORT_CREDITS,
+			   CONFIG_GREYBUS_RX_CPORT_CREDITS);
+	}
+
+	for (size_t i = 0; i < GREYBUS_CPORT_COUNT; i++) {
+		lane_cports[gb_rx_lane_get(i) - gb_rx_lanes]++;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(gb_rx_lanes); i++) {
+		struct gb_rx_lane *lane = &gb_rx_lanes[i];
+		const int prio = (i == 0) ? CONFIG_GREYBUS_RX_CONTROL_PRIORITY
+					  : CONFIG_GREYBUS_RX_BULK_PRIORITY;
+		const size_t depth = lane_cports[i] * CONFIG_GREYBUS_RX_CPORT_CREDITS;
+
+		for (size_t j = 0; j < ARRAY_SIZE(lane->msgq); j++) {
+			k_msgq_init(&lane->msgq[j],
+				    gb_rx_msgq_buf[j] + offset * sizeof(struct gb_rx_item),
+				    sizeof(struct gb_rx_item), depth);
+		}
+		offset += depth;
+		k_sem_init(&lane->pending, 0, K_SEM_MAX_LIMIT);
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+		lane->cport = GB_QUOTA_NO_CPORT;
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+		k_thread_create(&lane->thread, gb_rx_thread_stacks[i],
+				K_THREAD_STACK_SIZEOF(gb_rx_thread_stacks[i]),
+				gb_pending_message_worker, lane, NULL, NULL, prio, 0, K_NO_WAIT);
+		k_thread_name_set(&lane->thread, "gb_rx");
+	}
 
 	return transport->init();
 }
@@ -217,7 +608,9 @@ void gb_deinit(void)
 		return; /* gb not initialized */
 	}
 
-	k_thread_abort(&gb_rx_thread);
+	for (size_t i = 0; i < ARRAY_SIZE(gb_rx_lanes); i++) {
+		k_thread_abort(&gb_rx_lanes[i].thread);
+	}
 
 	gb_cports_deinit();
 
@@ -246,6 +639,7 @@ int gb_notify(uint16_t cport, enum gb_event event)
 		break;
 
 	case GB_EVT_DISCONNECTED:
+		gb_operation_cancel_all(cport);
 		if (cport_ptr->driver->disconnected) {
 			cport_ptr->driver->disconnected(cport_ptr->priv);
 		}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GREYBUS_AUDIO_H_
+#define _GREYBUS_AUDIO_H_
+
+#include <zephyr/kernel.h>
+#include <greybus/greybus_protocols.h>
+
+extern const struct gb_driver gb_audio_mgmt_driver;
+extern const struct gb_driver gb_audio_data_driver;
+
+/* One direction of the DAI. TX is playback (AP to I2S), RX is capture (I2S to AP). */
+struct gb_audio_stream {
+	struct k_mem_slab *const slab;
+	/* Audio bytes in each SEND_DATA message, and in each I2S block */
+	uint16_t data_size;
+	/* Blocks queued before the I2S is started, covering GB_AUDIO_SAMPLE_BUFFER_MIN_US */
+	uint16_t prefill;
+	/* Blocks queued since the I2S was prepared */
+	uint16_t queued;
+	bool active;
+	bool started;
+};
+
+/* Shared by the management and data cport of an audio bundle */
+struct gb_audio_driver_data {
+	const struct device *const i2s;
+	/* Optional, configured and started along with playback */
+	const struct device *const codec;
+	struct k_mutex lock;
+	struct k_work rx_work;
+	struct gb_audio_stream tx;
+	struct gb_audio_stream rx;
+	/* GB_AUDIO_PCM_FMT_* and GB_AUDIO_PCM_RATE_* set by SET_PCM, 0 until then */
+	uint32_t format;
+	uint32_t rate;
+	uint32_t frame_rate;
+	uint16_t mgmt_cport;
+	uint16_t data_cport;
+	uint8_t channels;
+	uint8_t sig_bits;
+	/* Bytes per sample of a single channel */
+	uint8_t sample_size;
+};
+
+#endif // _GREYBUS_AUDIO_H_
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GREYBUS_CAMERA_H_
+#define _GREYBUS_CAMERA_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/video.h>
+
+extern const struct gb_driver gb_camera_mgmt_driver;
+extern const struct gb_driver gb_camera_data_driver;
+
+/* Camera protocol operational model */
+enum gb_camera_state {
+	GB_CAMERA_STATE_UNCONFIGURED,
+	GB_CAMERA_STATE_CONFIGURED,
+	GB_CAMERA_STATE_STREAMING,
+};
+
+/* Shared by the management and data cport of a camera bundle */
+struct gb_camera_driver_data {
+	const struct device *const dev;
+	struct k_mutex lock;
+	struct k_work tx_work;
+	/* Allocated by CONFIGURE_STREAMS, owned by the video device while streaming */
+	struct video_buffer *buffers[CONFIG_GREYBUS_CAMERA_BUFFER_COUNT];
+	struct video_format fmt;
+	/* Capture request being served */
+	uint32_t request_id;
+	/* Frames left in the capture request, 0 for continuous capture */
+	uint16_t frames_left;
+	uint16_t frame_number;
+	uint16_t mgmt_cport;
+	uint16_t data_cport;
+	enum gb_camera_state state;
+	/* Cleared to stop the transmit work once the current frame is sent */
+	bool streaming;
+};
+
+#endif // _GREYBUS_CAMERA_H_
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * The taps only copy the message into the ring, the pcapng blocks are built while draining. The
+ * taps are serialized by a spinlock held for the copy, drains never take it. Drains and starts
+ * are serialized by a mutex instead, so that the ring is never reset under a drain.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <greybus/greybus_timesync.h>
+#include "greybus_capture.h"
+
+#define GB_PCAPNG_TYPE_SHB       0x0A0D0D0A
+#define GB_PCAPNG_TYPE_IDB       0x00000001
+#define GB_PCAPNG_TYPE_EPB       0x00000006
+#define GB_PCAPNG_BYTE_ORDER     0x1A2B3C4D
+#define GB_PCAPNG_OPT_IF_TSRESOL 9
+/* Timestamps in nanoseconds */
+#define GB_PCAPNG_TSRESOL        9
+
+#define GB_CAPTURE_SNAPLEN (sizeof(struct gb_capture_hdr) + CONFIG_GREYBUS_CAPTURE_SNAPLEN)
+
+/* pcapng blocks are in host byte order, the section header tells which one */
+struct gb_pcapng_shb {
+	uint32_t type;
+	uint32_t len;
+	uint32_t byte_order;
+	uint16_t major;
+	uint16_t minor;
+	int64_t section_len;
+	uint32_t len_trailer;
+} __packed;
+
+struct gb_pcapng_idb {
+	uint32_t type;
+	uint32_t len;
+	uint16_t linktype;
+	uint16_t reserved;
+	uint32_t snaplen;
+	uint16_t tsresol_code;
+	uint16_t tsresol_len;
+	uint8_t tsresol;
+	uint8_t tsresol_pad[3];
+	uint16_t end_code;
+	uint16_t end_len;
+	uint32_t len_trailer;
+} __packed;
+
+/* Enhanced packet block, up to the packet data */
+struct gb_pcapng_epb {
+	uint32_t type;
+	uint32_t len;
+	uint32_t interface_id;
+	uint32_t ts_high;
+	uint32_t ts_low;
+	uint32_t cap_len;
+	uint32_t orig_len;
+} __packed;
+
+/*
+ * struct gb_capture_record: Message in the ring, followed by the captured bytes
+ *
+ * @timestamp_ns: time the message passed the tap
+ * @cap_len: number of bytes following, pseudo header included
+ * @orig_len: size of the pseudo header and the whole message
+ */
+struct gb_capture_record {
+	uint64_t timestamp_ns;
+	uint32_t cap_len;
+	uint32_t orig_len;
+};
+
+/*
+ * struct gb_capture: Capture state
+ *
+ * @lock: serializes the taps
+ * @drain_lock: serializes the drains and starts
+ * @enabled: messages are being captured
+ * @header: the next drain starts a new section
+ * @drops: messages not captured because the ring was full
+ */
+struct gb_capture {
+	struct k_spinlock lock;
+	struct k_mutex drain_lock;
+	atomic_t enabled;
+	atomic_t header;
+	atomic_t drops;
+};
+
+static struct gb_capture gb_capture = {
+	.drain_lock = Z_MUTEX_INITIALIZER(gb_capture.drain_lock),
+};
+
+RING_BUF_DECLARE(gb_capture_ring, CONFIG_GREYBUS_CAPTURE_RING_SIZE);
+
+/*
+ * Helper to claim room for data in the ring. Nothing is visible to the drain before the whole
+ * record is finished.
+ */
+static void gb_capture_claim(const void *data, size_t len)
+{
+	uint8_t *dst;
+	uint32_t n;
+	const uint8_t *src = data;
+
+	while (len) {
+		n = ring_buf_put_claim(&gb_capture_ring, &dst, len);
+		memcpy(dst, src, n);
+		src += n;
+		len -= n;
+	}
+}
+
+static void gb_capture_message(uint16_t cport, const struct gb_message *msg, uint8_t direction)
+{
+	k_spinlock_key_t key;
+	struct gb_capture_record record;
+	const size_t size = sys_le16_to_cpu(msg->header.size);
+	const struct gb_capture_hdr hdr = {
+		.cport = sys_cpu_to_le16(cport),
+		.direction = direction,
+	};
+
+	if (!atomic_get(&gb_capture.enabled)) {
+		return;
+	}
+
+	record.timestamp_ns = gb_timesync_local_time();
+	record.cap_len = sizeof(hdr) + MIN(size, CONFIG_GREYBUS_CAPTURE_SNAPLEN);
+	record.orig_len = sizeof(hdr) + size;
+
+	key = k_spin_lock(&gb_capture.lock);
+
+	if (ring_buf_space_get(&gb_capture_ring) < sizeof(record) + record.cap_len) {
+		atomic_inc(&gb_capture.drops);
+	} else {
+		gb_capture_claim(&record, sizeof(record));
+		gb_capture_claim(&hdr, sizeof(hdr));
+		gb_capture_claim(&msg->header, record.cap_len - sizeof(hdr));
+		ring_buf_put_finish(&gb_capture_ring, sizeof(record) + record.cap_len);
+	}
+
+	k_spin_unlock(&gb_capture.lock, key);
+}
+
+void gb_capture_rx(uint16_t cport, const struct gb_message *msg)
+{
+	gb_capture_message(cport, msg, GB_CAPTURE_DIR_RX);
+}
+
+void gb_capture_tx(uint16_t cport, const struct gb_message *msg)
+{
+	gb_capture_message(cport, msg, GB_CAPTURE_DIR_TX);
+}
+
+void gb_capture_start(void)
+{
+	k_spinlock_key_t key;
+
+	k_mutex_lock(&gb_capture.drain_lock, K_FOREVER);
+	key = k_spin_lock(&gb_capture.lock);
+
+	ring_buf_reset(&gb_capture_ring);
+	atomic_set(&gb_capture.drops, 0);
+	atomic_set(&gb_capture.header, 1);
+	atomic_set(&gb_capture.enabled, 1);
+
+	k_spin_unlock(&gb_capture.lock, key);
+	k_mutex_unlock(&gb_capture.drain_lock);
+}
+
+void gb_capture_stop(void)
+{
+	atomic_set(&gb_capture.enabled, 0);
+}
+
+uint32_t gb_capture_drops(void)
+{
+	return atomic_get(&gb_capture.drops);
+}
+
+/*
+ * Helper to write the section header and the description of the only interface
+ */
+static int gb_capture_write_header(gb_capture_write_t write, void *user_data)
+{
+	int ret;
+	const struct gb_pcapng_shb shb = {
+		.type = GB_PCAPNG_TYPE_SHB,
+		.len = sizeof(shb),
+		.byte_order = GB_PCAPNG_BYTE_ORDER,
+		.major = 1,
+		.minor = 0,
+		/* Unknown, the capture is a stream */
+		.section_len = -1,
+		.len_trailer = sizeof(shb),
+	};
+	const struct gb_pcapng_idb idb = {
+		.type = GB_PCAPNG_TYPE_IDB,
+		.len = sizeof(idb),
+		.linktype = CONFIG_GREYBUS_CAPTURE_LINKTYPE,
+		.snaplen = GB_CAPTURE_SNAPLEN,
+		.tsresol_code = GB_PCAPNG_OPT_IF_TSRESOL,
+		.tsresol_len = 1,
+		.tsresol = GB_PCAPNG_TSRESOL,
+		.len_trailer = sizeof(idb),
+	};
+
+	ret = write(&shb, sizeof(shb), user_data);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return write(&idb, sizeof(idb), user_data);
+}
+
+/*
+ * Helper to write len bytes straight out of the ring. They are released even if the write fails,
+ * so that the drain stays in sync with the records.
+ */
+static int gb_capture_write_ring(gb_capture_write_t write, void *user_data, size_t len)
+{
+	int ret = 0;
+	uint8_t *data;
+	uint32_t n;
+
+	while (len) {
+		n = ring_buf_get_claim(&gb_capture_ring, &data, len);
+		if (ret == 0) {
+			ret = write(data, n, user_data);
+		}
+		ring_buf_get_finish(&gb_capture_ring, n);
+		len -= n;
+	}
+
+	return ret;
+}
+
+static int gb_capture_drain_locked(gb_capture_write_t write, void *user_data)
+{
+	int ret;
+	struct gb_capture_record record;
+	struct gb_pcapng_epb epb;
+	const uint8_t pad[sizeof(uint32_t)] = {0};
+	size_t pad_len;
+	uint32_t len;
+
+	if (atomic_cas(&gb_capture.header, 1, 0)) {
+		ret = gb_capture_write_header(write, user_data);
+		if (ret < 0) {
+			atomic_set(&gb_capture.header, 1);
+			return ret;
+		}
+	}
+
+	while (ring_buf_get(&gb_capture_ring, (uint8_t *)&record, sizeof(record)) ==
+	       sizeof(record)) {
+		pad_len = ROUND_UP(record.cap_len, sizeof(uint32_t)) - record.cap_len;
+		len = sizeof(epb) + record.cap_len + pad_len + sizeof(len);
+		epb = (struct gb_pcapng_epb){
+			.type = GB_PCAPNG_TYPE_EPB,
+			.len = len,
+			.interface_id = 0,
+			.ts_high = record.timestamp_ns >> 32,
+			.ts_low = (uint32_t)record.timestamp_ns,
+			.cap_len = record.cap_len,
+			.orig_len = record.orig_len,
+		};
+
+		ret = write(&epb, sizeof(epb), user_data);
+		if (ret < 0) {
+			ring_buf_get(&gb_capture_ring, NULL, record.cap_len);
+			return ret;
+		}
+
+		ret = gb_capture_write_ring(write, user_data, record.cap_len);
+		if (ret < 0) {
+			return ret;
+		}
+
+		if (pad_len) {
+			ret = write(pad, pad_len, user_data);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+
+		ret = write(&len, sizeof(len), user_data);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+int gb_capture_drain(gb_capture_write_t write, void *user_data)
+{
+	int ret;
+
+	k_mutex_lock(&gb_capture.drain_lock, K_FOREVER);
+	ret = gb_capture_drain_locked(write, user_data);
+	k_mutex_unlock(&gb_capture.drain_lock);
+
+	return ret;
+}
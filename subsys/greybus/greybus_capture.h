@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Capture taps on the rx and tx paths.
+ */
+
+#ifndef _GREYBUS_CAPTURE_INTERNAL_H_
+#define _GREYBUS_CAPTURE_INTERNAL_H_
+
+#include <stdint.h>
+#include <greybus/greybus_capture.h>
+#include <greybus/greybus_messages.h>
+
+#ifdef CONFIG_GREYBUS_CAPTURE
+
+/**
+ * Capture a message received from the transport.
+ */
+void gb_capture_rx(uint16_t cport, const struct gb_message *msg);
+
+/**
+ * Capture a message passed to the transport.
+ */
+void gb_capture_tx(uint16_t cport, const struct gb_message *msg);
+
+#else
+
+static inline void gb_capture_rx(uint16_t cport, const struct gb_message *msg)
+{
+}
+
+static inline void gb_capture_tx(uint16_t cport, const struct gb_message *msg)
+{
+}
+
+#endif // CONFIG_GREYBUS_CAPTURE
+
+#endif // _GREYBUS_CAPTURE_INTERNAL_H_
@@ -8,11 +8,30 @@
 #include "greybus-utils/manifest.h"
 #include "greybus-manifest.h"
 #include <zephyr/logging/log.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/sys/byteorder.h>
 #include "greybus_gpio.h"
 #include "greybus_lights.h"
 #include "greybus_pwm.h"
 #include "greybus_spi.h"
 #include "greybus_uart.h"
+#include "greybus_vibrator.h"
+#include "greybus_audio.h"
+#ifdef CONFIG_GREYBUS_CAMERA
+#include "greybus_camera.h"
+#endif // CONFIG_GREYBUS_CAMERA
+#ifdef CONFIG_GREYBUS_HID
+#include "greybus_hid.h"
+#endif // CONFIG_GREYBUS_HID
+#ifdef CONFIG_GREYBUS_POWER_SUPPLY
+#include "greybus_power_supply.h"
+#endif // CONFIG_GREYBUS_POWER_SUPPLY
+#ifdef CONFIG_GREYBUS_SDIO
+#include "greybus_sdio.h"
+#endif // CONFIG_GREYBUS_SDIO
+#ifdef CONFIG_GREYBUS_USB
+#include "greybus_usb.h"
+#endif // CONFIG_GREYBUS_USB
 #include "greybus_fw_download.h"
 #include "greybus_fw_mgmt.h"
 #include "greybus_internal.h"
@@ -24,7 +43,6 @@ extern const struct gb_driver gb_control_driver;
 extern const struct gb_driver gb_i2c_driver;
 extern const struct gb_driver gb_loopback_driver;
 extern const struct gb_driver gb_log_driver;
-extern const struct gb_driver gb_vibrator_driver;
 
 /* Reset the counter to 0 */
 enum {
@@ -50,11 +68,48 @@ enum {
 		.channel_num = ARRAY_SIZE(gb_pwm_channel_data_arr_##_idx),                         \
 	};
 
+#define GB_SPI_DEVICE_MODE(_node_id)                                                               \
+	((DT_PROP_OR(_node_id, spi_cpha, 0) ? GB_SPI_MODE_CPHA : 0) |                              \
+	 (DT_PROP_OR(_node_id, spi_cpol, 0) ? GB_SPI_MODE_CPOL : 0) |                              \
+	 (DT_PROP_OR(_node_id, spi_cs_high, 0) ? GB_SPI_MODE_CS_HIGH : 0) |                        \
+	 (DT_PROP_OR(_node_id, spi_lsb_first, 0) ? GB_SPI_MODE_LSB_FIRST : 0))
+
+/* Devices on the SPI bus, described to the AP by their chip select. The AP binds spidev to them. */
+#define GB_SPI_DEVICE_DATA(_node_id)                                                               \
+	{                                                                                          \
+		.id = DT_REG_ADDR(_node_id),                                                       \
+		.data =                                                                            \
+			{                                                                          \
+				.mode = sys_cpu_to_le16(GB_SPI_DEVICE_MODE(_node_id)),             \
+				.max_speed_hz =                                                    \
+					sys_cpu_to_le32(DT_PROP(_node_id, spi_max_frequency)),     \
+				.device_type = GB_SPI_SPI_DEV,                                     \
+			},                                                                         \
+	},
+
 #define GB_SPI_PRIV_DATA(_node_id, _prop, _idx)                                                    \
+	static const struct gb_spi_device_data gb_spi_device_data_##_idx[] = {                     \
+		DT_FOREACH_CHILD_STATUS_OKAY(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx),             \
+					     GB_SPI_DEVICE_DATA)};                                 \
 	static struct gb_spi_driver_data gb_spi_priv_data_##_idx = {                               \
 		.dev = DEVICE_DT_GET(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx)),                    \
-		.devices = NULL,                                                                   \
-		.device_num = 0,                                                                   \
+		.devices = gb_spi_device_data_##_idx,                                              \
+		.device_num = ARRAY_SIZE(gb_spi_device_data_##_idx),                               \
+	};
+
+#define GB_UART_PRIV_DATA(_node_id, _prop, _idx)                                                   \
+	static struct gb_uart_driver_data gb_uart_priv_data_##_idx = {                             \
+		.dev = DEVICE_DT_GET(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx)),                    \
+	};
+
+#define GB_SDIO_PRIV_DATA(_node_id, _prop, _idx)                                                   \
+	static struct gb_sdio_driver_data gb_sdio_priv_data_##_idx = {                             \
+		.dev = DEVICE_DT_GET(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx)),                    \
+	};
+
+#define GB_USB_PRIV_DATA(_node_id, _prop, _idx)                                                    \
+	static struct gb_usb_driver_data gb_usb_priv_data_##_idx = {                               \
+		.dev = DEVICE_DT_GET(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx)),                    \
 	};
 
 #define GB_BRIDGED_PHY_PRIV_DATA_HANDLER(_node_id)                                                 \
@@ -63,7 +118,13 @@ enum {
 	IF_ENABLED(GB_BRIDGED_PHY_CHECK(_node_id, spi_controllers, CONFIG_GREYBUS_SPI),            \
 		   (DT_FOREACH_PROP_ELEM(_node_id, spi_controllers, GB_SPI_PRIV_DATA)))            \
 	IF_ENABLED(GB_BRIDGED_PHY_CHECK(_node_id, pwm_controllers, CONFIG_GREYBUS_PWM),            \
-		   (DT_FOREACH_PROP_ELEM(_node_id, pwm_controllers, GB_PWM_PRIV_DATA)))
+		   (DT_FOREACH_PROP_ELEM(_node_id, pwm_controllers, GB_PWM_PRIV_DATA)))            \
+	IF_ENABLED(GB_BRIDGED_PHY_CHECK(_node_id, uart_controllers, CONFIG_GREYBUS_UART),          \
+		   (DT_FOREACH_PROP_ELEM(_node_id, uart_controllers, GB_UART_PRIV_DATA)))          \
+	IF_ENABLED(GB_BRIDGED_PHY_CHECK(_node_id, sdio_controllers, CONFIG_GREYBUS_SDIO),          \
+		   (DT_FOREACH_PROP_ELEM(_node_id, sdio_controllers, GB_SDIO_PRIV_DATA)))          \
+	IF_ENABLED(GB_BRIDGED_PHY_CHECK(_node_id, usb_controllers, CONFIG_GREYBUS_USB),            \
+		   (DT_FOREACH_PROP_ELEM(_node_id, usb_controllers, GB_USB_PRIV_DATA)))
 
 #define GB_LIGHTS_PRIV_DATA_ITEM(_node_id, _prop, _idx)                                            \
 	DEVICE_DT_GET(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx))
@@ -71,20 +132,135 @@ enum {
 #define GB_LIGHTS_PRIV_DATA(_node_id)                                                              \
 	static const struct device *gb_lights_priv_data_devs[] = {                                 \
 		DT_FOREACH_PROP_ELEM_SEP(_node_id, lights, GB_LIGHTS_PRIV_DATA_ITEM, (, ))};       \
+	IF_ENABLED(CONFIG_GREYBUS_LIGHTS_EFFECTS,                                                  \
+		   (static struct gb_lights_effect                                                 \
+			    gb_lights_priv_data_effects[ARRAY_SIZE(gb_lights_priv_data_devs)];))   \
 	static const struct gb_lights_driver_data gb_lights_priv_data = {                          \
 		.lights_num = ARRAY_SIZE(gb_lights_priv_data_devs),                                \
 		.devs = gb_lights_priv_data_devs,                                                  \
+		IF_ENABLED(CONFIG_GREYBUS_LIGHTS_EFFECTS,                                          \
+			   (.effects = gb_lights_priv_data_effects,))                              \
 	};
 
 #define GB_LIGHTS_PRIV_DATA_HANDLER(_node_id)                                                      \
 	IF_ENABLED(CONFIG_GREYBUS_LIGHTS, (GB_LIGHTS_PRIV_DATA(_node_id)))
 
+#define GB_VIBRATOR_PRIV_DATA(_node_id, _prop, _idx)                                              \
+	static struct gb_vibrator_driver_data gb_vibrator_priv_data_##_idx = {                     \
+		.dev = DEVICE_DT_GET(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx)),                    \
+	};
+
+#define GB_VIBRATOR_PRIV_DATA_HANDLER(_node_id)                                                    \
+	IF_ENABLED(CONFIG_GREYBUS_VIBRATOR,                                                        \
+		   (DT_FOREACH_PROP_ELEM(_node_id, vibrators, GB_VIBRATOR_PRIV_DATA)))
+
+#define GB_AUDIO_PRIV_DATA_NAME(_node_id) _CONCAT(gb_audio_priv_data_, DT_DEP_ORD(_node_id))
+#define GB_AUDIO_SLAB_NAME(_node_id, _dir) _CONCAT(gb_audio_##_dir##_slab_, DT_DEP_ORD(_node_id))
+
+#define GB_AUDIO_SLAB(_node_id, _dir)                                                              \
+	K_MEM_SLAB_DEFINE_STATIC(GB_AUDIO_SLAB_NAME(_node_id, _dir),                               \
+				 CONFIG_GREYBUS_AUDIO_BLOCK_SIZE,                                  \
+				 CONFIG_GREYBUS_AUDIO_BLOCK_COUNT, 4);
+
+#define GB_AUDIO_PRIV_DATA(_node_id)                                                               \
+	GB_AUDIO_SLAB(_node_id, tx)                                                                \
+	IF_ENABLED(DT_PROP(_node_id, capture), (GB_AUDIO_SLAB(_node_id, rx)))                      \
+	static struct gb_audio_driver_data GB_AUDIO_PRIV_DATA_NAME(_node_id) = {                   \
+		.i2s = DEVICE_DT_GET(DT_PHANDLE(_node_id, i2s)),                                   \
+		.codec = COND_CODE_1(DT_NODE_HAS_PROP(_node_id, codec),                            \
+				     (DEVICE_DT_GET(DT_PHANDLE(_node_id, codec))), (NULL)),        \
+		.tx = {.slab = &GB_AUDIO_SLAB_NAME(_node_id, tx)},                                 \
+		.rx = {.slab = COND_CODE_1(DT_PROP(_node_id, capture),                             \
+					   (&GB_AUDIO_SLAB_NAME(_node_id, rx)), (NULL))},          \
+	};
+
+#define GB_AUDIO_PRIV_DATA_HANDLER(_node_id)                                                       \
+	IF_ENABLED(CONFIG_GREYBUS_AUDIO, (GB_AUDIO_PRIV_DATA(_node_id)))
+
+#define GB_CAMERA_PRIV_DATA_NAME(_node_id) _CONCAT(gb_camera_priv_data_, DT_DEP_ORD(_node_id))
+
+#define GB_CAMERA_PRIV_DATA(_node_id)                                                              \
+	static struct gb_camera_driver_data GB_CAMERA_PRIV_DATA_NAME(_node_id) = {                 \
+		.dev = DEVICE_DT_GET(DT_PHANDLE(_node_id, camera)),                                \
+	};
+
+#define GB_CAMERA_PRIV_DATA_HANDLER(_node_id)                                                      \
+	IF_ENABLED(CONFIG_GREYBUS_CAMERA, (GB_CAMERA_PRIV_DATA(_node_id)))
+
+#define GB_HID_PRIV_DATA_NAME(_node_id) _CONCAT(gb_hid_priv_data_, DT_DEP_ORD(_node_id))
+
+#define GB_HID_PRIV_DATA(_node_id)                                                                 \
+	static struct gb_hid_driver_data GB_HID_PRIV_DATA_NAME(_node_id) = {                       \
+		.vendor_id = DT_PROP(_node_id, vendor_id),                                         \
+		.product_id = DT_PROP(_node_id, product_id),                                       \
+	};                                                                                         \
+	INPUT_CALLBACK_DEFINE_NAMED(COND_CODE_1(DT_NODE_HAS_PROP(_node_id, input),                 \
+						(DEVICE_DT_GET(DT_PHANDLE(_node_id, input))),      \
+						(NULL)),                                           \
+				    gb_hid_input_cb, &GB_HID_PRIV_DATA_NAME(_node_id),             \
+				    _CONCAT(gb_hid_input_cb_, DT_DEP_ORD(_node_id)));
+
+#define GB_HID_PRIV_DATA_HANDLER(_node_id)                                                         \
+	IF_ENABLED(CONFIG_GREYBUS_HID, (GB_HID_PRIV_DATA(_node_id)))
+
+#define GB_POWER_SUPPLY_PRIV_DATA_NAME(_node_id)                                                   \
+	_CONCAT(gb_power_supply_priv_data_, DT_DEP_ORD(_node_id))
+#define GB_POWER_SUPPLIES_NAME(_node_id) _CONCAT(gb_power_supplies_, DT_DEP_ORD(_node_id))
+
+#define GB_POWER_SUPPLY_ITEM(_node_id, _prop, _idx, _charger)                                      \
+	{                                                                                          \
+		.dev = DEVICE_DT_GET(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx)),                    \
+		.name = DT_NODE_FULL_NAME(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx)),               \
+		.charger = _charger,                                                               \
+	},
+
+/* Fuel gauges first, then chargers. The position is the power supply ID */
+#define GB_POWER_SUPPLY_PRIV_DATA(_node_id)                                                        \
+	static struct gb_power_supply GB_POWER_SUPPLIES_NAME(_node_id)[] = {                       \
+		IF_ENABLED(DT_NODE_HAS_PROP(_node_id, fuel_gauges),                                \
+			   (DT_FOREACH_PROP_ELEM_VARGS(_node_id, fuel_gauges,                      \
+						       GB_POWER_SUPPLY_ITEM, false)))              \
+		IF_ENABLED(DT_NODE_HAS_PROP(_node_id, chargers),                                   \
+			   (DT_FOREACH_PROP_ELEM_VARGS(_node_id, chargers, GB_POWER_SUPPLY_ITEM,   \
+						       true)))};                                   \
+	static struct gb_power_supply_driver_data GB_POWER_SUPPLY_PRIV_DATA_NAME(_node_id) = {     \
+		.supplies = GB_POWER_SUPPLIES_NAME(_node_id),                                      \
+		.supplies_count = ARRAY_SIZE(GB_POWER_SUPPLIES_NAME(_node_id)),                    \
+	};
+
+#define GB_POWER_SUPPLY_PRIV_DATA_HANDLER(_node_id)                                                \
+	IF_ENABLED(CONFIG_GREYBUS_POWER_SUPPLY, (GB_POWER_SUPPLY_PRIV_DATA(_node_id)))
+
+#define GB_HID_OR_POWER_SUPPLY_PRIV_DATA_HANDLER(_node_id)                                         \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_hid, okay),          \
+		    (GB_HID_PRIV_DATA_HANDLER(_node_id)),                                          \
+		    (IF_ENABLED(DT_NODE_HAS_COMPAT_STATUS(_node_id,                                \
+							  zephyr_greybus_bundle_power_supply,      \
+							  okay),                                   \
+				(GB_POWER_SUPPLY_PRIV_DATA_HANDLER(_node_id)))))
+
+#define GB_CAMERA_OR_HID_PRIV_DATA_HANDLER(_node_id)                                               \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_camera, okay),       \
+		    (GB_CAMERA_PRIV_DATA_HANDLER(_node_id)),                                       \
+		    (GB_HID_OR_POWER_SUPPLY_PRIV_DATA_HANDLER(_node_id)))
+
+#define GB_MEDIA_OR_HID_PRIV_DATA_HANDLER(_node_id)                                               \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_audio, okay),        \
+		    (GB_AUDIO_PRIV_DATA_HANDLER(_node_id)),                                        \
+		    (GB_CAMERA_OR_HID_PRIV_DATA_HANDLER(_node_id)))
+
+#define GB_VIBRATOR_OR_MEDIA_PRIV_DATA_HANDLER(_node_id)                                          \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_vibrator, okay),     \
+		    (GB_VIBRATOR_PRIV_DATA_HANDLER(_node_id)),                                     \
+		    (GB_MEDIA_OR_HID_PRIV_DATA_HANDLER(_node_id)))
+
 #define GB_PRIV_DATA_HANDLER(_node_id)                                                             \
 	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_bridged_phy, okay),  \
 		    (GB_BRIDGED_PHY_PRIV_DATA_HANDLER(_node_id)),                                  \
-		    (IF_ENABLED(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_lights,  \
-							  okay),                                   \
-				(GB_LIGHTS_PRIV_DATA_HANDLER(_node_id)))))
+		    (COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(_node_id, zephyr_greybus_bundle_lights, \
+							   okay),                                  \
+				 (GB_LIGHTS_PRIV_DATA_HANDLER(_node_id)),                          \
+				 (GB_VIBRATOR_OR_MEDIA_PRIV_DATA_HANDLER(_node_id)))))
 
 /* Define GPIO private data */
 DT_FOREACH_CHILD_STATUS_OKAY(_GREYBUS_BASE_NODE, GB_PRIV_DATA_HANDLER)
@@ -98,16 +274,37 @@ DT_FOREACH_CHILD_STATUS_OKAY(_GREYBUS_BASE_NODE, GB_PRIV_DATA_HANDLER)
 
 #define GB_CPORT_SPI_PRIV_DATA(_node_id, _prop, _idx) &gb_spi_priv_data_##_idx
 
-#define GB_CPORT(_priv, _bundle, _protocol, _driver)                                               \
+#define GB_CPORT_UART_PRIV_DATA(_node_id, _prop, _idx) &gb_uart_priv_data_##_idx
+
+#define GB_CPORT_SDIO_PRIV_DATA(_node_id, _prop, _idx) &gb_sdio_priv_data_##_idx
+
+#define GB_CPORT_USB_PRIV_DATA(_node_id, _prop, _idx) &gb_usb_priv_data_##_idx
+
+#define GB_CPORT_VIBRATOR_PRIV_DATA(_node_id, _prop, _idx) &gb_vibrator_priv_data_##_idx
+
+#ifdef CONFIG_GREYBUS_BUNDLE_PM
+#define GB_CPORT_DEV_INIT(_dev) .dev = _dev,
+#else
+#define GB_CPORT_DEV_INIT(_dev)
+#endif // CONFIG_GREYBUS_BUNDLE_PM
+
+#define GB_CPORT_WITH_DEV(_priv, _dev, _bundle, _protocol, _driver)                                \
 	{                                                                                          \
 		.bundle = _bundle,                                                                 \
 		.protocol = _protocol,                                                             \
 		.priv = _priv,                                                                     \
 		.driver = _driver,                                                                 \
+		GB_CPORT_DEV_INIT(_dev)                                                            \
 	}
 
+#define GB_CPORT(_priv, _bundle, _protocol, _driver)                                               \
+	GB_CPORT_WITH_DEV(_priv, NULL, _bundle, _protocol, _driver)
+
+/* Cports backed by one controller from a phandle array */
 #define _GB_CPORT(_node_id, _prop, _idx, _bundle, _protocol, _driver, PRIV_FN)                     \
-	GB_CPORT(PRIV_FN(_node_id, _prop, _idx), _bundle, _protocol, _driver)
+	GB_CPORT_WITH_DEV(PRIV_FN(_node_id, _prop, _idx),                                          \
+			  DEVICE_DT_GET(DT_PHANDLE_BY_IDX(_node_id, _prop, _idx)), _bundle,        \
+			  _protocol, _driver)
 
 #define GREYBUS_CPORTS_IN_BRIDGED_PHY_BUNDLE(_node_id, _bundle)                                    \
 	FOR_EACH_NONEMPTY_TERM(                                                                    \
@@ -129,7 +326,16 @@ DT_FOREACH_CHILD_STATUS_OKAY(_GREYBUS_BASE_NODE, GB_PRIV_DATA_HANDLER)
 			   (DT_FOREACH_PROP_ELEM_SEP_VARGS(_node_id, uart_controllers, _GB_CPORT,  \
 							   (, ), _bundle, GREYBUS_PROTOCOL_UART,   \
 							   &gb_uart_driver,                        \
-							   GB_CPORT_DEV_PRIV_DATA))),              \
+							   GB_CPORT_UART_PRIV_DATA))),             \
+		IF_ENABLED(CONFIG_GREYBUS_SDIO,                                                    \
+			   (DT_FOREACH_PROP_ELEM_SEP_VARGS(_node_id, sdio_controllers, _GB_CPORT,  \
+							   (, ), _bundle, GREYBUS_PROTOCOL_SDIO,   \
+							   &gb_sdio_driver,                        \
+							   GB_CPORT_SDIO_PRIV_DATA))),             \
+		IF_ENABLED(CONFIG_GREYBUS_USB, (DT_FOREACH_PROP_ELEM_SEP_VARGS(                    \
+						       _node_id, usb_controllers, _GB_CPORT, (, ), \
+						       _bundle, GREYBUS_PROTOCOL_USB,              \
+						       &gb_usb_driver, GB_CPORT_USB_PRIV_DATA))),  \
 		IF_ENABLED(CONFIG_GREYBUS_I2C, (DT_FOREACH_PROP_ELEM_SEP_VARGS(                    \
 						       _node_id, i2c_controllers, _GB_CPORT, (, ), \
 						       _bundle, GREYBUS_PROTOCOL_I2C,              \
@@ -143,7 +349,53 @@ DT_FOREACH_CHILD_STATUS_OKAY(_GREYBUS_BASE_NODE, GB_PRIV_DATA_HANDLER)
 	IF_ENABLED(CONFIG_GREYBUS_VIBRATOR,                                                        \
 		   (DT_FOREACH_PROP_ELEM_SEP_VARGS(_node_id, vibrators, _GB_CPORT, (, ), _bundle,  \
 						   GREYBUS_PROTOCOL_VIBRATOR, &gb_vibrator_driver, \
-						   GB_CPORT_DEV_PRIV_DATA)))
+						   GB_CPORT_VIBRATOR_PRIV_DATA)))
+
+#define GREYBUS_CPORTS_IN_AUDIO(_node_id, _bundle)                                                 \
+	IF_ENABLED(CONFIG_GREYBUS_AUDIO,                                                           \
+		   (GB_CPORT(&GB_AUDIO_PRIV_DATA_NAME(_node_id), _bundle,                          \
+			     GREYBUS_PROTOCOL_AUDIO_MGMT, &gb_audio_mgmt_driver),                  \
+		    GB_CPORT(&GB_AUDIO_PRIV_DATA_NAME(_node_id), _bundle,                          \
+			     GREYBUS_PROTOCOL_AUDIO_DATA, &gb_audio_data_driver), ))
+
+#define GREYBUS_CPORTS_IN_CAMERA(_node_id, _bundle)                                                \
+	IF_ENABLED(CONFIG_GREYBUS_CAMERA,                                                          \
+		   (GB_CPORT(&GB_CAMERA_PRIV_DATA_NAME(_node_id), _bundle,                         \
+			     GREYBUS_PROTOCOL_CAMERA_MGMT, &gb_camera_mgmt_driver),                \
+		    GB_CPORT(&GB_CAMERA_PRIV_DATA_NAME(_node_id), _bundle,                         \
+			     GREYBUS_PROTOCOL_CAMERA_DATA, &gb_camera_data_driver), ))
+
+#define GREYBUS_CPORT_IN_HID(_node_id, _bundle)                                                    \
+	IF_ENABLED(CONFIG_GREYBUS_HID, (GB_CPORT(&GB_HID_PRIV_DATA_NAME(_node_id), _bundle,        \
+						 GREYBUS_PROTOCOL_HID, &gb_hid_driver)))
+
+#define GREYBUS_CPORT_IN_POWER_SUPPLY(_node_id, _bundle)                                           \
+	IF_ENABLED(CONFIG_GREYBUS_POWER_SUPPLY,                                                    \
+		   (GB_CPORT(&GB_POWER_SUPPLY_PRIV_DATA_NAME(_node_id), _bundle,                   \
+			     GREYBUS_PROTOCOL_POWER_SUPPLY, &gb_power_supply_driver)))
+
+#define GB_CPORTS_IN_HID_OR_POWER_SUPPLY(node_id, bundle)                                          \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_hid, okay),           \
+		    (GREYBUS_CPORT_IN_HID(node_id, bundle)),                                       \
+		    (IF_ENABLED(DT_NODE_HAS_COMPAT_STATUS(node_id,                                 \
+							  zephyr_greybus_bundle_power_supply,      \
+							  okay),                                   \
+				(GREYBUS_CPORT_IN_POWER_SUPPLY(node_id, bundle)))))
+
+#define GB_CPORTS_IN_CAMERA_OR_HID(node_id, bundle)                                                \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_camera, okay),        \
+		    (GREYBUS_CPORTS_IN_CAMERA(node_id, bundle)),                                   \
+		    (GB_CPORTS_IN_HID_OR_POWER_SUPPLY(node_id, bundle)))
+
+#define GB_CPORTS_IN_MEDIA_OR_HID(node_id, bundle)                                                \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_audio, okay),         \
+		    (GREYBUS_CPORTS_IN_AUDIO(node_id, bundle)),                                    \
+		    (GB_CPORTS_IN_CAMERA_OR_HID(node_id, bundle)))
+
+#define GB_CPORTS_IN_VIBRATOR_OR_MEDIA(node_id, bundle)                                           \
+	COND_CODE_1(DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_vibrator, okay),      \
+		    (GREYBUS_CPORT_IN_VIBRATORS(node_id, bundle)),                                 \
+		    (GB_CPORTS_IN_MEDIA_OR_HID(node_id, bundle)))
 
 #define GB_CPORTS_IN_BUNDLE(node_id, bundle)                                                       \
 	COND_CODE_1(                                                                               \
@@ -152,9 +404,7 @@ DT_FOREACH_CHILD_STATUS_OKAY(_GREYBUS_BASE_NODE, GB_PRIV_DATA_HANDLER)
 		(COND_CODE_1(                                                                      \
 			DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_lights, okay),    \
 			(GREYBUS_CPORT_IN_LIGHTS(node_id, bundle)),                                \
-			(IF_ENABLED(DT_NODE_HAS_COMPAT_STATUS(                                     \
-					    node_id, zephyr_greybus_bundle_vibrator, okay),        \
-				    (GREYBUS_CPORT_IN_VIBRATORS(node_id, bundle)))))))
+			(GB_CPORTS_IN_VIBRATOR_OR_MEDIA(node_id, bundle)))))
 
 /* Requred for counter based naming to work */
 #define GB_CPORTS_BUNDLE_WRAPPER(node_id) GB_CPORTS_IN_BUNDLE(node_id, LOCAL_COUNTER)
@@ -192,16 +442,164 @@ static struct gb_cport cports[] = {
 
 BUILD_ASSERT(GREYBUS_CPORT_COUNT == ARRAY_SIZE(cports));
 
+/* Last operation id handed out on each cport */
+static atomic_t cport_operation_ids[GREYBUS_CPORT_COUNT];
+
 const struct gb_cport *gb_cport_get(uint16_t cport)
 {
 	return (cport >= GREYBUS_CPORT_COUNT) ? NULL : &cports[cport];
 }
 
+uint16_t gb_cport_operation_id(uint16_t cport)
+{
+	if (cport >= ARRAY_SIZE(cport_operation_ids)) {
+		return new_operation_id();
+	}
+
+	return gb_operation_id_next(&cport_operation_ids[cport]);
+}
+
+static bool gb_bundle_exists(uint8_t bundle)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(cports); i++) {
+		if (cports[i].bundle == bundle) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#ifdef CONFIG_GREYBUS_BUNDLE_PM
+
+/* Bundle ids are handed out per bundle, so there are never more bundles than cports */
+static ATOMIC_DEFINE(gb_bundles_suspended, GREYBUS_CPORT_COUNT);
+
+static int gb_cport_pm_set(const struct gb_cport *cport, bool active)
+{
+	if (!cport->dev) {
+		return 0;
+	}
+
+	return active ? pm_device_runtime_get(cport->dev) : pm_device_runtime_put(cport->dev);
+}
+
+/* Get or put the devices of every cport in the bundle. Undoes the ones done if one fails. */
+static int gb_bundle_pm_set(uint8_t bundle, bool active)
+{
+	int ret = 0;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(cports); i++) {
+		if (cports[i].bundle != bundle) {
+			continue;
+		}
+
+		ret = gb_cport_pm_set(&cports[i], active);
+		if (ret < 0) {
+			LOG_ERR("Failed to %s device of cport %zu: %d",
+				active ? "resume" : "suspend", i, ret);
+			break;
+		}
+	}
+
+	if (ret == 0) {
+		return 0;
+	}
+
+	while (i-- > 0) {
+		if (cports[i].bundle == bundle) {
+			gb_cport_pm_set(&cports[i], !active);
+		}
+	}
+
+	return ret;
+}
+
+int gb_bundle_suspend(uint8_t bundle)
+{
+	int ret;
+
+	if (!gb_bundle_exists(bundle)) {
+		return -EINVAL;
+	}
+
+	if (atomic_test_and_set_bit(gb_bundles_suspended, bundle)) {
+		return 0;
+	}
+
+	ret = gb_bundle_pm_set(bundle, false);
+	if (ret < 0) {
+		atomic_clear_bit(gb_bundles_suspended, bundle);
+	}
+
+	return ret;
+}
+
+int gb_bundle_resume(uint8_t bundle)
+{
+	int ret;
+
+	if (!gb_bundle_exists(bundle)) {
+		return -EINVAL;
+	}
+
+	if (!atomic_test_and_clear_bit(gb_bundles_suspended, bundle)) {
+		return 0;
+	}
+
+	ret = gb_bundle_pm_set(bundle, true);
+	if (ret < 0) {
+		atomic_set_bit(gb_bundles_suspended, bundle);
+	}
+
+	return ret;
+}
+
+/* Bundles start out active, as before the AP takes part in power management */
 int gb_cports_init()
 {
+	int ret;
+
+	for (size_t i = 0; i < ARRAY_SIZE(cports); i++) {
+		atomic_clear_bit(gb_bundles_suspended, i);
+		ret = gb_cport_pm_set(&cports[i], true);
+		if (ret < 0) {
+			LOG_WRN("Failed to resume device of cport %zu: %d", i, ret);
+		}
+	}
+
 	return 0;
 }
 
 void gb_cports_deinit()
 {
+	for (size_t i = 0; i < ARRAY_SIZE(cports); i++) {
+		if (!atomic_test_bit(gb_bundles_suspended, cports[i].bundle)) {
+			gb_cport_pm_set(&cports[i], false);
+		}
+	}
 }
+
+#else
+
+int gb_bundle_suspend(uint8_t bundle)
+{
+	return gb_bundle_exists(bundle) ? 0 : -EINVAL;
+}
+
+int gb_bundle_resume(uint8_t bundle)
+{
+	return gb_bundle_exists(bundle) ? 0 : -EINVAL;
+}
+
+int gb_cports_init()
+{
+	return 0;
+}
+
+void gb_cports_deinit()
+{
+}
+
+#endif // CONFIG_GREYBUS_BUNDLE_PM
@@ -8,16 +8,72 @@
 #define _GREYBUS_CPORT_H_
 
 #include <greybus/greybus.h>
+#include "greybus-manifest.h"
 
 struct gb_cport {
 	const struct gb_driver *driver;
 	const void *priv;
+#ifdef CONFIG_GREYBUS_BUNDLE_PM
+	/* Controller behind the cport, kept resumed while the bundle is active. Can be NULL. */
+	const struct device *dev;
+#endif // CONFIG_GREYBUS_BUNDLE_PM
 	uint8_t bundle;
 	uint8_t protocol;
 };
 
 const struct gb_cport *gb_cport_get(uint16_t cport);
 
+/**
+ * Get the next operation id of a cport.
+ *
+ * Each cport has its own ids, so requests on different cports do not contend.
+ */
+uint16_t gb_cport_operation_id(uint16_t cport);
+
+/**
+ * Allocate a request with the next operation id of the cport it is sent on.
+ *
+ * @param cport: cport the request is sent on
+ * @param payload_len: payload length
+ * @param request_type: request type
+ *
+ * @return greybus message allocated on heap. Null in case of error
+ */
+static inline struct gb_message *gb_cport_request_alloc(uint16_t cport, size_t payload_len,
+							 uint8_t request_type)
+{
+	return gb_message_alloc(payload_len, request_type, gb_cport_operation_id(cport), 0);
+}
+
+/**
+ * Check if the cport takes part in enumeration and hot-plug, and must not wait behind bulk traffic.
+ */
+static inline bool gb_cport_is_expedited(uint16_t cport)
+{
+	const struct gb_cport *cport_ptr = gb_cport_get(cport);
+
+	return cport_ptr && (cport_ptr->protocol == GREYBUS_PROTOCOL_CONTROL ||
+			     cport_ptr->protocol == GREYBUS_PROTOCOL_SVC);
+}
+
+/**
+ * Let the devices of all cports in a bundle suspend. Does nothing if the bundle is suspended.
+ *
+ * @param bundle: bundle id
+ *
+ * @return 0 on success, -EINVAL if there is no such bundle, or the device runtime PM error
+ */
+int gb_bundle_suspend(uint8_t bundle);
+
+/**
+ * Resume the devices of all cports in a bundle. Does nothing if the bundle is active.
+ *
+ * @param bundle: bundle id
+ *
+ * @return 0 on success, -EINVAL if there is no such bundle, or the device runtime PM error
+ */
+int gb_bundle_resume(uint8_t bundle);
+
 /**
  * Initialize all cports.
  */
@@ -8,14 +8,67 @@
 #define _GREYBUS_GPIO_H_
 
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
 
 extern const struct gb_driver gb_gpio_driver;
 
 struct gb_gpio_driver_data {
 	struct gpio_callback cb;
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_DEFERRED
+	struct k_work_delayable irq_work;
+	/* Lines with an interrupt waiting to be sent */
+	atomic_t irq_pending;
+#endif // CONFIG_GREYBUS_GPIO_IRQ_DEFERRED
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+	/* Cycle count of the first interrupt of each pending line */
+	uint32_t irq_cycles[GPIO_MAX_PINS_PER_PORT];
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+#ifdef CONFIG_GREYBUS_GPIO_DEBOUNCE
+	struct k_work_delayable debounce_work;
+	/* Protects the debounce state, which the GPIO callback updates */
+	struct k_spinlock debounce_lock;
+	/* Lines with a debounce time */
+	gpio_port_pins_t debounced;
+	/* Debounced lines waiting to settle */
+	gpio_port_pins_t bouncing;
+	/* Last settled level of the debounced lines */
+	gpio_port_pins_t settled;
+	/* Lines reporting rising and falling edges */
+	gpio_port_pins_t rising;
+	gpio_port_pins_t falling;
+	uint16_t debounce_us[GPIO_MAX_PINS_PER_PORT];
+	/* Uptime in ticks at which each bouncing line is considered settled */
+	int64_t deadline[GPIO_MAX_PINS_PER_PORT];
+	uint32_t edges[GPIO_MAX_PINS_PER_PORT];
+	uint32_t transitions[GPIO_MAX_PINS_PER_PORT];
+#endif // CONFIG_GREYBUS_GPIO_DEBOUNCE
 	const struct device *const dev;
 	uint16_t cport;
 	uint8_t ngpios;
 };
 
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+/*
+ * Record interrupts seen by the GPIO callback at cycle count cycles.
+ */
+void gb_gpio_latency_irq(size_t num, uint32_t cycles);
+
+/*
+ * Record an event passed to the transport at sent_cycles, for an interrupt at irq_cycles.
+ */
+void gb_gpio_latency_sent(uint32_t irq_cycles, uint32_t sent_cycles, bool tracked);
+
+/*
+ * Record the response to an event sent at sent_cycles. err is not 0 if no successful response
+ * arrived.
+ */
+void gb_gpio_latency_acked(uint32_t sent_cycles, int err);
+
+/*
+ * Record an event which could not be sent.
+ */
+void gb_gpio_latency_error(void);
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+
 #endif // _GREYBUS_GPIO_H_
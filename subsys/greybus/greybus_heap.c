@@ -11,12 +11,324 @@
 
 K_HEAP_DEFINE(greybus_heap, CONFIG_GREYBUS_HEAP_MEM_POOL_SIZE);
 
-void *gb_alloc(size_t len)
+#if CONFIG_GREYBUS_ISR_POOL_SIZE > 0
+K_HEAP_DEFINE(greybus_isr_heap, CONFIG_GREYBUS_ISR_POOL_SIZE);
+#endif
+
+static atomic_t gb_isr_failures;
+
+#ifdef CONFIG_GREYBUS_MEM_SLAB
+
+#define GB_SLAB_ALIGN 8
+
+struct gb_slab_tier {
+	struct k_mem_slab *slab;
+	size_t block_size;
+};
+
+#if CONFIG_GREYBUS_MEM_SLAB_64 > 0
+K_MEM_SLAB_DEFINE_STATIC(gb_slab_64, 64, CONFIG_GREYBUS_MEM_SLAB_64, GB_SLAB_ALIGN);
+#endif
+#if CONFIG_GREYBUS_MEM_SLAB_256 > 0
+K_MEM_SLAB_DEFINE_STATIC(gb_slab_256, 256, CONFIG_GREYBUS_MEM_SLAB_256, GB_SLAB_ALIGN);
+#endif
+#if CONFIG_GREYBUS_MEM_SLAB_1024 > 0
+K_MEM_SLAB_DEFINE_STATIC(gb_slab_1024, 1024, CONFIG_GREYBUS_MEM_SLAB_1024, GB_SLAB_ALIGN);
+#endif
+#if CONFIG_GREYBUS_MEM_SLAB_4096 > 0
+K_MEM_SLAB_DEFINE_STATIC(gb_slab_4096, 4096, CONFIG_GREYBUS_MEM_SLAB_4096, GB_SLAB_ALIGN);
+#endif
+
+/* Must be sorted by block size */
+static const struct gb_slab_tier gb_slab_tiers[] = {
+#if CONFIG_GREYBUS_MEM_SLAB_64 > 0
+	{&gb_slab_64, 64},
+#endif
+#if CONFIG_GREYBUS_MEM_SLAB_256 > 0
+	{&gb_slab_256, 256},
+#endif
+#if CONFIG_GREYBUS_MEM_SLAB_1024 > 0
+	{&gb_slab_1024, 1024},
+#endif
+#if CONFIG_GREYBUS_MEM_SLAB_4096 > 0
+	{&gb_slab_4096, 4096},
+#endif
+};
+
+static void *gb_slab_alloc(size_t len)
 {
-	return k_heap_alloc(&greybus_heap, len, K_FOREVER);
+	void *ptr;
+
+	/* If the best fitting tier is exhausted, spill over to the larger ones */
+	for (size_t i = 0; i < ARRAY_SIZE(gb_slab_tiers); i++) {
+		if (len > gb_slab_tiers[i].block_size) {
+			continue;
+		}
+
+		if (k_mem_slab_alloc(gb_slab_tiers[i].slab, &ptr, K_NO_WAIT) == 0) {
+			return ptr;
+		}
+	}
+
+	return NULL;
 }
 
-void gb_free(void *ptr)
+static const struct gb_slab_tier *gb_slab_find(const void *ptr)
+{
+	const struct gb_slab_tier *tier;
+	const char *start;
+
+	for (size_t i = 0; i < ARRAY_SIZE(gb_slab_tiers); i++) {
+		tier = &gb_slab_tiers[i];
+		start = tier->slab->buffer;
+
+		if ((const char *)ptr >= start &&
+		    (const char *)ptr < start + tier->block_size * tier->slab->info.num_blocks) {
+			return tier;
+		}
+	}
+
+	return NULL;
+}
+
+static bool gb_slab_free(void *ptr)
+{
+	const struct gb_slab_tier *tier = gb_slab_find(ptr);
+
+	if (tier) {
+		k_mem_slab_free(tier->slab, ptr);
+		return true;
+	}
+
+	return false;
+}
+
+static bool gb_slab_contains(const void *ptr)
+{
+	return gb_slab_find(ptr) != NULL;
+}
+
+#else
+
+static inline void *gb_slab_alloc(size_t len)
+{
+	ARG_UNUSED(len);
+	return NULL;
+}
+
+static inline bool gb_slab_free(void *ptr)
+{
+	ARG_UNUSED(ptr);
+	return false;
+}
+
+static inline bool gb_slab_contains(const void *ptr)
+{
+	ARG_UNUSED(ptr);
+	return false;
+}
+
+#endif // CONFIG_GREYBUS_MEM_SLAB
+
+static bool gb_k_heap_contains(const struct k_heap *heap, const void *ptr)
+{
+	const char *start = heap->heap.init_mem;
+	const char *end = start + heap->heap.init_bytes;
+
+	return (const char *)ptr >= start && (const char *)ptr < end;
+}
+
+#if CONFIG_GREYBUS_ISR_POOL_SIZE > 0
+static void *gb_isr_heap_alloc(size_t len)
+{
+	return k_heap_alloc(&greybus_isr_heap, len, K_NO_WAIT);
+}
+
+static bool gb_isr_heap_free(void *ptr)
+{
+	if (!gb_k_heap_contains(&greybus_isr_heap, ptr)) {
+		return false;
+	}
+
+	k_heap_free(&greybus_isr_heap, ptr);
+	return true;
+}
+
+static bool gb_isr_heap_contains(const void *ptr)
+{
+	return gb_k_heap_contains(&greybus_isr_heap, ptr);
+}
+#else
+static inline void *gb_isr_heap_alloc(size_t len)
+{
+	ARG_UNUSED(len);
+	return NULL;
+}
+
+static inline bool gb_isr_heap_free(void *ptr)
+{
+	ARG_UNUSED(ptr);
+	return false;
+}
+
+static inline bool gb_isr_heap_contains(const void *ptr)
+{
+	ARG_UNUSED(ptr);
+	return false;
+}
+#endif // CONFIG_GREYBUS_ISR_POOL_SIZE > 0
+
+bool gb_heap_contains(const void *ptr)
+{
+	return gb_k_heap_contains(&greybus_heap, ptr) || gb_slab_contains(ptr) ||
+	       gb_isr_heap_contains(ptr);
+}
+
+static void *gb_pool_alloc(size_t len, k_timeout_t timeout, bool isr)
+{
+	void *ptr = isr ? gb_isr_heap_alloc(len) : NULL;
+
+	if (!ptr) {
+		ptr = gb_slab_alloc(len);
+	}
+
+	if (!ptr) {
+		ptr = k_heap_alloc(&greybus_heap, len, isr ? K_NO_WAIT : timeout);
+	}
+
+	if (!ptr && isr) {
+		atomic_inc(&gb_isr_failures);
+	}
+
+	return ptr;
+}
+
+static void gb_pool_free(void *ptr)
 {
+	if (gb_slab_free(ptr) || gb_isr_heap_free(ptr)) {
+		return;
+	}
+
 	k_heap_free(&greybus_heap, ptr);
 }
+
+uint32_t gb_alloc_isr_failures(void)
+{
+	return atomic_get(&gb_isr_failures);
+}
+
+#ifdef CONFIG_GREYBUS_HEAP_STATS
+
+/* Every allocation is prefixed with its requested length. Keeps payload 8 byte aligned. */
+#define GB_HEAP_STATS_HDR_SIZE 8
+
+static struct gb_heap_stats gb_heap_stats;
+static struct k_spinlock gb_heap_stats_lock;
+
+static size_t gb_heap_stats_bucket(size_t len)
+{
+	size_t i = 0;
+
+	while (i < GB_HEAP_STATS_BUCKETS - 1 && len > GB_HEAP_STATS_BUCKET_SIZE(i)) {
+		i++;
+	}
+
+	return i;
+}
+
+static void *gb_alloc_common(size_t len, k_timeout_t timeout, bool isr)
+{
+	k_spinlock_key_t key;
+	uint8_t *ptr = gb_pool_alloc(len + GB_HEAP_STATS_HDR_SIZE, timeout, isr);
+
+	key = k_spin_lock(&gb_heap_stats_lock);
+
+	gb_heap_stats.histogram[gb_heap_stats_bucket(len)]++;
+	gb_heap_stats.max_request = MAX(gb_heap_stats.max_request, len);
+
+	if (!ptr) {
+		gb_heap_stats.failures++;
+		k_spin_unlock(&gb_heap_stats_lock, key);
+		return NULL;
+	}
+
+	gb_heap_stats.allocs++;
+	gb_heap_stats.cur_bytes += len;
+	gb_heap_stats.peak_bytes = MAX(gb_heap_stats.peak_bytes, gb_heap_stats.cur_bytes);
+
+	k_spin_unlock(&gb_heap_stats_lock, key);
+
+	*(size_t *)ptr = len;
+
+	return ptr + GB_HEAP_STATS_HDR_SIZE;
+}
+
+void gb_free(void *ptr)
+{
+	k_spinlock_key_t key;
+	uint8_t *base;
+
+	if (!ptr) {
+		return;
+	}
+
+	base = (uint8_t *)ptr - GB_HEAP_STATS_HDR_SIZE;
+
+	key = k_spin_lock(&gb_heap_stats_lock);
+	gb_heap_stats.frees++;
+	gb_heap_stats.cur_bytes -= *(size_t *)base;
+	k_spin_unlock(&gb_heap_stats_lock, key);
+
+	gb_pool_free(base);
+}
+
+void gb_heap_stats_get(struct gb_heap_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_heap_stats_lock);
+
+	*stats = gb_heap_stats;
+
+	k_spin_unlock(&gb_heap_stats_lock, key);
+}
+
+void gb_heap_stats_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_heap_stats_lock);
+	const uint32_t cur_bytes = gb_heap_stats.cur_bytes;
+
+	gb_heap_stats = (struct gb_heap_stats){
+		.cur_bytes = cur_bytes,
+		.peak_bytes = cur_bytes,
+	};
+
+	k_spin_unlock(&gb_heap_stats_lock, key);
+}
+
+#else
+
+static void *gb_alloc_common(size_t len, k_timeout_t timeout, bool isr)
+{
+	return gb_pool_alloc(len, timeout, isr);
+}
+
+void gb_free(void *ptr)
+{
+	gb_pool_free(ptr);
+}
+
+#endif // CONFIG_GREYBUS_HEAP_STATS
+
+void *gb_alloc(size_t len)
+{
+	return gb_alloc_common(len, K_FOREVER, false);
+}
+
+void *gb_alloc_timeout(size_t len, k_timeout_t timeout)
+{
+	return gb_alloc_common(len, timeout, false);
+}
+
+void *gb_alloc_isr(size_t len)
+{
+	return gb_alloc_common(len, K_NO_WAIT, true);
+}
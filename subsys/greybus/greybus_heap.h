@@ -9,10 +9,74 @@
 #ifndef _GREYBUS_HEAP_H_
 #define _GREYBUS_HEAP_H_
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
 
+/* Request size histogram buckets: <= 16, <= 32, ..., <= 4096, larger */
+#define GB_HEAP_STATS_BUCKETS          10
+#define GB_HEAP_STATS_BUCKET_SIZE(_idx) (16U << (_idx))
+
+struct gb_heap_stats {
+	/* Bytes currently handed out, as requested by callers */
+	uint32_t cur_bytes;
+	/* Highest value of cur_bytes since boot or last reset */
+	uint32_t peak_bytes;
+	uint32_t allocs;
+	uint32_t frees;
+	uint32_t failures;
+	/* Largest single request */
+	uint32_t max_request;
+	uint32_t histogram[GB_HEAP_STATS_BUCKETS];
+};
+
+/**
+ * Allocate memory, waiting for as long as it takes. Only for thread context.
+ */
 void *gb_alloc(size_t len);
 
+/**
+ * Allocate memory, waiting at most timeout for other users to free some. Only K_NO_WAIT is
+ * allowed in interrupt context.
+ */
+void *gb_alloc_timeout(size_t len, k_timeout_t timeout);
+
+/**
+ * Allocate memory from interrupt context without blocking.
+ *
+ * Takes from a pool reserved for interrupt context first, so that busy threads cannot starve
+ * interrupt originated messages, then from the common heap. Failures are counted.
+ */
+void *gb_alloc_isr(size_t len);
+
+/**
+ * Number of gb_alloc_isr() calls which failed since boot.
+ */
+uint32_t gb_alloc_isr_failures(void);
+
+/**
+ * Free memory from any of the allocators above. Can be called from interrupt context.
+ */
 void gb_free(void *ptr);
 
+/**
+ * Check if ptr points into memory managed by gb_alloc().
+ */
+bool gb_heap_contains(const void *ptr);
+
+/**
+ * Get a snapshot of the heap statistics.
+ *
+ * Only available with CONFIG_GREYBUS_HEAP_STATS.
+ */
+void gb_heap_stats_get(struct gb_heap_stats *stats);
+
+/**
+ * Reset the counters. The peak is reset to the current usage.
+ *
+ * Only available with CONFIG_GREYBUS_HEAP_STATS.
+ */
+void gb_heap_stats_reset(void);
+
 #endif // _GREYBUS_HEAP_H_
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GREYBUS_HID_H_
+#define _GREYBUS_HID_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/input/input.h>
+
+#define GB_HID_KEYS_MAX 6
+
+extern const struct gb_driver gb_hid_driver;
+
+void gb_hid_input_cb(struct input_event *evt, void *user_data);
+
+/* Boot protocol layout, prefixed by the report ID */
+struct gb_hid_keyboard_report {
+	uint8_t id;
+	uint8_t modifiers;
+	uint8_t reserved;
+	uint8_t keys[GB_HID_KEYS_MAX];
+} __packed;
+
+struct gb_hid_mouse_report {
+	uint8_t id;
+	uint8_t buttons;
+	int16_t x;
+	int16_t y;
+	int8_t wheel;
+} __packed;
+
+union gb_hid_report {
+	uint8_t id;
+	struct gb_hid_keyboard_report keyboard;
+	struct gb_hid_mouse_report mouse;
+};
+
+struct gb_hid_driver_data {
+	const uint16_t vendor_id;
+	const uint16_t product_id;
+	/* Protects everything below, which is updated from the input callback */
+	struct k_spinlock lock;
+	struct k_work_delayable tx_work;
+	struct gb_hid_keyboard_report keyboard;
+	uint8_t buttons;
+	/* Relative motion accumulated since the last mouse report */
+	int32_t dx;
+	int32_t dy;
+	int32_t wheel;
+	/* Key and button changes, in order, each as a full report */
+	union gb_hid_report queue[CONFIG_GREYBUS_HID_REPORT_QUEUE_SIZE];
+	uint8_t queue_head;
+	uint8_t queue_len;
+	bool keyboard_changed;
+	bool buttons_changed;
+	bool motion;
+	bool powered;
+	/* Uptime of the last motion report, motion is sent at most once per poll interval */
+	int64_t last_motion_ms;
+	uint16_t cport;
+};
+
+#endif // _GREYBUS_HID_H_
@@ -8,14 +8,78 @@
 #define _GREYBUS_INTERNAL_H_
 
 #include <greybus/greybus.h>
+#include <zephyr/kernel.h>
 
 typedef void (*gb_operation_handler_t)(const void *priv, struct gb_message *msg, uint16_t cport);
 
+/* First of the Zephyr specific request types of a protocol */
+#define GB_VENDOR_TYPE_BASE 0x70
+
+/*
+ * Handler of one request type, along with the payload it accepts. Requests made of a fixed part
+ * followed by an array also describe where the element count is, so that the array is known to
+ * be complete before the handler walks it.
+ */
+struct gb_operation_entry {
+	gb_operation_handler_t handler;
+	/* Size of the fixed part */
+	uint16_t min_payload_len;
+	/* Size of each array element, 0 for requests without an array */
+	uint16_t elem_size;
+	/* Little endian element count within the fixed part */
+	uint8_t count_offset;
+	uint8_t count_size;
+};
+
+/*
+ * Entry of an operation table, indexed by request type. Requests shorter than _min_len are
+ * rejected before reaching the handler.
+ */
+#define GB_OPERATION(_type, _handler, _min_len)                                                    \
+	[_type] = {.handler = _handler, .min_payload_len = _min_len}
+
+/*
+ * Entry for a request of type _req whose fixed part is followed by _count elements of type
+ * _elem. Any data following the array is left to the handler to validate.
+ */
+#define GB_OPERATION_ARRAY(_type, _handler, _req, _count, _elem)                                   \
+	[_type] = {                                                                                \
+		.handler = _handler,                                                               \
+		.min_payload_len = sizeof(_req),                                                   \
+		.elem_size = sizeof(_elem),                                                        \
+		.count_offset = offsetof(_req, _count),                                            \
+		.count_size = sizeof(((_req *)0)->_count),                                         \
+	}
+
+/* Entry of a vendor operation table, indexed from GB_VENDOR_TYPE_BASE */
+#define GB_VENDOR_OPERATION(_type, _handler, _min_len)                                             \
+	GB_OPERATION((_type) - GB_VENDOR_TYPE_BASE, _handler, _min_len)
+
+/* Initializer for the operation tables of a struct gb_driver */
+#define GB_OPERATIONS(_ops) .ops = _ops, .ops_num = ARRAY_SIZE(_ops)
+#define GB_VENDOR_OPERATIONS(_ops) .vendor_ops = _ops, .vendor_ops_num = ARRAY_SIZE(_ops)
+
 struct gb_driver {
 	void (*connected)(const void *priv, uint16_t cport);
 	void (*disconnected)(const void *priv);
 
+	/*
+	 * Requests are dispatched through the operation tables, which are built at compile time.
+	 * Drivers with a free form protocol provide op_handler instead, which then receives every
+	 * message of the cport.
+	 */
+	const struct gb_operation_entry *ops;
+	const struct gb_operation_entry *vendor_ops;
+	uint8_t ops_num;
+	uint8_t vendor_ops_num;
+
 	gb_operation_handler_t op_handler;
+
+	/*
+	 * Deadline of requests in the rx queue with CONFIG_GREYBUS_RX_DEADLINE, in milliseconds. 0
+	 * uses CONFIG_GREYBUS_RX_DEADLINE_MS.
+	 */
+	uint16_t rx_deadline_ms;
 };
 
 enum gb_event {
@@ -29,6 +93,37 @@ int gb_notify(uint16_t cport, enum gb_event event);
 
 uint8_t gb_errno_to_op_result(int err);
 
+/**
+ * Respond to the request being handled later.
+ *
+ * Called by an operation handler which starts a callback based driver operation, before it
+ * returns without responding. The handler keeps ownership of the request. The request holds on
+ * to its cport credit until gb_operation_deferred_done(), so CONFIG_GREYBUS_RX_CPORT_CREDITS
+ * limits the number of deferred requests per cport. Later requests on the cport may be handled
+ * before the deferred one is done.
+ *
+ * @param cport: cport of the request being handled
+ */
+void gb_operation_defer(uint16_t cport);
+
+/**
+ * Finish a deferred request, once its response was sent.
+ *
+ * @param cport: cport of the deferred request
+ */
+void gb_operation_deferred_done(uint16_t cport);
+
+#ifdef CONFIG_GREYBUS_ASYNC_OPERATIONS
+/**
+ * Run the completion of a deferred request in thread context.
+ *
+ * Driver callbacks usually run in interrupt context, where responses cannot be sent.
+ *
+ * @param work: completion work item
+ */
+void gb_operation_deferred_submit(struct k_work *work);
+#endif // CONFIG_GREYBUS_ASYNC_OPERATIONS
+
 /**
  * Initialize greybus.
  *
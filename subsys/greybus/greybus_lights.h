@@ -7,13 +7,59 @@
 #ifndef _GREYBUS_LIGHTS_H_
 #define _GREYBUS_LIGHTS_H_
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <zephyr/kernel.h>
 
 extern const struct gb_driver gb_lights_driver;
 
+#ifdef CONFIG_GREYBUS_LIGHTS_EFFECTS
+/*
+ * struct gb_lights_effect: Blink and fade state of a light, driven by a work item
+ *
+ * @work: updates the brightness along the current ramp
+ * @dev: LED controller of the light
+ * @phase_start_ms: uptime at the start of the current ramp, kept absolute to avoid drift
+ * @phase_ms: length of the current blink phase, the ramp included
+ * @ramp_ms: length of the ramp of the current phase
+ * @on_ms: length of the on phase while blinking
+ * @off_ms: length of the off phase while blinking
+ * @from: brightness at the start of the ramp
+ * @to: brightness at the end of the ramp
+ * @brightness: brightness last set on the LED
+ * @peak: brightness of the on phase while blinking
+ * @fade_in: fade in time requested by the AP, in units of CONFIG_GREYBUS_LIGHTS_FADE_UNIT_MS
+ * @fade_out: fade out time requested by the AP
+ * @id: LED index on the controller
+ * @blinking: blinking in software
+ * @on: current blink phase
+ */
+struct gb_lights_effect {
+	struct k_work_delayable work;
+	const struct device *dev;
+	int64_t phase_start_ms;
+	uint32_t phase_ms;
+	uint32_t ramp_ms;
+	uint16_t on_ms;
+	uint16_t off_ms;
+	uint8_t from;
+	uint8_t to;
+	uint8_t brightness;
+	uint8_t peak;
+	uint8_t fade_in;
+	uint8_t fade_out;
+	uint8_t id;
+	bool blinking;
+	bool on;
+};
+#endif // CONFIG_GREYBUS_LIGHTS_EFFECTS
+
 struct gb_lights_driver_data {
 	uint8_t lights_num;
 	const struct device **devs;
+#ifdef CONFIG_GREYBUS_LIGHTS_EFFECTS
+	struct gb_lights_effect *effects;
+#endif // CONFIG_GREYBUS_LIGHTS_EFFECTS
 };
 
 #endif // _GREYBUS_LIGHTS_H_
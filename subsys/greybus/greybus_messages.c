@@ -7,45 +7,197 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include "greybus_heap.h"
-
-#define OPERATION_ID_START 1
+#include "greybus_quota.h"
 
 LOG_MODULE_REGISTER(greybus_messages, CONFIG_GREYBUS_LOG_LEVEL);
 
-static atomic_t operation_id_counter = ATOMIC_INIT(OPERATION_ID_START);
+/* Last operation id handed out by new_operation_id() */
+static atomic_t operation_id_counter = ATOMIC_INIT(0);
+
+/*
+ * Bookkeeping placed in front of every message allocated by gb_message_alloc.
+ *
+ * @refcnt: number of owners of the message
+ * @capacity: payload bytes available in the allocation
+ * @cport: cport the allocation is charged to, GB_QUOTA_NO_CPORT if none
+ */
+struct gb_message_ctrl {
+	atomic_t refcnt;
+	size_t capacity;
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+	uint16_t cport;
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+};
+
+static inline struct gb_message_ctrl *gb_message_ctrl(const struct gb_message *msg)
+{
+	return (struct gb_message_ctrl *)msg - 1;
+}
+
+uint16_t gb_operation_id_next(atomic_t *counter)
+{
+	atomic_val_t last, next;
+
+	/* 0 marks oneshot operations, so ids go from 1 to UINT16_MAX and wrap back to 1 */
+	do {
+		last = atomic_get(counter);
+		next = last % UINT16_MAX + 1;
+	} while (!atomic_cas(counter, last, next));
+
+	return next;
+}
 
 uint16_t new_operation_id(void)
 {
-	atomic_val_t temp = atomic_inc(&operation_id_counter);
+	return gb_operation_id_next(&operation_id_counter);
+}
 
-	if (temp == UINT16_MAX) {
-		atomic_set(&operation_id_counter, OPERATION_ID_START);
-	}
-	return temp;
+static struct gb_message *gb_message_init(struct gb_message_ctrl *ctrl, size_t payload_len,
+					  uint8_t message_type, uint16_t operation_id,
+					  uint8_t status)
+{
+	struct gb_message *msg;
+
+	atomic_set(&ctrl->refcnt, 1);
+	ctrl->capacity = payload_len;
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+	ctrl->cport = GB_QUOTA_NO_CPORT;
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+	msg = (struct gb_message *)(ctrl + 1);
+
+	msg->header.size = sizeof(struct gb_operation_msg_hdr) + payload_len;
+	msg->header.operation_id = operation_id;
+	msg->header.type = message_type;
+	msg->header.result = status;
+
+	return msg;
+}
+
+static size_t gb_message_alloc_size(size_t payload_len)
+{
+	return sizeof(struct gb_message_ctrl) + sizeof(struct gb_message) + payload_len;
 }
 
 struct gb_message *gb_message_alloc(size_t payload_len, uint8_t message_type, uint16_t operation_id,
 				    uint8_t status)
 {
+	struct gb_message_ctrl *ctrl;
 	struct gb_message *msg;
+	const uint16_t cport = gb_quota_current_cport();
+
+	/* Allocations made while handling a request count against the budget of its cport */
+	if (gb_quota_charge(cport, gb_message_alloc_size(payload_len)) < 0) {
+		LOG_WRN("Cport %u is over its memory budget", cport);
+		return NULL;
+	}
 
-	msg = gb_alloc(sizeof(struct gb_message) + payload_len);
-	if (msg == NULL) {
+	ctrl = gb_alloc(gb_message_alloc_size(payload_len));
+	if (ctrl == NULL) {
 		LOG_WRN("Failed to allocate Greybus request message");
+		gb_quota_release(cport, gb_message_alloc_size(payload_len));
 		return NULL;
 	}
 
-	msg->header.size = sizeof(struct gb_operation_msg_hdr) + payload_len;
-	msg->header.operation_id = operation_id;
-	msg->header.type = message_type;
-	msg->header.result = status;
+	msg = gb_message_init(ctrl, payload_len, message_type, operation_id, status);
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+	ctrl->cport = cport;
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
 
 	return msg;
 }
 
+struct gb_message *gb_message_alloc_isr(size_t payload_len, uint8_t message_type,
+					uint16_t operation_id, uint8_t status)
+{
+	struct gb_message_ctrl *ctrl;
+
+	/* Counted by the heap, logging from here would only add to the interrupt latency */
+	ctrl = gb_alloc_isr(gb_message_alloc_size(payload_len));
+	if (ctrl == NULL) {
+		return NULL;
+	}
+
+	return gb_message_init(ctrl, payload_len, message_type, operation_id, status);
+}
+
 void gb_message_dealloc(struct gb_message *msg)
 {
-	gb_free(msg);
+	struct gb_message_ctrl *ctrl;
+
+	if (!msg) {
+		return;
+	}
+
+	ctrl = gb_message_ctrl(msg);
+	if (atomic_dec(&ctrl->refcnt) == 1) {
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+		gb_quota_release(ctrl->cport, gb_message_alloc_size(ctrl->capacity));
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+		gb_free(ctrl);
+	}
+}
+
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+int gb_message_quota_charge(struct gb_message *msg, uint16_t cport)
+{
+	struct gb_message_ctrl *ctrl = gb_message_ctrl(msg);
+	int ret;
+
+	if (ctrl->cport != GB_QUOTA_NO_CPORT) {
+		return 0;
+	}
+
+	ret = gb_quota_charge(cport, gb_message_alloc_size(ctrl->capacity));
+	if (ret == 0) {
+		ctrl->cport = cport;
+	}
+
+	return ret;
+}
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+
+struct gb_message *gb_message_ref(struct gb_message *msg)
+{
+	atomic_inc(&gb_message_ctrl(msg)->refcnt);
+
+	return msg;
+}
+
+bool gb_message_is_shared(const struct gb_message *msg)
+{
+	return atomic_get(&gb_message_ctrl(msg)->refcnt) > 1;
+}
+
+struct gb_message *gb_message_get(const struct gb_message *msg)
+{
+	if (gb_heap_contains(msg)) {
+		return gb_message_ref((struct gb_message *)msg);
+	}
+
+	return gb_message_copy(msg);
+}
+
+struct gb_message *gb_message_request_to_response(struct gb_message *req, const void *payload,
+						  size_t payload_len, uint8_t status)
+{
+	struct gb_message_ctrl *ctrl = gb_message_ctrl(req);
+	struct gb_message *resp;
+
+	if (atomic_get(&ctrl->refcnt) == 1 && ctrl->capacity >= payload_len) {
+		if (payload_len) {
+			memmove(req->payload, payload, payload_len);
+		}
+		req->header.size =
+			sys_cpu_to_le16(sizeof(struct gb_operation_msg_hdr) + payload_len);
+		req->header.type = GB_RESPONSE(req->header.type);
+		req->header.result = status;
+		return req;
+	}
+
+	resp = gb_message_response_alloc_from_req(payload, payload_len, req, status);
+	gb_message_dealloc(req);
+
+	return resp;
 }
 
 struct gb_message *gb_message_request_alloc(size_t payload_len, uint8_t request_type,
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "greybus_operation.h"
+#include "greybus_transport.h"
+
+LOG_MODULE_REGISTER(greybus_operation, CONFIG_GREYBUS_LOG_LEVEL);
+
+#define GB_OPERATION_NO_DEADLINE INT64_MAX
+
+struct gb_operation {
+	gb_operation_cb_t cb;
+	void *priv;
+	/* Uptime in ms at which the operation times out */
+	int64_t deadline;
+#if CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS > 0
+	/* Reference to the request, sent again until the response arrives */
+	struct gb_message *req;
+	/* Uptime in ms at which the request is sent again */
+	int64_t resend_at;
+	uint8_t retries;
+#endif
+	uint16_t cport;
+	uint16_t operation_id;
+	bool used;
+};
+
+static void gb_operation_timeout_handler(struct k_work *work);
+
+static struct gb_operation gb_operations[CONFIG_GREYBUS_OPERATIONS_MAX];
+static struct k_spinlock gb_operations_lock;
+static K_WORK_DELAYABLE_DEFINE(gb_operation_timeout_work, gb_operation_timeout_handler);
+
+static struct gb_operation *gb_operation_find(uint16_t cport, uint16_t operation_id)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(gb_operations); i++) {
+		if (gb_operations[i].used && gb_operations[i].cport == cport &&
+		    gb_operations[i].operation_id == operation_id) {
+			return &gb_operations[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Schedule the timeout work for the earliest deadline. Must be called with the lock held. */
+static void gb_operation_timeout_schedule(void)
+{
+	int64_t deadline = GB_OPERATION_NO_DEADLINE;
+
+	for (size_t i = 0; i < ARRAY_SIZE(gb_operations); i++) {
+		if (gb_operations[i].used) {
+			deadline = MIN(deadline, gb_operations[i].deadline);
+#if CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS > 0
+			if (gb_operations[i].req) {
+				deadline = MIN(deadline, gb_operations[i].resend_at);
+			}
+#endif
+		}
+	}
+
+	if (deadline == GB_OPERATION_NO_DEADLINE) {
+		k_work_cancel_delayable(&gb_operation_timeout_work);
+	} else {
+		k_work_reschedule(&gb_operation_timeout_work, K_TIMEOUT_ABS_MS(deadline));
+	}
+}
+
+/*
+ * Remove an operation from the table and return a copy. Must be called with the lock held. The
+ * copy must be released with gb_operation_release() once the lock is dropped.
+ */
+static struct gb_operation gb_operation_take(struct gb_operation *op)
+{
+	const struct gb_operation copy = *op;
+
+	op->used = false;
+
+	return copy;
+}
+
+static void gb_operation_release(struct gb_operation *op)
+{
+#if CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS > 0
+	gb_message_dealloc(op->req);
+	op->req = NULL;
+#else
+	ARG_UNUSED(op);
+#endif
+}
+
+#if CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS > 0
+/*
+ * Find an operation whose request is due to be sent again, and take a reference to the request.
+ * Must be called with the lock held.
+ */
+static struct gb_message *gb_operation_resend_take(uint16_t *cport)
+{
+	const int64_t now = k_uptime_get();
+	struct gb_operation *op;
+	struct gb_message *req;
+
+	for (size_t i = 0; i < ARRAY_SIZE(gb_operations); i++) {
+		op = &gb_operations[i];
+		if (!op->used || !op->req || op->resend_at > now) {
+			continue;
+		}
+
+		*cport = op->cport;
+		if (++op->retries >= CONFIG_GREYBUS_OPERATION_RETRIES) {
+			/* Last attempt, hand over the reference. Only the deadline is left. */
+			req = op->req;
+			op->req = NULL;
+			return req;
+		}
+
+		op->resend_at = now + (CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS << op->retries);
+		return gb_message_get(op->req);
+	}
+
+	return NULL;
+}
+#endif
+
+#if CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS > 0
+static void gb_operation_resend(void)
+{
+	uint16_t cport;
+	struct gb_message *req;
+	k_spinlock_key_t key;
+
+	do {
+		key = k_spin_lock(&gb_operations_lock);
+		req = gb_operation_resend_take(&cport);
+		k_spin_unlock(&gb_operations_lock, key);
+
+		if (req) {
+			LOG_DBG("Resending operation %u on cport %u", req->header.operation_id,
+				cport);
+			gb_transport_message_send(req, cport);
+			gb_message_dealloc(req);
+		}
+	} while (req);
+}
+#else
+static inline void gb_operation_resend(void)
+{
+}
+#endif
+
+static void gb_operation_timeout_handler(struct k_work *work)
+{
+	struct gb_operation op;
+	k_spinlock_key_t key;
+	bool expired;
+
+	ARG_UNUSED(work);
+
+	gb_operation_resend();
+
+	do {
+		expired = false;
+		key = k_spin_lock(&gb_operations_lock);
+		for (size_t i = 0; i < ARRAY_SIZE(gb_operations); i++) {
+			if (gb_operations[i].used && gb_operations[i].deadline <= k_uptime_get()) {
+				op = gb_operation_take(&gb_operations[i]);
+				expired = true;
+				break;
+			}
+		}
+		if (!expired) {
+			gb_operation_timeout_schedule();
+		}
+		k_spin_unlock(&gb_operations_lock, key);
+
+		if (expired) {
+			LOG_WRN("Operation %u on cport %u timed out", op.operation_id, op.cport);
+			gb_operation_release(&op);
+			op.cb(op.cport, op.operation_id, NULL, -ETIMEDOUT, op.priv);
+		}
+	} while (expired);
+}
+
+/*
+ * Add an operation to the table. req is the reference to send again until the response arrives,
+ * or NULL.
+ */
+static int gb_operation_add(uint16_t cport, uint16_t operation_id, uint32_t timeout_ms,
+			    gb_operation_cb_t cb, void *priv, struct gb_message *req)
+{
+	size_t in_flight = 0;
+	struct gb_operation *op = NULL;
+	k_spinlock_key_t key;
+
+#if CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS == 0
+	ARG_UNUSED(req);
+#endif
+
+	key = k_spin_lock(&gb_operations_lock);
+
+	for (size_t i = 0; i < ARRAY_SIZE(gb_operations); i++) {
+		if (!gb_operations[i].used) {
+			op = op ? op : &gb_operations[i];
+		} else if (gb_operations[i].cport == cport) {
+			in_flight++;
+		}
+	}
+
+	if (in_flight >= CONFIG_GREYBUS_OPERATIONS_PER_CPORT) {
+		k_spin_unlock(&gb_operations_lock, key);
+		return -EBUSY;
+	}
+
+	if (!op) {
+		k_spin_unlock(&gb_operations_lock, key);
+		return -ENOMEM;
+	}
+
+	*op = (struct gb_operation){
+		.cb = cb,
+		.priv = priv,
+		.deadline = timeout_ms ? k_uptime_get() + timeout_ms : GB_OPERATION_NO_DEADLINE,
+#if CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS > 0
+		.req = req,
+		.resend_at = k_uptime_get() + CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS,
+#endif
+		.cport = cport,
+		.operation_id = operation_id,
+		.used = true,
+	};
+	gb_operation_timeout_schedule();
+	k_spin_unlock(&gb_operations_lock, key);
+
+	return 0;
+}
+
+int gb_operation_track(uint16_t cport, uint16_t operation_id, uint32_t timeout_ms,
+		       gb_operation_cb_t cb, void *priv)
+{
+	return gb_operation_add(cport, operation_id, timeout_ms, cb, priv, NULL);
+}
+
+#ifdef CONFIG_GREYBUS_NODE
+int gb_operation_send(uint16_t cport, const struct gb_message *req, uint32_t timeout_ms,
+		      gb_operation_cb_t cb, void *priv)
+{
+	int ret;
+	struct gb_message *ref = NULL;
+	k_spinlock_key_t key;
+
+#if CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS > 0
+	/* Taking the reference can copy the message and block, so it is done before locking */
+	ref = gb_message_get(req);
+#endif
+
+	/* Register before sending, the response can arrive before send returns */
+	ret = gb_operation_add(cport, req->header.operation_id, timeout_ms, cb, priv, ref);
+	if (ret < 0) {
+		gb_message_dealloc(ref);
+		return ret;
+	}
+
+	ret = gb_transport_message_send(req, cport);
+	if (ret < 0) {
+		struct gb_operation *op;
+		struct gb_operation copy = {0};
+
+		key = k_spin_lock(&gb_operations_lock);
+		op = gb_operation_find(cport, req->header.operation_id);
+		if (op) {
+			copy = gb_operation_take(op);
+		}
+		k_spin_unlock(&gb_operations_lock, key);
+
+		gb_operation_release(&copy);
+	}
+
+	return ret;
+}
+#endif // CONFIG_GREYBUS_NODE
+
+int gb_operation_cancel(uint16_t cport, uint16_t operation_id)
+{
+	struct gb_operation *op;
+	struct gb_operation copy;
+	k_spinlock_key_t key = k_spin_lock(&gb_operations_lock);
+
+	op = gb_operation_find(cport, operation_id);
+	if (!op) {
+		k_spin_unlock(&gb_operations_lock, key);
+		return -ENOENT;
+	}
+
+	copy = gb_operation_take(op);
+	k_spin_unlock(&gb_operations_lock, key);
+
+	gb_operation_release(&copy);
+	copy.cb(copy.cport, copy.operation_id, NULL, -ECANCELED, copy.priv);
+
+	return 0;
+}
+
+void gb_operation_cancel_all(uint16_t cport)
+{
+	struct gb_operation copy;
+	k_spinlock_key_t key;
+	bool found;
+
+	do {
+		found = false;
+		key = k_spin_lock(&gb_operations_lock);
+		for (size_t i = 0; i < ARRAY_SIZE(gb_operations); i++) {
+			if (gb_operations[i].used && gb_operations[i].cport == cport) {
+				copy = gb_operation_take(&gb_operations[i]);
+				found = true;
+				break;
+			}
+		}
+		k_spin_unlock(&gb_operations_lock, key);
+
+		if (found) {
+			gb_operation_release(&copy);
+			copy.cb(copy.cport, copy.operation_id, NULL, -ECANCELED, copy.priv);
+		}
+	} while (found);
+}
+
+bool gb_operation_complete(uint16_t cport, struct gb_message *resp)
+{
+	struct gb_operation *op;
+	struct gb_operation copy;
+	k_spinlock_key_t key = k_spin_lock(&gb_operations_lock);
+
+	op = gb_operation_find(cport, resp->header.operation_id);
+	if (!op) {
+		k_spin_unlock(&gb_operations_lock, key);
+		return false;
+	}
+
+	copy = gb_operation_take(op);
+	k_spin_unlock(&gb_operations_lock, key);
+
+	gb_operation_release(&copy);
+	copy.cb(copy.cport, copy.operation_id, resp, 0, copy.priv);
+
+	return true;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Tracking of requests sent by the node, until their response arrives.
+ */
+
+#ifndef _GREYBUS_OPERATION_H_
+#define _GREYBUS_OPERATION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <greybus/greybus_messages.h>
+
+/**
+ * Called once per tracked operation.
+ *
+ * @param cport
+ * @param operation_id: Operation id of the request.
+ * @param resp: Response, owned by the callback. NULL if err is not 0.
+ * @param err: 0 if a response arrived, -ETIMEDOUT or -ECANCELED otherwise.
+ * @param priv: Pointer passed to gb_operation_send().
+ */
+typedef void (*gb_operation_cb_t)(uint16_t cport, uint16_t operation_id, struct gb_message *resp,
+				  int err, void *priv);
+
+/**
+ * Send a request and track it until its response arrives.
+ *
+ * The callback runs on the rx worker of the cport when the response arrives, or on the system
+ * workqueue when the operation times out. Like gb_transport_message_send(), this does not take
+ * ownership of the request.
+ *
+ * @param cport
+ * @param req: Request with a unique operation id.
+ * @param timeout_ms: Time to wait for the response. 0 to wait forever.
+ * @param cb
+ * @param priv
+ *
+ * @return 0 on success. The callback is called exactly once.
+ * @return -EBUSY if the cport has CONFIG_GREYBUS_OPERATIONS_PER_CPORT operations in flight.
+ * @return -ENOMEM if the operation table is full.
+ * @return other negative errno if sending failed. The callback is not called.
+ */
+int gb_operation_send(uint16_t cport, const struct gb_message *req, uint32_t timeout_ms,
+		      gb_operation_cb_t cb, void *priv);
+
+/**
+ * Track a request the caller sends itself, for messages that do not go through the transport of
+ * a local cport. The request is never sent again, and the caller hands the response to
+ * gb_operation_complete(). The callback runs on the thread completing it, or on the system
+ * workqueue when the operation times out.
+ *
+ * @param cport: Key of the operation, only needs to match the one given on completion.
+ * @param operation_id: Operation id of the request, tracked before it is sent.
+ * @param timeout_ms: Time to wait for the response. 0 to wait forever.
+ * @param cb
+ * @param priv
+ *
+ * @return 0 on success. The callback is called exactly once.
+ * @return -EBUSY if the cport has CONFIG_GREYBUS_OPERATIONS_PER_CPORT operations in flight.
+ * @return -ENOMEM if the operation table is full.
+ */
+int gb_operation_track(uint16_t cport, uint16_t operation_id, uint32_t timeout_ms,
+		       gb_operation_cb_t cb, void *priv);
+
+/**
+ * Stop tracking an operation. Its callback is called with -ECANCELED.
+ *
+ * @return 0 on success, -ENOENT if the operation is not in flight.
+ */
+int gb_operation_cancel(uint16_t cport, uint16_t operation_id);
+
+/**
+ * Cancel all operations in flight on a cport.
+ */
+void gb_operation_cancel_all(uint16_t cport);
+
+/**
+ * Complete the tracked operation matching a response.
+ *
+ * @return true if the response was handed to an operation callback.
+ * @return false if no operation matches. The caller keeps ownership of resp.
+ */
+bool gb_operation_complete(uint16_t cport, struct gb_message *resp);
+
+#endif // _GREYBUS_OPERATION_H_
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GREYBUS_POWER_SUPPLY_H_
+#define _GREYBUS_POWER_SUPPLY_H_
+
+#include <zephyr/kernel.h>
+
+#define GB_POWER_SUPPLY_PROPS_MAX 16
+
+extern const struct gb_driver gb_power_supply_driver;
+
+/* A fuel gauge or charger, along with the last values read from it */
+struct gb_power_supply {
+	const struct device *const dev;
+	const char *const name;
+	const bool charger;
+	/* Set once the supported properties are known */
+	bool probed;
+	uint8_t props_count;
+	/* Index in the property table and cached value of each supported property */
+	uint8_t props[GB_POWER_SUPPLY_PROPS_MAX];
+	uint32_t values[GB_POWER_SUPPLY_PROPS_MAX];
+	/* Uptime of the last refresh */
+	int64_t updated_ms;
+};
+
+struct gb_power_supply_driver_data {
+	struct gb_power_supply *const supplies;
+	const uint8_t supplies_count;
+	/* Protects the supply caches */
+	struct k_mutex lock;
+	struct k_work_delayable refresh_work;
+	uint16_t cport;
+	bool connected;
+};
+
+#endif // _GREYBUS_POWER_SUPPLY_H_
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Per cport budget for message memory.
+ */
+
+#ifndef _GREYBUS_QUOTA_H_
+#define _GREYBUS_QUOTA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <greybus/greybus_messages.h>
+
+/* Messages not charged to any cport */
+#define GB_QUOTA_NO_CPORT UINT16_MAX
+
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+
+/**
+ * Get the cport whose request is being handled by the calling thread.
+ *
+ * @return cport, or GB_QUOTA_NO_CPORT outside of RX workers
+ */
+uint16_t gb_quota_current_cport(void);
+
+/**
+ * Charge bytes to the budget of a cport. Control and SVC cports have no budget.
+ *
+ * @return 0 on success, -ENOMEM if the budget would be exceeded
+ */
+int gb_quota_charge(uint16_t cport, size_t bytes);
+
+/**
+ * Return bytes charged with gb_quota_charge().
+ */
+void gb_quota_release(uint16_t cport, size_t bytes);
+
+/**
+ * Charge a message allocated outside of a request handler, such as by a transport, to a cport.
+ * Does nothing if the message is already charged.
+ *
+ * @return 0 on success, -ENOMEM if the budget would be exceeded
+ */
+int gb_message_quota_charge(struct gb_message *msg, uint16_t cport);
+
+#else
+
+static inline uint16_t gb_quota_current_cport(void)
+{
+	return GB_QUOTA_NO_CPORT;
+}
+
+static inline int gb_quota_charge(uint16_t cport, size_t bytes)
+{
+	return 0;
+}
+
+static inline void gb_quota_release(uint16_t cport, size_t bytes)
+{
+}
+
+static inline int gb_message_quota_charge(struct gb_message *msg, uint16_t cport)
+{
+	return 0;
+}
+
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+
+#endif // _GREYBUS_QUOTA_H_
@@ -8,12 +8,17 @@
 #define _GREYBUS_RAW_INTERNAL_H_
 
 #include <greybus/greybus_raw.h>
+#include <zephyr/kernel.h>
 
 extern const struct gb_driver gb_raw_driver;
 
 struct gb_raw_driver_data {
 	greybus_raw_cb_t cb;
 	void *cb_priv;
+#ifdef CONFIG_GREYBUS_RAW_STREAM
+	/* One credit per streamed message the host is ready to receive */
+	struct k_sem credits;
+#endif // CONFIG_GREYBUS_RAW_STREAM
 };
 
 #endif // _GREYBUS_RAW_INTERNAL_H_
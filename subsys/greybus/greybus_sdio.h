@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GREYBUS_SDIO_H_
+#define _GREYBUS_SDIO_H_
+
+#include <zephyr/drivers/sdhc.h>
+#include <zephyr/kernel.h>
+#include <greybus/greybus_messages.h>
+
+extern const struct gb_driver gb_sdio_driver;
+
+struct gb_sdio_driver_data {
+	const struct device *const dev;
+	/* Held for each SDHC access, and by a posted write until it completes */
+	struct k_sem idle;
+	struct k_work write_work;
+	/* Data command deferred until its data phase */
+	struct sdhc_command cmd;
+	struct sdhc_data data;
+	/* Request holding the data of a write done straight from the payload */
+	struct gb_message *write_msg;
+	/* Error of the last posted write, reported to the next command */
+	int write_err;
+	/* Bytes of the data phase transferred so far, and in total */
+	uint32_t offset;
+	uint32_t total;
+	uint16_t cport;
+	bool has_cmd;
+	/* Bounce buffer for data phases split over several transfer operations */
+	uint8_t buf[CONFIG_GREYBUS_SDIO_BUFFER_SIZE] __aligned(CONFIG_SDHC_BUFFER_ALIGNMENT);
+};
+
+#endif // _GREYBUS_SDIO_H_
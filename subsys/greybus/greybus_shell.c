@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Greybus shell commands.
+ */
+
+#include <string.h>
+#include <zephyr/shell/shell.h>
+#include <greybus/greybus_capture.h>
+#include <greybus/greybus_gpio.h>
+#include <greybus/greybus_loopback.h>
+#include <greybus/greybus_protocols.h>
+#include "greybus_heap.h"
+#include "greybus_stats.h"
+#include "greybus_transport.h"
+#include <greybus-utils/manifest.h>
+
+#ifdef CONFIG_GREYBUS_HEAP_STATS
+static int cmd_gb_heap(const struct shell *sh, size_t argc, char **argv)
+{
+	struct gb_heap_stats stats;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_heap_stats_get(&stats);
+
+	shell_print(sh, "current: %u bytes", stats.cur_bytes);
+	shell_print(sh, "peak: %u bytes", stats.peak_bytes);
+	shell_print(sh, "allocs: %u, frees: %u, failures: %u", stats.allocs, stats.frees,
+		    stats.failures);
+	shell_print(sh, "largest request: %u bytes", stats.max_request);
+	shell_print(sh, "interrupt context failures: %u", gb_alloc_isr_failures());
+#ifdef CONFIG_GREYBUS_NODE
+	shell_print(sh, "interrupt context messages dropped: %u", gb_transport_isr_drops());
+#endif // CONFIG_GREYBUS_NODE
+
+	for (size_t i = 0; i < GB_HEAP_STATS_BUCKETS - 1; i++) {
+		shell_print(sh, "  <= %5u: %u", GB_HEAP_STATS_BUCKET_SIZE(i), stats.histogram[i]);
+	}
+	shell_print(sh, "   > %5u: %u", GB_HEAP_STATS_BUCKET_SIZE(GB_HEAP_STATS_BUCKETS - 2),
+		    stats.histogram[GB_HEAP_STATS_BUCKETS - 1]);
+
+	return 0;
+}
+
+static int cmd_gb_heap_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_heap_stats_reset();
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_gb_heap,
+			       SHELL_CMD(reset, NULL, "Reset heap statistics", cmd_gb_heap_reset),
+			       SHELL_SUBCMD_SET_END);
+#endif // CONFIG_GREYBUS_HEAP_STATS
+
+#ifdef CONFIG_GREYBUS_LOOPBACK_BENCH
+static int cmd_gb_loopback(const struct shell *sh, size_t argc, char **argv)
+{
+	struct gb_loopback_bench_stats stats;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_loopback_bench_stats_get(&stats);
+
+	shell_print(sh, "%s", stats.running ? "running" : "stopped");
+	shell_print(sh, "sent: %u, completed: %u, errors: %u, alloc failures: %u", stats.sent,
+		    stats.completed, stats.errors, stats.alloc_failures);
+	shell_print(sh, "elapsed: %u ms", stats.elapsed_ms);
+	if (stats.elapsed_ms) {
+		shell_print(sh, "throughput: %llu B/s, %llu req/s",
+			    (unsigned long long)(stats.bytes * MSEC_PER_SEC / stats.elapsed_ms),
+			    (unsigned long long)stats.completed * MSEC_PER_SEC / stats.elapsed_ms);
+	}
+	shell_print(sh, "latency: min %u us, p50 %u us, p99 %u us, max %u us", stats.min_us,
+		    gb_loopback_bench_percentile(&stats, 50),
+		    gb_loopback_bench_percentile(&stats, 99), stats.max_us);
+
+	return 0;
+}
+
+static int cmd_gb_loopback_start(const struct shell *sh, size_t argc, char **argv)
+{
+	int ret, err = 0;
+	uint8_t type;
+	uint32_t size = 0, count = 0, interval_us = 0;
+
+	if (strcmp(argv[1], "ping") == 0) {
+		type = GB_LOOPBACK_TYPE_PING;
+	} else if (strcmp(argv[1], "transfer") == 0) {
+		type = GB_LOOPBACK_TYPE_TRANSFER;
+	} else if (strcmp(argv[1], "sink") == 0) {
+		type = GB_LOOPBACK_TYPE_SINK;
+	} else {
+		shell_error(sh, "Invalid type: %s", argv[1]);
+		return -EINVAL;
+	}
+
+	if (argc > 2) {
+		size = shell_strtoul(argv[2], 0, &err);
+	}
+	if (argc > 3) {
+		count = shell_strtoul(argv[3], 0, &err);
+	}
+	if (argc > 4) {
+		interval_us = shell_strtoul(argv[4], 0, &err);
+	}
+	if (err) {
+		shell_error(sh, "Invalid argument");
+		return err;
+	}
+
+	ret = gb_loopback_bench_start(type, size, count, interval_us);
+	if (ret < 0) {
+		shell_error(sh, "Failed to start benchmark: %d", ret);
+	}
+
+	return ret;
+}
+
+static int cmd_gb_loopback_stop(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_loopback_bench_stop();
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+	sub_gb_loopback,
+	SHELL_CMD_ARG(start, NULL,
+		      "Start benchmark: <ping|transfer|sink> [size] [count] [interval_us]",
+		      cmd_gb_loopback_start, 2, 3),
+	SHELL_CMD(stop, NULL, "Stop benchmark", cmd_gb_loopback_stop), SHELL_SUBCMD_SET_END);
+#endif // CONFIG_GREYBUS_LOOPBACK_BENCH
+
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+static void gb_shell_print_latency(const struct shell *sh, const char *name,
+				   const struct gb_gpio_latency_hist *hist)
+{
+	if (!hist->count) {
+		shell_print(sh, "%s: no samples", name);
+		return;
+	}
+
+	shell_print(sh, "%s: %u samples, min %u us, p50 %u us, p99 %u us, max %u us", name,
+		    hist->count, hist->min_us, gb_gpio_latency_percentile(hist, 50),
+		    gb_gpio_latency_percentile(hist, 99), hist->max_us);
+}
+
+static int cmd_gb_gpio(const struct shell *sh, size_t argc, char **argv)
+{
+	struct gb_gpio_latency_stats stats;
+
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_gpio_latency_get(&stats);
+
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_BENCH
+	shell_print(sh, "benchmark %s", gb_gpio_bench_running() ? "running" : "stopped");
+#endif // CONFIG_GREYBUS_GPIO_IRQ_BENCH
+	shell_print(sh, "irqs: %u, events: %u, untracked: %u, errors: %u", stats.irqs,
+		    stats.events, stats.untracked, stats.errors);
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_BENCH
+	gb_shell_print_latency(sh, "edge to irq", &stats.edge_to_irq);
+#endif // CONFIG_GREYBUS_GPIO_IRQ_BENCH
+	gb_shell_print_latency(sh, "irq to send", &stats.irq_to_send);
+	gb_shell_print_latency(sh, "send to ack", &stats.send_to_ack);
+
+	return 0;
+}
+
+static int cmd_gb_gpio_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_gpio_latency_reset();
+
+	return 0;
+}
+
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_BENCH
+static int cmd_gb_gpio_bench_start(const struct shell *sh, size_t argc, char **argv)
+{
+	int ret, err = 0;
+	const struct device *port;
+	gpio_pin_t pin;
+	uint32_t rate_hz, count = 0;
+
+	port = device_get_binding(argv[1]);
+	if (!port) {
+		shell_error(sh, "Invalid device: %s", argv[1]);
+		return -ENODEV;
+	}
+
+	pin = shell_strtoul(argv[2], 0, &err);
+	rate_hz = shell_strtoul(argv[3], 0, &err);
+	if (argc > 4) {
+		count = shell_strtoul(argv[4], 0, &err);
+	}
+	if (err) {
+		shell_error(sh, "Invalid argument");
+		return err;
+	}
+
+	ret = gb_gpio_bench_start(port, pin, rate_hz, count);
+	if (ret < 0) {
+		shell_error(sh, "Failed to start benchmark: %d", ret);
+	}
+
+	return ret;
+}
+
+static int cmd_gb_gpio_bench_stop(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_gpio_bench_stop();
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+	sub_gb_gpio_bench,
+	SHELL_CMD_ARG(start, NULL, "Start benchmark: <device> <pin> <rate_hz> [count]",
+		      cmd_gb_gpio_bench_start, 4, 1),
+	SHELL_CMD(stop, NULL, "Stop benchmark", cmd_gb_gpio_bench_stop), SHELL_SUBCMD_SET_END);
+#endif // CONFIG_GREYBUS_GPIO_IRQ_BENCH
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+	sub_gb_gpio, SHELL_CMD(reset, NULL, "Reset latency statistics", cmd_gb_gpio_reset),
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_BENCH
+	SHELL_CMD(bench, &sub_gb_gpio_bench, "Interrupt latency benchmark", NULL),
+#endif
+	SHELL_SUBCMD_SET_END);
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+
+#ifdef CONFIG_GREYBUS_CPORT_STATS
+static void gb_shell_print_histogram(const struct shell *sh, const char *name,
+				     const uint32_t histogram[GB_CPORT_STATS_BUCKETS])
+{
+	shell_print(sh, "  %s:", name);
+	for (size_t i = 0; i < GB_CPORT_STATS_BUCKETS - 1; i++) {
+		if (histogram[i]) {
+			shell_print(sh, "    <= %5u us: %u", GB_CPORT_STATS_BUCKET_US(i),
+				    histogram[i]);
+		}
+	}
+	if (histogram[GB_CPORT_STATS_BUCKETS - 1]) {
+		shell_print(sh, "     > %5u us: %u",
+			    GB_CPORT_STATS_BUCKET_US(GB_CPORT_STATS_BUCKETS - 2),
+			    histogram[GB_CPORT_STATS_BUCKETS - 1]);
+	}
+}
+
+static int cmd_gb_cports(const struct shell *sh, size_t argc, char **argv)
+{
+	struct gb_cport_stats stats;
+	uint16_t first = 0, last = GREYBUS_CPORT_COUNT - 1;
+	int err = 0;
+
+	if (argc > 1) {
+		first = last = shell_strtoul(argv[1], 0, &err);
+		if (err || first >= GREYBUS_CPORT_COUNT) {
+			shell_error(sh, "Invalid cport: %s", argv[1]);
+			return -EINVAL;
+		}
+	}
+
+	for (uint16_t cport = first; cport <= last; cport++) {
+		gb_stats_get(cport, &stats);
+
+		shell_print(sh, "cport %u:", cport);
+		shell_print(sh, "  rx: %u msgs, %u bytes", stats.rx_msgs, stats.rx_bytes);
+		shell_print(sh, "  tx: %u msgs, %u bytes, %u errors", stats.tx_msgs, stats.tx_bytes,
+			    stats.tx_errors);
+		for (size_t i = 1; i < GB_CPORT_STATS_RESULTS; i++) {
+			if (stats.results[i]) {
+				shell_print(sh, "  result %s0x%02x: %u",
+					    (i == GB_CPORT_STATS_RESULTS - 1) ? ">= " : "",
+					    (unsigned int)i, stats.results[i]);
+			}
+		}
+		if (stats.rx_msgs) {
+			shell_print(sh, "  max queue wait: %u us, max handler time: %u us",
+				    stats.wait_max_us, stats.handler_max_us);
+			shell_print(sh, "  total handler time: %llu us",
+				    (unsigned long long)k_cyc_to_us_floor64(stats.handler_cycles));
+			gb_shell_print_histogram(sh, "queue wait", stats.wait_histogram);
+			gb_shell_print_histogram(sh, "handler time", stats.handler_histogram);
+		}
+	}
+
+	return 0;
+}
+
+static int cmd_gb_cports_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_stats_reset();
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_gb_cports,
+			       SHELL_CMD(reset, NULL, "Reset cport statistics",
+					 cmd_gb_cports_reset),
+			       SHELL_SUBCMD_SET_END);
+#endif // CONFIG_GREYBUS_CPORT_STATS
+
+#ifdef CONFIG_GREYBUS_CAPTURE
+static int cmd_gb_capture(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	shell_print(sh, "dropped: %u messages", gb_capture_drops());
+
+	return 0;
+}
+
+static int cmd_gb_capture_start(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_capture_start();
+
+	return 0;
+}
+
+static int cmd_gb_capture_stop(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	gb_capture_stop();
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_gb_capture,
+			       SHELL_CMD(start, NULL, "Start a new capture", cmd_gb_capture_start),
+			       SHELL_CMD(stop, NULL, "Stop capturing", cmd_gb_capture_stop),
+			       SHELL_SUBCMD_SET_END);
+#endif // CONFIG_GREYBUS_CAPTURE
+
+#ifdef CONFIG_GREYBUS_STACK_STATS
+static void gb_shell_print_stack(const struct k_thread *thread, void *user_data)
+{
+	const struct shell *sh = user_data;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+	const size_t size = thread->stack_info.size;
+	size_t unused;
+
+	/* All Greybus threads are named with this prefix */
+	if (!name || strncmp(name, "gb_", 3)) {
+		return;
+	}
+
+	if (k_thread_stack_space_get(thread, &unused)) {
+		shell_print(sh, "%-16s %p: unknown usage", name, thread);
+		return;
+	}
+
+	shell_print(sh, "%-16s %p: size %5zu, used %5zu, unused %5zu (%zu%%)", name, thread, size,
+		    size - unused, unused, size ? (size - unused) * 100 / size : 0);
+}
+
+static int cmd_gb_stacks(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	/* Printing may block, so the thread list is not locked */
+	k_thread_foreach_unlocked(gb_shell_print_stack, (void *)sh);
+
+	return 0;
+}
+#endif // CONFIG_GREYBUS_STACK_STATS
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_greybus,
+#ifdef CONFIG_GREYBUS_HEAP_STATS
+			       SHELL_CMD(heap, &sub_gb_heap, "Show heap statistics", cmd_gb_heap),
+#endif
+#ifdef CONFIG_GREYBUS_CPORT_STATS
+			       SHELL_CMD_ARG(cports, &sub_gb_cports,
+					     "Show cport statistics: [cport]", cmd_gb_cports, 1, 1),
+#endif
+#ifdef CONFIG_GREYBUS_STACK_STATS
+			       SHELL_CMD(stacks, NULL, "Show thread stack usage", cmd_gb_stacks),
+#endif
+#ifdef CONFIG_GREYBUS_CAPTURE
+			       SHELL_CMD(capture, &sub_gb_capture, "Show capture statistics",
+					 cmd_gb_capture),
+#endif
+#ifdef CONFIG_GREYBUS_LOOPBACK_BENCH
+			       SHELL_CMD(loopback, &sub_gb_loopback,
+					 "Show loopback benchmark statistics", cmd_gb_loopback),
+#endif
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+			       SHELL_CMD(gpio, &sub_gb_gpio, "Show GPIO interrupt latency",
+					 cmd_gb_gpio),
+#endif
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(greybus, &sub_greybus, "Greybus commands", NULL);
@@ -8,6 +8,7 @@
 #define _GREYBUS_SPI_H_
 
 #include <stdint.h>
+#include <zephyr/drivers/spi.h>
 #include <greybus/greybus_protocols.h>
 
 extern const struct gb_driver gb_spi_driver;
@@ -17,9 +18,21 @@ struct gb_spi_device_data {
 	uint8_t id;
 };
 
+/*
+ * SPI drivers skip reprogramming the controller when called with the same spi_config pointer as
+ * the previous transfer. Each chip select thus keeps its last configuration, and a changed one is
+ * written to the other slot so that the pointer changes too.
+ */
+struct gb_spi_cs_config {
+	struct spi_config conf[2];
+	uint8_t cur;
+	bool valid;
+};
+
 struct gb_spi_driver_data {
 	const struct gb_spi_device_data *devices;
 	const struct device *dev;
+	struct gb_spi_cs_config cs_configs[CONFIG_GREYBUS_SPI_CHIP_SELECTS];
 	uint8_t device_num;
 };
 
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/kernel.h>
+#include <greybus-utils/manifest.h>
+#include "greybus_stats.h"
+#include "greybus_cport.h"
+
+#ifdef CONFIG_GREYBUS_TRACING
+#include <zephyr/tracing/tracing.h>
+#endif // CONFIG_GREYBUS_TRACING
+
+static struct gb_cport_stats gb_cport_stats[GREYBUS_CPORT_COUNT];
+static struct k_spinlock gb_stats_lock;
+
+static size_t gb_stats_bucket(uint32_t us)
+{
+	size_t i = 0;
+
+	while (i < GB_CPORT_STATS_BUCKETS - 1 && us > GB_CPORT_STATS_BUCKET_US(i)) {
+		i++;
+	}
+
+	return i;
+}
+
+static void gb_stats_result(struct gb_cport_stats *stats, const struct gb_message *msg)
+{
+	if (gb_message_is_response(msg)) {
+		stats->results[MIN(msg->header.result, GB_CPORT_STATS_RESULTS - 1)]++;
+	}
+}
+
+void gb_stats_rx(uint16_t cport, const struct gb_message *msg, uint32_t wait_cycles)
+{
+	const uint32_t us = k_cyc_to_us_floor32(wait_cycles);
+	struct gb_cport_stats *stats;
+	k_spinlock_key_t key;
+
+	if (cport >= ARRAY_SIZE(gb_cport_stats)) {
+		return;
+	}
+
+#ifdef CONFIG_GREYBUS_TRACING
+	sys_trace_named_event("gb_rx", cport, gb_message_type(msg));
+#endif // CONFIG_GREYBUS_TRACING
+
+	stats = &gb_cport_stats[cport];
+	key = k_spin_lock(&gb_stats_lock);
+	stats->rx_msgs++;
+	stats->rx_bytes += sizeof(msg->header) + gb_message_payload_len(msg);
+	stats->wait_max_us = MAX(stats->wait_max_us, us);
+	stats->wait_histogram[gb_stats_bucket(us)]++;
+	gb_stats_result(stats, msg);
+	k_spin_unlock(&gb_stats_lock, key);
+}
+
+void gb_stats_handler(uint16_t cport, uint32_t cycles)
+{
+	const uint32_t us = k_cyc_to_us_floor32(cycles);
+	struct gb_cport_stats *stats;
+	k_spinlock_key_t key;
+
+	if (cport >= ARRAY_SIZE(gb_cport_stats)) {
+		return;
+	}
+
+#ifdef CONFIG_GREYBUS_TRACING
+	sys_trace_named_event("gb_handler", cport, us);
+#endif // CONFIG_GREYBUS_TRACING
+
+	stats = &gb_cport_stats[cport];
+	key = k_spin_lock(&gb_stats_lock);
+	stats->handler_max_us = MAX(stats->handler_max_us, us);
+	stats->handler_histogram[gb_stats_bucket(us)]++;
+	stats->handler_cycles += cycles;
+	k_spin_unlock(&gb_stats_lock, key);
+}
+
+void gb_stats_tx(uint16_t cport, const struct gb_message *msg, int err)
+{
+	struct gb_cport_stats *stats;
+	k_spinlock_key_t key;
+
+	if (cport >= ARRAY_SIZE(gb_cport_stats)) {
+		return;
+	}
+
+#ifdef CONFIG_GREYBUS_TRACING
+	sys_trace_named_event("gb_tx", cport, gb_message_type(msg));
+#endif // CONFIG_GREYBUS_TRACING
+
+	stats = &gb_cport_stats[cport];
+	key = k_spin_lock(&gb_stats_lock);
+	if (err) {
+		stats->tx_errors++;
+	} else {
+		stats->tx_msgs++;
+		stats->tx_bytes += sizeof(msg->header) + gb_message_payload_len(msg);
+		gb_stats_result(stats, msg);
+	}
+	k_spin_unlock(&gb_stats_lock, key);
+}
+
+int gb_stats_get(uint16_t cport, struct gb_cport_stats *stats)
+{
+	k_spinlock_key_t key;
+
+	if (cport >= ARRAY_SIZE(gb_cport_stats)) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&gb_stats_lock);
+	*stats = gb_cport_stats[cport];
+	k_spin_unlock(&gb_stats_lock, key);
+
+	return 0;
+}
+
+void gb_stats_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_stats_lock);
+
+	memset(gb_cport_stats, 0, sizeof(gb_cport_stats));
+	k_spin_unlock(&gb_stats_lock, key);
+}
+
+#ifdef CONFIG_GREYBUS_ENERGY_STATS
+int gb_stats_bundle_energy_get(uint8_t bundle, struct gb_bundle_energy *energy)
+{
+	bool found = false;
+	uint64_t cycles = 0, msgs, bytes;
+	const struct gb_cport_stats *stats;
+	k_spinlock_key_t key;
+
+	memset(energy, 0, sizeof(*energy));
+
+	key = k_spin_lock(&gb_stats_lock);
+	for (size_t i = 0; i < ARRAY_SIZE(gb_cport_stats); i++) {
+		if (gb_cport_get(i)->bundle != bundle) {
+			continue;
+		}
+
+		stats = &gb_cport_stats[i];
+		found = true;
+		energy->rx_msgs += stats->rx_msgs;
+		energy->rx_bytes += stats->rx_bytes;
+		energy->tx_msgs += stats->tx_msgs;
+		energy->tx_bytes += stats->tx_bytes;
+		cycles += stats->handler_cycles;
+	}
+	k_spin_unlock(&gb_stats_lock, key);
+
+	if (!found) {
+		return -EINVAL;
+	}
+
+	msgs = (uint64_t)energy->rx_msgs + energy->tx_msgs;
+	bytes = (uint64_t)energy->rx_bytes + energy->tx_bytes;
+	energy->radio_us = msgs * CONFIG_GREYBUS_ENERGY_RADIO_US_PER_MSG +
+			   bytes * CONFIG_GREYBUS_ENERGY_RADIO_NS_PER_BYTE / NSEC_PER_USEC;
+	energy->cpu_us = k_cyc_to_us_floor64(cycles);
+
+	return 0;
+}
+#endif // CONFIG_GREYBUS_ENERGY_STATS
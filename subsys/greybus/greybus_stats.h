@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Per cport traffic and timing statistics.
+ */
+
+#ifndef _GREYBUS_STATS_H_
+#define _GREYBUS_STATS_H_
+
+#include <stdint.h>
+#include <greybus/greybus_messages.h>
+
+/* Time histogram buckets: <= 8us, <= 16us, ..., <= 16ms, larger */
+#define GB_CPORT_STATS_BUCKETS          12
+#define GB_CPORT_STATS_BUCKET_US(_idx) (8U << (_idx))
+
+/* Results GB_OP_SUCCESS to GB_OP_NONEXISTENT, then everything else */
+#define GB_CPORT_STATS_RESULTS (GB_OP_NONEXISTENT + 2)
+
+struct gb_cport_stats {
+	uint32_t rx_msgs;
+	uint32_t rx_bytes;
+	uint32_t tx_msgs;
+	uint32_t tx_bytes;
+	uint32_t tx_errors;
+	/* Time spent in the rx queue before processing */
+	uint32_t wait_max_us;
+	uint32_t wait_histogram[GB_CPORT_STATS_BUCKETS];
+	/* Time spent in the operation handler */
+	uint32_t handler_max_us;
+	uint32_t handler_histogram[GB_CPORT_STATS_BUCKETS];
+	/* Total time spent in the operation handler */
+	uint64_t handler_cycles;
+	/* Results of responses sent and received */
+	uint32_t results[GB_CPORT_STATS_RESULTS];
+};
+
+/* Traffic and handler time of all cports of a bundle */
+struct gb_bundle_energy {
+	uint32_t rx_msgs;
+	uint32_t rx_bytes;
+	uint32_t tx_msgs;
+	uint32_t tx_bytes;
+	/* Estimated time the radio spent on the traffic */
+	uint64_t radio_us;
+	/* Time spent in operation handlers */
+	uint64_t cpu_us;
+};
+
+#ifdef CONFIG_GREYBUS_CPORT_STATS
+
+/**
+ * Account for a message taken from the rx queue, and the time it waited there.
+ */
+void gb_stats_rx(uint16_t cport, const struct gb_message *msg, uint32_t wait_cycles);
+
+/**
+ * Account for the time an operation handler took.
+ */
+void gb_stats_handler(uint16_t cport, uint32_t cycles);
+
+/**
+ * Account for a message passed to the transport.
+ */
+void gb_stats_tx(uint16_t cport, const struct gb_message *msg, int err);
+
+/**
+ * Get a snapshot of the statistics of a cport.
+ *
+ * @return 0 on success, -EINVAL if cport does not exist.
+ */
+int gb_stats_get(uint16_t cport, struct gb_cport_stats *stats);
+
+/**
+ * Reset the statistics of all cports.
+ */
+void gb_stats_reset(void);
+
+#ifdef CONFIG_GREYBUS_ENERGY_STATS
+/**
+ * Get the energy report of a bundle.
+ *
+ * @return 0 on success, -EINVAL if the bundle has no cport.
+ */
+int gb_stats_bundle_energy_get(uint8_t bundle, struct gb_bundle_energy *energy);
+#endif // CONFIG_GREYBUS_ENERGY_STATS
+
+#else
+
+static inline void gb_stats_rx(uint16_t cport, const struct gb_message *msg, uint32_t wait_cycles)
+{
+}
+
+static inline void gb_stats_handler(uint16_t cport, uint32_t cycles)
+{
+}
+
+static inline void gb_stats_tx(uint16_t cport, const struct gb_message *msg, int err)
+{
+}
+
+#endif // CONFIG_GREYBUS_CPORT_STATS
+
+#endif // _GREYBUS_STATS_H_
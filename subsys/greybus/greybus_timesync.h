@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * TimeSync operations of the control protocol.
+ */
+
+#ifndef _GREYBUS_TIMESYNC_INTERNAL_H_
+#define _GREYBUS_TIMESYNC_INTERNAL_H_
+
+#include <stdint.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/greybus_timesync.h>
+
+/**
+ * Start capturing strobes.
+ *
+ * @param count: number of strobes the SVC sends, at most GB_TIMESYNC_MAX_STROBES.
+ * @param frame_time: frame time of the AP at the first strobe.
+ * @param strobe_delay: time between strobes in microseconds.
+ * @param refclk: rate of the frame time in Hz.
+ *
+ * @return 0 on success, -EINVAL for an invalid count or refclk, or the GPIO error
+ */
+int gb_timesync_enable(uint8_t count, uint64_t frame_time, uint32_t strobe_delay,
+		       uint32_t refclk);
+
+/**
+ * Stop capturing strobes, and forget the synchronization.
+ */
+void gb_timesync_disable(void);
+
+/**
+ * Synchronize to the frame times the SVC measured for each strobe.
+ *
+ * @return 0 on success, -EAGAIN if TimeSync is disabled or no strobe was captured.
+ */
+int gb_timesync_authoritative(const uint64_t frame_time[GB_TIMESYNC_MAX_STROBES]);
+
+/**
+ * Get the frame time of the last strobe.
+ *
+ * @return 0 on success, -EAGAIN if TimeSync is disabled or no strobe was captured.
+ */
+int gb_timesync_get_last_event(uint64_t *frame_time);
+
+#endif // _GREYBUS_TIMESYNC_INTERNAL_H_
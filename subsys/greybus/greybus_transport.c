@@ -8,11 +8,16 @@
 
 #include "greybus_transport.h"
 #include "greybus/greybus.h"
+#include "greybus_capture.h"
+#include "greybus_cport.h"
+#include "greybus_stats.h"
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_REGISTER(greybus_transport_common, CONFIG_GREYBUS_LOG_LEVEL);
 
-int gb_transport_message_send(const struct gb_message *msg, uint16_t cport)
+static int gb_transport_backend_send(const struct gb_message *msg, uint16_t cport)
 {
 	int retval;
 	const struct gb_transport_backend *transport_backend = gb_transport_get_backend();
@@ -22,5 +27,222 @@ int gb_transport_message_send(const struct gb_message *msg, uint16_t cport)
 		LOG_ERR("Greybus backend failed to send: error %d", retval);
 	}
 
+	gb_stats_tx(cport, msg, retval);
+
 	return retval;
 }
+
+/*
+ * Helper to hand several messages to the backend, in one write when it supports batches.
+ */
+static int gb_transport_backend_send_batch(const struct gb_msg_with_cport *items, size_t num)
+{
+	int retval = 0, ret;
+	const struct gb_transport_backend *transport_backend = gb_transport_get_backend();
+
+	if (!transport_backend->send_batch) {
+		for (size_t i = 0; i < num; i++) {
+			ret = gb_transport_backend_send(items[i].msg, items[i].cport);
+			retval = retval ? retval : ret;
+		}
+		return retval;
+	}
+
+	retval = transport_backend->send_batch(items, num);
+	if (retval) {
+		LOG_ERR("Greybus backend failed to send %zu messages: error %d", num, retval);
+	}
+
+	for (size_t i = 0; i < num; i++) {
+		gb_stats_tx(items[i].cport, items[i].msg, retval);
+	}
+
+	return retval;
+}
+
+K_MSGQ_DEFINE(gb_tx_isr_msgq, sizeof(struct gb_msg_with_cport), CONFIG_GREYBUS_ISR_TX_QUEUE_DEPTH,
+	      4);
+static atomic_t gb_tx_isr_drops;
+
+static void gb_tx_isr_work_handler(struct k_work *work)
+{
+	struct gb_msg_with_cport item;
+
+	while (k_msgq_get(&gb_tx_isr_msgq, &item, K_NO_WAIT) == 0) {
+		gb_transport_message_send(item.msg, item.cport);
+		gb_message_dealloc(item.msg);
+	}
+}
+
+static K_WORK_DEFINE(gb_tx_isr_work, gb_tx_isr_work_handler);
+
+int gb_transport_message_send_isr(struct gb_message *msg, uint16_t cport)
+{
+	const struct gb_msg_with_cport item = {
+		.cport = cport,
+		.msg = msg,
+	};
+
+	if (k_msgq_put(&gb_tx_isr_msgq, &item, K_NO_WAIT) < 0) {
+		atomic_inc(&gb_tx_isr_drops);
+		gb_message_dealloc(msg);
+		return -ENOBUFS;
+	}
+
+	k_work_submit(&gb_tx_isr_work);
+
+	return 0;
+}
+
+uint32_t gb_transport_isr_drops(void)
+{
+	return atomic_get(&gb_tx_isr_drops);
+}
+
+#ifdef CONFIG_GREYBUS_TX_AGGREGATION
+
+static K_THREAD_STACK_DEFINE(gb_tx_wq_stack, CONFIG_GREYBUS_TX_AGGREGATION_WQ_STACK_SIZE);
+static struct k_work_q gb_tx_wq;
+
+/*
+ * struct gb_tx_batch: Messages waiting to go out in one transport write
+ *
+ * @lock: protects the batch
+ * @items: queued messages, each holding a reference
+ * @num: number of queued messages
+ * @bytes: total size of the queued messages
+ * @flush_work: flushes the batch once the first message has waited long enough
+ */
+struct gb_tx_batch {
+	struct k_mutex lock;
+	struct gb_msg_with_cport items[CONFIG_GREYBUS_TX_AGGREGATION_MSGS];
+	size_t num;
+	size_t bytes;
+	struct k_work_delayable flush_work;
+};
+
+static struct gb_tx_batch gb_tx_batch;
+
+/*
+ * Helper to send all queued messages. Must be called with the batch lock held.
+ */
+static void gb_tx_batch_flush(struct gb_tx_batch *batch)
+{
+	if (!batch->num) {
+		return;
+	}
+
+	gb_transport_backend_send_batch(batch->items, batch->num);
+
+	for (size_t i = 0; i < batch->num; i++) {
+		gb_message_dealloc(batch->items[i].msg);
+	}
+
+	batch->num = 0;
+	batch->bytes = 0;
+	k_work_cancel_delayable(&batch->flush_work);
+}
+
+static void gb_tx_batch_flush_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct gb_tx_batch *batch = CONTAINER_OF(dwork, struct gb_tx_batch, flush_work);
+
+	k_mutex_lock(&batch->lock, K_FOREVER);
+	gb_tx_batch_flush(batch);
+	k_mutex_unlock(&batch->lock);
+}
+
+int gb_transport_message_send(const struct gb_message *msg, uint16_t cport)
+{
+	struct gb_tx_batch *batch = &gb_tx_batch;
+	const size_t size = sys_le16_to_cpu(msg->header.size);
+	struct gb_message *ref;
+
+	gb_capture_tx(cport, msg);
+
+	k_mutex_lock(&batch->lock, K_FOREVER);
+
+	if (batch->num == ARRAY_SIZE(batch->items)) {
+		gb_tx_batch_flush(batch);
+	}
+
+	ref = gb_message_get(msg);
+	if (!ref) {
+		/* Keep the order on the cport, then fall back to sending directly */
+		gb_tx_batch_flush(batch);
+		k_mutex_unlock(&batch->lock);
+		return gb_transport_backend_send(msg, cport);
+	}
+
+	batch->items[batch->num].cport = cport;
+	batch->items[batch->num].msg = ref;
+	batch->num++;
+	batch->bytes += size;
+
+	/* Enumeration and hot-plug traffic takes everything queued before it along right away */
+	if (gb_cport_is_expedited(cport) || batch->num == ARRAY_SIZE(batch->items) ||
+	    batch->bytes >= CONFIG_GREYBUS_TX_AGGREGATION_BYTES) {
+		gb_tx_batch_flush(batch);
+	} else {
+		/* Does nothing if already scheduled, the delay counts from the oldest message */
+		k_work_schedule_for_queue(&gb_tx_wq, &batch->flush_work,
+					  K_USEC(CONFIG_GREYBUS_TX_AGGREGATION_DELAY_US));
+	}
+
+	k_mutex_unlock(&batch->lock);
+
+	return 0;
+}
+
+int gb_transport_message_send_batch(const struct gb_msg_with_cport *items, size_t num)
+{
+	int retval;
+	struct gb_tx_batch *batch = &gb_tx_batch;
+
+	for (size_t i = 0; i < num; i++) {
+		gb_capture_tx(items[i].cport, items[i].msg);
+	}
+
+	/* Already a batch, only what was queued before has to go out first */
+	k_mutex_lock(&batch->lock, K_FOREVER);
+	gb_tx_batch_flush(batch);
+	retval = gb_transport_backend_send_batch(items, num);
+	k_mutex_unlock(&batch->lock);
+
+	return retval;
+}
+
+static int gb_tx_batch_init(void)
+{
+	k_mutex_init(&gb_tx_batch.lock);
+	k_work_init_delayable(&gb_tx_batch.flush_work, gb_tx_batch_flush_work_handler);
+
+	k_work_queue_start(&gb_tx_wq, gb_tx_wq_stack, K_THREAD_STACK_SIZEOF(gb_tx_wq_stack),
+			   CONFIG_GREYBUS_TX_AGGREGATION_WQ_PRIORITY, NULL);
+	k_thread_name_set(&gb_tx_wq.thread, "gb_tx_wq");
+
+	return 0;
+}
+
+SYS_INIT(gb_tx_batch_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+
+#else
+
+int gb_transport_message_send(const struct gb_message *msg, uint16_t cport)
+{
+	gb_capture_tx(cport, msg);
+
+	return gb_transport_backend_send(msg, cport);
+}
+
+int gb_transport_message_send_batch(const struct gb_msg_with_cport *items, size_t num)
+{
+	for (size_t i = 0; i < num; i++) {
+		gb_capture_tx(items[i].cport, items[i].msg);
+	}
+
+	return gb_transport_backend_send_batch(items, num);
+}
+
+#endif // CONFIG_GREYBUS_TX_AGGREGATION
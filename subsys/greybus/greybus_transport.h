@@ -7,6 +7,7 @@
 #ifndef _GREYBUS_TRANSPORT_H_
 #define _GREYBUS_TRANSPORT_H_
 
+#include <greybus/greybus.h>
 #include <greybus/greybus_messages.h>
 
 extern const struct gb_transport_backend gb_trans_backend;
@@ -17,11 +18,40 @@ extern const struct gb_transport_backend gb_trans_backend;
  * This function does not take ownership over the message. Hence it is the caller's responsibility
  * to cleanup.
  *
+ * With CONFIG_GREYBUS_TX_AGGREGATION, the message may only be queued when this returns. Late
+ * failures are logged and counted in the cport stats.
+ *
  * @param cport
  * @param msg
  */
 int gb_transport_message_send(const struct gb_message *msg, uint16_t cport);
 
+/**
+ * Send several messages to AP, in a single transport write when the backend supports it.
+ *
+ * Like gb_transport_message_send(), this does not take ownership over the messages. Messages
+ * queued by CONFIG_GREYBUS_TX_AGGREGATION are sent first.
+ *
+ * @return 0 on success, the first error otherwise.
+ */
+int gb_transport_message_send_batch(const struct gb_msg_with_cport *items, size_t num);
+
+/**
+ * Send message to AP from interrupt context.
+ *
+ * The message is queued and sent from the system work queue. Takes ownership of the message,
+ * which should come from gb_message_alloc_isr(). Never blocks. The message is dropped, and
+ * counted, if the queue is full.
+ *
+ * @return 0 if queued, -ENOBUFS if dropped
+ */
+int gb_transport_message_send_isr(struct gb_message *msg, uint16_t cport);
+
+/**
+ * Number of messages dropped by gb_transport_message_send_isr() since boot.
+ */
+uint32_t gb_transport_isr_drops(void);
+
 /**
  * Helper to allocate and send success response
  *
@@ -38,12 +68,11 @@ static inline void gb_transport_message_response_success_send(struct gb_message
 	/* Very low chance of allocation failure. However, if it happens, the only thing we can do
 	 * is either busy wait or drop the message. Choosing to drop for now. */
 	struct gb_message *resp =
-		gb_message_response_alloc_from_req(payload, payload_len, req, GB_OP_SUCCESS);
+		gb_message_request_to_response(req, payload, payload_len, GB_OP_SUCCESS);
 	if (resp) {
 		gb_transport_message_send(resp, cport);
 	}
 
-	gb_message_dealloc(req);
 	gb_message_dealloc(resp);
 }
 
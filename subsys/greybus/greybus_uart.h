@@ -8,7 +8,43 @@
 #define _GREYBUS_UART_H_
 
 #include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/sys/slist.h>
 
 extern const struct gb_driver gb_uart_driver;
 
+struct gb_uart_driver_data {
+	const struct device *const dev;
+	struct ring_buf tx_rb;
+	struct k_spinlock tx_lock;
+	/* Given by the TX interrupt whenever space is freed in tx_rb, and on flush or disconnect */
+	struct k_sem tx_space;
+	/* Bumped by each flush and disconnect, ends a write waiting for tx_space */
+	atomic_t tx_cancel;
+	/* Set while the cport is connected */
+	atomic_t connected;
+	struct k_work_delayable credits_work;
+	/* Bytes handed to the hardware but not yet credited to the host */
+	atomic_t tx_credits;
+	struct ring_buf rx_rb;
+	struct k_spinlock rx_lock;
+#ifdef CONFIG_GREYBUS_UART_RX_PUMP
+	/* Entry in the list of UARTs served by the receive thread */
+	sys_snode_t rx_node;
+	/* Marks the data as due once the line has been idle long enough */
+	struct k_timer rx_idle_timer;
+	/* Set when buffered data should be sent by the next receive cycle */
+	atomic_t rx_ready;
+#else
+	struct k_work_delayable rx_work;
+#endif // CONFIG_GREYBUS_UART_RX_PUMP
+	/* Set when the RX interrupt was disabled because rx_rb is full */
+	atomic_t rx_stalled;
+	uint16_t cport;
+	uint8_t tx_buf[CONFIG_GREYBUS_UART_TX_BUF_SIZE];
+	uint8_t rx_buf[CONFIG_GREYBUS_UART_RX_BUF_SIZE];
+};
+
 #endif // _GREYBUS_UART_H_
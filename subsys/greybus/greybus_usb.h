@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GREYBUS_USB_H_
+#define _GREYBUS_USB_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/usb/uhc.h>
+
+extern const struct gb_driver gb_usb_driver;
+
+struct gb_usb_ep;
+
+/* URB submitted by the AP, owned by the driver until its completion is sent */
+struct gb_usb_urb_ctx {
+	sys_snode_t node;
+	struct uhc_transfer *xfer;
+	/* NULL while the context is free */
+	struct gb_usb_ep *ep;
+	int status;
+	uint16_t id;
+	uint16_t length;
+	uint16_t actual_length;
+	bool in;
+	/* Dequeued by the AP while owned by the controller */
+	bool unlinked;
+};
+
+/* URBs queued to one endpoint of a device, only one is handed to the controller at a time */
+struct gb_usb_ep {
+	sys_slist_t pending;
+	struct gb_usb_urb_ctx *inflight;
+	/* NULL while the endpoint is free */
+	struct usb_device *udev;
+	uint8_t addr;
+	uint8_t type;
+	/* URBs not yet completed to the AP */
+	uint16_t urbs;
+};
+
+struct gb_usb_driver_data {
+	const struct device *const dev;
+	/* Protects everything below */
+	struct k_mutex lock;
+	struct k_work tx_work;
+	struct gb_usb_urb_ctx urbs[CONFIG_GREYBUS_USB_URB_COUNT];
+	sys_slist_t free_urbs;
+	/* Completed URBs waiting to be sent to the AP */
+	sys_slist_t done;
+	struct gb_usb_ep eps[CONFIG_GREYBUS_USB_ENDPOINTS];
+	struct usb_device devices[CONFIG_GREYBUS_USB_DEVICES];
+	uint32_t devices_used;
+	/* Bulk endpoint served first by the next scheduling pass */
+	uint8_t next_bulk;
+	/* Root hub port */
+	uint16_t port_status;
+	uint16_t port_change;
+	uint16_t cport;
+	bool started;
+};
+
+#endif // _GREYBUS_USB_H_
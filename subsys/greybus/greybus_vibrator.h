@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GREYBUS_VIBRATOR_H_
+#define _GREYBUS_VIBRATOR_H_
+
+#include <zephyr/kernel.h>
+#include <greybus/greybus_protocols.h>
+
+extern const struct gb_driver gb_vibrator_driver;
+
+struct gb_vibrator_driver_data {
+	const struct device *const dev;
+#ifdef CONFIG_GREYBUS_VIBRATOR_PATTERN
+	struct k_work_delayable pattern_work;
+	struct gb_vibrator_pattern_step steps[CONFIG_GREYBUS_VIBRATOR_PATTERN_STEPS];
+	/* Uptime of the next pattern phase, kept absolute to avoid drift */
+	int64_t next_ms;
+	uint8_t step_count;
+	uint8_t repeat;
+	/* Current phase. Even phases are on, odd phases are off */
+	uint16_t phase;
+	uint8_t loops_left;
+#endif // CONFIG_GREYBUS_VIBRATOR_PATTERN
+};
+
+#endif // _GREYBUS_VIBRATOR_H_
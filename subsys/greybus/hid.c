@@ -26,740 +26,503 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <stdlib.h>
-#include <string.h>
-
-#include <zephyr/device.h>
-#include <greybus/greybus.h>
-
+#include <zephyr/input/input.h>
+#include <zephyr/input/input_hid.h>
+#include <zephyr/logging/log.h>
 #include <zephyr/sys/byteorder.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/greybus_messages.h>
+#include "greybus_transport.h"
+#include "greybus_internal.h"
+#include "greybus_hid.h"
 
-#include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(greybus_hid, CONFIG_GREYBUS_LOG_LEVEL);
 
-#include "hid-gb.h"
-
-#define GB_HID_VERSION_MAJOR 0
-#define GB_HID_VERSION_MINOR 1
-
-/* Reserved operations for IRQ event input report buffer. */
-#define MAX_REPORT_OPERATIONS 5
-
-/**
- * The structure for an operation queue.
- */
-struct op_node {
-	/** queue entry */
-	sq_entry_t entry;
-
-	/** pointer to operation */
-	struct gb_operation *operation;
-
-	/** pointer to buffer of request in operation */
-	uint8_t *buffer;
+#define GB_HID_VERSION_BCD 0x0111
+
+#define GB_HID_REPORT_ID_KEYBOARD 0x01
+#define GB_HID_REPORT_ID_MOUSE    0x02
+
+#define GB_HID_MOTION_MAX INT16_MAX
+#define GB_HID_WHEEL_MAX  INT8_MAX
+
+/* A boot keyboard and a three button mouse with a wheel, told apart by report ID */
+static const uint8_t gb_hid_report_desc[] = {
+	0x05, 0x01,       /* Usage Page (Generic Desktop) */
+	0x09, 0x06,       /* Usage (Keyboard) */
+	0xa1, 0x01,       /* Collection (Application) */
+	0x85, 0x01,       /*   Report ID (1) */
+	0x05, 0x07,       /*   Usage Page (Keyboard) */
+	0x19, 0xe0,       /*   Usage Minimum (Left Control) */
+	0x29, 0xe7,       /*   Usage Maximum (Right GUI) */
+	0x15, 0x00,       /*   Logical Minimum (0) */
+	0x25, 0x01,       /*   Logical Maximum (1) */
+	0x75, 0x01,       /*   Report Size (1) */
+	0x95, 0x08,       /*   Report Count (8) */
+	0x81, 0x02,       /*   Input (Data, Variable, Absolute) */
+	0x75, 0x08,       /*   Report Size (8) */
+	0x95, 0x01,       /*   Report Count (1) */
+	0x81, 0x01,       /*   Input (Constant) */
+	0x19, 0x00,       /*   Usage Minimum (0) */
+	0x29, 0xff,       /*   Usage Maximum (255) */
+	0x15, 0x00,       /*   Logical Minimum (0) */
+	0x26, 0xff, 0x00, /*   Logical Maximum (255) */
+	0x75, 0x08,       /*   Report Size (8) */
+	0x95, 0x06,       /*   Report Count (6) */
+	0x81, 0x00,       /*   Input (Data, Array) */
+	0xc0,             /* End Collection */
+	0x05, 0x01,       /* Usage Page (Generic Desktop) */
+	0x09, 0x02,       /* Usage (Mouse) */
+	0xa1, 0x01,       /* Collection (Application) */
+	0x85, 0x02,       /*   Report ID (2) */
+	0x09, 0x01,       /*   Usage (Pointer) */
+	0xa1, 0x00,       /*   Collection (Physical) */
+	0x05, 0x09,       /*     Usage Page (Button) */
+	0x19, 0x01,       /*     Usage Minimum (1) */
+	0x29, 0x03,       /*     Usage Maximum (3) */
+	0x15, 0x00,       /*     Logical Minimum (0) */
+	0x25, 0x01,       /*     Logical Maximum (1) */
+	0x75, 0x01,       /*     Report Size (1) */
+	0x95, 0x03,       /*     Report Count (3) */
+	0x81, 0x02,       /*     Input (Data, Variable, Absolute) */
+	0x75, 0x05,       /*     Report Size (5) */
+	0x95, 0x01,       /*     Report Count (1) */
+	0x81, 0x01,       /*     Input (Constant) */
+	0x05, 0x01,       /*     Usage Page (Generic Desktop) */
+	0x09, 0x30,       /*     Usage (X) */
+	0x09, 0x31,       /*     Usage (Y) */
+	0x16, 0x01, 0x80, /*     Logical Minimum (-32767) */
+	0x26, 0xff, 0x7f, /*     Logical Maximum (32767) */
+	0x75, 0x10,       /*     Report Size (16) */
+	0x95, 0x02,       /*     Report Count (2) */
+	0x81, 0x06,       /*     Input (Data, Variable, Relative) */
+	0x09, 0x38,       /*     Usage (Wheel) */
+	0x15, 0x81,       /*     Logical Minimum (-127) */
+	0x25, 0x7f,       /*     Logical Maximum (127) */
+	0x75, 0x08,       /*     Report Size (8) */
+	0x95, 0x01,       /*     Report Count (1) */
+	0x81, 0x06,       /*     Input (Data, Variable, Relative) */
+	0xc0,             /*   End Collection */
+	0xc0,             /* End Collection */
 };
 
-/**
- * The structure for protocol private data
- */
-struct gb_hid_info {
-	/** assigned CPort number */
-	uint16_t cport;
-
-	/** HID device of report descriptor length */
-	uint16_t report_desc_len;
-
-	/** available operation queue */
-	sq_queue_t free_queue;
-
-	/** received report data operation queue */
-	sq_queue_t data_queue;
-
-	/** operation node in receiving */
-	struct op_node *report_node;
-
-	/** buffer size in operation */
-	int report_buf_size;
-
-	/** amount of operations */
-	int entries;
-
-	/** flag to request free node for callback*/
-	int node_request;
-
-	/** semaphore for notifying input report data received */
-	sem_t active_sem;
-
-	/** Handler for report data receiver thread */
-	pthread_t pthread_handler;
-
-	/** inform the thread should be terminated */
-	int thread_stop;
-};
-
-/**
- * @brief Put the node back to queue.
- *
- * @param queue The target queue to put back.
- * @param node The pointer to a node that will be put.
- * @return None.
- */
-static void node_requeue(sq_queue_t *queue, struct op_node *node)
+static size_t gb_hid_report_len(uint8_t id)
 {
-	irqstate_t flags = irq_lock();
-
-	sq_addlast(&node->entry, queue);
-
-	irq_unlock(flags);
+	switch (id) {
+	case GB_HID_REPORT_ID_KEYBOARD:
+		return sizeof(struct gb_hid_keyboard_report);
+	case GB_HID_REPORT_ID_MOUSE:
+		return sizeof(struct gb_hid_mouse_report);
+	default:
+		return 0;
+	}
 }
 
-/**
- * @brief Get a node from the queue.
- *
- * @param queue The target queue.
- * @return A pointer to the node, NULL for no node to get.
- */
-static struct op_node *node_dequeue(sq_queue_t *queue)
+static k_timeout_t gb_hid_motion_delay(const struct gb_hid_driver_data *data)
 {
-	struct op_node *node = NULL;
-	irqstate_t flags = irq_lock();
+	int64_t remaining =
+		data->last_motion_ms + CONFIG_GREYBUS_HID_POLL_INTERVAL_MS - k_uptime_get();
 
-	if (sq_empty(queue)) {
-		irq_unlock(flags);
-		return NULL;
-	}
-
-	node = (struct op_node *)sq_remfirst(queue);
-	irq_unlock(flags);
-
-	return node;
+	return remaining > 0 ? K_MSEC(remaining) : K_NO_WAIT;
 }
 
-/**
- * @brief Get this firmware supported HID protocol version.
- *
- * This function is called when HID operates initialize in Greybus kernel.
- *
- * @param operation Pointer to structure of gb_operation.
- * @return GB_OP_SUCCESS on success, error code on failure
- */
-static uint8_t gb_hid_protocol_version(struct gb_operation *operation)
+/* Build a mouse report from the current buttons, consuming as much motion as it can carry */
+static void gb_hid_mouse_report_take_locked(struct gb_hid_driver_data *data,
+					    struct gb_hid_mouse_report *report)
 {
-	struct gb_hid_proto_version_response *response;
+	int32_t x = CLAMP(data->dx, -GB_HID_MOTION_MAX, GB_HID_MOTION_MAX);
+	int32_t y = CLAMP(data->dy, -GB_HID_MOTION_MAX, GB_HID_MOTION_MAX);
+	int32_t wheel = CLAMP(data->wheel, -GB_HID_WHEEL_MAX, GB_HID_WHEEL_MAX);
+
+	data->dx -= x;
+	data->dy -= y;
+	data->wheel -= wheel;
+	data->motion = data->dx || data->dy || data->wheel;
+	data->last_motion_ms = k_uptime_get();
+
+	report->id = GB_HID_REPORT_ID_MOUSE;
+	report->buttons = data->buttons;
+	report->x = (int16_t)sys_cpu_to_le16(x);
+	report->y = (int16_t)sys_cpu_to_le16(y);
+	report->wheel = wheel;
+}
 
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+static union gb_hid_report *gb_hid_queue_tail_locked(struct gb_hid_driver_data *data)
+{
+	if (data->queue_len == ARRAY_SIZE(data->queue)) {
+		return NULL;
 	}
 
-	response->major = GB_HID_VERSION_MAJOR;
-	response->minor = GB_HID_VERSION_MINOR;
-
-	return GB_OP_SUCCESS;
+	return &data->queue[(data->queue_head + data->queue_len++) % ARRAY_SIZE(data->queue)];
 }
 
-/**
- * @brief Returns HID Descriptor.
- *
- * This funtion get HID device of descriptor from low level driver.
- *
- * @param operation Pointer to structure of gb_operation.
- * @return GB_OP_SUCCESS on success, error code on failure
+/*
+ * Snapshot key and button changes into the queue, so that presses shorter than a poll interval
+ * still reach the AP. When the queue is full the change stays pending, and the latest state is
+ * sent once the queue drains.
  */
-static uint8_t gb_hid_get_descriptor(struct gb_operation *operation)
+static void gb_hid_changes_queue_locked(struct gb_hid_driver_data *data)
 {
-	struct gb_hid_desc_response *response;
-	struct hid_descriptor hid_desc;
-	struct gb_hid_info *hid_info;
-	struct gb_bundle *bundle;
-	int ret = 0;
-
-	bundle = gb_operation_get_bundle(operation);
-	DEBUGASSERT(bundle);
-
-	hid_info = bundle->priv;
-
-	if (!hid_info || !bundle->dev) {
-		return GB_OP_UNKNOWN_ERROR;
-	}
+	union gb_hid_report *report;
 
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	if (data->keyboard_changed) {
+		report = gb_hid_queue_tail_locked(data);
+		if (report) {
+			report->keyboard = data->keyboard;
+			data->keyboard_changed = false;
+		}
 	}
 
-	ret = device_hid_get_descriptor(bundle->dev, &hid_desc);
-	if (ret) {
-		return GB_OP_UNKNOWN_ERROR;
+	if (data->buttons_changed) {
+		report = gb_hid_queue_tail_locked(data);
+		if (report) {
+			gb_hid_mouse_report_take_locked(data, &report->mouse);
+			data->buttons_changed = false;
+		}
 	}
-
-	response->length = hid_desc.length;
-	response->report_desc_length = sys_cpu_to_le16(hid_desc.report_desc_length);
-	response->hid_version = sys_cpu_to_le16(hid_desc.hid_version);
-	response->product_id = sys_cpu_to_le16(hid_desc.product_id);
-	response->vendor_id = sys_cpu_to_le16(hid_desc.vendor_id);
-	response->country_code = hid_desc.country_code;
-
-	hid_info->report_desc_len = hid_desc.report_desc_length;
-
-	return GB_OP_SUCCESS;
 }
 
-/**
- * @brief Returns a HID Report Descriptor.
- *
- * This funtion get HID device of report descriptor from low level driver.
- *
- * @param operation Pointer to structure of gb_operation.
- * @return GB_OP_SUCCESS on success, error code on failure
- */
-static uint8_t gb_hid_get_report_descriptor(struct gb_operation *operation)
+/* Returns the length of the next report to send, or 0 if there is none yet */
+static size_t gb_hid_report_next_locked(struct gb_hid_driver_data *data,
+					union gb_hid_report *report)
 {
-	struct gb_hid_info *hid_info;
-	struct gb_bundle *bundle;
-	uint8_t *response;
-	int ret = 0;
+	k_timeout_t delay;
 
-	bundle = gb_operation_get_bundle(operation);
-	DEBUGASSERT(bundle);
+	if (!data->powered) {
+		return 0;
+	}
 
-	hid_info = bundle->priv;
+	gb_hid_changes_queue_locked(data);
 
-	if (!hid_info || !bundle->dev) {
-		return GB_OP_UNKNOWN_ERROR;
+	if (data->queue_len) {
+		*report = data->queue[data->queue_head];
+		data->queue_head = (data->queue_head + 1) % ARRAY_SIZE(data->queue);
+		data->queue_len--;
+		return gb_hid_report_len(report->id);
 	}
 
-	response = gb_operation_alloc_response(operation, hid_info->report_desc_len);
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	if (!data->motion) {
+		return 0;
 	}
 
-	ret = device_hid_get_report_descriptor(bundle->dev, response);
-	if (ret) {
-		return GB_OP_UNKNOWN_ERROR;
+	delay = gb_hid_motion_delay(data);
+	if (!K_TIMEOUT_EQ(delay, K_NO_WAIT)) {
+		k_work_schedule(&data->tx_work, delay);
+		return 0;
 	}
 
-	return GB_OP_SUCCESS;
+	gb_hid_mouse_report_take_locked(data, &report->mouse);
+	return sizeof(report->mouse);
 }
 
-/**
- * @brief Power-on the HID device.
- *
- * @param operation Pointer to structure of gb_operation.
- * @return GB_OP_SUCCESS on success, error code on failure
- */
-static uint8_t gb_hid_power_on(struct gb_operation *operation)
+static void gb_hid_report_send(const struct gb_hid_driver_data *data,
+			       const union gb_hid_report *report, size_t len)
 {
-	struct gb_hid_info *hid_info;
-	struct gb_bundle *bundle;
-	int ret = 0;
-
-	bundle = gb_operation_get_bundle(operation);
-	DEBUGASSERT(bundle);
-
-	hid_info = bundle->priv;
+	struct gb_message *req =
+		gb_message_request_alloc_with_payload(report, len, GB_HID_TYPE_IRQ_EVENT, true);
 
-	if (!hid_info || !bundle->dev) {
-		return GB_OP_UNKNOWN_ERROR;
-	}
-
-	ret = device_hid_power_on(bundle->dev);
-	if (ret) {
-		return GB_OP_UNKNOWN_ERROR;
+	if (!req) {
+		return;
 	}
 
-	return GB_OP_SUCCESS;
+	gb_transport_message_send(req, data->cport);
+	gb_message_dealloc(req);
 }
 
-/**
- * @brief Power-off the HID device.
- *
- * @param operation Pointer to structure of gb_operation.
- * @return GB_OP_SUCCESS on success, error code on failure
- */
-static uint8_t gb_hid_power_off(struct gb_operation *operation)
+static void gb_hid_tx_work_handler(struct k_work *work)
 {
-	struct gb_hid_info *hid_info;
-	struct gb_bundle *bundle;
-	int ret = 0;
-
-	bundle = gb_operation_get_bundle(operation);
-	DEBUGASSERT(bundle);
-
-	hid_info = bundle->priv;
-
-	if (!hid_info || !bundle->dev) {
-		return GB_OP_UNKNOWN_ERROR;
-	}
+	size_t len;
+	k_spinlock_key_t key;
+	union gb_hid_report report;
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct gb_hid_driver_data *data = CONTAINER_OF(dwork, struct gb_hid_driver_data, tx_work);
+
+	while (true) {
+		key = k_spin_lock(&data->lock);
+		len = gb_hid_report_next_locked(data, &report);
+		k_spin_unlock(&data->lock, key);
+
+		if (!len) {
+			return;
+		}
 
-	ret = device_hid_power_off(bundle->dev);
-	if (ret) {
-		return GB_OP_UNKNOWN_ERROR;
+		gb_hid_report_send(data, &report, len);
 	}
-
-	return GB_OP_SUCCESS;
 }
 
-/**
- * @brief Gets report from device.
- *
- * This function get HID report from low level driver in synchronously. The
- * report type can be " Input Report" or "Feature Report". The function calls
- * device_hid_get_report_length() to get report length for response buffer
- * creation, depend on request of "report_id" value, the reponse buffer
- * lenght has to extend 1 byte that if the "report_id" is non-zero.
- *
- * @param operation Pointer to structure of gb_operation.
- * @return GB_OP_SUCCESS on success, error code on failure
- */
-static uint8_t gb_hid_get_report(struct gb_operation *operation)
+static bool gb_hid_keyboard_key_set(struct gb_hid_keyboard_report *report, uint8_t usage,
+				    bool pressed)
 {
-	struct gb_hid_get_report_request *request;
-	struct gb_bundle *bundle;
-	uint8_t *response;
-	uint16_t report_len;
-	int ret = 0;
-
-	bundle = gb_operation_get_bundle(operation);
-	request = gb_operation_get_request_payload(operation);
+	size_t i;
 
-	DEBUGASSERT(bundle);
-
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return GB_OP_INVALID;
+	for (i = 0; i < ARRAY_SIZE(report->keys); i++) {
+		if (report->keys[i] == usage) {
+			break;
+		}
 	}
 
-	ret = device_hid_get_report_length(bundle->dev, request->report_type, request->report_id);
-
-	if (ret <= 0) {
-		return GB_OP_UNKNOWN_ERROR;
-	}
+	if (pressed) {
+		if (i < ARRAY_SIZE(report->keys)) {
+			return false;
+		}
 
-	report_len = ret;
+		for (i = 0; i < ARRAY_SIZE(report->keys); i++) {
+			if (!report->keys[i]) {
+				report->keys[i] = usage;
+				return true;
+			}
+		}
 
-	/**
-	 * If the report_id is not '0', the report data will extend one byte data
-	 * for ID.
-	 */
-	if (request->report_id > 0) {
-		report_len += 1;
+		/* Keys beyond the boot protocol rollover are ignored */
+		return false;
 	}
 
-	response = gb_operation_alloc_response(operation, report_len);
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	if (i == ARRAY_SIZE(report->keys)) {
+		return false;
 	}
 
-	ret = device_hid_get_report(bundle->dev, request->report_type, request->report_id, response,
-				    report_len);
-	if (ret) {
-		return GB_OP_UNKNOWN_ERROR;
-	}
+	memmove(&report->keys[i], &report->keys[i + 1], ARRAY_SIZE(report->keys) - i - 1);
+	report->keys[ARRAY_SIZE(report->keys) - 1] = 0;
 
-	return GB_OP_SUCCESS;
+	return true;
 }
 
-/**
- * @brief Set HID report.
- *
- * This function send Output or Feature report to low level HID driver.
- *
- * @param operation Pointer to structure of gb_operation.
- * @return GB_OP_SUCCESS on success, error code on failure
- */
-static uint8_t gb_hid_set_report(struct gb_operation *operation)
+static void gb_hid_key_update_locked(struct gb_hid_driver_data *data, uint16_t code, bool pressed)
 {
-	struct gb_hid_set_report_request *request;
-	struct gb_bundle *bundle;
-	uint16_t report_len;
-	int ret = 0;
-
-	bundle = gb_operation_get_bundle(operation);
-	request = gb_operation_get_request_payload(operation);
-
-	DEBUGASSERT(bundle);
-
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return GB_OP_INVALID;
+	int16_t usage;
+	uint8_t modifier;
+	uint8_t button;
+
+	switch (code) {
+	case INPUT_BTN_LEFT:
+		button = BIT(0);
+		break;
+	case INPUT_BTN_RIGHT:
+		button = BIT(1);
+		break;
+	case INPUT_BTN_MIDDLE:
+		button = BIT(2);
+		break;
+	default:
+		button = 0;
 	}
 
-	report_len =
-		device_hid_get_report_length(bundle->dev, request->report_type, request->report_id);
-	if (report_len <= 0) {
-		return GB_OP_UNKNOWN_ERROR;
+	if (button) {
+		data->buttons = pressed ? (data->buttons | button) : (data->buttons & ~button);
+		data->buttons_changed = true;
+		return;
 	}
 
-	ret = device_hid_set_report(bundle->dev, request->report_type, request->report_id,
-				    request->report, report_len);
-	if (ret) {
-		return GB_OP_UNKNOWN_ERROR;
+	modifier = input_to_hid_modifier(code);
+	if (modifier) {
+		data->keyboard.modifiers = pressed ? (data->keyboard.modifiers | modifier)
+						   : (data->keyboard.modifiers & ~modifier);
+		data->keyboard_changed = true;
+		return;
 	}
 
-	return GB_OP_SUCCESS;
+	usage = input_to_hid_code(code);
+	if (usage > 0 && gb_hid_keyboard_key_set(&data->keyboard, usage, pressed)) {
+		data->keyboard_changed = true;
+	}
 }
 
-/**
- * @brief Callback for data receiving
- *
- * This callback provide a function call for HID device driver to notify
- * protocol when device driver received a data stream.
- * It put the current operation node to data queue and set free operation
- * node for next receiving activte. Finally, active the report_proc_thread to
- * process IRQ Event request protocol.
- *
- * @param dev Pointer to structure of device data.
- * @param data Pointer to struct gb_hid_info.
- * @param report_type HID report type.
- * @param report Pointer to a received data buffer.
- * @param len Returned buffer lenght.
- * @return None.
- */
-static int hid_event_callback_routine(struct device *dev, void *data, uint8_t report_type,
-				      uint8_t *report, uint16_t len)
+static void gb_hid_rel_update_locked(struct gb_hid_driver_data *data, uint16_t code,
+				     int32_t value)
 {
-	struct gb_hid_info *hid_info;
-	struct op_node *node;
-
-	DEBUGASSERT(data);
-	hid_info = data;
-
-	if (!hid_info->report_node) {
-		/**
-		 * active report_proc_thread to send operation for node free
-		 */
-		sem_post(&hid_info->active_sem);
-		return -ENOMEM;
-	}
-
-	if (hid_info->report_buf_size != len) {
-		return -EINVAL;
-	}
-
-	memcpy(hid_info->report_node->buffer, report, len);
-
-	node_requeue(&hid_info->data_queue, hid_info->report_node);
-
-	node = node_dequeue(&hid_info->free_queue);
-	if (!node) {
-		hid_info->node_request = 1;
-		/**
-		 * event no free node, we still need active thread to process data
-		 * queue.
-		 */
+	switch (code) {
+	case INPUT_REL_X:
+		data->dx += value;
+		break;
+	case INPUT_REL_Y:
+		data->dy += value;
+		break;
+	case INPUT_REL_WHEEL:
+		data->wheel += value;
+		break;
+	default:
+		return;
 	}
 
-	hid_info->report_node = node;
-
-	sem_post(&hid_info->active_sem);
-
-	return 0;
+	data->motion = true;
 }
 
-/**
- * @brief Data receiving process thread
- *
- * This function is the thread for processing data receiving tasks. When
- * it was be activated, it checks the receiving queue for processing the come
- * in data.
- *
- * @param data The regular thread data.
- * @return None.
+/*
+ * Called by the input subsystem, possibly from an ISR. Events only update the report state, which
+ * the transmit work sends. Key and button changes are sent right away, while relative motion is
+ * accumulated and sent at most once per CONFIG_GREYBUS_HID_POLL_INTERVAL_MS.
  */
-static void *report_proc_thread(void *data)
+void gb_hid_input_cb(struct input_event *evt, void *user_data)
 {
-	struct gb_hid_info *hid_info = data;
-	struct op_node *node = NULL;
-	int ret;
+	struct gb_hid_driver_data *data = user_data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
 
-	while (1) {
-		sem_wait(&hid_info->active_sem);
+	if (!data->powered) {
+		goto unlock;
+	}
 
-		if (hid_info->thread_stop) {
-			break;
-		}
+	switch (evt->type) {
+	case INPUT_EV_KEY:
+		gb_hid_key_update_locked(data, evt->code, evt->value);
+		break;
+	case INPUT_EV_REL:
+		gb_hid_rel_update_locked(data, evt->code, evt->value);
+		break;
+	default:
+		goto unlock;
+	}
 
-		node = node_dequeue(&hid_info->data_queue);
-		if (node) {
-			ret = gb_operation_send_request(node->operation, false);
-			if (ret) {
-				LOG_INF("IRQ Event operation failed (%x)!", ret);
-			}
-			node_requeue(&hid_info->free_queue, node);
-		}
+	if (!evt->sync) {
+		goto unlock;
+	}
 
-		if (hid_info->node_request) {
-			node = node_dequeue(&hid_info->free_queue);
-			hid_info->report_node = node;
-			hid_info->node_request = 0;
-		}
+	gb_hid_changes_queue_locked(data);
+	if (data->queue_len) {
+		k_work_reschedule(&data->tx_work, K_NO_WAIT);
+	} else if (data->motion) {
+		k_work_schedule(&data->tx_work, gb_hid_motion_delay(data));
 	}
 
-	return NULL;
+unlock:
+	k_spin_unlock(&data->lock, key);
 }
 
-/**
- * @brief Free operations
- *
- * This funciton destroy operations and node memory.
- *
- * @param queue Target queue.
- * @return None.
- */
-static void hid_free_op(sq_queue_t *queue)
+static void gb_hid_get_desc(uint16_t cport, struct gb_message *req,
+			    const struct gb_hid_driver_data *data)
 {
-	struct op_node *node = NULL;
-
-	node = node_dequeue(queue);
-	while (node) {
-		gb_operation_destroy(node->operation);
-		free(node);
-		node = node_dequeue(queue);
-	}
+	const struct gb_hid_desc_response resp_data = {
+		.bLength = sizeof(resp_data),
+		.wReportDescLength = sys_cpu_to_le16(sizeof(gb_hid_report_desc)),
+		.bcdHID = sys_cpu_to_le16(GB_HID_VERSION_BCD),
+		.wProductID = sys_cpu_to_le16(data->product_id),
+		.wVendorID = sys_cpu_to_le16(data->vendor_id),
+		.bCountryCode = 0,
+	};
+
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-/**
- * @brief Allocate operations for receiver buffers
- *
- * This function is allocating operation and use them as receiving buffers.
- *
- * @param max_nodes Maximum nodes.
- * @param buf_size Buffer size in operation.
- * @param queue Target queue.
- * @return 0 for success, -errno for failures.
- */
-static int hid_alloc_op(int cport, int max_nodes, int buf_size, sq_queue_t *queue)
+static void gb_hid_get_report_desc(uint16_t cport, struct gb_message *req)
 {
-	struct gb_operation *operation = NULL;
-	struct gb_hid_input_report_request *request = NULL;
-	struct op_node *node = NULL;
-	int i = 0;
-
-	for (i = 0; i < max_nodes; i++) {
-		operation = gb_operation_create(cport, GB_HID_TYPE_IRQ_EVENT, buf_size);
-		if (!operation) {
-			goto err_free_op;
-		}
-
-		node = zalloc(sizeof(struct op_node));
-		if (!node) {
-			gb_operation_destroy(operation);
-			goto err_free_op;
-		}
-		node->operation = operation;
-
-		request = gb_operation_get_request_payload(operation);
-		node->buffer = request->report;
-		node_requeue(queue, node);
-	}
-
-	return 0;
-
-err_free_op:
-	hid_free_op(queue);
-
-	return -ENOMEM;
+	gb_transport_message_response_success_send(req, gb_hid_report_desc,
+						   sizeof(gb_hid_report_desc), cport);
 }
 
-/**
- * @brief Receiving data process initialization
- *
- * This function allocates OS resource to support the data receiving
- * function. It allocates two types of operations for undetermined length of
- * data. The semaphore works as message queue and all tasks are done in the
- * thread.
- *
- * @param None.
- * @return 0 for success, -errno for failures.
- */
-static int hid_receiver_callback_init(struct gb_hid_info *hid_info)
+static void gb_hid_power_on(uint16_t cport, struct gb_message *req,
+			    struct gb_hid_driver_data *data)
 {
-	int ret;
-
-	sq_init(&hid_info->free_queue);
-	sq_init(&hid_info->data_queue);
-
-	hid_info->entries = MAX_REPORT_OPERATIONS;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
 
-	ret = hid_alloc_op(hid_info->cport, hid_info->entries, hid_info->report_buf_size,
-			   &hid_info->free_queue);
-	if (ret) {
-		return ret;
-	}
-
-	ret = sem_init(&hid_info->active_sem, 0, 0);
-	if (ret) {
-		goto err_free_data_op;
-	}
+	data->powered = true;
+	k_spin_unlock(&data->lock, key);
 
-	ret = pthread_create(&hid_info->pthread_handler, NULL, report_proc_thread, hid_info);
-	if (ret) {
-		goto err_destroy_active_sem;
-	}
-
-	return 0;
-
-err_destroy_active_sem:
-	sem_destroy(&hid_info->active_sem);
-err_free_data_op:
-	hid_free_op(&hid_info->free_queue);
-
-	return -ret;
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
 }
 
-/**
- * @brief Releases resources for receiver thread.
- *
- * Terminates the thread for receiver, releases the system resouces and
- * operations allocated by hid_receiver_callback_init().
- *
- * @param None.
- * @return None.
- */
-static void hid_receiver_callback_deinit(struct gb_hid_info *hid_info)
+/* Drop everything not sent yet, keys held now are reported again on the next change */
+static void gb_hid_power_off_locked(struct gb_hid_driver_data *data)
 {
-	if (hid_info->pthread_handler != (pthread_t)0) {
-		hid_info->thread_stop = 1;
-		sem_post(&hid_info->active_sem);
-		pthread_join(hid_info->pthread_handler, NULL);
-	}
-
-	sem_destroy(&hid_info->active_sem);
-
-	hid_free_op(&hid_info->data_queue);
-	hid_free_op(&hid_info->free_queue);
+	data->powered = false;
+	data->queue_head = 0;
+	data->queue_len = 0;
+	data->keyboard_changed = false;
+	data->buttons_changed = false;
+	data->motion = false;
+	data->dx = 0;
+	data->dy = 0;
+	data->wheel = 0;
 }
 
-/**
- * @brief Greybus HID protocol initialize function
- *
- * @param cport CPort number
- * @param bundle Greybus bundle handle
- * @return 0 on success, negative errno on error
- */
-static int gb_hid_init(unsigned int cport, struct gb_bundle *bundle)
+static void gb_hid_power_off(uint16_t cport, struct gb_message *req,
+			     struct gb_hid_driver_data *data)
 {
-	struct gb_hid_info *hid_info;
-	int ret;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
 
-	DEBUGASSERT(bundle);
+	gb_hid_power_off_locked(data);
+	k_spin_unlock(&data->lock, key);
 
-	hid_info = zalloc(sizeof(*hid_info));
-	if (!hid_info) {
-		return -ENOMEM;
-	}
-
-	hid_info->cport = cport;
+	k_work_cancel_delayable(&data->tx_work);
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
 
-	bundle->dev = device_open(DEVICE_TYPE_HID_HW, 0);
-	if (!bundle->dev) {
-		LOG_INF("failed to open HID device!");
-		ret = -EIO;
-		goto err_hid_init;
-	}
+static void gb_hid_get_report(uint16_t cport, struct gb_message *req,
+			      struct gb_hid_driver_data *data)
+{
+	k_spinlock_key_t key;
+	union gb_hid_report report = {0};
+	size_t len;
+	const struct gb_hid_get_report_request *req_data =
+		(const struct gb_hid_get_report_request *)req->payload;
 
-	ret = device_hid_get_max_report_length(bundle->dev, GB_HID_INPUT_REPORT);
-	if (ret < 0) {
-		goto err_device_close;
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	hid_info->report_buf_size = ret;
-
-	ret = hid_receiver_callback_init(hid_info);
-	if (ret) {
-		goto err_device_close;
+	/* There are no output or feature reports */
+	len = gb_hid_report_len(req_data->report_id);
+	if (req_data->report_type != GB_HID_INPUT_REPORT || !len) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	/* Get first node pointer */
-	hid_info->report_node = node_dequeue(&hid_info->free_queue);
-	hid_info->node_request = 0;
-
-	ret = device_hid_register_callback(bundle->dev, hid_info, hid_event_callback_routine);
-	if (ret) {
-		goto err_hid_receiver_cb_deinit;
+	key = k_spin_lock(&data->lock);
+	if (req_data->report_id == GB_HID_REPORT_ID_KEYBOARD) {
+		report.keyboard = data->keyboard;
+	} else {
+		report.mouse.id = GB_HID_REPORT_ID_MOUSE;
+		report.mouse.buttons = data->buttons;
 	}
+	k_spin_unlock(&data->lock, key);
 
-	bundle->priv = hid_info;
-
-	return 0;
-
-err_hid_receiver_cb_deinit:
-	hid_receiver_callback_deinit(hid_info);
-err_device_close:
-	device_close(bundle->dev);
-err_hid_init:
-	free(hid_info);
-
-	return ret;
+	gb_transport_message_response_success_send(req, &report, len, cport);
 }
 
-/**
- * @brief Greybus HID protocol deinitialize function
- *
- * @param cport CPort number
- * @param bundle Greybus bundle handle
- */
-static void gb_hid_exit(unsigned int cport, struct gb_bundle *bundle)
+static void gb_hid_handler(const void *priv, struct gb_message *msg, uint16_t cport)
 {
-	struct gb_hid_info *hid_info;
-
-	DEBUGASSERT(bundle);
-	hid_info = bundle->priv;
-
-	if (!hid_info) {
-		return;
-	}
-
-	device_hid_unregister_callback(bundle->dev);
+	struct gb_hid_driver_data *data = (struct gb_hid_driver_data *)priv;
 
-	hid_receiver_callback_deinit(hid_info);
-
-	device_close(bundle->dev);
-
-	free(hid_info);
-	hid_info = NULL;
-}
-
-/**
- * @brief Greybus HID protocol operation handler
- */
-static uint8_t gb_hid_handler(uint8_t type, struct gb_operation *opr)
-{
-	switch (type) {
-	case GB_HID_TYPE_PROTOCOL_VERSION:
-		return gb_hid_protocol_version(opr);
+	switch (gb_message_type(msg)) {
 	case GB_HID_TYPE_GET_DESC:
-		return gb_hid_get_descriptor(opr);
+		return gb_hid_get_desc(cport, msg, data);
 	case GB_HID_TYPE_GET_REPORT_DESC:
-		return gb_hid_get_report_descriptor(opr);
+		return gb_hid_get_report_desc(cport, msg);
 	case GB_HID_TYPE_PWR_ON:
-		return gb_hid_power_on(opr);
+		return gb_hid_power_on(cport, msg, data);
 	case GB_HID_TYPE_PWR_OFF:
-		return gb_hid_power_off(opr);
+		return gb_hid_power_off(cport, msg, data);
 	case GB_HID_TYPE_GET_REPORT:
-		return gb_hid_get_report(opr);
+		return gb_hid_get_report(cport, msg, data);
 	case GB_HID_TYPE_SET_REPORT:
-		return gb_hid_set_report(opr);
+		/* There are no output or feature reports */
 	default:
 		LOG_ERR("Invalid type");
-		return GB_OP_INVALID;
+		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
 	}
 }
 
-static struct gb_driver gb_hid_driver = {
-	.init = gb_hid_init,
-	.exit = gb_hid_exit,
-	.op_handler = gb_hid_handler,
-};
+static void gb_hid_connected(const void *priv, uint16_t cport)
+{
+	struct gb_hid_driver_data *data = (struct gb_hid_driver_data *)priv;
 
-/**
- * @brief Register Greybus HID protocol
- *
- * @param cport CPort number
- * @param bundle Bundle number.
- */
-void gb_hid_register(int cport, int bundle)
+	data->cport = cport;
+	k_work_init_delayable(&data->tx_work, gb_hid_tx_work_handler);
+}
+
+static void gb_hid_disconnected(const void *priv)
 {
-	gb_register_driver(cport, bundle, &gb_hid_driver);
+	struct k_work_sync sync;
+	struct gb_hid_driver_data *data = (struct gb_hid_driver_data *)priv;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	gb_hid_power_off_locked(data);
+	k_spin_unlock(&data->lock, key);
+
+	/* The work is initialized again on the next connection */
+	k_work_cancel_delayable_sync(&data->tx_work, &sync);
 }
+
+const struct gb_driver gb_hid_driver = {
+	.connected = gb_hid_connected,
+	.disconnected = gb_hid_disconnected,
+	.op_handler = gb_hid_handler,
+};
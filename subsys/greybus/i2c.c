@@ -35,10 +35,11 @@
 #include <zephyr/logging/log.h>
 #include "greybus_transport.h"
 #include "greybus_internal.h"
+#include "greybus_heap.h"
 
 LOG_MODULE_REGISTER(greybus_i2c, CONFIG_GREYBUS_LOG_LEVEL);
 
-static void gb_i2c_protocol_functionality(uint16_t cport, struct gb_message *req)
+static void gb_i2c_protocol_functionality(const void *priv, struct gb_message *req, uint16_t cport)
 {
 	const struct gb_i2c_functionality_response resp_data = {
 		.functionality =
@@ -52,84 +53,282 @@ static void gb_i2c_protocol_functionality(uint16_t cport, struct gb_message *req
 	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-static void gb_i2c_protocol_transfer(uint16_t cport, struct gb_message *req,
-				     const struct device *dev)
+/*
+ * Ops targeting the same address are executed with a single transfer, so that every op after the
+ * first starts with a repeated start instead of a STOP/START pair.
+ */
+static void gb_i2c_ops_flags(struct i2c_msg *msgs, size_t num)
+{
+	size_t i;
+
+	for (i = 1; i < num; i++) {
+		msgs[i].flags |= I2C_MSG_RESTART;
+	}
+	msgs[num - 1].flags |= I2C_MSG_STOP;
+}
+
+/* i2c_transfer() takes a single address, so split where the address changes */
+static size_t gb_i2c_segment_end(const struct gb_i2c_transfer_request *req_data, size_t start)
+{
+	const size_t op_count = sys_le16_to_cpu(req_data->op_count);
+	size_t i;
+
+	for (i = start + 1; i < op_count && req_data->ops[i].addr == req_data->ops[start].addr;
+	     i++) {
+	}
+
+	return i;
+}
+
+/*
+ * Helper to validate a transfer request, allocate its response and fill msgs. Read ops point
+ * into the response payload and write ops into the request.
+ *
+ * @return GB_OP_SUCCESS, or the result to respond with
+ */
+static uint8_t gb_i2c_transfer_prepare(struct gb_message *req, struct i2c_msg *msgs,
+				       struct gb_message **resp)
 {
 	const struct gb_i2c_transfer_op *desc;
 	const uint8_t *write_data;
 	uint8_t *read_data;
 	const struct gb_i2c_transfer_request *req_data =
 		(const struct gb_i2c_transfer_request *)req->payload;
-	struct gb_message *resp;
-	size_t i, resp_size = 0;
-	uint16_t op_size, addr, op_count;
-	int ret;
+	size_t i, resp_size = 0, write_size = 0;
+	uint16_t op_size, op_count;
 
 	op_count = sys_le16_to_cpu(req_data->op_count);
+	if (op_count == 0 || op_count > CONFIG_GREYBUS_I2C_MAX_OPS) {
+		LOG_ERR("Unsupported op count: %u", op_count);
+		return GB_OP_INVALID;
+	}
+
 	write_data = (const uint8_t *)&req_data->ops[op_count];
 
 	for (i = 0; i < op_count; i++) {
 		desc = &req_data->ops[i];
 		if (desc->flags & GB_I2C_M_RD) {
 			resp_size += sys_le16_to_cpu(desc->size);
+		} else {
+			write_size += sys_le16_to_cpu(desc->size);
 		}
 	}
 
-	resp = gb_message_alloc(resp_size, GB_RESPONSE(req->header.type), req->header.operation_id,
-				GB_OP_SUCCESS);
-	if (!resp) {
+	if (gb_message_payload_len(req) <
+	    sizeof(*req_data) + op_count * sizeof(*desc) + write_size) {
+		LOG_ERR("dropping short message");
+		return GB_OP_INVALID;
+	}
+
+	*resp = gb_message_alloc(resp_size, GB_RESPONSE(req->header.type), req->header.operation_id,
+				 GB_OP_SUCCESS);
+	if (!*resp) {
 		LOG_ERR("Failed to allocate response");
-		return gb_transport_message_empty_response_send(req, GB_OP_NO_MEMORY, cport);
+		return GB_OP_NO_MEMORY;
 	}
-	read_data = resp->payload;
+	read_data = (*resp)->payload;
 
 	for (i = 0; i < op_count; i++) {
 		desc = &req_data->ops[i];
 		op_size = sys_le16_to_cpu(desc->size);
-		addr = sys_le16_to_cpu(desc->addr);
 
+		msgs[i].len = op_size;
 		if (desc->flags & GB_I2C_M_RD) {
-			ret = i2c_read(dev, read_data, op_size, desc->addr);
-			if (ret < 0) {
-				LOG_ERR("Failed to read i2c data");
-				ret = gb_errno_to_op_result(ret);
-				goto free_msg;
-			}
+			msgs[i].buf = read_data;
+			msgs[i].flags = I2C_MSG_READ;
 			read_data += op_size;
 		} else {
-			ret = i2c_write(dev, write_data, op_size, desc->addr);
-			if (ret < 0) {
-				LOG_ERR("Failed to write i2c data");
-				ret = gb_errno_to_op_result(ret);
-				goto free_msg;
-			}
+			/* i2c_msg buffers are not const, but writes do not modify them */
+			msgs[i].buf = (uint8_t *)write_data;
+			msgs[i].flags = I2C_MSG_WRITE;
 			write_data += op_size;
 		}
 	}
 
-	gb_transport_message_send(resp, cport);
-	return gb_message_dealloc(resp);
+	return GB_OP_SUCCESS;
+}
 
-free_msg:
-	gb_message_dealloc(resp);
-	return gb_transport_message_empty_response_send(req, ret, cport);
+#ifdef CONFIG_GREYBUS_I2C_ASYNC
+
+/*
+ * struct gb_i2c_async: Transfer running in the background
+ *
+ * @work: continues the transfer in thread context once a segment completed
+ * @dev: I2C controller
+ * @req: transfer request, owned until the response is sent
+ * @resp: response holding the read data
+ * @cport: cport of the request
+ * @start: first op of the running segment
+ * @end: op after the running segment
+ * @result: result of the running segment
+ * @msgs: ops of the request
+ */
+struct gb_i2c_async {
+	struct k_work work;
+	const struct device *dev;
+	struct gb_message *req;
+	struct gb_message *resp;
+	uint16_t cport;
+	size_t start;
+	size_t end;
+	int result;
+	struct i2c_msg msgs[CONFIG_GREYBUS_I2C_MAX_OPS];
+};
+
+static void gb_i2c_async_callback(const struct device *dev, int result, void *data)
+{
+	struct gb_i2c_async *ctx = data;
+
+	ctx->result = result;
+	gb_operation_deferred_submit(&ctx->work);
 }
 
-static void gb_i2c_handler(const void *priv, struct gb_message *msg, uint16_t cport)
+/*
+ * Helper to start the remaining segments. Controllers without callback support run them right
+ * away.
+ *
+ * @return -EINPROGRESS if a segment is running, 0 once all are done, or the transfer error
+ */
+static int gb_i2c_async_run(struct gb_i2c_async *ctx)
+{
+	const struct gb_i2c_transfer_request *req_data =
+		(const struct gb_i2c_transfer_request *)ctx->req->payload;
+	const size_t op_count = sys_le16_to_cpu(req_data->op_count);
+	struct i2c_msg *msgs;
+	uint16_t addr;
+	int ret;
+
+	for (; ctx->start < op_count; ctx->start = ctx->end) {
+		ctx->end = gb_i2c_segment_end(req_data, ctx->start);
+		msgs = &ctx->msgs[ctx->start];
+		addr = sys_le16_to_cpu(req_data->ops[ctx->start].addr);
+		gb_i2c_ops_flags(msgs, ctx->end - ctx->start);
+
+		ret = i2c_transfer_cb(ctx->dev, msgs, ctx->end - ctx->start, addr,
+				      gb_i2c_async_callback, ctx);
+		if (ret == 0) {
+			return -EINPROGRESS;
+		}
+		if (ret == -ENOSYS) {
+			ret = i2c_transfer(ctx->dev, msgs, ctx->end - ctx->start, addr);
+		}
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void gb_i2c_async_finish(struct gb_i2c_async *ctx, int ret)
+{
+	const uint16_t cport = ctx->cport;
+
+	if (ret < 0) {
+		LOG_ERR("Failed to transfer i2c data: %d", ret);
+		gb_transport_message_empty_response_send(ctx->req, gb_errno_to_op_result(ret),
+							 cport);
+	} else {
+		gb_transport_message_send(ctx->resp, cport);
+		gb_message_dealloc(ctx->req);
+	}
+
+	gb_message_dealloc(ctx->resp);
+	gb_free(ctx);
+	gb_operation_deferred_done(cport);
+}
+
+static void gb_i2c_async_work_handler(struct k_work *work)
+{
+	struct gb_i2c_async *ctx = CONTAINER_OF(work, struct gb_i2c_async, work);
+	int ret = ctx->result;
+
+	if (ret == 0) {
+		ctx->start = ctx->end;
+		ret = gb_i2c_async_run(ctx);
+	}
+
+	if (ret != -EINPROGRESS) {
+		gb_i2c_async_finish(ctx, ret);
+	}
+}
+
+/* The response is sent from the completion, so the worker can serve other buses meanwhile */
+static void gb_i2c_protocol_transfer(const void *priv, struct gb_message *req, uint16_t cport)
+{
+	struct gb_i2c_async *ctx = gb_alloc(sizeof(*ctx));
+	uint8_t status;
+	int ret;
+
+	if (!ctx) {
+		LOG_ERR("Failed to allocate transfer");
+		return gb_transport_message_empty_response_send(req, GB_OP_NO_MEMORY, cport);
+	}
+
+	status = gb_i2c_transfer_prepare(req, ctx->msgs, &ctx->resp);
+	if (status != GB_OP_SUCCESS) {
+		gb_free(ctx);
+		return gb_transport_message_empty_response_send(req, status, cport);
+	}
+
+	k_work_init(&ctx->work, gb_i2c_async_work_handler);
+	ctx->dev = priv;
+	ctx->req = req;
+	ctx->cport = cport;
+	ctx->start = 0;
+
+	gb_operation_defer(cport);
+	ret = gb_i2c_async_run(ctx);
+	if (ret != -EINPROGRESS) {
+		gb_i2c_async_finish(ctx, ret);
+	}
+}
+
+#else
+
+static void gb_i2c_protocol_transfer(const void *priv, struct gb_message *req, uint16_t cport)
 {
 	const struct device *dev = priv;
+	const struct gb_i2c_transfer_request *req_data =
+		(const struct gb_i2c_transfer_request *)req->payload;
+	struct i2c_msg msgs[CONFIG_GREYBUS_I2C_MAX_OPS];
+	struct gb_message *resp;
+	size_t start, end;
+	uint8_t status;
+	int ret;
+
+	status = gb_i2c_transfer_prepare(req, msgs, &resp);
+	if (status != GB_OP_SUCCESS) {
+		return gb_transport_message_empty_response_send(req, status, cport);
+	}
 
-	switch (gb_message_type(msg)) {
-	case GB_I2C_TYPE_FUNCTIONALITY:
-		return gb_i2c_protocol_functionality(cport, msg);
-	case GB_I2C_TYPE_TRANSFER:
-		return gb_i2c_protocol_transfer(cport, msg, dev);
-	default:
-		LOG_ERR("Invalid type");
-		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
+	for (start = 0; start < sys_le16_to_cpu(req_data->op_count); start = end) {
+		end = gb_i2c_segment_end(req_data, start);
+		gb_i2c_ops_flags(&msgs[start], end - start);
+
+		ret = i2c_transfer(dev, &msgs[start], end - start,
+				   sys_le16_to_cpu(req_data->ops[start].addr));
+		if (ret < 0) {
+			LOG_ERR("Failed to transfer i2c data: %d", ret);
+			gb_message_dealloc(resp);
+			return gb_transport_message_empty_response_send(
+				req, gb_errno_to_op_result(ret), cport);
+		}
 	}
+
+	gb_transport_message_send(resp, cport);
+	gb_message_dealloc(resp);
+	return gb_message_dealloc(req);
 }
 
+#endif // CONFIG_GREYBUS_I2C_ASYNC
+
+static const struct gb_operation_entry gb_i2c_ops[] = {
+	GB_OPERATION(GB_I2C_TYPE_FUNCTIONALITY, gb_i2c_protocol_functionality, 0),
+	GB_OPERATION_ARRAY(GB_I2C_TYPE_TRANSFER, gb_i2c_protocol_transfer,
+			   struct gb_i2c_transfer_request, op_count, struct gb_i2c_transfer_op),
+};
+
 const struct gb_driver gb_i2c_driver = {
-	.op_handler = gb_i2c_handler,
+	GB_OPERATIONS(gb_i2c_ops),
 };
@@ -2,62 +2,37 @@
 #include <zephyr/sys/errno_private.h>
 #include "greybus_heap.h"
 #include <zephyr/sys/util.h>
-#include <zephyr/sys/mutex.h>
+#include <zephyr/sys/atomic.h>
 
-static struct gb_interface *intfs[AP_MAX_NODES];
-K_MUTEX_DEFINE(intfs_mutex);
-
-static int new_interface_id(void)
-{
-	int ret, i;
-
-	ret = k_mutex_lock(&intfs_mutex, K_NO_WAIT);
-	if (ret < 0) {
-		return -EBUSY;
-	}
-
-	ret = -EOVERFLOW;
-
-	for (i = INTF_START_ID; i < ARRAY_SIZE(intfs); i++) {
-		if (!intfs[i]) {
-			ret = i;
-			goto unlock;
-		}
-	}
-
-unlock:
-	k_mutex_unlock(&intfs_mutex);
-	return ret;
-}
+/*
+ * Interface registry. Slots are claimed and released with atomic operations, so registration
+ * never blocks and lookup is wait-free.
+ *
+ * Lookups do not hold a reference. An interface must only be removed once no connection routes
+ * to it anymore.
+ */
+static atomic_ptr_t intfs[AP_MAX_NODES];
 
 int gb_interface_add(struct gb_interface *intf)
 {
-	int ret;
-
-	ret = k_mutex_lock(&intfs_mutex, K_NO_WAIT);
-	if (ret < 0) {
-		return -EBUSY;
+	if (intf->id >= ARRAY_SIZE(intfs)) {
+		return -EOVERFLOW;
 	}
 
-	if (intfs[intf->id]) {
-		ret = -EALREADY;
-	} else {
-		ret = 0;
-		intfs[intf->id] = intf;
+	if (!atomic_ptr_cas(&intfs[intf->id], NULL, intf)) {
+		return -EALREADY;
 	}
 
-	k_mutex_unlock(&intfs_mutex);
-
-	return ret;
+	return 0;
 }
 
 void gb_interface_remove(uint8_t id)
 {
-	k_mutex_lock(&intfs_mutex, K_FOREVER);
-
-	intfs[id] = NULL;
+	if (id >= ARRAY_SIZE(intfs)) {
+		return;
+	}
 
-	k_mutex_unlock(&intfs_mutex);
+	atomic_ptr_clear(&intfs[id]);
 }
 
 struct gb_interface *gb_interface_alloc(gb_controller_write_callback_t write_cb,
@@ -65,46 +40,49 @@ struct gb_interface *gb_interface_alloc(gb_controller_write_callback_t write_cb,
 					gb_controller_destroy_connection_t destroy_connection_cb,
 					void *ctrl_data)
 {
-	int ret;
 	struct gb_interface *intf;
 
-	ret = k_mutex_lock(&intfs_mutex, K_NO_WAIT);
-	if (ret < 0) {
-		return NULL;
-	}
-
-	ret = new_interface_id();
-	if (ret < 0) {
-		k_mutex_unlock(&intfs_mutex);
-		return NULL;
-	}
-
 	intf = gb_alloc(sizeof(struct gb_interface));
 	if (!intf) {
-		k_mutex_unlock(&intfs_mutex);
 		return intf;
 	}
 
-	intf->id = ret;
 	intf->create_connection = create_connection_cb;
 	intf->destroy_connection = destroy_connection_cb;
 	intf->write = write_cb;
 	intf->ctrl_data = ctrl_data;
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+	intf->tx_queue.wq = NULL;
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
 
-	gb_interface_add(intf);
+	/* Claim the first free ID. The interface is visible as soon as the slot is claimed. */
+	for (size_t i = INTF_START_ID; i < ARRAY_SIZE(intfs); i++) {
+		intf->id = i;
 
-	k_mutex_unlock(&intfs_mutex);
+		if (atomic_ptr_cas(&intfs[i], NULL, intf)) {
+			return intf;
+		}
+	}
+
+	gb_free(intf);
 
-	return intf;
+	return NULL;
 }
 
 void gb_interface_dealloc(struct gb_interface *intf)
 {
 	gb_interface_remove(intf->id);
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+	gb_interface_tx_queue_stop(intf);
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
 	gb_free(intf);
 }
 
 struct gb_interface *gb_interface_get(uint8_t id)
 {
-	return intfs[id];
+	if (id >= ARRAY_SIZE(intfs)) {
+		return NULL;
+	}
+
+	return atomic_ptr_get(&intfs[id]);
 }
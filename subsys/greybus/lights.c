@@ -32,11 +32,243 @@
 #include "greybus_lights.h"
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/led.h>
+#include <zephyr/sys/byteorder.h>
 #include <greybus/greybus_protocols.h>
 #include "greybus_internal.h"
 
 LOG_MODULE_REGISTER(greybus_lights, CONFIG_GREYBUS_LOG_LEVEL);
 
+#ifdef CONFIG_GREYBUS_LIGHTS_EFFECTS
+#define GB_LIGHTS_FADE_MS(_fade) ((uint32_t)(_fade) * CONFIG_GREYBUS_LIGHTS_FADE_UNIT_MS)
+
+/*
+ * Helper to start a ramp from the current brightness. The ramp is part of a phase of phase_ms,
+ * at least as long as the ramp.
+ */
+static void gb_lights_effect_ramp(struct gb_lights_effect *effect, uint8_t to, uint32_t ramp_ms,
+				  uint32_t phase_ms)
+{
+	effect->from = effect->brightness;
+	effect->to = to;
+	effect->ramp_ms = ramp_ms;
+	effect->phase_ms = phase_ms;
+}
+
+/*
+ * Helper to set up the current blink phase. The fades are cut to the length of the phase.
+ */
+static void gb_lights_effect_phase(struct gb_lights_effect *effect)
+{
+	if (effect->on) {
+		gb_lights_effect_ramp(effect, effect->peak,
+				      MIN(GB_LIGHTS_FADE_MS(effect->fade_in), effect->on_ms),
+				      effect->on_ms);
+	} else {
+		gb_lights_effect_ramp(effect, 0,
+				      MIN(GB_LIGHTS_FADE_MS(effect->fade_out), effect->off_ms),
+				      effect->off_ms);
+	}
+}
+
+static void gb_lights_effect_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct gb_lights_effect *effect = CONTAINER_OF(dwork, struct gb_lights_effect, work);
+	const int64_t elapsed = k_uptime_get() - effect->phase_start_ms;
+	int level = effect->to;
+	int ret;
+
+	if (elapsed < effect->ramp_ms) {
+		level = effect->from + ((int)effect->to - effect->from) * elapsed / effect->ramp_ms;
+	}
+
+	if (level != effect->brightness) {
+		ret = led_set_brightness(effect->dev, effect->id, level);
+		if (ret < 0) {
+			LOG_ERR("Failed to set light %u: %d", effect->id, ret);
+		}
+		effect->brightness = level;
+	}
+
+	if (elapsed < effect->ramp_ms) {
+		k_work_schedule(dwork, K_MSEC(CONFIG_GREYBUS_LIGHTS_FADE_STEP_MS));
+		return;
+	}
+
+	if (!effect->blinking) {
+		return;
+	}
+
+	if (elapsed < effect->phase_ms) {
+		k_work_schedule(dwork, K_TIMEOUT_ABS_MS(effect->phase_start_ms + effect->phase_ms));
+		return;
+	}
+
+	effect->phase_start_ms += effect->phase_ms;
+	effect->on = !effect->on;
+	gb_lights_effect_phase(effect);
+	k_work_schedule(dwork, K_TIMEOUT_ABS_MS(effect->phase_start_ms));
+}
+
+/* Stop a blink or fade in progress, the LED keeps its current brightness */
+static void gb_lights_effect_stop(struct gb_lights_effect *effect)
+{
+	struct k_work_sync sync;
+
+	k_work_cancel_delayable_sync(&effect->work, &sync);
+	effect->blinking = false;
+}
+
+/*
+ * Helper to set the brightness of a light, fading to it if the AP set a fade time for the
+ * direction of the change.
+ */
+static int gb_lights_effect_brightness(struct gb_lights_effect *effect, uint8_t brightness)
+{
+	int ret;
+	const uint8_t fade = brightness > effect->brightness ? effect->fade_in : effect->fade_out;
+
+	gb_lights_effect_stop(effect);
+	if (brightness) {
+		effect->peak = brightness;
+	}
+
+	if (!fade) {
+		ret = led_set_brightness(effect->dev, effect->id, brightness);
+		if (ret == 0) {
+			effect->brightness = brightness;
+		}
+		return ret;
+	}
+
+	effect->phase_start_ms = k_uptime_get();
+	gb_lights_effect_ramp(effect, brightness, GB_LIGHTS_FADE_MS(fade), GB_LIGHTS_FADE_MS(fade));
+	k_work_schedule(&effect->work, K_NO_WAIT);
+
+	return 0;
+}
+
+/*
+ * Helper to start blinking a light. The LED driver blinks on its own if it can and no fade is
+ * set, the work item steps the brightness otherwise.
+ */
+static int gb_lights_effect_blink(struct gb_lights_effect *effect, uint16_t on_ms,
+				  uint16_t off_ms)
+{
+	int ret;
+	uint8_t level;
+
+	gb_lights_effect_stop(effect);
+
+	/* No blinking, the LED stays in the only phase with a length */
+	if (on_ms == 0 || off_ms == 0) {
+		level = on_ms ? effect->peak : 0;
+		ret = led_set_brightness(effect->dev, effect->id, level);
+		if (ret == 0) {
+			effect->brightness = level;
+		}
+		return ret;
+	}
+
+	if (!effect->fade_in && !effect->fade_out) {
+		ret = led_blink(effect->dev, effect->id, on_ms, off_ms);
+		if (ret != -ENOSYS) {
+			return ret;
+		}
+	}
+
+	effect->on_ms = on_ms;
+	effect->off_ms = off_ms;
+	effect->blinking = true;
+	effect->on = true;
+	effect->phase_start_ms = k_uptime_get();
+	gb_lights_effect_phase(effect);
+	k_work_schedule(&effect->work, K_NO_WAIT);
+
+	return 0;
+}
+
+/**
+ * @brief Set blink time of specific channel
+ *
+ * This operation allows the AP Module to blink a light without timing every
+ * brightness change itself. A time of 0 for either phase stops blinking
+ *
+ * @param operation pointer to structure of Greybus operation message
+ * @return GB_OP_SUCCESS on success, error code on failure
+ */
+static void gb_lights_set_blink(uint16_t cport, struct gb_message *req,
+				const struct gb_lights_driver_data *data)
+{
+	const struct gb_lights_blink_request *req_data =
+		(const struct gb_lights_blink_request *)req->payload;
+	int ret;
+
+	if (req_data->light_id >= data->lights_num) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	ret = gb_lights_effect_blink(&data->effects[req_data->light_id],
+				     sys_le16_to_cpu(req_data->time_on_ms),
+				     sys_le16_to_cpu(req_data->time_off_ms));
+	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
+}
+
+/**
+ * @brief Set fade times of specific channel
+ *
+ * This operation allows the AP Module to set the time brightness changes take,
+ * in units of CONFIG_GREYBUS_LIGHTS_FADE_UNIT_MS. The times apply from the
+ * next brightness or blink request on
+ *
+ * @param operation pointer to structure of Greybus operation message
+ * @return GB_OP_SUCCESS on success, error code on failure
+ */
+static void gb_lights_set_fade(uint16_t cport, struct gb_message *req,
+			       const struct gb_lights_driver_data *data)
+{
+	const struct gb_lights_set_fade_request *req_data =
+		(const struct gb_lights_set_fade_request *)req->payload;
+	struct gb_lights_effect *effect;
+
+	if (req_data->light_id >= data->lights_num) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	effect = &data->effects[req_data->light_id];
+	gb_lights_effect_stop(effect);
+	effect->fade_in = req_data->fade_in;
+	effect->fade_out = req_data->fade_out;
+
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+
+static void gb_lights_connected(const void *priv, uint16_t cport)
+{
+	const struct gb_lights_driver_data *data = priv;
+	struct gb_lights_effect *effect;
+
+	for (size_t i = 0; i < data->lights_num; i++) {
+		effect = &data->effects[i];
+		*effect = (struct gb_lights_effect){
+			.dev = data->devs[i],
+			.id = i,
+			.peak = LED_BRIGHTNESS_MAX,
+		};
+		k_work_init_delayable(&effect->work, gb_lights_effect_work_handler);
+	}
+}
+
+static void gb_lights_disconnected(const void *priv)
+{
+	const struct gb_lights_driver_data *data = priv;
+
+	for (size_t i = 0; i < data->lights_num; i++) {
+		gb_lights_effect_stop(&data->effects[i]);
+	}
+}
+#endif // CONFIG_GREYBUS_LIGHTS_EFFECTS
+
 /**
  * @brief Returns lights count of lights driver
  *
@@ -109,7 +341,11 @@ static void gb_lights_get_channel_config(uint16_t cport, struct gb_message *req,
 	/* TODO: Implement properly */
 	const struct gb_lights_get_channel_config_response resp_data = {
 		.max_brightness = LED_BRIGHTNESS_MAX,
+#ifdef CONFIG_GREYBUS_LIGHTS_EFFECTS
+		.flags = sys_cpu_to_le32(GB_LIGHT_CHANNEL_BLINK | GB_LIGHT_CHANNEL_FADER),
+#else
 		.flags = 0,
+#endif // CONFIG_GREYBUS_LIGHTS_EFFECTS
 		.mode = 0,
 		.color = 0,
 	};
@@ -134,11 +370,74 @@ static void gb_lights_set_brightness(uint16_t cport, struct gb_message *req,
 		(const struct gb_lights_set_brightness_request *)req->payload;
 	int ret;
 
+#ifdef CONFIG_GREYBUS_LIGHTS_EFFECTS
+	if (req_data->light_id >= data->lights_num) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	ret = gb_errno_to_op_result(gb_lights_effect_brightness(&data->effects[req_data->light_id],
+								req_data->brightness));
+#else
 	ret = gb_errno_to_op_result(led_set_brightness(data->devs[req_data->light_id],
 						       req_data->light_id, req_data->brightness));
+#endif // CONFIG_GREYBUS_LIGHTS_EFFECTS
 	gb_transport_message_empty_response_send(req, ret, cport);
 }
 
+#ifdef CONFIG_GREYBUS_LIGHTS_BATCH
+/**
+ * @brief Set brightness of several lights
+ *
+ * This operation allows the AP Module to update many lights with a single
+ * request, e.g. for every frame of an animation. All entries are validated
+ * before any light is changed
+ *
+ * @param operation pointer to structure of Greybus operation message
+ * @return GB_OP_SUCCESS on success, error code on failure
+ */
+static void gb_lights_set_brightness_batch(uint16_t cport, struct gb_message *req,
+					   const struct gb_lights_driver_data *data)
+{
+	const struct gb_lights_set_brightness_batch_request *req_data =
+		(const struct gb_lights_set_brightness_batch_request *)req->payload;
+	const struct gb_lights_set_brightness_request *entry;
+	size_t i;
+	int ret;
+
+	if (gb_message_payload_len(req) < sizeof(*req_data) ||
+	    gb_message_payload_len(req) <
+		    sizeof(*req_data) + req_data->count * sizeof(req_data->entries[0])) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	for (i = 0; i < req_data->count; i++) {
+		if (req_data->entries[i].light_id >= data->lights_num) {
+			return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+		}
+	}
+
+	for (i = 0; i < req_data->count; i++) {
+		entry = &req_data->entries[i];
+
+#ifdef CONFIG_GREYBUS_LIGHTS_EFFECTS
+		ret = gb_lights_effect_brightness(&data->effects[entry->light_id],
+						  entry->brightness);
+#else
+		ret = led_set_brightness(data->devs[entry->light_id], entry->light_id,
+					 entry->brightness);
+#endif // CONFIG_GREYBUS_LIGHTS_EFFECTS
+		if (ret < 0) {
+			LOG_ERR("Failed to set light %u: %d", entry->light_id, ret);
+			return gb_transport_message_empty_response_send(
+				req, gb_errno_to_op_result(ret), cport);
+		}
+	}
+
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+#endif // CONFIG_GREYBUS_LIGHTS_BATCH
+
 /**
  * @brief Greybus Lights Protocol operation handler
  */
@@ -155,9 +454,20 @@ static void gb_lights_handler(const void *priv, struct gb_message *msg, uint16_t
 		return gb_lights_get_channel_config(cport, msg, data);
 	case GB_LIGHTS_TYPE_SET_BRIGHTNESS:
 		return gb_lights_set_brightness(cport, msg, data);
+#ifdef CONFIG_GREYBUS_LIGHTS_BATCH
+	case GB_LIGHTS_TYPE_VENDOR_SET_BRIGHTNESS_BATCH:
+		return gb_lights_set_brightness_batch(cport, msg, data);
+#endif // CONFIG_GREYBUS_LIGHTS_BATCH
+#ifdef CONFIG_GREYBUS_LIGHTS_EFFECTS
 	case GB_LIGHTS_TYPE_SET_BLINK:
-	case GB_LIGHTS_TYPE_SET_COLOR:
+		return gb_lights_set_blink(cport, msg, data);
 	case GB_LIGHTS_TYPE_SET_FADE:
+		return gb_lights_set_fade(cport, msg, data);
+#else
+	case GB_LIGHTS_TYPE_SET_BLINK:
+	case GB_LIGHTS_TYPE_SET_FADE:
+#endif // CONFIG_GREYBUS_LIGHTS_EFFECTS
+	case GB_LIGHTS_TYPE_SET_COLOR:
 	case GB_LIGHTS_TYPE_GET_CHANNEL_FLASH_CONFIG:
 	case GB_LIGHTS_TYPE_SET_FLASH_INTENSITY:
 	case GB_LIGHTS_TYPE_SET_FLASH_STROBE:
@@ -171,5 +481,9 @@ static void gb_lights_handler(const void *priv, struct gb_message *msg, uint16_t
 }
 
 const struct gb_driver gb_lights_driver = {
+#ifdef CONFIG_GREYBUS_LIGHTS_EFFECTS
+	.connected = gb_lights_connected,
+	.disconnected = gb_lights_disconnected,
+#endif // CONFIG_GREYBUS_LIGHTS_EFFECTS
 	.op_handler = gb_lights_handler,
 };
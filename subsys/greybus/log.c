@@ -7,39 +7,321 @@
 #include <greybus/greybus_protocols.h>
 #include "greybus_transport.h"
 #include <greybus-utils/manifest.h>
+#include "greybus_cport.h"
 #include "greybus_internal.h"
+#include <greybus/greybus_log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/ring_buffer.h>
+#ifdef CONFIG_GREYBUS_LOG_ZEPHYR_BACKEND
+#include <zephyr/logging/log_backend.h>
+#include <zephyr/logging/log_ctrl.h>
+#include <zephyr/logging/log_output.h>
+#endif // CONFIG_GREYBUS_LOG_ZEPHYR_BACKEND
 
-static void op_handler(const void *priv, struct gb_message *msg, uint16_t cport)
+/*
+ * Lines are queued here, and sent in batches by a low priority thread. Logging thus never
+ * allocates or blocks, and can be used from any context.
+ */
+RING_BUF_DECLARE(gb_log_rb, CONFIG_GREYBUS_LOG_BUF_SIZE);
+static struct k_spinlock gb_log_lock;
+static K_SEM_DEFINE(gb_log_sem, 0, 1);
+static atomic_t gb_log_dropped;
+
+#ifdef CONFIG_GREYBUS_LOG_CONTROL
+/*
+ * struct gb_log_rate: Token bucket limiting the lines sent to the host
+ *
+ * @lines_per_sec: tokens added per second, 0 if there is no limit
+ * @burst: most tokens in the bucket
+ * @tokens: lines that can be sent right away
+ * @refill_ms: uptime up to which tokens were added
+ */
+struct gb_log_rate {
+	uint32_t lines_per_sec;
+	uint32_t burst;
+	uint32_t tokens;
+	int64_t refill_ms;
+};
+
+/* Protected by gb_log_lock */
+static struct gb_log_rate gb_log_rate;
+
+/* Take a token for a line. Lines over the limit are reported as dropped. */
+static bool gb_log_rate_allow(void)
 {
-	ARG_UNUSED(priv);
+	bool allow = true;
+	uint64_t add;
+	struct gb_log_rate *rate = &gb_log_rate;
+	k_spinlock_key_t key = k_spin_lock(&gb_log_lock);
 
-	switch (gb_message_type(msg)) {
-	case GB_RESPONSE(GB_LOG_TYPE_SEND_LOG):
-		return gb_message_dealloc(msg);
-	default:
-		return gb_transport_message_empty_response_send(msg, GB_OP_PROTOCOL_BAD, cport);
+	if (rate->lines_per_sec) {
+		add = (k_uptime_get() - rate->refill_ms) * rate->lines_per_sec / MSEC_PER_SEC;
+		if (add) {
+			rate->tokens = MIN(rate->burst, rate->tokens + add);
+			/* Keep the remainder, so that slow rates still refill */
+			rate->refill_ms += add * MSEC_PER_SEC / rate->lines_per_sec;
+		}
+
+		allow = rate->tokens > 0;
+		if (allow) {
+			rate->tokens--;
+		}
+	}
+
+	k_spin_unlock(&gb_log_lock, key);
+
+	if (!allow) {
+		atomic_inc(&gb_log_dropped);
+	}
+
+	return allow;
+}
+#else
+static inline bool gb_log_rate_allow(void)
+{
+	return true;
+}
+#endif // CONFIG_GREYBUS_LOG_CONTROL
+
+/* Queue all of data or nothing, so that the host never gets part of a line */
+static bool gb_log_buf_put(const uint8_t *data, size_t len, bool newline)
+{
+	k_spinlock_key_t key = k_spin_lock(&gb_log_lock);
+	bool fits = ring_buf_space_get(&gb_log_rb) >= len + newline;
+
+	if (fits) {
+		ring_buf_put(&gb_log_rb, data, len);
+		if (newline) {
+			ring_buf_put(&gb_log_rb, (const uint8_t *)"\n", 1);
+		}
 	}
+	k_spin_unlock(&gb_log_lock, key);
+
+	if (fits) {
+		k_sem_give(&gb_log_sem);
+	} else {
+		atomic_inc(&gb_log_dropped);
+	}
+
+	return fits;
 }
 
 void gb_log_send_log(uint16_t len, const char *log)
 {
+	if (gb_log_rate_allow()) {
+		gb_log_buf_put((const uint8_t *)log, len, true);
+	}
+}
+
+/* Send queued lines to the host in a single message */
+static int gb_log_flush(void)
+{
+	int ret;
+	uint32_t len = 0, n, i;
+	atomic_val_t dropped;
+	k_spinlock_key_t key;
 	struct gb_log_send_log_request *req_data;
-	struct gb_message *msg =
-		gb_message_request_alloc(sizeof(*req_data) + len + 1, GB_LOG_TYPE_SEND_LOG, false);
+	struct gb_message *msg = gb_cport_request_alloc(
+		GREYBUS_LOG_CPORT, sizeof(*req_data) + CONFIG_GREYBUS_LOG_BATCH_SIZE,
+		GB_LOG_TYPE_SEND_LOG);
 
 	if (!msg) {
-		return;
+		return -ENOMEM;
 	}
 
 	req_data = (struct gb_log_send_log_request *)msg->payload;
 
-	/* Include NULL terminator */
-	req_data->len = sys_cpu_to_le16(len + 1);
-	memcpy(req_data->msg, log, len);
+	dropped = atomic_clear(&gb_log_dropped);
+	if (dropped) {
+		len = snprintk((char *)req_data->msg, CONFIG_GREYBUS_LOG_BATCH_SIZE,
+			       "--- %ld messages dropped ---\n", (long)dropped);
+		len = MIN(len, CONFIG_GREYBUS_LOG_BATCH_SIZE - 1);
+	}
+
+	/* Leave space for NULL terminator */
+	key = k_spin_lock(&gb_log_lock);
+	n = ring_buf_peek(&gb_log_rb, &req_data->msg[len], CONFIG_GREYBUS_LOG_BATCH_SIZE - 1 - len);
+
+	/* Only send complete lines, unless a single line does not fit */
+	for (i = n; i > 0 && req_data->msg[len + i - 1] != '\n'; i--) {
+	}
+	if (i > 0) {
+		n = i;
+	}
+	ring_buf_get(&gb_log_rb, NULL, n);
+	k_spin_unlock(&gb_log_lock, key);
+
+	len += n;
+	/* The host terminates the last line itself */
+	if (len > 0 && req_data->msg[len - 1] == '\n') {
+		len--;
+	}
 	req_data->msg[len] = '\0';
+	req_data->len = sys_cpu_to_le16(len + 1);
+	msg->header.size = sizeof(struct gb_operation_msg_hdr) + sizeof(*req_data) + len + 1;
 
-	gb_transport_message_send(msg, GREYBUS_LOG_CPORT);
+	ret = gb_transport_message_send(msg, GREYBUS_LOG_CPORT);
 	gb_message_dealloc(msg);
+
+	return ret;
+}
+
+static void gb_log_thread_handler(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		k_sem_take(&gb_log_sem, K_FOREVER);
+
+		/* Let more lines gather, so that they are sent in the same batch */
+		k_msleep(CONFIG_GREYBUS_LOG_FLUSH_DELAY_MS);
+
+		while (!ring_buf_is_empty(&gb_log_rb) || atomic_get(&gb_log_dropped)) {
+			if (gb_log_flush() < 0) {
+				k_msleep(CONFIG_GREYBUS_LOG_FLUSH_DELAY_MS);
+			}
+		}
+	}
+}
+
+K_THREAD_DEFINE(gb_log_thread, CONFIG_GREYBUS_LOG_THREAD_STACK_SIZE, gb_log_thread_handler, NULL,
+		NULL, NULL, CONFIG_GREYBUS_LOG_THREAD_PRIORITY, 0, 0);
+
+#ifdef CONFIG_GREYBUS_LOG_ZEPHYR_BACKEND
+static uint8_t gb_log_output_buf[CONFIG_GREYBUS_LOG_ZEPHYR_BACKEND_BUF_SIZE];
+
+static int gb_log_output_func(uint8_t *data, size_t length, void *ctx)
+{
+	ARG_UNUSED(ctx);
+
+	/* log_output terminates lines itself */
+	gb_log_buf_put(data, length, false);
+
+	return length;
+}
+
+LOG_OUTPUT_DEFINE(gb_log_output, gb_log_output_func, gb_log_output_buf,
+		  sizeof(gb_log_output_buf));
+
+static void gb_log_backend_process(const struct log_backend *const backend,
+				   union log_msg_generic *msg)
+{
+	ARG_UNUSED(backend);
+
+	if (!gb_log_rate_allow()) {
+		return;
+	}
+
+	log_output_msg_process(&gb_log_output, &msg->log,
+			       LOG_OUTPUT_FLAG_LEVEL | LOG_OUTPUT_FLAG_CRLF_LFONLY);
+}
+
+static void gb_log_backend_dropped(const struct log_backend *const backend, uint32_t cnt)
+{
+	ARG_UNUSED(backend);
+
+	atomic_add(&gb_log_dropped, cnt);
+}
+
+static void gb_log_backend_panic(const struct log_backend *const backend)
+{
+	ARG_UNUSED(backend);
+
+	/* Sending needs the transport threads, so there is nothing more to do here */
+}
+
+static const struct log_backend_api gb_log_backend_api = {
+	.process = gb_log_backend_process,
+	.dropped = gb_log_backend_dropped,
+	.panic = gb_log_backend_panic,
+};
+
+LOG_BACKEND_DEFINE(gb_log_backend, gb_log_backend_api, true);
+#endif // CONFIG_GREYBUS_LOG_ZEPHYR_BACKEND
+
+#ifdef CONFIG_GREYBUS_LOG_CONTROL
+/*
+ * Only messages going to the host are filtered, other backends keep their levels. The level can
+ * not go above the level a module was built with.
+ */
+static void gb_log_set_filter(struct gb_message *msg, uint16_t cport)
+{
+#if defined(CONFIG_GREYBUS_LOG_ZEPHYR_BACKEND) && defined(CONFIG_LOG_RUNTIME_FILTERING)
+	const struct gb_log_vendor_set_filter_request *req_data =
+		(const struct gb_log_vendor_set_filter_request *)msg->payload;
+	struct gb_log_vendor_set_filter_response resp_data;
+	char name[GB_LOG_MODULE_NAME_MAX + 1];
+	uint32_t first = 0, last;
+	int source;
+
+	if (gb_message_payload_len(msg) < sizeof(*req_data) || req_data->level > LOG_LEVEL_DBG) {
+		return gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
+	}
+
+	memcpy(name, req_data->module, sizeof(req_data->module));
+	name[sizeof(req_data->module)] = '\0';
+
+	last = log_src_cnt_get(Z_LOG_LOCAL_DOMAIN_ID);
+	if (name[0]) {
+		source = log_source_id_get(name);
+		if (source < 0) {
+			return gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
+		}
+		first = source;
+		last = source + 1;
+	}
+
+	for (uint32_t i = first; i < last; i++) {
+		log_filter_set(&gb_log_backend, Z_LOG_LOCAL_DOMAIN_ID, i, req_data->level);
+	}
+
+	resp_data.modules = sys_cpu_to_le16(last - first);
+	gb_transport_message_response_success_send(msg, &resp_data, sizeof(resp_data), cport);
+#else
+	gb_transport_message_empty_response_send(msg, GB_OP_PROTOCOL_BAD, cport);
+#endif
+}
+
+static void gb_log_set_rate_limit(struct gb_message *msg, uint16_t cport)
+{
+	const struct gb_log_vendor_set_rate_limit_request *req_data =
+		(const struct gb_log_vendor_set_rate_limit_request *)msg->payload;
+	k_spinlock_key_t key;
+
+	if (gb_message_payload_len(msg) < sizeof(*req_data)) {
+		return gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
+	}
+
+	key = k_spin_lock(&gb_log_lock);
+	gb_log_rate.lines_per_sec = sys_le16_to_cpu(req_data->lines_per_sec);
+	gb_log_rate.burst = MAX(sys_le16_to_cpu(req_data->burst), 1);
+	gb_log_rate.tokens = gb_log_rate.burst;
+	gb_log_rate.refill_ms = k_uptime_get();
+	k_spin_unlock(&gb_log_lock, key);
+
+	gb_transport_message_empty_response_send(msg, GB_OP_SUCCESS, cport);
+}
+#endif // CONFIG_GREYBUS_LOG_CONTROL
+
+static void op_handler(const void *priv, struct gb_message *msg, uint16_t cport)
+{
+	ARG_UNUSED(priv);
+
+	switch (gb_message_type(msg)) {
+	case GB_RESPONSE(GB_LOG_TYPE_SEND_LOG):
+		return gb_message_dealloc(msg);
+#ifdef CONFIG_GREYBUS_LOG_CONTROL
+	case GB_LOG_TYPE_VENDOR_SET_FILTER:
+		return gb_log_set_filter(msg, cport);
+	case GB_LOG_TYPE_VENDOR_SET_RATE_LIMIT:
+		return gb_log_set_rate_limit(msg, cport);
+#endif // CONFIG_GREYBUS_LOG_CONTROL
+	default:
+		return gb_transport_message_empty_response_send(msg, GB_OP_PROTOCOL_BAD, cport);
+	}
 }
 
 const struct gb_driver gb_log_driver = {
@@ -31,18 +31,302 @@
 #include "greybus_transport.h"
 #include <zephyr/logging/log.h>
 #include <greybus/greybus_protocols.h>
+#include "greybus_cport.h"
 #include "greybus_internal.h"
+#include <greybus/greybus_loopback.h>
 
 LOG_MODULE_REGISTER(greybus_loopback, CONFIG_GREYBUS_LOG_LEVEL);
 
-static void gb_loopback_transfer_req_cb(struct gb_message *req, uint16_t cport)
+#ifdef CONFIG_GREYBUS_LOOPBACK_BENCH
+static void gb_loopback_bench_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(gb_loopback_bench_work, gb_loopback_bench_work_handler);
+
+/*
+ * Node initiated benchmark. Requests are sent to the AP one at a time, and timed until their
+ * response arrives.
+ */
+static struct {
+	struct k_spinlock lock;
+	struct gb_loopback_bench_stats stats;
+	int64_t start_ms;
+	/* Cycle count when the request in flight was sent */
+	uint32_t sent_cycles;
+	uint32_t interval_us;
+	uint32_t count;
+	uint32_t size;
+	uint16_t operation_id;
+	uint16_t cport;
+	uint8_t type;
+	bool connected;
+	bool in_flight;
+} bench;
+
+static size_t gb_loopback_bench_payload_len(void)
+{
+	return (bench.type == GB_LOOPBACK_TYPE_PING)
+		       ? 0
+		       : sizeof(struct gb_loopback_transfer_request) + bench.size;
+}
+
+static bool gb_loopback_bench_done(void)
+{
+	return bench.count && bench.stats.sent >= bench.count;
+}
+
+static void gb_loopback_bench_send(void)
 {
-	req->header.type = GB_RESPONSE(GB_LOOPBACK_TYPE_TRANSFER);
-	req->header.result = GB_OP_SUCCESS;
+	int ret;
+	uint16_t operation_id, cport;
+	uint32_t size;
+	size_t payload_len;
+	uint8_t type;
+	k_spinlock_key_t key;
+	struct gb_loopback_transfer_request *req_data;
+	struct gb_message *msg;
 
-	gb_transport_message_send(req, cport);
+	key = k_spin_lock(&bench.lock);
+	cport = bench.cport;
+	type = bench.type;
+	size = bench.size;
+	payload_len = gb_loopback_bench_payload_len();
+	k_spin_unlock(&bench.lock, key);
+
+	/* The size is up to the user, so the request is built without the lock */
+	msg = gb_cport_request_alloc(cport, payload_len, type);
+	if (msg && payload_len) {
+		req_data = (struct gb_loopback_transfer_request *)msg->payload;
+		req_data->len = sys_cpu_to_le32(size);
+		memset(req_data->data, 0x5a, size);
+	}
+
+	key = k_spin_lock(&bench.lock);
+	if (!bench.stats.running) {
+		k_spin_unlock(&bench.lock, key);
+		gb_message_dealloc(msg);
+		return;
+	}
+
+	if (!msg) {
+		bench.stats.alloc_failures++;
+		k_spin_unlock(&bench.lock, key);
+		k_work_reschedule(&gb_loopback_bench_work, K_USEC(MAX(bench.interval_us, 1000)));
+		return;
+	}
+
+	operation_id = msg->header.operation_id;
+	bench.operation_id = operation_id;
+	bench.in_flight = true;
+	bench.stats.sent++;
+	bench.stats.bytes += payload_len;
+	bench.sent_cycles = k_cycle_get_32();
+	k_spin_unlock(&bench.lock, key);
+
+	/* Runs again on timeout, unless rescheduled by the response */
+	k_work_reschedule(&gb_loopback_bench_work,
+			  K_MSEC(CONFIG_GREYBUS_LOOPBACK_BENCH_TIMEOUT_MS));
+
+	ret = gb_transport_message_send(msg, cport);
+	gb_message_dealloc(msg);
+
+	if (ret < 0) {
+		key = k_spin_lock(&bench.lock);
+		if (bench.in_flight && bench.operation_id == operation_id) {
+			bench.in_flight = false;
+			bench.stats.errors++;
+			k_work_reschedule(&gb_loopback_bench_work, K_USEC(bench.interval_us));
+		}
+		k_spin_unlock(&bench.lock, key);
+	}
+}
 
-	gb_message_dealloc(req);
+static void gb_loopback_bench_work_handler(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&bench.lock);
+
+	ARG_UNUSED(work);
+
+	if (!bench.stats.running) {
+		k_spin_unlock(&bench.lock, key);
+		return;
+	}
+
+	if (bench.in_flight) {
+		LOG_WRN("Loopback request %u timed out", bench.operation_id);
+		bench.in_flight = false;
+		bench.stats.errors++;
+	}
+
+	if (gb_loopback_bench_done()) {
+		bench.stats.running = false;
+		k_spin_unlock(&bench.lock, key);
+		return;
+	}
+	k_spin_unlock(&bench.lock, key);
+
+	gb_loopback_bench_send();
+}
+
+static void gb_loopback_bench_response(struct gb_message *msg)
+{
+	size_t i = 0;
+	uint32_t latency_us;
+	uint32_t now = k_cycle_get_32();
+	k_spinlock_key_t key = k_spin_lock(&bench.lock);
+
+	if (!bench.stats.running || !bench.in_flight ||
+	    msg->header.operation_id != bench.operation_id) {
+		k_spin_unlock(&bench.lock, key);
+		return gb_message_dealloc(msg);
+	}
+
+	bench.in_flight = false;
+	latency_us = k_cyc_to_us_floor32(now - bench.sent_cycles);
+
+	if (!gb_message_is_success(msg) ||
+	    (bench.type == GB_LOOPBACK_TYPE_TRANSFER &&
+	     gb_message_payload_len(msg) != gb_loopback_bench_payload_len())) {
+		bench.stats.errors++;
+	} else {
+		bench.stats.completed++;
+		bench.stats.bytes += gb_message_payload_len(msg);
+		bench.stats.min_us = MIN(bench.stats.min_us, latency_us);
+		bench.stats.max_us = MAX(bench.stats.max_us, latency_us);
+		while (i < GB_LOOPBACK_BENCH_BUCKETS - 1 &&
+		       latency_us > GB_LOOPBACK_BENCH_BUCKET_US(i)) {
+			i++;
+		}
+		bench.stats.histogram[i]++;
+	}
+	bench.stats.elapsed_ms = k_uptime_get() - bench.start_ms;
+
+	if (gb_loopback_bench_done()) {
+		bench.stats.running = false;
+		k_work_cancel_delayable(&gb_loopback_bench_work);
+	} else {
+		k_work_reschedule(&gb_loopback_bench_work,
+				  K_USEC((bench.interval_us > latency_us)
+						 ? bench.interval_us - latency_us
+						 : 0));
+	}
+	k_spin_unlock(&bench.lock, key);
+
+	gb_message_dealloc(msg);
+}
+
+int gb_loopback_bench_start(uint8_t type, uint32_t size, uint32_t count, uint32_t interval_us)
+{
+	k_spinlock_key_t key;
+
+	if (type != GB_LOOPBACK_TYPE_PING && type != GB_LOOPBACK_TYPE_TRANSFER &&
+	    type != GB_LOOPBACK_TYPE_SINK) {
+		return -EINVAL;
+	}
+
+	if (size > UINT16_MAX - sizeof(struct gb_message) -
+			   sizeof(struct gb_loopback_transfer_request)) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&bench.lock);
+	if (!bench.connected) {
+		k_spin_unlock(&bench.lock, key);
+		return -ENOTCONN;
+	}
+
+	if (bench.stats.running) {
+		k_spin_unlock(&bench.lock, key);
+		return -EBUSY;
+	}
+
+	memset(&bench.stats, 0, sizeof(bench.stats));
+	bench.stats.min_us = UINT32_MAX;
+	bench.stats.running = true;
+	bench.type = type;
+	bench.size = size;
+	bench.count = count;
+	bench.interval_us = interval_us;
+	bench.in_flight = false;
+	bench.start_ms = k_uptime_get();
+	k_spin_unlock(&bench.lock, key);
+
+	k_work_reschedule(&gb_loopback_bench_work, K_NO_WAIT);
+
+	return 0;
+}
+
+void gb_loopback_bench_stop(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&bench.lock);
+
+	bench.stats.running = false;
+	bench.in_flight = false;
+	k_work_cancel_delayable(&gb_loopback_bench_work);
+	k_spin_unlock(&bench.lock, key);
+}
+
+void gb_loopback_bench_stats_get(struct gb_loopback_bench_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&bench.lock);
+
+	*stats = bench.stats;
+	k_spin_unlock(&bench.lock, key);
+
+	if (!stats->completed) {
+		stats->min_us = 0;
+	}
+}
+
+uint32_t gb_loopback_bench_percentile(const struct gb_loopback_bench_stats *stats,
+				      uint8_t percent)
+{
+	size_t i;
+	uint32_t seen = 0;
+	uint32_t target = DIV_ROUND_UP(stats->completed * (uint64_t)percent, 100);
+
+	if (!stats->completed) {
+		return 0;
+	}
+
+	for (i = 0; i < GB_LOOPBACK_BENCH_BUCKETS - 1; i++) {
+		seen += stats->histogram[i];
+		if (seen >= target) {
+			return MIN(GB_LOOPBACK_BENCH_BUCKET_US(i), stats->max_us);
+		}
+	}
+
+	return stats->max_us;
+}
+
+static void gb_loopback_connected(const void *priv, uint16_t cport)
+{
+	k_spinlock_key_t key = k_spin_lock(&bench.lock);
+
+	ARG_UNUSED(priv);
+
+	bench.cport = cport;
+	bench.connected = true;
+	k_spin_unlock(&bench.lock, key);
+}
+
+static void gb_loopback_disconnected(const void *priv)
+{
+	k_spinlock_key_t key = k_spin_lock(&bench.lock);
+
+	ARG_UNUSED(priv);
+
+	bench.connected = false;
+	k_spin_unlock(&bench.lock, key);
+
+	gb_loopback_bench_stop();
+}
+#endif // CONFIG_GREYBUS_LOOPBACK_BENCH
+
+static void gb_loopback_transfer_req_cb(struct gb_message *req, uint16_t cport)
+{
+	/* Echo the request payload back, reusing the request buffer */
+	gb_transport_message_response_success_send(req, req->payload, gb_message_payload_len(req),
+						   cport);
 }
 
 static void gb_loopback_handler(const void *priv, struct gb_message *msg, uint16_t cport)
@@ -56,6 +340,12 @@ static void gb_loopback_handler(const void *priv, struct gb_message *msg, uint16
 		return gb_loopback_transfer_req_cb(msg, cport);
 	case GB_LOOPBACK_TYPE_SINK:
 		return gb_transport_message_empty_response_send(msg, GB_OP_SUCCESS, cport);
+#ifdef CONFIG_GREYBUS_LOOPBACK_BENCH
+	case GB_RESPONSE(GB_LOOPBACK_TYPE_PING):
+	case GB_RESPONSE(GB_LOOPBACK_TYPE_TRANSFER):
+	case GB_RESPONSE(GB_LOOPBACK_TYPE_SINK):
+		return gb_loopback_bench_response(msg);
+#endif // CONFIG_GREYBUS_LOOPBACK_BENCH
 	default:
 		LOG_ERR("Invalid type");
 		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
@@ -63,5 +353,9 @@ static void gb_loopback_handler(const void *priv, struct gb_message *msg, uint16
 }
 
 const struct gb_driver gb_loopback_driver = {
+#ifdef CONFIG_GREYBUS_LOOPBACK_BENCH
+	.connected = gb_loopback_connected,
+	.disconnected = gb_loopback_disconnected,
+#endif // CONFIG_GREYBUS_LOOPBACK_BENCH
 	.op_handler = gb_loopback_handler,
 };
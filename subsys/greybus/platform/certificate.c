@@ -27,6 +27,12 @@ static const unsigned char greybus_tls_builtin_server_cert[] = {
 static const unsigned char greybus_tls_builtin_server_privkey[] = {
 #include "greybus_tls_builtin_server_privkey.inc"
 };
+
+#ifdef CONFIG_GREYBUS_TLS_PSK
+static const unsigned char greybus_tls_builtin_psk[] = {
+#include "greybus_tls_builtin_psk.inc"
+};
+#endif /* CONFIG_GREYBUS_TLS_PSK */
 #else
 #define greybus_tls_builtin_ca_cert        NULL
 #define greybus_tls_builtin_server_cert    NULL
@@ -72,6 +78,24 @@ int greybus_tls_init(void)
 			LOG_ERR("Failed to add Server Certificate (Private Key): %d", r);
 			return r;
 		}
+
+#ifdef CONFIG_GREYBUS_TLS_PSK
+		LOG_DBG("Adding Pre-Shared Key (%zu bytes)", sizeof(greybus_tls_builtin_psk));
+		r = tls_credential_add(GB_TLS_PSK_TAG, TLS_CREDENTIAL_PSK, greybus_tls_builtin_psk,
+				       sizeof(greybus_tls_builtin_psk));
+		if (r < 0) {
+			LOG_ERR("Failed to add Pre-Shared Key: %d", r);
+			return r;
+		}
+
+		r = tls_credential_add(GB_TLS_PSK_TAG, TLS_CREDENTIAL_PSK_ID,
+				       CONFIG_GREYBUS_TLS_PSK_IDENTITY,
+				       strlen(CONFIG_GREYBUS_TLS_PSK_IDENTITY));
+		if (r < 0) {
+			LOG_ERR("Failed to add Pre-Shared Key Identity: %d", r);
+			return r;
+		}
+#endif /* CONFIG_GREYBUS_TLS_PSK */
 	}
 
 	return 0;
@@ -13,6 +13,7 @@ enum greybus_tls_certificate_type {
 	GB_TLS_CA_CERT_TAG,
 	GB_TLS_SERVER_CERT_TAG,
 	GB_TLS_CLIENT_CERT_TAG,
+	GB_TLS_PSK_TAG,
 };
 
 int greybus_tls_init(void);
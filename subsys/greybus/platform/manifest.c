@@ -6,7 +6,10 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
 #include <greybus-utils/manifest.h>
+#include <greybus/greybus_messages.h>
+#include <greybus/greybus_protocols.h>
 #include "../greybus-manifest.h"
 #include "../greybus_cport.h"
 
@@ -55,11 +58,38 @@ struct greybus_manifest_cport {
 	UTIL_AND(DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_vibrator, okay),         \
 		 CONFIG_GREYBUS_VIBRATOR)
 
+#define _GB_BUNDLE_AUDIO_CHECK(node_id)                                                            \
+	UTIL_AND(DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_audio, okay),            \
+		 CONFIG_GREYBUS_AUDIO)
+
+#define _GB_BUNDLE_CAMERA_CHECK(node_id)                                                           \
+	UTIL_AND(DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_camera, okay),           \
+		 CONFIG_GREYBUS_CAMERA)
+
+#define _GB_BUNDLE_HID_CHECK(node_id)                                                              \
+	UTIL_AND(DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_hid, okay),              \
+		 CONFIG_GREYBUS_HID)
+
+#define _GB_BUNDLE_POWER_SUPPLY_CHECK(node_id)                                                     \
+	UTIL_AND(DT_NODE_HAS_COMPAT_STATUS(node_id, zephyr_greybus_bundle_power_supply, okay),     \
+		 CONFIG_GREYBUS_POWER_SUPPLY)
+
+#define _GB_BUNDLE_HID_OR_POWER_SUPPLY(node_id)                                                    \
+	COND_CODE_1(_GB_BUNDLE_HID_CHECK(node_id), (GREYBUS_CLASS_HID),                            \
+		    (IF_ENABLED(_GB_BUNDLE_POWER_SUPPLY_CHECK(node_id),                            \
+				(GREYBUS_CLASS_POWER_SUPPLY))))
+
+#define _GB_BUNDLE_MEDIA_OR_HID(node_id)                                                           \
+	COND_CODE_1(_GB_BUNDLE_AUDIO_CHECK(node_id), (GREYBUS_CLASS_AUDIO),                        \
+		    (COND_CODE_1(_GB_BUNDLE_CAMERA_CHECK(node_id), (GREYBUS_CLASS_CAMERA),         \
+				 (_GB_BUNDLE_HID_OR_POWER_SUPPLY(node_id)))))
+
 #define _GB_BUNDLE_CB(node_id)                                                                     \
 	COND_CODE_1(_GB_BUNDLE_BRIDGED_PHY_CHECK(node_id), (GREYBUS_CLASS_BRIDGED_PHY),            \
 		    (COND_CODE_1(_GB_BUNDLE_LIGHTS_CHECK(node_id), (GREYBUS_CLASS_LIGHTS),         \
-				 (IF_ENABLED(_GB_BUNDLE_VIBRATORS_CHECK(node_id),                  \
-					     (GREYBUS_CLASS_VIBRATOR))))))
+				 (COND_CODE_1(_GB_BUNDLE_VIBRATORS_CHECK(node_id),                 \
+					      (GREYBUS_CLASS_VIBRATOR),                            \
+					      (_GB_BUNDLE_MEDIA_OR_HID(node_id)))))))
 
 /* Position = Bundle ID. Value = Class */
 static uint8_t bundles[] = {
@@ -191,6 +221,57 @@ int manifest_create(uint8_t buf[], size_t len)
 	return manifest_size();
 }
 
+/*
+ * The manifest only depends on build time configuration, so the GET_MANIFEST response is generated
+ * once and served from here afterwards. It lives on the greybus heap, so that transports queue it
+ * by reference instead of copying it.
+ */
+static struct gb_message *manifest_resp;
+
+BUILD_ASSERT(sizeof(struct gb_operation_msg_hdr) + GREYBUS_MANIFEST_SIZE <= UINT16_MAX,
+	     "Manifest too large");
+
+/*
+ * Helper to generate the GET_MANIFEST response on first use
+ */
+static struct gb_message *manifest_response_get(void)
+{
+	if (!manifest_resp) {
+		manifest_resp = gb_message_alloc(GREYBUS_MANIFEST_SIZE,
+						 GB_RESPONSE(GB_CONTROL_TYPE_GET_MANIFEST), 0,
+						 GB_OP_SUCCESS);
+		if (manifest_resp) {
+			manifest_create(manifest_resp->payload, GREYBUS_MANIFEST_SIZE);
+		}
+	}
+
+	return manifest_resp;
+}
+
+struct gb_message *manifest_response(uint16_t operation_id)
+{
+	struct gb_message *msg = manifest_response_get();
+
+	if (!msg) {
+		return NULL;
+	}
+
+	/* A previous response still queued in the transport must keep its operation id */
+	msg = gb_message_is_shared(msg) ? gb_message_copy(msg) : gb_message_ref(msg);
+	if (msg) {
+		msg->header.operation_id = operation_id;
+	}
+
+	return msg;
+}
+
+uint32_t manifest_hash(void)
+{
+	const struct gb_message *msg = manifest_response_get();
+
+	return msg ? crc32_ieee(msg->payload, GREYBUS_MANIFEST_SIZE) : 0;
+}
+
 void manifest_print(uint8_t buf[])
 {
 	size_t i;
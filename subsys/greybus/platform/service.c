@@ -5,6 +5,7 @@
  */
 
 #include <zephyr/init.h>
+#include <zephyr/kernel.h>
 #include <greybus/greybus.h>
 #include <greybus-utils/manifest.h>
 #include "../greybus_transport.h"
@@ -15,7 +16,11 @@ LOG_MODULE_REGISTER(greybus_service, CONFIG_GREYBUS_LOG_LEVEL);
 
 #include "certificate.h"
 
-int greybus_service_init(void)
+/* Given once init finished. Waiters give it back, so that it stays available. */
+static K_SEM_DEFINE(gb_service_done, 0, 1);
+static int gb_service_status;
+
+static int gb_service_start(void)
 {
 	int r;
 	const struct gb_transport_backend *xport = gb_transport_get_backend();
@@ -42,6 +47,43 @@ int greybus_service_init(void)
 	return 0;
 }
 
-#ifdef CONFIG_GREYBUS_SERVICE
+int greybus_service_init(void)
+{
+	gb_service_status = gb_service_start();
+	k_sem_give(&gb_service_done);
+
+	return gb_service_status;
+}
+
+int greybus_service_wait(k_timeout_t timeout)
+{
+	int ret;
+
+	ret = k_sem_take(&gb_service_done, timeout);
+	if (ret < 0) {
+		return ret;
+	}
+	k_sem_give(&gb_service_done);
+
+	return gb_service_status;
+}
+
+#ifdef CONFIG_GREYBUS_SERVICE_ASYNC
+static void gb_service_init_work_handler(struct k_work *work)
+{
+	greybus_service_init();
+}
+
+static K_WORK_DEFINE(gb_service_init_work, gb_service_init_work_handler);
+
+static int gb_service_init_async(void)
+{
+	k_work_submit(&gb_service_init_work);
+
+	return 0;
+}
+
+SYS_INIT(gb_service_init_async, APPLICATION, CONFIG_GREYBUS_SERVICE_INIT_PRIORITY);
+#elif defined(CONFIG_GREYBUS_SERVICE)
 SYS_INIT(greybus_service_init, APPLICATION, CONFIG_GREYBUS_SERVICE_INIT_PRIORITY);
-#endif // CONFIG_GREYBUS_SERVICE
+#endif // CONFIG_GREYBUS_SERVICE_ASYNC
@@ -26,420 +26,616 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <errno.h>
-#include <stdlib.h>
 #include <string.h>
-
+#include <zephyr/drivers/charger.h>
+#include <zephyr/drivers/fuel_gauge.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
 #include <zephyr/sys/byteorder.h>
-#include <greybus/greybus.h>
-
-#include "power_supply-gb.h"
-#include <device_power_supply.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/greybus_messages.h>
+#include <greybus-utils/manifest.h>
+#include "greybus-manifest.h"
+#include "greybus_cport.h"
+#include "greybus_transport.h"
+#include "greybus_internal.h"
+#include "greybus_power_supply.h"
 
-#include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(greybus_power, CONFIG_GREYBUS_LOG_LEVEL);
 
-/* Version of the Greybus power supply protocol we support */
-#define GB_POWER_SUPPLY_VERSION_MAJOR 0x00
-#define GB_POWER_SUPPLY_VERSION_MINOR 0x01
-
-#define DESC_LEN 32
+/* Zero Celsius in tenths of Kelvin */
+#define GB_POWER_SUPPLY_ZERO_CELSIUS_DK 2731
 
-/**
- * Power supply protocol private information.
- */
-struct gb_power_supply_info {
-	/** CPort from greybus */
-	unsigned int cport;
+/* Mapping of a Greybus property to a fuel gauge or charger property */
+struct gb_power_supply_prop {
+	uint8_t property;
+	uint16_t prop;
+	bool writeable;
+	/* Changes of the value are pushed to the AP */
+	bool notify;
 };
 
-/**
- * @brief Event callback function for power supply device driver.
- *
- * @param data pointer to gb_power_supply_info
- * @param psy_id Power supply identification number.
- * @param event Event type.
- * @return 0 on success, negative errno on error.
- */
-static int event_callback(void *data, uint8_t psy_id, uint8_t event)
-{
-	struct gb_operation *operation;
-	struct gb_power_supply_event_request *request;
-	struct gb_power_supply_info *info;
-
-	DEBUGASSERT(data);
-	info = data;
-
-	operation = gb_operation_create(info->cport, GB_POWER_SUPPLY_TYPE_EVENT, sizeof(*request));
-	if (!operation) {
-		return -ENOMEM;
-	}
+/* The battery status is derived from the current */
+static const struct gb_power_supply_prop gb_fuel_gauge_props[] = {
+	{GB_POWER_SUPPLY_PROP_STATUS, FUEL_GAUGE_CURRENT, false, true},
+	{GB_POWER_SUPPLY_PROP_PRESENT, FUEL_GAUGE_PRESENT_STATE, false, true},
+	{GB_POWER_SUPPLY_PROP_CAPACITY, FUEL_GAUGE_RELATIVE_STATE_OF_CHARGE, false, true},
+	{GB_POWER_SUPPLY_PROP_CYCLE_COUNT, FUEL_GAUGE_CYCLE_COUNT, false, false},
+	{GB_POWER_SUPPLY_PROP_VOLTAGE_MAX_DESIGN, FUEL_GAUGE_DESIGN_VOLTAGE, false, false},
+	{GB_POWER_SUPPLY_PROP_VOLTAGE_NOW, FUEL_GAUGE_VOLTAGE, false, false},
+	{GB_POWER_SUPPLY_PROP_CURRENT_NOW, FUEL_GAUGE_CURRENT, false, false},
+	{GB_POWER_SUPPLY_PROP_CURRENT_AVG, FUEL_GAUGE_AVG_CURRENT, false, false},
+	{GB_POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN, FUEL_GAUGE_DESIGN_CAPACITY, false, false},
+	{GB_POWER_SUPPLY_PROP_CHARGE_FULL, FUEL_GAUGE_FULL_CHARGE_CAPACITY, false, false},
+	{GB_POWER_SUPPLY_PROP_CHARGE_NOW, FUEL_GAUGE_REMAINING_CAPACITY, false, false},
+	{GB_POWER_SUPPLY_PROP_TEMP, FUEL_GAUGE_TEMPERATURE, false, false},
+	{GB_POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW, FUEL_GAUGE_RUNTIME_TO_EMPTY, false, false},
+	{GB_POWER_SUPPLY_PROP_TIME_TO_FULL_NOW, FUEL_GAUGE_RUNTIME_TO_FULL, false, false},
+};
 
-	request = gb_operation_get_request_payload(operation);
-	request->psy_id = psy_id;
-	request->event = event;
+static const struct gb_power_supply_prop gb_charger_props[] = {
+	{GB_POWER_SUPPLY_PROP_STATUS, CHARGER_PROP_STATUS, false, true},
+	{GB_POWER_SUPPLY_PROP_CHARGE_TYPE, CHARGER_PROP_CHARGE_TYPE, false, false},
+	{GB_POWER_SUPPLY_PROP_HEALTH, CHARGER_PROP_HEALTH, false, true},
+	{GB_POWER_SUPPLY_PROP_PRESENT, CHARGER_PROP_PRESENT, false, true},
+	{GB_POWER_SUPPLY_PROP_ONLINE, CHARGER_PROP_ONLINE, false, true},
+	{GB_POWER_SUPPLY_PROP_CONSTANT_CHARGE_CURRENT, CHARGER_PROP_CONSTANT_CHARGE_CURRENT_UA,
+	 true, false},
+	{GB_POWER_SUPPLY_PROP_CONSTANT_CHARGE_VOLTAGE, CHARGER_PROP_CONSTANT_CHARGE_VOLTAGE_UV,
+	 true, false},
+	{GB_POWER_SUPPLY_PROP_INPUT_CURRENT_LIMIT, CHARGER_PROP_INPUT_REGULATION_CURRENT_UA,
+	 true, false},
+	{GB_POWER_SUPPLY_PROP_CHARGE_TERM_CURRENT, CHARGER_PROP_CHARGE_TERM_CURRENT_UA,
+	 true, false},
+};
 
-	gb_operation_send_request_nowait(operation, false);
-	gb_operation_destroy(operation);
+BUILD_ASSERT(ARRAY_SIZE(gb_fuel_gauge_props) <= GB_POWER_SUPPLY_PROPS_MAX);
+BUILD_ASSERT(ARRAY_SIZE(gb_charger_props) <= GB_POWER_SUPPLY_PROPS_MAX);
 
-	return 0;
+static const struct gb_power_supply_prop *
+gb_power_supply_prop_get(const struct gb_power_supply *psy, uint8_t idx)
+{
+	return psy->charger ? &gb_charger_props[psy->props[idx]]
+			    : &gb_fuel_gauge_props[psy->props[idx]];
 }
 
-/**
- * @brief Protocol get version function.
- *
- * Returns the major and minor Greybus power supply protocol version number
- * supported by the power supply controller.
- *
- * @param operation The pointer to structure of Greybus operation message
- * @return GB_OP_SUCCESS on success, error code on failure.
- */
-static uint8_t gb_power_supply_version(struct gb_operation *operation)
+/* Converts to the units of the Linux power supply class */
+static uint32_t gb_fuel_gauge_value(uint8_t property, const union fuel_gauge_prop_val *val)
 {
-	struct gb_power_supply_version_response *response;
-
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	switch (property) {
+	case GB_POWER_SUPPLY_PROP_STATUS:
+		if (val->current > 0) {
+			return GB_POWER_SUPPLY_STATUS_CHARGING;
+		}
+		return val->current < 0 ? GB_POWER_SUPPLY_STATUS_DISCHARGING
+					: GB_POWER_SUPPLY_STATUS_NOT_CHARGING;
+	case GB_POWER_SUPPLY_PROP_PRESENT:
+		return val->present_state;
+	case GB_POWER_SUPPLY_PROP_CAPACITY:
+		return val->relative_state_of_charge;
+	case GB_POWER_SUPPLY_PROP_CYCLE_COUNT:
+		return val->cycle_count;
+	case GB_POWER_SUPPLY_PROP_VOLTAGE_MAX_DESIGN:
+		return val->design_volt * 1000U;
+	case GB_POWER_SUPPLY_PROP_VOLTAGE_NOW:
+		return val->voltage;
+	case GB_POWER_SUPPLY_PROP_CURRENT_NOW:
+		return val->current;
+	case GB_POWER_SUPPLY_PROP_CURRENT_AVG:
+		return val->avg_current;
+	case GB_POWER_SUPPLY_PROP_CHARGE_FULL_DESIGN:
+		return val->design_cap * 1000U;
+	case GB_POWER_SUPPLY_PROP_CHARGE_FULL:
+		return val->full_charge_capacity;
+	case GB_POWER_SUPPLY_PROP_CHARGE_NOW:
+		return val->remaining_capacity;
+	case GB_POWER_SUPPLY_PROP_TEMP:
+		return (int32_t)val->temperature - GB_POWER_SUPPLY_ZERO_CELSIUS_DK;
+	case GB_POWER_SUPPLY_PROP_TIME_TO_EMPTY_NOW:
+		return val->runtime_to_empty * 60U;
+	case GB_POWER_SUPPLY_PROP_TIME_TO_FULL_NOW:
+		return val->runtime_to_full * 60U;
+	default:
+		return 0;
 	}
-
-	response->major = GB_POWER_SUPPLY_VERSION_MAJOR;
-	response->minor = GB_POWER_SUPPLY_VERSION_MINOR;
-
-	return GB_OP_SUCCESS;
 }
 
-/**
- * @brief Protocol gets power supply devices.
- *
- * Returns a value indicating the number of devices that this power supply
- * adapter controls.
- *
- * @param operation The pointer to structure of Greybus operation message
- * @return GB_OP_SUCCESS on success, error code on failure.
- */
-static uint8_t gb_power_supply_get_supplies(struct gb_operation *operation)
+static uint32_t gb_charger_health(enum charger_health health)
 {
-	struct gb_power_supply_get_supplies_response *response;
-	struct gb_bundle *bundle;
-	int ret = 0;
-	uint8_t supplies_count = 0;
-
-	bundle = gb_operation_get_bundle(operation);
-	DEBUGASSERT(bundle);
-
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	switch (health) {
+	case CHARGER_HEALTH_GOOD:
+		return GB_POWER_SUPPLY_HEALTH_GOOD;
+	case CHARGER_HEALTH_OVERHEAT:
+	case CHARGER_HEALTH_HOT:
+		return GB_POWER_SUPPLY_HEALTH_OVERHEAT;
+	case CHARGER_HEALTH_OVERVOLTAGE:
+		return GB_POWER_SUPPLY_HEALTH_OVERVOLTAGE;
+	case CHARGER_HEALTH_UNSPEC_FAILURE:
+		return GB_POWER_SUPPLY_HEALTH_UNSPEC_FAILURE;
+	case CHARGER_HEALTH_COLD:
+		return GB_POWER_SUPPLY_HEALTH_COLD;
+	case CHARGER_HEALTH_WATCHDOG_TIMER_EXPIRE:
+		return GB_POWER_SUPPLY_HEALTH_WATCHDOG_TIMER_EXPIRE;
+	case CHARGER_HEALTH_SAFETY_TIMER_EXPIRE:
+		return GB_POWER_SUPPLY_HEALTH_SAFETY_TIMER_EXPIRE;
+	default:
+		return GB_POWER_SUPPLY_HEALTH_UNKNOWN;
 	}
+}
 
-	ret = device_power_supply_get_supplies(bundle->dev, &supplies_count);
+/* The charger status and charge type follow the Linux power supply class values */
+static uint32_t gb_charger_value(uint8_t property, const union charger_propval *val)
+{
+	switch (property) {
+	case GB_POWER_SUPPLY_PROP_STATUS:
+		return val->status;
+	case GB_POWER_SUPPLY_PROP_CHARGE_TYPE:
+		return val->charge_type;
+	case GB_POWER_SUPPLY_PROP_HEALTH:
+		return gb_charger_health(val->health);
+	case GB_POWER_SUPPLY_PROP_PRESENT:
+		return val->present;
+	case GB_POWER_SUPPLY_PROP_ONLINE:
+		return val->online != CHARGER_ONLINE_OFFLINE;
+	case GB_POWER_SUPPLY_PROP_CONSTANT_CHARGE_CURRENT:
+		return val->const_charge_current_ua;
+	case GB_POWER_SUPPLY_PROP_CONSTANT_CHARGE_VOLTAGE:
+		return val->const_charge_voltage_uv;
+	case GB_POWER_SUPPLY_PROP_INPUT_CURRENT_LIMIT:
+		return val->input_current_regulation_current_ua;
+	case GB_POWER_SUPPLY_PROP_CHARGE_TERM_CURRENT:
+		return val->charge_term_current_ua;
+	default:
+		return 0;
+	}
+}
 
-	response->supplies_count = supplies_count;
+/* Keep the properties the device answers */
+static void gb_power_supply_probe(struct gb_power_supply *psy)
+{
+	int ret;
+	union fuel_gauge_prop_val fg_val;
+	union charger_propval chg_val;
+	const size_t count = psy->charger ? ARRAY_SIZE(gb_charger_props)
+					  : ARRAY_SIZE(gb_fuel_gauge_props);
+
+	psy->props_count = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (psy->charger) {
+			ret = charger_get_prop(psy->dev, gb_charger_props[i].prop, &chg_val);
+		} else {
+			ret = fuel_gauge_get_prop(psy->dev, gb_fuel_gauge_props[i].prop, &fg_val);
+		}
+
+		if (ret == 0) {
+			psy->props[psy->props_count++] = i;
+		}
+	}
 
-	return gb_errno_to_op_result(ret);
+	psy->probed = true;
+	LOG_DBG("%s: %u properties", psy->name, psy->props_count);
 }
 
-/**
- * @brief Protocol gets a set of configuration parameters.
+/*
+ * Read all properties of a supply, fuel gauge properties in a single call. Must be called with
+ * the lock held.
  *
- * Returns set of values related to a specific power supply device defined
- * by psy_id in the power supply controller.
- *
- * @param operation - pointer to structure of Greybus operation message
- * @return GB_OP_SUCCESS on success, error code on failure.
+ * @return true if a value the AP is notified about changed.
  */
-static uint8_t gb_power_supply_get_description(struct gb_operation *operation)
+static bool gb_power_supply_refresh(struct gb_power_supply *psy)
 {
-	struct gb_power_supply_get_description_request *request;
-	struct gb_power_supply_get_description_response *response;
-	struct gb_bundle *bundle;
-	struct power_supply_description description;
 	int ret = 0;
-
-	bundle = gb_operation_get_bundle(operation);
-	DEBUGASSERT(bundle);
-
-	request = gb_operation_get_request_payload(operation);
-
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return GB_OP_INVALID;
+	bool changed = false;
+	uint32_t value;
+	union charger_propval chg_val;
+	fuel_gauge_prop_t fg_props[GB_POWER_SUPPLY_PROPS_MAX];
+	union fuel_gauge_prop_val fg_vals[GB_POWER_SUPPLY_PROPS_MAX];
+	const struct gb_power_supply_prop *prop;
+
+	if (!psy->probed) {
+		gb_power_supply_probe(psy);
 	}
 
-	ret = device_power_supply_get_description(bundle->dev, request->psy_id, &description);
-	if (ret) {
-		return gb_errno_to_op_result(ret);
+	if (!psy->charger) {
+		for (uint8_t i = 0; i < psy->props_count; i++) {
+			fg_props[i] = gb_power_supply_prop_get(psy, i)->prop;
+		}
+
+		ret = fuel_gauge_get_props(psy->dev, fg_props, fg_vals, psy->props_count);
+		if (ret < 0) {
+			LOG_ERR("%s: failed to read properties: %d", psy->name, ret);
+			return false;
+		}
 	}
 
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	for (uint8_t i = 0; i < psy->props_count; i++) {
+		prop = gb_power_supply_prop_get(psy, i);
+
+		if (psy->charger) {
+			ret = charger_get_prop(psy->dev, prop->prop, &chg_val);
+			if (ret < 0) {
+				continue;
+			}
+			value = gb_charger_value(prop->property, &chg_val);
+		} else {
+			value = gb_fuel_gauge_value(prop->property, &fg_vals[i]);
+		}
+
+		if (value != psy->values[i]) {
+			changed |= prop->notify && psy->updated_ms != 0;
+			psy->values[i] = value;
+		}
 	}
 
-	memcpy(response->manufacturer, description.manufacturer, DESC_LEN);
-	memcpy(response->model, description.model, DESC_LEN);
-	memcpy(response->serial_number, description.serial_number, DESC_LEN);
-	response->type = sys_cpu_to_le16(description.type);
-	response->properties_count = description.properties_count;
+	/* Never zero, which marks a supply that was never refreshed */
+	psy->updated_ms = MAX(k_uptime_get(), 1);
 
-	return GB_OP_SUCCESS;
+	return changed;
 }
 
-/**
- * @brief Protocol gets the set of properties supported.
- *
- * Returns the number of property descriptors and set of descriptors related to
- * a specific power supply device defined by psy_id in the power supply
- * controller.
- *
- * @param operation - pointer to structure of Greybus operation message
- * @return GB_OP_SUCCESS on success, error code on failure.
+/*
+ * Refresh a supply whose values are older than the staleness bound. Must be called with the lock
+ * held.
  */
-static uint8_t gb_power_supply_get_prop_descriptors(struct gb_operation *operation)
+static void gb_power_supply_cache_update(struct gb_power_supply *psy)
 {
-	struct gb_power_supply_get_property_descriptors_request *request;
-	struct gb_power_supply_get_property_descriptors_response *response;
-	struct gb_bundle *bundle;
-	struct power_supply_props_desc *descriptors;
-	int i = 0, ret = 0;
-	uint8_t properties_count = 0;
-
-	bundle = gb_operation_get_bundle(operation);
-	DEBUGASSERT(bundle);
+	if (psy->updated_ms == 0 ||
+	    k_uptime_get() - psy->updated_ms > CONFIG_GREYBUS_POWER_SUPPLY_MAX_AGE_MS) {
+		gb_power_supply_refresh(psy);
+	}
+}
 
-	request = gb_operation_get_request_payload(operation);
+struct gb_power_supply_event_request_msg {
+	struct gb_operation_msg_hdr hdr;
+	struct gb_power_supply_event_request body;
+} __packed;
 
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
-		LOG_ERR("dropping short message");
-		return GB_OP_INVALID;
+static void gb_power_supply_event_send(uint16_t cport, uint8_t psy_id)
+{
+	int ret;
+	uint8_t buf[sizeof(struct gb_power_supply_event_request_msg)] = {0};
+	struct gb_power_supply_event_request_msg *msg =
+		(struct gb_power_supply_event_request_msg *)buf;
+
+	msg->hdr.size = sys_cpu_to_le16(sizeof(buf));
+	msg->hdr.type = GB_POWER_SUPPLY_TYPE_EVENT;
+	msg->body.psy_id = psy_id;
+	msg->body.event = GB_POWER_SUPPLY_UPDATE;
+
+	ret = gb_transport_message_send((const struct gb_message *)buf, cport);
+	if (ret < 0) {
+		LOG_ERR("Power supply event send failed: %d", ret);
 	}
+}
 
-	ret = device_power_supply_get_properties_count(bundle->dev, request->psy_id,
-						       &properties_count);
-	if (ret) {
-		return gb_errno_to_op_result(ret);
+static void gb_power_supply_refresh_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct gb_power_supply_driver_data *data =
+		CONTAINER_OF(dwork, struct gb_power_supply_driver_data, refresh_work);
+	bool changed;
+
+	for (uint8_t i = 0; i < data->supplies_count; i++) {
+		k_mutex_lock(&data->lock, K_FOREVER);
+		changed = gb_power_supply_refresh(&data->supplies[i]);
+		k_mutex_unlock(&data->lock);
+
+		if (changed) {
+			gb_power_supply_event_send(data->cport, i);
+		}
 	}
 
-	descriptors = malloc(properties_count * sizeof(*descriptors));
-	if (!descriptors) {
-		return GB_OP_NO_MEMORY;
+	if (CONFIG_GREYBUS_POWER_SUPPLY_POLL_INTERVAL_MS > 0 && data->connected) {
+		k_work_schedule(dwork, K_MSEC(CONFIG_GREYBUS_POWER_SUPPLY_POLL_INTERVAL_MS));
 	}
+}
 
-	ret = device_power_supply_get_prop_descriptors(bundle->dev, request->psy_id, descriptors);
-	if (ret) {
-		free(descriptors);
-		return gb_errno_to_op_result(ret);
+/* Charger notifications carry no user data, refresh all power supply bundles */
+static void gb_power_supply_notify_work_handler(struct k_work *work)
+{
+	const struct gb_cport *cport;
+	struct gb_power_supply_driver_data *data;
+
+	for (uint16_t i = 0; i < GREYBUS_CPORT_COUNT; i++) {
+		cport = gb_cport_get(i);
+		if (cport->protocol != GREYBUS_PROTOCOL_POWER_SUPPLY) {
+			continue;
+		}
+
+		data = (struct gb_power_supply_driver_data *)cport->priv;
+		if (data->connected) {
+			k_work_reschedule(&data->refresh_work, K_NO_WAIT);
+		}
 	}
+}
 
-	response = gb_operation_alloc_response(
-		operation, sizeof(*response) + properties_count * sizeof(*descriptors));
-	if (!response) {
-		free(descriptors);
-		return GB_OP_NO_MEMORY;
-	}
+static K_WORK_DEFINE(gb_power_supply_notify_work, gb_power_supply_notify_work_handler);
 
-	response->properties_count = properties_count;
-	for (i = 0; i < properties_count; i++) {
-		response->props[i].property = descriptors[i].property;
-		response->props[i].is_writeable = descriptors[i].is_writeable;
-	}
+static void gb_power_supply_status_cb(enum charger_status status)
+{
+	k_work_submit(&gb_power_supply_notify_work);
+}
 
-	free(descriptors);
+static void gb_power_supply_online_cb(enum charger_online online)
+{
+	k_work_submit(&gb_power_supply_notify_work);
+}
 
-	return GB_OP_SUCCESS;
+static struct gb_power_supply *gb_power_supply_get(struct gb_power_supply_driver_data *data,
+						   uint8_t psy_id)
+{
+	return psy_id < data->supplies_count ? &data->supplies[psy_id] : NULL;
 }
 
-/**
- * @brief Protocol gets the current value of a property.
- *
- * Returns the current value of a property in a specific psy_id in the power
- * supply device.
- *
- * @param operation - pointer to structure of Greybus operation message
- * @return GB_OP_SUCCESS on success, error code on failure.
- */
-static uint8_t gb_power_supply_get_property(struct gb_operation *operation)
+static void gb_power_supply_get_supplies(uint16_t cport, struct gb_message *req,
+					 struct gb_power_supply_driver_data *data)
 {
-	struct gb_power_supply_get_property_request *request;
-	struct gb_power_supply_get_property_response *response;
-	struct gb_bundle *bundle;
-	int ret = 0;
-	uint32_t prop_val = 0;
-	uint8_t property = 0;
+	const struct gb_power_supply_get_supplies_response resp_data = {
+		.supplies_count = data->supplies_count,
+	};
 
-	bundle = gb_operation_get_bundle(operation);
-	DEBUGASSERT(bundle);
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
+}
 
-	request = gb_operation_get_request_payload(operation);
+static void gb_power_supply_get_description(uint16_t cport, struct gb_message *req,
+					    struct gb_power_supply_driver_data *data)
+{
+	struct gb_power_supply *psy;
+	struct gb_power_supply_get_description_response resp_data = {0};
+	const struct gb_power_supply_get_description_request *req_data =
+		(const struct gb_power_supply_get_description_request *)req->payload;
 
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
 		LOG_ERR("dropping short message");
-		return GB_OP_INVALID;
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	property = request->property;
-	ret = device_power_supply_get_property(bundle->dev, request->psy_id, property, &prop_val);
-	if (ret) {
-		return gb_errno_to_op_result(ret);
+	psy = gb_power_supply_get(data, req_data->psy_id);
+	if (!psy) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
-	}
+	strncpy((char *)resp_data.model, psy->name, sizeof(resp_data.model) - 1);
+	resp_data.type = sys_cpu_to_le16(psy->charger ? GB_POWER_SUPPLY_MAINS_TYPE
+						      : GB_POWER_SUPPLY_BATTERY_TYPE);
 
-	response->prop_val = sys_cpu_to_le32(prop_val);
+	k_mutex_lock(&data->lock, K_FOREVER);
+	gb_power_supply_cache_update(psy);
+	resp_data.properties_count = psy->props_count;
+	k_mutex_unlock(&data->lock);
 
-	return GB_OP_SUCCESS;
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-/**
- * @brief Protocol sets the current value of a property.
- *
- * It sets the value of a given property in a specified psy_id, if the property
- * is not described in is descriptor as writable, this operation shall be
- * discarded.
- *
- * @param operation - pointer to structure of Greybus operation message
- * @return GB_OP_SUCCESS on success, error code on failure.
- */
-static uint8_t gb_power_supply_set_property(struct gb_operation *operation)
+static void gb_power_supply_get_prop_descriptors(uint16_t cport, struct gb_message *req,
+						 struct gb_power_supply_driver_data *data)
 {
-	struct gb_power_supply_set_property_request *request;
-	struct gb_bundle *bundle;
-	int ret = 0;
-	uint32_t prop_val = 0;
-	uint8_t property = 0;
-
-	bundle = gb_operation_get_bundle(operation);
-	DEBUGASSERT(bundle);
-
-	request = gb_operation_get_request_payload(operation);
-
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
+	struct gb_power_supply *psy;
+	const struct gb_power_supply_prop *prop;
+	uint8_t buf[sizeof(struct gb_power_supply_get_property_descriptors_response) +
+		    GB_POWER_SUPPLY_PROPS_MAX * sizeof(struct gb_power_supply_props_desc)];
+	struct gb_power_supply_get_property_descriptors_response *resp_data =
+		(struct gb_power_supply_get_property_descriptors_response *)buf;
+	const struct gb_power_supply_get_property_descriptors_request *req_data =
+		(const struct gb_power_supply_get_property_descriptors_request *)req->payload;
+
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
 		LOG_ERR("dropping short message");
-		return GB_OP_INVALID;
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	psy = gb_power_supply_get(data, req_data->psy_id);
+	if (!psy) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	property = request->property;
-	prop_val = sys_le32_to_cpu(request->prop_val);
-	ret = device_power_supply_set_property(bundle->dev, request->psy_id, property, prop_val);
-	if (ret) {
-		return gb_errno_to_op_result(ret);
+	k_mutex_lock(&data->lock, K_FOREVER);
+	gb_power_supply_cache_update(psy);
+	resp_data->properties_count = psy->props_count;
+	for (uint8_t i = 0; i < psy->props_count; i++) {
+		prop = gb_power_supply_prop_get(psy, i);
+		resp_data->props[i].property = prop->property;
+		resp_data->props[i].is_writeable = prop->writeable;
 	}
+	k_mutex_unlock(&data->lock);
 
-	return GB_OP_SUCCESS;
+	gb_transport_message_response_success_send(
+		req, buf,
+		sizeof(*resp_data) + resp_data->properties_count * sizeof(resp_data->props[0]),
+		cport);
 }
 
-/**
- * @brief Greybus power supply protocol initialize function.
- *
- * This function performs the protocol initialization function, such as open
- * the cooperation device driver, attach callback, create buffers etc.
- *
- * @param cport CPort number.
- * @param bundle Greybus bundle handle
- * @return 0 on success, negative errno on error.
- */
-static int gb_power_supply_init(unsigned int cport, struct gb_bundle *bundle)
+/* Index of a property in the supply cache, or -1 if not supported */
+static int gb_power_supply_prop_find(const struct gb_power_supply *psy, uint8_t property)
 {
-	struct gb_power_supply_info *info;
-	int ret;
-
-	DEBUGASSERT(bundle);
-
-	info = zalloc(sizeof(*info));
-	if (info == NULL) {
-		return -ENOMEM;
+	for (uint8_t i = 0; i < psy->props_count; i++) {
+		if (gb_power_supply_prop_get(psy, i)->property == property) {
+			return i;
+		}
 	}
 
-	info->cport = cport;
+	return -1;
+}
 
-	bundle->dev = device_open(DEVICE_TYPE_POWER_SUPPLY_DEVICE, 0);
-	if (!bundle->dev) {
-		ret = -ENODEV;
-		goto err_free_info;
-	}
+/* Answered from the cache, only touching the device when it is older than the staleness bound */
+static void gb_power_supply_get_property(uint16_t cport, struct gb_message *req,
+					 struct gb_power_supply_driver_data *data)
+{
+	int idx;
+	struct gb_power_supply *psy;
+	struct gb_power_supply_get_property_response resp_data;
+	const struct gb_power_supply_get_property_request *req_data =
+		(const struct gb_power_supply_get_property_request *)req->payload;
 
-	ret = device_power_supply_attach_callback(bundle->dev, event_callback, info);
-	if (ret) {
-		goto err_close_device;
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	return 0;
+	psy = gb_power_supply_get(data, req_data->psy_id);
+	if (!psy) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
 
-err_close_device:
-	device_close(bundle->dev);
+	k_mutex_lock(&data->lock, K_FOREVER);
+	gb_power_supply_cache_update(psy);
+	idx = gb_power_supply_prop_find(psy, req_data->property);
+	if (idx >= 0) {
+		resp_data.prop_val = sys_cpu_to_le32(psy->values[idx]);
+	}
+	k_mutex_unlock(&data->lock);
 
-err_free_info:
-	free(info);
+	if (idx < 0) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
 
-	return ret;
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
 }
 
-/**
- * @brief Protocol exit function.
- *
- * This function can be called when protocol terminated.
- *
- * @param cport CPort number.
- * @param bundle Greybus bundle handle
- * @return None.
- */
-static void gb_power_supply_exit(unsigned int cport, struct gb_bundle *bundle)
+static int gb_charger_prop_set(const struct device *dev, const struct gb_power_supply_prop *prop,
+			       uint32_t value)
 {
-	struct gb_power_supply_info *info;
+	union charger_propval val;
+
+	switch (prop->property) {
+	case GB_POWER_SUPPLY_PROP_CONSTANT_CHARGE_CURRENT:
+		val.const_charge_current_ua = value;
+		break;
+	case GB_POWER_SUPPLY_PROP_CONSTANT_CHARGE_VOLTAGE:
+		val.const_charge_voltage_uv = value;
+		break;
+	case GB_POWER_SUPPLY_PROP_INPUT_CURRENT_LIMIT:
+		val.input_current_regulation_current_ua = value;
+		break;
+	case GB_POWER_SUPPLY_PROP_CHARGE_TERM_CURRENT:
+		val.charge_term_current_ua = value;
+		break;
+	default:
+		return -EINVAL;
+	}
 
-	DEBUGASSERT(bundle);
-	info = bundle->priv;
+	return charger_set_prop(dev, prop->prop, &val);
+}
 
-	DEBUGASSERT(cport == info->cport);
+static void gb_power_supply_set_property(uint16_t cport, struct gb_message *req,
+					 struct gb_power_supply_driver_data *data)
+{
+	int idx, ret = -EINVAL;
+	uint32_t value;
+	struct gb_power_supply *psy;
+	const struct gb_power_supply_prop *prop;
+	const struct gb_power_supply_set_property_request *req_data =
+		(const struct gb_power_supply_set_property_request *)req->payload;
+
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
 
-	device_power_supply_attach_callback(bundle->dev, NULL, NULL);
+	psy = gb_power_supply_get(data, req_data->psy_id);
+	if (!psy) {
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
 
-	device_close(bundle->dev);
+	value = sys_le32_to_cpu(req_data->prop_val);
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	gb_power_supply_cache_update(psy);
+	idx = gb_power_supply_prop_find(psy, req_data->property);
+	if (idx >= 0) {
+		prop = gb_power_supply_prop_get(psy, idx);
+		if (prop->writeable) {
+			ret = gb_charger_prop_set(psy->dev, prop, value);
+		}
+		if (ret == 0) {
+			psy->values[idx] = value;
+		}
+	}
+	k_mutex_unlock(&data->lock);
 
-	free(info);
-	info = NULL;
+	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
 }
 
-/**
- * @brief Greybus power supply protocol operation handler
- */
-static uint8_t gb_power_supply_handler(uint8_t type, struct gb_operation *opr)
+static void gb_power_supply_handler(const void *priv, struct gb_message *msg, uint16_t cport)
 {
-	switch (type) {
-	case GB_POWER_SUPPLY_TYPE_VERSION:
-		return gb_power_supply_version(opr);
+	struct gb_power_supply_driver_data *data = (struct gb_power_supply_driver_data *)priv;
+
+	switch (gb_message_type(msg)) {
 	case GB_POWER_SUPPLY_TYPE_GET_SUPPLIES:
-		return gb_power_supply_get_supplies(opr);
+		return gb_power_supply_get_supplies(cport, msg, data);
 	case GB_POWER_SUPPLY_TYPE_GET_DESCRIPTION:
-		return gb_power_supply_get_description(opr);
+		return gb_power_supply_get_description(cport, msg, data);
 	case GB_POWER_SUPPLY_TYPE_GET_PROP_DESCRIPTORS:
-		return gb_power_supply_get_prop_descriptors(opr);
+		return gb_power_supply_get_prop_descriptors(cport, msg, data);
 	case GB_POWER_SUPPLY_TYPE_GET_PROPERTY:
-		return gb_power_supply_get_property(opr);
+		return gb_power_supply_get_property(cport, msg, data);
 	case GB_POWER_SUPPLY_TYPE_SET_PROPERTY:
-		return gb_power_supply_set_property(opr);
+		return gb_power_supply_set_property(cport, msg, data);
 	default:
 		LOG_ERR("Invalid type");
-		return GB_OP_INVALID;
+		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
 	}
 }
 
-static struct gb_driver gb_power_supply_driver = {
-	.init = gb_power_supply_init,
-	.exit = gb_power_supply_exit,
+static void gb_power_supply_connected(const void *priv, uint16_t cport)
+{
+	struct gb_power_supply_driver_data *data = (struct gb_power_supply_driver_data *)priv;
+
+	data->cport = cport;
+	data->connected = true;
+
+	if (CONFIG_GREYBUS_POWER_SUPPLY_POLL_INTERVAL_MS > 0) {
+		k_work_schedule(&data->refresh_work,
+				K_MSEC(CONFIG_GREYBUS_POWER_SUPPLY_POLL_INTERVAL_MS));
+	}
+}
+
+static void gb_power_supply_disconnected(const void *priv)
+{
+	struct gb_power_supply_driver_data *data = (struct gb_power_supply_driver_data *)priv;
+	struct k_work_sync sync;
+
+	data->connected = false;
+	k_work_cancel_delayable_sync(&data->refresh_work, &sync);
+}
+
+const struct gb_driver gb_power_supply_driver = {
+	.connected = gb_power_supply_connected,
+	.disconnected = gb_power_supply_disconnected,
 	.op_handler = gb_power_supply_handler,
 };
 
-/**
- * @brief Register Greybus power supply protocol.
- *
- * @param cport CPort number
- */
-void gb_power_supply_register(int cport, int bundle)
+static int gb_power_supply_init(void)
 {
-	gb_register_driver(cport, bundle, &gb_power_supply_driver);
+	const struct gb_cport *cport;
+	struct gb_power_supply_driver_data *data;
+	const union charger_propval status_cb = {.status_notification = gb_power_supply_status_cb};
+	const union charger_propval online_cb = {.online_notification = gb_power_supply_online_cb};
+
+	for (uint16_t i = 0; i < GREYBUS_CPORT_COUNT; i++) {
+		cport = gb_cport_get(i);
+		if (cport->protocol != GREYBUS_PROTOCOL_POWER_SUPPLY) {
+			continue;
+		}
+
+		data = (struct gb_power_supply_driver_data *)cport->priv;
+		k_mutex_init(&data->lock);
+		k_work_init_delayable(&data->refresh_work, gb_power_supply_refresh_work_handler);
+
+		/* Not all chargers support notifications, these are then only seen by polling */
+		for (uint8_t j = 0; j < data->supplies_count; j++) {
+			if (!data->supplies[j].charger) {
+				continue;
+			}
+
+			charger_set_prop(data->supplies[j].dev, CHARGER_PROP_STATUS_NOTIFICATION,
+					 &status_cb);
+			charger_set_prop(data->supplies[j].dev, CHARGER_PROP_ONLINE_NOTIFICATION,
+					 &online_cb);
+		}
+	}
+
+	return 0;
 }
+
+SYS_INIT(gb_power_supply_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
@@ -128,6 +128,58 @@ static void gb_pwm_protocol_disable(uint16_t cport, struct gb_message *req,
 	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
 }
 
+#ifdef CONFIG_GREYBUS_PWM_BATCH
+/**
+ * @brief Configure and enable or disable several channels at once.
+ *
+ * The whole request is validated first, so that a bad entry does not leave the channels half
+ * updated.
+ */
+static void gb_pwm_protocol_batch(uint16_t cport, struct gb_message *req,
+				  struct gb_pwm_driver_data *data)
+{
+	const struct gb_pwm_batch_request *req_data =
+		(const struct gb_pwm_batch_request *)req->payload;
+	const struct gb_pwm_batch_entry *entry;
+	struct gb_pwm_channel_data *chan;
+	size_t i;
+	int ret;
+
+	if (gb_message_payload_len(req) < sizeof(*req_data) ||
+	    gb_message_payload_len(req) <
+		    sizeof(*req_data) + req_data->count * sizeof(req_data->entries[0])) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	for (i = 0; i < req_data->count; i++) {
+		if (req_data->entries[i].which >= data->channel_num) {
+			return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+		}
+	}
+
+	for (i = 0; i < req_data->count; i++) {
+		entry = &req_data->entries[i];
+		chan = &data->channel_data[entry->which];
+
+		chan->duty = sys_le32_to_cpu(entry->duty);
+		chan->period = sys_le32_to_cpu(entry->period);
+		chan->polarity = entry->flags & GB_PWM_BATCH_FLAG_INVERTED;
+
+		ret = pwm_set(data->dev, entry->which, chan->period,
+			      (entry->flags & GB_PWM_BATCH_FLAG_ENABLE) ? chan->duty : 0,
+			      (chan->polarity) ? PWM_POLARITY_INVERTED : PWM_POLARITY_NORMAL);
+		if (ret < 0) {
+			LOG_ERR("Failed to set channel %u: %d", entry->which, ret);
+			return gb_transport_message_empty_response_send(
+				req, gb_errno_to_op_result(ret), cport);
+		}
+	}
+
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+#endif // CONFIG_GREYBUS_PWM_BATCH
+
 /*
  * This structure is to define each PWM protocol operation of handling function.
  */
@@ -150,6 +202,10 @@ static void gb_pwm_handler(const void *priv, struct gb_message *msg, uint16_t cp
 		return gb_pwm_protocol_enable(cport, msg, data);
 	case GB_PWM_TYPE_DISABLE:
 		return gb_pwm_protocol_disable(cport, msg, data);
+#ifdef CONFIG_GREYBUS_PWM_BATCH
+	case GB_PWM_TYPE_VENDOR_BATCH:
+		return gb_pwm_protocol_batch(cport, msg, data);
+#endif // CONFIG_GREYBUS_PWM_BATCH
 	default:
 		LOG_ERR("Invalid type");
 		return gb_transport_message_empty_response_send(msg, GB_OP_PROTOCOL_BAD, cport);
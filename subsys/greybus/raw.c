@@ -13,6 +13,9 @@
 #include "greybus_cport.h"
 #include <greybus/greybus.h>
 #include "greybus-manifest.h"
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(greybus_raw, CONFIG_GREYBUS_LOG_LEVEL);
 
 static void gb_raw_send_handler(uint16_t cport, struct gb_message *req,
 				const struct gb_raw_driver_data *data)
@@ -21,14 +24,87 @@ static void gb_raw_send_handler(uint16_t cport, struct gb_message *req,
 	const struct gb_raw_send_request *req_data =
 		(const struct gb_raw_send_request *)req->payload;
 
+	if (gb_message_payload_len(req) < sizeof(*req_data) ||
+	    sys_le32_to_cpu(req_data->len) > gb_message_payload_len(req) - sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
 	ret = data->cb(sys_le32_to_cpu(req_data->len), req_data->data, data->cb_priv);
 
 	gb_transport_message_empty_response_send(req, ret, cport);
 }
 
+#ifdef CONFIG_GREYBUS_RAW_DELIVERY_THREAD
+K_MSGQ_DEFINE(gb_raw_delivery_msgq, sizeof(struct gb_msg_with_cport),
+	      CONFIG_GREYBUS_RAW_DELIVERY_QUEUE_DEPTH, 4);
+
+static void gb_raw_delivery_thread_handler(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	struct gb_msg_with_cport item;
+
+	while (1) {
+		if (k_msgq_get(&gb_raw_delivery_msgq, &item, K_FOREVER) < 0) {
+			continue;
+		}
+
+		gb_raw_send_handler(item.cport, item.msg, gb_cport_get(item.cport)->priv);
+	}
+}
+
+K_THREAD_DEFINE(gb_raw_delivery_thread, CONFIG_GREYBUS_RAW_DELIVERY_STACK_SIZE,
+		gb_raw_delivery_thread_handler, NULL, NULL, NULL,
+		CONFIG_GREYBUS_RAW_DELIVERY_PRIORITY, 0, 0);
+
+static void gb_raw_send_queue(uint16_t cport, struct gb_message *req)
+{
+	const struct gb_msg_with_cport item = {
+		.cport = cport,
+		.msg = req,
+	};
+
+	if (k_msgq_put(&gb_raw_delivery_msgq, &item, K_NO_WAIT) < 0) {
+		LOG_WRN("Raw delivery queue full");
+		gb_transport_message_empty_response_send(req, GB_OP_NO_MEMORY, cport);
+	}
+}
+#endif // CONFIG_GREYBUS_RAW_DELIVERY_THREAD
+
+#ifdef CONFIG_GREYBUS_RAW_STREAM
+static void gb_raw_credits_handler(uint16_t cport, struct gb_message *req,
+				   struct gb_raw_driver_data *data)
+{
+	const struct gb_raw_credits_request *req_data =
+		(const struct gb_raw_credits_request *)req->payload;
+	uint16_t i;
+
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	for (i = 0; i < sys_le16_to_cpu(req_data->count); i++) {
+		k_sem_give(&data->credits);
+	}
+
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+
+/* Message whose payload holds the buffer returned by greybus_raw_buf_alloc() */
+static struct gb_message *gb_raw_buf_to_msg(uint8_t *buf)
+{
+	return (struct gb_message *)(buf - offsetof(struct gb_raw_send_request, data) -
+				     offsetof(struct gb_message, payload));
+}
+#endif // CONFIG_GREYBUS_RAW_STREAM
+
 static void op_handler(const void *priv, struct gb_message *msg, uint16_t cport)
 {
-	const struct gb_raw_driver_data *data = priv;
+	struct gb_raw_driver_data *data = (struct gb_raw_driver_data *)priv;
 
 	if (!data->cb) {
 		return gb_transport_message_empty_response_send(msg, GB_OP_INTERNAL, cport);
@@ -36,7 +112,15 @@ static void op_handler(const void *priv, struct gb_message *msg, uint16_t cport)
 
 	switch (gb_message_type(msg)) {
 	case GB_RAW_TYPE_SEND:
+#ifdef CONFIG_GREYBUS_RAW_DELIVERY_THREAD
+		return gb_raw_send_queue(cport, msg);
+#else
 		return gb_raw_send_handler(cport, msg, data);
+#endif // CONFIG_GREYBUS_RAW_DELIVERY_THREAD
+#ifdef CONFIG_GREYBUS_RAW_STREAM
+	case GB_RAW_TYPE_VENDOR_CREDITS:
+		return gb_raw_credits_handler(cport, msg, data);
+#endif // CONFIG_GREYBUS_RAW_STREAM
 	case GB_RESPONSE(GB_RAW_TYPE_SEND):
 		return gb_message_dealloc(msg);
 	default:
@@ -62,6 +146,10 @@ int greybus_raw_register(greybus_raw_cb_t cb, void *priv)
 
 		data = (struct gb_raw_driver_data *)cport->priv;
 		if (!data->cb) {
+#ifdef CONFIG_GREYBUS_RAW_STREAM
+			k_sem_init(&data->credits, CONFIG_GREYBUS_RAW_STREAM_CREDITS,
+				   K_SEM_MAX_LIMIT);
+#endif // CONFIG_GREYBUS_RAW_STREAM
 			data->cb = cb;
 			data->cb_priv = priv;
 
@@ -77,8 +165,16 @@ int greybus_raw_send_data(uint16_t id, uint32_t len, const uint8_t *data)
 	int ret;
 	uint16_t cport_id = GREYBUS_RAW_CPORT_START + id;
 	struct gb_raw_send_request *req_data;
-	struct gb_message *msg =
-		gb_message_request_alloc(sizeof(*req_data) + len, GB_RAW_TYPE_SEND, false);
+	struct gb_message *msg;
+
+	if (id >= GREYBUS_RAW_CPORT_COUNT) {
+		return -EINVAL;
+	}
+
+	msg = gb_cport_request_alloc(cport_id, sizeof(*req_data) + len, GB_RAW_TYPE_SEND);
+	if (!msg) {
+		return -ENOMEM;
+	}
 
 	req_data = (struct gb_raw_send_request *)msg->payload;
 
@@ -90,3 +186,66 @@ int greybus_raw_send_data(uint16_t id, uint32_t len, const uint8_t *data)
 
 	return ret;
 }
+
+#ifdef CONFIG_GREYBUS_RAW_STREAM
+uint8_t *greybus_raw_buf_alloc(uint32_t len)
+{
+	struct gb_raw_send_request *req_data;
+	struct gb_message *msg =
+		gb_message_request_alloc(sizeof(*req_data) + len, GB_RAW_TYPE_SEND, false);
+
+	if (!msg) {
+		return NULL;
+	}
+
+	req_data = (struct gb_raw_send_request *)msg->payload;
+
+	return req_data->data;
+}
+
+void greybus_raw_buf_free(uint8_t *buf)
+{
+	if (buf) {
+		gb_message_dealloc(gb_raw_buf_to_msg(buf));
+	}
+}
+
+int greybus_raw_send_buf(uint16_t id, uint8_t *buf, uint32_t len, k_timeout_t timeout)
+{
+	int ret;
+	uint16_t size;
+	uint16_t cport_id = GREYBUS_RAW_CPORT_START + id;
+	struct gb_message *msg = gb_raw_buf_to_msg(buf);
+	struct gb_raw_send_request *req_data = (struct gb_raw_send_request *)msg->payload;
+	struct gb_raw_driver_data *data;
+
+	if (id >= GREYBUS_RAW_CPORT_COUNT) {
+		return -EINVAL;
+	}
+
+	if (len > gb_message_payload_len(msg) - sizeof(*req_data)) {
+		return -EINVAL;
+	}
+
+	data = (struct gb_raw_driver_data *)gb_cport_get(cport_id)->priv;
+	if (k_sem_take(&data->credits, timeout) < 0) {
+		return -EAGAIN;
+	}
+
+	/* Only send the part of the buffer that was filled, the caller keeps all of it on error */
+	size = msg->header.size;
+	req_data->len = sys_cpu_to_le32(len);
+	msg->header.size = sizeof(struct gb_operation_msg_hdr) + sizeof(*req_data) + len;
+
+	ret = gb_transport_message_send(msg, cport_id);
+	if (ret < 0) {
+		msg->header.size = size;
+		k_sem_give(&data->credits);
+		return ret;
+	}
+
+	gb_message_dealloc(msg);
+
+	return 0;
+}
+#endif // CONFIG_GREYBUS_RAW_STREAM
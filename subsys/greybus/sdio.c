@@ -6,393 +6,539 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
-#include <zephyr/kernel.h>
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
-
-#include <zephyr/device.h>
 #include <zephyr/drivers/sdhc.h>
-#include <greybus/greybus.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
 #include <zephyr/sys/byteorder.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/greybus_messages.h>
+#include <greybus-utils/manifest.h>
+#include "greybus-manifest.h"
+#include "greybus_cport.h"
+#include "greybus_transport.h"
+#include "greybus_internal.h"
+#include "greybus_sdio.h"
 
-#include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(greybus_sdio, CONFIG_GREYBUS_LOG_LEVEL);
 
-#define GB_SDIO_VERSION_MAJOR 0
-#define GB_SDIO_VERSION_MINOR 1
+#define GB_SDIO_BLOCK_SIZE_MAX 512
 
-#define MAX_BLOCK_SIZE_0 512
-#define MAX_BLOCK_SIZE_1 1024
-#define MAX_BLOCK_SIZE_2 2048
+#define GB_SDIO_CMD_TIMEOUT_MS  200
+#define GB_SDIO_DATA_TIMEOUT_MS 1000
 
-struct gb_sdio_info {
-	unsigned int cport;
-	const struct device *sdhc_dev;
-	struct sdhc_command deferred_cmd;
-	bool has_deferred_cmd;
-};
+/* R1 card status of a card in transfer state, ready for data */
+#define GB_SDIO_R1_READY_FOR_DATA 0x00000900
 
-static uint16_t scale_max_sd_block_length(uint16_t value)
-{
-	if (value < MAX_BLOCK_SIZE_0) {
-		return 0;
-	} else if (value < MAX_BLOCK_SIZE_1) {
-		return MAX_BLOCK_SIZE_0;
-	} else if (value < MAX_BLOCK_SIZE_2) {
-		return MAX_BLOCK_SIZE_1;
-	}
-	return MAX_BLOCK_SIZE_2;
-}
+BUILD_ASSERT(CONFIG_GREYBUS_SDIO_BUFFER_SIZE % GB_SDIO_BLOCK_SIZE_MAX == 0,
+	     "SDIO buffer must hold whole blocks");
+
+static K_THREAD_STACK_DEFINE(gb_sdio_wq_stack, CONFIG_GREYBUS_SDIO_WQ_STACK_SIZE);
+static struct k_work_q gb_sdio_wq;
 
-static uint8_t gb_sdio_protocol_version(struct gb_operation *operation)
+static uint32_t gb_sdio_caps_get(const struct sdhc_host_props *props)
 {
-	struct gb_sdio_proto_version_response *response;
+	uint32_t caps = 0;
 
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	if (props->host_caps.bus_4_bit_support) {
+		caps |= GB_SDIO_CAP_4_BIT_DATA;
+	}
+	if (props->host_caps.bus_8_bit_support) {
+		caps |= GB_SDIO_CAP_8_BIT_DATA;
+	}
+	if (props->host_caps.high_spd_support) {
+		caps |= GB_SDIO_CAP_SD_HS | GB_SDIO_CAP_MMC_HS;
+	}
+	if (props->host_caps.vol_180_support) {
+		caps |= GB_SDIO_CAP_UHS_SDR12 | GB_SDIO_CAP_UHS_SDR25;
+		if (props->host_caps.sdr50_support) {
+			caps |= GB_SDIO_CAP_UHS_SDR50;
+		}
+		if (props->host_caps.sdr104_support) {
+			caps |= GB_SDIO_CAP_UHS_SDR104;
+		}
+		if (props->host_caps.ddr50_support) {
+			caps |= GB_SDIO_CAP_UHS_DDR50;
+		}
 	}
 
-	response->major = GB_SDIO_VERSION_MAJOR;
-	response->minor = GB_SDIO_VERSION_MINOR;
-
-	return GB_OP_SUCCESS;
+	return caps;
 }
 
-static uint8_t gb_sdio_protocol_get_capabilities(struct gb_operation *operation)
+static uint32_t gb_sdio_ocr_get(const struct sdhc_host_props *props)
 {
-	struct gb_sdio_get_caps_response *response;
-	struct gb_bundle *bundle;
-	struct gb_sdio_info *info;
-	struct sdhc_host_props props = {0};
-	uint16_t max_data_size;
-	uint32_t caps = 0;
-	int ret;
-
-	bundle = gb_operation_get_bundle(operation);
-	info = bundle->priv;
+	uint32_t ocr = 0;
 
-	ret = sdhc_get_host_props(info->sdhc_dev, &props);
-	if (ret) {
-		return gb_errno_to_op_result(ret);
+	if (props->host_caps.vol_330_support) {
+		ocr |= GB_SDIO_VDD_32_33 | GB_SDIO_VDD_33_34;
 	}
-
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	if (props->host_caps.vol_300_support) {
+		ocr |= GB_SDIO_VDD_29_30 | GB_SDIO_VDD_30_31;
+	}
+	if (props->host_caps.vol_180_support) {
+		ocr |= GB_SDIO_VDD_165_195;
 	}
 
-	max_data_size = GB_MAX_PAYLOAD_SIZE - sizeof(struct gb_sdio_transfer_response);
-	max_data_size = scale_max_sd_block_length(max_data_size);
-	if (!max_data_size) {
-		return GB_OP_INVALID;
+	return ocr;
+}
+
+/* Data phases of up to CONFIG_GREYBUS_SDIO_BUFFER_SIZE bytes run as a single SDHC request */
+static void gb_sdio_get_capabilities(uint16_t cport, struct gb_message *req,
+				     struct gb_sdio_driver_data *data)
+{
+	int ret;
+	struct sdhc_host_props props = {0};
+	struct gb_sdio_get_caps_response resp_data;
+
+	ret = sdhc_get_host_props(data->dev, &props);
+	if (ret < 0) {
+		return gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret),
+								cport);
 	}
 
-	/* Map Zephyr Caps to Greybus Caps - Best Effort */
-	if (props.host_caps.bus_4_bit_support) caps |= GB_SDIO_CAP_4_BIT_DATA;
-	if (props.host_caps.bus_8_bit_support) caps |= GB_SDIO_CAP_8_BIT_DATA;
-	if (props.host_caps.high_speed_support) caps |= GB_SDIO_CAP_SD_HS | GB_SDIO_CAP_MMC_HS;
-	if (props.host_caps.vol_330_support) caps |= GB_SDIO_CAP_HS200_1_2V; /* Partial mapping */
+	resp_data.caps = sys_cpu_to_le32(gb_sdio_caps_get(&props));
+	resp_data.ocr = sys_cpu_to_le32(gb_sdio_ocr_get(&props));
+	resp_data.f_min = sys_cpu_to_le32(props.f_min);
+	resp_data.f_max = sys_cpu_to_le32(props.f_max);
+	resp_data.max_blk_count =
+		sys_cpu_to_le16(CONFIG_GREYBUS_SDIO_BUFFER_SIZE / GB_SDIO_BLOCK_SIZE_MAX);
+	resp_data.max_blk_size = sys_cpu_to_le16(GB_SDIO_BLOCK_SIZE_MAX);
 
-	response->caps = sys_cpu_to_le32(caps);
-	response->ocr = sys_cpu_to_le32(0x00FF8000); /* Placeholder: 2.7-3.6V */
-	response->f_min = sys_cpu_to_le32(props.f_min);
-	response->f_max = sys_cpu_to_le32(props.f_max);
-	
-	/* Use calculated max values */
-	response->max_blk_count = sys_cpu_to_le16(max_data_size / 512); 
-	response->max_blk_size = sys_cpu_to_le16(512);
+	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
+}
 
-	return GB_OP_SUCCESS;
+static enum sdhc_timing_mode gb_sdio_timing_get(uint8_t timing)
+{
+	switch (timing) {
+	case GB_SDIO_TIMING_MMC_HS:
+	case GB_SDIO_TIMING_SD_HS:
+		return SDHC_TIMING_HS;
+	case GB_SDIO_TIMING_UHS_SDR12:
+		return SDHC_TIMING_SDR12;
+	case GB_SDIO_TIMING_UHS_SDR25:
+		return SDHC_TIMING_SDR25;
+	case GB_SDIO_TIMING_UHS_SDR50:
+		return SDHC_TIMING_SDR50;
+	case GB_SDIO_TIMING_UHS_SDR104:
+		return SDHC_TIMING_SDR104;
+	case GB_SDIO_TIMING_UHS_DDR50:
+		return SDHC_TIMING_DDR50;
+	case GB_SDIO_TIMING_MMC_DDR52:
+		return SDHC_TIMING_DDR52;
+	case GB_SDIO_TIMING_MMC_HS200:
+		return SDHC_TIMING_HS200;
+	case GB_SDIO_TIMING_MMC_HS400:
+		return SDHC_TIMING_HS400;
+	case GB_SDIO_TIMING_LEGACY:
+	default:
+		return SDHC_TIMING_LEGACY;
+	}
 }
 
-static uint8_t gb_sdio_protocol_set_ios(struct gb_operation *operation)
+static void gb_sdio_set_ios(uint16_t cport, struct gb_message *req,
+			    struct gb_sdio_driver_data *data)
 {
-	struct gb_sdio_set_ios_request *request;
-	struct gb_bundle *bundle;
-	struct gb_sdio_info *info;
-	struct sdhc_io ios = {0};
 	int ret;
+	const struct gb_sdio_set_ios_request *req_data =
+		(const struct gb_sdio_set_ios_request *)req->payload;
+	struct sdhc_io ios = {0};
 
-	bundle = gb_operation_get_bundle(operation);
-	info = bundle->priv;
-
-	request = gb_operation_get_request_payload(operation);
-
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
 		LOG_ERR("dropping short message");
-		return GB_OP_INVALID;
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	ios.clock = sys_le32_to_cpu(request->clock);
-	
-	switch(request->bus_mode) {
-		case GB_SDIO_BUSMODE_OPENDRAIN: ios.bus_mode = SDHC_BUSMODE_OPENDRAIN; break;
-		case GB_SDIO_BUSMODE_PUSHPULL: ios.bus_mode = SDHC_BUSMODE_PUSHPULL; break;
-		default: ios.bus_mode = SDHC_BUSMODE_PUSHPULL;
+	ios.clock = sys_le32_to_cpu(req_data->clock);
+	ios.bus_mode = req_data->bus_mode == GB_SDIO_BUSMODE_OPENDRAIN ? SDHC_BUSMODE_OPENDRAIN
+								      : SDHC_BUSMODE_PUSHPULL;
+	ios.power_mode = req_data->power_mode == GB_SDIO_POWER_OFF ? SDHC_POWER_OFF
+								   : SDHC_POWER_ON;
+	ios.timing = gb_sdio_timing_get(req_data->timing);
+
+	switch (req_data->bus_width) {
+	case GB_SDIO_BUS_WIDTH_4:
+		ios.bus_width = SDHC_BUS_WIDTH4BIT;
+		break;
+	case GB_SDIO_BUS_WIDTH_8:
+		ios.bus_width = SDHC_BUS_WIDTH8BIT;
+		break;
+	default:
+		ios.bus_width = SDHC_BUS_WIDTH1BIT;
 	}
 
-	switch(request->power_mode) {
-		case GB_SDIO_POWER_OFF: ios.power_mode = SDHC_POWER_OFF; break;
-		case GB_SDIO_POWER_UP: ios.power_mode = SDHC_POWER_ON; break;
-		case GB_SDIO_POWER_ON: ios.power_mode = SDHC_POWER_ON; break;
-		default: ios.power_mode = SDHC_POWER_OFF;
+	switch (req_data->signal_voltage) {
+	case GB_SDIO_SIGNAL_VOLTAGE_180:
+		ios.signal_voltage = SD_VOL_1_8_V;
+		break;
+	case GB_SDIO_SIGNAL_VOLTAGE_120:
+		ios.signal_voltage = SD_VOL_1_2_V;
+		break;
+	default:
+		ios.signal_voltage = SD_VOL_3_3_V;
 	}
 
-	switch(request->bus_width) {
-		case GB_SDIO_BUS_WIDTH_1: ios.bus_width = SDHC_BUS_WIDTH1BIT; break;
-		case GB_SDIO_BUS_WIDTH_4: ios.bus_width = SDHC_BUS_WIDTH4BIT; break;
-		case GB_SDIO_BUS_WIDTH_8: ios.bus_width = SDHC_BUS_WIDTH8BIT; break;
-		default: ios.bus_width = SDHC_BUS_WIDTH1BIT;
-	}
-	
-	switch(request->timing) {
-		case GB_SDIO_TIMING_LEGACY: ios.timing = SDHC_TIMING_LEGACY; break;
-		case GB_SDIO_TIMING_SD_HS: ios.timing = SDHC_TIMING_HS; break;
-		case GB_SDIO_TIMING_MMC_HS: ios.timing = SDHC_TIMING_HS; break;
-		default: ios.timing = SDHC_TIMING_LEGACY;
+	k_sem_take(&data->idle, K_FOREVER);
+	ret = sdhc_set_io(data->dev, &ios);
+	k_sem_give(&data->idle);
+
+	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
+}
+
+static enum sd_rsp_type gb_sdio_response_type_get(uint8_t flags)
+{
+	if (!(flags & GB_SDIO_RSP_PRESENT)) {
+		return SD_RSP_TYPE_NONE;
 	}
-	
-	/* Voltage mapping approximated */
-	switch(request->signal_voltage) {
-		case GB_SDIO_SIGNAL_VOLTAGE_330: ios.signal_voltage = SD_VOL_3_3_V; break;
-		case GB_SDIO_SIGNAL_VOLTAGE_180: ios.signal_voltage = SD_VOL_1_8_V; break;
-		case GB_SDIO_SIGNAL_VOLTAGE_120: ios.signal_voltage = SD_VOL_1_2_V; break;
-		default: ios.signal_voltage = SD_VOL_3_3_V;
+
+	if (flags & GB_SDIO_RSP_136) {
+		return SD_RSP_TYPE_R2;
 	}
 
-	ret = sdhc_set_io(info->sdhc_dev, &ios);
-	if (ret) {
-		return gb_errno_to_op_result(ret);
+	/* R3 and R4 carry no CRC */
+	if (!(flags & GB_SDIO_RSP_CRC)) {
+		return SD_RSP_TYPE_R3;
 	}
 
-	return GB_OP_SUCCESS;
+	return (flags & GB_SDIO_RSP_BUSY) ? SD_RSP_TYPE_R1b : SD_RSP_TYPE_R1;
 }
 
-static uint8_t gb_sdio_protocol_command(struct gb_operation *operation)
+/*
+ * A command with a data phase is only sent to the SDHC along with its data, once its transfer
+ * operations arrive. It is answered right away with a card status that is ready for data.
+ */
+static void gb_sdio_command(uint16_t cport, struct gb_message *req,
+			    struct gb_sdio_driver_data *data)
 {
-	struct gb_sdio_command_request *request;
-	struct gb_sdio_command_response *response;
-	struct gb_bundle *bundle;
-	struct gb_sdio_info *info;
+	int ret;
+	uint16_t blocks, blksz;
 	struct sdhc_command cmd = {0};
-	int i, ret;
-	uint16_t data_blocks;
+	struct gb_sdio_command_response resp_data = {0};
+	const struct gb_sdio_command_request *req_data =
+		(const struct gb_sdio_command_request *)req->payload;
 
-	bundle = gb_operation_get_bundle(operation);
-	info = bundle->priv;
-
-	request = gb_operation_get_request_payload(operation);
-
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
 		LOG_ERR("dropping short message");
-		return GB_OP_INVALID;
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
-	data_blocks = sys_le16_to_cpu(request->data_blocks);
+	blocks = sys_le16_to_cpu(req_data->data_blocks);
+	blksz = sys_le16_to_cpu(req_data->data_blksz);
 
-	cmd.opcode = request->cmd;
-	cmd.arg = sys_le32_to_cpu(request->cmd_arg);
-	
-	/* Map flags - simplified mapping */
-	if (request->cmd_flags & GB_SDIO_RSP_PRESENT) {
-		if (request->cmd_flags & GB_SDIO_RSP_136) {
-			cmd.response_type = SD_RSP_TYPE_R2;
-		} else if (request->cmd_flags & GB_SDIO_RSP_BUSY) {
-			cmd.response_type = SD_RSP_TYPE_R1b;
-		} else {
-			cmd.response_type = SD_RSP_TYPE_R1;
-		}
-	} else {
-		cmd.response_type = SD_RSP_TYPE_NONE;
+	cmd.opcode = req_data->cmd;
+	cmd.arg = sys_le32_to_cpu(req_data->cmd_arg);
+	cmd.response_type = gb_sdio_response_type_get(req_data->cmd_flags);
+	cmd.timeout_ms = GB_SDIO_CMD_TIMEOUT_MS;
+
+	k_sem_take(&data->idle, K_FOREVER);
+
+	/* Any data phase left unfinished is abandoned */
+	data->has_cmd = false;
+
+	ret = data->write_err;
+	data->write_err = 0;
+	if (ret < 0) {
+		LOG_ERR("Posted write failed: %d", ret);
+		goto fail;
 	}
 
-	if (data_blocks > 0) {
-		/* Defer execution */
-		info->deferred_cmd = cmd;
-		info->has_deferred_cmd = true;
-		
-		response = gb_operation_alloc_response(operation, sizeof(*response));
-		if (!response) {
-			return GB_OP_NO_MEMORY;
+	if (blocks) {
+		if (!blksz || blksz > GB_SDIO_BLOCK_SIZE_MAX ||
+		    blocks * blksz > CONFIG_GREYBUS_SDIO_BUFFER_SIZE) {
+			ret = -EINVAL;
+			goto fail;
 		}
-		
-		/* Spoof Success Response for now */
-		memset(response->resp, 0, sizeof(response->resp));
-		/* R1 Ready for Data */
-		response->resp[0] = sys_cpu_to_le32(0x00000900); 
 
-		return GB_OP_SUCCESS;
+		data->cmd = cmd;
+		data->data = (struct sdhc_data){
+			.block_size = blksz,
+			.blocks = blocks,
+			.timeout_ms = GB_SDIO_DATA_TIMEOUT_MS,
+		};
+		data->offset = 0;
+		data->total = blocks * blksz;
+		data->has_cmd = true;
+		k_sem_give(&data->idle);
+
+		resp_data.resp[0] = sys_cpu_to_le32(GB_SDIO_R1_READY_FOR_DATA);
+		return gb_transport_message_response_success_send(req, &resp_data,
+								  sizeof(resp_data), cport);
 	}
 
-	/* Immediate Execution */
-	ret = sdhc_request(info->sdhc_dev, &cmd, NULL);
-	if (ret) {
+	ret = sdhc_request(data->dev, &cmd, NULL);
+	k_sem_give(&data->idle);
+
+	if (ret < 0) {
 		LOG_ERR("sdhc_request failed: %d", ret);
-		return gb_errno_to_op_result(ret);
+		return gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret),
+								cport);
 	}
 
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+	/* Zephyr keeps the least significant word of long responses first, Greybus the most */
+	for (size_t i = 0; i < ARRAY_SIZE(resp_data.resp); i++) {
+		resp_data.resp[i] = sys_cpu_to_le32(cmd.response_type == SD_RSP_TYPE_R2
+							    ? cmd.response[3 - i]
+							    : cmd.response[i]);
 	}
 
-	for (i = 0; i < 4; i++) {
-		response->resp[i] = sys_cpu_to_le32(cmd.response[i]);
-	}
+	return gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data),
+							  cport);
 
-	return GB_OP_SUCCESS;
+fail:
+	k_sem_give(&data->idle);
+	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
 }
 
-static uint8_t gb_sdio_protocol_transfer(struct gb_operation *operation)
+static void gb_sdio_write_work_handler(struct k_work *work)
 {
-	struct gb_sdio_transfer_request *request;
-	struct gb_sdio_transfer_response *response;
-	struct gb_bundle *bundle;
-	struct gb_sdio_info *info;
-	struct sdhc_data data = {0};
-	int ret;
-	uint16_t blocks;
-	uint16_t blksz;
+	struct gb_sdio_driver_data *data =
+		CONTAINER_OF(work, struct gb_sdio_driver_data, write_work);
+
+	data->write_err = sdhc_request(data->dev, &data->cmd, &data->data);
+	data->has_cmd = false;
 
-	bundle = gb_operation_get_bundle(operation);
-	info = bundle->priv;
+	gb_message_dealloc(data->write_msg);
+	data->write_msg = NULL;
 
-	request = gb_operation_get_request_payload(operation);
+	k_sem_give(&data->idle);
+}
 
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
+static void gb_sdio_transfer_response_send(uint16_t cport, struct gb_message *resp,
+					   uint16_t blocks, uint16_t blksz)
+{
+	struct gb_sdio_transfer_response *resp_data =
+		(struct gb_sdio_transfer_response *)resp->payload;
+
+	resp_data->data_blocks = sys_cpu_to_le16(blocks);
+	resp_data->data_blksz = sys_cpu_to_le16(blksz);
+
+	gb_transport_message_send(resp, cport);
+	gb_message_dealloc(resp);
+}
+
+/*
+ * The last chunk of a write is answered before the data reaches the card, and the write completes
+ * on the work queue while the AP prepares the next command. A write that fits in a single transfer
+ * operation is done straight from the request payload.
+ *
+ * Must be called with idle held. Gives it back unless the write is posted.
+ */
+static uint8_t gb_sdio_transfer_write(uint16_t cport, struct gb_message *req,
+				      struct gb_sdio_driver_data *data, size_t len)
+{
+	struct gb_message *resp;
+	const struct gb_sdio_transfer_request *req_data =
+		(const struct gb_sdio_transfer_request *)req->payload;
+	const bool direct =
+		data->offset == 0 && len == data->total &&
+		IS_ALIGNED(POINTER_TO_UINT(req_data->data), CONFIG_SDHC_BUFFER_ALIGNMENT);
+
+	if (gb_message_payload_len(req) < sizeof(*req_data) + len) {
 		LOG_ERR("dropping short message");
 		return GB_OP_INVALID;
 	}
-	
-	blocks = sys_le16_to_cpu(request->data_blocks);
-	blksz = sys_le16_to_cpu(request->data_blksz);
-	
-	if (!info->has_deferred_cmd) {
-		LOG_ERR("Transfer request without deferred command");
-		return GB_OP_INVALID;
+
+	resp = gb_message_alloc(sizeof(struct gb_sdio_transfer_response),
+				GB_RESPONSE(GB_SDIO_TYPE_TRANSFER), req->header.operation_id,
+				GB_OP_SUCCESS);
+	if (!resp) {
+		return GB_OP_NO_MEMORY;
 	}
 
-	data.block_size = blksz;
-	data.blocks = blocks;
+	if (direct) {
+		data->data.data = (void *)req_data->data;
+	} else {
+		memcpy(&data->buf[data->offset], req_data->data, len);
+		data->data.data = data->buf;
+	}
+	data->offset += len;
 
-	if (request->data_flags & GB_SDIO_DATA_WRITE) {
-		if (!request->data) {
-			return GB_OP_INVALID;
-		}
-		data.data = request->data;
-		data.bytes_transferred = 0;
-		
-		ret = sdhc_request(info->sdhc_dev, &info->deferred_cmd, &data);
-		if (ret) {
-			info->has_deferred_cmd = false;
-			return gb_errno_to_op_result(ret);
-		}
-		
-		response = gb_operation_alloc_response(operation, sizeof(*response));
-		if (!response) {
-			return GB_OP_NO_MEMORY;
-		}
-		response->data_blocks = sys_cpu_to_le16(blocks);
-		response->data_blksz = sys_cpu_to_le16(blksz);
-
-	} else if (request->data_flags & GB_SDIO_DATA_READ) {
-		response = gb_operation_alloc_response(
-			operation, sizeof(*response) + blocks * blksz);
-		if (!response) {
-			return GB_OP_NO_MEMORY;
-		}
-		data.data = response->data;
-		data.bytes_transferred = 0;
-		
-		ret = sdhc_request(info->sdhc_dev, &info->deferred_cmd, &data);
-		if (ret) {
-			info->has_deferred_cmd = false;
-			return gb_errno_to_op_result(ret);
-		}
-		
-		response->data_blocks = sys_cpu_to_le16(blocks);
-		response->data_blksz = sys_cpu_to_le16(blksz);
+	gb_sdio_transfer_response_send(cport, resp, sys_le16_to_cpu(req_data->data_blocks),
+				       sys_le16_to_cpu(req_data->data_blksz));
+
+	if (data->offset < data->total) {
+		gb_message_dealloc(req);
+		k_sem_give(&data->idle);
+		return GB_OP_SUCCESS;
+	}
+
+	if (direct) {
+		data->write_msg = req;
 	} else {
-		return GB_OP_INVALID;
+		gb_message_dealloc(req);
 	}
-	
-	info->has_deferred_cmd = false;
+
+	k_work_submit_to_queue(&gb_sdio_wq, &data->write_work);
+
 	return GB_OP_SUCCESS;
 }
 
-static int gb_sdio_init(unsigned int cport, struct gb_bundle *bundle)
+/*
+ * The whole data phase is read by the first transfer operation. A read that fits in a single
+ * transfer operation goes straight into the response payload.
+ *
+ * Must be called with idle held.
+ */
+static uint8_t gb_sdio_transfer_read(uint16_t cport, struct gb_message *req,
+				     struct gb_sdio_driver_data *data, size_t len)
 {
-	struct gb_sdio_info *info;
-	const struct device *dev;
-
-	DEBUGASSERT(bundle);
-
-	dev = device_get_binding(CONFIG_GREYBUS_SDIO_CONTROLLER_NAME);
-	if (!dev) {
-		LOG_ERR("SDHC Device not found");
-		return -ENODEV;
+	int ret;
+	struct gb_message *resp;
+	struct gb_sdio_transfer_response *resp_data;
+	const struct gb_sdio_transfer_request *req_data =
+		(const struct gb_sdio_transfer_request *)req->payload;
+	bool direct = false;
+
+	resp = gb_message_alloc(sizeof(*resp_data) + len, GB_RESPONSE(GB_SDIO_TYPE_TRANSFER),
+				req->header.operation_id, GB_OP_SUCCESS);
+	if (!resp) {
+		return GB_OP_NO_MEMORY;
 	}
-	
-	if (!device_is_ready(dev)) {
-		LOG_ERR("SDHC Device not ready");
-		return -ENODEV;
+	resp_data = (struct gb_sdio_transfer_response *)resp->payload;
+
+	if (data->offset == 0) {
+		direct = len == data->total &&
+			 IS_ALIGNED(POINTER_TO_UINT(resp_data->data), CONFIG_SDHC_BUFFER_ALIGNMENT);
+		data->data.data = direct ? resp_data->data : data->buf;
+
+		ret = sdhc_request(data->dev, &data->cmd, &data->data);
+		if (ret < 0) {
+			LOG_ERR("sdhc_request failed: %d", ret);
+			data->has_cmd = false;
+			gb_message_dealloc(resp);
+			return gb_errno_to_op_result(ret);
+		}
 	}
 
-	info = zalloc(sizeof(*info));
-	if (info == NULL) {
-		return -ENOMEM;
+	if (!direct) {
+		memcpy(resp_data->data, &data->buf[data->offset], len);
 	}
 
-	info->cport = cport;
-	info->sdhc_dev = dev;
-	info->has_deferred_cmd = false;
+	data->offset += len;
+	if (data->offset == data->total) {
+		data->has_cmd = false;
+	}
 
-	bundle->priv = info;
+	gb_sdio_transfer_response_send(cport, resp, sys_le16_to_cpu(req_data->data_blocks),
+				       sys_le16_to_cpu(req_data->data_blksz));
+	gb_message_dealloc(req);
 
-	return 0;
+	k_sem_give(&data->idle);
+	return GB_OP_SUCCESS;
 }
 
-static void gb_sdio_exit(unsigned int cport, struct gb_bundle *bundle)
+static void gb_sdio_transfer(uint16_t cport, struct gb_message *req,
+			     struct gb_sdio_driver_data *data)
 {
-	struct gb_sdio_info *info;
+	uint8_t ret;
+	size_t len;
+	const struct gb_sdio_transfer_request *req_data =
+		(const struct gb_sdio_transfer_request *)req->payload;
 
-	DEBUGASSERT(bundle);
-	info = bundle->priv;
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	len = sys_le16_to_cpu(req_data->data_blocks) * sys_le16_to_cpu(req_data->data_blksz);
 
-	DEBUGASSERT(cport == info->cport);
+	k_sem_take(&data->idle, K_FOREVER);
+
+	if (!data->has_cmd) {
+		LOG_ERR("Transfer without a data command");
+		ret = GB_OP_INVALID;
+		goto fail;
+	}
 
-	free(info);
-	bundle->priv = NULL;
+	if (!len || sys_le16_to_cpu(req_data->data_blksz) != data->data.block_size ||
+	    data->offset + len > data->total) {
+		ret = GB_OP_INVALID;
+		goto fail;
+	}
+
+	switch (req_data->data_flags & (GB_SDIO_DATA_WRITE | GB_SDIO_DATA_READ)) {
+	case GB_SDIO_DATA_WRITE:
+		ret = gb_sdio_transfer_write(cport, req, data, len);
+		break;
+	case GB_SDIO_DATA_READ:
+		ret = gb_sdio_transfer_read(cport, req, data, len);
+		break;
+	default:
+		ret = GB_OP_INVALID;
+	}
+
+	if (ret == GB_OP_SUCCESS) {
+		return;
+	}
+
+fail:
+	k_sem_give(&data->idle);
+	gb_transport_message_empty_response_send(req, ret, cport);
 }
 
-static uint8_t gb_sdio_handler(uint8_t type, struct gb_operation *opr)
+static void gb_sdio_handler(const void *priv, struct gb_message *msg, uint16_t cport)
 {
-	switch (type) {
-	case GB_SDIO_TYPE_PROTOCOL_VERSION:
-		return gb_sdio_protocol_version(opr);
+	struct gb_sdio_driver_data *data = (struct gb_sdio_driver_data *)priv;
+
+	switch (gb_message_type(msg)) {
 	case GB_SDIO_TYPE_GET_CAPABILITIES:
-		return gb_sdio_protocol_get_capabilities(opr);
+		return gb_sdio_get_capabilities(cport, msg, data);
 	case GB_SDIO_TYPE_SET_IOS:
-		return gb_sdio_protocol_set_ios(opr);
+		return gb_sdio_set_ios(cport, msg, data);
 	case GB_SDIO_TYPE_COMMAND:
-		return gb_sdio_protocol_command(opr);
+		return gb_sdio_command(cport, msg, data);
 	case GB_SDIO_TYPE_TRANSFER:
-		return gb_sdio_protocol_transfer(opr);
+		return gb_sdio_transfer(cport, msg, data);
 	default:
-		LOG_ERR("Invalid type: %u", type);
-		return GB_OP_INVALID;
+		LOG_ERR("Invalid type");
+		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
 	}
 }
 
-static struct gb_driver sdio_driver = {
-	.init = gb_sdio_init,
-	.exit = gb_sdio_exit,
+static void gb_sdio_connected(const void *priv, uint16_t cport)
+{
+	struct gb_sdio_driver_data *data = (struct gb_sdio_driver_data *)priv;
+
+	data->cport = cport;
+	data->has_cmd = false;
+	data->write_err = 0;
+}
+
+/* Let a posted write complete before the next connection */
+static void gb_sdio_disconnected(const void *priv)
+{
+	struct gb_sdio_driver_data *data = (struct gb_sdio_driver_data *)priv;
+
+	k_sem_take(&data->idle, K_FOREVER);
+	data->has_cmd = false;
+	k_sem_give(&data->idle);
+}
+
+const struct gb_driver gb_sdio_driver = {
+	.connected = gb_sdio_connected,
+	.disconnected = gb_sdio_disconnected,
 	.op_handler = gb_sdio_handler,
 };
 
-void gb_sdio_register(int cport, int bundle)
+static int gb_sdio_init(void)
 {
-	gb_register_driver(cport, bundle, &sdio_driver);
+	const struct gb_cport *cport;
+	struct gb_sdio_driver_data *data;
+
+	for (uint16_t i = 0; i < GREYBUS_CPORT_COUNT; i++) {
+		cport = gb_cport_get(i);
+		if (cport->protocol != GREYBUS_PROTOCOL_SDIO) {
+			continue;
+		}
+
+		data = (struct gb_sdio_driver_data *)cport->priv;
+		k_sem_init(&data->idle, 1, 1);
+		k_work_init(&data->write_work, gb_sdio_write_work_handler);
+	}
+
+	k_work_queue_start(&gb_sdio_wq, gb_sdio_wq_stack, K_THREAD_STACK_SIZEOF(gb_sdio_wq_stack),
+			   CONFIG_GREYBUS_SDIO_WQ_PRIORITY, NULL);
+	k_thread_name_set(&gb_sdio_wq.thread, "gb_sdio_wq");
+
+	return 0;
 }
+
+SYS_INIT(gb_sdio_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
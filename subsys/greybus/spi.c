@@ -39,10 +39,10 @@ LOG_MODULE_REGISTER(greybus_spi, CONFIG_GREYBUS_LOG_LEVEL);
 /**
  * @brief Returns a set of configuration parameters related to SPI master.
  */
-static void gb_spi_protocol_master_config(uint16_t cport, struct gb_message *req,
-					  const struct gb_spi_driver_data *data)
+static void gb_spi_protocol_master_config(const void *priv, struct gb_message *req,
+					  uint16_t cport)
 {
-	ARG_UNUSED(data);
+	ARG_UNUSED(priv);
 
 	/* TODO: Zephyr should provide API to get these details */
 	const struct gb_spi_master_config_response resp_data = {
@@ -50,7 +50,7 @@ static void gb_spi_protocol_master_config(uint16_t cport, struct gb_message *req
 		.max_speed_hz = 24000000,
 		.mode = 0,
 		.flags = 0,
-		.num_chipselect = 1,
+		.num_chipselect = CONFIG_GREYBUS_SPI_CHIP_SELECTS,
 	};
 
 	gb_transport_message_response_success_send(req, &resp_data, sizeof(resp_data), cport);
@@ -62,9 +62,10 @@ static void gb_spi_protocol_master_config(uint16_t cport, struct gb_message *req
  * Returns a set of configuration parameters taht related to SPI device is
  * selected.
  */
-static void gb_spi_protocol_device_config(uint16_t cport, struct gb_message *req,
-					  const struct gb_spi_driver_data *data)
+static void gb_spi_protocol_device_config(const void *priv, struct gb_message *req,
+					  uint16_t cport)
 {
+	const struct gb_spi_driver_data *data = priv;
 	const struct gb_spi_device_config_request *req_data =
 		(const struct gb_spi_device_config_request *)req->payload;
 	struct gb_spi_device_config_response dev_data;
@@ -73,10 +74,9 @@ static void gb_spi_protocol_device_config(uint16_t cport, struct gb_message *req
 	strncpy(dev_data.name, data->dev->name, sizeof(dev_data.name));
 
 	for (i = 0; i < data->device_num; i++) {
-		if (data->device_num == req_data->chip_select) {
+		if (data->devices[i].id == req_data->chip_select) {
 			return gb_transport_message_response_success_send(
-				req, &data->devices[req_data->chip_select].data, sizeof(dev_data),
-				cport);
+				req, &data->devices[i].data, sizeof(dev_data), cport);
 		}
 	}
 
@@ -91,122 +91,182 @@ static void gb_spi_protocol_device_config(uint16_t cport, struct gb_message *req
 	gb_transport_message_response_success_send(req, &dev_data, sizeof(dev_data), cport);
 }
 
+/* Get the cached configuration of a chip select, switching slots only when it changes */
+static const struct spi_config *gb_spi_config_get(struct gb_spi_driver_data *data, uint8_t cs,
+						  uint32_t frequency, spi_operation_t operation)
+{
+	struct gb_spi_cs_config *cache = &data->cs_configs[cs];
+	struct spi_config *conf = &cache->conf[cache->cur];
+
+	if (cache->valid && conf->frequency == frequency && conf->operation == operation) {
+		return conf;
+	}
+
+	cache->cur ^= 1;
+	conf = &cache->conf[cache->cur];
+	conf->frequency = frequency;
+	conf->operation = operation;
+	conf->slave = cs;
+	cache->valid = true;
+
+	return conf;
+}
+
+static bool gb_spi_transfer_compatible(const struct gb_spi_transfer *a,
+				       const struct gb_spi_transfer *b)
+{
+	return a->speed_hz == b->speed_hz && a->bits_per_word == b->bits_per_word;
+}
+
 /**
  * @brief Performs a SPI transaction as one or more SPI transfers, defined
  *        in the supplied array.
+ *
+ * Consecutive transfers with the same speed and word size are merged into one spi_transceive()
+ * call, so chip select stays asserted between them. A transaction also ends after a transfer
+ * requesting a delay.
  */
-static void gb_spi_protocol_transfer(uint16_t cport, struct gb_message *req,
-				     const struct gb_spi_driver_data *data)
+static void gb_spi_protocol_transfer(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	struct gb_spi_driver_data *data = (struct gb_spi_driver_data *)priv;
 	int ret;
-	struct gb_spi_transfer_request *req_data = (struct gb_spi_transfer_request *)req->payload;
-	struct gb_spi_transfer *desc;
-	struct spi_config conf = {0};
-	size_t i, resp_pos = 0, resp_size = 0;
+	const struct gb_spi_transfer_request *req_data =
+		(const struct gb_spi_transfer_request *)req->payload;
+	const struct gb_spi_transfer *desc;
+	const struct spi_config *conf;
+	spi_operation_t operation = 0;
+	uint8_t bits;
+	size_t i, nbufs = 0, resp_pos = 0, resp_size = 0, write_left;
 	struct gb_message *resp;
-	struct spi_buf tx_buf, rx_buf;
-	uint8_t *trans_data = req->payload + 4 + (13 * req_data->count);
-	const struct spi_buf_set tx_buf_set = {
-		.buffers = &tx_buf,
-		.count = 1,
+	struct spi_buf tx_bufs[CONFIG_GREYBUS_SPI_MAX_BUFS], rx_bufs[CONFIG_GREYBUS_SPI_MAX_BUFS];
+	struct spi_buf_set tx_buf_set = {
+		.buffers = tx_bufs,
 	};
-	const struct spi_buf_set rx_buf_set = {
-		.buffers = &rx_buf,
-		.count = 1,
+	struct spi_buf_set rx_buf_set = {
+		.buffers = rx_bufs,
 	};
+	const uint8_t *trans_data;
+	uint16_t count;
+	uint32_t len;
+	uint16_t delay;
+
+	count = sys_le16_to_cpu(req_data->count);
+	trans_data = (const uint8_t *)&req_data->transfers[count];
 
 	if (req_data->mode & (GB_SPI_MODE_NO_CS | GB_SPI_MODE_3WIRE | GB_SPI_MODE_READY)) {
 		LOG_ERR("SPI Mode %u is not supported", req_data->mode);
 		return gb_transport_message_empty_response_send(req, GB_OP_INTERNAL, cport);
 	}
 
-	conf.slave = req_data->chip_select;
+	if (req_data->chip_select >= ARRAY_SIZE(data->cs_configs)) {
+		LOG_ERR("Invalid chip select: %u", req_data->chip_select);
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
 	if (req_data->mode & GB_SPI_MODE_CPHA) {
-		conf.operation |= SPI_MODE_CPHA;
+		operation |= SPI_MODE_CPHA;
 	}
 	if (req_data->mode & GB_SPI_MODE_CPOL) {
-		conf.operation |= SPI_MODE_CPOL;
+		operation |= SPI_MODE_CPOL;
 	}
 	if (req_data->mode & GB_SPI_MODE_CS_HIGH) {
-		conf.operation |= SPI_CS_ACTIVE_HIGH;
+		operation |= SPI_CS_ACTIVE_HIGH;
 	}
 	if (req_data->mode & GB_SPI_MODE_LSB_FIRST) {
-		conf.operation |= SPI_TRANSFER_LSB;
+		operation |= SPI_TRANSFER_LSB;
 	}
 	if (req_data->mode & GB_SPI_MODE_LOOP) {
-		conf.operation |= SPI_MODE_LOOP;
+		operation |= SPI_MODE_LOOP;
 	}
 
-	/* Calculate the response size */
-	for (i = 0; i < req_data->count; ++i) {
+	/*
+	 * Calculate the response size and validate the transfers. The lengths come from the host,
+	 * so each one is checked against what is left rather than summed first.
+	 */
+	write_left = gb_message_payload_len(req) - sizeof(*req_data) -
+		     count * sizeof(struct gb_spi_transfer);
+	for (i = 0; i < count; ++i) {
 		desc = &req_data->transfers[i];
+		if (desc->cs_change) {
+			LOG_ERR("cs_change not supported");
+			return gb_transport_message_empty_response_send(req, GB_OP_INTERNAL, cport);
+		}
+		if (!(desc->xfer_flags & (GB_SPI_XFER_READ | GB_SPI_XFER_WRITE))) {
+			LOG_ERR("Invalid flag");
+			return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+		}
+		len = sys_le32_to_cpu(desc->len);
 		if (desc->xfer_flags & GB_SPI_XFER_READ) {
-			resp_size += desc->len;
+			if (len > UINT16_MAX - sizeof(struct gb_operation_msg_hdr) - resp_size) {
+				LOG_ERR("Read of %u does not fit in a response", len);
+				return gb_transport_message_empty_response_send(req, GB_OP_INVALID,
+										cport);
+			}
+			resp_size += len;
+		}
+		if (desc->xfer_flags & GB_SPI_XFER_WRITE) {
+			if (len > write_left) {
+				LOG_ERR("dropping short message");
+				return gb_transport_message_empty_response_send(req, GB_OP_INVALID,
+										cport);
+			}
+			write_left -= len;
 		}
 	}
 
 	resp = gb_message_alloc(resp_size, GB_RESPONSE(GB_SPI_TYPE_TRANSFER),
 				req->header.operation_id, GB_OP_SUCCESS);
-	for (i = 0; i < req_data->count; ++i) {
+	if (!resp) {
+		LOG_ERR("Failed to allocate response");
+		return gb_transport_message_empty_response_send(req, GB_OP_NO_MEMORY, cport);
+	}
+
+	for (i = 0; i < count; ++i) {
 		desc = &req_data->transfers[i];
-		conf.frequency = desc->speed_hz;
-		conf.operation |= SPI_WORD_SET(desc->bits_per_word);
+		len = sys_le32_to_cpu(desc->len);
+		delay = sys_le16_to_cpu(desc->delay_usecs);
 
-		if (desc->cs_change) {
-			LOG_ERR("cs_change not supported");
-			gb_transport_message_empty_response_send(req, GB_OP_INTERNAL, cport);
-			goto free_resp;
-		}
+		/* A NULL buffer clocks out dummy data or discards received data */
+		tx_bufs[nbufs].len = len;
+		tx_bufs[nbufs].buf = NULL;
+		rx_bufs[nbufs].len = len;
+		rx_bufs[nbufs].buf = NULL;
 
-		if ((desc->xfer_flags & GB_SPI_XFER_READ) &&
-		    (desc->xfer_flags & GB_SPI_XFER_WRITE)) {
-			rx_buf.buf = resp->payload + resp_pos;
-			rx_buf.len = desc->len;
-			tx_buf.buf = trans_data;
-			tx_buf.len = desc->len;
-
-			ret = spi_transceive(data->dev, &conf, &tx_buf_set, &rx_buf_set);
-			if (ret < 0) {
-				LOG_ERR("SPI transceive failed");
-				gb_transport_message_empty_response_send(req, GB_OP_INTERNAL,
-									 cport);
-				goto free_resp;
-			}
+		if (desc->xfer_flags & GB_SPI_XFER_WRITE) {
+			tx_bufs[nbufs].buf = (void *)trans_data;
+			trans_data += len;
+		}
+		if (desc->xfer_flags & GB_SPI_XFER_READ) {
+			rx_bufs[nbufs].buf = resp->payload + resp_pos;
+			resp_pos += len;
+		}
+		nbufs++;
 
-			trans_data += desc->len;
-			resp_pos += desc->len;
-		} else if (desc->xfer_flags & GB_SPI_XFER_READ) {
-			rx_buf.buf = resp->payload + resp_pos;
-			rx_buf.len = desc->len;
-
-			ret = spi_read(data->dev, &conf, &rx_buf_set);
-			if (ret < 0) {
-				LOG_ERR("SPI read failed");
-				gb_transport_message_empty_response_send(req, GB_OP_INTERNAL,
-									 cport);
-				goto free_resp;
-			}
+		if (i + 1 < count && nbufs < ARRAY_SIZE(tx_bufs) && delay == 0 &&
+		    gb_spi_transfer_compatible(desc, &req_data->transfers[i + 1])) {
+			continue;
+		}
 
-			resp_pos += desc->len;
-		} else if (desc->xfer_flags & GB_SPI_XFER_WRITE) {
-			tx_buf.buf = trans_data;
-			tx_buf.len = desc->len;
-			ret = spi_write(data->dev, &conf, &tx_buf_set);
-			if (ret < 0) {
-				LOG_ERR("SPI write failed");
-				gb_transport_message_empty_response_send(req, GB_OP_INTERNAL,
-									 cport);
-				goto free_resp;
-			}
+		/* 0 selects the default word size */
+		bits = desc->bits_per_word ? desc->bits_per_word : 8;
+		conf = gb_spi_config_get(data, req_data->chip_select,
+					 sys_le32_to_cpu(desc->speed_hz),
+					 operation | SPI_WORD_SET(bits));
+		tx_buf_set.count = nbufs;
+		rx_buf_set.count = nbufs;
 
-			trans_data += desc->len;
-		} else {
-			LOG_ERR("Invalid flag");
-			gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+		ret = spi_transceive(data->dev, conf, &tx_buf_set, &rx_buf_set);
+		if (ret < 0) {
+			LOG_ERR("SPI transceive failed: %d", ret);
+			gb_transport_message_empty_response_send(req, GB_OP_INTERNAL, cport);
 			goto free_resp;
 		}
 
-		k_sleep(K_USEC(desc->delay_usecs));
+		nbufs = 0;
+
+		if (delay) {
+			k_sleep(K_USEC(delay));
+		}
 	}
 
 	gb_transport_message_send(resp, cport);
@@ -216,23 +276,14 @@ free_resp:
 	gb_message_dealloc(resp);
 }
 
-static void gb_spi_handler(const void *priv, struct gb_message *msg, uint16_t cport)
-{
-	const struct gb_spi_driver_data *data = priv;
-
-	switch (gb_message_type(msg)) {
-	case GB_SPI_TYPE_MASTER_CONFIG:
-		return gb_spi_protocol_master_config(cport, msg, data);
-	case GB_SPI_TYPE_DEVICE_CONFIG:
-		return gb_spi_protocol_device_config(cport, msg, data);
-	case GB_SPI_TYPE_TRANSFER:
-		return gb_spi_protocol_transfer(cport, msg, data);
-	default:
-		LOG_ERR("Invalid type");
-		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
-	}
-}
+static const struct gb_operation_entry gb_spi_ops[] = {
+	GB_OPERATION(GB_SPI_TYPE_MASTER_CONFIG, gb_spi_protocol_master_config, 0),
+	GB_OPERATION(GB_SPI_TYPE_DEVICE_CONFIG, gb_spi_protocol_device_config,
+		     sizeof(struct gb_spi_device_config_request)),
+	GB_OPERATION_ARRAY(GB_SPI_TYPE_TRANSFER, gb_spi_protocol_transfer,
+			   struct gb_spi_transfer_request, count, struct gb_spi_transfer),
+};
 
 const struct gb_driver gb_spi_driver = {
-	.op_handler = gb_spi_handler,
+	GB_OPERATIONS(gb_spi_ops),
 };
@@ -4,6 +4,7 @@
 #include <greybus/svc.h>
 #include <greybus/apbridge.h>
 #include <zephyr/logging/log.h>
+#include "greybus_operation.h"
 
 LOG_MODULE_REGISTER(greybus_svc, CONFIG_GREYBUS_LOG_LEVEL);
 
@@ -11,10 +12,36 @@ LOG_MODULE_REGISTER(greybus_svc, CONFIG_GREYBUS_LOG_LEVEL);
 #define GB_SVC_VERSION_MAJOR 0x00
 #define GB_SVC_VERSION_MINOR 0x01
 
-#define SVC_INIT_TIMEOUT K_SECONDS(5)
+/* SVC messages do not go through a local cport, so their operations are tracked under this one */
+#define SVC_OPERATION_CPORT UINT16_MAX
 
+/* Given once the AP answered the SVC hello. Waiters give it back, so that it stays available. */
 K_SEM_DEFINE(svc_init, 0, 1);
 
+/*
+ * struct gb_svc_hotplug: Module event waiting to be sent to the AP
+ *
+ * @type: GB_SVC_TYPE_MODULE_INSERTED or GB_SVC_TYPE_MODULE_REMOVED
+ * @primary_intf_id: primary interface of the module
+ * @intf_count: interfaces covered by the module, only for insertion
+ * @flags: insertion flags
+ */
+struct gb_svc_hotplug {
+	uint8_t type;
+	uint8_t primary_intf_id;
+	uint8_t intf_count;
+	uint16_t flags;
+};
+
+/*
+ * Module events are queued until the AP answered the hello, then sent without waiting for each
+ * other, with at most CONFIG_GREYBUS_SVC_MAX_OPERATIONS waiting for their response.
+ */
+K_MSGQ_DEFINE(svc_hotplug_msgq, sizeof(struct gb_svc_hotplug),
+	      CONFIG_GREYBUS_SVC_HOTPLUG_QUEUE_DEPTH, 4);
+static atomic_t svc_ready;
+static atomic_t svc_operations;
+
 /* TODO: Add support for standalone SVC support */
 static int gb_svc_msg_send(struct gb_message *msg)
 {
@@ -170,6 +197,148 @@ static void svc_interface_resume_handler(struct gb_message *msg)
 			    GB_SVC_OP_SUCCESS);
 }
 
+/*
+ * Helper to claim one of the outstanding operations
+ */
+static bool svc_operation_get(void)
+{
+	atomic_val_t num;
+
+	do {
+		num = atomic_get(&svc_operations);
+		if (num >= CONFIG_GREYBUS_SVC_MAX_OPERATIONS) {
+			return false;
+		}
+	} while (!atomic_cas(&svc_operations, num, num + 1));
+
+	return true;
+}
+
+static void svc_operation_put(void)
+{
+	atomic_dec(&svc_operations);
+}
+
+static void svc_hotplug_flush(void);
+
+/*
+ * Called once per module event, when its response arrives, when it times out or when the SVC
+ * stops. Frees the operation it held either way.
+ */
+static void svc_hotplug_done(uint16_t cport, uint16_t operation_id, struct gb_message *resp,
+			     int err, void *priv)
+{
+	const uint8_t type = POINTER_TO_UINT(priv);
+
+	ARG_UNUSED(cport);
+
+	if (err == -ETIMEDOUT) {
+		LOG_WRN("No response to module event %u", operation_id);
+	} else if (resp && !gb_message_is_success(resp) && type == GB_SVC_TYPE_MODULE_INSERTED) {
+		/* TODO: Add functionality to remove the interface in case of error */
+		LOG_ERR("Module Inserted Event failed");
+	} else if (resp && !gb_message_is_success(resp)) {
+		LOG_DBG("Module Removal Failed");
+	}
+	gb_message_dealloc(resp);
+
+	svc_operation_put();
+	/* Cancelled when sending failed or the SVC stopped, then nothing else is due */
+	if (err != -ECANCELED) {
+		svc_hotplug_flush();
+	}
+}
+
+/*
+ * Helper to send a module event on an operation claimed by the caller. The operation is freed if
+ * sending fails.
+ */
+static int svc_hotplug_send(const struct gb_svc_hotplug *ev)
+{
+	int ret;
+	struct gb_message *req;
+	uint16_t operation_id;
+	const struct gb_svc_module_inserted_request inserted = {
+		.primary_intf_id = ev->primary_intf_id,
+		.intf_count = ev->intf_count,
+		.flags = sys_cpu_to_le16(ev->flags),
+	};
+	const struct gb_svc_module_removed_request removed = {
+		.primary_intf_id = ev->primary_intf_id,
+	};
+
+	if (ev->type == GB_SVC_TYPE_MODULE_INSERTED) {
+		req = gb_message_request_alloc_with_payload(&inserted, sizeof(inserted), ev->type,
+							    false);
+	} else {
+		req = gb_message_request_alloc_with_payload(&removed, sizeof(removed), ev->type,
+							    false);
+	}
+	if (!req) {
+		svc_operation_put();
+		return -ENOMEM;
+	}
+
+	/* Tracked before sending, the response can arrive before send returns */
+	operation_id = req->header.operation_id;
+	ret = gb_operation_track(SVC_OPERATION_CPORT, operation_id,
+				 CONFIG_GREYBUS_SVC_OPERATION_TIMEOUT_MS, svc_hotplug_done,
+				 UINT_TO_POINTER(ev->type));
+	if (ret < 0) {
+		gb_message_dealloc(req);
+		svc_operation_put();
+		return ret;
+	}
+
+	ret = gb_svc_msg_send(req);
+	if (ret < 0) {
+		gb_operation_cancel(SVC_OPERATION_CPORT, operation_id);
+	}
+
+	return ret;
+}
+
+/*
+ * Helper to send queued module events, as far as the outstanding operations allow
+ */
+static void svc_hotplug_flush(void)
+{
+	struct gb_svc_hotplug ev;
+	int ret;
+
+	while (atomic_get(&svc_ready) && svc_operation_get()) {
+		if (k_msgq_get(&svc_hotplug_msgq, &ev, K_NO_WAIT) < 0) {
+			svc_operation_put();
+			/*
+			 * An event queued meanwhile may have found no free operation because of the
+			 * one held here, so it is left to this loop.
+			 */
+			if (!k_msgq_num_used_get(&svc_hotplug_msgq)) {
+				return;
+			}
+			continue;
+		}
+
+		ret = svc_hotplug_send(&ev);
+		if (ret < 0) {
+			LOG_ERR("Failed to send module event for interface %u (%d)",
+				ev.primary_intf_id, ret);
+		}
+	}
+}
+
+static int svc_hotplug_queue(const struct gb_svc_hotplug *ev)
+{
+	if (k_msgq_put(&svc_hotplug_msgq, ev, K_NO_WAIT) < 0) {
+		LOG_ERR("Too many module events, dropping interface %u", ev->primary_intf_id);
+		return -ENOBUFS;
+	}
+
+	svc_hotplug_flush();
+
+	return 0;
+}
+
 static int svc_send_hello(void)
 {
 	const struct gb_svc_hello_request req_data = {.endo_id = ENDO_ID,
@@ -189,81 +358,91 @@ static void svc_version_response_handler(struct gb_message *msg)
 	svc_send_hello();
 }
 
-static void svc_module_inserted_response_handler(struct gb_message *msg)
+/* Responses to module events that timed out, their operation is already gone */
+static void svc_hotplug_late_response_handler(struct gb_message *msg)
 {
-	if (!gb_message_is_success(msg)) {
-		/* TODO: Add functionality to remove the interface in case of error */
-		LOG_ERR("Module Inserted Event failed");
-	}
+	LOG_DBG("Late response to module event %u", msg->header.operation_id);
 }
 
-static void svc_module_removed_response_handler(struct gb_message *msg)
+static void svc_empty_response_handler(struct gb_message *msg)
 {
-	if (!gb_message_is_success(msg)) {
-		LOG_DBG("Module Removal Failed");
-	}
+	svc_response_helper(msg, NULL, 0, GB_OP_SUCCESS);
 }
 
+static void svc_hello_response_handler(struct gb_message *msg)
+{
+	atomic_set(&svc_ready, 1);
+	k_sem_give(&svc_init);
+	svc_hotplug_flush();
+}
+
+struct gb_svc_operation {
+	void (*handler)(struct gb_message *msg);
+	uint16_t min_payload_len;
+};
+
+#define GB_SVC_OPERATION(_type, _handler, _min_len)                                                \
+	[_type] = {.handler = _handler, .min_payload_len = _min_len}
+
+/* Requests from the AP, indexed by type */
+static const struct gb_svc_operation gb_svc_ops[] = {
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_DEVICE_ID, svc_empty_response_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_ROUTE_CREATE, svc_empty_response_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_ROUTE_DESTROY, svc_empty_response_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_PING, svc_empty_response_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_CONN_CREATE, svc_connection_create_handler,
+			 sizeof(struct gb_svc_conn_create_request)),
+	GB_SVC_OPERATION(GB_SVC_TYPE_CONN_DESTROY, svc_connection_destroy_handler,
+			 sizeof(struct gb_svc_conn_destroy_request)),
+	GB_SVC_OPERATION(GB_SVC_TYPE_DME_PEER_GET, svc_dme_peer_get_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_DME_PEER_SET, svc_dme_peer_set_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_SET_PWRM, svc_intf_set_pwrm_handler,
+			 sizeof(struct gb_svc_intf_set_pwrm_request)),
+	GB_SVC_OPERATION(GB_SVC_TYPE_PWRMON_RAIL_COUNT_GET, svc_pwrm_get_rail_count_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_VSYS_ENABLE, svc_intf_vsys_enable_disable_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_VSYS_DISABLE, svc_intf_vsys_enable_disable_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_REFCLK_ENABLE,
+			 svc_interface_refclk_enable_disable_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_REFCLK_DISABLE,
+			 svc_interface_refclk_enable_disable_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_UNIPRO_ENABLE,
+			 svc_interface_unipro_enable_disable_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_UNIPRO_DISABLE,
+			 svc_interface_unipro_enable_disable_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_ACTIVATE, svc_interface_activate_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_INTF_RESUME, svc_interface_resume_handler, 0),
+};
+
+/* Responses to requests sent by the SVC, indexed by request type */
+static const struct gb_svc_operation gb_svc_response_ops[] = {
+	GB_SVC_OPERATION(GB_SVC_TYPE_PROTOCOL_VERSION, svc_version_response_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_SVC_HELLO, svc_hello_response_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_MODULE_INSERTED, svc_hotplug_late_response_handler, 0),
+	GB_SVC_OPERATION(GB_SVC_TYPE_MODULE_REMOVED, svc_hotplug_late_response_handler, 0),
+};
+
 static void gb_handle_msg(struct gb_message *msg)
 {
-	switch (gb_message_type(msg)) {
-	case GB_SVC_TYPE_INTF_DEVICE_ID:
-	case GB_SVC_TYPE_ROUTE_CREATE:
-	case GB_SVC_TYPE_ROUTE_DESTROY:
-	case GB_SVC_TYPE_PING:
-		svc_response_helper(msg, NULL, 0, GB_OP_SUCCESS);
-		break;
-	case GB_SVC_TYPE_CONN_CREATE:
-		svc_connection_create_handler(msg);
-		break;
-	case GB_SVC_TYPE_CONN_DESTROY:
-		svc_connection_destroy_handler(msg);
-		break;
-	case GB_SVC_TYPE_DME_PEER_GET:
-		svc_dme_peer_get_handler(msg);
-		break;
-	case GB_SVC_TYPE_DME_PEER_SET:
-		svc_dme_peer_set_handler(msg);
-		break;
-	case GB_SVC_TYPE_INTF_SET_PWRM:
-		svc_intf_set_pwrm_handler(msg);
-		break;
-	case GB_SVC_TYPE_PWRMON_RAIL_COUNT_GET:
-		svc_pwrm_get_rail_count_handler(msg);
-		break;
-	case GB_SVC_TYPE_INTF_VSYS_ENABLE:
-	case GB_SVC_TYPE_INTF_VSYS_DISABLE:
-		svc_intf_vsys_enable_disable_handler(msg);
-		break;
-	case GB_SVC_TYPE_INTF_REFCLK_ENABLE:
-	case GB_SVC_TYPE_INTF_REFCLK_DISABLE:
-		svc_interface_refclk_enable_disable_handler(msg);
-		break;
-	case GB_SVC_TYPE_INTF_UNIPRO_ENABLE:
-	case GB_SVC_TYPE_INTF_UNIPRO_DISABLE:
-		svc_interface_unipro_enable_disable_handler(msg);
-		break;
-	case GB_SVC_TYPE_INTF_ACTIVATE:
-		svc_interface_activate_handler(msg);
-		break;
-	case GB_SVC_TYPE_INTF_RESUME:
-		svc_interface_resume_handler(msg);
-		break;
-	case GB_RESPONSE(GB_SVC_TYPE_PROTOCOL_VERSION):
-		svc_version_response_handler(msg);
-		break;
-	case GB_RESPONSE(GB_SVC_TYPE_SVC_HELLO):
-		k_sem_give(&svc_init);
-		break;
-	case GB_RESPONSE(GB_SVC_TYPE_MODULE_INSERTED):
-		svc_module_inserted_response_handler(msg);
-		break;
-	case GB_RESPONSE(GB_SVC_TYPE_MODULE_REMOVED):
-		svc_module_removed_response_handler(msg);
-		break;
-	default:
+	const bool is_response = gb_message_is_response(msg);
+	const struct gb_svc_operation *ops = is_response ? gb_svc_response_ops : gb_svc_ops;
+	const size_t ops_num =
+		is_response ? ARRAY_SIZE(gb_svc_response_ops) : ARRAY_SIZE(gb_svc_ops);
+	const uint8_t type = gb_message_type(msg) & ~GB_TYPE_RESPONSE_FLAG;
+
+	if (type >= ops_num || !ops[type].handler) {
 		LOG_WRN("Handling SVC operation Type %X not supported yet", msg->header.type);
+		return;
+	}
+
+	if (gb_message_payload_len(msg) < ops[type].min_payload_len) {
+		LOG_ERR("dropping short message");
+		if (!is_response) {
+			svc_response_helper(msg, NULL, 0, GB_OP_INVALID);
+		}
+		return;
 	}
+
+	ops[type].handler(msg);
 }
 
 static int gb_svc_intf_write(struct gb_interface *intf, struct gb_message *msg, uint16_t cport)
@@ -271,6 +450,11 @@ static int gb_svc_intf_write(struct gb_interface *intf, struct gb_message *msg,
 	ARG_UNUSED(intf);
 	ARG_UNUSED(cport);
 
+	/* Responses to module events go to their operation callback, which frees them */
+	if (gb_message_is_response(msg) && gb_operation_complete(SVC_OPERATION_CPORT, msg)) {
+		return 0;
+	}
+
 	gb_handle_msg(msg);
 	gb_message_dealloc(msg);
 	return 0;
@@ -304,6 +488,10 @@ int gb_svc_init(void)
 	int ret;
 
 	gb_interface_add(&svc_intf);
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+	/* SVC operations are handled in the write, keep them off the thread that routed them */
+	gb_interface_tx_queue_start(&svc_intf, NULL);
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
 
 	ret = gb_apbridge_connection_create(AP_INF_ID, 0, SVC_INF_ID, 0);
 	if (ret < 0) {
@@ -317,48 +505,53 @@ int gb_svc_init(void)
 		return ret;
 	}
 
-	ret = k_sem_take(&svc_init, SVC_INIT_TIMEOUT);
+	return 0;
+}
+
+int gb_svc_wait_ready(k_timeout_t timeout)
+{
+	int ret;
+
+	ret = k_sem_take(&svc_init, timeout);
 	if (ret < 0) {
-		LOG_ERR("Failed to init");
 		return ret;
 	}
+	k_sem_give(&svc_init);
 
 	return 0;
 }
 
 void gb_svc_deinit(void)
 {
+	atomic_set(&svc_ready, 0);
+	k_sem_reset(&svc_init);
 	gb_interface_remove(svc_intf.id);
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+	gb_interface_tx_queue_stop(&svc_intf);
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+	k_msgq_purge(&svc_hotplug_msgq);
+	/* Frees the operations of the module events still waiting for a response */
+	gb_operation_cancel_all(SVC_OPERATION_CPORT);
 }
 
 int gb_svc_send_module_inserted(uint8_t primary_intf_id, uint8_t intf_count, uint16_t flags)
 {
-	struct gb_message *req;
-	const struct gb_svc_module_inserted_request req_data = {
+	const struct gb_svc_hotplug ev = {
+		.type = GB_SVC_TYPE_MODULE_INSERTED,
 		.primary_intf_id = primary_intf_id,
 		.intf_count = intf_count,
 		.flags = flags,
 	};
 
-	req = gb_message_request_alloc_with_payload(&req_data, sizeof(req_data),
-						    GB_SVC_TYPE_MODULE_INSERTED, false);
-	if (!req) {
-		return -ENOMEM;
-	}
-
-	return gb_svc_msg_send(req);
+	return svc_hotplug_queue(&ev);
 }
 
 int gb_svc_send_module_removed(uint8_t primary_intf_id)
 {
-	struct gb_message *req;
-	const struct gb_svc_module_removed_request req_data = {.primary_intf_id = primary_intf_id};
-
-	req = gb_message_request_alloc_with_payload(&req_data, sizeof(req_data),
-						    GB_SVC_TYPE_MODULE_REMOVED, false);
-	if (!req) {
-		return -ENOMEM;
-	}
+	const struct gb_svc_hotplug ev = {
+		.type = GB_SVC_TYPE_MODULE_REMOVED,
+		.primary_intf_id = primary_intf_id,
+	};
 
-	return gb_svc_msg_send(req);
+	return svc_hotplug_queue(&ev);
 }
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2025 Ayush Singh BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * TimeSync keeps a node local timebase convertible to the frame time of the AP.
+ *
+ * The SVC pulses a wake line once per strobe, and the node captures its local time at each pulse.
+ * The AP then sends the frame time it measured for each strobe, which pins the local time of the
+ * last strobe to a frame time. Without a zephyr,greybus-timesync strobe input, the arrival of the
+ * enable request is taken as the only strobe, so the error is the one way transport latency.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include "greybus_timesync.h"
+
+LOG_MODULE_REGISTER(greybus_timesync, CONFIG_GREYBUS_LOG_LEVEL);
+
+#define GB_TIMESYNC_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(zephyr_greybus_timesync)
+
+/*
+ * struct gb_timesync: TimeSync state
+ *
+ * @lock: protects the state, strobes are captured in interrupt context
+ * @enabled: strobes are being captured
+ * @synced: ref_ns and ref_frame are valid
+ * @count: number of strobes expected
+ * @strobes: number of strobes captured
+ * @refclk: rate of the frame time in Hz
+ * @frame_time: frame time at the first strobe, from the enable request
+ * @strobe_ns: local time of each strobe
+ * @ref_ns: local time of the reference point
+ * @ref_frame: frame time of the reference point
+ */
+struct gb_timesync {
+	struct k_spinlock lock;
+	bool enabled;
+	bool synced;
+	uint8_t count;
+	uint8_t strobes;
+	uint32_t refclk;
+	uint64_t frame_time;
+	uint64_t strobe_ns[GB_TIMESYNC_MAX_STROBES];
+	uint64_t ref_ns;
+	uint64_t ref_frame;
+};
+
+static struct gb_timesync gb_timesync;
+
+#if DT_NODE_EXISTS(GB_TIMESYNC_NODE)
+static const struct gpio_dt_spec gb_timesync_strobe =
+	GPIO_DT_SPEC_GET(GB_TIMESYNC_NODE, strobe_gpios);
+static struct gpio_callback gb_timesync_strobe_cb;
+#endif // DT_NODE_EXISTS(GB_TIMESYNC_NODE)
+
+/*
+ * Helper to convert a local time to frame time. Must be called with the lock held and synced set.
+ * The elapsed time is split in seconds, so the multiplication cannot overflow.
+ */
+static uint64_t gb_timesync_frame_time(const struct gb_timesync *ts, uint64_t local_ns)
+{
+	const bool after = local_ns >= ts->ref_ns;
+	const uint64_t delta = after ? local_ns - ts->ref_ns : ts->ref_ns - local_ns;
+	const uint64_t ticks = (delta / NSEC_PER_SEC) * ts->refclk +
+			       (delta % NSEC_PER_SEC) * ts->refclk / NSEC_PER_SEC;
+
+	return after ? ts->ref_frame + ticks : ts->ref_frame - ticks;
+}
+
+int gb_timesync_to_frame_time(uint64_t local_ns, uint64_t *frame_time)
+{
+	int ret = 0;
+	k_spinlock_key_t key = k_spin_lock(&gb_timesync.lock);
+
+	if (gb_timesync.synced) {
+		*frame_time = gb_timesync_frame_time(&gb_timesync, local_ns);
+	} else {
+		ret = -EAGAIN;
+	}
+
+	k_spin_unlock(&gb_timesync.lock, key);
+
+	return ret;
+}
+
+/*
+ * Helper to record a strobe. Until the AP sends the authoritative frame times, the first strobe
+ * is pinned to the frame time from the enable request.
+ */
+static void gb_timesync_capture(struct gb_timesync *ts, uint64_t local_ns)
+{
+	k_spinlock_key_t key = k_spin_lock(&ts->lock);
+
+	if (ts->enabled && ts->strobes < ts->count) {
+		ts->strobe_ns[ts->strobes] = local_ns;
+		if (ts->strobes == 0) {
+			ts->ref_ns = local_ns;
+			ts->ref_frame = ts->frame_time;
+			ts->synced = true;
+		}
+		ts->strobes++;
+	}
+
+	k_spin_unlock(&ts->lock, key);
+}
+
+#if DT_NODE_EXISTS(GB_TIMESYNC_NODE)
+static void gb_timesync_strobe_handler(const struct device *dev, struct gpio_callback *cb,
+				       uint32_t pins)
+{
+	gb_timesync_capture(&gb_timesync, gb_timesync_local_time());
+}
+
+static int gb_timesync_strobe_set(bool enable)
+{
+	return gpio_pin_interrupt_configure_dt(&gb_timesync_strobe,
+					       enable ? GPIO_INT_EDGE_TO_ACTIVE : GPIO_INT_DISABLE);
+}
+#endif // DT_NODE_EXISTS(GB_TIMESYNC_NODE)
+
+int gb_timesync_enable(uint8_t count, uint64_t frame_time, uint32_t strobe_delay,
+		       uint32_t refclk)
+{
+	k_spinlock_key_t key;
+
+	if (!count || count > GB_TIMESYNC_MAX_STROBES || !refclk) {
+		return -EINVAL;
+	}
+
+	gb_timesync_disable();
+
+	key = k_spin_lock(&gb_timesync.lock);
+	gb_timesync.count = count;
+	gb_timesync.refclk = refclk;
+	gb_timesync.frame_time = frame_time;
+	gb_timesync.enabled = true;
+	k_spin_unlock(&gb_timesync.lock, key);
+
+	LOG_DBG("%u strobes %u us apart, refclk %u Hz", count, strobe_delay, refclk);
+
+#if DT_NODE_EXISTS(GB_TIMESYNC_NODE)
+	return gb_timesync_strobe_set(true);
+#else
+	gb_timesync_capture(&gb_timesync, gb_timesync_local_time());
+
+	return 0;
+#endif // DT_NODE_EXISTS(GB_TIMESYNC_NODE)
+}
+
+void gb_timesync_disable(void)
+{
+	k_spinlock_key_t key;
+
+#if DT_NODE_EXISTS(GB_TIMESYNC_NODE)
+	gb_timesync_strobe_set(false);
+#endif // DT_NODE_EXISTS(GB_TIMESYNC_NODE)
+
+	key = k_spin_lock(&gb_timesync.lock);
+	gb_timesync.enabled = false;
+	gb_timesync.synced = false;
+	gb_timesync.strobes = 0;
+	k_spin_unlock(&gb_timesync.lock, key);
+}
+
+int gb_timesync_authoritative(const uint64_t frame_time[GB_TIMESYNC_MAX_STROBES])
+{
+	int ret = 0;
+	k_spinlock_key_t key = k_spin_lock(&gb_timesync.lock);
+	const uint8_t last = gb_timesync.strobes - 1;
+
+	if (!gb_timesync.enabled || !gb_timesync.strobes) {
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	/* The last strobe is the most recent, so drift since then is the smallest */
+	gb_timesync.ref_ns = gb_timesync.strobe_ns[last];
+	gb_timesync.ref_frame = frame_time[last];
+	gb_timesync.synced = true;
+
+out:
+	k_spin_unlock(&gb_timesync.lock, key);
+
+	return ret;
+}
+
+int gb_timesync_get_last_event(uint64_t *frame_time)
+{
+	int ret = 0;
+	k_spinlock_key_t key = k_spin_lock(&gb_timesync.lock);
+
+	if (!gb_timesync.enabled || !gb_timesync.strobes) {
+		ret = -EAGAIN;
+	} else {
+		*frame_time = gb_timesync_frame_time(
+			&gb_timesync, gb_timesync.strobe_ns[gb_timesync.strobes - 1]);
+	}
+
+	k_spin_unlock(&gb_timesync.lock, key);
+
+	return ret;
+}
+
+#if DT_NODE_EXISTS(GB_TIMESYNC_NODE)
+static int gb_timesync_init(void)
+{
+	int ret;
+
+	if (!gpio_is_ready_dt(&gb_timesync_strobe)) {
+		LOG_ERR("TimeSync strobe GPIO is not ready");
+		return -ENODEV;
+	}
+
+	ret = gpio_pin_configure_dt(&gb_timesync_strobe, GPIO_INPUT);
+	if (ret < 0) {
+		LOG_ERR("Failed to configure TimeSync strobe GPIO: %d", ret);
+		return ret;
+	}
+
+	gpio_init_callback(&gb_timesync_strobe_cb, gb_timesync_strobe_handler,
+			   BIT(gb_timesync_strobe.pin));
+
+	return gpio_add_callback_dt(&gb_timesync_strobe, &gb_timesync_strobe_cb);
+}
+
+SYS_INIT(gb_timesync_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+#endif // DT_NODE_EXISTS(GB_TIMESYNC_NODE)
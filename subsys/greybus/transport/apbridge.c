@@ -36,9 +36,13 @@ static int gb_trans_listen(uint16_t cport)
 
 static int gb_trans_send(uint16_t cport, const struct gb_message *msg)
 {
-	struct gb_message *msg_copy = gb_message_copy(msg);
+	struct gb_message *msg_ref = gb_message_get(msg);
 
-	return gb_apbridge_send(INTF_START_ID, cport, msg_copy);
+	if (!msg_ref) {
+		return -ENOMEM;
+	}
+
+	return gb_apbridge_send(INTF_START_ID, cport, msg_ref);
 }
 
 const struct gb_transport_backend gb_trans_backend = {
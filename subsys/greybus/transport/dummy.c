@@ -10,7 +10,7 @@
 #include <greybus-utils/manifest.h>
 #include "../greybus_internal.h"
 
-K_MSGQ_DEFINE(rx_msgq, sizeof(struct gb_msg_with_cport), 2, 1);
+K_MSGQ_DEFINE(rx_msgq, sizeof(struct gb_msg_with_cport), CONFIG_GREYBUS_XPORT_DUMMY_QUEUE_DEPTH, 1);
 
 static int init()
 {
@@ -24,12 +24,22 @@ static int listen(uint16_t cport)
 
 static int trans_send(uint16_t cport, const struct gb_message *msg)
 {
+	int ret;
 	const struct gb_msg_with_cport msg_copy = {
 		.cport = cport,
-		.msg = gb_message_copy(msg),
+		.msg = gb_message_get(msg),
 	};
 
-	return k_msgq_put(&rx_msgq, &msg_copy, K_NO_WAIT);
+	if (!msg_copy.msg) {
+		return -ENOMEM;
+	}
+
+	ret = k_msgq_put(&rx_msgq, &msg_copy, K_NO_WAIT);
+	if (ret < 0) {
+		gb_message_dealloc(msg_copy.msg);
+	}
+
+	return ret;
 }
 
 const struct gb_transport_backend gb_trans_backend = {
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Transport to another core of the SoC over the IPC service instance chosen as zephyr,greybus-ipc.
+ *
+ * Each IPC message is the cport (le16) followed by the greybus message. Outgoing messages are
+ * written straight into the shared memory buffer of the backend when it supports no-copy send.
+ */
+
+#include <greybus/greybus.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/ipc/ipc_service.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <greybus/greybus_messages.h>
+#include "../greybus_heap.h"
+#include "../greybus_internal.h"
+
+LOG_MODULE_REGISTER(greybus_transport_ipc, CONFIG_GREYBUS_LOG_LEVEL);
+
+#define GB_TRANS_IPC_EPT_NAME "greybus"
+#define GB_TRANS_IPC_HDR_SIZE sizeof(__le16)
+
+/*
+ * struct gb_trans_ctx: Transport Context
+ *
+ * @instance: IPC service instance
+ * @ept: endpoint shared with the other core
+ * @bound: endpoint is bound on both sides
+ * @nocopy: backend supports no-copy send
+ */
+struct gb_trans_ctx {
+	const struct device *instance;
+	struct ipc_ept ept;
+	atomic_t bound;
+	bool nocopy;
+};
+
+static struct gb_trans_ctx ctx = {
+	.instance = DEVICE_DT_GET(DT_CHOSEN(zephyr_greybus_ipc)),
+	.nocopy = true,
+};
+
+static int gb_trans_listen_start(uint16_t cport)
+{
+	return 0;
+}
+
+static int gb_trans_listen_stop(uint16_t cport)
+{
+	return 0;
+}
+
+static void gb_trans_ept_bound(void *priv)
+{
+	struct gb_trans_ctx *ctx = priv;
+
+	atomic_set(&ctx->bound, 1);
+	LOG_INF("Greybus endpoint bound");
+}
+
+static void gb_trans_ept_unbound(void *priv)
+{
+	struct gb_trans_ctx *ctx = priv;
+
+	atomic_set(&ctx->bound, 0);
+	LOG_INF("Greybus endpoint unbound");
+}
+
+/*
+ * The shared buffer is returned to the other core as soon as this returns, so that a slow
+ * handler does not hold up the rings. The message is copied once, straight into its allocation.
+ */
+static void gb_trans_ept_received(const void *data, size_t len, void *priv)
+{
+	struct gb_operation_msg_hdr hdr;
+	struct gb_message *msg;
+	const uint8_t *buf = data;
+	uint16_t cport;
+	size_t size;
+
+	if (len < GB_TRANS_IPC_HDR_SIZE + sizeof(hdr)) {
+		LOG_ERR("Dropping short message (%zu)", len);
+		return;
+	}
+
+	cport = sys_get_le16(buf);
+	memcpy(&hdr, buf + GB_TRANS_IPC_HDR_SIZE, sizeof(hdr));
+	size = sys_le16_to_cpu(hdr.size);
+	if (size < sizeof(hdr) || size != len - GB_TRANS_IPC_HDR_SIZE) {
+		LOG_ERR("Invalid message size %zu in %zu bytes", size, len);
+		return;
+	}
+
+	msg = gb_message_alloc(gb_hdr_payload_len(&hdr), hdr.type, hdr.operation_id, hdr.result);
+	if (!msg) {
+		LOG_ERR("Failed to allocate node message");
+		return;
+	}
+	memcpy(&msg->header, buf + GB_TRANS_IPC_HDR_SIZE, size);
+
+	if (greybus_rx_handler(cport, msg) < 0) {
+		LOG_ERR("Failed to receive greybus message");
+		gb_message_dealloc(msg);
+	}
+}
+
+static void gb_trans_ept_error(const char *message, void *priv)
+{
+	LOG_ERR("IPC error: %s", message);
+}
+
+static const struct ipc_ept_cfg gb_trans_ept_cfg = {
+	.name = GB_TRANS_IPC_EPT_NAME,
+	.cb = {
+		.bound = gb_trans_ept_bound,
+		.unbound = gb_trans_ept_unbound,
+		.received = gb_trans_ept_received,
+		.error = gb_trans_ept_error,
+	},
+	.priv = &ctx,
+};
+
+/*
+ * Helper to fill a buffer with the cport and message.
+ */
+static void gb_trans_fill(uint8_t *buf, uint16_t cport, const struct gb_message *msg, size_t size)
+{
+	sys_put_le16(cport, buf);
+	memcpy(buf + GB_TRANS_IPC_HDR_SIZE, &msg->header, size);
+}
+
+/*
+ * Helper to send through a bounce buffer, for backends without no-copy send.
+ */
+static int gb_trans_send_copy(uint16_t cport, const struct gb_message *msg, size_t size)
+{
+	int ret;
+	uint8_t *buf = gb_alloc(GB_TRANS_IPC_HDR_SIZE + size);
+
+	if (!buf) {
+		return -ENOMEM;
+	}
+
+	gb_trans_fill(buf, cport, msg, size);
+	ret = ipc_service_send(&ctx.ept, buf, GB_TRANS_IPC_HDR_SIZE + size);
+	gb_free(buf);
+
+	return ret;
+}
+
+static int gb_trans_send(uint16_t cport, const struct gb_message *msg)
+{
+	int ret;
+	void *buf;
+	const size_t size = sys_le16_to_cpu(msg->header.size);
+	uint32_t len = GB_TRANS_IPC_HDR_SIZE + size;
+
+	if (msg->header.result) {
+		LOG_INF("CPort %u, Type: %u, Result: %u, Id: %u", cport, msg->header.type,
+			msg->header.result, msg->header.operation_id);
+	}
+
+	if (!atomic_get(&ctx.bound)) {
+		return -ENOTCONN;
+	}
+
+	if (!ctx.nocopy) {
+		ret = gb_trans_send_copy(cport, msg, size);
+		goto out;
+	}
+
+	ret = ipc_service_get_tx_buffer(&ctx.ept, &buf, &len,
+					K_MSEC(CONFIG_GREYBUS_XPORT_IPC_TX_TIMEOUT_MS));
+	if (ret == -ENOTSUP) {
+		LOG_INF("IPC backend has no no-copy send, copying messages");
+		ctx.nocopy = false;
+		ret = gb_trans_send_copy(cport, msg, size);
+		goto out;
+	}
+	if (ret < 0) {
+		goto out;
+	}
+
+	gb_trans_fill(buf, cport, msg, size);
+	ret = ipc_service_send_nocopy(&ctx.ept, buf, GB_TRANS_IPC_HDR_SIZE + size);
+	if (ret < 0) {
+		ipc_service_drop_tx_buffer(&ctx.ept, buf);
+	}
+
+out:
+	if (ret < 0) {
+		LOG_ERR("Failed to send %zu byte message on cport %u (%d)", size, cport, ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int gb_trans_init(void)
+{
+	int ret;
+
+	ret = ipc_service_open_instance(ctx.instance);
+	if (ret < 0 && ret != -EALREADY) {
+		LOG_ERR("Failed to open IPC instance %s (%d)", ctx.instance->name, ret);
+		return ret;
+	}
+
+	atomic_set(&ctx.bound, 0);
+	ret = ipc_service_register_endpoint(ctx.instance, &ctx.ept, &gb_trans_ept_cfg);
+	if (ret < 0) {
+		LOG_ERR("Failed to register IPC endpoint (%d)", ret);
+		return ret;
+	}
+
+	LOG_INF("Greybus transport on %s", ctx.instance->name);
+
+	return 0;
+}
+
+static void gb_trans_exit(void)
+{
+	atomic_set(&ctx.bound, 0);
+	ipc_service_deregister_endpoint(&ctx.ept);
+}
+
+const struct gb_transport_backend gb_trans_backend = {
+	.init = gb_trans_init,
+	.exit = gb_trans_exit,
+	.listen = gb_trans_listen_start,
+	.stop_listening = gb_trans_listen_stop,
+	.send = gb_trans_send,
+};
@@ -9,8 +9,11 @@
 #include <zephyr/net/dns_sd.h>
 #include <zephyr/net/net_ip.h>
 #include <zephyr/net/socket.h>
+#include <zephyr/sys/util.h>
+#include <greybus-utils/manifest.h>
 #include "../platform/certificate.h"
 #include <greybus/greybus_messages.h>
+#include "../greybus_cport.h"
 #include "../greybus_internal.h"
 
 LOG_MODULE_REGISTER(greybus_transport_tcpip, CONFIG_GREYBUS_LOG_LEVEL);
@@ -21,33 +24,90 @@ LOG_MODULE_REGISTER(greybus_transport_tcpip, CONFIG_GREYBUS_LOG_LEVEL);
 #define CONFIG_GREYBUS_TLS_HOSTNAME ""
 #endif
 
+#ifdef CONFIG_GREYBUS_TLS_1_3
+#define GB_TRANS_TLS_PROTO IPPROTO_TLS_1_3
+#else
+#define GB_TRANS_TLS_PROTO IPPROTO_TLS_1_2
+#endif
+
 /* Based on UniPro, from Linux */
 #define CPORT_ID_MAX 4095
 
-#define GB_TRANS_RX_STACK_SIZE     1024
-#define GB_TRANS_RX_STACK_PRIORITY 6
+/* Most messages written to the socket in one call */
+#define GB_TRANS_TX_BATCH 8
+
+/* Leave room for a reconnecting host while the stale connection is still open */
+#define GB_TRANS_LISTEN_BACKLOG 2
+
+#ifdef CONFIG_GREYBUS_TCPIP_DNS_SD_TXT
+/*
+ * TXT record, filled at init:
+ * - mh: CRC-32 of the manifest, 8 hex digits
+ * - pr: bitmap of the protocols of all cports, bit n set for protocol n, bytes in ascending order
+ * - fw: CONFIG_GREYBUS_TCPIP_DNS_SD_FW_VERSION
+ */
+#define GB_TRANS_TXT_HASH     "mh="
+#define GB_TRANS_TXT_PROTO    "pr="
+#define GB_TRANS_TXT_FW       "fw=" CONFIG_GREYBUS_TCPIP_DNS_SD_FW_VERSION
+#define GB_TRANS_TXT_PROTOS   (UINT8_MAX + 1)
+#define GB_TRANS_TXT_HASH_LEN (sizeof(GB_TRANS_TXT_HASH) - 1 + 2 * sizeof(uint32_t))
+#define GB_TRANS_TXT_PROTO_LEN                                                                     \
+	(sizeof(GB_TRANS_TXT_PROTO) - 1 + 2 * GB_TRANS_TXT_PROTOS / BITS_PER_BYTE)
+#define GB_TRANS_TXT_FW_LEN (sizeof(GB_TRANS_TXT_FW) - 1)
+
+BUILD_ASSERT(GB_TRANS_TXT_FW_LEN <= UINT8_MAX, "Firmware version too long for a TXT string");
+
+/* Each string is prefixed by its length, the last byte is only there for the terminator */
+static char gb_trans_txt[1 + GB_TRANS_TXT_HASH_LEN + 1 + GB_TRANS_TXT_PROTO_LEN + 1 +
+			 GB_TRANS_TXT_FW_LEN + 1];
+
+#define GB_TRANS_TXT gb_trans_txt
+#else
+#define GB_TRANS_TXT DNS_SD_EMPTY_TXT
+#endif /* CONFIG_GREYBUS_TCPIP_DNS_SD_TXT */
 
 #ifdef CONFIG_GREYBUS_ENABLE_TLS
 DNS_SD_REGISTER_TCP_SERVICE(gb_service_advertisement, CONFIG_NET_HOSTNAME, "_greybuss", "local",
-			    DNS_SD_EMPTY_TXT, GB_TRANSPORT_TCPIP_BASE_PORT);
+			    GB_TRANS_TXT, GB_TRANSPORT_TCPIP_BASE_PORT);
 #else  /* CONFIG_GREYBUS_ENABLE_TLS */
 DNS_SD_REGISTER_TCP_SERVICE(gb_service_advertisement, CONFIG_NET_HOSTNAME, "_greybus", "local",
-			    DNS_SD_EMPTY_TXT, GB_TRANSPORT_TCPIP_BASE_PORT);
+			    GB_TRANS_TXT, GB_TRANSPORT_TCPIP_BASE_PORT);
 #endif /* CONFIG_GREYBUS_ENABLE_TLS */
 
-K_THREAD_STACK_DEFINE(gb_trans_rx_stack, GB_TRANS_RX_STACK_SIZE);
+K_THREAD_STACK_DEFINE(gb_trans_rx_stack, CONFIG_GREYBUS_TCPIP_RX_STACK_SIZE);
+
+#ifdef CONFIG_GREYBUS_TCPIP_TX_THREAD
+K_THREAD_STACK_DEFINE(gb_trans_tx_stack, CONFIG_GREYBUS_TCPIP_TX_STACK_SIZE);
+K_MSGQ_DEFINE(gb_trans_tx_msgq, sizeof(struct gb_msg_with_cport),
+	      CONFIG_GREYBUS_TCPIP_TX_QUEUE_DEPTH, 4);
+#endif /* CONFIG_GREYBUS_TCPIP_TX_THREAD */
 
 /*
  * struct gb_trans_ctx: Transport Context
  *
  * @rx_thread: rx_thread
+ * @tx_thread: tx_thread
+ * @sock_lock: serializes writes to and closing of client_sock
  * @server_sock: socket on which the server listens for connections
  * @client_sock: socket with connection to a client
+ * @rx_len: number of bytes pending in rx_buf
+ * @rx_buf: data received from client but not yet dispatched. With
+ *          CONFIG_GREYBUS_TCPIP_RX_DIRECT, only the cport and header of the next message.
  */
 struct gb_trans_ctx {
 	struct k_thread rx_thread;
+#ifdef CONFIG_GREYBUS_TCPIP_TX_THREAD
+	struct k_thread tx_thread;
+#endif
+	struct k_mutex sock_lock;
 	int server_sock;
 	int client_sock;
+	size_t rx_len;
+#ifdef CONFIG_GREYBUS_TCPIP_RX_DIRECT
+	uint8_t rx_buf[sizeof(__le16) + sizeof(struct gb_operation_msg_hdr)];
+#else
+	uint8_t rx_buf[CONFIG_GREYBUS_TCPIP_RX_BUF_SIZE];
+#endif
 };
 
 static struct gb_trans_ctx ctx;
@@ -74,95 +134,261 @@ static int read_data(int sock, void *data, size_t len)
 }
 
 /*
- * Helper to write data to socket
+ * Helper to write a list of buffers to socket. The iovec array is consumed.
  */
-static int write_data(int sock, const void *data, size_t len)
+static int write_iov(int sock, struct iovec *iov, size_t iovcnt)
 {
-	int ret, transmitted = 0;
+	ssize_t ret;
+	struct msghdr hdr = {
+		.msg_iov = iov,
+		.msg_iovlen = iovcnt,
+	};
 
-	while (transmitted < len) {
-		ret = zsock_send(sock, transmitted + (char *)data, len - transmitted, 0);
+	while (hdr.msg_iovlen > 0) {
+		ret = zsock_sendmsg(sock, &hdr, 0);
 		if (ret < 0) {
 			LOG_ERR("Failed to transmit data");
-			return ret;
+			return -errno;
+		}
+
+		/* Drop whatever was sent from the front of the list */
+		while (hdr.msg_iovlen > 0 && ret >= hdr.msg_iov->iov_len) {
+			ret -= hdr.msg_iov->iov_len;
+			hdr.msg_iov++;
+			hdr.msg_iovlen--;
+		}
+
+		if (hdr.msg_iovlen > 0) {
+			hdr.msg_iov->iov_base = (uint8_t *)hdr.msg_iov->iov_base + ret;
+			hdr.msg_iov->iov_len -= ret;
 		}
-		transmitted += ret;
 	}
-	return transmitted;
+
+	return 0;
+}
+
+static int gb_trans_listen_start(uint16_t cport)
+{
+	return 0;
+}
+
+static int gb_trans_listen_stop(uint16_t cport)
+{
+	return 0;
 }
 
 /*
- * Helper to receive a greybus message from socket
+ * Helper to write greybus messages to the client, at most GB_TRANS_TX_BATCH of them. On failure
+ * the connection is shut down, which makes the rx thread tear down the session, so that a stuck
+ * host can reconnect.
  */
-static struct gb_msg_with_cport gb_message_receive(int sock, bool *flag)
+static int gb_trans_client_write_batch(struct gb_trans_ctx *ctx,
+				       const struct gb_msg_with_cport *msgs, size_t num)
 {
 	int ret;
-	struct gb_operation_msg_hdr hdr;
-	struct gb_msg_with_cport msg;
-
-	ret = read_data(sock, &msg.cport, sizeof(msg.cport));
-	if (ret != sizeof(msg.cport)) {
-		*flag = ret == 0;
-		goto early_exit;
+	__le16 cports[GB_TRANS_TX_BATCH];
+	struct iovec iov[GB_TRANS_TX_BATCH * 3];
+	size_t iovcnt = 0;
+
+	__ASSERT_NO_MSG(num <= GB_TRANS_TX_BATCH);
+
+	for (size_t i = 0; i < num; i++) {
+		cports[i] = sys_cpu_to_le16(msgs[i].cport);
+		iov[iovcnt].iov_base = &cports[i];
+		iov[iovcnt++].iov_len = sizeof(cports[i]);
+		iov[iovcnt].iov_base = (void *)&msgs[i].msg->header;
+		iov[iovcnt++].iov_len = sizeof(msgs[i].msg->header);
+		if (gb_message_payload_len(msgs[i].msg)) {
+			iov[iovcnt].iov_base = (void *)msgs[i].msg->payload;
+			iov[iovcnt++].iov_len = gb_message_payload_len(msgs[i].msg);
+		}
 	}
-	msg.cport = sys_le16_to_cpu(msg.cport);
 
-	ret = read_data(sock, &hdr, sizeof(hdr));
-	if (ret != sizeof(hdr)) {
-		*flag = ret == 0;
-		goto early_exit;
+	k_mutex_lock(&ctx->sock_lock, K_FOREVER);
+
+	if (ctx->client_sock < 0) {
+		ret = -ENOTCONN;
+		goto unlock;
 	}
 
-	msg.msg =
-		gb_message_alloc(gb_hdr_payload_len(&hdr), hdr.type, hdr.operation_id, hdr.result);
-	if (!msg.msg) {
-		LOG_ERR("Failed to allocate node message");
-		goto early_exit;
+	/* Send everything in a single call so that small operations go out in one segment */
+	ret = write_iov(ctx->client_sock, iov, iovcnt);
+	if (ret < 0) {
+		LOG_ERR("Dropping connection after send failure (%d)", ret);
+		zsock_shutdown(ctx->client_sock, ZSOCK_SHUT_RDWR);
 	}
 
-	ret = read_data(sock, (uint8_t *)msg.msg + sizeof(hdr), gb_message_payload_len(msg.msg));
-	if (ret != gb_message_payload_len(msg.msg)) {
-		*flag = ret == 0;
-		goto free_msg;
+unlock:
+	k_mutex_unlock(&ctx->sock_lock);
+	return ret;
+}
+
+#ifndef CONFIG_GREYBUS_TCPIP_TX_THREAD
+static int gb_trans_client_write(struct gb_trans_ctx *ctx, uint16_t cport,
+				 const struct gb_message *msg)
+{
+	const struct gb_msg_with_cport item = {
+		.cport = cport,
+		.msg = (struct gb_message *)msg,
+	};
+
+	return gb_trans_client_write_batch(ctx, &item, 1);
+}
+#endif /* !CONFIG_GREYBUS_TCPIP_TX_THREAD */
+
+#ifdef CONFIG_GREYBUS_TCPIP_TX_THREAD
+/*
+ * Hander function for tx thread. An item without message stops the thread.
+ */
+static void gb_trans_tx_thread_handler(void *p1, void *p2, void *p3)
+{
+	struct gb_msg_with_cport items[GB_TRANS_TX_BATCH];
+	size_t num;
+	bool stop = false;
+
+	while (!stop) {
+		k_msgq_get(&gb_trans_tx_msgq, &items[0], K_FOREVER);
+		if (!items[0].msg) {
+			return;
+		}
+
+		/* Whatever queued up meanwhile goes out in the same write */
+		for (num = 1; num < ARRAY_SIZE(items); num++) {
+			if (k_msgq_get(&gb_trans_tx_msgq, &items[num], K_NO_WAIT) < 0) {
+				break;
+			}
+
+			if (!items[num].msg) {
+				stop = true;
+				break;
+			}
+		}
+
+		gb_trans_client_write_batch(&ctx, items, num);
+		for (size_t i = 0; i < num; i++) {
+			gb_message_dealloc(items[i].msg);
+		}
 	}
+}
 
-	return msg;
+/*
+ * Helper to stop the tx thread once it is done with what it already took from the queue
+ */
+static void gb_trans_tx_stop(void)
+{
+	const struct gb_msg_with_cport stop = {0};
 
-free_msg:
-	gb_message_dealloc(msg.msg);
-early_exit:
-	msg.cport = 0;
-	msg.msg = NULL;
-	return msg;
+	k_msgq_put(&gb_trans_tx_msgq, &stop, K_FOREVER);
+	k_thread_join(&ctx.tx_thread, K_FOREVER);
 }
 
-static int gb_trans_listen_start(uint16_t cport)
+/*
+ * Helper to drop all messages queued for a session that is gone
+ */
+static void gb_trans_tx_purge(void)
 {
-	return 0;
+	struct gb_msg_with_cport item;
+
+	while (k_msgq_get(&gb_trans_tx_msgq, &item, K_NO_WAIT) == 0) {
+		gb_message_dealloc(item.msg);
+	}
 }
 
-static int gb_trans_listen_stop(uint16_t cport)
+static int gb_trans_tx_queue(uint16_t cport, const struct gb_message *msg, k_timeout_t timeout)
 {
+	int ret;
+	const struct gb_msg_with_cport item = {
+		.cport = cport,
+		.msg = gb_message_get(msg),
+	};
+
+	if (!item.msg) {
+		return -ENOMEM;
+	}
+
+	ret = k_msgq_put(&gb_trans_tx_msgq, &item, timeout);
+	if (ret < 0) {
+		LOG_ERR("TX queue full, dropping message");
+		gb_message_dealloc(item.msg);
+		return -ENOBUFS;
+	}
+
 	return 0;
 }
+#else
+static inline void gb_trans_tx_purge(void)
+{
+}
+#endif /* CONFIG_GREYBUS_TCPIP_TX_THREAD */
 
 static int gb_trans_send(uint16_t cport, const struct gb_message *msg)
 {
-	int ret;
-	__le16 cport_u16 = sys_cpu_to_le16(cport);
-
 	if (msg->header.result) {
 		LOG_INF("CPort %u, Type: %u, Result: %u, Id: %u", cport, msg->header.type,
 			msg->header.result, msg->header.operation_id);
 	}
 
-	ret = write_data(ctx.client_sock, &cport_u16, sizeof(cport_u16));
-	if (ret < 0) {
-		return ret;
+	if (ctx.client_sock < 0) {
+		return -ENOTCONN;
 	}
 
-	ret = write_data(ctx.client_sock, msg, sys_le16_to_cpu(msg->header.size));
-	return MIN(0, ret);
+#ifdef CONFIG_GREYBUS_TCPIP_TX_THREAD
+	return gb_trans_tx_queue(cport, msg, K_MSEC(CONFIG_GREYBUS_TCPIP_TX_QUEUE_TIMEOUT_MS));
+#else
+	return gb_trans_client_write(&ctx, cport, msg);
+#endif
+}
+
+static int gb_trans_send_batch(const struct gb_msg_with_cport *msgs, size_t num)
+{
+	int ret = 0;
+
+	if (ctx.client_sock < 0) {
+		return -ENOTCONN;
+	}
+
+#ifdef CONFIG_GREYBUS_TCPIP_TX_THREAD
+	/* The tx thread picks them up GB_TRANS_TX_BATCH at a time, making room for the rest */
+	for (size_t i = 0; i < num && ret == 0; i++) {
+		ret = gb_trans_tx_queue(msgs[i].cport, msgs[i].msg,
+					K_MSEC(CONFIG_GREYBUS_TCPIP_TX_QUEUE_TIMEOUT_MS));
+	}
+#else
+	size_t chunk;
+
+	for (size_t i = 0; i < num && ret == 0; i += chunk) {
+		chunk = MIN(num - i, GB_TRANS_TX_BATCH);
+		ret = gb_trans_client_write_batch(&ctx, msgs + i, chunk);
+	}
+#endif
+
+	return ret;
+}
+
+/*
+ * Helper to apply per connection socket options
+ */
+static void gb_trans_client_setup(int sock)
+{
+	if (IS_ENABLED(CONFIG_GREYBUS_TCPIP_NODELAY)) {
+		const int yes = true;
+
+		if (zsock_setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)) < 0) {
+			LOG_WRN("setsockopt: Failed to set TCP_NODELAY (%d)", errno);
+		}
+	}
+
+	if (CONFIG_GREYBUS_TCPIP_SEND_TIMEOUT_MS > 0) {
+		const struct timeval tv = {
+			.tv_sec = CONFIG_GREYBUS_TCPIP_SEND_TIMEOUT_MS / MSEC_PER_SEC,
+			.tv_usec = (CONFIG_GREYBUS_TCPIP_SEND_TIMEOUT_MS % MSEC_PER_SEC) *
+				   USEC_PER_MSEC,
+		};
+
+		if (zsock_setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
+			LOG_WRN("setsockopt: Failed to set SO_SNDTIMEO (%d)", errno);
+		}
+	}
 }
 
 static int netsetup()
@@ -173,7 +399,7 @@ static int netsetup()
 	socklen_t sa_len;
 
 	if (IS_ENABLED(CONFIG_GREYBUS_TLS_BUILTIN)) {
-		proto = IPPROTO_TLS_1_2;
+		proto = GB_TRANS_TLS_PROTO;
 	}
 
 	memset(&sa, 0, sizeof(sa));
@@ -213,6 +439,9 @@ static int netsetup()
 			GB_TLS_CA_CERT_TAG,
 #endif
 			GB_TLS_SERVER_CERT_TAG,
+#ifdef CONFIG_GREYBUS_TLS_PSK
+			GB_TLS_PSK_TAG,
+#endif
 		};
 
 		ret = zsock_setsockopt(sock, SOL_TLS, TLS_SEC_TAG_LIST, sec_tag_opt,
@@ -245,6 +474,32 @@ static int netsetup()
 			LOG_ERR("setsockopt: Failed to set TLS_PEER_VERIFY (%d)", errno);
 			return -errno;
 		}
+
+		if (IS_ENABLED(CONFIG_GREYBUS_TLS_SESSION_CACHE)) {
+			/* Lets a reconnecting host skip the full handshake */
+			const int cache = TLS_SESSION_CACHE_ENABLED;
+
+			ret = zsock_setsockopt(sock, SOL_TLS, TLS_SESSION_CACHE, &cache,
+					       sizeof(cache));
+			if (ret < 0) {
+				LOG_WRN("setsockopt: Failed to set TLS_SESSION_CACHE (%d)", errno);
+			}
+		}
+
+#ifdef CONFIG_GREYBUS_TLS_PSK_ONLY
+		static const int psk_ciphersuites[] = {
+			0x00A8, /* TLS_PSK_WITH_AES_128_GCM_SHA256 */
+			0xC0A4, /* TLS_PSK_WITH_AES_128_CCM */
+			0x00AE, /* TLS_PSK_WITH_AES_128_CBC_SHA256 */
+		};
+
+		ret = zsock_setsockopt(sock, SOL_TLS, TLS_CIPHERSUITE_LIST, psk_ciphersuites,
+				       sizeof(psk_ciphersuites));
+		if (ret < 0) {
+			LOG_ERR("setsockopt: Failed to set TLS_CIPHERSUITE_LIST (%d)", errno);
+			return -errno;
+		}
+#endif /* CONFIG_GREYBUS_TLS_PSK_ONLY */
 	}
 
 	ret = zsock_bind(sock, &sa, sa_len);
@@ -254,7 +509,7 @@ static int netsetup()
 	}
 
 	/* We will only ever be connected to a single ap */
-	ret = zsock_listen(sock, 1);
+	ret = zsock_listen(sock, GB_TRANS_LISTEN_BACKLOG);
 	if (ret < 0) {
 		LOG_ERR("listen: %d", errno);
 		return -errno;
@@ -266,95 +521,288 @@ static int netsetup()
 }
 
 /*
- * Helper to accept new connection
+ * Helper to end the current session
+ */
+static void gb_trans_client_close(struct gb_trans_ctx *ctx)
+{
+	k_mutex_lock(&ctx->sock_lock, K_FOREVER);
+	if (ctx->client_sock >= 0) {
+		zsock_close(ctx->client_sock);
+		ctx->client_sock = -1;
+	}
+	k_mutex_unlock(&ctx->sock_lock);
+
+	gb_trans_tx_purge();
+	ctx->rx_len = 0;
+}
+
+/*
+ * Helper to accept new connection. Since there is only ever a single AP, a new connection
+ * replaces the current one. This lets a host that lost its link reconnect right away instead of
+ * waiting for the stale connection to time out.
  */
 static void gb_trans_accept(struct gb_trans_ctx *ctx)
 {
 	int ret;
-	struct zsock_pollfd fd = {
-		.fd = ctx->server_sock,
-		.events = ZSOCK_POLLIN,
-	};
 	struct sockaddr_in6 addr = {
 		.sin6_family = AF_INET6,
 		.sin6_addr = in6addr_any,
 	};
 	socklen_t addrlen = sizeof(addr);
 
-	ret = zsock_poll(&fd, 1, -1);
+	ret = zsock_accept(ctx->server_sock, (struct sockaddr *)&addr, &addrlen);
 	if (ret < 0) {
-		LOG_ERR("Socket poll failed");
+		LOG_ERR("Failed to accept connection");
 		return;
 	}
 
-	if (fd.revents & ZSOCK_POLLIN) {
-		ret = zsock_accept(fd.fd, (struct sockaddr *)&addr, &addrlen);
-		if (ret < 0) {
-			LOG_ERR("Failed to accept connection");
-			return;
-		}
-		ctx->client_sock = ret;
+	if (ctx->client_sock >= 0) {
+		LOG_INF("Replacing existing connection");
+		gb_trans_client_close(ctx);
 	}
 
+	gb_trans_client_setup(ret);
+
+	k_mutex_lock(&ctx->sock_lock, K_FOREVER);
+	ctx->client_sock = ret;
+	k_mutex_unlock(&ctx->sock_lock);
+
 	LOG_INF("Accepted new connection");
 }
 
+#ifdef CONFIG_GREYBUS_TCPIP_RX_DIRECT
 /*
- * Helper to receive messages if socket connection is established
+ * Helper to receive messages if socket connection is established. Only the cport and header go
+ * through rx_buf, the payload is received into the allocated message. Messages are dispatched
+ * until no more data is available, a partial header is kept for the next call.
  */
 static void gb_trans_rx(struct gb_trans_ctx *ctx)
 {
 	int ret;
-	bool flag = false;
-	struct gb_msg_with_cport msg;
-	struct zsock_pollfd fd = {
-		.fd = ctx->client_sock,
-		.events = ZSOCK_POLLIN,
-	};
+	size_t msg_size, payload_len;
+	__le16 cport;
+	struct gb_operation_msg_hdr hdr;
+	struct gb_message *msg;
 
-	ret = zsock_poll(&fd, 1, -1);
-	if (ret < 0) {
-		LOG_ERR("Socket poll failed");
-		return;
+	while (true) {
+		ret = zsock_recv(ctx->client_sock, ctx->rx_buf + ctx->rx_len,
+				 sizeof(ctx->rx_buf) - ctx->rx_len, ZSOCK_MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return;
+			}
+			LOG_ERR("Failed to receive data");
+			goto close_sock;
+		} else if (ret == 0) {
+			/* Socket was closed by peer */
+			goto close_sock;
+		}
+
+		ctx->rx_len += ret;
+		if (ctx->rx_len < sizeof(ctx->rx_buf)) {
+			continue;
+		}
+		ctx->rx_len = 0;
+
+		memcpy(&cport, ctx->rx_buf, sizeof(cport));
+		memcpy(&hdr, ctx->rx_buf + sizeof(cport), sizeof(hdr));
+
+		msg_size = sys_le16_to_cpu(hdr.size);
+		if (msg_size < sizeof(hdr)) {
+			LOG_ERR("Invalid message size %zu", msg_size);
+			goto close_sock;
+		}
+
+		msg = gb_message_alloc(gb_hdr_payload_len(&hdr), hdr.type, hdr.operation_id,
+				       hdr.result);
+		if (!msg) {
+			LOG_ERR("Failed to allocate node message");
+			goto close_sock;
+		}
+
+		memcpy(&msg->header, &hdr, sizeof(hdr));
+		payload_len = gb_message_payload_len(msg);
+		if (payload_len) {
+			ret = read_data(ctx->client_sock, msg->payload, payload_len);
+			if (ret != payload_len) {
+				gb_message_dealloc(msg);
+				goto close_sock;
+			}
+		}
+
+		ret = greybus_rx_handler(sys_le16_to_cpu(cport), msg);
+		if (ret < 0) {
+			LOG_ERR("Failed to receive greybus message");
+			gb_message_dealloc(msg);
+		}
 	}
 
-	if (fd.revents & ZSOCK_POLLIN) {
-		msg = gb_message_receive(fd.fd, &flag);
-		if (flag) {
-			zsock_close(fd.fd);
-			ctx->client_sock = -1;
-			return;
+close_sock:
+	gb_trans_client_close(ctx);
+}
+#else
+/*
+ * Helper to dispatch all complete messages present in the receive buffer. A message that is
+ * larger than the buffer is completed with a direct read from the socket.
+ */
+static int gb_trans_rx_parse(struct gb_trans_ctx *ctx)
+{
+	int ret;
+	size_t off = 0, avail, msg_size;
+	__le16 cport;
+	struct gb_operation_msg_hdr hdr;
+	struct gb_message *msg;
+
+	while (ctx->rx_len - off >= sizeof(cport) + sizeof(hdr)) {
+		memcpy(&cport, ctx->rx_buf + off, sizeof(cport));
+		memcpy(&hdr, ctx->rx_buf + off + sizeof(cport), sizeof(hdr));
+
+		msg_size = sys_le16_to_cpu(hdr.size);
+		if (msg_size < sizeof(hdr)) {
+			LOG_ERR("Invalid message size %zu", msg_size);
+			return -EPROTO;
 		}
 
-		if (!msg.msg) {
-			LOG_ERR("Failed to receive message");
-			return;
+		avail = ctx->rx_len - off - sizeof(cport);
+		if (avail < msg_size && sizeof(cport) + msg_size <= sizeof(ctx->rx_buf)) {
+			/* Wait for the rest of the message */
+			break;
+		}
+
+		msg = gb_message_alloc(gb_hdr_payload_len(&hdr), hdr.type, hdr.operation_id,
+				       hdr.result);
+		if (!msg) {
+			LOG_ERR("Failed to allocate node message");
+			return -ENOMEM;
 		}
 
-		ret = greybus_rx_handler(msg.cport, msg.msg);
+		avail = MIN(avail, msg_size);
+		memcpy(msg, ctx->rx_buf + off + sizeof(cport), avail);
+		off += sizeof(cport) + avail;
+
+		if (avail < msg_size) {
+			ret = read_data(ctx->client_sock, (uint8_t *)msg + avail, msg_size - avail);
+			if (ret != msg_size - avail) {
+				gb_message_dealloc(msg);
+				return (ret < 0) ? ret : -ECONNRESET;
+			}
+		}
+
+		ret = greybus_rx_handler(sys_le16_to_cpu(cport), msg);
 		if (ret < 0) {
 			LOG_ERR("Failed to receive greybus message");
-			gb_message_dealloc(msg.msg);
+			gb_message_dealloc(msg);
 		}
 	}
+
+	ctx->rx_len -= off;
+	memmove(ctx->rx_buf, ctx->rx_buf + off, ctx->rx_len);
+
+	return 0;
+}
+
+/*
+ * Helper to receive messages if socket connection is established. Everything available is read
+ * in one go and all complete messages are dispatched before the next receive.
+ */
+static void gb_trans_rx(struct gb_trans_ctx *ctx)
+{
+	int ret;
+
+	ret = zsock_recv(ctx->client_sock, ctx->rx_buf + ctx->rx_len,
+			 sizeof(ctx->rx_buf) - ctx->rx_len, 0);
+	if (ret < 0) {
+		LOG_ERR("Failed to receive data");
+		goto close_sock;
+	} else if (ret == 0) {
+		/* Socket was closed by peer */
+		goto close_sock;
+	}
+
+	ctx->rx_len += ret;
+
+	ret = gb_trans_rx_parse(ctx);
+	if (ret < 0) {
+		goto close_sock;
+	}
+
+	return;
+
+close_sock:
+	gb_trans_client_close(ctx);
 }
+#endif /* CONFIG_GREYBUS_TCPIP_RX_DIRECT */
 
 /*
  * Hander function for rx thread
  */
 static void gb_trans_rx_thread_handler(void *p1, void *p2, void *p3)
 {
+	int ret;
+	struct zsock_pollfd fds[] = {
+		{
+			.fd = ctx.server_sock,
+			.events = ZSOCK_POLLIN,
+		},
+		{
+			.events = ZSOCK_POLLIN,
+		},
+	};
+
 	while (true) {
-		if (ctx.client_sock == -1) {
-			gb_trans_accept(&ctx);
-		} else {
+		/* Negative fd is ignored by poll */
+		fds[1].fd = ctx.client_sock;
+
+		ret = zsock_poll(fds, ARRAY_SIZE(fds), -1);
+		if (ret < 0) {
+			LOG_ERR("Socket poll failed");
+			continue;
+		}
+
+		if (fds[1].revents & (ZSOCK_POLLIN | ZSOCK_POLLHUP | ZSOCK_POLLERR)) {
 			gb_trans_rx(&ctx);
 		}
+
+		if (fds[0].revents & ZSOCK_POLLIN) {
+			gb_trans_accept(&ctx);
+		}
 	}
 }
 
+#ifdef CONFIG_GREYBUS_TCPIP_DNS_SD_TXT
+/*
+ * Helper to fill the TXT record, so hosts can recognize a node without connecting to it
+ */
+static void gb_trans_txt_fill(void)
+{
+	uint8_t protos[GB_TRANS_TXT_PROTOS / BITS_PER_BYTE] = {0};
+	const struct gb_cport *cport;
+	char *p = gb_trans_txt;
+
+	*p++ = GB_TRANS_TXT_HASH_LEN;
+	p += snprintk(p, GB_TRANS_TXT_HASH_LEN + 1, GB_TRANS_TXT_HASH "%08x", manifest_hash());
+
+	for (size_t i = 0; i < GREYBUS_CPORT_COUNT; i++) {
+		cport = gb_cport_get(i);
+		protos[cport->protocol / BITS_PER_BYTE] |= BIT(cport->protocol % BITS_PER_BYTE);
+	}
+
+	*p++ = GB_TRANS_TXT_PROTO_LEN;
+	memcpy(p, GB_TRANS_TXT_PROTO, sizeof(GB_TRANS_TXT_PROTO) - 1);
+	p += sizeof(GB_TRANS_TXT_PROTO) - 1;
+	p += bin2hex(protos, sizeof(protos), p, 2 * sizeof(protos) + 1);
+
+	*p++ = GB_TRANS_TXT_FW_LEN;
+	memcpy(p, GB_TRANS_TXT_FW, GB_TRANS_TXT_FW_LEN);
+}
+#endif /* CONFIG_GREYBUS_TCPIP_DNS_SD_TXT */
+
 static int gb_trans_init(void)
 {
+#ifdef CONFIG_GREYBUS_TCPIP_DNS_SD_TXT
+	gb_trans_txt_fill();
+#endif /* CONFIG_GREYBUS_TCPIP_DNS_SD_TXT */
+
 	ctx.server_sock = netsetup();
 
 	if (ctx.server_sock < 0) {
@@ -362,10 +810,19 @@ static int gb_trans_init(void)
 		return -ESOCKTNOSUPPORT;
 	}
 	ctx.client_sock = -1;
+	k_mutex_init(&ctx.sock_lock);
+
+#ifdef CONFIG_GREYBUS_TCPIP_TX_THREAD
+	k_thread_create(&ctx.tx_thread, gb_trans_tx_stack, K_THREAD_STACK_SIZEOF(gb_trans_tx_stack),
+			gb_trans_tx_thread_handler, NULL, NULL, NULL,
+			CONFIG_GREYBUS_TCPIP_TX_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&ctx.tx_thread, "gb_trans_tx");
+#endif
 
 	k_thread_create(&ctx.rx_thread, gb_trans_rx_stack, K_THREAD_STACK_SIZEOF(gb_trans_rx_stack),
-			gb_trans_rx_thread_handler, NULL, NULL, NULL, GB_TRANS_RX_STACK_PRIORITY, 0,
-			K_NO_WAIT);
+			gb_trans_rx_thread_handler, NULL, NULL, NULL,
+			CONFIG_GREYBUS_TCPIP_RX_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&ctx.rx_thread, "gb_trans_rx");
 
 	return 0;
 }
@@ -373,8 +830,18 @@ static int gb_trans_init(void)
 static void gb_trans_exit(void)
 {
 	k_thread_abort(&ctx.rx_thread);
+#ifdef CONFIG_GREYBUS_TCPIP_TX_THREAD
+	/*
+	 * The tx thread may hold sock_lock while blocked in a write, so it is not aborted. Shutting
+	 * the connection down fails its writes, then it is stopped through the queue.
+	 */
+	if (ctx.client_sock >= 0) {
+		zsock_shutdown(ctx.client_sock, ZSOCK_SHUT_RDWR);
+	}
+	gb_trans_tx_stop();
+#endif
 	zsock_close(ctx.server_sock);
-	zsock_close(ctx.client_sock);
+	gb_trans_client_close(&ctx);
 }
 
 const struct gb_transport_backend gb_trans_backend = {
@@ -383,4 +850,5 @@ const struct gb_transport_backend gb_trans_backend = {
 	.listen = gb_trans_listen_start,
 	.stop_listening = gb_trans_listen_stop,
 	.send = gb_trans_send,
+	.send_batch = gb_trans_send_batch,
 };
@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Transport over the UART chosen as zephyr,greybus-uart, for nodes wired directly to the host.
+ *
+ * Messages are sent in HDLC like frames:
+ *
+ *   0x7E | cport (le16) | greybus message | FCS (le16) | 0x7E
+ *
+ * 0x7E and 0x7D inside the frame are sent as 0x7D followed by the byte XOR 0x20. The FCS is the
+ * CRC-16/X.25 of the cport and the message. Frames with a bad FCS are dropped, the host retries.
+ */
+
+#include <greybus/greybus.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <greybus/greybus_messages.h>
+#include "../greybus_internal.h"
+
+LOG_MODULE_REGISTER(greybus_transport_uart, CONFIG_GREYBUS_LOG_LEVEL);
+
+#define GB_UART_FLAG   0x7E
+#define GB_UART_ESCAPE 0x7D
+#define GB_UART_XOR    0x20
+
+#define GB_UART_CRC_INIT 0xFFFF
+
+/* cport and greybus header, needed to allocate the message */
+#define GB_UART_HDR_SIZE (sizeof(__le16) + sizeof(struct gb_operation_msg_hdr))
+#define GB_UART_FCS_SIZE sizeof(__le16)
+
+K_THREAD_STACK_DEFINE(gb_trans_rx_stack, CONFIG_GREYBUS_XPORT_UART_RX_STACK_SIZE);
+RING_BUF_DECLARE(gb_trans_rx_ring, CONFIG_GREYBUS_XPORT_UART_RX_RING_SIZE);
+
+enum gb_uart_rx_state {
+	/* Discard everything until the next flag */
+	GB_UART_RX_HUNT,
+	GB_UART_RX_DATA,
+	GB_UART_RX_ESCAPE,
+};
+
+/*
+ * struct gb_uart_rx: Frame being received
+ *
+ * @state: decoder state
+ * @pos: number of unescaped bytes received in the frame
+ * @crc: CRC of the cport and message bytes received so far
+ * @hdr: cport and greybus header
+ * @fcs: FCS received at the end of the frame
+ * @msg: message being filled, allocated once the header is complete
+ */
+struct gb_uart_rx {
+	enum gb_uart_rx_state state;
+	size_t pos;
+	uint16_t crc;
+	uint8_t hdr[GB_UART_HDR_SIZE];
+	uint8_t fcs[GB_UART_FCS_SIZE];
+	struct gb_message *msg;
+};
+
+/*
+ * struct gb_trans_ctx: Transport Context
+ *
+ * @dev: UART device
+ * @rx_thread: rx_thread
+ * @rx_sem: given when bytes were added to the ring buffer
+ * @rx_buf: buffers handed to the UART driver in turn
+ * @rx_buf_next: next buffer of rx_buf to hand to the driver
+ * @rx_overruns: number of times the ring buffer was full
+ * @rx_stopping: receive is being disabled for good
+ * @rx: frame decoder, only used by the rx thread
+ * @tx_lock: serializes senders
+ * @tx_done: given when the UART is done with the last transmission
+ * @tx_buf: frame is encoded into one buffer while the other one is being sent
+ * @tx_buf_idx: buffer being encoded into
+ * @tx_len: number of bytes in the buffer being encoded into
+ */
+struct gb_trans_ctx {
+	const struct device *dev;
+	struct k_thread rx_thread;
+	struct k_sem rx_sem;
+	uint8_t rx_buf[2][CONFIG_GREYBUS_XPORT_UART_RX_BUF_SIZE];
+	uint8_t rx_buf_next;
+	atomic_t rx_overruns;
+	bool rx_stopping;
+	struct gb_uart_rx rx;
+	struct k_mutex tx_lock;
+	struct k_sem tx_done;
+	uint8_t tx_buf[2][CONFIG_GREYBUS_XPORT_UART_TX_BUF_SIZE];
+	uint8_t tx_buf_idx;
+	size_t tx_len;
+};
+
+static struct gb_trans_ctx ctx = {
+	.dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_greybus_uart)),
+};
+
+static int gb_trans_listen_start(uint16_t cport)
+{
+	return 0;
+}
+
+static int gb_trans_listen_stop(uint16_t cport)
+{
+	return 0;
+}
+
+static void gb_trans_uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	int ret;
+	struct gb_trans_ctx *ctx = user_data;
+
+	switch (evt->type) {
+	case UART_TX_DONE:
+	case UART_TX_ABORTED:
+		k_sem_give(&ctx->tx_done);
+		break;
+	case UART_RX_RDY:
+		ret = ring_buf_put(&gb_trans_rx_ring, evt->data.rx.buf + evt->data.rx.offset,
+				   evt->data.rx.len);
+		if (ret < evt->data.rx.len) {
+			atomic_inc(&ctx->rx_overruns);
+		}
+		k_sem_give(&ctx->rx_sem);
+		break;
+	case UART_RX_BUF_REQUEST:
+		uart_rx_buf_rsp(dev, ctx->rx_buf[ctx->rx_buf_next], sizeof(ctx->rx_buf[0]));
+		ctx->rx_buf_next ^= 1;
+		break;
+	case UART_RX_STOPPED:
+		LOG_WRN("UART receive stopped (%d)", evt->data.rx_stop.reason);
+		break;
+	case UART_RX_DISABLED:
+		if (ctx->rx_stopping) {
+			break;
+		}
+
+		/* Restarted after errors, a partial frame fails its FCS */
+		ret = uart_rx_enable(dev, ctx->rx_buf[0], sizeof(ctx->rx_buf[0]),
+				     CONFIG_GREYBUS_XPORT_UART_RX_TIMEOUT_US);
+		if (ret < 0) {
+			LOG_ERR("Failed to restart UART receive (%d)", ret);
+		}
+		ctx->rx_buf_next = 1;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Helper to start sending the buffer being encoded into. Must be called with tx_lock held.
+ */
+static int gb_trans_tx_flush(struct gb_trans_ctx *ctx)
+{
+	int ret;
+
+	if (!ctx->tx_len) {
+		return 0;
+	}
+
+	/* Wait for the other buffer to go out */
+	k_sem_take(&ctx->tx_done, K_FOREVER);
+
+	ret = uart_tx(ctx->dev, ctx->tx_buf[ctx->tx_buf_idx], ctx->tx_len, SYS_FOREVER_US);
+	if (ret < 0) {
+		LOG_ERR("Failed to transmit data (%d)", ret);
+		k_sem_give(&ctx->tx_done);
+	}
+
+	ctx->tx_buf_idx ^= 1;
+	ctx->tx_len = 0;
+
+	return ret;
+}
+
+/*
+ * Helper to add an unescaped byte to the frame. Must be called with tx_lock held.
+ */
+static int gb_trans_tx_put_raw(struct gb_trans_ctx *ctx, uint8_t byte)
+{
+	int ret;
+
+	if (ctx->tx_len == sizeof(ctx->tx_buf[0])) {
+		ret = gb_trans_tx_flush(ctx);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	ctx->tx_buf[ctx->tx_buf_idx][ctx->tx_len++] = byte;
+
+	return 0;
+}
+
+/*
+ * Helper to add frame contents, escaping as needed. Must be called with tx_lock held.
+ */
+static int gb_trans_tx_put(struct gb_trans_ctx *ctx, const uint8_t *data, size_t len)
+{
+	int ret = 0;
+
+	for (size_t i = 0; i < len && ret == 0; i++) {
+		if (data[i] == GB_UART_FLAG || data[i] == GB_UART_ESCAPE) {
+			ret = gb_trans_tx_put_raw(ctx, GB_UART_ESCAPE);
+			if (ret == 0) {
+				ret = gb_trans_tx_put_raw(ctx, data[i] ^ GB_UART_XOR);
+			}
+		} else {
+			ret = gb_trans_tx_put_raw(ctx, data[i]);
+		}
+	}
+
+	return ret;
+}
+
+static int gb_trans_send(uint16_t cport, const struct gb_message *msg)
+{
+	int ret;
+	uint16_t crc;
+	const __le16 cport_u16 = sys_cpu_to_le16(cport);
+	const size_t size = sys_le16_to_cpu(msg->header.size);
+	__le16 fcs;
+
+	if (msg->header.result) {
+		LOG_INF("CPort %u, Type: %u, Result: %u, Id: %u", cport, msg->header.type,
+			msg->header.result, msg->header.operation_id);
+	}
+
+	crc = crc16_ccitt(GB_UART_CRC_INIT, (const uint8_t *)&cport_u16, sizeof(cport_u16));
+	crc = crc16_ccitt(crc, (const uint8_t *)&msg->header, size);
+	fcs = sys_cpu_to_le16(~crc);
+
+	k_mutex_lock(&ctx.tx_lock, K_FOREVER);
+
+	ret = gb_trans_tx_put_raw(&ctx, GB_UART_FLAG);
+	if (ret == 0) {
+		ret = gb_trans_tx_put(&ctx, (const uint8_t *)&cport_u16, sizeof(cport_u16));
+	}
+	if (ret == 0) {
+		ret = gb_trans_tx_put(&ctx, (const uint8_t *)&msg->header, size);
+	}
+	if (ret == 0) {
+		ret = gb_trans_tx_put(&ctx, (const uint8_t *)&fcs, sizeof(fcs));
+	}
+	if (ret == 0) {
+		ret = gb_trans_tx_put_raw(&ctx, GB_UART_FLAG);
+	}
+	if (ret == 0) {
+		ret = gb_trans_tx_flush(&ctx);
+	}
+
+	/* Do not leave half a frame for the next sender, the host drops it on the next flag */
+	ctx.tx_len = 0;
+
+	k_mutex_unlock(&ctx.tx_lock);
+
+	return ret;
+}
+
+/*
+ * Helper to drop the frame being received and wait for the next flag
+ */
+static void gb_trans_rx_reset(struct gb_uart_rx *rx, enum gb_uart_rx_state state)
+{
+	gb_message_dealloc(rx->msg);
+	rx->msg = NULL;
+	rx->pos = 0;
+	rx->crc = GB_UART_CRC_INIT;
+	rx->state = state;
+}
+
+/*
+ * Helper to add an unescaped byte to the frame being received
+ */
+static void gb_trans_rx_byte(struct gb_uart_rx *rx, uint8_t byte)
+{
+	struct gb_operation_msg_hdr hdr;
+	size_t size = rx->msg ? sys_le16_to_cpu(rx->msg->header.size) : 0;
+	uint16_t cport;
+
+	if (rx->pos < GB_UART_HDR_SIZE) {
+		rx->hdr[rx->pos++] = byte;
+		rx->crc = crc16_ccitt(rx->crc, &byte, 1);
+		if (rx->pos < GB_UART_HDR_SIZE) {
+			return;
+		}
+
+		memcpy(&hdr, rx->hdr + sizeof(__le16), sizeof(hdr));
+		if (sys_le16_to_cpu(hdr.size) < sizeof(hdr)) {
+			LOG_ERR("Invalid message size %u", sys_le16_to_cpu(hdr.size));
+			gb_trans_rx_reset(rx, GB_UART_RX_HUNT);
+			return;
+		}
+
+		rx->msg = gb_message_alloc(gb_hdr_payload_len(&hdr), hdr.type, hdr.operation_id,
+					   hdr.result);
+		if (!rx->msg) {
+			LOG_ERR("Failed to allocate node message");
+			gb_trans_rx_reset(rx, GB_UART_RX_HUNT);
+			return;
+		}
+		memcpy(&rx->msg->header, &hdr, sizeof(hdr));
+		return;
+	}
+
+	if (rx->pos < sizeof(__le16) + size) {
+		((uint8_t *)&rx->msg->header)[rx->pos - sizeof(__le16)] = byte;
+		rx->crc = crc16_ccitt(rx->crc, &byte, 1);
+		rx->pos++;
+		return;
+	}
+
+	rx->fcs[rx->pos - sizeof(__le16) - size] = byte;
+	rx->pos++;
+	if (rx->pos < sizeof(__le16) + size + GB_UART_FCS_SIZE) {
+		return;
+	}
+
+	if (sys_get_le16(rx->fcs) != (uint16_t)~rx->crc) {
+		LOG_WRN("Dropping frame with bad FCS");
+		gb_trans_rx_reset(rx, GB_UART_RX_HUNT);
+		return;
+	}
+
+	/* Complete, do not wait for the closing flag */
+	cport = sys_get_le16(rx->hdr);
+	if (greybus_rx_handler(cport, rx->msg) < 0) {
+		LOG_ERR("Failed to receive greybus message");
+		gb_message_dealloc(rx->msg);
+	}
+	rx->msg = NULL;
+	gb_trans_rx_reset(rx, GB_UART_RX_HUNT);
+}
+
+static void gb_trans_rx_decode(struct gb_uart_rx *rx, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (data[i] == GB_UART_FLAG) {
+			if (rx->pos && rx->state != GB_UART_RX_HUNT) {
+				LOG_WRN("Dropping truncated frame");
+			}
+			gb_trans_rx_reset(rx, GB_UART_RX_DATA);
+			continue;
+		}
+
+		switch (rx->state) {
+		case GB_UART_RX_HUNT:
+			break;
+		case GB_UART_RX_ESCAPE:
+			rx->state = GB_UART_RX_DATA;
+			gb_trans_rx_byte(rx, data[i] ^ GB_UART_XOR);
+			break;
+		case GB_UART_RX_DATA:
+			if (data[i] == GB_UART_ESCAPE) {
+				rx->state = GB_UART_RX_ESCAPE;
+			} else {
+				gb_trans_rx_byte(rx, data[i]);
+			}
+			break;
+		}
+	}
+}
+
+/*
+ * Hander function for rx thread
+ */
+static void gb_trans_rx_thread_handler(void *p1, void *p2, void *p3)
+{
+	uint8_t *data;
+	uint32_t len;
+	atomic_val_t overruns;
+
+	while (true) {
+		k_sem_take(&ctx.rx_sem, K_FOREVER);
+
+		overruns = atomic_set(&ctx.rx_overruns, 0);
+		if (overruns) {
+			LOG_WRN("Receive ring full %ld times, frames lost", (long)overruns);
+		}
+
+		while ((len = ring_buf_get_claim(&gb_trans_rx_ring, &data,
+						 CONFIG_GREYBUS_XPORT_UART_RX_RING_SIZE)) > 0) {
+			gb_trans_rx_decode(&ctx.rx, data, len);
+			ring_buf_get_finish(&gb_trans_rx_ring, len);
+		}
+	}
+}
+
+static int gb_trans_init(void)
+{
+	int ret;
+
+	if (!device_is_ready(ctx.dev)) {
+		LOG_ERR("UART %s is not ready", ctx.dev->name);
+		return -ENODEV;
+	}
+
+	ctx.rx_stopping = false;
+	k_sem_init(&ctx.rx_sem, 0, 1);
+	k_sem_init(&ctx.tx_done, 1, 1);
+	k_mutex_init(&ctx.tx_lock);
+	gb_trans_rx_reset(&ctx.rx, GB_UART_RX_HUNT);
+
+	ret = uart_callback_set(ctx.dev, gb_trans_uart_cb, &ctx);
+	if (ret < 0) {
+		LOG_ERR("Failed to set UART callback (%d)", ret);
+		return ret;
+	}
+
+	k_thread_create(&ctx.rx_thread, gb_trans_rx_stack, K_THREAD_STACK_SIZEOF(gb_trans_rx_stack),
+			gb_trans_rx_thread_handler, NULL, NULL, NULL,
+			CONFIG_GREYBUS_XPORT_UART_RX_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&ctx.rx_thread, "gb_trans_rx");
+
+	ctx.rx_buf_next = 1;
+	ret = uart_rx_enable(ctx.dev, ctx.rx_buf[0], sizeof(ctx.rx_buf[0]),
+			     CONFIG_GREYBUS_XPORT_UART_RX_TIMEOUT_US);
+	if (ret < 0) {
+		LOG_ERR("Failed to enable UART receive (%d)", ret);
+		k_thread_abort(&ctx.rx_thread);
+		return ret;
+	}
+
+	LOG_INF("Greybus transport on %s", ctx.dev->name);
+
+	return 0;
+}
+
+static void gb_trans_exit(void)
+{
+	ctx.rx_stopping = true;
+	uart_rx_disable(ctx.dev);
+	uart_tx_abort(ctx.dev);
+	k_thread_abort(&ctx.rx_thread);
+	gb_trans_rx_reset(&ctx.rx, GB_UART_RX_HUNT);
+}
+
+const struct gb_transport_backend gb_trans_backend = {
+	.init = gb_trans_init,
+	.exit = gb_trans_exit,
+	.listen = gb_trans_listen_start,
+	.stop_listening = gb_trans_listen_stop,
+	.send = gb_trans_send,
+};
@@ -0,0 +1,662 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Datagram transport for lossy links. Every datagram starts with struct gb_udp_hdr. Messages
+ * larger than the datagram size are split into up to GB_UDP_FRAGS_MAX fragments, which may arrive
+ * in any order.
+ *
+ * Nothing is retransmitted by the transport itself. Requests sent by the node are retransmitted
+ * by the operation tracker (CONFIG_GREYBUS_OPERATION_RETRANSMIT_MS), requests sent by the AP are
+ * retransmitted by the AP. A retransmitted request that was already handled is answered from a
+ * cache of recent responses instead of being handled again.
+ */
+
+#include <greybus/greybus.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/dns_sd.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/byteorder.h>
+#include "../platform/certificate.h"
+#include <greybus/greybus_messages.h>
+#include "../greybus_internal.h"
+
+LOG_MODULE_REGISTER(greybus_transport_udp, CONFIG_GREYBUS_LOG_LEVEL);
+
+#define GB_TRANSPORT_UDP_BASE_PORT 4242
+
+/* Limited by the reassembly bitmap */
+#define GB_UDP_FRAGS_MAX 32
+
+#define GB_UDP_FRAG_SIZE (CONFIG_GREYBUS_UDP_MTU - sizeof(struct gb_udp_hdr))
+
+#ifdef CONFIG_GREYBUS_ENABLE_TLS
+DNS_SD_REGISTER_UDP_SERVICE(gb_service_advertisement, CONFIG_NET_HOSTNAME, "_greybuss", "local",
+			    DNS_SD_EMPTY_TXT, GB_TRANSPORT_UDP_BASE_PORT);
+#else  /* CONFIG_GREYBUS_ENABLE_TLS */
+DNS_SD_REGISTER_UDP_SERVICE(gb_service_advertisement, CONFIG_NET_HOSTNAME, "_greybus", "local",
+			    DNS_SD_EMPTY_TXT, GB_TRANSPORT_UDP_BASE_PORT);
+#endif /* CONFIG_GREYBUS_ENABLE_TLS */
+
+K_THREAD_STACK_DEFINE(gb_trans_rx_stack, CONFIG_GREYBUS_UDP_RX_STACK_SIZE);
+
+/*
+ * struct gb_udp_hdr: Datagram header
+ *
+ * @cport: cport of the message
+ * @seq: message number, per sender
+ * @size: size of the whole greybus message
+ * @offset: offset of this fragment in the greybus message
+ * @frag: index of this fragment
+ * @frags: number of fragments of the message
+ */
+struct gb_udp_hdr {
+	__le16 cport;
+	__le16 seq;
+	__le16 size;
+	__le16 offset;
+	uint8_t frag;
+	uint8_t frags;
+} __packed;
+
+/*
+ * struct gb_udp_reasm: Message being reassembled
+ *
+ * @msg: message, NULL if the slot is free
+ * @start_ms: uptime when the first fragment arrived
+ * @received: bitmap of received fragments
+ * @cport: cport of the message
+ * @seq: message number
+ * @frags: number of fragments, from the first fragment that arrived
+ */
+struct gb_udp_reasm {
+	struct gb_message *msg;
+	int64_t start_ms;
+	uint32_t received;
+	uint16_t cport;
+	uint16_t seq;
+	uint8_t frags;
+};
+
+/*
+ * struct gb_udp_resp_cache: Recently received request
+ *
+ * @resp: response sent for the request, NULL while it is being handled
+ * @cport: cport of the request
+ * @operation_id: operation id of the request
+ * @used: entry is valid
+ */
+struct gb_udp_resp_cache {
+	struct gb_message *resp;
+	uint16_t cport;
+	uint16_t operation_id;
+	bool used;
+};
+
+/*
+ * struct gb_trans_ctx: Transport Context
+ *
+ * @rx_thread: rx_thread
+ * @stop: set on exit, tells rx_thread to return
+ * @lock: protects everything below
+ * @sock: socket bound to the greybus port
+ * @peer: address of the AP, learned from the last valid datagram
+ * @peer_len: length of peer, 0 until the AP has sent something
+ * @tx_seq: number of the next message sent
+ * @reasm: messages being reassembled
+ * @cache: recently received requests, oldest replaced first
+ * @cache_next: next entry of cache to replace
+ * @rx_buf: received datagram
+ */
+struct gb_trans_ctx {
+	struct k_thread rx_thread;
+	atomic_t stop;
+	struct k_mutex lock;
+	int sock;
+	struct sockaddr peer;
+	socklen_t peer_len;
+	uint16_t tx_seq;
+	struct gb_udp_reasm reasm[CONFIG_GREYBUS_UDP_REASSEMBLY_SLOTS];
+	struct gb_udp_resp_cache cache[CONFIG_GREYBUS_UDP_RESPONSE_CACHE];
+	size_t cache_next;
+	uint8_t rx_buf[CONFIG_GREYBUS_UDP_MTU];
+};
+
+static struct gb_trans_ctx ctx;
+
+static int gb_trans_listen_start(uint16_t cport)
+{
+	return 0;
+}
+
+static int gb_trans_listen_stop(uint16_t cport)
+{
+	return 0;
+}
+
+/*
+ * Helper to send a datagram. Must be called with the lock held.
+ */
+static int gb_trans_datagram_send(struct gb_trans_ctx *ctx, const struct gb_udp_hdr *hdr,
+				  const uint8_t *data, size_t len)
+{
+	ssize_t ret;
+	struct iovec iov[] = {
+		{
+			.iov_base = (void *)hdr,
+			.iov_len = sizeof(*hdr),
+		},
+		{
+			.iov_base = (void *)data,
+			.iov_len = len,
+		},
+	};
+	struct msghdr msg = {
+		/* A DTLS socket only talks to the peer of its session */
+		.msg_name = IS_ENABLED(CONFIG_GREYBUS_ENABLE_TLS) ? NULL : &ctx->peer,
+		.msg_namelen = IS_ENABLED(CONFIG_GREYBUS_ENABLE_TLS) ? 0 : ctx->peer_len,
+		.msg_iov = iov,
+		.msg_iovlen = ARRAY_SIZE(iov),
+	};
+
+	ret = zsock_sendmsg(ctx->sock, &msg, 0);
+	if (ret < 0) {
+		LOG_ERR("Failed to transmit datagram (%d)", errno);
+		return -errno;
+	}
+
+	return 0;
+}
+
+/*
+ * Helper to keep the response to a request still in the cache, so that a retransmitted request
+ * can be answered again. Must be called with the lock held.
+ */
+static void gb_trans_cache_response(struct gb_trans_ctx *ctx, uint16_t cport,
+				    const struct gb_message *msg)
+{
+	struct gb_udp_resp_cache *entry;
+
+	for (size_t i = 0; i < ARRAY_SIZE(ctx->cache); i++) {
+		entry = &ctx->cache[i];
+		if (entry->used && !entry->resp && entry->cport == cport &&
+		    entry->operation_id == msg->header.operation_id) {
+			/* Empty responses may live on the stack */
+			entry->resp = gb_message_get(msg);
+			return;
+		}
+	}
+}
+
+static int gb_trans_send(uint16_t cport, const struct gb_message *msg)
+{
+	int ret = 0;
+	const uint8_t *data = (const uint8_t *)&msg->header;
+	const size_t size = sys_le16_to_cpu(msg->header.size);
+	const size_t frags = DIV_ROUND_UP(size, GB_UDP_FRAG_SIZE);
+	struct gb_udp_hdr hdr = {
+		.cport = sys_cpu_to_le16(cport),
+		.size = sys_cpu_to_le16(size),
+		.frags = frags,
+	};
+
+	if (msg->header.result) {
+		LOG_INF("CPort %u, Type: %u, Result: %u, Id: %u", cport, msg->header.type,
+			msg->header.result, msg->header.operation_id);
+	}
+
+	if (frags > GB_UDP_FRAGS_MAX) {
+		LOG_ERR("Message of %zu bytes needs too many fragments", size);
+		return -EMSGSIZE;
+	}
+
+	k_mutex_lock(&ctx.lock, K_FOREVER);
+
+	if (!ctx.peer_len) {
+		ret = -ENOTCONN;
+		goto unlock;
+	}
+
+	if (gb_message_is_response(msg) && msg->header.operation_id) {
+		gb_trans_cache_response(&ctx, cport, msg);
+	}
+
+	hdr.seq = sys_cpu_to_le16(ctx.tx_seq++);
+	for (size_t i = 0; i < frags && ret == 0; i++) {
+		const size_t offset = i * GB_UDP_FRAG_SIZE;
+
+		hdr.offset = sys_cpu_to_le16(offset);
+		hdr.frag = i;
+		ret = gb_trans_datagram_send(&ctx, &hdr, data + offset,
+					     MIN(GB_UDP_FRAG_SIZE, size - offset));
+	}
+
+unlock:
+	k_mutex_unlock(&ctx.lock);
+	return ret;
+}
+
+/*
+ * Helper to filter retransmitted requests. Returns true if the request was handled before, in
+ * which case its response is sent again if it is known already. Must be called with the lock
+ * held.
+ */
+static bool gb_trans_request_seen(struct gb_trans_ctx *ctx, uint16_t cport,
+				  const struct gb_message *msg)
+{
+	struct gb_udp_resp_cache *entry;
+
+	for (size_t i = 0; i < ARRAY_SIZE(ctx->cache); i++) {
+		entry = &ctx->cache[i];
+		if (!entry->used || entry->cport != cport ||
+		    entry->operation_id != msg->header.operation_id) {
+			continue;
+		}
+
+		/* Operation ids wrap around, a different type is a new request */
+		if (entry->resp &&
+		    gb_message_type(entry->resp) != GB_RESPONSE(gb_message_type(msg))) {
+			goto replace;
+		}
+
+		if (entry->resp) {
+			/* The lock is recursive */
+			LOG_DBG("Resending response %u on cport %u", msg->header.operation_id,
+				cport);
+			gb_trans_send(cport, entry->resp);
+		}
+
+		return true;
+	}
+
+	entry = &ctx->cache[ctx->cache_next];
+	ctx->cache_next = (ctx->cache_next + 1) % ARRAY_SIZE(ctx->cache);
+
+replace:
+	gb_message_dealloc(entry->resp);
+	*entry = (struct gb_udp_resp_cache){
+		.cport = cport,
+		.operation_id = msg->header.operation_id,
+		.used = true,
+	};
+
+	return false;
+}
+
+/*
+ * Helper to hand a complete message to greybus
+ */
+static void gb_trans_dispatch(struct gb_trans_ctx *ctx, uint16_t cport, struct gb_message *msg)
+{
+	bool seen = false;
+
+	if (!gb_message_is_response(msg) && msg->header.operation_id) {
+		k_mutex_lock(&ctx->lock, K_FOREVER);
+		seen = gb_trans_request_seen(ctx, cport, msg);
+		k_mutex_unlock(&ctx->lock);
+	}
+
+	if (seen) {
+		gb_message_dealloc(msg);
+		return;
+	}
+
+	if (greybus_rx_handler(cport, msg) < 0) {
+		LOG_ERR("Failed to receive greybus message");
+		gb_message_dealloc(msg);
+	}
+}
+
+/*
+ * Helper to find the reassembly slot of a message, or a slot to start it in. A slot is reused
+ * once its message is older than CONFIG_GREYBUS_UDP_REASSEMBLY_TIMEOUT_MS, or when all slots are
+ * in use, in which case the oldest message is dropped.
+ */
+static struct gb_udp_reasm *gb_trans_reasm_slot(struct gb_trans_ctx *ctx, uint16_t cport,
+						uint16_t seq)
+{
+	const int64_t now = k_uptime_get();
+	struct gb_udp_reasm *slot = NULL;
+	struct gb_udp_reasm *reasm;
+
+	for (size_t i = 0; i < ARRAY_SIZE(ctx->reasm); i++) {
+		reasm = &ctx->reasm[i];
+		if (!reasm->msg) {
+			continue;
+		}
+
+		if (reasm->cport == cport && reasm->seq == seq) {
+			return reasm;
+		}
+
+		if (now - reasm->start_ms > CONFIG_GREYBUS_UDP_REASSEMBLY_TIMEOUT_MS) {
+			LOG_WRN("Dropping incomplete message %u on cport %u", reasm->seq,
+				reasm->cport);
+			gb_message_dealloc(reasm->msg);
+			reasm->msg = NULL;
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(ctx->reasm); i++) {
+		reasm = &ctx->reasm[i];
+		if (!reasm->msg) {
+			return reasm;
+		}
+
+		if (!slot || reasm->start_ms < slot->start_ms) {
+			slot = reasm;
+		}
+	}
+
+	LOG_WRN("Dropping incomplete message %u on cport %u", slot->seq, slot->cport);
+	gb_message_dealloc(slot->msg);
+	slot->msg = NULL;
+
+	return slot;
+}
+
+/*
+ * Helper to add a fragment to its message. Returns the message once all fragments arrived.
+ */
+static struct gb_message *gb_trans_reasm(struct gb_trans_ctx *ctx, const struct gb_udp_hdr *hdr,
+					 const uint8_t *data, size_t len)
+{
+	struct gb_message *msg;
+	struct gb_udp_reasm *slot;
+	const struct gb_operation_msg_hdr *gb_hdr = (const struct gb_operation_msg_hdr *)data;
+	const uint16_t cport = sys_le16_to_cpu(hdr->cport);
+	const uint16_t seq = sys_le16_to_cpu(hdr->seq);
+	const size_t size = sys_le16_to_cpu(hdr->size);
+
+	slot = gb_trans_reasm_slot(ctx, cport, seq);
+	if (!slot->msg) {
+		/* The greybus header is only known once the first fragment arrives */
+		slot->msg = gb_message_alloc(size - sizeof(struct gb_operation_msg_hdr), 0, 0, 0);
+		if (!slot->msg) {
+			LOG_ERR("Failed to allocate node message");
+			return NULL;
+		}
+		slot->start_ms = k_uptime_get();
+		slot->received = 0;
+		slot->cport = cport;
+		slot->seq = seq;
+		slot->frags = hdr->frags;
+	} else if (sys_le16_to_cpu(slot->msg->header.size) != size || slot->frags != hdr->frags) {
+		LOG_ERR("Fragment size mismatch");
+		return NULL;
+	}
+
+	if (slot->received & BIT(hdr->frag)) {
+		/* Duplicated by the network */
+		return NULL;
+	}
+
+	msg = slot->msg;
+	memcpy((uint8_t *)&msg->header + sys_le16_to_cpu(hdr->offset), data, len);
+	if (hdr->frag == 0 && sys_le16_to_cpu(gb_hdr->size) != size) {
+		LOG_ERR("Invalid message size %u", sys_le16_to_cpu(gb_hdr->size));
+		gb_message_dealloc(msg);
+		slot->msg = NULL;
+		return NULL;
+	}
+	slot->received |= BIT(hdr->frag);
+
+	if (slot->received != (uint32_t)BIT64_MASK(slot->frags)) {
+		return NULL;
+	}
+
+	slot->msg = NULL;
+	return msg;
+}
+
+/*
+ * Helper to check a datagram header against the fragment layout used by gb_trans_send(). Every
+ * fragment but the last is GB_UDP_FRAG_SIZE long, so a fragment can neither overlap another one
+ * nor leave a hole.
+ */
+static bool gb_trans_frag_valid(const struct gb_udp_hdr *hdr, size_t len)
+{
+	const size_t size = sys_le16_to_cpu(hdr->size);
+	const size_t offset = sys_le16_to_cpu(hdr->offset);
+
+	if (size < sizeof(struct gb_operation_msg_hdr) || !hdr->frags ||
+	    hdr->frags > GB_UDP_FRAGS_MAX || hdr->frag >= hdr->frags) {
+		return false;
+	}
+
+	if (offset != hdr->frag * GB_UDP_FRAG_SIZE || offset + len > size) {
+		return false;
+	}
+
+	if (hdr->frag == 0 && len < sizeof(struct gb_operation_msg_hdr)) {
+		return false;
+	}
+
+	return len == (hdr->frag + 1 < hdr->frags ? GB_UDP_FRAG_SIZE : size - offset);
+}
+
+/*
+ * Helper to receive and dispatch one datagram
+ */
+static void gb_trans_rx(struct gb_trans_ctx *ctx)
+{
+	int ret;
+	size_t len, size;
+	struct sockaddr addr;
+	socklen_t addr_len = sizeof(addr);
+	struct gb_udp_hdr hdr;
+	struct gb_operation_msg_hdr gb_hdr;
+	struct gb_message *msg;
+	const uint8_t *data = ctx->rx_buf + sizeof(hdr);
+
+	ret = zsock_recvfrom(ctx->sock, ctx->rx_buf, sizeof(ctx->rx_buf), 0, &addr, &addr_len);
+	if (ret < 0 && atomic_get(&ctx->stop)) {
+		return;
+	}
+	if (ret < 0) {
+		LOG_ERR("Failed to receive data (%d)", errno);
+		return;
+	}
+
+	if (ret < sizeof(hdr)) {
+		LOG_ERR("Dropping short datagram");
+		return;
+	}
+
+	memcpy(&hdr, ctx->rx_buf, sizeof(hdr));
+	len = ret - sizeof(hdr);
+	size = sys_le16_to_cpu(hdr.size);
+
+	if (!gb_trans_frag_valid(&hdr, len)) {
+		LOG_ERR("Dropping invalid datagram");
+		return;
+	}
+
+	/* Replies go to wherever the AP last sent from */
+	k_mutex_lock(&ctx->lock, K_FOREVER);
+	memcpy(&ctx->peer, &addr, addr_len);
+	ctx->peer_len = addr_len;
+	k_mutex_unlock(&ctx->lock);
+
+	if (hdr.frags > 1) {
+		msg = gb_trans_reasm(ctx, &hdr, data, len);
+	} else {
+		memcpy(&gb_hdr, data, sizeof(gb_hdr));
+		if (sys_le16_to_cpu(gb_hdr.size) != size) {
+			LOG_ERR("Invalid message size %u", sys_le16_to_cpu(gb_hdr.size));
+			return;
+		}
+
+		msg = gb_message_alloc(gb_hdr_payload_len(&gb_hdr), gb_hdr.type,
+				       gb_hdr.operation_id, gb_hdr.result);
+		if (!msg) {
+			LOG_ERR("Failed to allocate node message");
+			return;
+		}
+		memcpy(msg, data, size);
+	}
+
+	if (msg) {
+		gb_trans_dispatch(ctx, sys_le16_to_cpu(hdr.cport), msg);
+	}
+}
+
+/*
+ * Hander function for rx thread
+ */
+static void gb_trans_rx_thread_handler(void *p1, void *p2, void *p3)
+{
+	while (!atomic_get(&ctx.stop)) {
+		gb_trans_rx(&ctx);
+	}
+}
+
+static int netsetup(void)
+{
+	int sock, ret, family, proto = IPPROTO_UDP;
+	struct sockaddr sa;
+	socklen_t sa_len;
+
+	if (IS_ENABLED(CONFIG_GREYBUS_TLS_BUILTIN)) {
+		proto = IPPROTO_DTLS_1_2;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	if (IS_ENABLED(CONFIG_NET_IPV6)) {
+		family = AF_INET6;
+		net_sin6(&sa)->sin6_family = AF_INET6;
+		net_sin6(&sa)->sin6_addr = in6addr_any;
+		net_sin6(&sa)->sin6_port = htons(GB_TRANSPORT_UDP_BASE_PORT);
+		sa_len = sizeof(struct sockaddr_in6);
+	} else if (IS_ENABLED(CONFIG_NET_IPV4)) {
+		family = AF_INET;
+		net_sin(&sa)->sin_family = AF_INET;
+		net_sin(&sa)->sin_addr.s_addr = INADDR_ANY;
+		net_sin(&sa)->sin_port = htons(GB_TRANSPORT_UDP_BASE_PORT);
+		sa_len = sizeof(struct sockaddr_in);
+	} else {
+		LOG_ERR("Neither IPv6 nor IPv4 is available");
+		return -EINVAL;
+	}
+
+	sock = zsock_socket(family, SOCK_DGRAM, proto);
+	if (sock < 0) {
+		LOG_ERR("socket: %d", errno);
+		return -errno;
+	}
+
+	if (IS_ENABLED(CONFIG_GREYBUS_ENABLE_TLS)) {
+		static const sec_tag_t sec_tag_opt[] = {
+#if defined(CONFIG_GREYBUS_TLS_CLIENT_VERIFY_OPTIONAL) ||                                          \
+	defined(CONFIG_GREYBUS_TLS_CLIENT_VERIFY_REQUIRED)
+			GB_TLS_CA_CERT_TAG,
+#endif
+			GB_TLS_SERVER_CERT_TAG,
+#ifdef CONFIG_GREYBUS_TLS_PSK
+			GB_TLS_PSK_TAG,
+#endif
+		};
+		const int role = TLS_DTLS_ROLE_SERVER;
+		int verify = TLS_PEER_VERIFY_NONE;
+
+		ret = zsock_setsockopt(sock, SOL_TLS, TLS_SEC_TAG_LIST, sec_tag_opt,
+				       sizeof(sec_tag_opt));
+		if (ret < 0) {
+			LOG_ERR("setsockopt: Failed to set SEC_TAG_LIST (%d)", errno);
+			return -errno;
+		}
+
+		ret = zsock_setsockopt(sock, SOL_TLS, TLS_DTLS_ROLE, &role, sizeof(role));
+		if (ret < 0) {
+			LOG_ERR("setsockopt: Failed to set DTLS_ROLE (%d)", errno);
+			return -errno;
+		}
+
+		if (IS_ENABLED(CONFIG_GREYBUS_TLS_CLIENT_VERIFY_OPTIONAL)) {
+			verify = TLS_PEER_VERIFY_OPTIONAL;
+		}
+
+		if (IS_ENABLED(CONFIG_GREYBUS_TLS_CLIENT_VERIFY_REQUIRED)) {
+			verify = TLS_PEER_VERIFY_REQUIRED;
+		}
+
+		ret = zsock_setsockopt(sock, SOL_TLS, TLS_PEER_VERIFY, &verify, sizeof(verify));
+		if (ret < 0) {
+			LOG_ERR("setsockopt: Failed to set TLS_PEER_VERIFY (%d)", errno);
+			return -errno;
+		}
+
+		if (IS_ENABLED(CONFIG_GREYBUS_TLS_SESSION_CACHE)) {
+			const int cache = TLS_SESSION_CACHE_ENABLED;
+
+			ret = zsock_setsockopt(sock, SOL_TLS, TLS_SESSION_CACHE, &cache,
+					       sizeof(cache));
+			if (ret < 0) {
+				LOG_WRN("setsockopt: Failed to set TLS_SESSION_CACHE (%d)", errno);
+			}
+		}
+	}
+
+	ret = zsock_bind(sock, &sa, sa_len);
+	if (ret < 0) {
+		LOG_ERR("bind: %d", errno);
+		return -errno;
+	}
+
+	LOG_INF("Greybus socket opened at port %u", GB_TRANSPORT_UDP_BASE_PORT);
+
+	return sock;
+}
+
+static int gb_trans_init(void)
+{
+	ctx.sock = netsetup();
+
+	if (ctx.sock < 0) {
+		LOG_ERR("Failed to setup base UDP port");
+		return -ESOCKTNOSUPPORT;
+	}
+	k_mutex_init(&ctx.lock);
+	atomic_clear(&ctx.stop);
+
+	k_thread_create(&ctx.rx_thread, gb_trans_rx_stack, K_THREAD_STACK_SIZEOF(gb_trans_rx_stack),
+			gb_trans_rx_thread_handler, NULL, NULL, NULL,
+			CONFIG_GREYBUS_UDP_RX_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&ctx.rx_thread, "gb_trans_rx");
+
+	return 0;
+}
+
+static void gb_trans_exit(void)
+{
+	/*
+	 * The rx thread may hold the lock, even across a resend, so it is not aborted. Shutting the
+	 * socket down wakes it from the receive, then it returns on the stop flag.
+	 */
+	atomic_set(&ctx.stop, 1);
+	zsock_shutdown(ctx.sock, ZSOCK_SHUT_RDWR);
+	k_thread_join(&ctx.rx_thread, K_FOREVER);
+	zsock_close(ctx.sock);
+
+	k_mutex_lock(&ctx.lock, K_FOREVER);
+	ctx.peer_len = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(ctx.reasm); i++) {
+		gb_message_dealloc(ctx.reasm[i].msg);
+		ctx.reasm[i].msg = NULL;
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(ctx.cache); i++) {
+		gb_message_dealloc(ctx.cache[i].resp);
+		ctx.cache[i] = (struct gb_udp_resp_cache){0};
+	}
+	k_mutex_unlock(&ctx.lock);
+}
+
+const struct gb_transport_backend gb_trans_backend = {
+	.init = gb_trans_init,
+	.exit = gb_trans_exit,
+	.listen = gb_trans_listen_start,
+	.stop_listening = gb_trans_listen_stop,
+	.send = gb_trans_send,
+};
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Transport over the CDC ACM UART chosen as zephyr,greybus-usb.
+ *
+ * The stream uses the same framing as the TCP/IP transport, the cport (le16) followed by the
+ * greybus message, so the host can reuse its socket code on the tty. Outgoing messages are queued
+ * in a ring that the USB stack drains into bulk transfers, so several small messages share one
+ * transfer. The USB stack itself is enabled by the application.
+ */
+
+#include <greybus/greybus.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <greybus/greybus_messages.h>
+#include "../greybus_internal.h"
+
+LOG_MODULE_REGISTER(greybus_transport_usb, CONFIG_GREYBUS_LOG_LEVEL);
+
+/* cport and greybus header, needed to allocate the message */
+#define GB_USB_HDR_SIZE (sizeof(__le16) + sizeof(struct gb_operation_msg_hdr))
+
+K_THREAD_STACK_DEFINE(gb_trans_rx_stack, CONFIG_GREYBUS_XPORT_USB_RX_STACK_SIZE);
+RING_BUF_DECLARE(gb_trans_rx_ring, CONFIG_GREYBUS_XPORT_USB_RX_RING_SIZE);
+RING_BUF_DECLARE(gb_trans_tx_ring, CONFIG_GREYBUS_XPORT_USB_TX_RING_SIZE);
+
+/*
+ * struct gb_usb_rx: Message being received
+ *
+ * @pos: number of bytes of the cport and greybus header received
+ * @hdr: cport and greybus header
+ * @msg: message being filled, allocated once the header is complete
+ * @len: number of payload bytes received
+ */
+struct gb_usb_rx {
+	size_t pos;
+	uint8_t hdr[GB_USB_HDR_SIZE];
+	struct gb_message *msg;
+	size_t len;
+};
+
+/*
+ * struct gb_trans_ctx: Transport Context
+ *
+ * @dev: CDC ACM UART device
+ * @rx_thread: rx_thread
+ * @rx_sem: given when bytes were added to the receive ring
+ * @rx_overruns: number of times the receive ring was full
+ * @rx: message decoder, only used by the rx thread
+ * @tx_lock: serializes senders
+ * @tx_space: given when the USB stack took bytes from the transmit ring
+ */
+struct gb_trans_ctx {
+	const struct device *dev;
+	struct k_thread rx_thread;
+	struct k_sem rx_sem;
+	atomic_t rx_overruns;
+	struct gb_usb_rx rx;
+	struct k_mutex tx_lock;
+	struct k_sem tx_space;
+};
+
+static struct gb_trans_ctx ctx = {
+	.dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_greybus_usb)),
+};
+
+static int gb_trans_listen_start(uint16_t cport)
+{
+	return 0;
+}
+
+static int gb_trans_listen_stop(uint16_t cport)
+{
+	return 0;
+}
+
+/*
+ * Helper to move received bytes from the USB FIFO into the receive ring, without a bounce buffer
+ */
+static void gb_trans_isr_rx(struct gb_trans_ctx *ctx)
+{
+	uint8_t *data;
+	uint32_t space;
+	int len;
+
+	while (uart_irq_rx_ready(ctx->dev)) {
+		space = ring_buf_put_claim(&gb_trans_rx_ring, &data,
+					   CONFIG_GREYBUS_XPORT_USB_RX_RING_SIZE);
+		if (!space) {
+			/* Leave the bytes in the FIFO, USB flow control holds the host back */
+			uart_irq_rx_disable(ctx->dev);
+			atomic_inc(&ctx->rx_overruns);
+			break;
+		}
+
+		len = uart_fifo_read(ctx->dev, data, space);
+		ring_buf_put_finish(&gb_trans_rx_ring, MAX(len, 0));
+		if (len <= 0) {
+			break;
+		}
+	}
+
+	k_sem_give(&ctx->rx_sem);
+}
+
+static void gb_trans_isr_tx(struct gb_trans_ctx *ctx)
+{
+	uint8_t *data;
+	uint32_t len;
+	int sent;
+
+	while (uart_irq_tx_ready(ctx->dev)) {
+		len = ring_buf_get_claim(&gb_trans_tx_ring, &data,
+					 CONFIG_GREYBUS_XPORT_USB_TX_RING_SIZE);
+		if (!len) {
+			uart_irq_tx_disable(ctx->dev);
+			break;
+		}
+
+		sent = uart_fifo_fill(ctx->dev, data, len);
+		ring_buf_get_finish(&gb_trans_tx_ring, MAX(sent, 0));
+		if (sent <= 0) {
+			break;
+		}
+	}
+
+	k_sem_give(&ctx->tx_space);
+}
+
+static void gb_trans_isr(const struct device *dev, void *user_data)
+{
+	struct gb_trans_ctx *ctx = user_data;
+
+	while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+		gb_trans_isr_rx(ctx);
+		gb_trans_isr_tx(ctx);
+	}
+}
+
+static int gb_trans_send(uint16_t cport, const struct gb_message *msg)
+{
+	int ret = 0;
+	const __le16 cport_u16 = sys_cpu_to_le16(cport);
+	const size_t size = sys_le16_to_cpu(msg->header.size);
+	const uint8_t *parts[] = {(const uint8_t *)&cport_u16, (const uint8_t *)&msg->header};
+	const size_t lens[] = {sizeof(cport_u16), size};
+	const k_timeout_t timeout = K_MSEC(CONFIG_GREYBUS_XPORT_USB_TX_TIMEOUT_MS);
+	size_t off;
+	uint32_t put;
+
+	if (msg->header.result) {
+		LOG_INF("CPort %u, Type: %u, Result: %u, Id: %u", cport, msg->header.type,
+			msg->header.result, msg->header.operation_id);
+	}
+
+	k_mutex_lock(&ctx.tx_lock, K_FOREVER);
+
+	/* Wait for room for the whole message when it fits, so a timeout never cuts one in half */
+	while (ring_buf_space_get(&gb_trans_tx_ring) <
+	       MIN(sizeof(cport_u16) + size, CONFIG_GREYBUS_XPORT_USB_TX_RING_SIZE)) {
+		uart_irq_tx_enable(ctx.dev);
+		if (k_sem_take(&ctx.tx_space, timeout) < 0) {
+			ret = -EAGAIN;
+			goto out;
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(parts); i++) {
+		for (off = 0; off < lens[i]; off += put) {
+			put = ring_buf_put(&gb_trans_tx_ring, parts[i] + off, lens[i] - off);
+			uart_irq_tx_enable(ctx.dev);
+			if (!put && k_sem_take(&ctx.tx_space, timeout) < 0) {
+				LOG_ERR("Host stopped reading in the middle of a message");
+				ret = -EIO;
+				goto out;
+			}
+		}
+	}
+
+out:
+	k_mutex_unlock(&ctx.tx_lock);
+
+	if (ret < 0) {
+		LOG_ERR("Failed to send %zu byte message on cport %u (%d)", size, cport, ret);
+	}
+
+	return ret;
+}
+
+/*
+ * Helper to drop the message being received
+ */
+static void gb_trans_rx_reset(struct gb_usb_rx *rx)
+{
+	gb_message_dealloc(rx->msg);
+	rx->msg = NULL;
+	rx->pos = 0;
+	rx->len = 0;
+}
+
+/*
+ * Helper to decode received bytes. Returns the number of bytes used.
+ */
+static size_t gb_trans_rx_decode(struct gb_usb_rx *rx, const uint8_t *data, size_t len)
+{
+	struct gb_operation_msg_hdr hdr;
+	size_t n;
+
+	if (rx->pos < GB_USB_HDR_SIZE) {
+		n = MIN(len, GB_USB_HDR_SIZE - rx->pos);
+		memcpy(rx->hdr + rx->pos, data, n);
+		rx->pos += n;
+		if (rx->pos < GB_USB_HDR_SIZE) {
+			return n;
+		}
+
+		memcpy(&hdr, rx->hdr + sizeof(__le16), sizeof(hdr));
+		if (sys_le16_to_cpu(hdr.size) < sizeof(hdr)) {
+			/* Nothing to resynchronize on, expect a header in the next bytes */
+			LOG_ERR("Invalid message size %u", sys_le16_to_cpu(hdr.size));
+			gb_trans_rx_reset(rx);
+			return n;
+		}
+
+		rx->msg = gb_message_alloc(gb_hdr_payload_len(&hdr), hdr.type, hdr.operation_id,
+					   hdr.result);
+		if (!rx->msg) {
+			LOG_ERR("Failed to allocate node message");
+			gb_trans_rx_reset(rx);
+			return n;
+		}
+		memcpy(&rx->msg->header, &hdr, sizeof(hdr));
+	} else {
+		n = MIN(len, gb_message_payload_len(rx->msg) - rx->len);
+		memcpy(rx->msg->payload + rx->len, data, n);
+		rx->len += n;
+	}
+
+	if (rx->len < gb_message_payload_len(rx->msg)) {
+		return n;
+	}
+
+	if (greybus_rx_handler(sys_get_le16(rx->hdr), rx->msg) < 0) {
+		LOG_ERR("Failed to receive greybus message");
+		gb_message_dealloc(rx->msg);
+	}
+	rx->msg = NULL;
+	gb_trans_rx_reset(rx);
+
+	return n;
+}
+
+/*
+ * Hander function for rx thread
+ */
+static void gb_trans_rx_thread_handler(void *p1, void *p2, void *p3)
+{
+	uint8_t *data;
+	uint32_t len;
+	size_t used;
+	atomic_val_t overruns;
+
+	while (true) {
+		k_sem_take(&ctx.rx_sem, K_FOREVER);
+
+		while ((len = ring_buf_get_claim(&gb_trans_rx_ring, &data,
+						 CONFIG_GREYBUS_XPORT_USB_RX_RING_SIZE)) > 0) {
+			for (used = 0; used < len;) {
+				used += gb_trans_rx_decode(&ctx.rx, data + used, len - used);
+			}
+			ring_buf_get_finish(&gb_trans_rx_ring, len);
+		}
+
+		overruns = atomic_set(&ctx.rx_overruns, 0);
+		if (overruns) {
+			/* The ring has room again */
+			uart_irq_rx_enable(ctx.dev);
+		}
+	}
+}
+
+static int gb_trans_init(void)
+{
+	int ret;
+
+	if (!device_is_ready(ctx.dev)) {
+		LOG_ERR("CDC ACM UART %s is not ready", ctx.dev->name);
+		return -ENODEV;
+	}
+
+	k_sem_init(&ctx.rx_sem, 0, 1);
+	k_sem_init(&ctx.tx_space, 0, 1);
+	k_mutex_init(&ctx.tx_lock);
+	gb_trans_rx_reset(&ctx.rx);
+	ring_buf_reset(&gb_trans_rx_ring);
+	ring_buf_reset(&gb_trans_tx_ring);
+
+	ret = uart_irq_callback_user_data_set(ctx.dev, gb_trans_isr, &ctx);
+	if (ret < 0) {
+		LOG_ERR("Failed to set UART callback (%d)", ret);
+		return ret;
+	}
+
+	k_thread_create(&ctx.rx_thread, gb_trans_rx_stack, K_THREAD_STACK_SIZEOF(gb_trans_rx_stack),
+			gb_trans_rx_thread_handler, NULL, NULL, NULL,
+			CONFIG_GREYBUS_XPORT_USB_RX_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&ctx.rx_thread, "gb_trans_rx");
+
+	uart_irq_rx_enable(ctx.dev);
+
+	LOG_INF("Greybus transport on %s", ctx.dev->name);
+
+	return 0;
+}
+
+static void gb_trans_exit(void)
+{
+	uart_irq_rx_disable(ctx.dev);
+	uart_irq_tx_disable(ctx.dev);
+	k_thread_abort(&ctx.rx_thread);
+	gb_trans_rx_reset(&ctx.rx);
+}
+
+const struct gb_transport_backend gb_trans_backend = {
+	.init = gb_trans_init,
+	.exit = gb_trans_exit,
+	.listen = gb_trans_listen_start,
+	.stop_listening = gb_trans_listen_stop,
+	.send = gb_trans_send,
+};
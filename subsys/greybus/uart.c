@@ -34,54 +34,143 @@
 
 LOG_MODULE_REGISTER(greybus_uart, CONFIG_GREYBUS_LOG_LEVEL);
 
-/* Reserved buffer for rx data. */
-#define MAX_RX_BUF_SIZE 64
+#define MAX_RX_BUF_SIZE CONFIG_GREYBUS_UART_RX_MSG_SIZE
 
 /* The id of error in protocol operating. */
 #define GB_UART_EVENT_PROTOCOL_ERROR 1
 #define GB_UART_EVENT_DEVICE_ERROR   2
 
-static void gb_uart_receive_credits(uint16_t cport, uint16_t count)
+/* Credits the host starts with, before any has been returned */
+#define GB_UART_HOST_CREDITS 4096
+
+BUILD_ASSERT(CONFIG_GREYBUS_UART_TX_BUF_SIZE >= GB_UART_HOST_CREDITS,
+	     "TX buffer does not hold the initial credits of the host");
+
+static int gb_uart_receive_credits(uint16_t cport, uint16_t count)
 {
 	struct gb_uart_receive_credits_request *req_data;
 	struct gb_message *msg =
 		gb_message_request_alloc(sizeof(*req_data), GB_UART_TYPE_RECEIVE_CREDITS, true);
 
+	if (!msg) {
+		return -ENOMEM;
+	}
+
 	req_data = (struct gb_uart_receive_credits_request *)msg->payload;
 
 	req_data->count = sys_cpu_to_le16(count);
 
 	gb_transport_message_send(msg, cport);
 	gb_message_dealloc(msg);
+
+	return 0;
+}
+
+static void gb_uart_credits_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct gb_uart_driver_data *data =
+		CONTAINER_OF(dwork, struct gb_uart_driver_data, credits_work);
+	atomic_val_t count = atomic_clear(&data->tx_credits);
+
+	while (count > 0) {
+		if (gb_uart_receive_credits(data->cport, MIN(count, UINT16_MAX)) < 0) {
+			LOG_ERR("Failed to allocate message");
+			/* The host stops sending without them, keep them and retry later */
+			atomic_add(&data->tx_credits, count);
+			k_work_schedule(&data->credits_work,
+					K_USEC(CONFIG_GREYBUS_UART_RX_IDLE_US));
+			return;
+		}
+		count -= MIN(count, UINT16_MAX);
+	}
+}
+
+/*
+ * Helper to tell the host that data it sent was dropped, as an overrun without any data
+ */
+static void gb_uart_report_overrun(uint16_t cport)
+{
+	struct gb_uart_recv_data_request *req_data;
+	struct gb_message *req =
+		gb_message_request_alloc(sizeof(*req_data), GB_UART_TYPE_RECEIVE_DATA, true);
+
+	if (!req) {
+		LOG_ERR("Failed to allocate message");
+		return;
+	}
+
+	req_data = (struct gb_uart_recv_data_request *)req->payload;
+	req_data->size = 0;
+	req_data->flags = GB_UART_RECV_FLAG_OVERRUN;
+
+	gb_transport_message_send(req, cport);
+	gb_message_dealloc(req);
 }
 
 /**
  * @brief Protocol send data function.
  */
-static void gb_uart_send_data(uint16_t cport, struct gb_message *req, const struct device *dev)
+static void gb_uart_send_data(const void *priv, struct gb_message *req, uint16_t cport)
 {
-	size_t i;
+	struct gb_uart_driver_data *data = (struct gb_uart_driver_data *)priv;
+	size_t len, written = 0;
+	k_spinlock_key_t key;
+	atomic_val_t cancel = atomic_get(&data->tx_cancel);
+	int ret;
 	const struct gb_uart_send_data_request *req_data =
 		(const struct gb_uart_send_data_request *)req->payload;
 
+	if (gb_message_payload_len(req) - sizeof(*req_data) < sys_le16_to_cpu(req_data->size)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
 	/* Success response does not signify that writing is done. So can be sent early */
 	gb_transport_message_empty_response_send_no_free(req, GB_OP_SUCCESS, cport);
 
-	for (i = 0; i < sys_le16_to_cpu(req_data->size); i++) {
-		uart_poll_out(dev, req_data->data[i]);
+	len = sys_le16_to_cpu(req_data->size);
+	while (written < len) {
+		key = k_spin_lock(&data->tx_lock);
+		written += ring_buf_put(&data->tx_rb, &req_data->data[written], len - written);
+		k_spin_unlock(&data->tx_lock, key);
+
+		uart_irq_tx_enable(data->dev);
+
+		if (written == len) {
+			break;
+		}
+
+		/* The buffer holds all credits, so only a host sending without credits blocks */
+		ret = k_sem_take(&data->tx_space, K_MSEC(CONFIG_GREYBUS_UART_TX_TIMEOUT_MS));
+		if (atomic_get(&data->tx_cancel) != cancel) {
+			/* Flushed or disconnected, the rest goes the way of the buffered data */
+			break;
+		}
+
+		if (ret < 0) {
+			LOG_ERR("TX stalled, dropping %zu bytes", len - written);
+			gb_uart_report_overrun(cport);
+			break;
+		}
+	}
+
+	/* Dropped data never drains, so it is credited back right away */
+	if (written < len && atomic_get(&data->connected)) {
+		atomic_add(&data->tx_credits, len - written);
+		k_work_schedule(&data->credits_work, K_NO_WAIT);
 	}
 
-	/* Send request to signal the number of bytes written */
-	gb_uart_receive_credits(cport, sys_le16_to_cpu(req_data->size));
+	/* Credits are returned by the TX interrupt as the data drains */
 	gb_message_dealloc(req);
 }
 
 /**
  * @brief Protocol set line coding function.
  */
-static void gb_uart_set_line_coding(uint16_t cport, struct gb_message *req,
-				    const struct device *dev)
+static void gb_uart_set_line_coding(const void *priv, struct gb_message *req, uint16_t cport)
 {
+	const struct device *dev = ((const struct gb_uart_driver_data *)priv)->dev;
 	int ret;
 	const struct gb_uart_set_line_coding_request *req_data =
 		(const struct gb_uart_set_line_coding_request *)req->payload;
@@ -143,11 +232,18 @@ static void gb_uart_set_line_coding(uint16_t cport, struct gb_message *req,
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
 
+	/*
+	 * With hardware flow control, a deasserted CTS stops the TX ring from draining, which
+	 * withholds credits from the host. A full RX ring leaves data in the hardware FIFO, which
+	 * deasserts RTS.
+	 */
 	switch (req_data->flow_control) {
 	case 0:
+		conf.flow_ctrl = UART_CFG_FLOW_CTRL_NONE;
 		break;
-	case 0x01:
+	case GB_SERIAL_AUTO_RTSCTS_EN:
 		conf.flow_ctrl = UART_CFG_FLOW_CTRL_RTS_CTS;
+		break;
 	default:
 		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
 	}
@@ -159,9 +255,10 @@ static void gb_uart_set_line_coding(uint16_t cport, struct gb_message *req,
 /**
  * @brief Protocol set RTS & DTR line status function.
  */
-static void gb_uart_set_control_line_state(uint16_t cport, struct gb_message *req,
-					   const struct device *dev)
+static void gb_uart_set_control_line_state(const void *priv, struct gb_message *req,
+					   uint16_t cport)
 {
+	const struct device *dev = ((const struct gb_uart_driver_data *)priv)->dev;
 	int ret;
 	const struct gb_uart_set_control_line_state_request *req_data =
 		(const struct gb_uart_set_control_line_state_request *)req->payload;
@@ -183,89 +280,418 @@ static void gb_uart_set_control_line_state(uint16_t cport, struct gb_message *re
 /**
  * @brief Protocol send break function.
  */
-static void gb_uart_send_break(uint16_t cport, struct gb_message *req, const struct device *dev)
+static void gb_uart_send_break(const void *priv, struct gb_message *req, uint16_t cport)
 {
 	/* TODO: zephyr should provide API for this. */
 	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
 }
 
-static void uart_irq_cb(const struct device *dev, void *user_data)
+static void gb_uart_tx_isr(struct gb_uart_driver_data *data)
 {
-	uint16_t cport = POINTER_TO_UINT(user_data);
-	struct gb_message *req;
-	struct gb_uart_recv_data_request *req_data;
 	int ret;
-
-	if (!uart_irq_update(dev) && !uart_irq_rx_ready(dev)) {
+	uint8_t *buf;
+	uint32_t len;
+	k_spinlock_key_t key = k_spin_lock(&data->tx_lock);
+
+	len = ring_buf_get_claim(&data->tx_rb, &buf, sizeof(data->tx_buf));
+	if (len == 0) {
+		uart_irq_tx_disable(data->dev);
+		k_spin_unlock(&data->tx_lock, key);
 		return;
 	}
 
-	req = gb_message_request_alloc(MAX_RX_BUF_SIZE, GB_UART_TYPE_RECEIVE_DATA, true);
+	ret = uart_fifo_fill(data->dev, buf, len);
+	ring_buf_get_finish(&data->tx_rb, MAX(ret, 0));
+	k_spin_unlock(&data->tx_lock, key);
+
+	if (ret > 0) {
+		atomic_add(&data->tx_credits, ret);
+		k_work_schedule(&data->credits_work, K_NO_WAIT);
+		k_sem_give(&data->tx_space);
+	}
+}
+
+#ifdef CONFIG_GREYBUS_UART_RX_PUMP
+/*
+ * UARTs with a connected cport. The lock is held by the receive thread for a whole cycle, so a
+ * UART is never served once its cport has been disconnected.
+ */
+static K_MUTEX_DEFINE(gb_uart_rx_ports_lock);
+static sys_slist_t gb_uart_rx_ports = SYS_SLIST_STATIC_INIT(&gb_uart_rx_ports);
+static size_t gb_uart_rx_ports_num;
+
+/* Given whenever a UART has data due */
+static K_SEM_DEFINE(gb_uart_rx_pump_sem, 0, 1);
+
+/*
+ * Helper to take at most one message worth of buffered data from a UART.
+ *
+ * @returns NULL if no data is buffered, or if no message could be allocated.
+ */
+static struct gb_message *gb_uart_rx_take(struct gb_uart_driver_data *data)
+{
+	struct gb_uart_recv_data_request *req_data;
+	struct gb_message *req;
+	k_spinlock_key_t key;
+	uint32_t len, remaining;
+
+	key = k_spin_lock(&data->rx_lock);
+	len = MIN(ring_buf_size_get(&data->rx_rb), MAX_RX_BUF_SIZE);
+	k_spin_unlock(&data->rx_lock, key);
+
+	if (len == 0) {
+		return NULL;
+	}
+
+	req = gb_message_request_alloc(sizeof(*req_data) + len, GB_UART_TYPE_RECEIVE_DATA, true);
 	if (!req) {
 		LOG_ERR("Failed to allocate message");
-		return;
+		/* Keep the data buffered and retry later */
+		k_timer_start(&data->rx_idle_timer, K_USEC(CONFIG_GREYBUS_UART_RX_IDLE_US),
+			      K_NO_WAIT);
+		return NULL;
 	}
+
 	req_data = (struct gb_uart_recv_data_request *)req->payload;
 
-	ret = uart_fifo_read(dev, req_data->data, MAX_RX_BUF_SIZE);
+	key = k_spin_lock(&data->rx_lock);
+	len = ring_buf_get(&data->rx_rb, req_data->data, len);
+	remaining = ring_buf_size_get(&data->rx_rb);
+	k_spin_unlock(&data->rx_lock, key);
+
+	req_data->flags = 0;
+	req_data->size = sys_cpu_to_le16(len);
+
+	/* The rest is due as well, but waits for the other UARTs to get their turn */
+	if (remaining) {
+		atomic_set(&data->rx_ready, 1);
+	}
+
+	if (atomic_cas(&data->rx_stalled, 1, 0)) {
+		uart_irq_rx_enable(data->dev);
+	}
+
+	return req;
+}
+
+/*
+ * Helper to run one receive cycle. Each UART with data due gets at most one message, and all
+ * messages of the cycle are sent in one batch.
+ *
+ * @returns true if a UART still has data due.
+ */
+static bool gb_uart_rx_pump_cycle(void)
+{
+	struct gb_msg_with_cport items[CONFIG_GREYBUS_UART_RX_PUMP_BATCH];
+	struct gb_uart_driver_data *data;
+	sys_snode_t *node;
+	size_t num = 0;
+	bool pending = false;
+
+	k_mutex_lock(&gb_uart_rx_ports_lock, K_FOREVER);
+
+	for (size_t i = 0; i < gb_uart_rx_ports_num && num < ARRAY_SIZE(items); i++) {
+		/* Visited UARTs go to the back, a full batch leaves the rest first in line */
+		node = sys_slist_get_not_empty(&gb_uart_rx_ports);
+		sys_slist_append(&gb_uart_rx_ports, node);
+		data = CONTAINER_OF(node, struct gb_uart_driver_data, rx_node);
+
+		if (!atomic_cas(&data->rx_ready, 1, 0)) {
+			continue;
+		}
+
+		items[num].msg = gb_uart_rx_take(data);
+		if (items[num].msg) {
+			items[num].cport = data->cport;
+			num++;
+		}
+	}
+
+	if (num) {
+		gb_transport_message_send_batch(items, num);
+	}
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&gb_uart_rx_ports, data, rx_node) {
+		pending = pending || atomic_get(&data->rx_ready);
+	}
+
+	k_mutex_unlock(&gb_uart_rx_ports_lock);
+
+	for (size_t i = 0; i < num; i++) {
+		gb_message_dealloc(items[i].msg);
+	}
+
+	return pending;
+}
+
+static void gb_uart_rx_pump_thread_handler(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	while (1) {
+		k_sem_take(&gb_uart_rx_pump_sem, K_FOREVER);
+
+		while (gb_uart_rx_pump_cycle()) {
+		}
+	}
+}
+
+K_THREAD_DEFINE(gb_uart_rx_pump, CONFIG_GREYBUS_UART_RX_PUMP_STACK_SIZE,
+		gb_uart_rx_pump_thread_handler, NULL, NULL, NULL,
+		CONFIG_GREYBUS_UART_RX_PUMP_PRIORITY, 0, 0);
+
+/* Hand the buffered data of a UART to the receive thread */
+static void gb_uart_rx_due(struct gb_uart_driver_data *data)
+{
+	atomic_set(&data->rx_ready, 1);
+	k_sem_give(&gb_uart_rx_pump_sem);
+}
+
+static void gb_uart_rx_idle_expiry(struct k_timer *timer)
+{
+	gb_uart_rx_due(CONTAINER_OF(timer, struct gb_uart_driver_data, rx_idle_timer));
+}
+#else
+/* Send everything buffered by the RX interrupt */
+static void gb_uart_rx_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct gb_uart_driver_data *data = CONTAINER_OF(dwork, struct gb_uart_driver_data, rx_work);
+	struct gb_uart_recv_data_request *req_data;
+	struct gb_message *req;
+	k_spinlock_key_t key;
+	uint32_t len;
+
+	for (;;) {
+		key = k_spin_lock(&data->rx_lock);
+		len = MIN(ring_buf_size_get(&data->rx_rb), MAX_RX_BUF_SIZE);
+		k_spin_unlock(&data->rx_lock, key);
+
+		if (len == 0) {
+			break;
+		}
+
+		req = gb_message_request_alloc(sizeof(*req_data) + len, GB_UART_TYPE_RECEIVE_DATA,
+					       true);
+		if (!req) {
+			LOG_ERR("Failed to allocate message");
+			/* Keep the data buffered and retry later */
+			k_work_schedule(&data->rx_work, K_USEC(CONFIG_GREYBUS_UART_RX_IDLE_US));
+			return;
+		}
+
+		req_data = (struct gb_uart_recv_data_request *)req->payload;
+
+		key = k_spin_lock(&data->rx_lock);
+		len = ring_buf_get(&data->rx_rb, req_data->data, len);
+		k_spin_unlock(&data->rx_lock, key);
+
+		req_data->flags = 0;
+		req_data->size = sys_cpu_to_le16(len);
+
+		gb_transport_message_send(req, data->cport);
+		gb_message_dealloc(req);
+	}
+
+	if (atomic_cas(&data->rx_stalled, 1, 0)) {
+		uart_irq_rx_enable(data->dev);
+	}
+}
+#endif // CONFIG_GREYBUS_UART_RX_PUMP
+
+/*
+ * Runs in interrupt context. Only moves the data into the ring buffer, the messages carrying it
+ * are allocated and sent from thread context.
+ */
+static void gb_uart_rx_isr(struct gb_uart_driver_data *data)
+{
+	int ret = 0;
+	uint8_t *buf;
+	uint32_t len, buffered;
+	k_spinlock_key_t key = k_spin_lock(&data->rx_lock);
+
+	do {
+		len = ring_buf_put_claim(&data->rx_rb, &buf, sizeof(data->rx_buf));
+		if (len == 0) {
+			/* Leave the rest in the hardware until the buffer drains */
+			uart_irq_rx_disable(data->dev);
+			atomic_set(&data->rx_stalled, 1);
+			break;
+		}
+
+		ret = uart_fifo_read(data->dev, buf, len);
+		ring_buf_put_finish(&data->rx_rb, MAX(ret, 0));
+	} while (ret == len);
+
+	buffered = ring_buf_size_get(&data->rx_rb);
+	k_spin_unlock(&data->rx_lock, key);
+
 	if (ret < 0) {
 		LOG_ERR("Failed to read from UART");
-		goto free_msg;
 	}
 
-	req_data->flags = 0;
-	req_data->size = ret;
-	req->header.size =
-		ret + sizeof(struct gb_message) + sizeof(struct gb_uart_recv_data_request);
+	/* Flush once a message worth of data is available, otherwise when the line goes idle */
+#ifdef CONFIG_GREYBUS_UART_RX_PUMP
+	if (buffered >= MAX_RX_BUF_SIZE) {
+		k_timer_stop(&data->rx_idle_timer);
+		gb_uart_rx_due(data);
+	} else {
+		k_timer_start(&data->rx_idle_timer, K_USEC(CONFIG_GREYBUS_UART_RX_IDLE_US),
+			      K_NO_WAIT);
+	}
+#else
+	if (buffered >= MAX_RX_BUF_SIZE) {
+		k_work_reschedule(&data->rx_work, K_NO_WAIT);
+	} else {
+		k_work_reschedule(&data->rx_work, K_USEC(CONFIG_GREYBUS_UART_RX_IDLE_US));
+	}
+#endif // CONFIG_GREYBUS_UART_RX_PUMP
+}
 
-	if (ret) {
-		gb_transport_message_send(req, cport);
+static void uart_irq_cb(const struct device *dev, void *user_data)
+{
+	struct gb_uart_driver_data *data = user_data;
+
+	if (!uart_irq_update(dev)) {
+		return;
 	}
 
-free_msg:
-	gb_message_dealloc(req);
+	if (uart_irq_rx_ready(dev)) {
+		gb_uart_rx_isr(data);
+	}
+
+	if (uart_irq_tx_ready(dev)) {
+		gb_uart_tx_isr(data);
+	}
 }
 
-static void gb_uart_handler(const void *priv, struct gb_message *msg, uint16_t cport)
+/**
+ * @brief Protocol flush fifos function.
+ *
+ * Discards data buffered in either direction. Discarded TX data is credited back to the host,
+ * since it will never drain.
+ */
+static void gb_uart_flush_fifos(const void *priv, struct gb_message *req, uint16_t cport)
 {
-	const struct device *dev = priv;
-
-	switch (gb_message_type(msg)) {
-	case GB_UART_TYPE_SEND_DATA:
-		return gb_uart_send_data(cport, msg, dev);
-	case GB_UART_TYPE_SET_LINE_CODING:
-		return gb_uart_set_line_coding(cport, msg, dev);
-	case GB_UART_TYPE_SET_CONTROL_LINE_STATE:
-		return gb_uart_set_control_line_state(cport, msg, dev);
-	case GB_UART_TYPE_SEND_BREAK:
-		return gb_uart_send_break(cport, msg, dev);
-	case GB_UART_TYPE_FLUSH_FIFOS:
-		/* Since I am not doing any internal buffering, this is not implemented. */
-		return gb_transport_message_empty_response_send(msg, GB_OP_SUCCESS, cport);
-	default:
-		LOG_ERR("Invalid type");
-		return gb_transport_message_empty_response_send(msg, GB_OP_PROTOCOL_BAD, cport);
+	struct gb_uart_driver_data *data = (struct gb_uart_driver_data *)priv;
+	uint32_t len;
+	k_spinlock_key_t key;
+	const struct gb_uart_serial_flush_request *req_data =
+		(const struct gb_uart_serial_flush_request *)req->payload;
+
+	if (req_data->flags & GB_SERIAL_FLAG_FLUSH_TRANSMITTER) {
+		key = k_spin_lock(&data->tx_lock);
+		len = ring_buf_size_get(&data->tx_rb);
+		ring_buf_reset(&data->tx_rb);
+		k_spin_unlock(&data->tx_lock, key);
+
+		if (len) {
+			atomic_add(&data->tx_credits, len);
+			k_work_schedule(&data->credits_work, K_NO_WAIT);
+		}
+
+		/* A write waiting for room drops the rest as well */
+		atomic_inc(&data->tx_cancel);
+		k_sem_give(&data->tx_space);
+	}
+
+	if (req_data->flags & GB_SERIAL_FLAG_FLUSH_RECEIVER) {
+		key = k_spin_lock(&data->rx_lock);
+		ring_buf_reset(&data->rx_rb);
+		k_spin_unlock(&data->rx_lock, key);
+
+		if (atomic_cas(&data->rx_stalled, 1, 0)) {
+			uart_irq_rx_enable(data->dev);
+		}
 	}
+
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
 }
 
+static const struct gb_operation_entry gb_uart_ops[] = {
+	GB_OPERATION(GB_UART_TYPE_SEND_DATA, gb_uart_send_data,
+		     sizeof(struct gb_uart_send_data_request)),
+	GB_OPERATION(GB_UART_TYPE_SET_LINE_CODING, gb_uart_set_line_coding,
+		     sizeof(struct gb_uart_set_line_coding_request)),
+	GB_OPERATION(GB_UART_TYPE_SET_CONTROL_LINE_STATE, gb_uart_set_control_line_state,
+		     sizeof(struct gb_uart_set_control_line_state_request)),
+	GB_OPERATION(GB_UART_TYPE_SEND_BREAK, gb_uart_send_break,
+		     sizeof(struct gb_uart_set_break_request)),
+	GB_OPERATION(GB_UART_TYPE_FLUSH_FIFOS, gb_uart_flush_fifos,
+		     sizeof(struct gb_uart_serial_flush_request)),
+};
+
 static void gb_uart_connected(const void *priv, uint16_t cport)
 {
-	const struct device *dev = priv;
-
-	uart_irq_callback_user_data_set(dev, uart_irq_cb, UINT_TO_POINTER(cport));
-	uart_irq_rx_enable(dev);
+	struct gb_uart_driver_data *data = (struct gb_uart_driver_data *)priv;
+
+	data->cport = cport;
+	ring_buf_init(&data->tx_rb, sizeof(data->tx_buf), data->tx_buf);
+	k_sem_init(&data->tx_space, 0, 1);
+	k_work_init_delayable(&data->credits_work, gb_uart_credits_work_handler);
+	atomic_clear(&data->tx_credits);
+	atomic_set(&data->connected, 1);
+	ring_buf_init(&data->rx_rb, sizeof(data->rx_buf), data->rx_buf);
+	atomic_clear(&data->rx_stalled);
+#ifdef CONFIG_GREYBUS_UART_RX_PUMP
+	k_timer_init(&data->rx_idle_timer, gb_uart_rx_idle_expiry, NULL);
+	atomic_clear(&data->rx_ready);
+
+	k_mutex_lock(&gb_uart_rx_ports_lock, K_FOREVER);
+	if (!sys_slist_find_and_remove(&gb_uart_rx_ports, &data->rx_node)) {
+		gb_uart_rx_ports_num++;
+	}
+	sys_slist_append(&gb_uart_rx_ports, &data->rx_node);
+	k_mutex_unlock(&gb_uart_rx_ports_lock);
+#else
+	k_work_init_delayable(&data->rx_work, gb_uart_rx_work_handler);
+#endif // CONFIG_GREYBUS_UART_RX_PUMP
+
+	uart_irq_callback_user_data_set(data->dev, uart_irq_cb, data);
+	uart_irq_rx_enable(data->dev);
 }
 
 static void gb_uart_disconnected(const void *priv)
 {
+	struct gb_uart_driver_data *data = (struct gb_uart_driver_data *)priv;
+	k_spinlock_key_t key;
 
-	const struct device *dev = priv;
+	uart_irq_rx_disable(data->dev);
+	uart_irq_tx_disable(data->dev);
 
-	uart_irq_rx_disable(dev);
+	key = k_spin_lock(&data->tx_lock);
+	ring_buf_reset(&data->tx_rb);
+	k_spin_unlock(&data->tx_lock, key);
+
+	/* Frees the lane from a write waiting for room that will never come */
+	atomic_clear(&data->connected);
+	atomic_inc(&data->tx_cancel);
+	k_sem_give(&data->tx_space);
+
+	k_work_cancel_delayable(&data->credits_work);
+#ifdef CONFIG_GREYBUS_UART_RX_PUMP
+	k_timer_stop(&data->rx_idle_timer);
+
+	/* Waits for a receive cycle serving this UART to finish */
+	k_mutex_lock(&gb_uart_rx_ports_lock, K_FOREVER);
+	if (sys_slist_find_and_remove(&gb_uart_rx_ports, &data->rx_node)) {
+		gb_uart_rx_ports_num--;
+	}
+	k_mutex_unlock(&gb_uart_rx_ports_lock);
+	atomic_clear(&data->rx_ready);
+#else
+	k_work_cancel_delayable(&data->rx_work);
+#endif // CONFIG_GREYBUS_UART_RX_PUMP
+
+	key = k_spin_lock(&data->rx_lock);
+	ring_buf_reset(&data->rx_rb);
+	k_spin_unlock(&data->rx_lock, key);
 }
 
 const struct gb_driver gb_uart_driver = {
-	.op_handler = gb_uart_handler,
+	GB_OPERATIONS(gb_uart_ops),
 	.connected = gb_uart_connected,
 	.disconnected = gb_uart_disconnected,
 };
@@ -28,133 +28,813 @@
  * Author: Fabien Parent <fparent@baylibre.com>
  */
 
-#include <sys/byteorder.h>
-#include <greybus/greybus.h>
-#include <usb.h>
-#include "usb-gb.h"
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
+#include <zephyr/drivers/usb/uhc.h>
+#include <zephyr/init.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/usb/usb_ch9.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/greybus_messages.h>
+#include <greybus-utils/manifest.h>
+#include "greybus-manifest.h"
+#include "greybus_cport.h"
+#include "greybus_transport.h"
+#include "greybus_internal.h"
+#include "greybus_usb.h"
+
 LOG_MODULE_REGISTER(greybus_usb, CONFIG_GREYBUS_LOG_LEVEL);
 
-static struct device *usbdev;
+BUILD_ASSERT(CONFIG_GREYBUS_USB_DEVICES <= 32, "devices_used is a 32 bit mask");
+
+/* Root hub requests, (bmRequestType << 8) | bRequest */
+#define GB_USB_HUB_CLEAR_HUB_FEATURE  0x2001
+#define GB_USB_HUB_SET_HUB_FEATURE    0x2003
+#define GB_USB_HUB_CLEAR_PORT_FEATURE 0x2301
+#define GB_USB_HUB_SET_PORT_FEATURE   0x2303
+#define GB_USB_HUB_GET_HUB_STATUS     0xa000
+#define GB_USB_HUB_GET_DESCRIPTOR     0xa006
+#define GB_USB_HUB_GET_PORT_STATUS    0xa300
+
+#define GB_USB_HUB_DESC_TYPE 0x29
+
+/* Port status bits */
+#define GB_USB_PORT_STAT_CONNECTION BIT(0)
+#define GB_USB_PORT_STAT_ENABLE     BIT(1)
+#define GB_USB_PORT_STAT_SUSPEND    BIT(2)
+#define GB_USB_PORT_STAT_RESET      BIT(4)
+#define GB_USB_PORT_STAT_POWER      BIT(8)
+#define GB_USB_PORT_STAT_LOW_SPEED  BIT(9)
+#define GB_USB_PORT_STAT_HIGH_SPEED BIT(10)
+
+/* Port features, change features map to bit (feature - C_CONNECTION) of the change word */
+#define GB_USB_PORT_FEAT_ENABLE       1
+#define GB_USB_PORT_FEAT_SUSPEND      2
+#define GB_USB_PORT_FEAT_RESET        4
+#define GB_USB_PORT_FEAT_POWER        8
+#define GB_USB_PORT_FEAT_C_CONNECTION 16
+#define GB_USB_PORT_FEAT_C_SUSPEND    18
+#define GB_USB_PORT_FEAT_C_RESET      20
 
-static uint8_t gb_usb_protocol_version(struct gb_operation *operation)
+#define GB_USB_PORT_CHANGE(feature) BIT((feature) - GB_USB_PORT_FEAT_C_CONNECTION)
+
+/* Largest IN URB whose completion fits in a single completion request */
+#define GB_USB_URB_IN_MAX                                                                          \
+	(CONFIG_GREYBUS_USB_COMPLETE_SIZE - sizeof(struct gb_usb_urb_complete_request) -          \
+	 sizeof(struct gb_usb_urb_completion))
+
+/* Single port hub, individual port power switching and over-current protection */
+static const uint8_t gb_usb_hub_desc[] = {
+	9, GB_USB_HUB_DESC_TYPE, 1, 0x11, 0x00, 1, 0, 0x00, 0xff,
+};
+
+static inline bool gb_usb_urb_is_in(const struct gb_usb_urb *urb)
 {
-	struct gb_usb_proto_version_response *response;
+	return USB_EP_DIR_IS_IN(urb->ep);
+}
 
-	response = gb_operation_alloc_response(operation, sizeof(*response));
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+static struct usb_device *gb_usb_device_get(struct gb_usb_driver_data *data, uint8_t devnum)
+{
+	struct usb_device *udev;
+	int free = -1;
+
+	for (int i = 0; i < ARRAY_SIZE(data->devices); i++) {
+		if (!(data->devices_used & BIT(i))) {
+			free = (free < 0) ? i : free;
+			continue;
+		}
+
+		if (data->devices[i].addr == devnum) {
+			return &data->devices[i];
+		}
+	}
+
+	if (free < 0) {
+		return NULL;
+	}
+
+	udev = &data->devices[free];
+	udev->addr = devnum;
+	if (data->port_status & GB_USB_PORT_STAT_HIGH_SPEED) {
+		udev->speed = USB_SPEED_SPEED_HS;
+	} else if (data->port_status & GB_USB_PORT_STAT_LOW_SPEED) {
+		udev->speed = USB_SPEED_SPEED_LS;
+	} else {
+		udev->speed = USB_SPEED_SPEED_FS;
 	}
+	data->devices_used |= BIT(free);
 
-	response->major = GB_USB_VERSION_MAJOR;
-	response->minor = GB_USB_VERSION_MINOR;
-	return GB_OP_SUCCESS;
+	return udev;
 }
 
-static uint8_t gb_usb_hcd_stop(struct gb_operation *operation)
+/* Forget devices that no longer have URBs, the AP enumerates them again on reconnect */
+static void gb_usb_devices_release(struct gb_usb_driver_data *data)
 {
-	LOG_DBG("%s()", __func__);
+	for (int i = 0; i < ARRAY_SIZE(data->devices); i++) {
+		bool busy = false;
 
-	device_usb_hcd_stop(usbdev);
+		for (int j = 0; j < ARRAY_SIZE(data->eps); j++) {
+			busy |= data->eps[j].udev == &data->devices[i];
+		}
 
-	return GB_OP_SUCCESS;
+		if (!busy) {
+			data->devices_used &= ~BIT(i);
+		}
+	}
 }
 
-static uint8_t gb_usb_hcd_start(struct gb_operation *operation)
+static struct gb_usb_ep *gb_usb_ep_get(struct gb_usb_driver_data *data, struct usb_device *udev,
+				       const struct gb_usb_urb *urb)
 {
-	int retval;
+	/* Both directions of the default control pipe share a queue */
+	const uint8_t addr = (urb->type == GB_USB_URB_TYPE_CONTROL) ? 0 : urb->ep;
+	struct gb_usb_ep *free = NULL;
+
+	for (int i = 0; i < ARRAY_SIZE(data->eps); i++) {
+		struct gb_usb_ep *ep = &data->eps[i];
 
-	LOG_DBG("%s()", __func__);
+		if (!ep->udev) {
+			free = free ? free : ep;
+		} else if (ep->udev == udev && ep->addr == addr) {
+			return ep;
+		}
+	}
 
-	retval = device_usb_hcd_start(usbdev);
-	if (retval) {
-		return GB_OP_UNKNOWN_ERROR;
+	if (free) {
+		sys_slist_init(&free->pending);
+		free->inflight = NULL;
+		free->udev = udev;
+		free->addr = addr;
+		free->type = urb->type;
+		free->urbs = 0;
 	}
 
-	return GB_OP_SUCCESS;
+	return free;
+}
+
+static void gb_usb_urb_complete(struct gb_usb_driver_data *data, struct gb_usb_urb_ctx *ctx,
+				int status)
+{
+	ctx->status = status;
+	sys_slist_append(&data->done, &ctx->node);
+	k_work_submit(&data->tx_work);
+}
+
+static void gb_usb_urb_free(struct gb_usb_driver_data *data, struct gb_usb_urb_ctx *ctx)
+{
+	if (ctx->xfer) {
+		if (ctx->xfer->buf) {
+			uhc_xfer_buf_free(data->dev, ctx->xfer->buf);
+		}
+		uhc_xfer_free(data->dev, ctx->xfer);
+		ctx->xfer = NULL;
+	}
+
+	if (ctx->ep && --ctx->ep->urbs == 0) {
+		ctx->ep->udev = NULL;
+	}
+
+	ctx->ep = NULL;
+	sys_slist_append(&data->free_urbs, &ctx->node);
+}
+
+/* Hand the next URB of an idle endpoint to the controller */
+static void gb_usb_ep_kick(struct gb_usb_driver_data *data, struct gb_usb_ep *ep)
+{
+	struct gb_usb_urb_ctx *ctx;
+	int ret;
+
+	while (!ep->inflight && !sys_slist_is_empty(&ep->pending)) {
+		ctx = SYS_SLIST_CONTAINER(sys_slist_get(&ep->pending), ctx, node);
+		ep->inflight = ctx;
+
+		ret = uhc_ep_enqueue(data->dev, ctx->xfer);
+		if (ret < 0) {
+			LOG_ERR("Failed to enqueue URB %u: %d", ctx->id, ret);
+			ep->inflight = NULL;
+			gb_usb_urb_complete(data, ctx, ret);
+		}
+	}
+}
+
+/*
+ * Control and interrupt endpoints carry little data with latency requirements, so they are served
+ * before bulk endpoints. Bulk endpoints are served round robin, so that a mass storage stream
+ * does not delay the other bulk endpoints either.
+ */
+static void gb_usb_schedule(struct gb_usb_driver_data *data)
+{
+	const size_t eps = ARRAY_SIZE(data->eps);
+	bool served = false;
+
+	if (!data->started) {
+		return;
+	}
+
+	for (size_t i = 0; i < eps; i++) {
+		if (data->eps[i].udev && data->eps[i].type != GB_USB_URB_TYPE_BULK) {
+			gb_usb_ep_kick(data, &data->eps[i]);
+		}
+	}
+
+	for (size_t n = 0; n < eps; n++) {
+		const size_t i = (data->next_bulk + n) % eps;
+		struct gb_usb_ep *ep = &data->eps[i];
+
+		if (!ep->udev || ep->type != GB_USB_URB_TYPE_BULK || ep->inflight ||
+		    sys_slist_is_empty(&ep->pending)) {
+			continue;
+		}
+
+		gb_usb_ep_kick(data, ep);
+		if (!served) {
+			data->next_bulk = (i + 1) % eps;
+			served = true;
+		}
+	}
 }
 
-static uint8_t gb_usb_hub_control(struct gb_operation *operation)
+/* Drop everything queued to the controller, URBs are completed with -ESHUTDOWN */
+static void gb_usb_stop(struct gb_usb_driver_data *data)
 {
-	struct gb_usb_hub_control_response *response;
-	struct gb_usb_hub_control_request *request = gb_operation_get_request_payload(operation);
-	uint16_t typeReq;
-	uint16_t wValue;
-	uint16_t wIndex;
-	uint16_t wLength;
-	int status;
+	struct gb_usb_urb_ctx *ctx;
+	int ret;
 
-	if (gb_operation_get_request_payload_size(operation) < sizeof(*request)) {
-		return GB_OP_INVALID;
+	if (!data->started) {
+		return;
 	}
 
-	typeReq = sys_le16_to_cpu(request->typeReq);
-	wValue = sys_le16_to_cpu(request->wValue);
-	wIndex = sys_le16_to_cpu(request->wIndex);
-	wLength = sys_le16_to_cpu(request->wLength);
+	data->started = false;
+
+	for (int i = 0; i < ARRAY_SIZE(data->eps); i++) {
+		struct gb_usb_ep *ep = &data->eps[i];
+
+		if (!ep->udev) {
+			continue;
+		}
 
-	response = gb_operation_alloc_response(operation, sizeof(*response) + wLength);
-	if (!response) {
-		return GB_OP_NO_MEMORY;
+		while (!sys_slist_is_empty(&ep->pending)) {
+			ctx = SYS_SLIST_CONTAINER(sys_slist_get(&ep->pending), ctx, node);
+			gb_usb_urb_complete(data, ctx, -ESHUTDOWN);
+		}
+
+		if (ep->inflight) {
+			ep->inflight->unlinked = true;
+			uhc_ep_dequeue(data->dev, ep->inflight->xfer);
+		}
 	}
 
-	LOG_DBG("%s(%hX, %hX, %hX, %hX)", __func__, typeReq, wValue, wIndex, wLength);
+	ret = uhc_disable(data->dev);
+	if (ret < 0 && ret != -EALREADY) {
+		LOG_ERR("Failed to disable controller: %d", ret);
+	}
 
-	status = device_usb_hcd_hub_control(usbdev, typeReq, wValue, wIndex, (char *)response->buf,
-					    wLength);
-	if (status) {
-		return GB_OP_UNKNOWN_ERROR;
+	data->port_status &= GB_USB_PORT_STAT_CONNECTION | GB_USB_PORT_STAT_LOW_SPEED |
+			     GB_USB_PORT_STAT_HIGH_SPEED;
+	gb_usb_devices_release(data);
+}
+
+/* Called by the controller driver when a transfer is returned */
+static void gb_usb_xfer_done(struct gb_usb_driver_data *data, struct uhc_transfer *xfer)
+{
+	struct gb_usb_urb_ctx *ctx = xfer->priv;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	if (!ctx || ctx->xfer != xfer || !ctx->ep || ctx->ep->inflight != ctx) {
+		LOG_WRN("Ignoring stale transfer");
+		goto out;
 	}
 
-	return GB_OP_SUCCESS;
+	ctx->ep->inflight = NULL;
+
+	if (ctx->in) {
+		ctx->actual_length = xfer->buf ? MIN(xfer->buf->len, ctx->length) : 0;
+	} else {
+		ctx->actual_length = xfer->err ? 0 : ctx->length;
+	}
+
+	gb_usb_urb_complete(data, ctx, ctx->unlinked ? -ECONNRESET : xfer->err);
+
+out:
+	k_mutex_unlock(&data->lock);
 }
 
-static int gb_usb_init(unsigned int cport, struct gb_bundle *bundle)
+static int gb_usb_event_cb(const struct device *dev, const struct uhc_event *const event)
 {
-	usbdev = device_open(DEVICE_TYPE_USB_HCD, 0);
-	if (!usbdev) {
-		return -ENODEV;
+	struct gb_usb_driver_data *data = uhc_get_event_ctx(dev);
+	uint16_t speed = 0;
+
+	if (event->type == UHC_EVT_EP_REQUEST) {
+		gb_usb_xfer_done(data, event->xfer);
+		return 0;
+	}
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	switch (event->type) {
+	case UHC_EVT_DEV_CONNECTED_LS:
+	case UHC_EVT_DEV_CONNECTED_FS:
+	case UHC_EVT_DEV_CONNECTED_HS:
+		if (event->type == UHC_EVT_DEV_CONNECTED_LS) {
+			speed = GB_USB_PORT_STAT_LOW_SPEED;
+		} else if (event->type == UHC_EVT_DEV_CONNECTED_HS) {
+			speed = GB_USB_PORT_STAT_HIGH_SPEED;
+		}
+		data->port_status |= GB_USB_PORT_STAT_CONNECTION | speed;
+		data->port_change |= GB_USB_PORT_CHANGE(GB_USB_PORT_FEAT_C_CONNECTION);
+		break;
+	case UHC_EVT_DEV_REMOVED:
+		data->port_status &= GB_USB_PORT_STAT_POWER;
+		data->port_change |= GB_USB_PORT_CHANGE(GB_USB_PORT_FEAT_C_CONNECTION);
+		gb_usb_devices_release(data);
+		break;
+	case UHC_EVT_RESETED:
+		data->port_status &= ~GB_USB_PORT_STAT_RESET;
+		data->port_status |= GB_USB_PORT_STAT_ENABLE;
+		data->port_change |= GB_USB_PORT_CHANGE(GB_USB_PORT_FEAT_C_RESET);
+		uhc_sof_enable(dev);
+		break;
+	case UHC_EVT_SUSPENDED:
+		data->port_status |= GB_USB_PORT_STAT_SUSPEND;
+		break;
+	case UHC_EVT_RESUMED:
+	case UHC_EVT_RWUP:
+		if (data->port_status & GB_USB_PORT_STAT_SUSPEND) {
+			data->port_status &= ~GB_USB_PORT_STAT_SUSPEND;
+			data->port_change |= GB_USB_PORT_CHANGE(GB_USB_PORT_FEAT_C_SUSPEND);
+		}
+		break;
+	case UHC_EVT_ERROR:
+		LOG_ERR("Controller error: %d", event->status);
+		break;
+	default:
+		break;
 	}
 
+	k_mutex_unlock(&data->lock);
+
 	return 0;
 }
 
-static void gb_usb_exit(unsigned int cport, struct gb_bundle *bundle)
+/* Send completed URBs to the AP, as many as fit in each completion request */
+static void gb_usb_tx_work_handler(struct k_work *work)
 {
-	if (usbdev) {
-		device_close(usbdev);
+	struct gb_usb_driver_data *data = CONTAINER_OF(work, struct gb_usb_driver_data, tx_work);
+	struct gb_usb_urb_complete_request *req_data;
+	struct gb_usb_urb_completion *completion;
+	struct gb_usb_urb_ctx *ctx;
+	struct gb_message *msg;
+	size_t len, entry, off;
+	uint8_t count;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	while (!sys_slist_is_empty(&data->done)) {
+		len = sizeof(*req_data);
+		count = 0;
+
+		SYS_SLIST_FOR_EACH_CONTAINER(&data->done, ctx, node) {
+			entry = sizeof(*completion) + (ctx->in ? ctx->actual_length : 0);
+			if (len + entry > CONFIG_GREYBUS_USB_COMPLETE_SIZE || count == UINT8_MAX) {
+				break;
+			}
+			len += entry;
+			count++;
+		}
+
+		msg = data->started
+			      ? gb_message_request_alloc(len, GB_USB_TYPE_VENDOR_URB_COMPLETE, true)
+			      : NULL;
+		if (data->started && !msg) {
+			/* Retried on the next completion */
+			LOG_ERR("Failed to allocate URB completion");
+			break;
+		}
+
+		off = 0;
+		for (uint8_t i = 0; i < count; i++) {
+			ctx = SYS_SLIST_CONTAINER(sys_slist_get(&data->done), ctx, node);
+
+			if (msg) {
+				req_data = (struct gb_usb_urb_complete_request *)msg->payload;
+				completion = (struct gb_usb_urb_completion *)&req_data->urbs[off];
+				completion->id = sys_cpu_to_le16(ctx->id);
+				completion->actual_length = sys_cpu_to_le16(ctx->actual_length);
+				completion->status = sys_cpu_to_le32(ctx->status);
+				off += sizeof(*completion);
+
+				if (ctx->in && ctx->actual_length) {
+					memcpy(completion->data, ctx->xfer->buf->data,
+					       ctx->actual_length);
+					off += ctx->actual_length;
+				}
+			}
+
+			gb_usb_urb_free(data, ctx);
+		}
+
+		if (!msg) {
+			continue;
+		}
+
+		req_data = (struct gb_usb_urb_complete_request *)msg->payload;
+		req_data->count = count;
+
+		k_mutex_unlock(&data->lock);
+		gb_transport_message_send(msg, data->cport);
+		gb_message_dealloc(msg);
+		k_mutex_lock(&data->lock, K_FOREVER);
 	}
+
+	/* Freed URBs may have unblocked their endpoint */
+	gb_usb_schedule(data);
+
+	k_mutex_unlock(&data->lock);
 }
 
-static uint8_t gb_usb_handler(uint8_t type, struct gb_operation *opr)
+static void gb_usb_hcd_start(uint16_t cport, struct gb_message *req,
+			     struct gb_usb_driver_data *data)
 {
-	switch (type) {
-	case GB_USB_TYPE_PROTOCOL_VERSION:
-		return gb_usb_protocol_version(opr);
-	case GB_USB_TYPE_HCD_STOP:
-		return gb_usb_hcd_stop(opr);
+	int ret;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	ret = uhc_enable(data->dev);
+	if (ret == -EALREADY) {
+		ret = 0;
+	}
+
+	data->started = (ret == 0);
+
+	k_mutex_unlock(&data->lock);
+
+	if (ret < 0) {
+		LOG_ERR("Failed to enable controller: %d", ret);
+	}
+
+	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
+}
+
+static void gb_usb_hcd_stop(uint16_t cport, struct gb_message *req,
+			    struct gb_usb_driver_data *data)
+{
+	k_mutex_lock(&data->lock, K_FOREVER);
+	gb_usb_stop(data);
+	k_mutex_unlock(&data->lock);
+
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+
+static int gb_usb_port_set_feature(struct gb_usb_driver_data *data, uint16_t feature)
+{
+	int ret;
+
+	switch (feature) {
+	case GB_USB_PORT_FEAT_POWER:
+		data->port_status |= GB_USB_PORT_STAT_POWER;
+		return 0;
+	case GB_USB_PORT_FEAT_RESET:
+		ret = uhc_bus_reset(data->dev);
+		if (ret == 0) {
+			data->port_status &= ~GB_USB_PORT_STAT_ENABLE;
+			data->port_status |= GB_USB_PORT_STAT_RESET;
+		}
+		return ret;
+	case GB_USB_PORT_FEAT_SUSPEND:
+		ret = uhc_bus_suspend(data->dev);
+		if (ret == 0) {
+			data->port_status |= GB_USB_PORT_STAT_SUSPEND;
+		}
+		return ret;
+	default:
+		/* Indicator and test modes are not supported, nothing to do */
+		return 0;
+	}
+}
+
+static int gb_usb_port_clear_feature(struct gb_usb_driver_data *data, uint16_t feature)
+{
+	if (feature >= GB_USB_PORT_FEAT_C_CONNECTION && feature <= GB_USB_PORT_FEAT_C_RESET) {
+		data->port_change &= ~GB_USB_PORT_CHANGE(feature);
+		return 0;
+	}
+
+	switch (feature) {
+	case GB_USB_PORT_FEAT_ENABLE:
+		data->port_status &= ~GB_USB_PORT_STAT_ENABLE;
+		return 0;
+	case GB_USB_PORT_FEAT_SUSPEND:
+		return uhc_bus_resume(data->dev);
+	case GB_USB_PORT_FEAT_POWER:
+		data->port_status &= ~GB_USB_PORT_STAT_POWER;
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+/* Requests to the root hub, emulated as a hub with a single port driven by the controller */
+static void gb_usb_hub_control(uint16_t cport, struct gb_message *req,
+			       struct gb_usb_driver_data *data)
+{
+	const struct gb_usb_hub_control_request *req_data =
+		(const struct gb_usb_hub_control_request *)req->payload;
+	uint8_t buf[sizeof(gb_usb_hub_desc)] = {0};
+	uint16_t type_req, value, index;
+	size_t len = 0;
+	int ret = 0;
+
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	type_req = sys_le16_to_cpu(req_data->typeReq);
+	value = sys_le16_to_cpu(req_data->wValue);
+	index = sys_le16_to_cpu(req_data->wIndex);
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	switch (type_req) {
+	case GB_USB_HUB_GET_DESCRIPTOR:
+		if ((value >> 8) != GB_USB_HUB_DESC_TYPE) {
+			ret = -EINVAL;
+			break;
+		}
+		memcpy(buf, gb_usb_hub_desc, sizeof(gb_usb_hub_desc));
+		len = sizeof(gb_usb_hub_desc);
+		break;
+	case GB_USB_HUB_GET_HUB_STATUS:
+		len = 4;
+		break;
+	case GB_USB_HUB_GET_PORT_STATUS:
+		if (index != 1) {
+			ret = -EINVAL;
+			break;
+		}
+		sys_put_le16(data->port_status, &buf[0]);
+		sys_put_le16(data->port_change, &buf[2]);
+		len = 4;
+		break;
+	case GB_USB_HUB_SET_HUB_FEATURE:
+	case GB_USB_HUB_CLEAR_HUB_FEATURE:
+		break;
+	case GB_USB_HUB_SET_PORT_FEATURE:
+		ret = (index == 1) ? gb_usb_port_set_feature(data, value) : -EINVAL;
+		break;
+	case GB_USB_HUB_CLEAR_PORT_FEATURE:
+		ret = (index == 1) ? gb_usb_port_clear_feature(data, value) : -EINVAL;
+		break;
+	default:
+		LOG_WRN("Unsupported hub request 0x%04x", type_req);
+		ret = -ENOTSUP;
+	}
+
+	k_mutex_unlock(&data->lock);
+
+	if (ret < 0) {
+		return gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret),
+								cport);
+	}
+
+	gb_transport_message_response_success_send(
+		req, buf, MIN(len, sys_le16_to_cpu(req_data->wLength)), cport);
+}
+
+static int gb_usb_urb_queue(struct gb_usb_driver_data *data, struct gb_usb_urb_ctx *ctx,
+			    const struct gb_usb_urb *urb)
+{
+	struct usb_device *udev;
+	struct net_buf *buf;
+
+	ctx->id = sys_le16_to_cpu(urb->id);
+	ctx->length = sys_le16_to_cpu(urb->length);
+	ctx->actual_length = 0;
+	ctx->in = gb_usb_urb_is_in(urb);
+	ctx->unlinked = false;
+	ctx->xfer = NULL;
+	ctx->ep = NULL;
+
+	udev = gb_usb_device_get(data, urb->devnum);
+	if (!udev) {
+		return -ENOMEM;
+	}
+
+	ctx->ep = gb_usb_ep_get(data, udev, urb);
+	if (!ctx->ep) {
+		return -ENOMEM;
+	}
+	ctx->ep->urbs++;
+
+	ctx->xfer = uhc_xfer_alloc(data->dev, urb->ep, udev, NULL, ctx);
+	if (!ctx->xfer) {
+		return -ENOMEM;
+	}
+
+	ctx->xfer->mps = sys_le16_to_cpu(urb->mps);
+	ctx->xfer->type = urb->type;
+	if (urb->type == GB_USB_URB_TYPE_CONTROL) {
+		memcpy(ctx->xfer->setup_pkt, urb->setup, sizeof(urb->setup));
+	}
+
+	if (ctx->length) {
+		buf = uhc_xfer_buf_alloc(data->dev, ctx->length);
+		if (!buf) {
+			return -ENOMEM;
+		}
+
+		if (!ctx->in) {
+			net_buf_add_mem(buf, urb->data, ctx->length);
+		}
+
+		uhc_xfer_buf_add(data->dev, ctx->xfer, buf);
+	}
+
+	sys_slist_append(&ctx->ep->pending, &ctx->node);
+
+	return 0;
+}
+
+/*
+ * Several URBs can be submitted in one request. They are queued together and completed
+ * asynchronously, possibly in a different order across endpoints.
+ */
+static void gb_usb_urb_submit(uint16_t cport, struct gb_message *req,
+			      struct gb_usb_driver_data *data)
+{
+	const struct gb_usb_urb_submit_request *req_data =
+		(const struct gb_usb_urb_submit_request *)req->payload;
+	const size_t req_len = gb_message_payload_len(req);
+	const struct gb_usb_urb *urb;
+	struct gb_usb_urb_ctx *ctx;
+	size_t off, len;
+	uint8_t ret = GB_OP_SUCCESS;
+	int err;
+
+	if (req_len < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	/* Validate the whole batch first, so that a bad request does not queue anything */
+	off = sizeof(*req_data);
+	for (uint8_t i = 0; i < req_data->count; i++) {
+		if (off + sizeof(*urb) > req_len) {
+			LOG_ERR("dropping short message");
+			return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+		}
+
+		urb = (const struct gb_usb_urb *)&req->payload[off];
+		len = sys_le16_to_cpu(urb->length);
+		off += sizeof(*urb) + (gb_usb_urb_is_in(urb) ? 0 : len);
+
+		if (off > req_len || (gb_usb_urb_is_in(urb) && len > GB_USB_URB_IN_MAX)) {
+			LOG_ERR("Invalid URB length %zu", len);
+			return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+		}
+	}
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	if (!data->started) {
+		ret = GB_OP_INVALID;
+		goto out;
+	}
+
+	if (sys_slist_len(&data->free_urbs) < req_data->count) {
+		ret = GB_OP_NO_MEMORY;
+		goto out;
+	}
+
+	off = sizeof(*req_data);
+	for (uint8_t i = 0; i < req_data->count; i++) {
+		urb = (const struct gb_usb_urb *)&req->payload[off];
+		off += sizeof(*urb) + (gb_usb_urb_is_in(urb) ? 0 : sys_le16_to_cpu(urb->length));
+
+		ctx = SYS_SLIST_CONTAINER(sys_slist_get(&data->free_urbs), ctx, node);
+		err = gb_usb_urb_queue(data, ctx, urb);
+		if (err < 0) {
+			LOG_ERR("Failed to queue URB %u: %d", ctx->id, err);
+			gb_usb_urb_complete(data, ctx, err);
+		}
+	}
+
+	gb_usb_schedule(data);
+
+out:
+	k_mutex_unlock(&data->lock);
+	gb_transport_message_empty_response_send(req, ret, cport);
+}
+
+static void gb_usb_urb_dequeue(uint16_t cport, struct gb_message *req,
+			       struct gb_usb_driver_data *data)
+{
+	const struct gb_usb_urb_dequeue_request *req_data =
+		(const struct gb_usb_urb_dequeue_request *)req->payload;
+	struct gb_usb_urb_ctx *ctx;
+	uint16_t id;
+
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	id = sys_le16_to_cpu(req_data->id);
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+
+	for (int i = 0; i < ARRAY_SIZE(data->urbs); i++) {
+		ctx = &data->urbs[i];
+		if (!ctx->ep || ctx->id != id) {
+			continue;
+		}
+
+		if (ctx->ep->inflight == ctx) {
+			/* Completed as -ECONNRESET once the controller returns it */
+			ctx->unlinked = true;
+			uhc_ep_dequeue(data->dev, ctx->xfer);
+		} else if (sys_slist_find_and_remove(&ctx->ep->pending, &ctx->node)) {
+			gb_usb_urb_complete(data, ctx, -ECONNRESET);
+		}
+	}
+
+	k_mutex_unlock(&data->lock);
+
+	/* An URB that already completed is not an error, its completion is on the way */
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+
+static void gb_usb_handler(const void *priv, struct gb_message *msg, uint16_t cport)
+{
+	struct gb_usb_driver_data *data = (struct gb_usb_driver_data *)priv;
+
+	switch (gb_message_type(msg)) {
 	case GB_USB_TYPE_HCD_START:
-		return gb_usb_hcd_start(opr);
+		return gb_usb_hcd_start(cport, msg, data);
+	case GB_USB_TYPE_HCD_STOP:
+		return gb_usb_hcd_stop(cport, msg, data);
 	case GB_USB_TYPE_HUB_CONTROL:
-		return gb_usb_hub_control(opr);
+		return gb_usb_hub_control(cport, msg, data);
+	case GB_USB_TYPE_VENDOR_URB_SUBMIT:
+		return gb_usb_urb_submit(cport, msg, data);
+	case GB_USB_TYPE_VENDOR_URB_DEQUEUE:
+		return gb_usb_urb_dequeue(cport, msg, data);
 	default:
 		LOG_ERR("Invalid type");
-		return GB_OP_INVALID;
+		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
 	}
 }
 
-struct gb_driver usb_driver = {
-	.init = gb_usb_init,
-	.exit = gb_usb_exit,
+static void gb_usb_connected(const void *priv, uint16_t cport)
+{
+	struct gb_usb_driver_data *data = (struct gb_usb_driver_data *)priv;
+
+	data->cport = cport;
+}
+
+static void gb_usb_disconnected(const void *priv)
+{
+	struct gb_usb_driver_data *data = (struct gb_usb_driver_data *)priv;
+
+	k_mutex_lock(&data->lock, K_FOREVER);
+	gb_usb_stop(data);
+	k_mutex_unlock(&data->lock);
+}
+
+const struct gb_driver gb_usb_driver = {
+	.connected = gb_usb_connected,
+	.disconnected = gb_usb_disconnected,
 	.op_handler = gb_usb_handler,
 };
 
-void gb_usb_register(int cport, int bundle)
+static int gb_usb_init(void)
 {
-	gb_register_driver(cport, bundle, &usb_driver);
+	const struct gb_cport *cport;
+	struct gb_usb_driver_data *data;
+	int ret;
+
+	for (uint16_t i = 0; i < GREYBUS_CPORT_COUNT; i++) {
+		cport = gb_cport_get(i);
+		if (cport->protocol != GREYBUS_PROTOCOL_USB) {
+			continue;
+		}
+
+		data = (struct gb_usb_driver_data *)cport->priv;
+		k_mutex_init(&data->lock);
+		k_work_init(&data->tx_work, gb_usb_tx_work_handler);
+		sys_slist_init(&data->free_urbs);
+		sys_slist_init(&data->done);
+		for (int j = 0; j < ARRAY_SIZE(data->urbs); j++) {
+			sys_slist_append(&data->free_urbs, &data->urbs[j].node);
+		}
+
+		ret = uhc_init(data->dev, gb_usb_event_cb, data);
+		if (ret < 0) {
+			LOG_ERR("Failed to initialize %s: %d", data->dev->name, ret);
+		}
+	}
+
+	return 0;
 }
+
+SYS_INIT(gb_usb_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
@@ -28,41 +28,178 @@
  */
 
 #include <zephyr/drivers/haptics.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 #include <greybus/greybus_protocols.h>
 #include <greybus/greybus_messages.h>
 #include "greybus_transport.h"
 #include "greybus_internal.h"
+#include "greybus_vibrator.h"
+
+LOG_MODULE_REGISTER(greybus_vibrator, CONFIG_GREYBUS_LOG_LEVEL);
+
+#ifdef CONFIG_GREYBUS_VIBRATOR_PATTERN
+static void gb_vibrator_pattern_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct gb_vibrator_driver_data *data =
+		CONTAINER_OF(dwork, struct gb_vibrator_driver_data, pattern_work);
+	const struct gb_vibrator_pattern_step *step = &data->steps[data->phase / 2];
+	uint16_t duration;
+
+	if (data->phase % 2 == 0) {
+		duration = sys_le16_to_cpu(step->on_ms);
+		if (duration) {
+			haptics_start_output(data->dev);
+		}
+	} else {
+		duration = sys_le16_to_cpu(step->off_ms);
+		haptics_stop_output(data->dev);
+	}
+
+	data->phase++;
+	if (data->phase == data->step_count * 2) {
+		data->phase = 0;
+		if (data->repeat != GB_VIBRATOR_PATTERN_REPEAT_FOREVER) {
+			if (data->loops_left == 0) {
+				return;
+			}
+			data->loops_left--;
+		}
+	}
+
+	data->next_ms += duration;
+	k_work_schedule(dwork, K_TIMEOUT_ABS_MS(data->next_ms));
+}
+
+/* Stop a pattern being played, and make sure the output is left off */
+static void gb_vibrator_pattern_stop(struct gb_vibrator_driver_data *data)
+{
+	struct k_work_sync sync;
+
+	if (k_work_cancel_delayable_sync(&data->pattern_work, &sync)) {
+		haptics_stop_output(data->dev);
+	}
+}
+
+static void gb_vibrator_pattern_upload(uint16_t cport, struct gb_message *req,
+				       struct gb_vibrator_driver_data *data)
+{
+	const struct gb_vibrator_pattern_upload_request *req_data =
+		(const struct gb_vibrator_pattern_upload_request *)req->payload;
+
+	if (gb_message_payload_len(req) < sizeof(*req_data) ||
+	    gb_message_payload_len(req) <
+		    sizeof(*req_data) + req_data->count * sizeof(req_data->steps[0])) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	if (req_data->count == 0 || req_data->count > ARRAY_SIZE(data->steps)) {
+		LOG_ERR("Invalid pattern length: %u", req_data->count);
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	gb_vibrator_pattern_stop(data);
+
+	memcpy(data->steps, req_data->steps, req_data->count * sizeof(req_data->steps[0]));
+	data->step_count = req_data->count;
+	data->repeat = req_data->repeat;
+
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+
+static void gb_vibrator_pattern_play(uint16_t cport, struct gb_message *req,
+				     struct gb_vibrator_driver_data *data)
+{
+	const struct gb_vibrator_pattern_play_request *req_data =
+		(const struct gb_vibrator_pattern_play_request *)req->payload;
+
+	if (gb_message_payload_len(req) < sizeof(*req_data)) {
+		LOG_ERR("dropping short message");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	if (data->step_count == 0) {
+		LOG_ERR("No pattern uploaded");
+		return gb_transport_message_empty_response_send(req, GB_OP_INVALID, cport);
+	}
+
+	gb_vibrator_pattern_stop(data);
+
+	data->phase = 0;
+	data->loops_left = data->repeat;
+	data->next_ms = k_uptime_get() + sys_le16_to_cpu(req_data->delay_ms);
+	k_work_schedule(&data->pattern_work, K_TIMEOUT_ABS_MS(data->next_ms));
+
+	gb_transport_message_empty_response_send(req, GB_OP_SUCCESS, cport);
+}
+
+static void gb_vibrator_connected(const void *priv, uint16_t cport)
+{
+	struct gb_vibrator_driver_data *data = (struct gb_vibrator_driver_data *)priv;
+
+	k_work_init_delayable(&data->pattern_work, gb_vibrator_pattern_work_handler);
+}
+
+static void gb_vibrator_disconnected(const void *priv)
+{
+	struct gb_vibrator_driver_data *data = (struct gb_vibrator_driver_data *)priv;
+
+	gb_vibrator_pattern_stop(data);
+}
+#else
+static inline void gb_vibrator_pattern_stop(struct gb_vibrator_driver_data *data)
+{
+}
+#endif // CONFIG_GREYBUS_VIBRATOR_PATTERN
 
 static void gb_vibrator_vibrator_on(uint16_t cport, struct gb_message *req,
-				    const struct device *dev)
+				    struct gb_vibrator_driver_data *data)
 {
-	int ret = haptics_start_output(dev);
+	int ret;
+
+	gb_vibrator_pattern_stop(data);
+	ret = haptics_start_output(data->dev);
 
 	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
 }
 
 static void gb_vibrator_vibrator_off(uint16_t cport, struct gb_message *req,
-				     const struct device *dev)
+				     struct gb_vibrator_driver_data *data)
 {
-	int ret = haptics_stop_output(dev);
+	int ret;
+
+	gb_vibrator_pattern_stop(data);
+	ret = haptics_stop_output(data->dev);
 
 	gb_transport_message_empty_response_send(req, gb_errno_to_op_result(ret), cport);
 }
 
 static void gb_vibrator_handler(const void *priv, struct gb_message *msg, uint16_t cport)
 {
-	const struct device *dev = priv;
+	struct gb_vibrator_driver_data *data = (struct gb_vibrator_driver_data *)priv;
 
 	switch (gb_message_type(msg)) {
 	case GB_VIBRATOR_TYPE_ON:
-		return gb_vibrator_vibrator_on(cport, msg, dev);
+		return gb_vibrator_vibrator_on(cport, msg, data);
 	case GB_VIBRATOR_TYPE_OFF:
-		return gb_vibrator_vibrator_off(cport, msg, dev);
+		return gb_vibrator_vibrator_off(cport, msg, data);
+#ifdef CONFIG_GREYBUS_VIBRATOR_PATTERN
+	case GB_VIBRATOR_TYPE_VENDOR_PATTERN_UPLOAD:
+		return gb_vibrator_pattern_upload(cport, msg, data);
+	case GB_VIBRATOR_TYPE_VENDOR_PATTERN_PLAY:
+		return gb_vibrator_pattern_play(cport, msg, data);
+#endif // CONFIG_GREYBUS_VIBRATOR_PATTERN
 	default:
 		gb_transport_message_empty_response_send(msg, GB_OP_INVALID, cport);
 	}
 }
 
 const struct gb_driver gb_vibrator_driver = {
+#ifdef CONFIG_GREYBUS_VIBRATOR_PATTERN
+	.connected = gb_vibrator_connected,
+	.disconnected = gb_vibrator_disconnected,
+#endif // CONFIG_GREYBUS_VIBRATOR_PATTERN
 	.op_handler = gb_vibrator_handler,
 };
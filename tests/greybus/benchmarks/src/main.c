@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Round trip benchmarks through greybus_rx_handler(), the receive workers, the protocol driver
+ * and the dummy transport. Each benchmark prints a single line of the form
+ *
+ *   BENCH:name=<name>,iterations=<n>,ops_per_sec=<n>,ns_per_op=<n>,cycles_per_op=<n>,heap_peak=<n>
+ *
+ * which twister records through the regex in testcase.yaml.
+ */
+
+#include "greybus/greybus_messages.h"
+#include <zephyr/ztest.h>
+#include <zephyr/device.h>
+#include <zephyr/timing/timing.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/sys/byteorder.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_raw.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus-utils/manifest.h>
+
+#define BENCH_WARMUP     16
+#define BENCH_ITERATIONS 2000
+
+#define LOOPBACK_SIZE 256
+#define RAW_SIZE      128
+#define I2C_SIZE      16
+#define I2C_ADDR      0x01
+
+#define CONTROL_CPORT  0
+#define RAW_CPORT      GREYBUS_RAW_CPORT_START
+#define LOOPBACK_CPORT (GREYBUS_RAW_CPORT_START + GREYBUS_RAW_CPORT_COUNT)
+#define GPIO_CPORT     (LOOPBACK_CPORT + 1)
+#define I2C_CPORT      (LOOPBACK_CPORT + 2)
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+void gb_heap_stats_reset(void);
+
+static const struct device *i2c_dev = DEVICE_DT_GET(DT_NODELABEL(i2c0));
+
+#ifdef CONFIG_ARCH_POSIX
+/* Simulated time does not advance while code runs, see native/bench_host_clock.c */
+uint64_t bench_host_time_ns(void);
+#endif // CONFIG_ARCH_POSIX
+
+struct bench_ctx {
+	uint16_t cport;
+	uint8_t type;
+	/* Request payload, copied into every request */
+	const void *payload;
+	size_t payload_len;
+};
+
+static int i2c_emul_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+			     int addr)
+{
+	return 0;
+}
+
+static const struct i2c_emul_api i2c_api = {
+	.transfer = i2c_emul_transfer,
+};
+
+static const struct device i2c_target_dev = {
+	.name = "bench-dev",
+};
+
+static const struct emul i2c_target_emul = {
+	.dev = &i2c_target_dev,
+};
+
+static struct i2c_emul i2c_target = {
+	.addr = I2C_ADDR,
+	.api = &i2c_api,
+	.target = &i2c_target_emul,
+};
+
+static uint8_t raw_cb(uint32_t len, const uint8_t *data, void *priv)
+{
+	return GB_OP_SUCCESS;
+}
+
+static struct gb_message *bench_round_trip(uint16_t cport, uint8_t type, const void *payload,
+					   size_t payload_len)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *req =
+		gb_message_request_alloc_with_payload(payload, payload_len, type, false);
+
+	zassert_not_null(req, "Failed to allocate request");
+
+	greybus_rx_handler(cport, req);
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, cport, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+	zassert_true(gb_message_is_success(resp.msg), "Request 0x%02x failed", type);
+
+	return resp.msg;
+}
+
+static uint32_t bench_heap_peak(void)
+{
+	struct gb_message *resp = bench_round_trip(CONTROL_CPORT, GB_CONTROL_TYPE_VENDOR_HEAP_STATS,
+						   NULL, 0);
+	const struct gb_control_heap_stats_response *stats =
+		(const struct gb_control_heap_stats_response *)resp->payload;
+	const uint32_t peak = sys_le32_to_cpu(stats->peak_bytes);
+
+	gb_message_dealloc(resp);
+
+	return peak;
+}
+
+static void bench_run(const char *name, const struct bench_ctx *ctx)
+{
+	timing_t start, end;
+	uint64_t cycles, ns;
+	uint32_t heap_peak;
+
+	for (int i = 0; i < BENCH_WARMUP; i++) {
+		gb_message_dealloc(bench_round_trip(ctx->cport, ctx->type, ctx->payload,
+						    ctx->payload_len));
+	}
+
+	gb_heap_stats_reset();
+
+#ifdef CONFIG_ARCH_POSIX
+	const uint64_t start_ns = bench_host_time_ns();
+#endif // CONFIG_ARCH_POSIX
+	start = timing_counter_get();
+
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		gb_message_dealloc(bench_round_trip(ctx->cport, ctx->type, ctx->payload,
+						    ctx->payload_len));
+	}
+
+	end = timing_counter_get();
+	cycles = timing_cycles_get(&start, &end);
+#ifdef CONFIG_ARCH_POSIX
+	ns = bench_host_time_ns() - start_ns;
+#else
+	ns = timing_cycles_to_ns(cycles);
+#endif // CONFIG_ARCH_POSIX
+
+	heap_peak = bench_heap_peak();
+
+	TC_PRINT("BENCH:name=%s,iterations=%u,ops_per_sec=%llu,ns_per_op=%llu,cycles_per_op=%llu,"
+		 "heap_peak=%u\n",
+		 name, BENCH_ITERATIONS,
+		 ns ? (unsigned long long)BENCH_ITERATIONS * NSEC_PER_SEC / ns : 0,
+		 (unsigned long long)ns / BENCH_ITERATIONS,
+		 (unsigned long long)cycles / BENCH_ITERATIONS, heap_peak);
+}
+
+static void *bench_setup(void)
+{
+	const struct gb_gpio_direction_out_request dir_out = {.which = 0, .value = 0};
+	int ret;
+
+	zassert_equal(GREYBUS_CPORT_COUNT, I2C_CPORT + 1, "Unexpected cport layout");
+
+	timing_init();
+	timing_start();
+
+	ret = i2c_emul_register(i2c_dev, &i2c_target);
+	zassert_equal(ret, 0, "Failed to register i2c target");
+
+	ret = greybus_raw_register(raw_cb, NULL);
+	zassert_true(ret >= 0, "Failed to register raw callback");
+
+	gb_message_dealloc(bench_round_trip(GPIO_CPORT, GB_GPIO_TYPE_DIRECTION_OUT, &dir_out,
+					    sizeof(dir_out)));
+
+	return NULL;
+}
+
+static void bench_teardown(void *fixture)
+{
+	timing_stop();
+}
+
+ZTEST_SUITE(greybus_benchmarks, NULL, bench_setup, NULL, NULL, bench_teardown);
+
+ZTEST(greybus_benchmarks, test_loopback_ping)
+{
+	const struct bench_ctx ctx = {
+		.cport = LOOPBACK_CPORT,
+		.type = GB_LOOPBACK_TYPE_PING,
+	};
+
+	bench_run("loopback_ping", &ctx);
+}
+
+ZTEST(greybus_benchmarks, test_loopback_transfer)
+{
+	static uint8_t payload[sizeof(struct gb_loopback_transfer_request) + LOOPBACK_SIZE];
+	struct gb_loopback_transfer_request *req_data =
+		(struct gb_loopback_transfer_request *)payload;
+	const struct bench_ctx ctx = {
+		.cport = LOOPBACK_CPORT,
+		.type = GB_LOOPBACK_TYPE_TRANSFER,
+		.payload = payload,
+		.payload_len = sizeof(payload),
+	};
+
+	req_data->len = sys_cpu_to_le32(LOOPBACK_SIZE);
+	for (int i = 0; i < LOOPBACK_SIZE; i++) {
+		req_data->data[i] = i;
+	}
+
+	bench_run("loopback_transfer", &ctx);
+}
+
+ZTEST(greybus_benchmarks, test_gpio_set_value)
+{
+	const struct gb_gpio_set_value_request req_data = {.which = 0, .value = 1};
+	const struct bench_ctx ctx = {
+		.cport = GPIO_CPORT,
+		.type = GB_GPIO_TYPE_SET_VALUE,
+		.payload = &req_data,
+		.payload_len = sizeof(req_data),
+	};
+
+	bench_run("gpio_set_value", &ctx);
+}
+
+ZTEST(greybus_benchmarks, test_gpio_get_value)
+{
+	const struct gb_gpio_get_value_request req_data = {.which = 0};
+	const struct bench_ctx ctx = {
+		.cport = GPIO_CPORT,
+		.type = GB_GPIO_TYPE_GET_VALUE,
+		.payload = &req_data,
+		.payload_len = sizeof(req_data),
+	};
+
+	bench_run("gpio_get_value", &ctx);
+}
+
+ZTEST(greybus_benchmarks, test_i2c_transfer)
+{
+	static uint8_t payload[sizeof(struct gb_i2c_transfer_request) +
+			       sizeof(struct gb_i2c_transfer_op) + I2C_SIZE];
+	struct gb_i2c_transfer_request *req_data = (struct gb_i2c_transfer_request *)payload;
+	uint8_t *write_data = (uint8_t *)&req_data->ops[1];
+	const struct bench_ctx ctx = {
+		.cport = I2C_CPORT,
+		.type = GB_I2C_TYPE_TRANSFER,
+		.payload = payload,
+		.payload_len = sizeof(payload),
+	};
+
+	req_data->op_count = sys_cpu_to_le16(1);
+	req_data->ops[0].addr = sys_cpu_to_le16(I2C_ADDR);
+	req_data->ops[0].flags = 0;
+	req_data->ops[0].size = sys_cpu_to_le16(I2C_SIZE);
+	for (int i = 0; i < I2C_SIZE; i++) {
+		write_data[i] = i;
+	}
+
+	bench_run("i2c_transfer", &ctx);
+}
+
+ZTEST(greybus_benchmarks, test_raw_send)
+{
+	static uint8_t payload[sizeof(struct gb_raw_send_request) + RAW_SIZE];
+	struct gb_raw_send_request *req_data = (struct gb_raw_send_request *)payload;
+	const struct bench_ctx ctx = {
+		.cport = RAW_CPORT,
+		.type = GB_RAW_TYPE_SEND,
+		.payload = payload,
+		.payload_len = sizeof(payload),
+	};
+
+	req_data->len = sys_cpu_to_le32(RAW_SIZE);
+	for (int i = 0; i < RAW_SIZE; i++) {
+		req_data->data[i] = i;
+	}
+
+	bench_run("raw_send", &ctx);
+}
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+# SPDX-License-Identifier: Apache-2.0
+
+"""
+Report the footprint matrix out of a twister run:
+
+  west twister -T tests/greybus/footprint --enable-size-report
+  tests/greybus/footprint/footprint.py twister-out/twister.json
+
+Flash and static RAM come from the build of each variant, thread stacks and the Greybus heap
+peak from the variants that ran. Each variant is also reported against its parent, the variant
+named by dropping the last part of its name, which gives the marginal cost of the feature.
+"""
+
+import argparse
+import csv
+import json
+import sys
+
+PREFIX = "footprint.greybus"
+FIELDS = ("rom", "ram", "threads", "stack_size", "stack_used", "heap_peak")
+
+
+def load(path):
+    with open(path) as f:
+        report = json.load(f)
+
+    variants = {}
+    for suite in report.get("testsuites", []):
+        name = suite["name"].rsplit("/", 1)[-1]
+        if not name.startswith(PREFIX):
+            continue
+
+        entry = {
+            "variant": name,
+            "platform": suite["platform"],
+            "status": suite.get("status"),
+            "rom": suite.get("used_rom"),
+            "ram": suite.get("used_ram"),
+        }
+        recording = (suite.get("recording") or [{}])[0]
+        for field in FIELDS[2:]:
+            entry[field] = int(recording[field]) if field in recording else None
+
+        variants[(name, entry["platform"])] = entry
+
+    return variants
+
+
+def add_deltas(variants):
+    for (name, platform), entry in variants.items():
+        parent = variants.get((name.rsplit(".", 1)[0], platform))
+        entry["parent"] = parent["variant"] if parent else None
+        for field in FIELDS:
+            if parent and entry[field] is not None and parent[field] is not None:
+                entry[field + "_delta"] = entry[field] - parent[field]
+            else:
+                entry[field + "_delta"] = None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("report", help="twister.json of the run")
+    parser.add_argument("--csv", action="store_true", help="print CSV instead of JSON")
+    args = parser.parse_args()
+
+    variants = load(args.report)
+    if not variants:
+        sys.exit(f"No {PREFIX} variants in {args.report}")
+
+    add_deltas(variants)
+    rows = [variants[key] for key in sorted(variants, key=lambda k: (k[1], k[0]))]
+
+    if args.csv:
+        writer = csv.DictWriter(sys.stdout, fieldnames=list(rows[0]))
+        writer.writeheader()
+        writer.writerows(rows)
+    else:
+        json.dump(rows, sys.stdout, indent=2)
+        print()
+
+
+if __name__ == "__main__":
+    main()
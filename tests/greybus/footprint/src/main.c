@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runtime half of the footprint matrix. The node is enumerated over the dummy transport the way
+ * the AP would, then the thread stacks and the Greybus heap peak are printed as
+ *
+ *   FOOTPRINT_THREAD:name=<name>,size=<n>,used=<n>
+ *   FOOTPRINT:threads=<n>,stack_size=<n>,stack_used=<n>,heap_peak=<n>
+ *
+ * Flash and static RAM come from the build, footprint.py merges both out of twister.json.
+ */
+
+#include "greybus/greybus_messages.h"
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus-utils/manifest.h>
+
+#define CONTROL_CPORT 0
+
+/* Version of the control protocol sent by the Linux AP */
+#define CONTROL_VERSION_MAJOR 0
+#define CONTROL_VERSION_MINOR 1
+
+/*
+ * struct footprint_stacks: Totals over all threads
+ *
+ * @threads: number of threads
+ * @size: size of their stacks
+ * @used: bytes of their stacks used so far
+ */
+struct footprint_stacks {
+	uint32_t threads;
+	size_t size;
+	size_t used;
+};
+
+#ifdef CONFIG_GREYBUS_XPORT_DUMMY
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+static struct gb_message *footprint_round_trip(uint16_t cport, uint8_t type, const void *payload,
+					       size_t payload_len)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *req =
+		gb_message_request_alloc_with_payload(payload, payload_len, type, false);
+
+	zassert_not_null(req, "Failed to allocate request");
+
+	greybus_rx_handler(cport, req);
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, cport, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+	zassert_true(gb_message_is_success(resp.msg), "Request 0x%02x failed", type);
+
+	return resp.msg;
+}
+
+/* Helper to go through the same steps as the AP when the node shows up */
+static void footprint_enumerate(void)
+{
+	struct gb_message *resp;
+	const struct gb_control_version_request version = {
+		.major = CONTROL_VERSION_MAJOR,
+		.minor = CONTROL_VERSION_MINOR,
+	};
+	struct gb_control_connected_request connected;
+
+	gb_message_dealloc(footprint_round_trip(CONTROL_CPORT, GB_CONTROL_TYPE_VERSION, &version,
+						sizeof(version)));
+
+	gb_message_dealloc(
+		footprint_round_trip(CONTROL_CPORT, GB_CONTROL_TYPE_GET_MANIFEST_SIZE, NULL, 0));
+
+	resp = footprint_round_trip(CONTROL_CPORT, GB_CONTROL_TYPE_GET_MANIFEST, NULL, 0);
+	zassert_true(gb_message_payload_len(resp) > 0, "Empty manifest");
+	gb_message_dealloc(resp);
+
+	for (uint16_t cport = CONTROL_CPORT + 1; cport < GREYBUS_CPORT_COUNT; cport++) {
+		connected.cport_id = sys_cpu_to_le16(cport);
+		gb_message_dealloc(footprint_round_trip(CONTROL_CPORT, GB_CONTROL_TYPE_CONNECTED,
+							&connected, sizeof(connected)));
+	}
+}
+
+static uint32_t footprint_heap_peak(void)
+{
+	struct gb_message *resp =
+		footprint_round_trip(CONTROL_CPORT, GB_CONTROL_TYPE_VENDOR_HEAP_STATS, NULL, 0);
+	const struct gb_control_heap_stats_response *stats =
+		(const struct gb_control_heap_stats_response *)resp->payload;
+	const uint32_t peak = sys_le32_to_cpu(stats->peak_bytes);
+
+	gb_message_dealloc(resp);
+
+	return peak;
+}
+#else
+/* Other transports are only built, there is no AP to answer */
+static void footprint_enumerate(void)
+{
+}
+
+static uint32_t footprint_heap_peak(void)
+{
+	return 0;
+}
+#endif // CONFIG_GREYBUS_XPORT_DUMMY
+
+static void footprint_thread(const struct k_thread *thread, void *user_data)
+{
+	struct footprint_stacks *stacks = user_data;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+	const size_t size = thread->stack_info.size;
+	size_t unused;
+
+	/* Threads without a stack of their own, like the idle thread on some arches */
+	if (k_thread_stack_space_get(thread, &unused)) {
+		unused = size;
+	}
+
+	TC_PRINT("FOOTPRINT_THREAD:name=%s,size=%zu,used=%zu\n", name ? name : "unknown", size,
+		 size - unused);
+
+	stacks->threads++;
+	stacks->size += size;
+	stacks->used += size - unused;
+}
+
+ZTEST_SUITE(greybus_footprint, NULL, NULL, NULL, NULL, NULL);
+
+ZTEST(greybus_footprint, test_footprint)
+{
+	struct footprint_stacks stacks = {0};
+	uint32_t heap_peak;
+
+	footprint_enumerate();
+	heap_peak = footprint_heap_peak();
+
+	k_thread_foreach(footprint_thread, &stacks);
+
+	TC_PRINT("FOOTPRINT:threads=%u,stack_size=%zu,stack_used=%zu,heap_peak=%u\n",
+		 stacks.threads, stacks.size, stacks.used, heap_peak);
+}
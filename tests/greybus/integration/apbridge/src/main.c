@@ -119,3 +119,244 @@ ZTEST(greybus_apbridge_tests, test_message_send)
 	gb_interface_remove(AP_INF_ID);
 	gb_interface_remove(0);
 }
+
+static int route_write_cb(struct gb_interface *intf, struct gb_message *msg, uint16_t cport)
+{
+	ARG_UNUSED(msg);
+
+	intf->ctrl_data = UINT_TO_POINTER(cport);
+
+	return 0;
+}
+
+ZTEST(greybus_apbridge_tests, test_message_routing)
+{
+	int ret;
+	uint16_t i;
+	struct gb_message msg;
+	struct gb_interface ap_intf = {
+		.id = AP_INF_ID,
+		.write = route_write_cb,
+	};
+	struct gb_interface *node_intf;
+
+	ret = gb_interface_add(&ap_intf);
+	zassert_equal(ret, 0, "Failed to add AP");
+
+	node_intf = gb_interface_alloc(route_write_cb, NULL, NULL, NULL);
+	zassert_not_null(node_intf, "Failed to allocate greybus interface");
+
+	/* Use every AP cport, with node cports that do not line up with them */
+	for (i = 0; i < AP_MAX_NODES; i++) {
+		ret = gb_apbridge_connection_create(AP_INF_ID, i, node_intf->id, 1000 + i * 7);
+		zassert_equal(ret, 0, "Failed to create connection %u", i);
+	}
+
+	ret = gb_apbridge_connection_create(AP_INF_ID, AP_MAX_NODES, node_intf->id, 1);
+	zassert_equal(ret, -EOVERFLOW, "AP cport out of range should fail");
+
+	ret = gb_apbridge_connection_create(AP_INF_ID, 0, node_intf->id, 1);
+	zassert_equal(ret, -EALREADY, "AP cport already in use should fail");
+
+	for (i = 0; i < AP_MAX_NODES; i++) {
+		ret = gb_apbridge_send(node_intf->id, 1000 + i * 7, &msg);
+		zassert_equal(ret, 0, "Failed to send message");
+		zassert_equal(POINTER_TO_UINT(ap_intf.ctrl_data), i, "Wrong AP cport");
+
+		ret = gb_apbridge_send(AP_INF_ID, i, &msg);
+		zassert_equal(ret, 0, "Failed to send message");
+		zassert_equal(POINTER_TO_UINT(node_intf->ctrl_data), 1000 + i * 7,
+			      "Wrong node cport");
+	}
+
+	/* Remove every other connection, the rest must still be reachable */
+	for (i = 0; i < AP_MAX_NODES; i += 2) {
+		ret = gb_apbridge_connection_destroy(AP_INF_ID, i, node_intf->id, 1000 + i * 7);
+		zassert_equal(ret, 0, "Failed to destroy connection");
+	}
+
+	for (i = 0; i < AP_MAX_NODES; i++) {
+		ret = gb_apbridge_send(node_intf->id, 1000 + i * 7, &msg);
+		if (i % 2 == 0) {
+			zassert_not_equal(ret, 0, "Destroyed connection should not route");
+			continue;
+		}
+
+		zassert_equal(ret, 0, "Failed to send message");
+		zassert_equal(POINTER_TO_UINT(ap_intf.ctrl_data), i, "Wrong AP cport");
+	}
+
+	for (i = 1; i < AP_MAX_NODES; i += 2) {
+		gb_apbridge_connection_destroy(AP_INF_ID, i, node_intf->id, 1000 + i * 7);
+	}
+
+	gb_interface_dealloc(node_intf);
+	gb_interface_remove(AP_INF_ID);
+}
+
+static int node_write_cb(struct gb_interface *intf, struct gb_message *msg, uint16_t cport)
+{
+	ARG_UNUSED(cport);
+
+	intf->ctrl_data = msg;
+
+	return 0;
+}
+
+ZTEST(greybus_apbridge_tests, test_node_to_node)
+{
+	int ret;
+	struct gb_message msg;
+	struct gb_interface *node1, *node2;
+
+	node1 = gb_interface_alloc(node_write_cb, NULL, NULL, NULL);
+	zassert_not_null(node1, "Failed to allocate greybus interface");
+
+	node2 = gb_interface_alloc(node_write_cb, NULL, NULL, NULL);
+	zassert_not_null(node2, "Failed to allocate greybus interface");
+
+	ret = gb_apbridge_connection_create(node1->id, 3, node2->id, 5);
+	zassert_equal(ret, 0, "Failed to create node to node connection");
+
+	ret = gb_apbridge_send(node1->id, 3, &msg);
+	zassert_equal(ret, 0, "Failed to send message");
+	zassert_equal_ptr(&msg, node2->ctrl_data, "Message should reach node 2");
+
+	ret = gb_apbridge_send(node2->id, 5, &msg);
+	zassert_equal(ret, 0, "Failed to send message");
+	zassert_equal_ptr(&msg, node1->ctrl_data, "Message should reach node 1");
+
+	ret = gb_apbridge_connection_create(AP_INF_ID, 1, AP_INF_ID, 2);
+	zassert_equal(ret, -EINVAL, "AP to AP connection should fail");
+
+	ret = gb_apbridge_connection_destroy(node1->id, 3, node2->id, 5);
+	zassert_equal(ret, 0, "Failed to destroy connection");
+
+	ret = gb_apbridge_send(node1->id, 3, &msg);
+	zassert_not_equal(ret, 0, "Destroyed connection should not route");
+
+	gb_interface_dealloc(node1);
+	gb_interface_dealloc(node2);
+}
+
+ZTEST(greybus_apbridge_tests, test_route_table_full)
+{
+	int ret;
+	uint16_t i;
+	struct gb_message msg;
+	struct gb_interface *node1, *node2;
+
+	node1 = gb_interface_alloc(node_write_cb, NULL, NULL, NULL);
+	zassert_not_null(node1, "Failed to allocate greybus interface");
+
+	node2 = gb_interface_alloc(node_write_cb, NULL, NULL, NULL);
+	zassert_not_null(node2, "Failed to allocate greybus interface");
+
+	/* Node to node connections are not limited by AP cports, only by the route table */
+	for (i = 0; i < AP_MAX_CONNECTIONS; i++) {
+		ret = gb_apbridge_connection_create(node1->id, i, node2->id, 500 + i);
+		zassert_equal(ret, 0, "Failed to create connection %u", i);
+	}
+
+	ret = gb_apbridge_connection_create(node1->id, AP_MAX_CONNECTIONS, node2->id, 1);
+	zassert_equal(ret, -ENOMEM, "Full route table should fail");
+
+	/* Lookups of missing routes must still terminate */
+	ret = gb_apbridge_send(node1->id, AP_MAX_CONNECTIONS, &msg);
+	zassert_not_equal(ret, 0, "Missing route should not route");
+
+	for (i = 0; i < AP_MAX_CONNECTIONS; i++) {
+		ret = gb_apbridge_send(node1->id, i, &msg);
+		zassert_equal(ret, 0, "Failed to send message");
+		zassert_equal_ptr(&msg, node2->ctrl_data, "Message should reach node 2");
+	}
+
+	/* Freeing one connection makes room for another */
+	ret = gb_apbridge_connection_destroy(node1->id, 0, node2->id, 500);
+	zassert_equal(ret, 0, "Failed to destroy connection");
+
+	ret = gb_apbridge_connection_create(node1->id, AP_MAX_CONNECTIONS, node2->id, 1);
+	zassert_equal(ret, 0, "Failed to create connection after destroy");
+
+	ret = gb_apbridge_connection_destroy(node1->id, AP_MAX_CONNECTIONS, node2->id, 1);
+	zassert_equal(ret, 0, "Failed to destroy connection");
+
+	for (i = 1; i < AP_MAX_CONNECTIONS; i++) {
+		gb_apbridge_connection_destroy(node1->id, i, node2->id, 500 + i);
+	}
+
+	gb_interface_dealloc(node1);
+	gb_interface_dealloc(node2);
+}
+
+#ifdef CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
+static K_SEM_DEFINE(queued_entered, 0, 1);
+static K_SEM_DEFINE(queued_gate, 0, CONFIG_GREYBUS_APBRIDGE_TX_QUEUE_DEPTH + 1);
+static K_SEM_DEFINE(queued_written, 0, CONFIG_GREYBUS_APBRIDGE_TX_QUEUE_DEPTH + 1);
+
+static int queued_write_cb(struct gb_interface *intf, struct gb_message *msg, uint16_t cport)
+{
+	ARG_UNUSED(cport);
+
+	k_sem_give(&queued_entered);
+	k_sem_take(&queued_gate, K_FOREVER);
+	intf->ctrl_data = msg;
+	k_sem_give(&queued_written);
+
+	return 0;
+}
+
+ZTEST(greybus_apbridge_tests, test_tx_queue)
+{
+	int ret;
+	size_t i;
+	struct gb_message msg;
+	struct gb_interface *node1, *node2;
+
+	node1 = gb_interface_alloc(node_write_cb, NULL, NULL, NULL);
+	zassert_not_null(node1, "Failed to allocate greybus interface");
+
+	node2 = gb_interface_alloc(queued_write_cb, NULL, NULL, NULL);
+	zassert_not_null(node2, "Failed to allocate greybus interface");
+
+	ret = gb_interface_tx_queue_start(node2, NULL);
+	zassert_equal(ret, 0, "Failed to start TX queue");
+
+	ret = gb_interface_tx_queue_start(node2, NULL);
+	zassert_equal(ret, -EALREADY, "TX queue should already be started");
+
+	ret = gb_apbridge_connection_create(node1->id, 3, node2->id, 5);
+	zassert_equal(ret, 0, "Failed to create node to node connection");
+
+	/* The first message blocks the work queue in the write */
+	ret = gb_apbridge_send(node1->id, 3, &msg);
+	zassert_equal(ret, 0, "Failed to send message");
+	zassert_ok(k_sem_take(&queued_entered, K_SECONDS(1)), "Message was not written");
+	zassert_is_null(node2->ctrl_data, "Write should still be blocked");
+
+	for (i = 0; i < CONFIG_GREYBUS_APBRIDGE_TX_QUEUE_DEPTH; i++) {
+		ret = gb_apbridge_send(node1->id, 3, &msg);
+		zassert_equal(ret, 0, "Failed to queue message %zu", i);
+	}
+
+	ret = gb_apbridge_send(node1->id, 3, &msg);
+	zassert_equal(ret, -ENOBUFS, "Full queue should refuse the message");
+
+	/* The inline interface is not held up by the blocked one */
+	ret = gb_apbridge_send(node2->id, 5, &msg);
+	zassert_equal(ret, 0, "Failed to send message");
+	zassert_equal_ptr(&msg, node1->ctrl_data, "Message should reach node 1");
+
+	for (i = 0; i <= CONFIG_GREYBUS_APBRIDGE_TX_QUEUE_DEPTH; i++) {
+		k_sem_give(&queued_gate);
+		zassert_ok(k_sem_take(&queued_written, K_SECONDS(1)), "Message %zu was lost", i);
+	}
+	zassert_equal_ptr(&msg, node2->ctrl_data, "Message should reach node 2");
+
+	ret = gb_apbridge_connection_destroy(node1->id, 3, node2->id, 5);
+	zassert_equal(ret, 0, "Failed to destroy connection");
+
+	gb_interface_dealloc(node1);
+	gb_interface_dealloc(node2);
+}
+#endif // CONFIG_GREYBUS_APBRIDGE_TX_QUEUE
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT test_i2s_stub
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/i2s.h>
+#include "i2s_stub.h"
+
+struct i2s_stub_state i2s_stub_state;
+
+static int i2s_stub_configure(const struct device *dev, enum i2s_dir dir,
+			      const struct i2s_config *cfg)
+{
+	if (dir != I2S_DIR_TX) {
+		return -ENOSYS;
+	}
+
+	i2s_stub_state.tx_cfg = *cfg;
+
+	return 0;
+}
+
+static const struct i2s_config *i2s_stub_config_get(const struct device *dev, enum i2s_dir dir)
+{
+	return dir == I2S_DIR_TX ? &i2s_stub_state.tx_cfg : NULL;
+}
+
+static int i2s_stub_write(const struct device *dev, void *mem_block, size_t size)
+{
+	i2s_stub_state.writes++;
+	i2s_stub_state.write_size = size;
+	k_mem_slab_free(i2s_stub_state.tx_cfg.mem_slab, mem_block);
+
+	return 0;
+}
+
+static int i2s_stub_read(const struct device *dev, void **mem_block, size_t *size)
+{
+	return -ENOSYS;
+}
+
+static int i2s_stub_trigger(const struct device *dev, enum i2s_dir dir, enum i2s_trigger_cmd cmd)
+{
+	switch (cmd) {
+	case I2S_TRIGGER_START:
+		i2s_stub_state.started = true;
+		return 0;
+	case I2S_TRIGGER_DROP:
+	case I2S_TRIGGER_STOP:
+		i2s_stub_state.started = false;
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+static DEVICE_API(i2s, i2s_stub_api) = {
+	.configure = i2s_stub_configure,
+	.config_get = i2s_stub_config_get,
+	.write = i2s_stub_write,
+	.read = i2s_stub_read,
+	.trigger = i2s_stub_trigger,
+};
+
+#define I2S_STUB_INIT(n)                                                                           \
+	DEVICE_DT_INST_DEFINE(n, NULL, NULL, NULL, NULL, POST_KERNEL,                              \
+			      CONFIG_KERNEL_INIT_PRIORITY_DEVICE, &i2s_stub_api);
+
+DT_INST_FOREACH_STATUS_OKAY(I2S_STUB_INIT)
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _I2S_STUB_H_
+#define _I2S_STUB_H_
+
+#include <stdint.h>
+#include <zephyr/drivers/i2s.h>
+
+struct i2s_stub_state {
+	struct i2s_config tx_cfg;
+	/* Blocks written, they are freed right away as if played */
+	uint32_t writes;
+	/* Bytes of the last block written */
+	size_t write_size;
+	bool started;
+};
+
+extern struct i2s_stub_state i2s_stub_state;
+
+#endif // _I2S_STUB_H_
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_messages.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus-utils/manifest.h>
+#include <zephyr/sys/byteorder.h>
+#include "i2s_stub.h"
+
+#define MGMT_CPORT 1
+#define DATA_CPORT 2
+
+/* 1ms of 48kHz 16 bit stereo audio */
+#define DATA_SIZE 192
+/* Blocks covering GB_AUDIO_SAMPLE_BUFFER_MIN_US */
+#define PREFILL   10
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+/*
+ * Helper to send a management request. Returns the result of the response.
+ */
+static uint8_t audio_request(uint8_t type, const void *payload, size_t len)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *req = gb_message_request_alloc(len, type, false);
+	uint8_t result;
+
+	zassert_not_null(req, "Failed to allocate request");
+	if (len) {
+		memcpy(req->payload, payload, len);
+	}
+	greybus_rx_handler(MGMT_CPORT, req);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, MGMT_CPORT, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+	result = resp.msg->header.result;
+	gb_message_dealloc(resp.msg);
+
+	return result;
+}
+
+static uint8_t audio_set_pcm(uint32_t format, uint8_t channels)
+{
+	const struct gb_audio_set_pcm_request req_data = {
+		.data_cport = sys_cpu_to_le16(DATA_CPORT),
+		.format = sys_cpu_to_le32(format),
+		.rate = sys_cpu_to_le32(GB_AUDIO_PCM_RATE_48000),
+		.channels = channels,
+		.sig_bits = 16,
+	};
+
+	return audio_request(GB_AUDIO_TYPE_SET_PCM, &req_data, sizeof(req_data));
+}
+
+static uint8_t audio_set_tx_data_size(uint16_t size)
+{
+	const struct gb_audio_set_tx_data_size_request req_data = {
+		.data_cport = sys_cpu_to_le16(DATA_CPORT),
+		.size = sys_cpu_to_le16(size),
+	};
+
+	return audio_request(GB_AUDIO_TYPE_SET_TX_DATA_SIZE, &req_data, sizeof(req_data));
+}
+
+/*
+ * Helper to send playback data. SEND_DATA has no response.
+ */
+static void audio_send_data(size_t size)
+{
+	struct gb_message *req =
+		gb_message_request_alloc(sizeof(struct gb_audio_send_data_request) + size,
+					 GB_AUDIO_TYPE_SEND_DATA, true);
+
+	zassert_not_null(req, "Failed to allocate request");
+	greybus_rx_handler(DATA_CPORT, req);
+}
+
+static void *audio_setup(void)
+{
+	const struct gb_audio_deactivate_tx_request req_data = {
+		.data_cport = sys_cpu_to_le16(DATA_CPORT),
+	};
+
+	/* Leave playback from a previous run stopped */
+	zassert_equal(audio_request(GB_AUDIO_TYPE_DEACTIVATE_TX, &req_data, sizeof(req_data)),
+		      GB_OP_SUCCESS, "Failed to deactivate playback");
+
+	return NULL;
+}
+
+ZTEST_SUITE(greybus_audio_tests, NULL, audio_setup, NULL, NULL, NULL);
+
+ZTEST(greybus_audio_tests, test_cport_count)
+{
+	zassert_equal(GREYBUS_CPORT_COUNT, 3, "Invalid number of cports");
+}
+
+ZTEST(greybus_audio_tests, test_malformed_requests)
+{
+	const __le16 data_cport = sys_cpu_to_le16(DATA_CPORT);
+	const struct gb_audio_get_pcm_request wrong_cport = {
+		.data_cport = sys_cpu_to_le16(MGMT_CPORT),
+	};
+
+	/* Short of the data cport */
+	zassert_equal(audio_request(GB_AUDIO_TYPE_GET_PCM, &data_cport, 1), GB_OP_INVALID,
+		      "Short request accepted");
+	zassert_equal(audio_request(GB_AUDIO_TYPE_SET_PCM, &data_cport, sizeof(data_cport)),
+		      GB_OP_INVALID, "Short request accepted");
+	zassert_equal(audio_request(GB_AUDIO_TYPE_ACTIVATE_TX, NULL, 0), GB_OP_INVALID,
+		      "Empty request accepted");
+
+	zassert_equal(audio_request(GB_AUDIO_TYPE_GET_PCM, &wrong_cport, sizeof(wrong_cport)),
+		      GB_OP_INVALID, "Wrong data cport accepted");
+
+	/* Not part of the topology */
+	zassert_equal(audio_request(GB_AUDIO_TYPE_GET_CONTROL, NULL, 0), GB_OP_INVALID,
+		      "Control request accepted");
+
+	zassert_equal(audio_set_pcm(BIT(0), 2), GB_OP_INVALID, "Unsupported format accepted");
+	zassert_equal(audio_set_pcm(GB_AUDIO_PCM_FMT_S16_LE, 0), GB_OP_INVALID,
+		      "Zero channels accepted");
+	zassert_equal(audio_set_pcm(GB_AUDIO_PCM_FMT_S16_LE, 3), GB_OP_INVALID,
+		      "Too many channels accepted");
+
+	zassert_equal(audio_set_pcm(GB_AUDIO_PCM_FMT_S16_LE, 2), GB_OP_SUCCESS,
+		      "Failed to set PCM");
+	zassert_equal(audio_set_tx_data_size(DATA_SIZE - 1), GB_OP_INVALID,
+		      "Partial frame accepted");
+	zassert_equal(audio_set_tx_data_size(CONFIG_GREYBUS_AUDIO_BLOCK_SIZE + 4), GB_OP_INVALID,
+		      "Data size over the block size accepted");
+}
+
+ZTEST(greybus_audio_tests, test_playback)
+{
+	struct gb_msg_with_cport event;
+	const struct gb_audio_streaming_event_request *event_data;
+	const struct gb_audio_activate_tx_request req_data = {
+		.data_cport = sys_cpu_to_le16(DATA_CPORT),
+	};
+
+	zassert_equal(audio_set_pcm(GB_AUDIO_PCM_FMT_S16_LE, 2), GB_OP_SUCCESS,
+		      "Failed to set PCM");
+
+	/* Setting the PCM clears the data size */
+	zassert_equal(audio_request(GB_AUDIO_TYPE_ACTIVATE_TX, &req_data, sizeof(req_data)),
+		      GB_OP_PROTOCOL_BAD, "Activated without a data size");
+
+	zassert_equal(audio_set_tx_data_size(DATA_SIZE), GB_OP_SUCCESS, "Failed to set data size");
+	zassert_equal(audio_request(GB_AUDIO_TYPE_ACTIVATE_TX, &req_data, sizeof(req_data)),
+		      GB_OP_SUCCESS, "Failed to activate playback");
+	zassert_equal(i2s_stub_state.tx_cfg.word_size, 16, "Invalid word size");
+	zassert_equal(i2s_stub_state.tx_cfg.channels, 2, "Invalid channels");
+	zassert_equal(i2s_stub_state.tx_cfg.frame_clk_freq, 48000, "Invalid frame rate");
+	zassert_equal(i2s_stub_state.tx_cfg.block_size, DATA_SIZE, "Invalid block size");
+
+	i2s_stub_state.writes = 0;
+	for (size_t i = 0; i < PREFILL - 1; i++) {
+		audio_send_data(DATA_SIZE);
+	}
+	k_msleep(50);
+	zassert_equal(i2s_stub_state.writes, PREFILL - 1, "Blocks not written");
+	zassert_false(i2s_stub_state.started, "Started before the buffer is filled");
+
+	audio_send_data(DATA_SIZE);
+	k_msleep(50);
+	zassert_equal(i2s_stub_state.writes, PREFILL, "Block not written");
+	zassert_equal(i2s_stub_state.write_size, DATA_SIZE, "Invalid block size written");
+	zassert_true(i2s_stub_state.started, "Playback not started");
+
+	/* Short data is dropped and reported on the management cport */
+	audio_send_data(DATA_SIZE / 2);
+	event = gb_transport_get_message();
+	zassert_equal(event.cport, MGMT_CPORT, "Invalid cport");
+	zassert_equal(gb_message_type(event.msg), GB_AUDIO_TYPE_STREAMING_EVENT,
+		      "Invalid event type");
+	event_data = (const struct gb_audio_streaming_event_request *)event.msg->payload;
+	zassert_equal(event_data->event, GB_AUDIO_STREAMING_EVENT_DATA_LEN, "Invalid event");
+	gb_message_dealloc(event.msg);
+	zassert_equal(i2s_stub_state.writes, PREFILL, "Short block written");
+
+	zassert_equal(audio_request(GB_AUDIO_TYPE_DEACTIVATE_TX, &req_data, sizeof(req_data)),
+		      GB_OP_SUCCESS, "Failed to deactivate playback");
+	zassert_false(i2s_stub_state.started, "Playback not stopped");
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_messages.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus-utils/manifest.h>
+#include <zephyr/sys/byteorder.h>
+#include "video_stub.h"
+
+#define MGMT_CPORT 1
+#define DATA_CPORT 2
+
+/* Camera protocol error code for requests in the wrong state */
+#define GB_CAM_OP_INVALID_STATE 0x80
+
+/* UYVY, 16 bits per pixel */
+#define GB_FORMAT_UYVY 0x01
+#define WIDTH          16
+#define HEIGHT         8
+#define FRAME_SIZE     (WIDTH * HEIGHT * 2)
+#define CHUNKS         (FRAME_SIZE / CONFIG_GREYBUS_CAMERA_CHUNK_SIZE)
+
+#define REQUEST_ID 7
+
+struct configure_streams_request {
+	struct gb_camera_configure_streams_request req;
+	struct gb_camera_stream_config_request config;
+} __packed;
+
+struct configure_streams_response {
+	struct gb_camera_configure_streams_response resp;
+	struct gb_camera_stream_config_response config;
+} __packed;
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+/*
+ * Helper to send a management request. Returns the response, which the caller frees.
+ */
+static struct gb_message *camera_request(uint8_t type, const void *payload, size_t len)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *req = gb_message_request_alloc(len, type, false);
+
+	zassert_not_null(req, "Failed to allocate request");
+	if (len) {
+		memcpy(req->payload, payload, len);
+	}
+	greybus_rx_handler(MGMT_CPORT, req);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, MGMT_CPORT, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+
+	return resp.msg;
+}
+
+/*
+ * Helper to send a management request. Returns the result of the response.
+ */
+static uint8_t camera_request_result(uint8_t type, const void *payload, size_t len)
+{
+	struct gb_message *resp = camera_request(type, payload, len);
+	const uint8_t result = resp->header.result;
+
+	gb_message_dealloc(resp);
+
+	return result;
+}
+
+static struct gb_message *camera_configure(uint16_t width, uint8_t flags)
+{
+	const struct configure_streams_request req_data = {
+		.req = {
+			.num_streams = 1,
+			.flags = flags,
+		},
+		.config = {
+			.width = sys_cpu_to_le16(width),
+			.height = sys_cpu_to_le16(HEIGHT),
+			.format = sys_cpu_to_le16(GB_FORMAT_UYVY),
+		},
+	};
+
+	return camera_request(GB_CAMERA_TYPE_CONFIGURE_STREAMS, &req_data, sizeof(req_data));
+}
+
+static void camera_unconfigure(void)
+{
+	const struct gb_camera_configure_streams_request req_data = {0};
+
+	zassert_equal(camera_request_result(GB_CAMERA_TYPE_CONFIGURE_STREAMS, &req_data,
+					    sizeof(req_data)),
+		      GB_OP_SUCCESS, "Failed to unconfigure");
+}
+
+/*
+ * Helper to check a frame chunk against the frames of the video stub
+ */
+static void chunk_check(const struct gb_message *msg, size_t index)
+{
+	const struct gb_camera_frame_chunk_request *chunk =
+		(const struct gb_camera_frame_chunk_request *)msg->payload;
+	const size_t offset = sys_le32_to_cpu(chunk->offset);
+	const uint8_t flags = (index == CHUNKS - 1) ? GB_CAMERA_FRAME_CHUNK_LAST : 0;
+
+	zassert_equal(gb_message_payload_len(msg),
+		      sizeof(*chunk) + CONFIG_GREYBUS_CAMERA_CHUNK_SIZE, "Invalid chunk size");
+	zassert_equal(sys_le32_to_cpu(chunk->request_id), REQUEST_ID, "Invalid request id");
+	zassert_equal(offset, index * CONFIG_GREYBUS_CAMERA_CHUNK_SIZE, "Chunks out of order");
+	zassert_equal(chunk->flags, flags, "Invalid chunk flags");
+
+	for (size_t i = 0; i < CONFIG_GREYBUS_CAMERA_CHUNK_SIZE; i++) {
+		zassert_equal(chunk->data[i], video_stub_pattern(offset + i),
+			      "Invalid frame data at %zu", offset + i);
+	}
+}
+
+static void *camera_setup(void)
+{
+	camera_unconfigure();
+
+	return NULL;
+}
+
+ZTEST_SUITE(greybus_camera_tests, NULL, camera_setup, NULL, NULL, NULL);
+
+ZTEST(greybus_camera_tests, test_cport_count)
+{
+	zassert_equal(GREYBUS_CPORT_COUNT, 3, "Invalid number of cports");
+}
+
+ZTEST(greybus_camera_tests, test_malformed_requests)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_camera_configure_streams_request streams = {
+		.num_streams = 1,
+	};
+	struct gb_camera_capture_request capture = {
+		.request_id = sys_cpu_to_le32(REQUEST_ID),
+		.streams = BIT(0),
+	};
+	static uint8_t too_many[sizeof(struct gb_camera_configure_streams_request) +
+				(GB_CAMERA_MAX_STREAMS + 1) *
+					sizeof(struct gb_camera_stream_config_request)];
+
+	camera_unconfigure();
+
+	zassert_equal(camera_request_result(GB_CAMERA_TYPE_CONFIGURE_STREAMS, NULL, 0),
+		      GB_OP_INVALID, "Empty request accepted");
+	/* A stream is announced but its configuration is missing */
+	zassert_equal(camera_request_result(GB_CAMERA_TYPE_CONFIGURE_STREAMS, &streams,
+					    sizeof(streams)),
+		      GB_OP_INVALID, "Short request accepted");
+
+	too_many[0] = GB_CAMERA_MAX_STREAMS + 1;
+	zassert_equal(camera_request_result(GB_CAMERA_TYPE_CONFIGURE_STREAMS, too_many,
+					    sizeof(too_many)),
+		      GB_OP_INVALID, "Too many streams accepted");
+
+	zassert_equal(camera_request_result(GB_CAMERA_TYPE_CAPTURE, &capture, sizeof(capture) - 1),
+		      GB_OP_INVALID, "Short request accepted");
+	capture.streams = BIT(1);
+	zassert_equal(camera_request_result(GB_CAMERA_TYPE_CAPTURE, &capture, sizeof(capture)),
+		      GB_OP_INVALID, "Unknown stream accepted");
+
+	/* Nothing to capture or flush before the stream is configured */
+	capture.streams = BIT(0);
+	zassert_equal(camera_request_result(GB_CAMERA_TYPE_CAPTURE, &capture, sizeof(capture)),
+		      GB_CAM_OP_INVALID_STATE, "Capture accepted while unconfigured");
+	zassert_equal(camera_request_result(GB_CAMERA_TYPE_FLUSH, NULL, 0),
+		      GB_CAM_OP_INVALID_STATE, "Flush accepted while unconfigured");
+
+	/* The AP sends nothing on the data cport */
+	greybus_rx_handler(DATA_CPORT, gb_message_request_alloc(0, GB_CAMERA_TYPE_CAPTURE, false));
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, DATA_CPORT, "Invalid cport");
+	zassert_equal(resp.msg->header.result, GB_OP_INVALID, "Data cport request accepted");
+	gb_message_dealloc(resp.msg);
+}
+
+ZTEST(greybus_camera_tests, test_stream)
+{
+	size_t chunks = 0;
+	bool metadata = false, response = false;
+	struct gb_message *resp;
+	struct gb_msg_with_cport msg;
+	const struct configure_streams_response *cfg;
+	const struct gb_camera_metadata_request *meta_req;
+	const struct gb_camera_frame_metadata *meta;
+	const struct gb_camera_flush_response *flush;
+	const struct gb_camera_capture_request capture = {
+		.request_id = sys_cpu_to_le32(REQUEST_ID),
+		.streams = BIT(0),
+		.num_frames = sys_cpu_to_le16(1),
+	};
+
+	/* An odd width does not fit the video device, it is only reported */
+	resp = camera_configure(WIDTH + 1, GB_CAMERA_CONFIGURE_STREAMS_TEST_ONLY);
+	cfg = (const struct configure_streams_response *)resp->payload;
+	zassert_true(gb_message_is_success(resp), "Failed to test configuration");
+	zassert_equal(cfg->resp.flags, GB_CAMERA_CONFIGURE_STREAMS_ADJUSTED, "Not adjusted");
+	zassert_equal(sys_le16_to_cpu(cfg->config.width), WIDTH, "Invalid adjusted width");
+	gb_message_dealloc(resp);
+
+	resp = camera_configure(WIDTH, 0);
+	cfg = (const struct configure_streams_response *)resp->payload;
+	zassert_true(gb_message_is_success(resp), "Failed to configure");
+	zassert_equal(cfg->resp.flags, 0, "Valid configuration adjusted");
+	zassert_equal(sys_le32_to_cpu(cfg->config.max_size), FRAME_SIZE, "Invalid frame size");
+	zassert_equal(sys_le16_to_cpu(cfg->config.max_pkt_size), CONFIG_GREYBUS_CAMERA_CHUNK_SIZE,
+		      "Invalid chunk size");
+	gb_message_dealloc(resp);
+	zassert_equal(video_stub_state.fmt.width, WIDTH, "Format not applied");
+
+	greybus_rx_handler(MGMT_CPORT,
+			   gb_message_request_alloc_with_payload(&capture, sizeof(capture),
+								 GB_CAMERA_TYPE_CAPTURE, false));
+
+	/* The frame may be sent before the capture response */
+	for (size_t i = 0; i < CHUNKS + 2; i++) {
+		msg = gb_transport_get_message();
+
+		switch (gb_message_type(msg.msg)) {
+		case GB_RESPONSE(GB_CAMERA_TYPE_CAPTURE):
+			zassert_true(gb_message_is_success(msg.msg), "Capture failed");
+			response = true;
+			break;
+		case GB_CAMERA_TYPE_VENDOR_FRAME_CHUNK:
+			zassert_equal(msg.cport, DATA_CPORT, "Chunk on the wrong cport");
+			chunk_check(msg.msg, chunks++);
+			break;
+		case GB_CAMERA_TYPE_METADATA:
+			meta_req = (const struct gb_camera_metadata_request *)msg.msg->payload;
+			meta = (const struct gb_camera_frame_metadata *)meta_req->metadata;
+			zassert_equal(msg.cport, MGMT_CPORT, "Metadata on the wrong cport");
+			zassert_equal(chunks, CHUNKS, "Metadata before the frame");
+			zassert_equal(sys_le32_to_cpu(meta_req->request_id), REQUEST_ID,
+				      "Invalid request id");
+			zassert_equal(sys_le32_to_cpu(meta->size), FRAME_SIZE,
+				      "Invalid frame size");
+			metadata = true;
+			break;
+		default:
+			zassert_unreachable("Unexpected message 0x%02x", gb_message_type(msg.msg));
+		}
+
+		gb_message_dealloc(msg.msg);
+	}
+
+	zassert_true(response && metadata, "Capture incomplete");
+
+	resp = camera_request(GB_CAMERA_TYPE_FLUSH, NULL, 0);
+	flush = (const struct gb_camera_flush_response *)resp->payload;
+	zassert_true(gb_message_is_success(resp), "Flush failed");
+	zassert_equal(sys_le32_to_cpu(flush->request_id), REQUEST_ID, "Invalid request id");
+	gb_message_dealloc(resp);
+	zassert_false(video_stub_state.streaming, "Video device not stopped");
+
+	camera_unconfigure();
+}
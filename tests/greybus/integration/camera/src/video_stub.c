@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT test_video_stub
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/video.h>
+#include "video_stub.h"
+
+struct video_stub_state video_stub_state;
+
+K_MSGQ_DEFINE(video_stub_bufs, sizeof(struct video_buffer *), CONFIG_VIDEO_BUFFER_POOL_NUM_MAX,
+	      sizeof(void *));
+
+static const struct video_format_cap video_stub_caps[] = {
+	{
+		.pixelformat = VIDEO_PIX_FMT_UYVY,
+		.width_min = VIDEO_STUB_WIDTH_MIN,
+		.width_max = VIDEO_STUB_WIDTH_MAX,
+		.height_min = VIDEO_STUB_HEIGHT_MIN,
+		.height_max = VIDEO_STUB_HEIGHT_MAX,
+		.width_step = 2,
+		.height_step = 1,
+	},
+	{0},
+};
+
+static int video_stub_set_format(const struct device *dev, struct video_format *fmt)
+{
+	if (fmt->pixelformat != VIDEO_PIX_FMT_UYVY) {
+		return -ENOTSUP;
+	}
+
+	fmt->pitch = fmt->width * 2;
+	video_stub_state.fmt = *fmt;
+
+	return 0;
+}
+
+static int video_stub_get_format(const struct device *dev, struct video_format *fmt)
+{
+	*fmt = video_stub_state.fmt;
+
+	return 0;
+}
+
+static int video_stub_set_stream(const struct device *dev, bool enable, enum video_buf_type type)
+{
+	video_stub_state.streaming = enable;
+
+	return 0;
+}
+
+static int video_stub_enqueue(const struct device *dev, struct video_buffer *vbuf)
+{
+	return k_msgq_put(&video_stub_bufs, &vbuf, K_NO_WAIT);
+}
+
+static int video_stub_dequeue(const struct device *dev, struct video_buffer **vbuf,
+			      k_timeout_t timeout)
+{
+	const struct video_format *fmt = &video_stub_state.fmt;
+	int ret;
+
+	ret = k_msgq_get(&video_stub_bufs, vbuf, timeout);
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* Buffers taken back after stopping carry no frame */
+	(*vbuf)->bytesused = 0;
+	if (!video_stub_state.streaming) {
+		return 0;
+	}
+
+	(*vbuf)->bytesused = MIN((*vbuf)->size, fmt->pitch * fmt->height);
+	for (size_t i = 0; i < (*vbuf)->bytesused; i++) {
+		(*vbuf)->buffer[i] = video_stub_pattern(i);
+	}
+	(*vbuf)->timestamp = k_uptime_get_32();
+	video_stub_state.frames++;
+
+	return 0;
+}
+
+static int video_stub_get_caps(const struct device *dev, struct video_caps *caps)
+{
+	caps->format_caps = video_stub_caps;
+	caps->min_vbuf_count = 1;
+
+	return 0;
+}
+
+static DEVICE_API(video, video_stub_api) = {
+	.set_format = video_stub_set_format,
+	.get_format = video_stub_get_format,
+	.set_stream = video_stub_set_stream,
+	.enqueue = video_stub_enqueue,
+	.dequeue = video_stub_dequeue,
+	.get_caps = video_stub_get_caps,
+};
+
+#define VIDEO_STUB_INIT(n)                                                                         \
+	DEVICE_DT_INST_DEFINE(n, NULL, NULL, NULL, NULL, POST_KERNEL,                              \
+			      CONFIG_VIDEO_INIT_PRIORITY, &video_stub_api);
+
+DT_INST_FOREACH_STATUS_OKAY(VIDEO_STUB_INIT)
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _VIDEO_STUB_H_
+#define _VIDEO_STUB_H_
+
+#include <stdbool.h>
+#include <zephyr/drivers/video.h>
+
+#define VIDEO_STUB_WIDTH_MIN  2
+#define VIDEO_STUB_WIDTH_MAX  64
+#define VIDEO_STUB_HEIGHT_MIN 2
+#define VIDEO_STUB_HEIGHT_MAX 64
+
+struct video_stub_state {
+	struct video_format fmt;
+	/* Buffers dequeued while streaming are filled with a frame */
+	bool streaming;
+	uint32_t frames;
+};
+
+extern struct video_stub_state video_stub_state;
+
+/* Byte at offset of every frame */
+static inline uint8_t video_stub_pattern(size_t offset)
+{
+	return offset * 3;
+}
+
+#endif // _VIDEO_STUB_H_
@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "greybus/greybus_messages.h"
+#include <string.h>
+#include <zephyr/ztest.h>
+#include <zephyr/irq_offload.h>
+#include <zephyr/sys/crc.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus-utils/manifest.h>
+#include <greybus/greybus_timesync.h>
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+ZTEST_SUITE(greybus_control_tests, NULL, NULL, NULL, NULL, NULL);
+
+ZTEST(greybus_control_tests, test_cport_count)
+{
+	zassert_equal(GREYBUS_CPORT_COUNT, 1, "Invalid number of cports");
+}
+
+ZTEST(greybus_control_tests, test_operation_id_wrap)
+{
+	atomic_t counter = ATOMIC_INIT(0);
+
+	zassert_equal(gb_operation_id_next(&counter), 1, "Ids should start at 1");
+
+	atomic_set(&counter, UINT16_MAX - 1);
+	zassert_equal(gb_operation_id_next(&counter), UINT16_MAX, "Largest id skipped");
+	zassert_equal(gb_operation_id_next(&counter), 1, "Ids should wrap to 1, 0 is oneshot");
+}
+
+ZTEST(greybus_control_tests, test_manifest_hash)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *req = gb_message_request_alloc(0, GB_CONTROL_TYPE_GET_MANIFEST, false);
+
+	greybus_rx_handler(0, req);
+	resp = gb_transport_get_message();
+
+	zassert_true(gb_message_is_success(resp.msg), "Get manifest failed");
+	zassert_equal(manifest_hash(),
+		      crc32_ieee(resp.msg->payload, gb_message_payload_len(resp.msg)),
+		      "Hash does not match the manifest sent to the host");
+
+	gb_message_dealloc(resp.msg);
+}
+
+ZTEST(greybus_control_tests, test_heap_stats)
+{
+	struct gb_msg_with_cport resp;
+	const struct gb_control_heap_stats_response *resp_data;
+	struct gb_message *req =
+		gb_message_request_alloc(0, GB_CONTROL_TYPE_VENDOR_HEAP_STATS, false);
+	uint32_t total = 0;
+
+	greybus_rx_handler(0, req);
+	resp = gb_transport_get_message();
+
+	zassert_true(gb_message_is_success(resp.msg), "Heap stats request failed");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(GB_CONTROL_TYPE_VENDOR_HEAP_STATS),
+		      "Invalid response type");
+	zassert_equal(gb_message_payload_len(resp.msg), sizeof(*resp_data),
+		      "Invalid response size");
+
+	resp_data = (const struct gb_control_heap_stats_response *)resp.msg->payload;
+
+	/* The request itself is still allocated when the stats are taken */
+	zassert_true(sys_le32_to_cpu(resp_data->cur_bytes) > 0, "Current usage not tracked");
+	zassert_true(sys_le32_to_cpu(resp_data->peak_bytes) >=
+			     sys_le32_to_cpu(resp_data->cur_bytes),
+		     "Peak below current usage");
+	zassert_true(sys_le32_to_cpu(resp_data->allocs) > sys_le32_to_cpu(resp_data->frees),
+		     "Invalid alloc/free counters");
+	zassert_equal(sys_le32_to_cpu(resp_data->failures), 0, "Unexpected failures");
+
+	for (size_t i = 0; i < ARRAY_SIZE(resp_data->histogram); i++) {
+		total += sys_le32_to_cpu(resp_data->histogram[i]);
+	}
+	zassert_equal(total, sys_le32_to_cpu(resp_data->allocs), "Histogram does not add up");
+
+	gb_message_dealloc(resp.msg);
+}
+
+static uint8_t bundle_pm_request(uint8_t type, uint8_t bundle)
+{
+	struct gb_msg_with_cport resp;
+	const struct gb_control_bundle_pm_request req_data = {
+		.bundle_id = bundle,
+	};
+	struct gb_message *req = gb_message_request_alloc_with_payload(&req_data, sizeof(req_data),
+									type, false);
+	uint8_t status;
+
+	greybus_rx_handler(0, req);
+	resp = gb_transport_get_message();
+
+	zassert_true(gb_message_is_success(resp.msg), "Bundle PM request failed");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+	zassert_equal(gb_message_payload_len(resp.msg),
+		      sizeof(struct gb_control_bundle_pm_response), "Invalid response size");
+
+	status = ((const struct gb_control_bundle_pm_response *)resp.msg->payload)->status;
+	gb_message_dealloc(resp.msg);
+
+	return status;
+}
+
+ZTEST(greybus_control_tests, test_bundle_suspend_resume)
+{
+	zassert_equal(bundle_pm_request(GB_CONTROL_TYPE_BUNDLE_SUSPEND, 0),
+		      GB_CONTROL_BUNDLE_PM_OK, "Bundle suspend failed");
+	/* Suspending again is not an error */
+	zassert_equal(bundle_pm_request(GB_CONTROL_TYPE_BUNDLE_SUSPEND, 0),
+		      GB_CONTROL_BUNDLE_PM_OK, "Repeated bundle suspend failed");
+	zassert_equal(bundle_pm_request(GB_CONTROL_TYPE_BUNDLE_RESUME, 0),
+		      GB_CONTROL_BUNDLE_PM_OK, "Bundle resume failed");
+}
+
+ZTEST(greybus_control_tests, test_bundle_pm_invalid)
+{
+	zassert_equal(bundle_pm_request(GB_CONTROL_TYPE_BUNDLE_SUSPEND, 5),
+		      GB_CONTROL_BUNDLE_PM_INVAL, "Suspended a missing bundle");
+	zassert_equal(bundle_pm_request(GB_CONTROL_TYPE_BUNDLE_RESUME, 5),
+		      GB_CONTROL_BUNDLE_PM_INVAL, "Resumed a missing bundle");
+}
+
+static struct gb_message *timesync_request(uint8_t type, const void *payload, size_t len)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *req = payload ? gb_message_request_alloc_with_payload(payload, len, type,
+										 false)
+					 : gb_message_request_alloc(0, type, false);
+
+	greybus_rx_handler(0, req);
+	resp = gb_transport_get_message();
+
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+
+	return resp.msg;
+}
+
+ZTEST(greybus_control_tests, test_timesync)
+{
+	const struct gb_control_timesync_enable_request enable = {
+		.count = 1,
+		.frame_time = sys_cpu_to_le64(1000000),
+		.refclk = sys_cpu_to_le32(1000000),
+	};
+	const struct gb_control_timesync_authoritative_request authoritative = {
+		.frame_time = {sys_cpu_to_le64(5000000)},
+	};
+	const struct gb_control_timesync_get_last_event_response *last_event;
+	struct gb_message *resp;
+	uint64_t frame_time;
+
+	resp = timesync_request(GB_CONTROL_TYPE_TIMESYNC_DISABLE, NULL, 0);
+	zassert_true(gb_message_is_success(resp), "TimeSync disable failed");
+	gb_message_dealloc(resp);
+	zassert_equal(gb_timesync_get_frame_time(&frame_time), -EAGAIN, "Synced while disabled");
+
+	resp = timesync_request(GB_CONTROL_TYPE_TIMESYNC_ENABLE, &enable, sizeof(enable));
+	zassert_true(gb_message_is_success(resp), "TimeSync enable failed");
+	gb_message_dealloc(resp);
+
+	/* Without a strobe GPIO, the enable request is the strobe */
+	resp = timesync_request(GB_CONTROL_TYPE_TIMESYNC_GET_LAST_EVENT, NULL, 0);
+	zassert_true(gb_message_is_success(resp), "TimeSync get last event failed");
+	zassert_equal(gb_message_payload_len(resp), sizeof(*last_event), "Invalid response size");
+	last_event = (const struct gb_control_timesync_get_last_event_response *)resp->payload;
+	zassert_equal(sys_le64_to_cpu(last_event->frame_time), 1000000, "Invalid last event");
+	gb_message_dealloc(resp);
+
+	resp = timesync_request(GB_CONTROL_TYPE_TIMESYNC_AUTHORITATIVE, &authoritative,
+				sizeof(authoritative));
+	zassert_true(gb_message_is_success(resp), "TimeSync authoritative failed");
+	gb_message_dealloc(resp);
+
+	/* The frame time counts microseconds with a 1 MHz refclk */
+	k_msleep(10);
+	zassert_ok(gb_timesync_get_frame_time(&frame_time), "Not synced");
+	zassert_true(frame_time >= 5000000 + 10000, "Frame time did not advance");
+	zassert_true(frame_time < 5000000 + 1000000, "Frame time advanced too far");
+
+	resp = timesync_request(GB_CONTROL_TYPE_TIMESYNC_DISABLE, NULL, 0);
+	gb_message_dealloc(resp);
+	zassert_equal(gb_timesync_get_frame_time(&frame_time), -EAGAIN, "Synced after disable");
+}
+
+static void alloc_isr_handler(const void *param)
+{
+	struct gb_message **msg = (struct gb_message **)param;
+
+	*msg = gb_message_alloc_isr(16, GB_CONTROL_TYPE_VERSION, 0, 0);
+}
+
+ZTEST(greybus_control_tests, test_message_alloc_isr)
+{
+	struct gb_message *msg = NULL;
+
+	irq_offload(alloc_isr_handler, &msg);
+
+	zassert_not_null(msg, "Allocation in interrupt context failed");
+	zassert_equal(gb_message_payload_len(msg), 16, "Invalid payload length");
+	gb_message_dealloc(msg);
+}
+
+#ifdef CONFIG_GREYBUS_STACK_STATS
+static void find_rx_worker(const struct k_thread *thread, void *user_data)
+{
+	const struct k_thread **found = user_data;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+
+	if (name && !strcmp(name, "gb_rx")) {
+		*found = thread;
+	}
+}
+
+ZTEST(greybus_control_tests, test_stack_stats)
+{
+	const struct k_thread *worker = NULL;
+	size_t unused;
+	struct gb_msg_with_cport resp;
+	struct gb_message *req = gb_message_request_alloc(0, GB_CONTROL_TYPE_VERSION, false);
+
+	greybus_rx_handler(0, req);
+	resp = gb_transport_get_message();
+	gb_message_dealloc(resp.msg);
+
+	k_thread_foreach(find_rx_worker, &worker);
+	zassert_not_null(worker, "RX worker not named");
+	zassert_ok(k_thread_stack_space_get(worker, &unused), "No stack usage");
+	zassert_true(unused < worker->stack_info.size, "Stack not used");
+}
+#endif // CONFIG_GREYBUS_STACK_STATS
+
+#ifdef CONFIG_GREYBUS_ENERGY_STATS
+static uint8_t energy_stats_request(uint8_t bundle,
+				    struct gb_control_energy_stats_response *resp_data)
+{
+	struct gb_msg_with_cport resp;
+	const struct gb_control_energy_stats_request req_data = {
+		.bundle_id = bundle,
+	};
+	struct gb_message *req = gb_message_request_alloc_with_payload(
+		&req_data, sizeof(req_data), GB_CONTROL_TYPE_VENDOR_ENERGY_STATS, false);
+	uint8_t result;
+
+	greybus_rx_handler(0, req);
+	resp = gb_transport_get_message();
+
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(GB_CONTROL_TYPE_VENDOR_ENERGY_STATS),
+		      "Invalid response type");
+	result = resp.msg->header.result;
+	if (result == GB_OP_SUCCESS) {
+		zassert_equal(gb_message_payload_len(resp.msg), sizeof(*resp_data),
+			      "Invalid response size");
+		memcpy(resp_data, resp.msg->payload, sizeof(*resp_data));
+	}
+	gb_message_dealloc(resp.msg);
+
+	return result;
+}
+
+ZTEST(greybus_control_tests, test_energy_stats)
+{
+	struct gb_control_energy_stats_response first, second;
+	uint64_t msgs, bytes;
+
+	zassert_equal(energy_stats_request(0, &first), GB_OP_SUCCESS, "Energy stats failed");
+	zassert_equal(energy_stats_request(0, &second), GB_OP_SUCCESS, "Energy stats failed");
+
+	/* Each request is accounted for before it is handled */
+	zassert_true(sys_le32_to_cpu(second.rx_msgs) > sys_le32_to_cpu(first.rx_msgs),
+		     "Request not accounted");
+	zassert_true(sys_le32_to_cpu(second.tx_msgs) > sys_le32_to_cpu(first.tx_msgs),
+		     "Response not accounted");
+
+	msgs = (uint64_t)sys_le32_to_cpu(second.rx_msgs) + sys_le32_to_cpu(second.tx_msgs);
+	bytes = (uint64_t)sys_le32_to_cpu(second.rx_bytes) + sys_le32_to_cpu(second.tx_bytes);
+	zassert_equal(sys_le64_to_cpu(second.radio_us),
+		      msgs * CONFIG_GREYBUS_ENERGY_RADIO_US_PER_MSG +
+			      bytes * CONFIG_GREYBUS_ENERGY_RADIO_NS_PER_BYTE / NSEC_PER_USEC,
+		      "Invalid radio time estimate");
+	zassert_true(sys_le64_to_cpu(second.cpu_us) >= sys_le64_to_cpu(first.cpu_us),
+		     "Handler time went backwards");
+
+	zassert_equal(energy_stats_request(5, &first), GB_OP_INVALID, "Reported a missing bundle");
+}
+#endif // CONFIG_GREYBUS_ENERGY_STATS
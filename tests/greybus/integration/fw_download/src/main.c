@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_messages.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/service.h>
+#include <greybus-utils/manifest.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#define FW_TAG "s2l"
+
+#define PLAIN_SIZE 100
+
+/* A download the test serves as the AP */
+struct fw_download {
+	/* Both the request id and the firmware id */
+	uint8_t id;
+	uint8_t load_method;
+	const uint8_t *image;
+	size_t size;
+	/* Fetches answered before leaving the download to itself, 0 to serve all of them */
+	size_t fetch_limit;
+	/* End of the furthest chunk requested */
+	size_t fetched;
+	size_t fetches;
+	bool released;
+	bool loaded;
+};
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+static uint8_t plain_image[PLAIN_SIZE];
+
+static uint8_t image_pattern(size_t i)
+{
+	return (i * 7 + 1) & 0xff;
+}
+
+/* Helper to answer a fetch of the current download */
+static void fw_fetch(struct fw_download *dl, struct gb_message *req)
+{
+	const struct gb_fw_download_fetch_firmware_request *req_data =
+		(const struct gb_fw_download_fetch_firmware_request *)req->payload;
+	const size_t offset = sys_le32_to_cpu(req_data->offset);
+	const size_t size = sys_le32_to_cpu(req_data->size);
+
+	zassert_true(size > 0 && size <= CONFIG_GREYBUS_FW_DOWNLOAD_CHUNK_SIZE, "Invalid size");
+	zassert_true(offset + size <= dl->size, "Fetch past the end of the image");
+
+	dl->fetched = MAX(dl->fetched, offset + size);
+	dl->fetches++;
+
+	greybus_rx_handler(GREYBUS_FW_DOWNLOAD_CPORT,
+			   gb_message_response_alloc_from_req(dl->image + offset, size, req,
+							      GB_OP_SUCCESS));
+}
+
+/* Helper to handle a message of the module on the firmware management cport */
+static void fw_mgmt_message(struct fw_download *dl, const struct gb_message *msg)
+{
+	const struct gb_fw_mgmt_loaded_fw_request *loaded =
+		(const struct gb_fw_mgmt_loaded_fw_request *)msg->payload;
+
+	switch (gb_message_type(msg)) {
+	case GB_RESPONSE(GB_FW_MGMT_TYPE_LOAD_AND_VALIDATE_FW):
+		zassert_true(gb_message_is_success(msg), "Failed to load firmware");
+		break;
+	case GB_FW_MGMT_TYPE_LOADED_FW:
+		zassert_equal(loaded->request_id, dl->id, "Invalid request id");
+		zassert_true(dl->released, "Loaded before the firmware was released");
+		dl->loaded = true;
+		break;
+	default:
+		zassert_unreachable("Unexpected message 0x%02x", gb_message_type(msg));
+	}
+}
+
+/* Helper to handle a message of the module on the firmware download cport */
+static void fw_download_message(struct fw_download *dl, struct gb_message *msg)
+{
+	const struct gb_fw_download_fetch_firmware_request *fetch =
+		(const struct gb_fw_download_fetch_firmware_request *)msg->payload;
+	const struct gb_fw_download_release_firmware_request *release =
+		(const struct gb_fw_download_release_firmware_request *)msg->payload;
+	const struct gb_fw_download_find_firmware_response find = {
+		.firmware_id = dl->id,
+		.size = sys_cpu_to_le32(dl->size),
+	};
+
+	switch (gb_message_type(msg)) {
+	case GB_FW_DOWNLOAD_TYPE_FIND_FIRMWARE:
+		zassert_str_equal((const char *)msg->payload, FW_TAG, "Invalid tag");
+		greybus_rx_handler(GREYBUS_FW_DOWNLOAD_CPORT,
+				   gb_message_response_alloc_from_req(&find, sizeof(find), msg,
+								      GB_OP_SUCCESS));
+		break;
+	case GB_FW_DOWNLOAD_TYPE_FETCH_FIRMWARE:
+		if (fetch->firmware_id == dl->id) {
+			fw_fetch(dl, msg);
+		}
+		break;
+	case GB_FW_DOWNLOAD_TYPE_RELEASE_FIRMWARE:
+		zassert_equal(release->firmware_id, dl->id, "Invalid firmware released");
+		dl->released = true;
+		break;
+	default:
+		zassert_unreachable("Unexpected message 0x%02x", gb_message_type(msg));
+	}
+}
+
+/*
+ * Helper to ask for a firmware and serve it until the module reports it loaded, or until
+ * fetch_limit chunks have been served. Fetches of earlier downloads are dropped.
+ */
+static void fw_download_serve(struct fw_download *dl)
+{
+	struct gb_msg_with_cport msg;
+	struct gb_message *req;
+	const struct gb_fw_mgmt_load_and_validate_fw_request req_data = {
+		.request_id = dl->id,
+		.load_method = dl->load_method,
+		.firmware_tag = FW_TAG,
+	};
+
+	req = gb_message_request_alloc_with_payload(&req_data, sizeof(req_data),
+						    GB_FW_MGMT_TYPE_LOAD_AND_VALIDATE_FW, false);
+	zassert_not_null(req, "Failed to allocate request");
+	greybus_rx_handler(GREYBUS_FW_MANAGEMENT_CPORT, req);
+
+	while (!dl->loaded && (!dl->fetch_limit || dl->fetches < dl->fetch_limit)) {
+		msg = gb_transport_get_message();
+
+		if (msg.cport == GREYBUS_FW_MANAGEMENT_CPORT) {
+			fw_mgmt_message(dl, msg.msg);
+		} else {
+			zassert_equal(msg.cport, GREYBUS_FW_DOWNLOAD_CPORT, "Invalid cport");
+			fw_download_message(dl, msg.msg);
+		}
+
+		gb_message_dealloc(msg.msg);
+	}
+}
+
+/* Helper to check the secondary slot against the expected image */
+static void slot_check(const uint8_t *expected, size_t size)
+{
+	uint8_t buf[16];
+	size_t n;
+	const struct flash_area *fa;
+
+	zassert_ok(flash_area_open(FIXED_PARTITION_ID(slot1_partition), &fa), "Failed to open");
+	for (size_t off = 0; off < size; off += n) {
+		n = MIN(size - off, sizeof(buf));
+		zassert_ok(flash_area_read(fa, off, buf, n), "Failed to read");
+		zassert_mem_equal(buf, expected + off, n, "Invalid image at %zu", off);
+	}
+	flash_area_close(fa);
+}
+
+/* Helper to check that nothing reached the secondary slot */
+static void slot_check_erased(size_t size)
+{
+	uint8_t buf[16];
+	size_t n;
+	const struct flash_area *fa;
+
+	zassert_ok(flash_area_open(FIXED_PARTITION_ID(slot1_partition), &fa), "Failed to open");
+	for (size_t off = 0; off < size; off += n) {
+		n = MIN(size - off, sizeof(buf));
+		zassert_ok(flash_area_read(fa, off, buf, n), "Failed to read");
+		for (size_t i = 0; i < n; i++) {
+			zassert_equal(buf[i], 0xff, "Image written at %zu", off + i);
+		}
+	}
+	flash_area_close(fa);
+}
+
+static void *fw_download_setup(void)
+{
+	zassert_ok(greybus_service_wait(K_SECONDS(5)), "Greybus service failed to start");
+
+	for (size_t i = 0; i < sizeof(plain_image); i++) {
+		plain_image[i] = image_pattern(i);
+	}
+
+	return NULL;
+}
+
+static void fw_download_before(void *fixture)
+{
+	const struct flash_area *fa;
+
+	ARG_UNUSED(fixture);
+
+	zassert_ok(flash_area_open(FIXED_PARTITION_ID(slot1_partition), &fa), "Failed to open");
+	zassert_ok(flash_area_erase(fa, 0, fa->fa_size), "Failed to erase");
+	flash_area_close(fa);
+}
+
+ZTEST_SUITE(greybus_fw_download_tests, NULL, fw_download_setup, fw_download_before, NULL, NULL);
+
+ZTEST(greybus_fw_download_tests, test_cport_count)
+{
+	zassert_equal(GREYBUS_CPORT_COUNT, 3, "Invalid number of cports");
+}
+
+ZTEST(greybus_fw_download_tests, test_plain)
+{
+	struct fw_download dl = {
+		.id = 1,
+		.load_method = GB_FW_LOAD_METHOD_UNIPRO,
+		.image = plain_image,
+		.size = sizeof(plain_image),
+	};
+
+	fw_download_serve(&dl);
+	zassert_equal(dl.fetched, dl.size, "Image not fetched");
+	slot_check(plain_image, sizeof(plain_image));
+}
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK
+
+/*
+ * "heatshrink -w 8 -l 4" style stream with its header: 14 literals, 4 backrefs of 16 bytes at
+ * offset 14 and 3 more literals. With 16 byte chunks, one literal and one backref are split
+ * across chunks.
+ */
+static const uint8_t hs_image[] = {
+	0x47, 0x42, 0x48, 0x53, 0x08, 0x04, 0x00, 0x00, 0x51, 0x00, 0x00, 0x00, 0x98,
+	0x4c, 0x66, 0x53, 0x39, 0xa4, 0xd6, 0x6d, 0x37, 0x9c, 0x4e, 0x6c, 0x36, 0x2b,
+	0x1d, 0x90, 0x1b, 0xe0, 0xdf, 0x06, 0xf8, 0x37, 0xef, 0x17, 0x9b, 0xd0,
+};
+
+static const char hs_expected[] = "0123456789abcd0123456789abcd0123456789abcd0123456789abcd"
+				  "0123456789abcd01234567xyz";
+
+/* Offsets of the header fields */
+#define HS_WINDOW_BITS 4
+#define HS_SIZE        8
+
+ZTEST(greybus_fw_download_tests, test_heatshrink)
+{
+	struct fw_download dl = {
+		.id = 2,
+		.load_method = GB_FW_LOAD_METHOD_UNIPRO,
+		.image = hs_image,
+		.size = sizeof(hs_image),
+	};
+
+	/* More output than the decoder buffers at once */
+	BUILD_ASSERT(sizeof(hs_expected) - 1 > 64);
+	zassert_equal(sys_get_le32(hs_image + HS_SIZE), sizeof(hs_expected) - 1,
+		      "Invalid test vector");
+
+	fw_download_serve(&dl);
+	zassert_equal(dl.fetched, dl.size, "Image not fetched");
+	slot_check((const uint8_t *)hs_expected, sizeof(hs_expected) - 1);
+}
+
+ZTEST(greybus_fw_download_tests, test_heatshrink_window)
+{
+	static uint8_t image[sizeof(hs_image)];
+	struct fw_download dl = {
+		.id = 3,
+		.load_method = GB_FW_LOAD_METHOD_UNIPRO,
+		.image = image,
+		.size = sizeof(image),
+	};
+
+	/* Takes a larger window than the decoder has */
+	memcpy(image, hs_image, sizeof(image));
+	image[HS_WINDOW_BITS] = CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK_WINDOW_BITS + 1;
+
+	fw_download_serve(&dl);
+	slot_check_erased(sizeof(hs_expected) - 1);
+}
+
+ZTEST(greybus_fw_download_tests, test_heatshrink_truncated)
+{
+	static uint8_t image[sizeof(hs_image)];
+	struct fw_download dl = {
+		.id = 4,
+		.load_method = GB_FW_LOAD_METHOD_UNIPRO,
+		.image = image,
+		.size = sizeof(image),
+	};
+
+	/* The stream ends one byte short of the announced size */
+	memcpy(image, hs_image, sizeof(image));
+	sys_put_le32(sizeof(hs_expected), image + HS_SIZE);
+
+	fw_download_serve(&dl);
+	slot_check_erased(sizeof(hs_expected));
+}
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_HEATSHRINK
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
+
+/* Spans three erase blocks of the native_sim flash */
+#define ERASE_IMAGE_SIZE (2 * 4096 + 16)
+
+static uint8_t erase_image[ERASE_IMAGE_SIZE];
+
+/*
+ * Helper to fill the image and program the part of the secondary slot it goes to, so that none
+ * of it can be written before being erased again
+ */
+static void erase_test_init(void)
+{
+	static const uint8_t zeros[64];
+	size_t n;
+	const struct flash_area *fa;
+
+	for (size_t i = 0; i < sizeof(erase_image); i++) {
+		erase_image[i] = image_pattern(i);
+	}
+
+	zassert_ok(flash_area_open(FIXED_PARTITION_ID(slot1_partition), &fa), "Failed to open");
+	for (size_t off = 0; off < sizeof(erase_image); off += n) {
+		n = MIN(sizeof(erase_image) - off, sizeof(zeros));
+		zassert_ok(flash_area_write(fa, off, zeros, n), "Failed to write");
+	}
+	flash_area_close(fa);
+}
+
+ZTEST(greybus_fw_download_tests, test_erase_ahead)
+{
+	struct fw_download dl = {
+		.id = 7,
+		.load_method = GB_FW_LOAD_METHOD_UNIPRO,
+		.image = erase_image,
+		.size = sizeof(erase_image),
+	};
+
+	erase_test_init();
+
+	/* The writer waits for every block the eraser has not reached yet */
+	fw_download_serve(&dl);
+	zassert_equal(dl.fetched, dl.size, "Image not fetched");
+	slot_check(erase_image, sizeof(erase_image));
+}
+
+ZTEST(greybus_fw_download_tests, test_erase_ahead_cancel)
+{
+	struct fw_download first = {
+		.id = 8,
+		.load_method = GB_FW_LOAD_METHOD_UNIPRO,
+		.image = erase_image,
+		.size = sizeof(erase_image),
+		.fetch_limit = 2,
+	};
+	struct fw_download second = {
+		.id = 9,
+		.load_method = GB_FW_LOAD_METHOD_UNIPRO,
+		.image = erase_image,
+		.size = sizeof(erase_image),
+	};
+
+	erase_test_init();
+
+	/*
+	 * The second request supersedes the first download while its writer may be waiting for
+	 * the eraser. The first one is never reported, and erasing starts over.
+	 */
+	fw_download_serve(&first);
+	fw_download_serve(&second);
+	zassert_false(first.loaded, "Superseded download loaded");
+	zassert_equal(second.fetched, second.size, "Image not fetched");
+	slot_check(erase_image, sizeof(erase_image));
+}
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_ERASE_AHEAD
+
+#ifdef CONFIG_GREYBUS_FW_DOWNLOAD_DELTA
+
+#define DELTA_SOURCE_SIZE 64
+#define DELTA_TARGET_SIZE 80
+/* Offsets in the delta image of the source crc and of the first record */
+#define DELTA_SOURCE_CRC 8
+#define DELTA_RECORD     16
+
+static uint8_t delta_source[DELTA_SOURCE_SIZE];
+static uint8_t delta_target[DELTA_TARGET_SIZE];
+/* Header, then two records with 48 and 32 bytes of data */
+static uint8_t delta_image[16 + 12 + 48 + 12 + 32];
+
+static uint8_t *delta_record(uint8_t *p, uint32_t diff_len, uint32_t extra_len, int32_t seek)
+{
+	sys_put_le32(diff_len, p);
+	sys_put_le32(extra_len, p + 4);
+	sys_put_le32(seek, p + 8);
+
+	return p + 12;
+}
+
+/*
+ * Helper to write the source image to the primary slot and build a delta from it: 32 bytes
+ * patched and 16 new ones, then a jump over 16 source bytes, 16 bytes copied and 16 new ones.
+ */
+static void delta_test_init(void)
+{
+	uint8_t *p = delta_image;
+	const struct flash_area *fa;
+
+	for (size_t i = 0; i < DELTA_SOURCE_SIZE; i++) {
+		delta_source[i] = i * 3;
+	}
+	for (size_t i = 0; i < 16; i++) {
+		delta_target[i] = delta_source[i] + 1;
+		delta_target[i + 16] = delta_source[i + 16] + 1;
+		delta_target[i + 32] = 0xa0 + i;
+		delta_target[i + 48] = delta_source[i + 48];
+		delta_target[i + 64] = 0xb0 + i;
+	}
+
+	memcpy(p, "GBDL", 4);
+	sys_put_le32(DELTA_SOURCE_SIZE, p + 4);
+	sys_put_le32(crc32_ieee(delta_source, DELTA_SOURCE_SIZE), p + DELTA_SOURCE_CRC);
+	sys_put_le32(DELTA_TARGET_SIZE, p + 12);
+	p = delta_record(p + DELTA_RECORD, 32, 16, 16);
+	memset(p, 1, 32);
+	memcpy(p + 32, delta_target + 32, 16);
+	p = delta_record(p + 48, 16, 16, 0);
+	memset(p, 0, 16);
+	memcpy(p + 16, delta_target + 64, 16);
+	zassert_equal(p + 32 - delta_image, sizeof(delta_image), "Invalid test vector");
+
+	zassert_ok(flash_area_open(FIXED_PARTITION_ID(slot0_partition), &fa), "Failed to open");
+	zassert_ok(flash_area_erase(fa, 0, 4096), "Failed to erase");
+	zassert_ok(flash_area_write(fa, 0, delta_source, sizeof(delta_source)), "Failed to write");
+	flash_area_close(fa);
+}
+
+/* Helper to check that a delta image is refused before it has been fetched to the end */
+static void delta_check_rejected(const uint8_t *image, uint8_t id)
+{
+	struct fw_download dl = {
+		.id = id,
+		.load_method = GB_FW_LOAD_METHOD_VENDOR_UNIPRO_DELTA,
+		.image = image,
+		.size = sizeof(delta_image),
+	};
+
+	fw_download_serve(&dl);
+	zassert_true(dl.fetched < dl.size, "Invalid delta fetched to the end");
+	slot_check_erased(DELTA_TARGET_SIZE);
+}
+
+ZTEST(greybus_fw_download_tests, test_delta)
+{
+	struct fw_download dl = {
+		.id = 10,
+		.load_method = GB_FW_LOAD_METHOD_VENDOR_UNIPRO_DELTA,
+		.image = delta_image,
+		.size = sizeof(delta_image),
+	};
+
+	delta_test_init();
+
+	fw_download_serve(&dl);
+	zassert_equal(dl.fetched, dl.size, "Image not fetched");
+	slot_check(delta_target, sizeof(delta_target));
+}
+
+ZTEST(greybus_fw_download_tests, test_delta_source_crc)
+{
+	static uint8_t image[sizeof(delta_image)];
+
+	delta_test_init();
+
+	/* Made from another running image */
+	memcpy(image, delta_image, sizeof(image));
+	image[DELTA_SOURCE_CRC] ^= 1;
+
+	delta_check_rejected(image, 11);
+}
+
+ZTEST(greybus_fw_download_tests, test_delta_record_bounds)
+{
+	static uint8_t image[sizeof(delta_image)];
+	const struct {
+		uint32_t diff_len;
+		uint32_t extra_len;
+		int32_t seek;
+	} records[] = {
+		/* More diff bytes than the source has */
+		{DELTA_SOURCE_SIZE + 1, 0, 0},
+		/* More bytes than the patched image has */
+		{32, DELTA_TARGET_SIZE - 32 + 1, 0},
+		/* Seeks out of the source */
+		{0, 0, -1},
+		{0, 0, DELTA_SOURCE_SIZE + 1},
+	};
+
+	delta_test_init();
+
+	for (size_t i = 0; i < ARRAY_SIZE(records); i++) {
+		memcpy(image, delta_image, sizeof(image));
+		delta_record(image + DELTA_RECORD, records[i].diff_len, records[i].extra_len,
+			     records[i].seek);
+		delta_check_rejected(image, 12 + i);
+	}
+}
+
+#endif // CONFIG_GREYBUS_FW_DOWNLOAD_DELTA
@@ -12,6 +12,10 @@
 #include <zephyr/device.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/sys/byteorder.h>
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+#include <greybus/greybus_gpio.h>
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
 
 static const struct device *dev = DEVICE_DT_GET(DT_NODELABEL(gpio0));
 
@@ -198,3 +202,257 @@ ZTEST(greybus_gpio_tests, test_invalid_pin_index)
 		      "Driver should have rejected invalid pin index 255");
 	gb_message_dealloc(msg);
 }
+
+ZTEST(greybus_gpio_tests, test_irq_coalesce)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_control_connected_request *conn_data;
+	struct gb_gpio_irq_type_request *irq_data;
+	const struct gb_gpio_irq_event_request *event_data;
+	struct gb_message *msg;
+
+	Z_TEST_SKIP_IFNDEF(CONFIG_GREYBUS_GPIO_IRQ_COALESCE);
+
+	msg = gb_message_request_alloc(sizeof(*conn_data), GB_CONTROL_TYPE_CONNECTED, false);
+	conn_data = (struct gb_control_connected_request *)msg->payload;
+	conn_data->cport_id = sys_cpu_to_le16(1);
+	greybus_rx_handler(0, msg);
+	resp = gb_transport_get_message();
+	zassert(gb_message_is_success(resp.msg), "Failed to connect cport");
+	gb_message_dealloc(resp.msg);
+
+	gpio_pin_configure(dev, 2, GPIO_INPUT);
+	gpio_emul_input_set(dev, 2, 0);
+
+	msg = gb_message_request_alloc(sizeof(*irq_data), GB_GPIO_TYPE_IRQ_TYPE, false);
+	irq_data = (struct gb_gpio_irq_type_request *)msg->payload;
+	irq_data->which = 2;
+	irq_data->type = GB_GPIO_IRQ_TYPE_EDGE_BOTH;
+	greybus_rx_handler(1, msg);
+	resp = get_first_non_event_checked(GB_RESPONSE(GB_GPIO_TYPE_IRQ_TYPE), 0);
+	gb_message_dealloc(resp.msg);
+
+	/* A burst of edges within the window is reported once */
+	gpio_emul_input_set(dev, 2, 1);
+	gpio_emul_input_set(dev, 2, 0);
+	gpio_emul_input_set(dev, 2, 1);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_GPIO_TYPE_IRQ_EVENT, "Expected irq event");
+	event_data = (const struct gb_gpio_irq_event_request *)resp.msg->payload;
+	zassert_equal(event_data->which, 2, "Invalid irq line");
+	gb_message_dealloc(resp.msg);
+
+	/* Next message must be the response, not another event */
+	msg = gb_message_request_alloc(0, GB_GPIO_TYPE_LINE_COUNT, false);
+	greybus_rx_handler(1, msg);
+	resp = get_first_non_event_checked(GB_RESPONSE(GB_GPIO_TYPE_LINE_COUNT),
+					   sizeof(struct gb_gpio_line_count_response));
+	gb_message_dealloc(resp.msg);
+
+	gpio_pin_interrupt_configure(dev, 2, GPIO_INT_DISABLE);
+}
+
+#ifdef CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+ZTEST(greybus_gpio_tests, test_irq_latency)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_control_connected_request *conn_data;
+	struct gb_gpio_irq_type_request *irq_data;
+	struct gb_gpio_latency_stats stats;
+	struct gb_message *msg;
+	uint16_t operation_id;
+
+	msg = gb_message_request_alloc(sizeof(*conn_data), GB_CONTROL_TYPE_CONNECTED, false);
+	conn_data = (struct gb_control_connected_request *)msg->payload;
+	conn_data->cport_id = sys_cpu_to_le16(1);
+	greybus_rx_handler(0, msg);
+	resp = gb_transport_get_message();
+	zassert(gb_message_is_success(resp.msg), "Failed to connect cport");
+	gb_message_dealloc(resp.msg);
+
+	gpio_pin_configure(dev, 6, GPIO_INPUT);
+	gpio_emul_input_set(dev, 6, 0);
+
+	msg = gb_message_request_alloc(sizeof(*irq_data), GB_GPIO_TYPE_IRQ_TYPE, false);
+	irq_data = (struct gb_gpio_irq_type_request *)msg->payload;
+	irq_data->which = 6;
+	irq_data->type = GB_GPIO_IRQ_TYPE_EDGE_RISING;
+	greybus_rx_handler(1, msg);
+	resp = get_first_non_event_checked(GB_RESPONSE(GB_GPIO_TYPE_IRQ_TYPE), 0);
+	gb_message_dealloc(resp.msg);
+
+	gb_gpio_latency_reset();
+	gpio_emul_input_set(dev, 6, 1);
+
+	/* The event is a tracked operation, which the AP acknowledges */
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_GPIO_TYPE_IRQ_EVENT, "Expected irq event");
+	operation_id = resp.msg->header.operation_id;
+	zassert_not_equal(operation_id, 0, "Event without operation id");
+	gb_message_dealloc(resp.msg);
+
+	msg = gb_message_alloc(0, GB_RESPONSE(GB_GPIO_TYPE_IRQ_EVENT), operation_id,
+			       GB_OP_SUCCESS);
+	greybus_rx_handler(1, msg);
+
+	for (int i = 0; i < 100; i++) {
+		gb_gpio_latency_get(&stats);
+		if (stats.send_to_ack.count) {
+			break;
+		}
+		k_msleep(1);
+	}
+
+	zassert_equal(stats.irqs, 1, "Invalid irq count");
+	zassert_equal(stats.events, 1, "Invalid event count");
+	zassert_equal(stats.errors, 0, "Unexpected errors");
+	zassert_equal(stats.irq_to_send.count, 1, "Send latency not recorded");
+	zassert_equal(stats.send_to_ack.count, 1, "Ack latency not recorded");
+	zassert(stats.send_to_ack.min_us <= stats.send_to_ack.max_us, "Invalid latency range");
+
+	gpio_pin_interrupt_configure(dev, 6, GPIO_INT_DISABLE);
+}
+#endif // CONFIG_GREYBUS_GPIO_IRQ_LATENCY
+
+#ifdef CONFIG_GREYBUS_GPIO_DEBOUNCE
+static void gpio_edge_count_get(uint8_t which, uint32_t *edges, uint32_t *transitions)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_gpio_edge_count_request *req_data;
+	const struct gb_gpio_edge_count_response *resp_data;
+	struct gb_message *msg;
+
+	msg = gb_message_request_alloc(sizeof(*req_data), GB_GPIO_TYPE_VENDOR_EDGE_COUNT, false);
+	req_data = (struct gb_gpio_edge_count_request *)msg->payload;
+	req_data->which = which;
+	greybus_rx_handler(1, msg);
+	resp = get_first_non_event_checked(GB_RESPONSE(GB_GPIO_TYPE_VENDOR_EDGE_COUNT),
+					   sizeof(*resp_data));
+	resp_data = (const struct gb_gpio_edge_count_response *)resp.msg->payload;
+	*edges = sys_le32_to_cpu(resp_data->edges);
+	*transitions = sys_le32_to_cpu(resp_data->transitions);
+	gb_message_dealloc(resp.msg);
+}
+
+ZTEST(greybus_gpio_tests, test_debounce)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_control_connected_request *conn_data;
+	struct gb_gpio_irq_type_request *irq_data;
+	struct gb_gpio_set_debounce_request *debounce_data;
+	const struct gb_gpio_irq_event_request *event_data;
+	struct gb_message *msg;
+	uint32_t edges, transitions;
+
+	msg = gb_message_request_alloc(sizeof(*conn_data), GB_CONTROL_TYPE_CONNECTED, false);
+	conn_data = (struct gb_control_connected_request *)msg->payload;
+	conn_data->cport_id = sys_cpu_to_le16(1);
+	greybus_rx_handler(0, msg);
+	resp = gb_transport_get_message();
+	zassert(gb_message_is_success(resp.msg), "Failed to connect cport");
+	gb_message_dealloc(resp.msg);
+
+	gpio_pin_configure(dev, 7, GPIO_INPUT);
+	gpio_emul_input_set(dev, 7, 0);
+
+	msg = gb_message_request_alloc(sizeof(*irq_data), GB_GPIO_TYPE_IRQ_TYPE, false);
+	irq_data = (struct gb_gpio_irq_type_request *)msg->payload;
+	irq_data->which = 7;
+	irq_data->type = GB_GPIO_IRQ_TYPE_EDGE_RISING;
+	greybus_rx_handler(1, msg);
+	resp = get_first_non_event_checked(GB_RESPONSE(GB_GPIO_TYPE_IRQ_TYPE), 0);
+	gb_message_dealloc(resp.msg);
+
+	msg = gb_message_request_alloc(sizeof(*debounce_data), GB_GPIO_TYPE_SET_DEBOUNCE, false);
+	debounce_data = (struct gb_gpio_set_debounce_request *)msg->payload;
+	debounce_data->which = 7;
+	debounce_data->usec = sys_cpu_to_le16(5000);
+	greybus_rx_handler(1, msg);
+	resp = get_first_non_event_checked(GB_RESPONSE(GB_GPIO_TYPE_SET_DEBOUNCE), 0);
+	gb_message_dealloc(resp.msg);
+
+	/* A bouncing press is reported once it settled */
+	gpio_emul_input_set(dev, 7, 1);
+	gpio_emul_input_set(dev, 7, 0);
+	gpio_emul_input_set(dev, 7, 1);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_GPIO_TYPE_IRQ_EVENT, "Expected irq event");
+	event_data = (const struct gb_gpio_irq_event_request *)resp.msg->payload;
+	zassert_equal(event_data->which, 7, "Invalid irq line");
+	gb_message_dealloc(resp.msg);
+
+	/* A glitch back to the settled level and a release are not rising edges */
+	gpio_emul_input_set(dev, 7, 0);
+	gpio_emul_input_set(dev, 7, 1);
+	k_msleep(10);
+	gpio_emul_input_set(dev, 7, 0);
+	k_msleep(10);
+
+	gpio_edge_count_get(7, &edges, &transitions);
+	zassert_equal(edges, 6, "Invalid edge count");
+	zassert_equal(transitions, 2, "Invalid transition count");
+
+	/* Level interrupts are not debounced, the line keeps its debounce time */
+	msg = gb_message_request_alloc(sizeof(*irq_data), GB_GPIO_TYPE_IRQ_TYPE, false);
+	irq_data = (struct gb_gpio_irq_type_request *)msg->payload;
+	irq_data->which = 7;
+	irq_data->type = GB_GPIO_IRQ_TYPE_LEVEL_HIGH;
+	greybus_rx_handler(1, msg);
+	resp = get_first_non_event_checked(GB_RESPONSE(GB_GPIO_TYPE_IRQ_TYPE), 0);
+	gb_message_dealloc(resp.msg);
+
+	gpio_emul_input_set(dev, 7, 1);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_GPIO_TYPE_IRQ_EVENT, "Expected irq event");
+	event_data = (const struct gb_gpio_irq_event_request *)resp.msg->payload;
+	zassert_equal(event_data->which, 7, "Invalid irq line");
+	gb_message_dealloc(resp.msg);
+
+	gpio_pin_interrupt_configure(dev, 7, GPIO_INT_DISABLE);
+	gpio_emul_input_set(dev, 7, 0);
+}
+#endif // CONFIG_GREYBUS_GPIO_DEBOUNCE
+
+ZTEST(greybus_gpio_tests, test_port_ops)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_gpio_port_set_request *set_data;
+	const struct gb_gpio_port_get_response *get_data;
+	struct gb_message *msg;
+
+	Z_TEST_SKIP_IFNDEF(CONFIG_GREYBUS_GPIO_PORT_OPS);
+
+	gpio_pin_configure(dev, 3, GPIO_OUTPUT);
+	gpio_pin_configure(dev, 4, GPIO_OUTPUT);
+	gpio_pin_configure(dev, 5, GPIO_INPUT);
+	gpio_pin_set(dev, 4, 1);
+
+	/* Pin 4 is outside the mask and must keep its value */
+	msg = gb_message_request_alloc(sizeof(*set_data), GB_GPIO_TYPE_VENDOR_PORT_SET, false);
+	set_data = (struct gb_gpio_port_set_request *)msg->payload;
+	set_data->mask = sys_cpu_to_le32(BIT(3));
+	set_data->value = sys_cpu_to_le32(BIT(3));
+	greybus_rx_handler(1, msg);
+	resp = get_first_non_event_checked(GB_RESPONSE(GB_GPIO_TYPE_VENDOR_PORT_SET), 0);
+	gb_message_dealloc(resp.msg);
+
+	zassert_equal(gpio_emul_output_get(dev, 3), 1, "Pin 3 was not set");
+	zassert_equal(gpio_emul_output_get(dev, 4), 1, "Pin 4 was modified");
+
+	gpio_emul_input_set(dev, 5, 1);
+
+	msg = gb_message_request_alloc(0, GB_GPIO_TYPE_VENDOR_PORT_GET, false);
+	greybus_rx_handler(1, msg);
+	resp = get_first_non_event_checked(GB_RESPONSE(GB_GPIO_TYPE_VENDOR_PORT_GET),
+					   sizeof(*get_data));
+	get_data = (const struct gb_gpio_port_get_response *)resp.msg->payload;
+	zassert_equal(sys_le32_to_cpu(get_data->value) & BIT(5), BIT(5), "Pin 5 should be 1");
+	gb_message_dealloc(resp.msg);
+}
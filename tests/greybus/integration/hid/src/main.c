@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/input/input.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_messages.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus-utils/manifest.h>
+#include <zephyr/sys/byteorder.h>
+
+#define HID_CPORT           1
+#define REPORT_ID_KEYBOARD  0x01
+#define REPORT_ID_MOUSE     0x02
+#define KEYBOARD_REPORT_LEN 9
+#define MOUSE_REPORT_LEN    7
+#define HID_USAGE_A         0x04
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+static uint8_t hid_request(uint8_t type, const void *payload, size_t len,
+			   struct gb_message **resp_msg)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *msg;
+	uint8_t result;
+
+	msg = gb_message_request_alloc_with_payload(payload, len, type, false);
+	greybus_rx_handler(HID_CPORT, msg);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, HID_CPORT, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+	result = resp.msg->header.result;
+
+	if (resp_msg) {
+		*resp_msg = resp.msg;
+	} else {
+		gb_message_dealloc(resp.msg);
+	}
+
+	return result;
+}
+
+static struct gb_message *hid_report_get(void)
+{
+	struct gb_msg_with_cport req = gb_transport_get_message();
+
+	zassert_equal(req.cport, HID_CPORT, "Invalid cport");
+	zassert_equal(gb_message_type(req.msg), GB_HID_TYPE_IRQ_EVENT, "Invalid request type");
+
+	return req.msg;
+}
+
+static void *hid_setup(void)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_control_connected_request *conn_data;
+	struct gb_message *msg;
+
+	msg = gb_message_request_alloc(sizeof(*conn_data), GB_CONTROL_TYPE_CONNECTED, false);
+	conn_data = (struct gb_control_connected_request *)msg->payload;
+	conn_data->cport_id = sys_cpu_to_le16(HID_CPORT);
+	greybus_rx_handler(0, msg);
+	resp = gb_transport_get_message();
+	zassert(gb_message_is_success(resp.msg), "Failed to connect cport");
+	gb_message_dealloc(resp.msg);
+
+	return NULL;
+}
+
+static void hid_before(void *fixture)
+{
+	zassert_equal(hid_request(GB_HID_TYPE_PWR_ON, NULL, 0, NULL), GB_OP_SUCCESS,
+		      "Failed to power on");
+}
+
+static void hid_after(void *fixture)
+{
+	zassert_equal(hid_request(GB_HID_TYPE_PWR_OFF, NULL, 0, NULL), GB_OP_SUCCESS,
+		      "Failed to power off");
+}
+
+ZTEST_SUITE(greybus_hid_tests, NULL, hid_setup, hid_before, hid_after, NULL);
+
+ZTEST(greybus_hid_tests, test_cport_count)
+{
+	zassert_equal(GREYBUS_CPORT_COUNT, 2, "Invalid number of cports");
+}
+
+ZTEST(greybus_hid_tests, test_descriptors)
+{
+	struct gb_message *resp;
+	const struct gb_hid_desc_response *desc;
+	uint16_t report_desc_len;
+
+	zassert_equal(hid_request(GB_HID_TYPE_GET_DESC, NULL, 0, &resp), GB_OP_SUCCESS,
+		      "Failed to get descriptor");
+	zassert_equal(gb_message_payload_len(resp), sizeof(*desc), "Invalid descriptor length");
+	desc = (const struct gb_hid_desc_response *)resp->payload;
+	zassert_equal(sys_le16_to_cpu(desc->wVendorID), 0x2fe3, "Invalid vendor id");
+	zassert_equal(sys_le16_to_cpu(desc->wProductID), 0x0001, "Invalid product id");
+	report_desc_len = sys_le16_to_cpu(desc->wReportDescLength);
+	gb_message_dealloc(resp);
+
+	zassert_equal(hid_request(GB_HID_TYPE_GET_REPORT_DESC, NULL, 0, &resp), GB_OP_SUCCESS,
+		      "Failed to get report descriptor");
+	zassert_equal(gb_message_payload_len(resp), report_desc_len,
+		      "Invalid report descriptor length");
+	gb_message_dealloc(resp);
+}
+
+ZTEST(greybus_hid_tests, test_get_report)
+{
+	struct gb_message *resp;
+	struct gb_hid_get_report_request req = {
+		.report_type = GB_HID_INPUT_REPORT,
+		.report_id = REPORT_ID_KEYBOARD,
+	};
+
+	zassert_equal(hid_request(GB_HID_TYPE_GET_REPORT, &req, sizeof(req), &resp),
+		      GB_OP_SUCCESS, "Failed to get keyboard report");
+	zassert_equal(gb_message_payload_len(resp), KEYBOARD_REPORT_LEN, "Invalid report length");
+	zassert_equal(resp->payload[0], REPORT_ID_KEYBOARD, "Invalid report id");
+	gb_message_dealloc(resp);
+
+	req.report_type = GB_HID_FEATURE_REPORT;
+	zassert_equal(hid_request(GB_HID_TYPE_GET_REPORT, &req, sizeof(req), NULL), GB_OP_INVALID,
+		      "Feature report accepted");
+}
+
+ZTEST(greybus_hid_tests, test_key_press_release)
+{
+	struct gb_message *report;
+
+	input_report_key(NULL, INPUT_KEY_A, 1, true, K_FOREVER);
+	input_report_key(NULL, INPUT_KEY_A, 0, true, K_FOREVER);
+
+	report = hid_report_get();
+	zassert_equal(gb_message_payload_len(report), KEYBOARD_REPORT_LEN, "Invalid length");
+	zassert_equal(report->payload[0], REPORT_ID_KEYBOARD, "Invalid report id");
+	zassert_equal(report->payload[3], HID_USAGE_A, "Press not reported");
+	gb_message_dealloc(report);
+
+	report = hid_report_get();
+	zassert_equal(report->payload[0], REPORT_ID_KEYBOARD, "Invalid report id");
+	zassert_equal(report->payload[3], 0, "Release not reported");
+	gb_message_dealloc(report);
+}
+
+ZTEST(greybus_hid_tests, test_motion_coalesce)
+{
+	struct gb_message *report;
+	int32_t x = 0;
+	int reports = 0;
+
+	input_report_rel(NULL, INPUT_REL_X, 1, true, K_FOREVER);
+	input_report_rel(NULL, INPUT_REL_X, 2, true, K_FOREVER);
+	input_report_rel(NULL, INPUT_REL_X, 3, true, K_FOREVER);
+
+	while (x < 6) {
+		report = hid_report_get();
+		zassert_equal(gb_message_payload_len(report), MOUSE_REPORT_LEN, "Invalid length");
+		zassert_equal(report->payload[0], REPORT_ID_MOUSE, "Invalid report id");
+		x += (int16_t)sys_get_le16(&report->payload[2]);
+		gb_message_dealloc(report);
+		reports++;
+	}
+
+	zassert_equal(x, 6, "Motion lost");
+	zassert(reports < 3, "Motion not coalesced");
+}
@@ -62,6 +62,38 @@ static struct i2c_emul i2c_dev_2 = {
 	.target = &i2c_emul_dev,
 };
 
+/* Register style device: a write of the register index followed by a repeated start read */
+static int i2c_emul_reg_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+				 int addr)
+{
+	size_t i;
+
+	zassert_equal(addr, 0x03, "Wrong address");
+	zassert_equal(num_msgs, 2, "Expected a single transfer");
+	zassert_false(msgs[0].flags & I2C_MSG_READ, "First op should be write");
+	zassert_false(msgs[0].flags & I2C_MSG_STOP, "Unexpected stop after write");
+	zassert_equal(msgs[0].len, 1, "Unexpected register size");
+	zassert_true(msgs[1].flags & I2C_MSG_READ, "Second op should be read");
+	zassert_true(msgs[1].flags & I2C_MSG_RESTART, "Expected repeated start");
+	zassert_true(msgs[1].flags & I2C_MSG_STOP, "Expected stop after read");
+
+	for (i = 0; i < msgs[1].len; i++) {
+		msgs[1].buf[i] = msgs[0].buf[0] + i;
+	}
+
+	return 0;
+}
+
+static const struct i2c_emul_api reg_api = {
+	.transfer = i2c_emul_reg_transfer,
+};
+
+static struct i2c_emul i2c_dev_3 = {
+	.addr = 0x03,
+	.api = &reg_api,
+	.target = &i2c_emul_dev,
+};
+
 ZTEST_SUITE(greybus_i2c_tests, NULL, NULL, NULL, NULL, NULL);
 
 ZTEST(greybus_i2c_tests, test_cport_count)
@@ -115,3 +147,39 @@ ZTEST(greybus_i2c_tests, test_transfer)
 
 	gb_message_dealloc(resp.msg);
 }
+
+ZTEST(greybus_i2c_tests, test_transfer_repeated_start)
+{
+	int i, ret;
+	struct gb_msg_with_cport resp;
+	struct gb_i2c_transfer_request *req_data;
+	struct gb_message *req = gb_message_request_alloc(
+		sizeof(*req_data) + sizeof(struct gb_i2c_transfer_op) * 2 + 1, GB_I2C_TYPE_TRANSFER,
+		false);
+
+	ret = i2c_emul_register(dev, &i2c_dev_3);
+	zassert_equal(ret, 0, "Failed to register i2c_dev_3");
+
+	req_data = (struct gb_i2c_transfer_request *)req->payload;
+	req_data->op_count = 2;
+
+	req_data->ops[0].addr = 0x03;
+	req_data->ops[0].size = 1;
+	req_data->ops[1].addr = 0x03;
+	req_data->ops[1].size = 4;
+	req_data->ops[1].flags = GB_I2C_M_RD;
+	/* Register index */
+	((uint8_t *)&req_data->ops[2])[0] = 0x10;
+
+	greybus_rx_handler(1, req);
+	resp = gb_transport_get_message();
+
+	zassert(gb_message_is_success(resp.msg), "Request failed");
+	zassert_equal(gb_message_payload_len(resp.msg), 4, "Invalid response size");
+
+	for (i = 0; i < 4; i++) {
+		zassert_equal(resp.msg->payload[i], 0x10 + i, "Unexpected data");
+	}
+
+	gb_message_dealloc(resp.msg);
+}
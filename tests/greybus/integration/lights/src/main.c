@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "greybus/greybus_messages.h"
+#include <zephyr/ztest.h>
+#include <greybus/greybus.h>
+#include <greybus-utils/manifest.h>
+#include <greybus/greybus_protocols.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/drivers/led.h>
+#include <zephyr/sys/byteorder.h>
+
+static const struct device *gpio = DEVICE_DT_GET(DT_NODELABEL(gpio0));
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+static void *lights_setup(void)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_control_connected_request *conn_data;
+	struct gb_message *msg;
+
+	msg = gb_message_request_alloc(sizeof(*conn_data), GB_CONTROL_TYPE_CONNECTED, false);
+	conn_data = (struct gb_control_connected_request *)msg->payload;
+	conn_data->cport_id = sys_cpu_to_le16(1);
+	greybus_rx_handler(0, msg);
+	resp = gb_transport_get_message();
+	zassert(gb_message_is_success(resp.msg), "Failed to connect cport");
+	gb_message_dealloc(resp.msg);
+
+	return NULL;
+}
+
+ZTEST_SUITE(greybus_lights_tests, NULL, lights_setup, NULL, NULL, NULL);
+
+ZTEST(greybus_lights_tests, test_cport_count)
+{
+	zassert_equal(GREYBUS_CPORT_COUNT, 2, "Invalid number of cports");
+}
+
+/* Returns the result of the response to a request */
+static uint8_t lights_request(struct gb_message *msg)
+{
+	struct gb_msg_with_cport resp;
+	const uint8_t type = gb_message_type(msg);
+	uint8_t result;
+
+	greybus_rx_handler(1, msg);
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+	result = resp.msg->header.result;
+	gb_message_dealloc(resp.msg);
+
+	return result;
+}
+
+static uint8_t set_brightness(uint8_t brightness)
+{
+	struct gb_lights_set_brightness_request *req_data;
+	struct gb_message *msg =
+		gb_message_request_alloc(sizeof(*req_data), GB_LIGHTS_TYPE_SET_BRIGHTNESS, false);
+
+	req_data = (struct gb_lights_set_brightness_request *)msg->payload;
+	req_data->light_id = 0;
+	req_data->channel_id = 0;
+	req_data->brightness = brightness;
+
+	return lights_request(msg);
+}
+
+static uint8_t set_blink(uint16_t on_ms, uint16_t off_ms)
+{
+	struct gb_lights_blink_request *req_data;
+	struct gb_message *msg =
+		gb_message_request_alloc(sizeof(*req_data), GB_LIGHTS_TYPE_SET_BLINK, false);
+
+	req_data = (struct gb_lights_blink_request *)msg->payload;
+	req_data->light_id = 0;
+	req_data->channel_id = 0;
+	req_data->time_on_ms = sys_cpu_to_le16(on_ms);
+	req_data->time_off_ms = sys_cpu_to_le16(off_ms);
+
+	return lights_request(msg);
+}
+
+static uint8_t set_fade(uint8_t fade_in, uint8_t fade_out)
+{
+	struct gb_lights_set_fade_request *req_data;
+	struct gb_message *msg =
+		gb_message_request_alloc(sizeof(*req_data), GB_LIGHTS_TYPE_SET_FADE, false);
+
+	req_data = (struct gb_lights_set_fade_request *)msg->payload;
+	req_data->light_id = 0;
+	req_data->channel_id = 0;
+	req_data->fade_in = fade_in;
+	req_data->fade_out = fade_out;
+
+	return lights_request(msg);
+}
+
+ZTEST(greybus_lights_tests, test_set_brightness)
+{
+	zassert_equal(set_brightness(LED_BRIGHTNESS_MAX), GB_OP_SUCCESS, "Request failed");
+	zassert_equal(gpio_emul_output_get(gpio, 0), 1, "Light should be on");
+
+	zassert_equal(set_brightness(0), GB_OP_SUCCESS, "Request failed");
+	zassert_equal(gpio_emul_output_get(gpio, 0), 0, "Light should be off");
+}
+
+ZTEST(greybus_lights_tests, test_effects)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_lights_get_channel_config_request *config_data;
+	const struct gb_lights_get_channel_config_response *config;
+	struct gb_message *msg;
+	bool seen_on = false, seen_off = false;
+
+	Z_TEST_SKIP_IFNDEF(CONFIG_GREYBUS_LIGHTS_EFFECTS);
+
+	msg = gb_message_request_alloc(sizeof(*config_data), GB_LIGHTS_TYPE_GET_CHANNEL_CONFIG,
+				       false);
+	config_data = (struct gb_lights_get_channel_config_request *)msg->payload;
+	config_data->light_id = 0;
+	config_data->channel_id = 0;
+	greybus_rx_handler(1, msg);
+	resp = gb_transport_get_message();
+	zassert(gb_message_is_success(resp.msg), "Failed to get channel config");
+	config = (const struct gb_lights_get_channel_config_response *)resp.msg->payload;
+	zassert_equal(sys_le32_to_cpu(config->flags),
+		      GB_LIGHT_CHANNEL_BLINK | GB_LIGHT_CHANNEL_FADER, "Invalid channel flags");
+	gb_message_dealloc(resp.msg);
+
+	/* GPIO LEDs cannot blink on their own, the node blinks them */
+	zassert_equal(set_blink(10, 10), GB_OP_SUCCESS, "Request failed");
+	for (int i = 0; i < 20; i++) {
+		if (gpio_emul_output_get(gpio, 0)) {
+			seen_on = true;
+		} else {
+			seen_off = true;
+		}
+		k_msleep(3);
+	}
+	zassert(seen_on && seen_off, "Light did not blink");
+
+	zassert_equal(set_blink(0, 0), GB_OP_SUCCESS, "Request failed");
+	k_msleep(30);
+	zassert_equal(gpio_emul_output_get(gpio, 0), 0, "Light should stay off");
+
+	/* The brightness ramps up from 0, so the light turns on after the first step */
+	zassert_equal(set_fade(10, 0), GB_OP_SUCCESS, "Request failed");
+	zassert_equal(set_brightness(LED_BRIGHTNESS_MAX), GB_OP_SUCCESS, "Request failed");
+	zassert_equal(gpio_emul_output_get(gpio, 0), 0, "Light should still be off");
+	k_msleep(150);
+	zassert_equal(gpio_emul_output_get(gpio, 0), 1, "Light should be on");
+
+	zassert_equal(set_brightness(0), GB_OP_SUCCESS, "Request failed");
+	zassert_equal(gpio_emul_output_get(gpio, 0), 0, "Light should be off");
+
+	zassert_equal(set_fade(0, 0), GB_OP_SUCCESS, "Request failed");
+}
@@ -9,9 +9,34 @@
 #include <greybus/greybus.h>
 #include <greybus-utils/manifest.h>
 #include <greybus/greybus_log.h>
+#include <greybus/greybus_protocols.h>
+#ifdef CONFIG_LOG_RUNTIME_FILTERING
+#include <zephyr/logging/log.h>
+#include <zephyr/logging/log_ctrl.h>
+
+LOG_MODULE_REGISTER(log_test, LOG_LEVEL_DBG);
+#endif // CONFIG_LOG_RUNTIME_FILTERING
 
 struct gb_msg_with_cport gb_transport_get_message(void);
 
+static void check_log(const char *expected)
+{
+	struct gb_msg_with_cport req;
+	const struct gb_log_send_log_request *req_data;
+
+	req = gb_transport_get_message();
+	zassert_equal(req.cport, 1, "Incorrect cport");
+	zassert_equal(gb_message_type(req.msg), GB_LOG_TYPE_SEND_LOG, "Invalid request type");
+
+	req_data = (const struct gb_log_send_log_request *)req.msg->payload;
+	zassert_equal(sys_le16_to_cpu(req_data->len), strlen(expected) + 1,
+		      "Incorrect msg length");
+	zassert_equal(memcmp(req_data->msg, expected, strlen(expected) + 1), 0,
+		      "Incorrect msg string");
+
+	gb_message_dealloc(req.msg);
+}
+
 ZTEST_SUITE(greybus_log_tests, NULL, NULL, NULL, NULL, NULL);
 
 ZTEST(greybus_log_tests, test_cport_count)
@@ -50,3 +75,102 @@ ZTEST(greybus_log_tests, test_send_log)
 
 	gb_message_dealloc(req.msg);
 }
+
+ZTEST(greybus_log_tests, test_send_log_batch)
+{
+	/* Lines logged together are sent in one message */
+	gb_log_send_log(strlen("first"), "first");
+	gb_log_send_log(strlen("second"), "second");
+
+	check_log("first\nsecond");
+}
+
+ZTEST(greybus_log_tests, test_send_log_dropped)
+{
+	static char line[CONFIG_GREYBUS_LOG_BUF_SIZE];
+
+	/* Does not fit with its newline */
+	memset(line, 'a', sizeof(line));
+	gb_log_send_log(sizeof(line), line);
+	gb_log_send_log(strlen("after"), "after");
+
+	check_log("--- 1 messages dropped ---\nafter");
+}
+
+/*
+ * Helper to send a log control request and return the response
+ */
+static struct gb_message *log_control(uint8_t type, const void *payload, size_t len)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *req = gb_message_request_alloc_with_payload(payload, len, type, false);
+
+	zassert_not_null(req, "Failed to allocate request");
+	zassert_equal(greybus_rx_handler(1, req), 0, "Failed to send request");
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, 1, "Incorrect cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+
+	return resp.msg;
+}
+
+ZTEST(greybus_log_tests, test_rate_limit)
+{
+	struct gb_message *resp;
+	struct gb_log_vendor_set_rate_limit_request req_data = {
+		.lines_per_sec = sys_cpu_to_le16(1),
+		.burst = sys_cpu_to_le16(2),
+	};
+
+	resp = log_control(GB_LOG_TYPE_VENDOR_SET_RATE_LIMIT, &req_data, sizeof(req_data));
+	zassert_true(gb_message_is_success(resp), "Failed to set rate limit");
+	gb_message_dealloc(resp);
+
+	/* The burst goes through, the rest counts as dropped */
+	gb_log_send_log(strlen("first"), "first");
+	gb_log_send_log(strlen("second"), "second");
+	gb_log_send_log(strlen("third"), "third");
+
+	check_log("--- 1 messages dropped ---\nfirst\nsecond");
+
+	req_data.lines_per_sec = 0;
+	resp = log_control(GB_LOG_TYPE_VENDOR_SET_RATE_LIMIT, &req_data, sizeof(req_data));
+	zassert_true(gb_message_is_success(resp), "Failed to remove rate limit");
+	gb_message_dealloc(resp);
+
+	gb_log_send_log(strlen("fourth"), "fourth");
+	check_log("fourth");
+}
+
+#ifdef CONFIG_LOG_RUNTIME_FILTERING
+ZTEST(greybus_log_tests, test_set_filter)
+{
+	struct gb_message *resp;
+	struct gb_log_vendor_set_filter_request req_data = {
+		.level = LOG_LEVEL_ERR,
+		.module = "log_test",
+	};
+
+	resp = log_control(GB_LOG_TYPE_VENDOR_SET_FILTER, &req_data, sizeof(req_data));
+	zassert_true(gb_message_is_success(resp), "Failed to set filter");
+	zassert_equal(sys_le16_to_cpu(((const struct gb_log_vendor_set_filter_response *)
+					       resp->payload)->modules),
+		      1, "Only the named module should change");
+	gb_message_dealloc(resp);
+
+	strcpy(req_data.module, "no_such_module");
+	resp = log_control(GB_LOG_TYPE_VENDOR_SET_FILTER, &req_data, sizeof(req_data));
+	zassert_equal(resp->header.result, GB_OP_INVALID, "Unknown module should fail");
+	gb_message_dealloc(resp);
+
+	memset(req_data.module, 0, sizeof(req_data.module));
+	req_data.level = LOG_LEVEL_DBG;
+	resp = log_control(GB_LOG_TYPE_VENDOR_SET_FILTER, &req_data, sizeof(req_data));
+	zassert_true(gb_message_is_success(resp), "Failed to reset filters");
+	zassert_equal(sys_le16_to_cpu(((const struct gb_log_vendor_set_filter_response *)
+					       resp->payload)->modules),
+		      log_src_cnt_get(Z_LOG_LOCAL_DOMAIN_ID), "All modules should change");
+	gb_message_dealloc(resp);
+}
+#endif // CONFIG_LOG_RUNTIME_FILTERING
@@ -7,13 +7,28 @@
 #include "greybus/greybus_messages.h"
 #include <zephyr/ztest.h>
 #include <greybus/greybus.h>
+#include <greybus/greybus_capture.h>
 #include <greybus-utils/manifest.h>
+#include <greybus/greybus_loopback.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/service.h>
+
+#ifdef CONFIG_GREYBUS_CPORT_STATS
+#include "greybus_stats.h"
+#endif // CONFIG_GREYBUS_CPORT_STATS
 
 #define REQ_SIZE 256
 
 struct gb_msg_with_cport gb_transport_get_message(void);
 
-ZTEST_SUITE(greybus_loopback_tests, NULL, NULL, NULL, NULL, NULL);
+static void *greybus_loopback_tests_setup(void)
+{
+	zassert_ok(greybus_service_wait(K_SECONDS(5)), "Greybus service failed to start");
+
+	return NULL;
+}
+
+ZTEST_SUITE(greybus_loopback_tests, NULL, greybus_loopback_tests_setup, NULL, NULL, NULL);
 
 ZTEST(greybus_loopback_tests, test_cport_count)
 {
@@ -145,3 +160,292 @@ ZTEST(greybus_loopback_tests, test_rapid_pings)
 		gb_message_dealloc(resp.msg);
 	}
 }
+
+ZTEST(greybus_loopback_tests, test_bench)
+{
+	int i, ret;
+	struct gb_msg_with_cport req;
+	struct gb_control_connected_request *conn_data;
+	struct gb_loopback_bench_stats stats;
+	struct gb_message *msg;
+
+	Z_TEST_SKIP_IFNDEF(CONFIG_GREYBUS_LOOPBACK_BENCH);
+
+	msg = gb_message_request_alloc(sizeof(*conn_data), GB_CONTROL_TYPE_CONNECTED, false);
+	conn_data = (struct gb_control_connected_request *)msg->payload;
+	conn_data->cport_id = sys_cpu_to_le16(1);
+	greybus_rx_handler(0, msg);
+	req = gb_transport_get_message();
+	zassert(gb_message_is_success(req.msg), "Failed to connect cport");
+	gb_message_dealloc(req.msg);
+
+	ret = gb_loopback_bench_start(GB_LOOPBACK_TYPE_TRANSFER, 16, 2, 0);
+	zassert_equal(ret, 0, "Failed to start benchmark");
+	zassert_equal(gb_loopback_bench_start(GB_LOOPBACK_TYPE_PING, 0, 1, 0), -EBUSY,
+		      "Started a second benchmark");
+
+	/* Act as the AP and echo the requests */
+	for (i = 0; i < 2; i++) {
+		req = gb_transport_get_message();
+		zassert_equal(req.cport, 1, "Invalid cport");
+		zassert_equal(gb_message_type(req.msg), GB_LOOPBACK_TYPE_TRANSFER,
+			      "Invalid request type");
+		zassert_equal(gb_message_payload_len(req.msg),
+			      sizeof(struct gb_loopback_transfer_request) + 16,
+			      "Invalid request size");
+
+		msg = gb_message_response_alloc_from_req(req.msg->payload,
+							 gb_message_payload_len(req.msg), req.msg,
+							 GB_OP_SUCCESS);
+		greybus_rx_handler(1, msg);
+		gb_message_dealloc(req.msg);
+	}
+
+	zassert(WAIT_FOR((gb_loopback_bench_stats_get(&stats), !stats.running), 100000,
+			 k_msleep(1)),
+		"Benchmark did not finish");
+	zassert_equal(stats.sent, 2, "Invalid sent count");
+	zassert_equal(stats.completed, 2, "Invalid completed count");
+	zassert_equal(stats.errors, 0, "Unexpected errors");
+	zassert(stats.min_us <= stats.max_us, "Invalid latency range");
+	zassert(gb_loopback_bench_percentile(&stats, 99) <= stats.max_us, "Invalid p99");
+}
+
+ZTEST(greybus_loopback_tests, test_rx_credits_retry)
+{
+	int i;
+	uint16_t last_id = 0;
+	struct gb_msg_with_cport resp;
+	struct gb_message *req;
+
+	Z_TEST_SKIP_IFNDEF(CONFIG_GREYBUS_RX_OVERFLOW_RETRY);
+
+	/* The test thread is cooperative, so nothing is handled until it waits */
+	for (i = 0; i <= CONFIG_GREYBUS_RX_CPORT_CREDITS; i++) {
+		req = gb_message_request_alloc(0, GB_LOOPBACK_TYPE_PING, false);
+		last_id = req->header.operation_id;
+		greybus_rx_handler(1, req);
+	}
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.msg->header.operation_id, last_id, "Wrong request rejected");
+	zassert_equal(resp.msg->header.result, GB_OP_RETRY, "Request not rejected");
+	gb_message_dealloc(resp.msg);
+
+	for (i = 0; i < CONFIG_GREYBUS_RX_CPORT_CREDITS; i++) {
+		resp = gb_transport_get_message();
+		zassert_true(gb_message_is_success(resp.msg), "Greybus loopback ping failed");
+		gb_message_dealloc(resp.msg);
+	}
+}
+
+ZTEST(greybus_loopback_tests, test_expedited_overtake)
+{
+	int i;
+	struct gb_msg_with_cport resp;
+	struct gb_message *req;
+
+	/* With more workers, the control cport has a lane of its own */
+	if (CONFIG_GREYBUS_RX_WORKERS > 1) {
+		ztest_test_skip();
+	}
+
+	/* The test thread is cooperative, so everything is queued before the worker runs */
+	for (i = 0; i < CONFIG_GREYBUS_RX_CPORT_CREDITS; i++) {
+		req = gb_message_request_alloc(0, GB_LOOPBACK_TYPE_PING, false);
+		greybus_rx_handler(1, req);
+	}
+
+	req = gb_message_request_alloc(0, 0x00, false);
+	greybus_rx_handler(0, req);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, 0, "Control request did not overtake the loopback ones");
+	zassert_true(gb_message_is_success(resp.msg), "Control ping failed");
+	gb_message_dealloc(resp.msg);
+
+	for (i = 0; i < CONFIG_GREYBUS_RX_CPORT_CREDITS; i++) {
+		resp = gb_transport_get_message();
+		zassert_equal(resp.cport, 1, "Invalid cport");
+		zassert_true(gb_message_is_success(resp.msg), "Greybus loopback ping failed");
+		gb_message_dealloc(resp.msg);
+	}
+}
+
+#ifdef CONFIG_GREYBUS_RX_DEADLINE
+ZTEST(greybus_loopback_tests, test_rx_deadline)
+{
+	uint16_t stale_id;
+	struct gb_msg_with_cport resp;
+	struct gb_message *req = gb_message_request_alloc(0, GB_LOOPBACK_TYPE_PING, false);
+
+	/* The test thread is cooperative, so the request stays queued while time passes */
+	stale_id = req->header.operation_id;
+	greybus_rx_handler(1, req);
+	k_busy_wait((CONFIG_GREYBUS_RX_DEADLINE_MS + 10) * USEC_PER_MSEC);
+
+	req = gb_message_request_alloc(0, GB_LOOPBACK_TYPE_PING, false);
+	greybus_rx_handler(1, req);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.msg->header.operation_id, stale_id, "Wrong request answered first");
+	zassert_equal(resp.msg->header.result, GB_OP_TIMEOUT, "Stale request handled");
+	gb_message_dealloc(resp.msg);
+
+	resp = gb_transport_get_message();
+	zassert_true(gb_message_is_success(resp.msg), "Fresh request not handled");
+	gb_message_dealloc(resp.msg);
+}
+#endif // CONFIG_GREYBUS_RX_DEADLINE
+
+#ifdef CONFIG_GREYBUS_CPORT_QUOTA
+ZTEST(greybus_loopback_tests, test_cport_quota)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *req;
+	struct gb_loopback_transfer_request *req_data;
+	const size_t len = CONFIG_GREYBUS_CPORT_QUOTA_BYTES;
+
+	req = gb_message_request_alloc(sizeof(*req_data) + len, GB_LOOPBACK_TYPE_TRANSFER, false);
+	zassert_not_null(req, "Failed to allocate request");
+	req_data = (struct gb_loopback_transfer_request *)req->payload;
+	req_data->len = sys_cpu_to_le32(len);
+
+	greybus_rx_handler(1, req);
+	resp = gb_transport_get_message();
+	zassert_equal(resp.msg->header.result, GB_OP_NO_MEMORY, "Request over budget accepted");
+	gb_message_dealloc(resp.msg);
+
+	/* The budget is returned, smaller requests still go through */
+	req = gb_message_request_alloc(0, GB_LOOPBACK_TYPE_PING, false);
+	greybus_rx_handler(1, req);
+	resp = gb_transport_get_message();
+	zassert_true(gb_message_is_success(resp.msg), "Greybus loopback ping failed");
+	gb_message_dealloc(resp.msg);
+}
+#endif // CONFIG_GREYBUS_CPORT_QUOTA
+
+#ifdef CONFIG_GREYBUS_CAPTURE
+struct capture_buf {
+	uint8_t data[256];
+	size_t len;
+};
+
+static int capture_write(const void *data, size_t len, void *user_data)
+{
+	struct capture_buf *buf = user_data;
+
+	if (buf->len + len > sizeof(buf->data)) {
+		return -ENOSPC;
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+
+	return 0;
+}
+
+ZTEST(greybus_loopback_tests, test_capture)
+{
+	static struct capture_buf buf;
+	struct gb_msg_with_cport resp;
+	struct gb_message *req = gb_message_request_alloc(0, GB_LOOPBACK_TYPE_PING, false);
+	/* Section header, interface description, then the first enhanced packet block */
+	const size_t first = 28 + 32;
+	const struct gb_capture_hdr *hdr;
+
+	gb_capture_start();
+	greybus_rx_handler(1, req);
+	resp = gb_transport_get_message();
+	gb_message_dealloc(resp.msg);
+	gb_capture_stop();
+
+	zassert_ok(gb_capture_drain(capture_write, &buf), "Failed to drain capture");
+	zassert_equal(gb_capture_drops(), 0, "Messages dropped from the capture");
+	zassert_equal(sys_get_le32(buf.data), 0x0A0D0D0A, "Missing section header");
+	zassert_equal(sys_get_le16(buf.data + 36), CONFIG_GREYBUS_CAPTURE_LINKTYPE,
+		      "Invalid link type");
+
+	/* Ping request and response, 8 byte greybus headers after the pseudo header */
+	zassert_equal(buf.len, first + 2 * (28 + 12 + 4), "Invalid capture length");
+	zassert_equal(sys_get_le32(buf.data + first), 6, "Missing enhanced packet block");
+	hdr = (const struct gb_capture_hdr *)(buf.data + first + 28);
+	zassert_equal(sys_le16_to_cpu(hdr->cport), 1, "Invalid cport");
+	zassert_equal(hdr->direction, GB_CAPTURE_DIR_RX, "Invalid direction");
+	hdr = (const struct gb_capture_hdr *)(buf.data + first + 44 + 28);
+	zassert_equal(hdr->direction, GB_CAPTURE_DIR_TX, "Invalid direction");
+}
+#endif // CONFIG_GREYBUS_CAPTURE
+
+#ifdef CONFIG_GREYBUS_CPORT_STATS
+/*
+ * Helper to sum up a histogram
+ */
+static uint32_t histogram_sum(const uint32_t *histogram)
+{
+	uint32_t sum = 0;
+
+	for (size_t i = 0; i < GB_CPORT_STATS_BUCKETS; i++) {
+		sum += histogram[i];
+	}
+
+	return sum;
+}
+
+ZTEST(greybus_loopback_tests, test_stats)
+{
+	struct gb_cport_stats stats;
+	struct gb_msg_with_cport resp;
+	struct gb_message *req;
+	struct gb_loopback_transfer_request *req_data;
+	const size_t hdr_len = sizeof(struct gb_operation_msg_hdr);
+	const size_t sink_len = sizeof(*req_data) + REQ_SIZE;
+	const uint8_t types[] = {
+		GB_LOOPBACK_TYPE_PING,
+		GB_LOOPBACK_TYPE_PING,
+		GB_LOOPBACK_TYPE_SINK,
+		0x7F,
+	};
+
+	gb_stats_reset();
+
+	for (size_t i = 0; i < ARRAY_SIZE(types); i++) {
+		if (types[i] == GB_LOOPBACK_TYPE_SINK) {
+			req = gb_message_request_alloc(sink_len, types[i], false);
+			req_data = (struct gb_loopback_transfer_request *)req->payload;
+			req_data->len = sys_cpu_to_le32(REQ_SIZE);
+		} else {
+			req = gb_message_request_alloc(0, types[i], false);
+		}
+
+		greybus_rx_handler(1, req);
+		resp = gb_transport_get_message();
+		gb_message_dealloc(resp.msg);
+	}
+
+	/* The response reaches the transport before the handler time is accounted */
+	k_msleep(10);
+
+	zassert_equal(gb_stats_get(GREYBUS_CPORT_COUNT, &stats), -EINVAL, "Invalid cport accepted");
+	zassert_ok(gb_stats_get(1, &stats), "Failed to get stats");
+
+	zassert_equal(stats.rx_msgs, ARRAY_SIZE(types), "Invalid rx count");
+	zassert_equal(stats.rx_bytes, ARRAY_SIZE(types) * hdr_len + sink_len, "Invalid rx bytes");
+	zassert_equal(stats.tx_msgs, ARRAY_SIZE(types), "Invalid tx count");
+	zassert_equal(stats.tx_bytes, ARRAY_SIZE(types) * hdr_len, "Invalid tx bytes");
+	zassert_equal(stats.tx_errors, 0, "Unexpected tx errors");
+
+	/* Only the responses carry a result */
+	zassert_equal(stats.results[GB_OP_SUCCESS], 3, "Invalid success count");
+	zassert_equal(stats.results[GB_OP_INVALID], 1, "Invalid error count");
+
+	zassert_equal(histogram_sum(stats.wait_histogram), ARRAY_SIZE(types),
+		      "Invalid wait histogram");
+	zassert_equal(histogram_sum(stats.handler_histogram), ARRAY_SIZE(types),
+		      "Invalid handler histogram");
+
+	/* Other cports are not affected */
+	zassert_ok(gb_stats_get(0, &stats), "Failed to get stats");
+	zassert_equal(stats.rx_msgs, 0, "Traffic accounted to the wrong cport");
+}
+#endif // CONFIG_GREYBUS_CPORT_STATS
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "greybus/greybus_messages.h"
+#include <zephyr/ztest.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/service.h>
+
+#define LOOPBACK_PORT 1
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+/* From greybus_operation.h */
+typedef void (*gb_operation_cb_t)(uint16_t cport, uint16_t operation_id, struct gb_message *resp,
+				  int err, void *priv);
+int gb_operation_send(uint16_t cport, const struct gb_message *req, uint32_t timeout_ms,
+		      gb_operation_cb_t cb, void *priv);
+int gb_operation_cancel(uint16_t cport, uint16_t operation_id);
+void gb_operation_cancel_all(uint16_t cport);
+
+struct op_result {
+	struct k_sem done;
+	uint16_t operation_id;
+	uint8_t resp_type;
+	int err;
+	size_t calls;
+};
+
+static void *greybus_operation_tests_setup(void)
+{
+	zassert_ok(greybus_service_wait(K_SECONDS(5)), "Greybus service failed to start");
+
+	return NULL;
+}
+
+ZTEST_SUITE(greybus_operation_tests, NULL, greybus_operation_tests_setup, NULL, NULL, NULL);
+
+static void op_cb(uint16_t cport, uint16_t operation_id, struct gb_message *resp, int err,
+		  void *priv)
+{
+	struct op_result *result = priv;
+
+	zassert_equal(cport, LOOPBACK_PORT, "Invalid cport");
+	zassert_equal(err == 0, resp != NULL, "Response must be set exactly on success");
+
+	result->operation_id = operation_id;
+	result->resp_type = resp ? gb_message_type(resp) : 0;
+	result->err = err;
+	result->calls++;
+	gb_message_dealloc(resp);
+
+	k_sem_give(&result->done);
+}
+
+static void op_result_init(struct op_result *result)
+{
+	*result = (struct op_result){0};
+	k_sem_init(&result->done, 0, K_SEM_MAX_LIMIT);
+}
+
+/*
+ * Helper to send a tracked ping. Returns the operation id of the request.
+ */
+static uint16_t ping_send(uint32_t timeout_ms, struct op_result *result)
+{
+	struct gb_msg_with_cport sent;
+	struct gb_message *req = gb_message_request_alloc(0, GB_LOOPBACK_TYPE_PING, false);
+	const uint16_t operation_id = req->header.operation_id;
+
+	zassert_ok(gb_operation_send(LOOPBACK_PORT, req, timeout_ms, op_cb, result),
+		   "Failed to send operation");
+	gb_message_dealloc(req);
+
+	sent = gb_transport_get_message();
+	zassert_equal(sent.cport, LOOPBACK_PORT, "Invalid cport");
+	zassert_equal(sent.msg->header.operation_id, operation_id, "Invalid request sent");
+	gb_message_dealloc(sent.msg);
+
+	return operation_id;
+}
+
+ZTEST(greybus_operation_tests, test_response)
+{
+	struct op_result result;
+	uint16_t operation_id;
+
+	op_result_init(&result);
+	operation_id = ping_send(0, &result);
+
+	greybus_rx_handler(LOOPBACK_PORT,
+			   gb_message_alloc(0, GB_RESPONSE(GB_LOOPBACK_TYPE_PING), operation_id,
+					    GB_OP_SUCCESS));
+
+	zassert_ok(k_sem_take(&result.done, K_SECONDS(1)), "Operation not completed");
+	zassert_ok(result.err, "Operation failed");
+	zassert_equal(result.operation_id, operation_id, "Invalid operation id");
+	zassert_equal(result.resp_type, GB_RESPONSE(GB_LOOPBACK_TYPE_PING), "Invalid response");
+
+	/* Completed operations are not tracked anymore */
+	zassert_equal(gb_operation_cancel(LOOPBACK_PORT, operation_id), -ENOENT,
+		      "Completed operation still tracked");
+	zassert_equal(result.calls, 1, "Callback called more than once");
+}
+
+ZTEST(greybus_operation_tests, test_timeout)
+{
+	struct op_result result;
+	uint16_t operation_id;
+
+	op_result_init(&result);
+	operation_id = ping_send(50, &result);
+
+	zassert_equal(k_sem_take(&result.done, K_MSEC(20)), -EAGAIN, "Timed out too early");
+	zassert_ok(k_sem_take(&result.done, K_SECONDS(1)), "Operation did not time out");
+	zassert_equal(result.err, -ETIMEDOUT, "Invalid error");
+	zassert_equal(result.operation_id, operation_id, "Invalid operation id");
+
+	zassert_equal(gb_operation_cancel(LOOPBACK_PORT, operation_id), -ENOENT,
+		      "Timed out operation still tracked");
+	zassert_equal(result.calls, 1, "Callback called more than once");
+}
+
+ZTEST(greybus_operation_tests, test_cancel)
+{
+	struct op_result result;
+	uint16_t operation_id;
+
+	op_result_init(&result);
+	operation_id = ping_send(50, &result);
+
+	zassert_ok(gb_operation_cancel(LOOPBACK_PORT, operation_id), "Failed to cancel");
+	zassert_equal(result.calls, 1, "Callback not called on cancel");
+	zassert_equal(result.err, -ECANCELED, "Invalid error");
+
+	zassert_equal(gb_operation_cancel(LOOPBACK_PORT, operation_id), -ENOENT,
+		      "Cancelled operation still tracked");
+
+	/* The timeout does not reach the callback anymore */
+	zassert_ok(k_sem_take(&result.done, K_NO_WAIT), "Callback did not signal");
+	zassert_equal(k_sem_take(&result.done, K_MSEC(100)), -EAGAIN, "Callback called again");
+	zassert_equal(result.calls, 1, "Callback called more than once");
+}
+
+ZTEST(greybus_operation_tests, test_cancel_on_disconnect)
+{
+	struct op_result result;
+	struct gb_msg_with_cport resp;
+	struct gb_control_disconnected_request *req_data;
+	struct gb_message *req;
+
+	op_result_init(&result);
+	ping_send(0, &result);
+	ping_send(0, &result);
+
+	req = gb_message_request_alloc(sizeof(*req_data), GB_CONTROL_TYPE_DISCONNECTED, false);
+	req_data = (struct gb_control_disconnected_request *)req->payload;
+	req_data->cport_id = sys_cpu_to_le16(LOOPBACK_PORT);
+	greybus_rx_handler(0, req);
+
+	resp = gb_transport_get_message();
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(GB_CONTROL_TYPE_DISCONNECTED),
+		      "Invalid response");
+	gb_message_dealloc(resp.msg);
+
+	zassert_equal(result.calls, 2, "Operations not cancelled on disconnect");
+	zassert_equal(result.err, -ECANCELED, "Invalid error");
+}
+
+ZTEST(greybus_operation_tests, test_cport_limit)
+{
+	struct op_result result;
+	struct gb_message *req;
+
+	op_result_init(&result);
+	for (size_t i = 0; i < CONFIG_GREYBUS_OPERATIONS_PER_CPORT; i++) {
+		ping_send(0, &result);
+	}
+
+	req = gb_message_request_alloc(0, GB_LOOPBACK_TYPE_PING, false);
+	zassert_equal(gb_operation_send(LOOPBACK_PORT, req, 0, op_cb, &result), -EBUSY,
+		      "Cport limit not enforced");
+	gb_message_dealloc(req);
+	zassert_equal(result.calls, 0, "Callback called for a rejected operation");
+
+	gb_operation_cancel_all(LOOPBACK_PORT);
+	zassert_equal(result.calls, CONFIG_GREYBUS_OPERATIONS_PER_CPORT,
+		      "Not all operations cancelled");
+
+	/* Room again once the others are gone */
+	ping_send(0, &result);
+	gb_operation_cancel_all(LOOPBACK_PORT);
+}
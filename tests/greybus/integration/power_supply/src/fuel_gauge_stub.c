@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT test_fuel_gauge_stub
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/fuel_gauge.h>
+#include "fuel_gauge_stub.h"
+
+struct fuel_gauge_stub_state fuel_gauge_stub_state = {
+	.current = -100000,
+	.voltage = 3800000,
+	.soc = 80,
+};
+
+static int fuel_gauge_stub_get_prop(const struct device *dev, fuel_gauge_prop_t prop,
+				    union fuel_gauge_prop_val *val)
+{
+	fuel_gauge_stub_state.reads++;
+
+	switch (prop) {
+	case FUEL_GAUGE_CURRENT:
+		val->current = fuel_gauge_stub_state.current;
+		return 0;
+	case FUEL_GAUGE_VOLTAGE:
+		val->voltage = fuel_gauge_stub_state.voltage;
+		return 0;
+	case FUEL_GAUGE_RELATIVE_STATE_OF_CHARGE:
+		val->relative_state_of_charge = fuel_gauge_stub_state.soc;
+		return 0;
+	default:
+		return -ENOTSUP;
+	}
+}
+
+static DEVICE_API(fuel_gauge, fuel_gauge_stub_api) = {
+	.get_property = fuel_gauge_stub_get_prop,
+};
+
+#define FUEL_GAUGE_STUB_INIT(n)                                                                    \
+	DEVICE_DT_INST_DEFINE(n, NULL, NULL, NULL, NULL, POST_KERNEL,                              \
+			      CONFIG_FUEL_GAUGE_INIT_PRIORITY, &fuel_gauge_stub_api);
+
+DT_INST_FOREACH_STATUS_OKAY(FUEL_GAUGE_STUB_INIT)
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _FUEL_GAUGE_STUB_H_
+#define _FUEL_GAUGE_STUB_H_
+
+#include <stdint.h>
+
+struct fuel_gauge_stub_state {
+	int current;
+	int voltage;
+	uint8_t soc;
+	/* Number of properties read */
+	uint32_t reads;
+};
+
+extern struct fuel_gauge_stub_state fuel_gauge_stub_state;
+
+#endif // _FUEL_GAUGE_STUB_H_
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_messages.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus-utils/manifest.h>
+#include <zephyr/sys/byteorder.h>
+#include "fuel_gauge_stub.h"
+
+#define PSY_CPORT 1
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+static struct gb_message *psy_request(uint8_t type, const void *payload, size_t len)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *msg;
+
+	msg = gb_message_request_alloc_with_payload(payload, len, type, false);
+	greybus_rx_handler(PSY_CPORT, msg);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, PSY_CPORT, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+	zassert(gb_message_is_success(resp.msg), "Request failed");
+
+	return resp.msg;
+}
+
+static uint32_t psy_property_get(uint8_t property)
+{
+	const struct gb_power_supply_get_property_request req_data = {
+		.psy_id = 0,
+		.property = property,
+	};
+	struct gb_message *resp = psy_request(GB_POWER_SUPPLY_TYPE_GET_PROPERTY, &req_data,
+					      sizeof(req_data));
+	uint32_t val;
+
+	zassert_equal(gb_message_payload_len(resp),
+		      sizeof(struct gb_power_supply_get_property_response),
+		      "Invalid response size");
+	val = sys_le32_to_cpu(
+		((const struct gb_power_supply_get_property_response *)resp->payload)->prop_val);
+	gb_message_dealloc(resp);
+
+	return val;
+}
+
+static void *power_supply_setup(void)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_control_connected_request *conn_data;
+	struct gb_message *msg;
+
+	msg = gb_message_request_alloc(sizeof(*conn_data), GB_CONTROL_TYPE_CONNECTED, false);
+	conn_data = (struct gb_control_connected_request *)msg->payload;
+	conn_data->cport_id = sys_cpu_to_le16(PSY_CPORT);
+	greybus_rx_handler(0, msg);
+	resp = gb_transport_get_message();
+	zassert(gb_message_is_success(resp.msg), "Failed to connect cport");
+	gb_message_dealloc(resp.msg);
+
+	return NULL;
+}
+
+ZTEST_SUITE(greybus_power_supply_tests, NULL, power_supply_setup, NULL, NULL, NULL);
+
+ZTEST(greybus_power_supply_tests, test_cport_count)
+{
+	zassert_equal(GREYBUS_CPORT_COUNT, 2, "Invalid number of cports");
+}
+
+ZTEST(greybus_power_supply_tests, test_get_supplies)
+{
+	struct gb_message *resp = psy_request(GB_POWER_SUPPLY_TYPE_GET_SUPPLIES, NULL, 0);
+
+	zassert_equal(((const struct gb_power_supply_get_supplies_response *)resp->payload)
+			      ->supplies_count,
+		      1, "Invalid supplies count");
+	gb_message_dealloc(resp);
+}
+
+ZTEST(greybus_power_supply_tests, test_get_description)
+{
+	const struct gb_power_supply_get_description_request req_data = {.psy_id = 0};
+	const struct gb_power_supply_get_description_response *resp_data;
+	struct gb_message *resp =
+		psy_request(GB_POWER_SUPPLY_TYPE_GET_DESCRIPTION, &req_data, sizeof(req_data));
+
+	resp_data = (const struct gb_power_supply_get_description_response *)resp->payload;
+	zassert_equal(sys_le16_to_cpu(resp_data->type), GB_POWER_SUPPLY_BATTERY_TYPE,
+		      "Invalid type");
+	zassert_str_equal((const char *)resp_data->model, "battery0", "Invalid model");
+	/* Status, capacity, voltage and current */
+	zassert_equal(resp_data->properties_count, 4, "Invalid properties count");
+
+	gb_message_dealloc(resp);
+}
+
+ZTEST(greybus_power_supply_tests, test_get_prop_descriptors)
+{
+	const struct gb_power_supply_get_property_descriptors_request req_data = {.psy_id = 0};
+	const struct gb_power_supply_get_property_descriptors_response *resp_data;
+	struct gb_message *resp = psy_request(GB_POWER_SUPPLY_TYPE_GET_PROP_DESCRIPTORS,
+					      &req_data, sizeof(req_data));
+
+	resp_data =
+		(const struct gb_power_supply_get_property_descriptors_response *)resp->payload;
+	zassert_equal(resp_data->properties_count, 4, "Invalid properties count");
+	zassert_equal(gb_message_payload_len(resp),
+		      sizeof(*resp_data) + 4 * sizeof(resp_data->props[0]),
+		      "Invalid response size");
+	zassert_equal(resp_data->props[0].property, GB_POWER_SUPPLY_PROP_STATUS,
+		      "Invalid property");
+	zassert_false(resp_data->props[0].is_writeable, "Property should be read only");
+
+	gb_message_dealloc(resp);
+}
+
+ZTEST(greybus_power_supply_tests, test_get_property_cached)
+{
+	uint32_t reads;
+
+	zassert_equal(psy_property_get(GB_POWER_SUPPLY_PROP_VOLTAGE_NOW), 3800000,
+		      "Invalid voltage");
+
+	reads = fuel_gauge_stub_state.reads;
+	zassert_equal(psy_property_get(GB_POWER_SUPPLY_PROP_CAPACITY), 80, "Invalid capacity");
+	zassert_equal((int32_t)psy_property_get(GB_POWER_SUPPLY_PROP_CURRENT_NOW), -100000,
+		      "Invalid current");
+	zassert_equal(fuel_gauge_stub_state.reads, reads, "Property read from the device");
+}
+
+ZTEST(greybus_power_supply_tests, test_get_property_unsupported)
+{
+	const struct gb_power_supply_get_property_request req_data = {
+		.psy_id = 0,
+		.property = GB_POWER_SUPPLY_PROP_TEMP,
+	};
+	struct gb_msg_with_cport resp;
+	struct gb_message *msg = gb_message_request_alloc_with_payload(
+		&req_data, sizeof(req_data), GB_POWER_SUPPLY_TYPE_GET_PROPERTY, false);
+
+	greybus_rx_handler(PSY_CPORT, msg);
+	resp = gb_transport_get_message();
+	zassert_false(gb_message_is_success(resp.msg), "Unsupported property read");
+	gb_message_dealloc(resp.msg);
+}
+
+ZTEST(greybus_power_supply_tests, test_status_event)
+{
+	struct gb_msg_with_cport req;
+	const struct gb_power_supply_event_request *req_data;
+
+	zassert_equal(psy_property_get(GB_POWER_SUPPLY_PROP_STATUS),
+		      GB_POWER_SUPPLY_STATUS_DISCHARGING, "Invalid status");
+
+	fuel_gauge_stub_state.current = 200000;
+
+	/* Pushed by the next refresh */
+	req = gb_transport_get_message();
+	zassert_equal(req.cport, PSY_CPORT, "Invalid cport");
+	zassert_equal(gb_message_type(req.msg), GB_POWER_SUPPLY_TYPE_EVENT, "Invalid type");
+	req_data = (const struct gb_power_supply_event_request *)req.msg->payload;
+	zassert_equal(req_data->psy_id, 0, "Invalid power supply");
+	zassert_equal(req_data->event, GB_POWER_SUPPLY_UPDATE, "Invalid event");
+	gb_message_dealloc(req.msg);
+
+	zassert_equal(psy_property_get(GB_POWER_SUPPLY_PROP_STATUS),
+		      GB_POWER_SUPPLY_STATUS_CHARGING, "Invalid status");
+}
@@ -81,3 +81,58 @@ ZTEST(greybus_raw_tests, test_send_data)
 	gb_message_dealloc(resp.msg);
 	gb_message_dealloc(req);
 }
+
+ZTEST(greybus_raw_tests, test_stream_send_buf)
+{
+	int i, id, ret;
+	uint8_t cb_buf[BUF_SIZE];
+	uint8_t *buf;
+	struct gb_msg_with_cport resp;
+	struct gb_raw_credits_request *credits_data;
+	const struct gb_raw_send_request *req_data;
+	struct gb_message *req;
+
+	Z_TEST_SKIP_IFNDEF(CONFIG_GREYBUS_RAW_STREAM);
+
+	id = greybus_raw_register(greybus_raw_cb, cb_buf);
+	zassert(id >= 0, "Failed to register raw cport");
+
+	buf = greybus_raw_buf_alloc(BUF_SIZE);
+	zassert_not_null(buf, "Failed to allocate buffer");
+	for (i = 0; i < BUF_SIZE / 2; i++) {
+		buf[i] = i;
+	}
+
+	ret = greybus_raw_send_buf(id, buf, BUF_SIZE / 2, K_NO_WAIT);
+	zassert_equal(ret, -EAGAIN, "Sent without credits");
+
+	req = gb_message_request_alloc(sizeof(*credits_data), GB_RAW_TYPE_VENDOR_CREDITS, false);
+	credits_data = (struct gb_raw_credits_request *)req->payload;
+	credits_data->count = sys_cpu_to_le16(1);
+	greybus_rx_handler(GREYBUS_RAW_CPORT_START + id, req);
+	resp = gb_transport_get_message();
+	zassert(gb_message_is_success(resp.msg), "Failed to grant credits");
+	gb_message_dealloc(resp.msg);
+
+	ret = greybus_raw_send_buf(id, buf, BUF_SIZE / 2, K_NO_WAIT);
+	zassert_equal(ret, 0, "Failed to send buffer");
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, GREYBUS_RAW_CPORT_START + id, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RAW_TYPE_SEND, "Invalid request type");
+	zassert_equal(gb_message_payload_len(resp.msg), sizeof(*req_data) + BUF_SIZE / 2,
+		      "Invalid request size");
+	req_data = (const struct gb_raw_send_request *)resp.msg->payload;
+	zassert_equal(sys_le32_to_cpu(req_data->len), BUF_SIZE / 2, "Invalid data length");
+	for (i = 0; i < BUF_SIZE / 2; i++) {
+		zassert_equal(req_data->data[i], i, "Invalid data");
+	}
+	gb_message_dealloc(resp.msg);
+
+	/* The only credit was used */
+	buf = greybus_raw_buf_alloc(BUF_SIZE);
+	zassert_not_null(buf, "Failed to allocate buffer");
+	ret = greybus_raw_send_buf(id, buf, BUF_SIZE, K_NO_WAIT);
+	zassert_equal(ret, -EAGAIN, "Sent without credits");
+	greybus_raw_buf_free(buf);
+}
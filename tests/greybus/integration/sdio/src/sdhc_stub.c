@@ -9,6 +9,7 @@
 #include <zephyr/device.h>
 #include <zephyr/drivers/sdhc.h>
 #include <zephyr/logging/log.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(sdhc_stub, CONFIG_SDHC_LOG_LEVEL);
 
@@ -16,6 +17,15 @@ struct sdhc_stub_config {
     struct sdhc_host_props props;
 };
 
+/* Last request, and the card contents written and read by data requests */
+struct sdhc_stub_state {
+    uint32_t opcode;
+    uint32_t blocks;
+    uint32_t block_size;
+    uint32_t requests;
+    uint8_t card[16384];
+} sdhc_stub_state;
+
 static int sdhc_stub_reset(const struct device *dev)
 {
     return 0;
@@ -25,12 +35,38 @@ static int sdhc_stub_request(const struct device *dev,
                              struct sdhc_command *cmd,
                              struct sdhc_data *data)
 {
-    /* Mock successful responses */
+    size_t len;
+
+    sdhc_stub_state.opcode = cmd->opcode;
+    sdhc_stub_state.requests++;
+
+    /* Mock successful responses, long responses have the least significant word first */
     cmd->response[0] = 0x00000900; /* Ready for data */
-    cmd->response[1] = 0;
-    cmd->response[2] = 0;
-    cmd->response[3] = 0;
-    
+    cmd->response[1] = 1;
+    cmd->response[2] = 2;
+    cmd->response[3] = 3;
+
+    if (!data) {
+        sdhc_stub_state.blocks = 0;
+        return 0;
+    }
+
+    sdhc_stub_state.blocks = data->blocks;
+    sdhc_stub_state.block_size = data->block_size;
+
+    len = data->blocks * data->block_size;
+    if (len > sizeof(sdhc_stub_state.card)) {
+        return -EINVAL;
+    }
+
+    /* Single and multiple block writes */
+    if (cmd->opcode == 24 || cmd->opcode == 25) {
+        memcpy(sdhc_stub_state.card, data->data, len);
+    } else {
+        memcpy(data->data, sdhc_stub_state.card, len);
+    }
+    data->bytes_xfered = len;
+
     return 0;
 }
 
@@ -73,9 +109,8 @@ static DEVICE_API(sdhc, sdhc_stub_api) = {
                 .vol_330_support = 1,                                          \
                 .suspend_res_support = 0,                                      \
                 .sdma_support = 0,                                             \
-                .high_speed_support = 1,                                       \
+                .high_spd_support = 1,                                         \
                 .adma_2_support = 0,                                           \
-                .uahs_support = 0,                                             \
                 .bus_8_bit_support = 1,                                        \
                 .bus_4_bit_support = 1,                                        \
                 .sdr104_support = 0,                                           \
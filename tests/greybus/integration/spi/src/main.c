@@ -20,16 +20,21 @@ static const struct device *dev = DEVICE_DT_GET(DT_NODELABEL(spi0));
 
 struct gb_msg_with_cport gb_transport_get_message(void);
 
+static size_t spi_emul_io_count;
+
 static int spi_emul_io(const struct emul *target, const struct spi_config *config,
 		       const struct spi_buf_set *tx_bufs, const struct spi_buf_set *rx_bufs)
 {
 	uint8_t *buf;
 	size_t i, j;
 
+	spi_emul_io_count++;
+
+	/* NULL buffers only clock data */
 	if (tx_bufs) {
 		for (i = 0; i < tx_bufs->count; i++) {
-			for (j = 0; j < tx_bufs->buffers[i].len; j++) {
-				buf = tx_bufs->buffers[i].buf;
+			buf = tx_bufs->buffers[i].buf;
+			for (j = 0; buf && j < tx_bufs->buffers[i].len; j++) {
 				zassert_equal(buf[j], j, "Invalid data");
 			}
 		}
@@ -37,8 +42,8 @@ static int spi_emul_io(const struct emul *target, const struct spi_config *confi
 
 	if (rx_bufs) {
 		for (i = 0; i < rx_bufs->count; i++) {
-			for (j = 0; j < rx_bufs->buffers[i].len; j++) {
-				buf = rx_bufs->buffers[i].buf;
+			buf = rx_bufs->buffers[i].buf;
+			for (j = 0; buf && j < rx_bufs->buffers[i].len; j++) {
 				buf[j] = j;
 			}
 		}
@@ -116,9 +121,11 @@ ZTEST(greybus_spi_tests, test_transfer)
 		write_data[TRANSFER_BUF + i] = i;
 	}
 
+	spi_emul_io_count = 0;
 	greybus_rx_handler(1, req);
 	resp = gb_transport_get_message();
 
+	zassert_equal(spi_emul_io_count, 1, "Transfers should share one transaction");
 	zassert_equal(resp.cport, 1, "Invalid cport");
 	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(GB_SPI_TYPE_TRANSFER),
 		      "Invalid response type");
@@ -133,3 +140,104 @@ ZTEST(greybus_spi_tests, test_transfer)
 
 	gb_message_dealloc(resp.msg);
 }
+
+/*
+ * Helper to send a transfer of two descriptors without any write data. Returns the result of the
+ * response.
+ */
+static uint8_t spi_transfer_result(uint32_t len0, uint8_t flags0, uint32_t len1, uint8_t flags1)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_spi_transfer_request *req_data;
+	struct gb_message *req = gb_message_request_alloc(
+		sizeof(*req_data) + sizeof(struct gb_spi_transfer) * 2, GB_SPI_TYPE_TRANSFER,
+		false);
+	uint8_t result;
+
+	zassert_not_null(req, "Failed to allocate request");
+	memset(req->payload, 0, gb_message_payload_len(req));
+
+	req_data = (struct gb_spi_transfer_request *)req->payload;
+	req_data->count = sys_cpu_to_le16(2);
+	req_data->transfers[0].len = sys_cpu_to_le32(len0);
+	req_data->transfers[0].xfer_flags = flags0;
+	req_data->transfers[1].len = sys_cpu_to_le32(len1);
+	req_data->transfers[1].xfer_flags = flags1;
+
+	greybus_rx_handler(1, req);
+	resp = gb_transport_get_message();
+
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(GB_SPI_TYPE_TRANSFER),
+		      "Invalid response type");
+	result = resp.msg->header.result;
+	gb_message_dealloc(resp.msg);
+
+	return result;
+}
+
+ZTEST(greybus_spi_tests, test_transfer_bounds)
+{
+	spi_emul_io_count = 0;
+
+	/* Reads whose lengths wrap around to a small response */
+	zassert_equal(spi_transfer_result(0x80000000, GB_SPI_XFER_READ, 0x80000000,
+					  GB_SPI_XFER_READ),
+		      GB_OP_INVALID, "Wrapping reads accepted");
+	zassert_equal(spi_transfer_result(UINT16_MAX, GB_SPI_XFER_READ, 0, GB_SPI_XFER_READ),
+		      GB_OP_INVALID, "Read larger than a response accepted");
+
+	/* Writes whose lengths wrap around, or that the request does not carry */
+	zassert_equal(spi_transfer_result(0xffffffff, GB_SPI_XFER_WRITE, 1, GB_SPI_XFER_WRITE),
+		      GB_OP_INVALID, "Wrapping writes accepted");
+	zassert_equal(spi_transfer_result(1, GB_SPI_XFER_WRITE, 0, GB_SPI_XFER_READ),
+		      GB_OP_INVALID, "Missing write data accepted");
+
+	zassert_equal(spi_emul_io_count, 0, "Rejected transfer reached the bus");
+}
+
+/*
+ * Helper to get the configuration of the device on a chip select. Returns the response, which
+ * the caller frees.
+ */
+static struct gb_message *spi_device_config(uint8_t chip_select)
+{
+	struct gb_msg_with_cport resp;
+	const struct gb_spi_device_config_request req_data = {
+		.chip_select = chip_select,
+	};
+
+	greybus_rx_handler(1, gb_message_request_alloc_with_payload(&req_data, sizeof(req_data),
+								    GB_SPI_TYPE_DEVICE_CONFIG,
+								    false));
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(GB_SPI_TYPE_DEVICE_CONFIG),
+		      "Invalid response type");
+	zassert(gb_message_is_success(resp.msg), "Request failed");
+	zassert_equal(gb_message_payload_len(resp.msg),
+		      sizeof(struct gb_spi_device_config_response), "Invalid response size");
+
+	return resp.msg;
+}
+
+ZTEST(greybus_spi_tests, test_device_config)
+{
+	struct gb_message *resp;
+	const struct gb_spi_device_config_response *resp_data;
+
+	/* Described by the devicetree node on chip select 1 */
+	resp = spi_device_config(1);
+	resp_data = (const struct gb_spi_device_config_response *)resp->payload;
+	zassert_equal(sys_le16_to_cpu(resp_data->mode), GB_SPI_MODE_MODE_3, "Invalid mode");
+	zassert_equal(sys_le32_to_cpu(resp_data->max_speed_hz), 1000000, "Invalid max speed");
+	zassert_equal(resp_data->device_type, GB_SPI_SPI_DEV, "Invalid device type");
+	gb_message_dealloc(resp);
+
+	/* Nothing described, the defaults are reported */
+	resp = spi_device_config(0);
+	resp_data = (const struct gb_spi_device_config_response *)resp->payload;
+	zassert_equal(sys_le16_to_cpu(resp_data->mode), 0, "Invalid mode");
+	zassert_equal(sys_le32_to_cpu(resp_data->max_speed_hz), 24000000, "Invalid max speed");
+	gb_message_dealloc(resp);
+}
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT test_spi_device_stub
+
+#include <zephyr/device.h>
+
+/* Only described to the AP, but the emulated controller links a device for each of its children */
+#define SPI_DEVICE_STUB_INIT(n)                                                                    \
+	DEVICE_DT_INST_DEFINE(n, NULL, NULL, NULL, NULL, POST_KERNEL,                              \
+			      CONFIG_KERNEL_INIT_PRIORITY_DEVICE, NULL);
+
+DT_INST_FOREACH_STATUS_OKAY(SPI_DEVICE_STUB_INIT)
@@ -87,6 +87,8 @@ static void *greybus_standalone_tests_init(void)
 	gb_apbridge_init();
 	ret = gb_svc_init();
 	zassert_equal(ret, 0, "Failed to initialize SVC");
+	ret = gb_svc_wait_ready(K_SECONDS(5));
+	zassert_equal(ret, 0, "SVC handshake did not complete");
 
 	ret = greybus_service_init();
 	zassert_equal(ret, 0, "Failed to register greybus service");
@@ -145,3 +147,36 @@ ZTEST(greybus_standalone_tests, test_get_manifest_size)
 
 	gb_message_dealloc(msg.msg);
 }
+
+ZTEST(greybus_standalone_tests, test_get_manifest)
+{
+	int ret;
+	uint16_t op_id;
+	struct gb_msg_with_cport msg;
+	struct gb_message *req;
+	uint8_t expected[manifest_size()];
+
+	ret = manifest_create(expected, sizeof(expected));
+	zassert_equal(ret, sizeof(expected), "Failed to create manifest");
+
+	/* Response is cached after the first request. Ensure both answers are identical. */
+	for (int i = 0; i < 2; i++) {
+		req = gb_message_request_alloc(0, GB_CONTROL_TYPE_GET_MANIFEST, false);
+		op_id = req->header.operation_id;
+
+		ret = gb_apbridge_send(AP_INF_ID, 1, req);
+		zassert_equal(ret, 0, "Failed to send request to node");
+
+		ret = k_msgq_get(&rx_msgq, &msg, K_SECONDS(5));
+		zassert_equal(ret, 0, "Expected get manifest response, got nothing");
+		zassert_equal(gb_message_type(msg.msg), GB_RESPONSE(GB_CONTROL_TYPE_GET_MANIFEST),
+			      "Expected get manifest response");
+		zassert_equal(msg.msg->header.operation_id, op_id, "Invalid operation id");
+		zassert(gb_message_is_success(msg.msg), "get manifest request failed");
+		zassert_equal(gb_message_payload_len(msg.msg), sizeof(expected),
+			      "Unexpected payload length");
+		zassert_mem_equal(msg.msg->payload, expected, sizeof(expected), "Invalid manifest");
+
+		gb_message_dealloc(msg.msg);
+	}
+}
@@ -9,7 +9,138 @@
 #include <greybus/greybus.h>
 #include <greybus-utils/manifest.h>
 #include <greybus/greybus_log.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/apbridge.h>
+#include <greybus/svc.h>
 
 // struct gb_msg_with_cport gb_transport_get_message(void);
 
 ZTEST_SUITE(greybus_svc_tests, NULL, NULL, NULL, NULL, NULL);
+
+K_MSGQ_DEFINE(ap_msgq, sizeof(struct gb_message *), CONFIG_GREYBUS_SVC_HOTPLUG_QUEUE_DEPTH, 4);
+
+static int ap_write_cb(struct gb_interface *intf, struct gb_message *msg, uint16_t cport)
+{
+	ARG_UNUSED(intf);
+	ARG_UNUSED(cport);
+
+	return k_msgq_put(&ap_msgq, &msg, K_NO_WAIT);
+}
+
+/*
+ * Helper to take the next request sent to the AP and answer it
+ */
+static uint8_t ap_respond(void)
+{
+	struct gb_message *req, *resp;
+	uint8_t type;
+
+	zassert_ok(k_msgq_get(&ap_msgq, &req, K_SECONDS(1)), "SVC sent no request");
+	type = gb_message_type(req);
+
+	resp = gb_message_response_alloc(NULL, 0, type, req->header.operation_id, GB_OP_SUCCESS);
+	zassert_not_null(resp, "Failed to allocate response");
+	gb_message_dealloc(req);
+
+	zassert_ok(gb_apbridge_send(AP_INF_ID, 0, resp), "Failed to send response");
+
+	return type;
+}
+
+/*
+ * Helper to take the next request sent to the AP and drop it, as if its response was lost
+ */
+static uint8_t ap_drop(void)
+{
+	struct gb_message *req;
+	uint8_t type;
+
+	zassert_ok(k_msgq_get(&ap_msgq, &req, K_NO_WAIT), "SVC sent no request");
+	type = gb_message_type(req);
+	gb_message_dealloc(req);
+
+	return type;
+}
+
+ZTEST(greybus_svc_tests, test_hotplug_batch)
+{
+	int ret;
+	size_t i;
+	struct gb_interface ap_intf = {
+		.id = AP_INF_ID,
+		.write = ap_write_cb,
+	};
+	const size_t modules = CONFIG_GREYBUS_SVC_MAX_OPERATIONS + 2;
+
+	ret = gb_interface_add(&ap_intf);
+	zassert_equal(ret, 0, "Failed to add AP");
+
+	ret = gb_svc_init();
+	zassert_equal(ret, 0, "Failed to start SVC");
+
+	zassert_equal(ap_respond(), GB_SVC_TYPE_PROTOCOL_VERSION, "Expected version request");
+
+	/* Nothing goes out before the AP answered the hello */
+	for (i = 0; i < modules; i++) {
+		ret = gb_svc_send_module_inserted(INTF_START_ID + i, 1, 0);
+		zassert_equal(ret, 0, "Failed to queue module %zu", i);
+	}
+	zassert_equal(k_msgq_num_used_get(&ap_msgq), 1, "Only the hello should be sent");
+
+	zassert_equal(ap_respond(), GB_SVC_TYPE_SVC_HELLO, "Expected hello request");
+	zassert_ok(gb_svc_wait_ready(K_NO_WAIT), "SVC should be ready");
+
+	/* Then as many as allowed at once, each response letting the next one go */
+	zassert_equal(k_msgq_num_used_get(&ap_msgq), CONFIG_GREYBUS_SVC_MAX_OPERATIONS,
+		      "Module events should be sent in parallel");
+	for (i = 0; i < modules; i++) {
+		zassert_equal(ap_respond(), GB_SVC_TYPE_MODULE_INSERTED,
+			      "Expected module inserted request");
+	}
+	zassert_equal(k_msgq_num_used_get(&ap_msgq), 0, "No request should be left");
+
+	gb_svc_deinit();
+	gb_apbridge_deinit();
+	gb_interface_remove(AP_INF_ID);
+}
+
+ZTEST(greybus_svc_tests, test_hotplug_timeout)
+{
+	int ret;
+	size_t i;
+	struct gb_message *req;
+	struct gb_interface ap_intf = {
+		.id = AP_INF_ID,
+		.write = ap_write_cb,
+	};
+
+	ret = gb_interface_add(&ap_intf);
+	zassert_equal(ret, 0, "Failed to add AP");
+
+	ret = gb_svc_init();
+	zassert_equal(ret, 0, "Failed to start SVC");
+	zassert_equal(ap_respond(), GB_SVC_TYPE_PROTOCOL_VERSION, "Expected version request");
+	zassert_equal(ap_respond(), GB_SVC_TYPE_SVC_HELLO, "Expected hello request");
+
+	for (i = 0; i < CONFIG_GREYBUS_SVC_MAX_OPERATIONS + 1; i++) {
+		ret = gb_svc_send_module_inserted(INTF_START_ID + i, 1, 0);
+		zassert_equal(ret, 0, "Failed to queue module %zu", i);
+	}
+
+	/* None of these get a response */
+	for (i = 0; i < CONFIG_GREYBUS_SVC_MAX_OPERATIONS; i++) {
+		zassert_equal(ap_drop(), GB_SVC_TYPE_MODULE_INSERTED,
+			      "Expected module inserted request");
+	}
+	zassert_not_equal(k_msgq_get(&ap_msgq, &req, K_NO_WAIT), 0,
+			  "No operation should be free");
+
+	/* Their operations time out, which lets the last event go */
+	zassert_equal(ap_respond(), GB_SVC_TYPE_MODULE_INSERTED,
+		      "Timed out operations were not freed");
+	zassert_equal(k_msgq_num_used_get(&ap_msgq), 0, "No request should be left");
+
+	gb_svc_deinit();
+	gb_apbridge_deinit();
+	gb_interface_remove(AP_INF_ID);
+}
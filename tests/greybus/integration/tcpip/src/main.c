@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/ztest.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/byteorder.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/service.h>
+
+#define GB_TCPIP_PORT 4242
+#define LOOPBACK_PORT 1
+
+/* More than the transmission queue holds */
+#define PINGS 32
+
+/* Every message on the stream is prefixed by its cport */
+struct tcpip_msg {
+	__le16 cport;
+	struct gb_operation_msg_hdr hdr;
+} __packed;
+
+static int sock;
+
+static void *greybus_tcpip_tests_setup(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(GB_TCPIP_PORT),
+	};
+
+	zassert_ok(greybus_service_wait(K_SECONDS(5)), "Greybus service failed to start");
+
+	sock = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	zassert_true(sock >= 0, "Failed to create socket");
+
+	zsock_inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	zassert_ok(zsock_connect(sock, (struct sockaddr *)&addr, sizeof(addr)),
+		   "Failed to connect socket");
+
+	return NULL;
+}
+
+ZTEST_SUITE(greybus_tcpip_tests, NULL, greybus_tcpip_tests_setup, NULL, NULL, NULL);
+
+/*
+ * Helper to receive exactly len bytes. Returns false if they did not arrive in time.
+ */
+static bool recv_all(void *buf, size_t len)
+{
+	size_t received = 0;
+	ssize_t ret;
+	struct zsock_pollfd fds = {
+		.fd = sock,
+		.events = ZSOCK_POLLIN,
+	};
+
+	while (received < len) {
+		if (zsock_poll(&fds, 1, 1000) <= 0) {
+			return false;
+		}
+
+		ret = zsock_recv(sock, (uint8_t *)buf + received, len - received, 0);
+		if (ret <= 0) {
+			return false;
+		}
+		received += ret;
+	}
+
+	return true;
+}
+
+ZTEST(greybus_tcpip_tests, test_pipelined_pings)
+{
+	static struct tcpip_msg reqs[PINGS];
+	struct tcpip_msg resp;
+
+	for (size_t i = 0; i < PINGS; i++) {
+		reqs[i] = (struct tcpip_msg){
+			.cport = sys_cpu_to_le16(LOOPBACK_PORT),
+			.hdr = {
+				.size = sys_cpu_to_le16(sizeof(reqs[i].hdr)),
+				.operation_id = sys_cpu_to_le16(i + 1),
+				.type = GB_LOOPBACK_TYPE_PING,
+			},
+		};
+	}
+
+	/* All responses are pending at once, with aggregation they are flushed as one batch */
+	zassert_equal(zsock_send(sock, reqs, sizeof(reqs), 0), sizeof(reqs),
+		      "Failed to send requests");
+
+	for (size_t i = 0; i < PINGS; i++) {
+		zassert_true(recv_all(&resp, sizeof(resp)), "Response %zu missing", i);
+		zassert_equal(sys_le16_to_cpu(resp.cport), LOOPBACK_PORT, "Invalid cport");
+		zassert_equal(resp.hdr.type, GB_RESPONSE(GB_LOOPBACK_TYPE_PING),
+			      "Invalid response type");
+		zassert_equal(resp.hdr.result, GB_OP_SUCCESS, "Ping failed");
+		zassert_equal(sys_le16_to_cpu(resp.hdr.operation_id), i + 1,
+			      "Responses out of order");
+	}
+}
@@ -50,6 +50,7 @@ ZTEST(greybus_uart_tests, test_cport_count)
 ZTEST(greybus_uart_tests, test_send_data)
 {
 	int i, ret;
+	size_t credits = 0;
 	uint8_t buf[TX_DATA_SIZE];
 	struct gb_msg_with_cport resp;
 	struct gb_uart_send_data_request *req_data;
@@ -74,18 +75,21 @@ ZTEST(greybus_uart_tests, test_send_data)
 
 	gb_message_dealloc(resp.msg);
 
-	/* Handle receive credits request */
-	resp = gb_transport_get_message();
-	zassert_equal(resp.cport, 1, "Invalid cport");
-	zassert_equal(gb_message_type(resp.msg), GB_UART_TYPE_RECEIVE_CREDITS,
-		      "Invalid response type");
-	zassert_equal(gb_message_payload_len(resp.msg), sizeof(*req_credits_data),
-		      "Invalid response size");
-	req_credits_data = (const struct gb_uart_receive_credits_request *)resp.msg->payload;
-	zassert_equal(sys_le16_to_cpu(req_credits_data->count), TX_DATA_SIZE,
-		      "Invalid receive credits request");
+	/* Credits are returned as data drains, possibly over several requests */
+	while (credits < TX_DATA_SIZE) {
+		resp = gb_transport_get_message();
+		zassert_equal(resp.cport, 1, "Invalid cport");
+		zassert_equal(gb_message_type(resp.msg), GB_UART_TYPE_RECEIVE_CREDITS,
+			      "Invalid response type");
+		zassert_equal(gb_message_payload_len(resp.msg), sizeof(*req_credits_data),
+			      "Invalid response size");
+		req_credits_data =
+			(const struct gb_uart_receive_credits_request *)resp.msg->payload;
+		credits += sys_le16_to_cpu(req_credits_data->count);
 
-	gb_message_dealloc(resp.msg);
+		gb_message_dealloc(resp.msg);
+	}
+	zassert_equal(credits, TX_DATA_SIZE, "Invalid receive credits request");
 
 	ret = uart_emul_get_tx_data(dev, buf, ARRAY_SIZE(buf));
 	zassert_equal(ret, TX_DATA_SIZE, "Invalid tx data");
@@ -137,3 +141,49 @@ ZTEST(greybus_uart_tests, test_receive_data)
 		zassert_equal(buf[i], i, "Invalid tx data");
 	}
 }
+
+ZTEST(greybus_uart_tests, test_set_line_coding_rts_cts)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_uart_set_line_coding_request *req_data;
+	struct gb_message *req = gb_message_request_alloc(sizeof(*req_data),
+							  GB_UART_TYPE_SET_LINE_CODING, false);
+
+	req_data = (struct gb_uart_set_line_coding_request *)req->payload;
+	req_data->rate = sys_cpu_to_le32(115200);
+	req_data->format = GB_SERIAL_1_STOP_BITS;
+	req_data->parity = GB_SERIAL_NO_PARITY;
+	req_data->data_bits = 8;
+	req_data->flow_control = GB_SERIAL_AUTO_RTSCTS_EN;
+
+	greybus_rx_handler(1, req);
+	resp = gb_transport_get_message();
+
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(GB_UART_TYPE_SET_LINE_CODING),
+		      "Invalid response type");
+	zassert(gb_message_is_success(resp.msg), "RTS/CTS flow control rejected");
+
+	gb_message_dealloc(resp.msg);
+}
+
+ZTEST(greybus_uart_tests, test_flush_fifos)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_uart_serial_flush_request *req_data;
+	struct gb_message *req =
+		gb_message_request_alloc(sizeof(*req_data), GB_UART_TYPE_FLUSH_FIFOS, false);
+
+	req_data = (struct gb_uart_serial_flush_request *)req->payload;
+	req_data->flags = GB_SERIAL_FLAG_FLUSH_TRANSMITTER | GB_SERIAL_FLAG_FLUSH_RECEIVER;
+
+	greybus_rx_handler(1, req);
+	resp = gb_transport_get_message();
+
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(GB_UART_TYPE_FLUSH_FIFOS),
+		      "Invalid response type");
+	zassert(gb_message_is_success(resp.msg), "Flush request failed");
+
+	gb_message_dealloc(resp.msg);
+}
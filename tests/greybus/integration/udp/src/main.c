@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <zephyr/ztest.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/byteorder.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/service.h>
+
+#define GB_UDP_PORT   4242
+#define LOOPBACK_PORT 1
+
+/* Same layout as struct gb_udp_hdr of the transport */
+struct udp_hdr {
+	__le16 cport;
+	__le16 seq;
+	__le16 size;
+	__le16 offset;
+	uint8_t frag;
+	uint8_t frags;
+} __packed;
+
+#define FRAG_SIZE (CONFIG_GREYBUS_UDP_MTU - sizeof(struct udp_hdr))
+
+/* Sink request of three fragments */
+#define MSG_SIZE  (2 * FRAG_SIZE + 12)
+#define MSG_FRAGS 3
+
+static int sock;
+static uint8_t msg_buf[MSG_SIZE];
+
+static void *greybus_udp_tests_setup(void)
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(GB_UDP_PORT),
+	};
+
+	zassert_ok(greybus_service_wait(K_SECONDS(5)), "Greybus service failed to start");
+
+	sock = zsock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	zassert_true(sock >= 0, "Failed to create socket");
+
+	zsock_inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+	zassert_ok(zsock_connect(sock, (struct sockaddr *)&addr, sizeof(addr)),
+		   "Failed to connect socket");
+
+	return NULL;
+}
+
+ZTEST_SUITE(greybus_udp_tests, NULL, greybus_udp_tests_setup, NULL, NULL, NULL);
+
+/*
+ * Helper to build a sink request in msg_buf
+ */
+static void sink_request_build(uint16_t operation_id)
+{
+	struct gb_operation_msg_hdr *hdr = (struct gb_operation_msg_hdr *)msg_buf;
+	struct gb_loopback_transfer_request *req = (struct gb_loopback_transfer_request *)&hdr[1];
+	const size_t len = MSG_SIZE - sizeof(*hdr) - sizeof(*req);
+
+	memset(msg_buf, 0, sizeof(msg_buf));
+	hdr->size = sys_cpu_to_le16(MSG_SIZE);
+	hdr->operation_id = sys_cpu_to_le16(operation_id);
+	hdr->type = GB_LOOPBACK_TYPE_SINK;
+	req->len = sys_cpu_to_le32(len);
+	memset(req->data, 0xa5, len);
+}
+
+/*
+ * Helper to send part of msg_buf as one datagram
+ */
+static void frag_send(uint16_t seq, uint8_t frag, uint8_t frags, size_t offset, size_t len)
+{
+	uint8_t buf[CONFIG_GREYBUS_UDP_MTU];
+	const struct udp_hdr hdr = {
+		.cport = sys_cpu_to_le16(LOOPBACK_PORT),
+		.seq = sys_cpu_to_le16(seq),
+		.size = sys_cpu_to_le16(MSG_SIZE),
+		.offset = sys_cpu_to_le16(offset),
+		.frag = frag,
+		.frags = frags,
+	};
+
+	memcpy(buf, &hdr, sizeof(hdr));
+	memcpy(buf + sizeof(hdr), msg_buf + offset, len);
+	zassert_equal(zsock_send(sock, buf, sizeof(hdr) + len, 0), sizeof(hdr) + len,
+		      "Failed to send fragment");
+}
+
+/*
+ * Helper to send one fragment as the transport lays them out
+ */
+static void frag_send_valid(uint16_t seq, uint8_t frag)
+{
+	const size_t offset = frag * FRAG_SIZE;
+
+	frag_send(seq, frag, MSG_FRAGS, offset, MIN(FRAG_SIZE, MSG_SIZE - offset));
+}
+
+/*
+ * Helper to wait for the sink response. Returns false if none arrived.
+ */
+static bool sink_response_recv(uint16_t operation_id)
+{
+	uint8_t buf[CONFIG_GREYBUS_UDP_MTU];
+	struct gb_operation_msg_hdr gb_hdr;
+	struct zsock_pollfd fds = {
+		.fd = sock,
+		.events = ZSOCK_POLLIN,
+	};
+	ssize_t ret;
+
+	if (zsock_poll(&fds, 1, 200) <= 0) {
+		return false;
+	}
+
+	ret = zsock_recv(sock, buf, sizeof(buf), 0);
+	zassert_equal(ret, sizeof(struct udp_hdr) + sizeof(gb_hdr), "Invalid response size");
+
+	memcpy(&gb_hdr, buf + sizeof(struct udp_hdr), sizeof(gb_hdr));
+	zassert_equal(gb_hdr.type, GB_RESPONSE(GB_LOOPBACK_TYPE_SINK), "Invalid response type");
+	zassert_equal(sys_le16_to_cpu(gb_hdr.operation_id), operation_id, "Invalid operation id");
+	zassert_equal(gb_hdr.result, GB_OP_SUCCESS, "Sink request failed");
+
+	return true;
+}
+
+ZTEST(greybus_udp_tests, test_in_order)
+{
+	sink_request_build(1);
+	for (uint8_t i = 0; i < MSG_FRAGS; i++) {
+		frag_send_valid(1, i);
+	}
+
+	zassert_true(sink_response_recv(1), "No response to complete message");
+}
+
+ZTEST(greybus_udp_tests, test_out_of_order)
+{
+	sink_request_build(2);
+	frag_send_valid(2, 2);
+	frag_send_valid(2, 0);
+	zassert_false(sink_response_recv(2), "Response to incomplete message");
+
+	frag_send_valid(2, 1);
+	zassert_true(sink_response_recv(2), "No response to complete message");
+}
+
+ZTEST(greybus_udp_tests, test_duplicate)
+{
+	sink_request_build(3);
+	frag_send_valid(3, 0);
+	frag_send_valid(3, 0);
+	frag_send_valid(3, 1);
+	frag_send_valid(3, 1);
+	zassert_false(sink_response_recv(3), "Duplicates completed the message");
+
+	frag_send_valid(3, 2);
+	zassert_true(sink_response_recv(3), "No response to complete message");
+	zassert_false(sink_response_recv(3), "Message handled twice");
+}
+
+ZTEST(greybus_udp_tests, test_overlap)
+{
+	sink_request_build(4);
+	frag_send_valid(4, 0);
+	/* Second fragment shifted back into the first one */
+	frag_send(4, 1, MSG_FRAGS, FRAG_SIZE - 8, FRAG_SIZE);
+	frag_send_valid(4, 2);
+	zassert_false(sink_response_recv(4), "Overlapping fragment accepted");
+
+	/* A short fragment that is not the last one would leave a hole */
+	frag_send(4, 1, MSG_FRAGS, FRAG_SIZE, FRAG_SIZE - 8);
+	zassert_false(sink_response_recv(4), "Short fragment accepted");
+
+	frag_send_valid(4, 1);
+	zassert_true(sink_response_recv(4), "No response to complete message");
+}
+
+ZTEST(greybus_udp_tests, test_frags_mismatch)
+{
+	sink_request_build(5);
+	frag_send_valid(5, 0);
+	/* Valid on its own, but the message was started with a different fragment count */
+	frag_send(5, 1, MSG_FRAGS + 1, FRAG_SIZE, FRAG_SIZE);
+	frag_send_valid(5, 2);
+	zassert_false(sink_response_recv(5), "Fragment count mismatch accepted");
+
+	frag_send_valid(5, 1);
+	zassert_true(sink_response_recv(5), "No response to complete message");
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/ztest.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_messages.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus-utils/manifest.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/usb/usb_ch9.h>
+
+#define USB_CPORT 1
+
+/* Root hub requests, (bmRequestType << 8) | bRequest */
+#define HUB_SET_PORT_FEATURE 0x2303
+#define HUB_GET_DESCRIPTOR   0xa006
+#define HUB_GET_PORT_STATUS  0xa300
+
+#define HUB_DESC_TYPE   0x29
+#define PORT_FEAT_POWER 8
+#define PORT_STAT_POWER BIT(8)
+
+/* Largest IN URB whose completion fits in a single completion request */
+#define URB_IN_MAX                                                                                 \
+	(CONFIG_GREYBUS_USB_COMPLETE_SIZE - sizeof(struct gb_usb_urb_complete_request) -          \
+	 sizeof(struct gb_usb_urb_completion))
+
+struct urb_submit_request {
+	struct gb_usb_urb_submit_request req;
+	struct gb_usb_urb urb;
+	uint8_t data[8];
+} __packed;
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+
+/*
+ * Helper to send a request. Returns the response, which the caller frees.
+ */
+static struct gb_message *usb_request(uint8_t type, const void *payload, size_t len)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_message *req = gb_message_request_alloc(len, type, false);
+
+	zassert_not_null(req, "Failed to allocate request");
+	if (len) {
+		memcpy(req->payload, payload, len);
+	}
+	greybus_rx_handler(USB_CPORT, req);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, USB_CPORT, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg), GB_RESPONSE(type), "Invalid response type");
+
+	return resp.msg;
+}
+
+/*
+ * Helper to send a request. Returns the result of the response.
+ */
+static uint8_t usb_request_result(uint8_t type, const void *payload, size_t len)
+{
+	struct gb_message *resp = usb_request(type, payload, len);
+	const uint8_t result = resp->header.result;
+
+	gb_message_dealloc(resp);
+
+	return result;
+}
+
+static struct gb_message *hub_control(uint16_t type_req, uint16_t value, uint16_t index,
+				      uint16_t length)
+{
+	const struct gb_usb_hub_control_request req_data = {
+		.typeReq = sys_cpu_to_le16(type_req),
+		.wValue = sys_cpu_to_le16(value),
+		.wIndex = sys_cpu_to_le16(index),
+		.wLength = sys_cpu_to_le16(length),
+	};
+
+	return usb_request(GB_USB_TYPE_HUB_CONTROL, &req_data, sizeof(req_data));
+}
+
+static uint16_t hub_port_status(void)
+{
+	struct gb_message *resp = hub_control(HUB_GET_PORT_STATUS, 0, 1, 4);
+	uint16_t status;
+
+	zassert_true(gb_message_is_success(resp), "Failed to get port status");
+	zassert_equal(gb_message_payload_len(resp), 4, "Invalid port status size");
+	status = sys_get_le16(resp->payload);
+	gb_message_dealloc(resp);
+
+	return status;
+}
+
+static void urb_init(struct urb_submit_request *req_data, uint8_t ep, uint16_t length)
+{
+	*req_data = (struct urb_submit_request){
+		.req = {
+			.count = 1,
+		},
+		.urb = {
+			.id = sys_cpu_to_le16(1),
+			.devnum = 1,
+			.ep = ep,
+			.type = GB_USB_URB_TYPE_BULK,
+			.mps = sys_cpu_to_le16(64),
+			.length = sys_cpu_to_le16(length),
+		},
+	};
+}
+
+static void *usb_setup(void)
+{
+	zassert_equal(usb_request_result(GB_USB_TYPE_HCD_STOP, NULL, 0), GB_OP_SUCCESS,
+		      "Failed to stop controller");
+
+	return NULL;
+}
+
+ZTEST_SUITE(greybus_usb_tests, NULL, usb_setup, NULL, NULL, NULL);
+
+ZTEST(greybus_usb_tests, test_cport_count)
+{
+	zassert_equal(GREYBUS_CPORT_COUNT, 2, "Invalid number of cports");
+}
+
+ZTEST(greybus_usb_tests, test_malformed_requests)
+{
+	struct urb_submit_request urb;
+	const uint8_t hub_short[4] = {0};
+	const uint8_t dequeue_short[1] = {0};
+	struct gb_message *resp;
+
+	zassert_equal(usb_request_result(GB_USB_TYPE_HUB_CONTROL, hub_short, sizeof(hub_short)),
+		      GB_OP_INVALID, "Short hub request accepted");
+
+	resp = hub_control(HUB_GET_PORT_STATUS, 0, 2, 4);
+	zassert_equal(resp->header.result, GB_OP_INVALID, "Missing port accepted");
+	gb_message_dealloc(resp);
+
+	zassert_equal(usb_request_result(GB_USB_TYPE_VENDOR_URB_SUBMIT, NULL, 0), GB_OP_INVALID,
+		      "Empty submit accepted");
+
+	/* The URB announced by the count is missing */
+	urb_init(&urb, USB_EP_DIR_OUT | 1, 0);
+	zassert_equal(usb_request_result(GB_USB_TYPE_VENDOR_URB_SUBMIT, &urb, sizeof(urb.req)),
+		      GB_OP_INVALID, "Missing URB accepted");
+
+	/* More OUT data announced than carried */
+	urb_init(&urb, USB_EP_DIR_OUT | 1, sizeof(urb.data) + 1);
+	zassert_equal(usb_request_result(GB_USB_TYPE_VENDOR_URB_SUBMIT, &urb, sizeof(urb)),
+		      GB_OP_INVALID, "Short OUT data accepted");
+
+	/* The completion of the IN URB would not fit in a completion request */
+	urb_init(&urb, USB_EP_DIR_IN | 1, URB_IN_MAX + 1);
+	zassert_equal(usb_request_result(GB_USB_TYPE_VENDOR_URB_SUBMIT, &urb,
+					 offsetof(struct urb_submit_request, data)),
+		      GB_OP_INVALID, "Oversized IN URB accepted");
+
+	/* Well formed, but the controller is not started */
+	urb_init(&urb, USB_EP_DIR_OUT | 1, sizeof(urb.data));
+	zassert_equal(usb_request_result(GB_USB_TYPE_VENDOR_URB_SUBMIT, &urb, sizeof(urb)),
+		      GB_OP_INVALID, "URB accepted while stopped");
+
+	zassert_equal(usb_request_result(GB_USB_TYPE_VENDOR_URB_DEQUEUE, dequeue_short,
+					 sizeof(dequeue_short)),
+		      GB_OP_INVALID, "Short dequeue accepted");
+
+	zassert_equal(usb_request_result(0x7f, NULL, 0), GB_OP_INVALID, "Unknown type accepted");
+}
+
+ZTEST(greybus_usb_tests, test_root_hub)
+{
+	struct gb_message *resp;
+
+	zassert_equal(usb_request_result(GB_USB_TYPE_HCD_START, NULL, 0), GB_OP_SUCCESS,
+		      "Failed to start controller");
+
+	resp = hub_control(HUB_GET_DESCRIPTOR, HUB_DESC_TYPE << 8, 0, 64);
+	zassert_true(gb_message_is_success(resp), "Failed to get hub descriptor");
+	zassert_equal(gb_message_payload_len(resp), 9, "Invalid hub descriptor size");
+	zassert_equal(resp->payload[1], HUB_DESC_TYPE, "Invalid descriptor type");
+	zassert_equal(resp->payload[2], 1, "Invalid number of ports");
+	gb_message_dealloc(resp);
+
+	/* The response is cut to wLength */
+	resp = hub_control(HUB_GET_DESCRIPTOR, HUB_DESC_TYPE << 8, 0, 2);
+	zassert_equal(gb_message_payload_len(resp), 2, "Descriptor not cut to wLength");
+	gb_message_dealloc(resp);
+
+	zassert_false(hub_port_status() & PORT_STAT_POWER, "Port powered before request");
+	resp = hub_control(HUB_SET_PORT_FEATURE, PORT_FEAT_POWER, 1, 0);
+	zassert_true(gb_message_is_success(resp), "Failed to power the port");
+	gb_message_dealloc(resp);
+	zassert_true(hub_port_status() & PORT_STAT_POWER, "Port not powered");
+
+	zassert_equal(usb_request_result(GB_USB_TYPE_HCD_STOP, NULL, 0), GB_OP_SUCCESS,
+		      "Failed to stop controller");
+	zassert_false(hub_port_status() & PORT_STAT_POWER, "Port still powered after stop");
+}
@@ -9,8 +9,10 @@
 #include <greybus/greybus.h>
 #include <greybus-utils/manifest.h>
 #include <greybus/greybus_log.h>
+#include <greybus/greybus_protocols.h>
+#include <zephyr/sys/byteorder.h>
 
-// struct gb_msg_with_cport gb_transport_get_message(void);
+struct gb_msg_with_cport gb_transport_get_message(void);
 
 ZTEST_SUITE(greybus_vibrator_tests, NULL, NULL, NULL, NULL, NULL);
 
@@ -18,3 +20,55 @@ ZTEST(greybus_vibrator_tests, test_cport_count)
 {
 	zassert_equal(GREYBUS_CPORT_COUNT, 2, "Invalid number of cports");
 }
+
+static uint8_t pattern_upload(uint8_t count)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_vibrator_pattern_upload_request *req_data;
+	struct gb_message *msg;
+	uint8_t result;
+	size_t i;
+
+	msg = gb_message_request_alloc(sizeof(*req_data) + count * sizeof(req_data->steps[0]),
+				       GB_VIBRATOR_TYPE_VENDOR_PATTERN_UPLOAD, false);
+	req_data = (struct gb_vibrator_pattern_upload_request *)msg->payload;
+	req_data->repeat = 0;
+	req_data->count = count;
+	for (i = 0; i < count; i++) {
+		req_data->steps[i].on_ms = sys_cpu_to_le16(10);
+		req_data->steps[i].off_ms = sys_cpu_to_le16(20);
+	}
+	greybus_rx_handler(1, msg);
+
+	resp = gb_transport_get_message();
+	zassert_equal(resp.cport, 1, "Invalid cport");
+	zassert_equal(gb_message_type(resp.msg),
+		      GB_RESPONSE(GB_VIBRATOR_TYPE_VENDOR_PATTERN_UPLOAD), "Invalid response type");
+	result = resp.msg->header.result;
+	gb_message_dealloc(resp.msg);
+
+	return result;
+}
+
+ZTEST(greybus_vibrator_tests, test_pattern_upload)
+{
+	struct gb_msg_with_cport resp;
+	struct gb_control_connected_request *conn_data;
+	struct gb_message *msg;
+
+	Z_TEST_SKIP_IFNDEF(CONFIG_GREYBUS_VIBRATOR_PATTERN);
+
+	msg = gb_message_request_alloc(sizeof(*conn_data), GB_CONTROL_TYPE_CONNECTED, false);
+	conn_data = (struct gb_control_connected_request *)msg->payload;
+	conn_data->cport_id = sys_cpu_to_le16(1);
+	greybus_rx_handler(0, msg);
+	resp = gb_transport_get_message();
+	zassert(gb_message_is_success(resp.msg), "Failed to connect cport");
+	gb_message_dealloc(resp.msg);
+
+	zassert_equal(pattern_upload(0), GB_OP_INVALID, "Empty pattern accepted");
+	zassert_equal(pattern_upload(CONFIG_GREYBUS_VIBRATOR_PATTERN_STEPS + 1), GB_OP_INVALID,
+		      "Oversized pattern accepted");
+	zassert_equal(pattern_upload(CONFIG_GREYBUS_VIBRATOR_PATTERN_STEPS), GB_OP_SUCCESS,
+		      "Failed to upload pattern");
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+# Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+# SPDX-License-Identifier: Apache-2.0
+
+"""Generate the synthetic sessions replayed by the test.
+
+Writes pcapng files in the format of the node capture (CONFIG_GREYBUS_CAPTURE), with requests from
+the AP only, for the cport layout of tests/greybus/replay. Recordings of real sessions taken with
+gb_capture_drain() go next to them.
+"""
+
+import pathlib
+import struct
+
+LINKTYPE_USER0 = 147
+SNAPLEN = 0xFFFF
+
+GB_HDR = struct.Struct("<HHBBxx")
+GB_CAPTURE_HDR = struct.Struct("<HBx")
+GB_CAPTURE_DIR_RX = 0
+
+CONTROL_CPORT = 0
+GPIO_CPORT = 3
+I2C_CPORT = 4
+
+GB_CONTROL_TYPE_VERSION = 0x01
+GB_CONTROL_TYPE_GET_MANIFEST_SIZE = 0x03
+GB_CONTROL_TYPE_GET_MANIFEST = 0x04
+GB_CONTROL_TYPE_CONNECTED = 0x05
+
+GB_GPIO_TYPE_LINE_COUNT = 0x02
+GB_GPIO_TYPE_DIRECTION_OUT = 0x07
+GB_GPIO_TYPE_GET_VALUE = 0x08
+GB_GPIO_TYPE_SET_VALUE = 0x09
+
+GB_I2C_TYPE_FUNCTIONALITY = 0x02
+GB_I2C_TYPE_TRANSFER = 0x05
+I2C_ADDR = 0x01
+
+
+def block(block_type, body):
+    pad = b"\0" * (-len(body) % 4)
+    length = 12 + len(body) + len(pad)
+    return struct.pack("<II", block_type, length) + body + pad + struct.pack("<I", length)
+
+
+def header():
+    shb = block(0x0A0D0D0A, struct.pack("<IHHq", 0x1A2B3C4D, 1, 0, -1))
+    # if_tsresol of 9, nanoseconds
+    options = struct.pack("<HHB3x", 9, 1, 9) + struct.pack("<HH", 0, 0)
+    idb = block(0x00000001, struct.pack("<HxxI", LINKTYPE_USER0, SNAPLEN) + options)
+    return shb + idb
+
+
+class Session:
+    def __init__(self):
+        self.time_ns = 0
+        self.operation_id = 0
+        self.blocks = []
+
+    def request(self, delay_us, cport, msg_type, payload=b""):
+        self.time_ns += delay_us * 1000
+        self.operation_id = self.operation_id % 0xFFFF + 1
+        data = (
+            GB_CAPTURE_HDR.pack(cport, GB_CAPTURE_DIR_RX)
+            + GB_HDR.pack(GB_HDR.size + len(payload), self.operation_id, msg_type, 0)
+            + payload
+        )
+        epb = struct.pack(
+            "<IIIII", 0, self.time_ns >> 32, self.time_ns & 0xFFFFFFFF, len(data), len(data)
+        )
+        self.blocks.append(block(0x00000006, epb + data))
+
+    def write(self, path):
+        path.write_bytes(header() + b"".join(self.blocks))
+
+
+def enumeration():
+    """What the AP does when the node shows up"""
+    s = Session()
+    s.request(0, CONTROL_CPORT, GB_CONTROL_TYPE_VERSION, struct.pack("<BB", 0, 1))
+    s.request(400, CONTROL_CPORT, GB_CONTROL_TYPE_GET_MANIFEST_SIZE)
+    s.request(300, CONTROL_CPORT, GB_CONTROL_TYPE_GET_MANIFEST)
+    for cport in range(1, I2C_CPORT + 1):
+        s.request(1500, CONTROL_CPORT, GB_CONTROL_TYPE_CONNECTED, struct.pack("<H", cport))
+    s.request(800, GPIO_CPORT, GB_GPIO_TYPE_LINE_COUNT)
+    s.request(200, I2C_CPORT, GB_I2C_TYPE_FUNCTIONALITY)
+    return s
+
+
+def gpio_storm():
+    """Bit banging from the AP, requests back to back with short pauses"""
+    s = Session()
+    s.request(0, GPIO_CPORT, GB_GPIO_TYPE_DIRECTION_OUT, struct.pack("<BB", 0, 0))
+    for i in range(512):
+        value = struct.pack("<BB", 0, i & 1)
+        s.request(15 + (i % 7) * 5, GPIO_CPORT, GB_GPIO_TYPE_SET_VALUE, value)
+        if i % 8 == 7:
+            s.request(10, GPIO_CPORT, GB_GPIO_TYPE_GET_VALUE, struct.pack("<B", 0))
+        if i % 64 == 63:
+            s.request(2000, GPIO_CPORT, GB_GPIO_TYPE_GET_VALUE, struct.pack("<B", 0))
+    return s
+
+
+def i2c_burst():
+    """Register dumps, bursts of transfers separated by idle time"""
+    s = Session()
+    for burst in range(16):
+        for i in range(16):
+            size = 4 << (i % 4)
+            payload = struct.pack("<HHHH", 1, I2C_ADDR, 0, size) + bytes(range(size))
+            s.request(5000 if i == 0 and burst else 50, I2C_CPORT, GB_I2C_TYPE_TRANSFER, payload)
+    return s
+
+
+def main():
+    here = pathlib.Path(__file__).parent
+    for session in (enumeration, gpio_storm, i2c_burst):
+        session().write(here / f"{session.__name__}.pcapng")
+
+
+if __name__ == "__main__":
+    main()
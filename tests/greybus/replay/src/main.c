@@ -0,0 +1,605 @@
+/*
+ * Copyright (c) 2025 Ayush Singh, BeagleBoard.org
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Replays recorded sessions into greybus_rx_handler(), at the recorded pace scaled by
+ * CONFIG_REPLAY_SPEEDUP or as fast as the node answers. Sessions are pcapng captures taken with
+ * CONFIG_GREYBUS_CAPTURE, only the requests from the AP are replayed. When the capture also holds
+ * the responses of the node, the results are checked against them.
+ *
+ * Each session prints a line per cport and operation type, and a summary
+ *
+ *   REPLAY:session=<name>,ops=<n>,avg_ns=<n>,max_ns=<n>,heap_peak=<n>
+ *
+ * which twister records through the regex in testcase.yaml. The summary is compared against the
+ * baselines in replay_sessions[].
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/device.h>
+#include <zephyr/timing/timing.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/sys/byteorder.h>
+#include <greybus/greybus.h>
+#include <greybus/greybus_capture.h>
+#include <greybus/greybus_messages.h>
+#include <greybus/greybus_protocols.h>
+#include <greybus/greybus_raw.h>
+#include <greybus-utils/manifest.h>
+
+/* Layout the sessions were recorded with, see sessions/gen_sessions.py */
+#define CONTROL_CPORT  0
+#define LOOPBACK_CPORT (GREYBUS_RAW_CPORT_START + GREYBUS_RAW_CPORT_COUNT)
+#define GPIO_CPORT     (LOOPBACK_CPORT + 1)
+#define I2C_CPORT      (LOOPBACK_CPORT + 2)
+#define I2C_ADDR       0x01
+
+/* Requests in flight at once, as a host would pipeline them */
+#define REPLAY_WINDOW  8
+#define REPLAY_MAX_OPS 32
+#define REPLAY_TIMEOUT K_SECONDS(5)
+
+#define PCAPNG_TYPE_SHB        0x0A0D0D0A
+#define PCAPNG_TYPE_IDB        0x00000001
+#define PCAPNG_TYPE_EPB        0x00000006
+#define PCAPNG_BYTE_ORDER      0x1A2B3C4D
+#define PCAPNG_OPT_END         0
+#define PCAPNG_OPT_IF_TSRESOL  9
+#define PCAPNG_LINKTYPE_USER0  147
+#define PCAPNG_LINKTYPE_USER15 162
+
+struct gb_msg_with_cport gb_transport_get_message(void);
+void gb_heap_stats_reset(void);
+
+#ifdef CONFIG_ARCH_POSIX
+/* Simulated time does not advance while code runs, see benchmarks/native/bench_host_clock.c */
+uint64_t bench_host_time_ns(void);
+#endif // CONFIG_ARCH_POSIX
+
+static const uint8_t enumeration_pcapng[] = {
+#include "enumeration.pcapng.inc"
+};
+
+static const uint8_t gpio_storm_pcapng[] = {
+#include "gpio_storm.pcapng.inc"
+};
+
+static const uint8_t i2c_burst_pcapng[] = {
+#include "i2c_burst.pcapng.inc"
+};
+
+/*
+ * struct replay_session: Recorded session and its baselines
+ *
+ * @name: name printed in the results
+ * @data: pcapng capture
+ * @len: size of the capture
+ * @heap_peak: highest greybus heap usage in bytes, 0 if not recorded yet
+ * @avg_ns: average request to response time, 0 if not recorded yet
+ */
+struct replay_session {
+	const char *name;
+	const uint8_t *data;
+	size_t len;
+	uint32_t heap_peak;
+	uint32_t avg_ns;
+};
+
+#define REPLAY_SESSION(_name)                                                                      \
+	{                                                                                          \
+		.name = #_name,                                                                    \
+		.data = _name##_pcapng,                                                            \
+		.len = sizeof(_name##_pcapng),                                                     \
+	}
+
+/* Baselines are taken from the REPLAY: line of a known good run */
+static const struct replay_session replay_sessions[] = {
+	REPLAY_SESSION(enumeration),
+	REPLAY_SESSION(gpio_storm),
+	REPLAY_SESSION(i2c_burst),
+};
+
+/*
+ * struct replay_packet: Packet of the capture
+ *
+ * @ts_ns: capture time
+ * @cport: cport of the message
+ * @direction: GB_CAPTURE_DIR_RX or GB_CAPTURE_DIR_TX
+ * @hdr: greybus header
+ * @msg: whole greybus message, hdr.size bytes
+ */
+struct replay_packet {
+	uint64_t ts_ns;
+	uint16_t cport;
+	uint8_t direction;
+	struct gb_operation_msg_hdr hdr;
+	const uint8_t *msg;
+};
+
+/*
+ * struct replay_reader: Position in a capture
+ *
+ * @data: pcapng capture
+ * @len: size of the capture
+ * @pos: offset of the next block
+ * @ns_per_ts: nanoseconds per timestamp unit of the interface
+ */
+struct replay_reader {
+	const uint8_t *data;
+	size_t len;
+	size_t pos;
+	uint32_t ns_per_ts;
+};
+
+struct replay_pending {
+	bool used;
+	uint16_t cport;
+	uint16_t operation_id;
+	uint8_t type;
+	/* Result the node gave in the recording, -1 if the recording has no response */
+	int16_t expected;
+	uint64_t start_ns;
+};
+
+struct replay_op_stats {
+	uint16_t cport;
+	uint8_t type;
+	uint32_t ops;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+/*
+ * struct replay_state: Replay of one session, shared with the response thread
+ *
+ * @lock: protects everything below
+ * @pending: requests waiting for their response
+ * @stats: latency of each cport and operation type
+ * @mismatches: responses with another result than in the recording
+ * @heap_peak: from the heap statistics response
+ * @window: free pending slots
+ * @heap_sem: given when the heap statistics response arrived
+ */
+struct replay_state {
+	struct k_spinlock lock;
+	struct replay_pending pending[REPLAY_WINDOW];
+	struct replay_op_stats stats[REPLAY_MAX_OPS];
+	uint32_t mismatches;
+	uint32_t heap_peak;
+	struct k_sem window;
+	struct k_sem heap_sem;
+};
+
+static struct replay_state state;
+
+static const struct device *i2c_dev = DEVICE_DT_GET(DT_NODELABEL(i2c0));
+
+static int i2c_emul_transfer(const struct emul *target, struct i2c_msg *msgs, int num_msgs,
+			     int addr)
+{
+	return 0;
+}
+
+static const struct i2c_emul_api i2c_api = {
+	.transfer = i2c_emul_transfer,
+};
+
+static const struct device i2c_target_dev = {
+	.name = "replay-dev",
+};
+
+static const struct emul i2c_target_emul = {
+	.dev = &i2c_target_dev,
+};
+
+static struct i2c_emul i2c_target = {
+	.addr = I2C_ADDR,
+	.api = &i2c_api,
+	.target = &i2c_target_emul,
+};
+
+static uint64_t replay_now_ns(void)
+{
+#ifdef CONFIG_ARCH_POSIX
+	return bench_host_time_ns();
+#else
+	return timing_cycles_to_ns(timing_counter_get());
+#endif // CONFIG_ARCH_POSIX
+}
+
+/* Helper to parse an interface description block */
+static int replay_idb(struct replay_reader *r, const uint8_t *b, uint32_t len)
+{
+	const uint16_t linktype = sys_get_le16(b + 8);
+	uint16_t code, olen;
+	uint8_t tsresol = 6;
+	uint32_t per_sec = 1;
+
+	if (linktype < PCAPNG_LINKTYPE_USER0 || linktype > PCAPNG_LINKTYPE_USER15) {
+		return -ENOTSUP;
+	}
+
+	for (size_t off = 16; off + 4 <= len - 4; off += 4 + ROUND_UP(olen, 4)) {
+		code = sys_get_le16(b + off);
+		olen = sys_get_le16(b + off + 2);
+		if (code == PCAPNG_OPT_END) {
+			break;
+		}
+		if (code == PCAPNG_OPT_IF_TSRESOL && olen == 1) {
+			tsresol = b[off + 4];
+		}
+	}
+
+	/* Only decimal resolutions down to nanoseconds */
+	if (tsresol > 9) {
+		return -ENOTSUP;
+	}
+
+	while (tsresol--) {
+		per_sec *= 10;
+	}
+	r->ns_per_ts = NSEC_PER_SEC / per_sec;
+
+	return 0;
+}
+
+/* Helper to parse an enhanced packet block */
+static int replay_epb(struct replay_reader *r, const uint8_t *b, uint32_t len,
+		      struct replay_packet *pkt)
+{
+	const uint64_t ts = ((uint64_t)sys_get_le32(b + 12) << 32) | sys_get_le32(b + 16);
+	const uint32_t cap_len = sys_get_le32(b + 20);
+	const uint32_t orig_len = sys_get_le32(b + 24);
+	const uint8_t *data = b + 28;
+	struct gb_capture_hdr capture;
+
+	if (cap_len > len - 32 || cap_len < sizeof(capture) + sizeof(pkt->hdr)) {
+		return -EINVAL;
+	}
+
+	if (cap_len != orig_len) {
+		/* Cannot be replayed, use a larger CONFIG_GREYBUS_CAPTURE_SNAPLEN */
+		return -E2BIG;
+	}
+
+	memcpy(&capture, data, sizeof(capture));
+	memcpy(&pkt->hdr, data + sizeof(capture), sizeof(pkt->hdr));
+	if (sys_le16_to_cpu(pkt->hdr.size) != cap_len - sizeof(capture)) {
+		return -EINVAL;
+	}
+
+	pkt->ts_ns = ts * r->ns_per_ts;
+	pkt->cport = sys_le16_to_cpu(capture.cport);
+	pkt->direction = capture.direction;
+	pkt->msg = data + sizeof(capture);
+
+	return 0;
+}
+
+/*
+ * Helper to get the next packet of the capture. Returns 1 with a packet, 0 at the end of the
+ * capture, or a negative error for a capture that cannot be replayed.
+ */
+static int replay_next(struct replay_reader *r, struct replay_packet *pkt)
+{
+	int ret = 0;
+	const uint8_t *b;
+	uint32_t type, len;
+
+	while (r->pos + 12 <= r->len) {
+		b = r->data + r->pos;
+		type = sys_get_le32(b);
+		len = sys_get_le32(b + 4);
+		if (len < 12 || len % 4 || len > r->len - r->pos) {
+			return -EINVAL;
+		}
+		r->pos += len;
+
+		switch (type) {
+		case PCAPNG_TYPE_SHB:
+			/* Captures are written in the byte order of the node */
+			ret = sys_get_le32(b + 8) == PCAPNG_BYTE_ORDER ? 0 : -ENOTSUP;
+			break;
+		case PCAPNG_TYPE_IDB:
+			ret = replay_idb(r, b, len);
+			break;
+		case PCAPNG_TYPE_EPB:
+			ret = replay_epb(r, b, len, pkt);
+			if (ret == 0) {
+				return 1;
+			}
+			break;
+		default:
+			break;
+		}
+
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/* Helper to find the result the node gave to a request in the recording */
+static int16_t replay_recorded_result(struct replay_reader r, const struct replay_packet *req)
+{
+	struct replay_packet pkt;
+
+	while (replay_next(&r, &pkt) == 1) {
+		if (pkt.cport != req->cport || pkt.hdr.operation_id != req->hdr.operation_id) {
+			continue;
+		}
+
+		if (pkt.direction == GB_CAPTURE_DIR_RX) {
+			/* The operation id is being reused, the request had no response */
+			break;
+		}
+
+		if (pkt.hdr.type == GB_RESPONSE(req->hdr.type)) {
+			return pkt.hdr.result;
+		}
+	}
+
+	return -1;
+}
+
+/* Helper to account for a response. Must be called with the lock held. */
+static void replay_op_done(uint16_t cport, uint8_t type, uint64_t ns)
+{
+	struct replay_op_stats *stats;
+
+	for (size_t i = 0; i < ARRAY_SIZE(state.stats); i++) {
+		stats = &state.stats[i];
+		if (stats->ops && (stats->cport != cport || stats->type != type)) {
+			continue;
+		}
+
+		stats->cport = cport;
+		stats->type = type;
+		stats->ops++;
+		stats->total_ns += ns;
+		stats->max_ns = MAX(stats->max_ns, ns);
+		return;
+	}
+}
+
+static void replay_response(uint16_t cport, const struct gb_message *msg)
+{
+	const uint64_t now = replay_now_ns();
+	const struct gb_control_heap_stats_response *heap;
+	struct replay_pending *pending;
+	k_spinlock_key_t key;
+
+	if (!gb_message_is_response(msg)) {
+		/* Requests of the node to the AP, nothing to measure */
+		return;
+	}
+
+	if (cport == CONTROL_CPORT &&
+	    gb_message_type(msg) == GB_RESPONSE(GB_CONTROL_TYPE_VENDOR_HEAP_STATS)) {
+		heap = (const struct gb_control_heap_stats_response *)msg->payload;
+		state.heap_peak = sys_le32_to_cpu(heap->peak_bytes);
+		k_sem_give(&state.heap_sem);
+		return;
+	}
+
+	key = k_spin_lock(&state.lock);
+
+	for (size_t i = 0; i < ARRAY_SIZE(state.pending); i++) {
+		pending = &state.pending[i];
+		if (!pending->used || pending->cport != cport ||
+		    pending->operation_id != msg->header.operation_id) {
+			continue;
+		}
+
+		replay_op_done(cport, pending->type, now - pending->start_ns);
+		if (pending->expected >= 0 && pending->expected != msg->header.result) {
+			state.mismatches++;
+		}
+		pending->used = false;
+		k_sem_give(&state.window);
+		break;
+	}
+
+	k_spin_unlock(&state.lock, key);
+}
+
+/* Takes the responses from the dummy transport while requests are being replayed */
+static void replay_response_thread(void *p1, void *p2, void *p3)
+{
+	struct gb_msg_with_cport resp;
+
+	while (true) {
+		resp = gb_transport_get_message();
+		replay_response(resp.cport, resp.msg);
+		gb_message_dealloc(resp.msg);
+	}
+}
+
+K_THREAD_DEFINE(replay_response_tid, 2048, replay_response_thread, NULL, NULL, NULL,
+		K_PRIO_COOP(1), 0, 0);
+
+/* Helper to hand a request to the node, waiting for room in the window first */
+static void replay_request(const struct replay_packet *pkt, int16_t expected)
+{
+	struct gb_message *msg;
+	struct replay_pending *pending = NULL;
+	k_spinlock_key_t key;
+
+	msg = gb_message_alloc(gb_hdr_payload_len(&pkt->hdr), pkt->hdr.type,
+			       pkt->hdr.operation_id, pkt->hdr.result);
+	zassert_not_null(msg, "Failed to allocate request");
+	memcpy(&msg->header, pkt->msg, sys_le16_to_cpu(pkt->hdr.size));
+
+	if (pkt->hdr.operation_id) {
+		zassert_ok(k_sem_take(&state.window, REPLAY_TIMEOUT), "Node stopped responding");
+
+		key = k_spin_lock(&state.lock);
+		for (size_t i = 0; i < ARRAY_SIZE(state.pending) && !pending; i++) {
+			if (!state.pending[i].used) {
+				pending = &state.pending[i];
+			}
+		}
+		*pending = (struct replay_pending){
+			.used = true,
+			.cport = pkt->cport,
+			.operation_id = pkt->hdr.operation_id,
+			.type = pkt->hdr.type,
+			.expected = expected,
+			.start_ns = replay_now_ns(),
+		};
+		k_spin_unlock(&state.lock, key);
+	}
+
+	zassert_ok(greybus_rx_handler(pkt->cport, msg), "Failed to replay request");
+}
+
+/* Helper to ask the node for its heap peak once everything was answered */
+static uint32_t replay_heap_peak(void)
+{
+	struct gb_message *req =
+		gb_message_request_alloc(0, GB_CONTROL_TYPE_VENDOR_HEAP_STATS, false);
+
+	zassert_not_null(req, "Failed to allocate request");
+	greybus_rx_handler(CONTROL_CPORT, req);
+	zassert_ok(k_sem_take(&state.heap_sem, REPLAY_TIMEOUT), "No heap statistics");
+
+	return state.heap_peak;
+}
+
+/* Helper to compare a measurement against its baseline */
+static void replay_check(const char *session, const char *what, uint64_t value,
+			 uint32_t baseline)
+{
+	if (!baseline) {
+		TC_PRINT("%s: no %s baseline, measured %llu\n", session, what,
+			 (unsigned long long)value);
+		return;
+	}
+
+	zassert_true(value <= baseline + (uint64_t)baseline * CONFIG_REPLAY_TOLERANCE_PERCENT / 100,
+		     "%s: %s of %llu regressed from %u", session, what, (unsigned long long)value,
+		     baseline);
+}
+
+static void replay_run(const char *name)
+{
+	int ret;
+	const struct replay_session *session = NULL;
+	struct replay_reader r;
+	struct replay_packet pkt;
+	struct replay_op_stats *stats;
+	uint64_t first_ts = 0, start_ns, total_ns = 0, max_ns = 0;
+	uint32_t ops = 0, heap_peak;
+	bool first = true;
+
+	for (size_t i = 0; i < ARRAY_SIZE(replay_sessions); i++) {
+		if (!strcmp(replay_sessions[i].name, name)) {
+			session = &replay_sessions[i];
+		}
+	}
+	zassert_not_null(session, "Unknown session %s", name);
+
+	memset(state.pending, 0, sizeof(state.pending));
+	memset(state.stats, 0, sizeof(state.stats));
+	state.mismatches = 0;
+	k_sem_init(&state.window, REPLAY_WINDOW, REPLAY_WINDOW);
+	k_sem_init(&state.heap_sem, 0, 1);
+
+	r = (struct replay_reader){
+		.data = session->data,
+		.len = session->len,
+		.ns_per_ts = NSEC_PER_USEC,
+	};
+
+	gb_heap_stats_reset();
+	start_ns = k_ticks_to_ns_ceil64(k_uptime_ticks());
+
+	while ((ret = replay_next(&r, &pkt)) == 1) {
+		if (pkt.direction != GB_CAPTURE_DIR_RX || (pkt.hdr.type & GB_TYPE_RESPONSE_FLAG)) {
+			continue;
+		}
+
+		if (first) {
+			first_ts = pkt.ts_ns;
+			first = false;
+		}
+
+		if (CONFIG_REPLAY_SPEEDUP) {
+			k_sleep(K_TIMEOUT_ABS_NS(start_ns +
+						 (pkt.ts_ns - first_ts) / CONFIG_REPLAY_SPEEDUP));
+		}
+
+		replay_request(&pkt, replay_recorded_result(r, &pkt));
+	}
+	zassert_equal(ret, 0, "Cannot replay %s: %d", name, ret);
+
+	/* Wait for the last responses */
+	for (size_t i = 0; i < REPLAY_WINDOW; i++) {
+		zassert_ok(k_sem_take(&state.window, REPLAY_TIMEOUT), "Node stopped responding");
+	}
+
+	heap_peak = replay_heap_peak();
+
+	for (size_t i = 0; i < ARRAY_SIZE(state.stats) && state.stats[i].ops; i++) {
+		stats = &state.stats[i];
+		TC_PRINT("REPLAY_OP:session=%s,cport=%u,type=0x%02x,ops=%u,"
+			 "avg_ns=%llu,max_ns=%llu\n",
+			 name, stats->cport, stats->type, stats->ops,
+			 (unsigned long long)(stats->total_ns / stats->ops),
+			 (unsigned long long)stats->max_ns);
+		ops += stats->ops;
+		total_ns += stats->total_ns;
+		max_ns = MAX(max_ns, stats->max_ns);
+	}
+
+	TC_PRINT("REPLAY:session=%s,ops=%u,avg_ns=%llu,max_ns=%llu,heap_peak=%u\n", name, ops,
+		 (unsigned long long)(ops ? total_ns / ops : 0), (unsigned long long)max_ns,
+		 heap_peak);
+
+	zassert_equal(state.mismatches, 0, "%s: %u results differ from the recording", name,
+		      state.mismatches);
+	replay_check(name, "heap peak", heap_peak, session->heap_peak);
+	if (IS_ENABLED(CONFIG_REPLAY_CHECK_LATENCY)) {
+		replay_check(name, "average latency", ops ? total_ns / ops : 0, session->avg_ns);
+	}
+}
+
+static void *replay_setup(void)
+{
+	zassert_equal(GREYBUS_CPORT_COUNT, I2C_CPORT + 1, "Unexpected cport layout");
+
+	timing_init();
+	timing_start();
+
+	zassert_ok(i2c_emul_register(i2c_dev, &i2c_target), "Failed to register i2c target");
+
+	return NULL;
+}
+
+static void replay_teardown(void *fixture)
+{
+	timing_stop();
+}
+
+ZTEST_SUITE(greybus_replay, NULL, replay_setup, NULL, NULL, replay_teardown);
+
+ZTEST(greybus_replay, test_enumeration)
+{
+	replay_run("enumeration");
+}
+
+ZTEST(greybus_replay, test_gpio_storm)
+{
+	replay_run("gpio_storm");
+}
+
+ZTEST(greybus_replay, test_i2c_burst)
+{
+	replay_run("i2c_burst");
+}